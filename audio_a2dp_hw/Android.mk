@@ -16,7 +16,7 @@ LOCAL_C_INCLUDES += \
 LOCAL_MODULE := audio.a2dp.default
 LOCAL_MODULE_RELATIVE_PATH := hw
 
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SHARED_LIBRARIES := liblog libcutils
 LOCAL_STATIC_LIBRARIES := libosi
 
 LOCAL_MODULE_TAGS := optional
@@ -58,6 +58,8 @@
 #include "osi/include/hash_map_utils.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
+#include "osi/include/properties.h"
+#include "osi/include/shm_ring.h"
 #include "osi/include/socket_utils/sockets.h"
 
 #include <dlfcn.h>
@@ -164,6 +166,7 @@ static const char* dump_a2dp_ctrl_event(char event)
         CASE_RETURN_STR(A2DP_CTRL_CMD_CHECK_STREAM_STARTED)
         CASE_RETURN_STR(A2DP_CTRL_CMD_OFFLOAD_SUPPORTED)
         CASE_RETURN_STR(A2DP_CTRL_CMD_OFFLOAD_NOT_SUPPORTED)
+        CASE_RETURN_STR(A2DP_CTRL_CMD_SHM_RING_SETUP)
         default:
             return "UNKNOWN MSG ID";
     }
@@ -199,6 +202,30 @@ static void ts_error_log(char *tag, int val, int buff_size, struct a2dp_config c
     }
 }
 
+/*****************************************************************************
+**
+**   shared memory audio ring
+**
+*****************************************************************************/
+
+static void a2dp_release_shm_ring(struct a2dp_stream_common *common)
+{
+    if (common->shm_ring == NULL)
+        return;
+
+    /* out_write copies into the ring without holding the lock; let it drop
+       the ring when it is done. The stack closing its side wakes it up. */
+    if (common->shm_ring_busy) {
+        common->shm_ring_stale = true;
+        return;
+    }
+
+    INFO("releasing shared memory ring");
+    shm_ring_free(common->shm_ring);
+    common->shm_ring = NULL;
+    common->shm_ring_stale = false;
+}
+
 #ifndef BT_HOST_IPC_ENABLED
 /* logs timestamp with microsec precision
    pprev is optional in case a dedicated diff is required */
@@ -367,6 +394,30 @@ static int skt_disconnect(int fd)
     return 0;
 }
 
+static int ring_write(struct shm_ring_t *ring, const void *p, size_t len)
+{
+    size_t count = 0;
+
+    ts_log("ring_write", len, NULL);
+
+    /* steady state is a plain copy into the ring; only block on the space
+       eventfd when the stack has fallen behind by more than one write */
+    while (count < len) {
+        ssize_t sent = shm_ring_write(ring, (const uint8_t *)p + count, len - count);
+        if (sent < 0) {
+            ERROR("ring closed by stack, wrote %zu bytes", count);
+            return -1;
+        }
+        count += sent;
+        if (count < len &&
+            !shm_ring_wait_writable(ring, len - count, SOCK_SEND_TIMEOUT_MS)) {
+            WARN("ring write timeout exceeded, wrote %zu bytes", count);
+            return -1;
+        }
+    }
+    return (int)count;
+}
+
 
 
 /*****************************************************************************
@@ -406,10 +457,8 @@ static int a2dp_ctrl_receive(struct a2dp_stream_common *common, void* buffer, in
     return ret;
 }
 
-static int a2dp_command(struct a2dp_stream_common *common, char cmd)
+static int a2dp_command_send(struct a2dp_stream_common *common, char cmd)
 {
-    char ack;
-
     INFO("A2DP COMMAND %s", dump_a2dp_ctrl_event(cmd));
 
     if (common->ctrl_fd == AUDIO_SKT_DISCONNECTED) {
@@ -432,12 +481,11 @@ static int a2dp_command(struct a2dp_stream_common *common, char cmd)
         return -1;
     }
 
-    /* wait for ack byte */
-    if (a2dp_ctrl_receive(common, &ack, 1) < 0) {
-        ERROR("A2DP COMMAND %s: no ACK", dump_a2dp_ctrl_event(cmd));
-        return -1;
-    }
+    return 0;
+}
 
+static int a2dp_command_status(char cmd, char ack)
+{
     INFO("A2DP COMMAND %s DONE STATUS %d", dump_a2dp_ctrl_event(cmd), ack);
 
     if (ack == A2DP_CTRL_ACK_INCALL_FAILURE)
@@ -450,6 +498,132 @@ static int a2dp_command(struct a2dp_stream_common *common, char cmd)
     return 0;
 }
 
+static int a2dp_command(struct a2dp_stream_common *common, char cmd)
+{
+    char ack;
+
+    if (a2dp_command_send(common, cmd) < 0)
+        return -1;
+
+    /* wait for ack byte */
+    if (a2dp_ctrl_receive(common, &ack, 1) < 0) {
+        ERROR("A2DP COMMAND %s: no ACK", dump_a2dp_ctrl_event(cmd));
+        return -1;
+    }
+
+    return a2dp_command_status(cmd, ack);
+}
+
+/* Receives one byte from the control socket along with any descriptors sent
+   with it. Returns 0 if no descriptors came with the byte, |num_fds| once
+   exactly that many were stored in |fds|, and -1 on any other outcome, in
+   which case the control socket is closed since the stream can no longer be
+   trusted to be in step with the stack. */
+static int a2dp_ctrl_receive_fds(struct a2dp_stream_common *common, char *byte,
+                                 int *fds, int num_fds)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    char control_buf[CMSG_SPACE(sizeof(int) * SHM_RING_FD_COUNT)];
+    int received = 0;
+    bool extra = false;
+    ssize_t ret;
+
+    if (num_fds > SHM_RING_FD_COUNT)
+        return -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = byte;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control_buf;
+    msg.msg_controllen = sizeof(control_buf);
+
+    OSI_NO_INTR(ret = recvmsg(common->ctrl_fd, &msg, MSG_NOSIGNAL | MSG_CMSG_CLOEXEC));
+    if (ret <= 0) {
+        ERROR("fd receive failed (%s)", ret < 0 ? strerror(errno) : "peer closed");
+        goto error;
+    }
+
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(&msg); header != NULL;
+         header = CMSG_NXTHDR(&msg, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+            continue;
+        int n = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *data = (int *)CMSG_DATA(header);
+        for (int i = 0; i < n; i++) {
+            if (received < num_fds) {
+                fds[received++] = data[i];
+            } else {
+                close(data[i]);
+                extra = true;
+            }
+        }
+    }
+
+    if (received == 0 && !(msg.msg_flags & MSG_CTRUNC))
+        return 0;
+
+    if (received == num_fds && *byte == num_fds && !extra && !(msg.msg_flags & MSG_CTRUNC))
+        return num_fds;
+
+    ERROR("expected %d fds, got %d", num_fds, received);
+    for (int i = 0; i < received; i++)
+        close(fds[i]);
+
+error:
+    skt_disconnect(common->ctrl_fd);
+    common->ctrl_fd = AUDIO_SKT_DISCONNECTED;
+    return -1;
+}
+
+/* Optionally moves PCM from the audio socket to a shared memory ring set up
+   by the stack. Any failure leaves the socket in charge. */
+static void a2dp_setup_shm_ring(struct a2dp_stream_common *common)
+{
+    char value[PROPERTY_VALUE_MAX] = {'\0'};
+    int fds[SHM_RING_FD_COUNT];
+    char reply;
+    char ack;
+
+    if (common->shm_ring != NULL && !common->shm_ring_stale)
+        return;
+    a2dp_release_shm_ring(common);
+    if (common->shm_ring != NULL)
+        return;
+
+    osi_property_get(A2DP_SHM_RING_PROPERTY, value, "false");
+    if (strcmp(value, "true") != 0)
+        return;
+
+    if (a2dp_command_send(common, A2DP_CTRL_CMD_SHM_RING_SETUP) < 0)
+        return;
+
+    /* The stack sends the ring ahead of its ACK, so a reply without
+       descriptors is the ACK of a setup that did not happen. */
+    int received = a2dp_ctrl_receive_fds(common, &reply, fds, SHM_RING_FD_COUNT);
+    if (received < 0)
+        return;
+    if (received == 0) {
+        a2dp_command_status(A2DP_CTRL_CMD_SHM_RING_SETUP, reply);
+        INFO("shared memory ring not available, using socket");
+        return;
+    }
+
+    if (a2dp_ctrl_receive(common, &ack, 1) < 0 ||
+        a2dp_command_status(A2DP_CTRL_CMD_SHM_RING_SETUP, ack) != 0) {
+        for (int i = 0; i < SHM_RING_FD_COUNT; i++)
+            close(fds[i]);
+        INFO("shared memory ring not available, using socket");
+        return;
+    }
+
+    common->shm_ring = shm_ring_attach(fds);
+    if (common->shm_ring != NULL)
+        INFO("using shared memory ring (%zu bytes)", shm_ring_capacity(common->shm_ring));
+}
+
 static int check_a2dp_ready(struct a2dp_stream_common *common)
 {
     INFO("state %s", dump_a2dp_hal_state(common->state));
@@ -529,6 +703,9 @@ static void a2dp_stream_common_init(struct a2dp_stream_common *common)
 
     common->ctrl_fd = AUDIO_SKT_DISCONNECTED;
     common->audio_fd = AUDIO_SKT_DISCONNECTED;
+    common->shm_ring = NULL;
+    common->shm_ring_busy = false;
+    common->shm_ring_stale = false;
     common->state = AUDIO_A2DP_STATE_STOPPED;
 
     /* manages max capacity of socket pipe */
@@ -585,6 +762,7 @@ static int start_audio_datapath(struct a2dp_stream_common *common)
             ERROR("Audiopath start failed - error opening data socket");
             goto error;
         }
+        a2dp_setup_shm_ring(common);
         common->state = AUDIO_A2DP_STATE_STARTED;
     }
 #else
@@ -618,6 +796,7 @@ static int stop_audio_datapath(struct a2dp_stream_common *common)
 
 #ifndef BTA_AV_SPLIT_A2DP_ENABLED
     /* disconnect audio path */
+    a2dp_release_shm_ring(common);
     skt_disconnect(common->audio_fd);
     common->audio_fd = AUDIO_SKT_DISCONNECTED;
 #endif
@@ -642,6 +821,7 @@ static int suspend_audio_datapath(struct a2dp_stream_common *common, bool standb
 
 #ifndef BTA_AV_SPLIT_A2DP_ENABLED
     /* disconnect audio path */
+    a2dp_release_shm_ring(common);
     skt_disconnect(common->audio_fd);
 
     common->audio_fd = AUDIO_SKT_DISCONNECTED;
@@ -713,6 +893,8 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
 
     ts_error_log("a2dp_out_write", bytes, out->common.buffer_sz, out->common.cfg);
 
+    struct shm_ring_t *ring = out->common.shm_ring_stale ? NULL : out->common.shm_ring;
+    out->common.shm_ring_busy = (ring != NULL);
     pthread_mutex_unlock(&out->common.lock);
 
     #ifdef BT_AUDIO_SYSTRACE_LOG
@@ -726,9 +908,15 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
 #ifdef BT_HOST_IPC_ENABLED
     sent = ipc_if->skt_write(out->common.audio_fd, buffer,  bytes);
 #else
-    sent = skt_write(out->common.audio_fd, buffer,  bytes);
+    if (ring != NULL)
+        sent = ring_write(ring, buffer, bytes);
+    else
+        sent = skt_write(out->common.audio_fd, buffer,  bytes);
 #endif
     pthread_mutex_lock(&out->common.lock);
+    out->common.shm_ring_busy = false;
+    if (out->common.shm_ring_stale)
+        a2dp_release_shm_ring(&out->common);
 
     #ifdef BT_AUDIO_SYSTRACE_LOG
     if (PERF_SYSTRACE)
@@ -742,6 +930,7 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
 #ifdef BT_HOST_IPC_ENABLED
         ipc_if->skt_disconnect(out->common.audio_fd);
 #else
+        a2dp_release_shm_ring(&out->common);
         skt_disconnect(out->common.audio_fd);
 #endif
         out->common.audio_fd = AUDIO_SKT_DISCONNECTED;
@@ -1451,6 +1640,7 @@ static void adev_close_output_stream(struct audio_hw_device *dev,
 #ifdef BT_HOST_IPC_ENABLED
     ipc_if->skt_disconnect(out->common.ctrl_fd);
 #else
+    a2dp_release_shm_ring(&out->common);
     skt_disconnect(out->common.ctrl_fd);
 #endif
     out->common.ctrl_fd = AUDIO_SKT_DISCONNECTED;
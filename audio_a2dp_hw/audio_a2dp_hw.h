@@ -32,6 +32,7 @@
 #ifndef AUDIO_A2DP_HW_H
 #define AUDIO_A2DP_HW_H
 #include <pthread.h>
+#include <stdbool.h>
 /*****************************************************************************
 **  Constants & Macros
 ******************************************************************************/
@@ -87,6 +88,15 @@
 
 #define AUDIO_SKT_DISCONNECTED             (-1)
 
+// A2DP_SHM_RING_SZ is the size of the optional shared memory ring which
+// replaces the audio socket once negotiated with A2DP_CTRL_CMD_SHM_RING_SETUP.
+// It is kept close to AUDIO_STREAM_OUTPUT_BUFFER_SZ (rings are a power of two)
+// so switching transports does not change the playback latency noticeably.
+#define A2DP_SHM_RING_SZ                   (16*1024)
+
+// Set this property to "true" to let the HAL negotiate the shared memory ring.
+#define A2DP_SHM_RING_PROPERTY             "persist.bt.a2dp.shm_ring"
+
 typedef enum {
     A2DP_CTRL_CMD_NONE,
     A2DP_CTRL_CMD_CHECK_READY,
@@ -98,6 +108,7 @@ typedef enum {
     A2DP_CTRL_CMD_OFFLOAD_START,
     A2DP_CTRL_CMD_OFFLOAD_SUPPORTED,
     A2DP_CTRL_CMD_OFFLOAD_NOT_SUPPORTED,
+    A2DP_CTRL_CMD_SHM_RING_SETUP,
 } tA2DP_CTRL_CMD;
 
 typedef enum {
@@ -126,10 +137,15 @@ struct a2dp_config {
 /* move ctrl_fd outside output stream and keep open until HAL unloaded ? */
 #define  MAX_CODEC_CFG_SIZE  30
 
+struct shm_ring_t;
+
 struct a2dp_stream_common {
     pthread_mutex_t         lock;
     int                     ctrl_fd;
     int                     audio_fd;
+    struct shm_ring_t       *shm_ring; /* replaces audio_fd for PCM when set */
+    bool                    shm_ring_busy;  /* written to without lock held */
+    bool                    shm_ring_stale; /* release once no longer busy */
     size_t                  buffer_sz;
     struct a2dp_config      cfg;
     a2dp_state_t            state;
@@ -28,6 +28,7 @@
 #include "bta_ag_co.h"
 #include "bta_ag_int.h"
 #include "port_api.h"
+#include "sdp_api.h"
 #include "utl.h"
 #include <string.h>
 #include "bta_dm_int.h"
@@ -283,6 +284,10 @@ void bta_ag_disc_int_res(tBTA_AG_SCB *p_scb, tBTA_AG_DATA *p_data)
         }
     }
 
+    /* the result may have come from a stale cache entry */
+    if (event == BTA_AG_DISC_FAIL_EVT)
+        SDP_FlushDiscoveryCache(p_scb->peer_addr);
+
     /* free discovery db */
     bta_ag_free_db(p_scb, p_data);
 
@@ -400,6 +405,10 @@ void bta_ag_rfc_fail(tBTA_AG_SCB *p_scb, tBTA_AG_DATA *p_data)
 {
     UNUSED(p_data);
 
+    /* the peer scn we connected to may have come from a stale cache entry */
+    if (p_scb->role == BTA_AG_INT)
+        SDP_FlushDiscoveryCache(p_scb->peer_addr);
+
     /* reinitialize stuff */
     p_scb->conn_handle = 0;
     p_scb->conn_service = 0;
@@ -781,7 +781,11 @@ static void bta_av_a2d_sdp_cback(BOOLEAN found, tA2D_Service *p_service)
 
     bta_sys_sendmsg(p_msg);
     if (!found)
+    {
         APPL_TRACE_ERROR ("bta_av_a2d_sdp_cback, SDP record not found");
+        /* the result may have come from a stale cache entry */
+        SDP_FlushDiscoveryCache(p_scb->peer_addr);
+    }
     bta_sys_conn_close(BTA_ID_AV, p_scb->hdi, p_scb->peer_addr);
 }
 
@@ -2279,7 +2283,7 @@ void bta_av_str_stopped (tBTA_AV_SCB *p_scb, tBTA_AV_DATA *p_data)
         {
             p_buf = (BT_HDR *)list_front(p_scb->a2d_list);
             list_remove(p_scb->a2d_list, p_buf);
-            osi_free(p_buf);
+            bta_av_media_buf_release(p_buf);
         }
 
     /* drop the audio buffers queued in L2CAP */
@@ -2439,7 +2443,7 @@ void bta_av_data_path (tBTA_AV_SCB *p_scb, tBTA_AV_DATA *p_data)
         p_buf = (BT_HDR *)list_front(p_scb->a2d_list);
         list_remove(p_scb->a2d_list, p_buf);
          /* use q_info.a2d data, read the timestamp */
-        timestamp = *(UINT32 *)(p_buf + 1);
+        timestamp = BTA_AV_MEDIA_BUF_TIMESTAMP(p_buf);
     }
     else
     {
@@ -2451,7 +2455,8 @@ void bta_av_data_path (tBTA_AV_SCB *p_scb, tBTA_AV_DATA *p_data)
         if (p_buf)
         {
             /* use the offset area for the time stamp */
-            *(UINT32 *)(p_buf + 1) = timestamp;
+            BTA_AV_MEDIA_BUF_TIMESTAMP(p_buf) = timestamp;
+            BTA_AV_MEDIA_BUF_QUEUED(p_buf) = 1;
 
             /* dup the data to other channels */
             bta_av_dup_audio_buf(p_scb, p_buf);
@@ -2462,6 +2467,10 @@ void bta_av_data_path (tBTA_AV_SCB *p_scb, tBTA_AV_DATA *p_data)
     {
         if(p_scb->l2c_bufs < (BTA_AV_QUEUE_DATA_CHK_NUM))
         {
+            /* the lower layers own what they are given, get our own packet */
+            if (!new_buf)
+                p_buf = bta_av_media_buf_take(p_buf);
+
             /* there's a buffer, just queue it to L2CAP */
             /*  There's no need to increment it here, it is always read from L2CAP see above */
             /* p_scb->l2c_bufs++; */
@@ -2499,7 +2508,7 @@ void bta_av_data_path (tBTA_AV_SCB *p_scb, tBTA_AV_DATA *p_data)
                 {
                     /* too many buffers in a2d_list, drop it. */
                     bta_av_co_audio_drop(p_scb->hndl);
-                    osi_free(p_buf);
+                    bta_av_media_buf_release(p_buf);
                 }
             }
         }
@@ -484,6 +484,14 @@ typedef union
                                            is needed on another AV channel */
 } tBTA_AV_Q_INFO;
 
+/* An encoded media packet queued on an a2d_list keeps its timestamp and the
+   number of a2d_lists it is queued on in its offset area, ahead of the AVDTP
+   headroom. The lower layers overwrite the packet while sending it, so only
+   the queued packet is shared: every channel but the last one to send it
+   still sends a copy of its own */
+#define BTA_AV_MEDIA_BUF_TIMESTAMP(p_buf)   (*(UINT32 *)((p_buf) + 1))
+#define BTA_AV_MEDIA_BUF_QUEUED(p_buf)      (((UINT8 *)((p_buf) + 1))[sizeof(UINT32)])
+
 #define BTA_AV_Q_TAG_OPEN               0x01 /* after API_OPEN, before STR_OPENED */
 #define BTA_AV_Q_TAG_START              0x02 /* before start sending media packets */
 #define BTA_AV_Q_TAG_STREAM             0x03 /* during streaming */
@@ -685,6 +693,8 @@ extern BOOLEAN bta_av_is_multicast_enabled();
 /* main functions */
 extern void bta_av_api_deregister(tBTA_AV_DATA *p_data);
 extern void bta_av_dup_audio_buf(tBTA_AV_SCB *p_scb, BT_HDR *p_buf);
+extern BT_HDR *bta_av_media_buf_take(BT_HDR *p_buf);
+extern void bta_av_media_buf_release(BT_HDR *p_buf);
 extern void bta_av_sm_execute(tBTA_AV_CB *p_cb, UINT16 event, tBTA_AV_DATA *p_data);
 extern void bta_av_ssm_execute(tBTA_AV_SCB *p_scb, UINT16 event, tBTA_AV_DATA *p_data);
 extern BOOLEAN bta_av_hdl_event(BT_HDR *p_msg);
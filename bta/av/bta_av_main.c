@@ -1401,22 +1401,76 @@ UINT16 bta_av_chk_mtu(tBTA_AV_SCB *p_scb, UINT16 mtu)
     return ret_mtu;
 }
 
+/*******************************************************************************
+**
+** Function         bta_av_media_buf_take
+**
+** Description      Remove a media packet from one a2d_list and get a packet
+**                  that can be handed to AVDTP. AVDTP, L2CAP and the HCI
+**                  fragmenter overwrite the packet in place and free it once
+**                  it is sent, so this returns a copy while the packet is
+**                  still queued on other a2d_lists. The last list gets the
+**                  packet itself, which with a single audio channel is
+**                  always the case.
+**
+** Returns          packet owned by the caller
+**
+*******************************************************************************/
+BT_HDR *bta_av_media_buf_take(BT_HDR *p_buf)
+{
+    if (BTA_AV_MEDIA_BUF_QUEUED(p_buf) <= 1)
+        return p_buf;
+
+    BTA_AV_MEDIA_BUF_QUEUED(p_buf)--;
+
+    UINT16 copy_size = BT_HDR_SIZE + p_buf->len + p_buf->offset;
+    BT_HDR *p_copy = (BT_HDR *)osi_malloc(copy_size);
+    memcpy(p_copy, p_buf, copy_size);
+    BTA_AV_MEDIA_BUF_QUEUED(p_copy) = 1;
+    return p_copy;
+}
+
+/*******************************************************************************
+**
+** Function         bta_av_media_buf_release
+**
+** Description      Remove a media packet from one a2d_list without sending
+**                  it, freeing the packet once no a2d_list holds it.
+**
+** Returns          void
+**
+*******************************************************************************/
+void bta_av_media_buf_release(BT_HDR *p_buf)
+{
+    if (BTA_AV_MEDIA_BUF_QUEUED(p_buf) <= 1)
+        osi_free(p_buf);
+    else
+        BTA_AV_MEDIA_BUF_QUEUED(p_buf)--;
+}
+
 /*******************************************************************************
 **
 ** Function         bta_av_dup_audio_buf
 **
-** Description      dup the audio data to the q_info.a2d of other audio channels
+** Description      dup the audio data to the a2d_list of other audio channels.
+**                  p_buf itself is sent on p_scb. A single copy is queued on
+**                  all the other channels and each of them but the last one
+**                  to send it copies it again when sending, see
+**                  bta_av_media_buf_take. Only packets dropped from a full
+**                  a2d_list are never copied per channel.
 **
 ** Returns          void
 **
 *******************************************************************************/
 void bta_av_dup_audio_buf(tBTA_AV_SCB *p_scb, BT_HDR *p_buf)
 {
+    tBTA_AV_SCB *p_dest[BTA_AV_NUM_STRS];
+    UINT8 num_dest = 0;
+
     /* Test whether there is more than one audio channel connected */
     if ((p_buf == NULL) || (bta_av_cb.audio_open_cnt < 2))
         return;
 
-    UINT16 copy_size = BT_HDR_SIZE + p_buf->len + p_buf->offset;
     for (int i = 0; i < BTA_AV_NUM_STRS; i++) {
         tBTA_AV_SCB *p_scbi = bta_av_cb.p_scb[i];
 
@@ -1427,17 +1481,28 @@ void bta_av_dup_audio_buf(tBTA_AV_SCB *p_scb, BT_HDR *p_buf)
         if (!(bta_av_cb.conn_audio & BTA_AV_HNDL_TO_MSK(i)))
             continue;           /* Audio is not connected */
 
+        p_dest[num_dest++] = p_scbi;
+    }
+
+    if (num_dest == 0)
+        return;
+
+    /* the copy carries the timestamp in its offset area */
+    UINT16 copy_size = BT_HDR_SIZE + p_buf->len + p_buf->offset;
+    BT_HDR *p_new = (BT_HDR *)osi_malloc(copy_size);
+    memcpy(p_new, p_buf, copy_size);
+    BTA_AV_MEDIA_BUF_QUEUED(p_new) = num_dest;
+
+    for (int i = 0; i < num_dest; i++) {
         /* Enqueue the data */
-        BT_HDR *p_new = (BT_HDR *)osi_malloc(copy_size);
-        memcpy(p_new, p_buf, copy_size);
-        list_append(p_scbi->a2d_list, p_new);
+        list_append(p_dest[i]->a2d_list, p_new);
 
-        if (list_length(p_scbi->a2d_list) > p_bta_av_cfg->audio_mqs) {
+        if (list_length(p_dest[i]->a2d_list) > p_bta_av_cfg->audio_mqs) {
             // Drop the oldest packet
-            bta_av_co_audio_drop(p_scbi->hndl);
-            BT_HDR *p_buf_drop = list_front(p_scbi->a2d_list);
-            list_remove(p_scbi->a2d_list, p_buf_drop);
-            osi_free(p_buf_drop);
+            bta_av_co_audio_drop(p_dest[i]->hndl);
+            BT_HDR *p_drop = (BT_HDR *)list_front(p_dest[i]->a2d_list);
+            list_remove(p_dest[i]->a2d_list, p_drop);
+            bta_av_media_buf_release(p_drop);
         }
     }
 }
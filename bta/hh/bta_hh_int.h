@@ -204,6 +204,14 @@ typedef struct
 #define BTA_HH_LE_RPT_MAX       20
 #endif
 
+/* input report lookup entry, built when the connection is opened */
+typedef struct
+{
+    UINT16                  handle;
+    UINT8                   rpt_id;
+    UINT8                   app_id;
+}tBTA_HH_LE_INPUT_MAP;
+
 typedef struct
 {
     BOOLEAN                 in_use;
@@ -284,6 +292,10 @@ typedef struct
 #define BTA_HH_LE_SCPS_NOTIFY_SPT  0x01
 #define BTA_HH_LE_SCPS_NOTIFY_ENB  0x02
     UINT8               scps_notify;   /* scan refresh supported/notification enabled */
+
+    /* input report notification handle -> report ID/app ID */
+    tBTA_HH_LE_INPUT_MAP input_map[BTA_HH_LE_RPT_MAX];
+    UINT8               input_map_count;
 #endif
 
     BOOLEAN             security_pending;
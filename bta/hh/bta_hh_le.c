@@ -23,6 +23,8 @@
 
 #if (defined BTA_HH_LE_INCLUDED && BTA_HH_LE_INCLUDED == TRUE)
 
+#include <pthread.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "bta_api.h"
@@ -31,7 +33,9 @@
 #include "btm_api.h"
 #include "btm_ble_api.h"
 #include "btm_int.h"
+#include "btu.h"
 #include "osi/include/log.h"
+#include "osi/include/time.h"
 #include "srvc_api.h"
 #include "stack/include/l2c_api.h"
 #include "utl.h"
@@ -62,6 +66,25 @@ static void bta_hh_gattc_callback(tBTA_GATTC_EVT event, tBTA_GATTC *p_data);
 static void bta_hh_le_register_scpp_notif(tBTA_HH_DEV_CB *p_dev_cb, tBTA_GATT_STATUS status);
 static void bta_hh_le_register_scpp_notif_cmpl(tBTA_HH_DEV_CB *p_dev_cb, tBTA_GATT_STATUS status);
 static void bta_hh_le_add_dev_bg_conn(tBTA_HH_DEV_CB *p_cb, BOOLEAN check_bond);
+static void bta_hh_le_build_input_map(tBTA_HH_DEV_CB *p_cb);
+static void bta_hh_le_record_input_latency(UINT64 rx_time_us);
+
+/* input latency statistics, from HCI receive to the uhid write returning */
+#define BTA_HH_LE_LATENCY_BUCKETS   8
+static const UINT32 bta_hh_le_latency_bounds_us[BTA_HH_LE_LATENCY_BUCKETS - 1] =
+{
+    500, 1000, 2000, 5000, 10000, 20000, 50000
+};
+
+static struct
+{
+    UINT32  count;
+    UINT32  unknown;    /* reports whose HCI receive time was not known */
+    UINT64  total_us;
+    UINT64  max_us;
+    UINT32  buckets[BTA_HH_LE_LATENCY_BUCKETS];
+} bta_hh_le_latency;
+static pthread_mutex_t bta_hh_le_latency_lock = PTHREAD_MUTEX_INITIALIZER;
 //TODO(jpawlowski): uncomment when fixed
 // static void bta_hh_process_cache_rpt (tBTA_HH_DEV_CB *p_cb,
 //                                       tBTA_HH_RPT_CACHE_ENTRY *p_rpt_cache,
@@ -905,6 +928,7 @@ void bta_hh_le_open_cmpl(tBTA_HH_DEV_CB *p_cb)
         bta_hh_le_hid_report_dbg(p_cb);
 #endif
         bta_hh_le_register_input_notif(p_cb, 0, p_cb->mode, TRUE);
+        bta_hh_le_build_input_map(p_cb);
         bta_hh_sm_execute(p_cb, BTA_HH_OPEN_CMPL_EVT, NULL);
 
 #if (BTA_HH_LE_RECONN == TRUE)
@@ -916,6 +940,53 @@ void bta_hh_le_open_cmpl(tBTA_HH_DEV_CB *p_cb)
     }
 }
 
+/*******************************************************************************
+**
+** Function         bta_hh_le_build_input_map
+**
+** Description      Record the report ID and app ID of every input report
+**                  characteristic, so that notifications don't need to look
+**                  up the GATT cache and the report table.
+**
+*******************************************************************************/
+static void bta_hh_le_build_input_map(tBTA_HH_DEV_CB *p_cb)
+{
+    UINT8           srvc_inst_id = p_cb->hid_srvc[0].srvc_inst_id;
+    tBTA_HH_LE_RPT  *p_rpt;
+
+    p_cb->input_map_count = 0;
+
+    for (int i = 0; i < BTA_HH_LE_HID_SRVC_MAX; i ++)
+    {
+        p_rpt = &p_cb->hid_srvc[i].report[0];
+
+        for (int j = 0; j < BTA_HH_LE_RPT_MAX; j ++, p_rpt ++)
+        {
+            if (!p_rpt->in_use || p_rpt->rpt_type != BTA_HH_RPTT_INPUT ||
+                p_rpt->srvc_inst_id != srvc_inst_id)
+                continue;
+
+            if (p_rpt->uuid != GATT_UUID_HID_REPORT &&
+                p_rpt->uuid != GATT_UUID_HID_BT_KB_INPUT &&
+                p_rpt->uuid != GATT_UUID_HID_BT_MOUSE_INPUT)
+                continue;
+
+            if (p_cb->input_map_count == BTA_HH_LE_RPT_MAX)
+                return;
+
+            tBTA_HH_LE_INPUT_MAP *p_map = &p_cb->input_map[p_cb->input_map_count++];
+            p_map->handle = p_rpt->char_inst_id;
+            p_map->rpt_id = p_rpt->rpt_id;
+            if (p_rpt->uuid == GATT_UUID_HID_BT_MOUSE_INPUT)
+                p_map->app_id = BTA_HH_APP_ID_MI;
+            else if (p_rpt->uuid == GATT_UUID_HID_BT_KB_INPUT)
+                p_map->app_id = BTA_HH_APP_ID_KB;
+            else
+                p_map->app_id = p_cb->app_id;
+        }
+    }
+}
+
 /*******************************************************************************
 **
 ** Function         bta_hh_le_write_char_clt_cfg
@@ -2219,7 +2290,9 @@ void bta_hh_le_write_char_descr_cmpl(tBTA_HH_DEV_CB *p_dev_cb, tBTA_HH_DATA *p_b
 void bta_hh_le_input_rpt_notify(tBTA_GATTC_NOTIFY *p_data)
 {
     tBTA_HH_DEV_CB       *p_dev_cb = bta_hh_le_find_dev_cb_by_conn_id(p_data->conn_id);
+    UINT64          rx_time_us = btu_acl_rx_time_us();
     UINT8           app_id;
+    UINT8           rpt_id;
     UINT8           *p_buf;
     tBTA_HH_LE_RPT  *p_rpt;
 
@@ -2230,51 +2303,69 @@ void bta_hh_le_input_rpt_notify(tBTA_GATTC_NOTIFY *p_data)
         return;
     }
 
-    const tBTA_GATTC_CHARACTERISTIC *p_char = BTA_GATTC_GetCharacteristic(p_dev_cb->conn_id,
-                                                                          p_data->handle);
-    if (p_char == NULL)
+    /* fast path for the input reports known when the connection was opened */
+    tBTA_HH_LE_INPUT_MAP *p_map = NULL;
+    for (UINT8 i = 0; i < p_dev_cb->input_map_count; i ++)
     {
-        APPL_TRACE_ERROR("%s: notification received for Unknown Characteristic, conn_id: 0x%04x, handle: 0x%04x",
-            __func__, p_dev_cb->conn_id, p_data->handle);
-        return;
+        if (p_dev_cb->input_map[i].handle == p_data->handle)
+        {
+            p_map = &p_dev_cb->input_map[i];
+            break;
+        }
     }
 
-    app_id= p_dev_cb->app_id;
-
-    if (p_char->uuid.uu.uuid16 == GATT_UUID_SCAN_REFRESH) {
-        APPL_TRACE_DEBUG("Notification received for scan refresh parameters");
-        BTA_HhUpdateLeScanParam(p_dev_cb->hid_handle,BTM_BLE_SCAN_SLOW_INT_1,
-                                             BTM_BLE_SCAN_SLOW_WIN_1);
-       return;
-    }
-    p_rpt = bta_hh_le_find_report_entry(p_dev_cb,
-                                        p_dev_cb->hid_srvc[0].srvc_inst_id,
-                                        p_char->uuid.uu.uuid16,
-                                        p_char->handle);
-    if (p_rpt == NULL)
+    if (p_map != NULL)
     {
-        APPL_TRACE_ERROR("%s: notification received for Unknown Report, uuid: 0x%04x, handle: 0x%04x",
-            __func__, p_char->uuid.uu.uuid16, p_char->handle);
-        return;
+        app_id = p_map->app_id;
+        rpt_id = p_map->rpt_id;
     }
+    else
+    {
+        const tBTA_GATTC_CHARACTERISTIC *p_char = BTA_GATTC_GetCharacteristic(p_dev_cb->conn_id,
+                                                                              p_data->handle);
+        if (p_char == NULL)
+        {
+            APPL_TRACE_ERROR("%s: notification received for Unknown Characteristic, conn_id: 0x%04x, handle: 0x%04x",
+                __func__, p_dev_cb->conn_id, p_data->handle);
+            return;
+        }
 
-    if (p_char->uuid.uu.uuid16 == GATT_UUID_HID_BT_MOUSE_INPUT)
-        app_id = BTA_HH_APP_ID_MI;
-    else if (p_char->uuid.uu.uuid16 == GATT_UUID_HID_BT_KB_INPUT)
-        app_id = BTA_HH_APP_ID_KB;
+        app_id= p_dev_cb->app_id;
 
-    APPL_TRACE_DEBUG("Notification received on report ID: %d", p_rpt->rpt_id);
+        if (p_char->uuid.uu.uuid16 == GATT_UUID_SCAN_REFRESH) {
+            APPL_TRACE_DEBUG("Notification received for scan refresh parameters");
+            BTA_HhUpdateLeScanParam(p_dev_cb->hid_handle,BTM_BLE_SCAN_SLOW_INT_1,
+                                                 BTM_BLE_SCAN_SLOW_WIN_1);
+           return;
+        }
+        p_rpt = bta_hh_le_find_report_entry(p_dev_cb,
+                                            p_dev_cb->hid_srvc[0].srvc_inst_id,
+                                            p_char->uuid.uu.uuid16,
+                                            p_char->handle);
+        if (p_rpt == NULL)
+        {
+            APPL_TRACE_ERROR("%s: notification received for Unknown Report, uuid: 0x%04x, handle: 0x%04x",
+                __func__, p_char->uuid.uu.uuid16, p_char->handle);
+            return;
+        }
 
-    /* need to append report ID to the head of data */
-    if (p_rpt->rpt_id != 0)
-    {
-        p_buf = (UINT8 *)osi_malloc(p_data->len + 1);
+        if (p_char->uuid.uu.uuid16 == GATT_UUID_HID_BT_MOUSE_INPUT)
+            app_id = BTA_HH_APP_ID_MI;
+        else if (p_char->uuid.uu.uuid16 == GATT_UUID_HID_BT_KB_INPUT)
+            app_id = BTA_HH_APP_ID_KB;
+        rpt_id = p_rpt->rpt_id;
+    }
+
+    APPL_TRACE_DEBUG("Notification received on report ID: %d", rpt_id);
 
-        p_buf[0] = p_rpt->rpt_id;
-        memcpy(&p_buf[1], p_data->value, p_data->len);
+    /* need to append report ID to the head of data, the notification
+       reserves headroom for it */
+    p_buf = p_data->value;
+    if (rpt_id != 0)
+    {
+        --p_buf;
+        p_buf[0] = rpt_id;
         ++p_data->len;
-    } else {
-        p_buf = p_data->value;
     }
 
     bta_hh_co_data((UINT8)p_dev_cb->hid_handle,
@@ -2286,8 +2377,73 @@ void bta_hh_le_input_rpt_notify(tBTA_GATTC_NOTIFY *p_data)
                     p_dev_cb->addr,
                     app_id);
 
-    if (p_buf != p_data->value)
-        osi_free(p_buf);
+    bta_hh_le_record_input_latency(rx_time_us);
+}
+
+/*******************************************************************************
+**
+** Function         bta_hh_le_record_input_latency
+**
+** Description      Account an input report handed to the HID host callout,
+**                  received from the controller at |rx_time_us|.
+**
+*******************************************************************************/
+static void bta_hh_le_record_input_latency(UINT64 rx_time_us)
+{
+    UINT64 now_us = time_get_os_boottime_us();
+
+    pthread_mutex_lock(&bta_hh_le_latency_lock);
+    if (rx_time_us == 0 || rx_time_us > now_us)
+    {
+        bta_hh_le_latency.unknown ++;
+    }
+    else
+    {
+        UINT64 latency_us = now_us - rx_time_us;
+        int    bucket = 0;
+
+        while (bucket < BTA_HH_LE_LATENCY_BUCKETS - 1 &&
+               latency_us >= bta_hh_le_latency_bounds_us[bucket])
+            bucket ++;
+
+        bta_hh_le_latency.count ++;
+        bta_hh_le_latency.total_us += latency_us;
+        if (latency_us > bta_hh_le_latency.max_us)
+            bta_hh_le_latency.max_us = latency_us;
+        bta_hh_le_latency.buckets[bucket] ++;
+    }
+    pthread_mutex_unlock(&bta_hh_le_latency_lock);
+}
+
+/*******************************************************************************
+**
+** Function         BTA_HhLeDebugDump
+**
+** Description      Dump the HID over GATT input latency statistics.
+**
+** Returns          void
+**
+*******************************************************************************/
+void BTA_HhLeDebugDump(int fd)
+{
+    pthread_mutex_lock(&bta_hh_le_latency_lock);
+
+    dprintf(fd, "\nHID over GATT Input Latency (HCI receive to uhid write):\n");
+    dprintf(fd, "  Reports: %u, unknown receive time: %u\n",
+            bta_hh_le_latency.count, bta_hh_le_latency.unknown);
+    if (bta_hh_le_latency.count > 0)
+    {
+        dprintf(fd, "  Average/max (us): %llu / %llu\n",
+                (unsigned long long)(bta_hh_le_latency.total_us / bta_hh_le_latency.count),
+                (unsigned long long)bta_hh_le_latency.max_us);
+        dprintf(fd, "  Histogram (us):");
+        for (int i = 0; i < BTA_HH_LE_LATENCY_BUCKETS - 1; i ++)
+            dprintf(fd, " <%u: %u", bta_hh_le_latency_bounds_us[i], bta_hh_le_latency.buckets[i]);
+        dprintf(fd, " >=%u: %u\n", bta_hh_le_latency_bounds_us[BTA_HH_LE_LATENCY_BUCKETS - 2],
+                bta_hh_le_latency.buckets[BTA_HH_LE_LATENCY_BUCKETS - 1]);
+    }
+
+    pthread_mutex_unlock(&bta_hh_le_latency_lock);
 }
 
 /*******************************************************************************
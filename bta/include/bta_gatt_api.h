@@ -189,6 +189,9 @@ typedef struct
 
 #define BTA_GATT_MAX_ATTR_LEN       GATT_MAX_ATTR_LEN
 
+/* bytes writable in front of a notification value, e.g. for a HID report ID */
+#define BTA_GATTC_NOTIFY_HEADROOM   1
+
 #define BTA_GATTC_TYPE_WRITE             GATT_WRITE
 #define BTA_GATTC_TYPE_WRITE_NO_RSP      GATT_WRITE_NO_RSP
 typedef UINT8 tBTA_GATTC_WRITE_TYPE;
@@ -315,6 +318,7 @@ typedef struct
     BD_ADDR             bda;
     UINT16              handle;
     UINT16              len;
+    UINT8               headroom[BTA_GATTC_NOTIFY_HEADROOM]; /* lets a receiver prepend to value in place */
     UINT8               value[BTA_GATT_MAX_ATTR_LEN];
     BOOLEAN             is_notify;
 }tBTA_GATTC_NOTIFY;
@@ -561,6 +561,18 @@ extern void BTA_HhParseBootRpt(tBTA_HH_BOOT_RPT *p_data, UINT8 *p_report,
 **
 *******************************************************************************/
 extern void BTA_HhUpdateLeScanParam(UINT8 dev_handle, UINT16 scan_int, UINT16 scan_win);
+
+/*******************************************************************************
+**
+** Function         BTA_HhLeDebugDump
+**
+** Description      Dump the HID over GATT input latency statistics, measured
+**                  from HCI receive to the report being written to the kernel.
+**
+** Returns          void
+**
+*******************************************************************************/
+extern void BTA_HhLeDebugDump(int fd);
 #endif
 /* test commands */
 extern void bta_hh_le_hid_read_rpt_clt_cfg(BD_ADDR bd_addr, UINT8 rpt_id);
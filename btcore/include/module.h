@@ -54,6 +54,26 @@ void module_shut_down(const module_t *module);
 // If not initialized, does nothing.
 void module_clean_up(const module_t *module);
 
+// Initializes every module in the NULL terminated |modules| array, running
+// modules which don't depend on each other concurrently on a small pool of
+// worker threads. Dependencies are matched by name within the array; those
+// outside of it must already be initialized. Modules which are already
+// initialized are skipped, and modules depending on a failed module are not
+// initialized at all. Returns true if every module ended up initialized.
+bool module_init_all(const module_t *modules[]);
+// Initializes |module| on its first use if nobody has done so yet. Safe to
+// call from any thread. |module| may not be NULL. Returns true if |module| is
+// initialized on return.
+bool module_init_lazy(const module_t *module);
+// Shuts down and cleans up every module initialized by |module_init_lazy|,
+// most recently initialized first. Modules which were already cleaned up
+// are skipped.
+void module_clean_up_lazy(void);
+
+// Writes the most recent module init and start up calls, with their durations
+// and calling threads, to |fd|.
+void module_timeline_dump(int fd);
+
 // Temporary callbacked wrapper for module start up, so real modules can be
 // spliced into the current janky startup sequence. Runs on a separate thread,
 // which terminates when the module start up has finished. When module startup
@@ -20,15 +20,20 @@
 
 #include <assert.h>
 #include <dlfcn.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "btcore/include/module.h"
 #include "osi/include/allocator.h"
+#include "osi/include/compat.h"
 #include "osi/include/hash_functions.h"
 #include "osi/include/hash_map.h"
+#include "osi/include/list.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
+#include "osi/include/time.h"
 
 typedef enum {
   MODULE_STATE_NONE = 0,
@@ -42,7 +47,34 @@ static hash_map_t *metadata;
 // Include this lock for now for correctness, while the startup sequence is being refactored
 static pthread_mutex_t metadata_lock;
 
+// Number of worker threads |module_init_all| spreads independent modules over.
+#define MAX_INIT_WORKERS 4
+// Number of lifecycle calls kept for |module_timeline_dump|.
+#define TIMELINE_ENTRIES 32
+
+typedef struct {
+  const char *module;
+  const char *phase;
+  uint64_t start_us;
+  uint64_t duration_us;
+  pid_t tid;
+  bool success;
+} timeline_entry_t;
+
+// The timeline outlives module management so it can be dumped after a failed
+// or torn down start up.
+static pthread_mutex_t timeline_lock = PTHREAD_MUTEX_INITIALIZER;
+static timeline_entry_t timeline[TIMELINE_ENTRIES];
+static size_t timeline_count;
+
+// Serializes |module_init_lazy| callers racing on the first use of a module,
+// and protects |lazy_modules|.
+static pthread_mutex_t lazy_init_lock = PTHREAD_MUTEX_INITIALIZER;
+// Modules initialized by |module_init_lazy|, most recent first.
+static list_t *lazy_modules;
+
 static bool call_lifecycle_function(module_lifecycle_fn function);
+static bool timed_lifecycle_call(const module_t *module, const char *phase, module_lifecycle_fn function, uint64_t *duration_us);
 static module_state_t get_module_state(const module_t *module);
 static void set_module_state(const module_t *module, module_state_t state);
 
@@ -56,12 +88,21 @@ void module_management_start(void) {
   );
 
   pthread_mutex_init(&metadata_lock, NULL);
+
+  pthread_mutex_lock(&lazy_init_lock);
+  lazy_modules = list_new(NULL);
+  pthread_mutex_unlock(&lazy_init_lock);
 }
 
 void module_management_stop(void) {
   if (!metadata)
     return;
 
+  pthread_mutex_lock(&lazy_init_lock);
+  list_free(lazy_modules);
+  lazy_modules = NULL;
+  pthread_mutex_unlock(&lazy_init_lock);
+
   hash_map_free(metadata);
   metadata = NULL;
 
@@ -80,12 +121,14 @@ bool module_init(const module_t *module) {
   assert(get_module_state(module) == MODULE_STATE_NONE);
 
   LOG_INFO(LOG_TAG, "%s Initializing module \"%s\"", __func__, module->name);
-  if (!call_lifecycle_function(module->init)) {
+  uint64_t duration_us;
+  if (!timed_lifecycle_call(module, "init", module->init, &duration_us)) {
     LOG_ERROR(LOG_TAG, "%s Failed to initialize module \"%s\"",
               __func__, module->name);
     return false;
   }
-  LOG_INFO(LOG_TAG, "%s Initialized module \"%s\"", __func__, module->name);
+  LOG_INFO(LOG_TAG, "%s Initialized module \"%s\" in %" PRIu64 " us",
+           __func__, module->name, duration_us);
 
   set_module_state(module, MODULE_STATE_INITIALIZED);
   return true;
@@ -100,12 +143,14 @@ bool module_start_up(const module_t *module) {
   assert(get_module_state(module) == MODULE_STATE_INITIALIZED || module->init == NULL);
 
   LOG_INFO(LOG_TAG, "%s Starting module \"%s\"", __func__, module->name);
-  if (!call_lifecycle_function(module->start_up)) {
+  uint64_t duration_us;
+  if (!timed_lifecycle_call(module, "start_up", module->start_up, &duration_us)) {
     LOG_ERROR(LOG_TAG, "%s failed to start up \"%s\"", __func__, module->name);
     set_module_state(module, MODULE_STATE_STARTUP_ERROR);
     return false;
   }
-  LOG_INFO(LOG_TAG, "%s Started module \"%s\"", __func__, module->name);
+  LOG_INFO(LOG_TAG, "%s Started module \"%s\" in %" PRIu64 " us",
+           __func__, module->name, duration_us);
 
   set_module_state(module, MODULE_STATE_STARTED);
   return true;
@@ -152,6 +197,258 @@ void module_clean_up(const module_t *module) {
   set_module_state(module, MODULE_STATE_NONE);
 }
 
+bool module_init_lazy(const module_t *module) {
+  assert(metadata != NULL);
+  assert(module != NULL);
+
+  // Unlocked fast path; the state only ever moves away from NONE under
+  // |lazy_init_lock| or from the thread which owns the module's lifecycle.
+  if (get_module_state(module) != MODULE_STATE_NONE)
+    return true;
+
+  pthread_mutex_lock(&lazy_init_lock);
+  bool success = get_module_state(module) != MODULE_STATE_NONE;
+  if (!success && module_init(module)) {
+    list_prepend(lazy_modules, (void *)module);
+    success = true;
+  }
+  pthread_mutex_unlock(&lazy_init_lock);
+  return success;
+}
+
+void module_clean_up_lazy(void) {
+  assert(metadata != NULL);
+
+  // The lifecycle functions run without |lazy_init_lock| so they are free to
+  // take their own locks, which may also be held around |module_init_lazy|.
+  pthread_mutex_lock(&lazy_init_lock);
+  list_t *modules = lazy_modules;
+  lazy_modules = list_new(NULL);
+  pthread_mutex_unlock(&lazy_init_lock);
+
+  for (const list_node_t *node = list_begin(modules); node != list_end(modules);
+       node = list_next(node)) {
+    const module_t *module = (const module_t *)list_node(node);
+    module_shut_down(module);
+    module_clean_up(module);
+  }
+  list_free(modules);
+}
+
+// Dependency graph driven initialization
+
+typedef enum {
+  INIT_JOB_WAITING,
+  INIT_JOB_RUNNING,
+  INIT_JOB_SUCCEEDED,
+  INIT_JOB_FAILED
+} init_job_state_t;
+
+typedef struct {
+  const module_t *module;
+  init_job_state_t state;
+  size_t unfinished_dependencies;
+  bool dependency_failed;
+} init_job_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  init_job_t *jobs;
+  size_t count;
+  size_t finished;
+  size_t running;
+  bool success;
+} init_batch_t;
+
+static void run_init_jobs(void *context);
+static bool depends_on(const module_t *module, const module_t *dependency);
+static void finish_init_job(init_batch_t *batch, size_t index, bool success);
+
+bool module_init_all(const module_t *modules[]) {
+  assert(metadata != NULL);
+  assert(modules != NULL);
+
+  init_batch_t batch;
+  memset(&batch, 0, sizeof(batch));
+  while (modules[batch.count])
+    ++batch.count;
+  if (batch.count == 0)
+    return true;
+
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.changed, NULL);
+  batch.jobs = osi_calloc(batch.count * sizeof(init_job_t));
+  batch.success = true;
+
+  // Dependencies outside of the batch are the caller's business; they must
+  // already be initialized by the time this is called.
+  for (size_t i = 0; i < batch.count; ++i) {
+    batch.jobs[i].module = modules[i];
+    for (size_t j = 0; j < batch.count; ++j) {
+      if (i != j && depends_on(modules[i], modules[j]))
+        ++batch.jobs[i].unfinished_dependencies;
+    }
+  }
+
+  size_t worker_count = batch.count < MAX_INIT_WORKERS ? batch.count : MAX_INIT_WORKERS;
+  thread_t *workers[MAX_INIT_WORKERS];
+  size_t started = 0;
+  for (size_t i = 0; i < worker_count; ++i) {
+    workers[started] = thread_new("module_init");
+    if (!workers[started]) {
+      LOG_WARN(LOG_TAG, "%s unable to create init worker %zu", __func__, i);
+      continue;
+    }
+    thread_post(workers[started++], run_init_jobs, &batch);
+  }
+
+  // Without any worker the calling thread does the work itself, in order.
+  if (started == 0)
+    run_init_jobs(&batch);
+
+  pthread_mutex_lock(&batch.lock);
+  while (batch.finished < batch.count) {
+    // Everything left is waiting on something that can never finish.
+    if (batch.running == 0) {
+      bool runnable = false;
+      for (size_t i = 0; i < batch.count && !runnable; ++i)
+        runnable = batch.jobs[i].state == INIT_JOB_WAITING && batch.jobs[i].unfinished_dependencies == 0;
+      if (!runnable)
+        break;
+    }
+    pthread_cond_wait(&batch.changed, &batch.lock);
+  }
+
+  for (size_t i = 0; i < batch.count; ++i) {
+    if (batch.jobs[i].state == INIT_JOB_WAITING) {
+      LOG_ERROR(LOG_TAG, "%s module \"%s\" is part of a dependency cycle",
+                __func__, batch.jobs[i].module->name);
+      batch.jobs[i].state = INIT_JOB_FAILED;
+      batch.success = false;
+    }
+  }
+  bool success = batch.success;
+  pthread_mutex_unlock(&batch.lock);
+
+  // The workers have run out of jobs by now, so this only joins them.
+  for (size_t i = 0; i < started; ++i)
+    thread_free(workers[i]);
+
+  osi_free(batch.jobs);
+  pthread_cond_destroy(&batch.changed);
+  pthread_mutex_destroy(&batch.lock);
+  return success;
+}
+
+void module_timeline_dump(int fd) {
+  pthread_mutex_lock(&timeline_lock);
+
+  dprintf(fd, "\nModule Lifecycle Timeline:\n");
+  size_t first = timeline_count > TIMELINE_ENTRIES ? timeline_count - TIMELINE_ENTRIES : 0;
+  if (first == timeline_count)
+    dprintf(fd, "  (no lifecycle calls)\n");
+
+  uint64_t origin_us = timeline[first % TIMELINE_ENTRIES].start_us;
+  for (size_t i = first; i < timeline_count; ++i) {
+    const timeline_entry_t *entry = &timeline[i % TIMELINE_ENTRIES];
+    dprintf(fd, "  +%8" PRIu64 " us  %-8s %-24s %8" PRIu64 " us  tid %-6d %s\n",
+            entry->start_us - origin_us, entry->phase, entry->module,
+            entry->duration_us, (int)entry->tid,
+            entry->success ? "ok" : "FAILED");
+  }
+
+  pthread_mutex_unlock(&timeline_lock);
+}
+
+// Runs on the init workers, and takes ready jobs until there are none left.
+static void run_init_jobs(void *context) {
+  init_batch_t *batch = (init_batch_t *)context;
+
+  pthread_mutex_lock(&batch->lock);
+  for (;;) {
+    size_t index = batch->count;
+    for (size_t i = 0; i < batch->count; ++i) {
+      if (batch->jobs[i].state == INIT_JOB_WAITING && batch->jobs[i].unfinished_dependencies == 0) {
+        index = i;
+        break;
+      }
+    }
+
+    if (index == batch->count) {
+      // Nothing ready; jobs still running may unlock more work.
+      if (batch->running == 0)
+        break;
+      pthread_cond_wait(&batch->changed, &batch->lock);
+      continue;
+    }
+
+    init_job_t *job = &batch->jobs[index];
+    if (job->dependency_failed) {
+      LOG_ERROR(LOG_TAG, "%s not initializing \"%s\", a dependency failed",
+                __func__, job->module->name);
+      finish_init_job(batch, index, false);
+      continue;
+    }
+
+    job->state = INIT_JOB_RUNNING;
+    ++batch->running;
+    pthread_mutex_unlock(&batch->lock);
+
+    bool success = get_module_state(job->module) != MODULE_STATE_NONE || module_init(job->module);
+
+    pthread_mutex_lock(&batch->lock);
+    --batch->running;
+    finish_init_job(batch, index, success);
+  }
+  pthread_mutex_unlock(&batch->lock);
+}
+
+// Must be called with |batch->lock| held.
+static void finish_init_job(init_batch_t *batch, size_t index, bool success) {
+  init_job_t *job = &batch->jobs[index];
+  job->state = success ? INIT_JOB_SUCCEEDED : INIT_JOB_FAILED;
+  ++batch->finished;
+  if (!success)
+    batch->success = false;
+
+  for (size_t i = 0; i < batch->count; ++i) {
+    if (i != index && depends_on(batch->jobs[i].module, job->module)) {
+      --batch->jobs[i].unfinished_dependencies;
+      if (!success)
+        batch->jobs[i].dependency_failed = true;
+    }
+  }
+
+  pthread_cond_broadcast(&batch->changed);
+}
+
+static bool depends_on(const module_t *module, const module_t *dependency) {
+  for (size_t i = 0; module->dependencies[i]; ++i) {
+    if (!strcmp(module->dependencies[i], dependency->name))
+      return true;
+  }
+  return false;
+}
+
+static bool timed_lifecycle_call(const module_t *module, const char *phase, module_lifecycle_fn function, uint64_t *duration_us) {
+  uint64_t start_us = time_get_os_boottime_us();
+  bool success = call_lifecycle_function(function);
+  *duration_us = time_get_os_boottime_us() - start_us;
+
+  pthread_mutex_lock(&timeline_lock);
+  timeline_entry_t *entry = &timeline[timeline_count++ % TIMELINE_ENTRIES];
+  entry->module = module->name;
+  entry->phase = phase;
+  entry->start_us = start_us;
+  entry->duration_us = *duration_us;
+  entry->tid = gettid();
+  entry->success = success;
+  pthread_mutex_unlock(&timeline_lock);
+
+  return success;
+}
+
 static bool call_lifecycle_function(module_lifecycle_fn function) {
   // A NULL lifecycle function means it isn't needed, so assume success
   if (!function)
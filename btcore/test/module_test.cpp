@@ -0,0 +1,178 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2014 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "osi/test/AllocationTestHarness.h"
+
+extern "C" {
+#include "btcore/include/module.h"
+}
+
+static pthread_mutex_t order_lock = PTHREAD_MUTEX_INITIALIZER;
+static char init_order[16];
+static size_t init_count;
+static char lifecycle_order[16];
+static size_t lifecycle_count;
+static int concurrent;
+static int max_concurrent;
+
+static void record_init(char id) {
+  pthread_mutex_lock(&order_lock);
+  init_order[init_count++] = id;
+  ++concurrent;
+  if (concurrent > max_concurrent)
+    max_concurrent = concurrent;
+  pthread_mutex_unlock(&order_lock);
+
+  // Long enough for independent modules to overlap.
+  usleep(20 * 1000);
+
+  pthread_mutex_lock(&order_lock);
+  --concurrent;
+  pthread_mutex_unlock(&order_lock);
+}
+
+static future_t *init_a(void) { record_init('a'); return NULL; }
+static future_t *init_b(void) { record_init('b'); return NULL; }
+static future_t *init_c(void) { record_init('c'); return NULL; }
+static future_t *init_fail(void) { record_init('f'); return future_new_immediate(FUTURE_FAIL); }
+
+static void record_lifecycle(char id) {
+  pthread_mutex_lock(&order_lock);
+  lifecycle_order[lifecycle_count++] = id;
+  pthread_mutex_unlock(&order_lock);
+}
+
+static future_t *shut_down_a(void) { record_lifecycle('A'); return NULL; }
+static future_t *clean_up_a(void) { record_lifecycle('a'); return NULL; }
+static future_t *clean_up_b(void) { record_lifecycle('b'); return NULL; }
+
+static const module_t module_a = { "module_a", init_a, NULL, NULL, NULL, { NULL } };
+static const module_t module_b = { "module_b", init_b, NULL, NULL, NULL, { NULL } };
+static const module_t module_c = { "module_c", init_c, NULL, NULL, NULL, { "module_a", "module_b", NULL } };
+static const module_t module_fail = { "module_fail", init_fail, NULL, NULL, NULL, { NULL } };
+static const module_t module_after_fail = { "module_after_fail", init_a, NULL, NULL, NULL, { "module_fail", NULL } };
+static const module_t module_loop_x = { "module_loop_x", init_a, NULL, NULL, NULL, { "module_loop_y", NULL } };
+static const module_t module_loop_y = { "module_loop_y", init_b, NULL, NULL, NULL, { "module_loop_x", NULL } };
+static const module_t module_lazy_a = { "module_lazy_a", init_a, NULL, shut_down_a, clean_up_a, { NULL } };
+static const module_t module_lazy_b = { "module_lazy_b", init_b, NULL, NULL, clean_up_b, { "module_lazy_a", NULL } };
+
+class ModuleTest : public AllocationTestHarness {
+  protected:
+    virtual void SetUp() {
+      AllocationTestHarness::SetUp();
+
+      memset(init_order, 0, sizeof(init_order));
+      init_count = 0;
+      memset(lifecycle_order, 0, sizeof(lifecycle_order));
+      lifecycle_count = 0;
+      concurrent = 0;
+      max_concurrent = 0;
+      module_management_start();
+    }
+
+    virtual void TearDown() {
+      module_management_stop();
+
+      AllocationTestHarness::TearDown();
+    }
+};
+
+TEST_F(ModuleTest, test_init_all_respects_dependencies) {
+  const module_t *modules[] = { &module_c, &module_b, &module_a, NULL };
+
+  EXPECT_TRUE(module_init_all(modules));
+  ASSERT_EQ(3u, init_count);
+  EXPECT_EQ('c', init_order[2]);
+  EXPECT_EQ(2, max_concurrent);
+
+  module_clean_up(&module_c);
+  module_clean_up(&module_b);
+  module_clean_up(&module_a);
+}
+
+TEST_F(ModuleTest, test_init_all_skips_initialized) {
+  const module_t *modules[] = { &module_a, &module_b, NULL };
+
+  EXPECT_TRUE(module_init(&module_a));
+  EXPECT_TRUE(module_init_all(modules));
+  EXPECT_STREQ("ab", init_order);
+
+  module_clean_up(&module_b);
+  module_clean_up(&module_a);
+}
+
+TEST_F(ModuleTest, test_init_all_failure_stops_dependents) {
+  const module_t *modules[] = { &module_after_fail, &module_fail, &module_b, NULL };
+
+  EXPECT_FALSE(module_init_all(modules));
+  EXPECT_EQ(2u, init_count);
+  EXPECT_TRUE(strchr(init_order, 'a') == NULL);
+
+  module_clean_up(&module_b);
+}
+
+TEST_F(ModuleTest, test_init_all_reports_cycles) {
+  const module_t *modules[] = { &module_loop_x, &module_loop_y, &module_a, NULL };
+
+  EXPECT_FALSE(module_init_all(modules));
+  EXPECT_STREQ("a", init_order);
+
+  module_clean_up(&module_a);
+}
+
+TEST_F(ModuleTest, test_init_lazy_runs_once) {
+  EXPECT_TRUE(module_init_lazy(&module_b));
+  EXPECT_TRUE(module_init_lazy(&module_b));
+  EXPECT_STREQ("b", init_order);
+
+  module_clean_up(&module_b);
+}
+
+TEST_F(ModuleTest, test_clean_up_lazy_reverse_order) {
+  EXPECT_TRUE(module_init_lazy(&module_lazy_a));
+  EXPECT_TRUE(module_init_lazy(&module_lazy_b));
+  EXPECT_TRUE(module_start_up(&module_lazy_a));
+
+  module_clean_up_lazy();
+  EXPECT_STREQ("bAa", lifecycle_order);
+
+  // Nothing is left to clean up, and the next use initializes again.
+  module_clean_up_lazy();
+  EXPECT_STREQ("bAa", lifecycle_order);
+  EXPECT_TRUE(module_init_lazy(&module_lazy_a));
+  EXPECT_STREQ("aba", init_order);
+
+  module_clean_up_lazy();
+  EXPECT_STREQ("bAaa", lifecycle_order);
+}
+
+TEST_F(ModuleTest, test_clean_up_lazy_skips_cleaned_up) {
+  EXPECT_TRUE(module_init_lazy(&module_lazy_a));
+  EXPECT_TRUE(module_init_lazy(&module_lazy_b));
+  module_clean_up(&module_lazy_b);
+
+  module_clean_up_lazy();
+  EXPECT_STREQ("ba", lifecycle_order);
+}
@@ -87,6 +87,7 @@ btifCommonSrc += \
 
 # Tests
 btifTestSrc := \
+  test/btif_debug_btsnoop_test.cpp \
   test/btif_storage_test.cpp
 
 # Includes
@@ -151,7 +152,7 @@ include $(BUILD_STATIC_LIBRARY)
 include $(CLEAR_VARS)
 LOCAL_C_INCLUDES := $(btifCommonIncludes)
 LOCAL_SRC_FILES := $(btifTestSrc)
-LOCAL_SHARED_LIBRARIES += liblog libhardware libhardware_legacy libcutils
+LOCAL_SHARED_LIBRARIES += liblog libhardware libhardware_legacy libcutils libz
 LOCAL_STATIC_LIBRARIES += libbtcore libbtif libosi
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE := net_test_btif
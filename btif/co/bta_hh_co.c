@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <linux/uhid.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -159,26 +160,32 @@ static void lst_free_cb (void * rpt_id)
     rpt_id = NULL;
 }
 
-/*Internal function to perform UHID write and error checking*/
-static int uhid_write(int fd, const struct uhid_event *ev)
+/*Internal function to perform UHID write of the first |len| bytes of |ev| and error checking*/
+static int uhid_write_len(int fd, const struct uhid_event *ev, size_t len)
 {
     ssize_t ret;
-    OSI_NO_INTR(ret = write(fd, ev, sizeof(*ev)));
+    OSI_NO_INTR(ret = write(fd, ev, len));
 
     if (ret < 0){
         int rtn = -errno;
         APPL_TRACE_ERROR("%s: Cannot write to uhid:%s",
                          __FUNCTION__, strerror(errno));
         return rtn;
-    } else if (ret != (ssize_t)sizeof(*ev)) {
+    } else if (ret != (ssize_t)len) {
         APPL_TRACE_ERROR("%s: Wrong size written to uhid: %zd != %zu",
-                         __FUNCTION__, ret, sizeof(*ev));
+                         __FUNCTION__, ret, len);
         return -EFAULT;
     }
 
     return 0;
 }
 
+/*Internal function to perform UHID write and error checking*/
+static int uhid_write(int fd, const struct uhid_event *ev)
+{
+    return uhid_write_len(fd, ev, sizeof(*ev));
+}
+
 /* Internal function to parse the events received from UHID driver*/
 static int uhid_read_event(btif_hh_device_t *p_dev)
 {
@@ -424,17 +431,19 @@ int bta_hh_co_write(int fd, UINT8* rpt, UINT16 len)
     APPL_TRACE_DEBUG("%s: UHID write %d", __func__, len);
 
     struct uhid_event ev;
-    memset(&ev, 0, sizeof(ev));
-    ev.type = UHID_INPUT;
-    ev.u.input.size = len;
     if(len > sizeof(ev.u.input.data)){
         APPL_TRACE_WARNING("%s: Report size greater than allowed size",
                            __FUNCTION__);
         return -1;
     }
+
+    /* Input reports are written on every key press or mouse move, so only
+       send the part of the 4k event that is used. uhid zero fills the rest. */
+    ev.type = UHID_INPUT;
+    ev.u.input.size = len;
     memcpy(ev.u.input.data, rpt, len);
 
-    return uhid_write(fd, &ev);
+    return uhid_write_len(fd, &ev, offsetof(struct uhid_event, u.input.data) + len);
 
 }
 
@@ -26,6 +26,7 @@
 
 #include "osi/include/osi.h"
 #include "osi/include/log.h"
+#include "osi/include/thread.h"
 #include "bt_types.h"
 #include "bta_api.h"
 
@@ -187,6 +188,8 @@ typedef struct
 {
     BT_HDR               hdr;
     tBTIF_CBACK*         p_cb;    /* context switch callback */
+    thread_work_t        work;    /* queues the message on the btif thread */
+    UINT8                slab;    /* slab class the message was taken from */
 
     /* parameters passed to callback */
     UINT16               event;   /* message event id */
@@ -204,6 +207,7 @@ tBTA_SERVICE_MASK btif_get_enabled_services_mask(void);
 bt_status_t btif_enable_service(tBTA_SERVICE_ID service_id);
 bt_status_t btif_disable_service(tBTA_SERVICE_ID service_id);
 int btif_is_enabled(void);
+void btif_debug_context_switch_dump(int fd);
 
 /**
  * BTIF_Events
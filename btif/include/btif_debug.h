@@ -23,6 +23,11 @@
 // Debug API
 
 void btif_debug_init(void);
+void btif_debug_cleanup(void);
+
+// Writes out the perf trace collected since the last call (see
+// osi/include/perf_trace.h) and keeps tracing.
+void btif_debug_perf_trace_dump(int fd);
 
 // Debug helpers
 
@@ -82,8 +82,8 @@ typedef struct
     int open_count;
     int flow; // 1: outbound data flow on; 0: outbound data flow off
     btpan_conn_t conns[MAX_PAN_CONNS];
-    int congest_packet_size;
-    unsigned char congest_packet[1600]; //max ethernet packet size
+    BT_HDR *congest_buf;  // frame read from TAP that BNEP could not take yet
+    BT_HDR *spare_buf;    // preallocated RX buffer left over from the last drain
 } btpan_cb_t;
 
 
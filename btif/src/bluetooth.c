@@ -46,18 +46,22 @@
 #include <hardware/vendor.h>
 
 #include "bt_utils.h"
+#include "bta_hh_api.h"
 #include "btif_api.h"
+#include "btcore/include/module.h"
 #include "btif_common.h"
 #include "device/include/controller.h"
 #include "btif_debug.h"
 #include "btsnoop.h"
 #include "btsnoop_mem.h"
+#include "hci_layer.h"
 #include "device/include/interop.h"
 #include "osi/include/allocation_tracker.h"
 #include "osi/include/alarm.h"
 #include "osi/include/log.h"
 #include "osi/include/metrics.h"
 #include "osi/include/osi.h"
+#include "osi/include/thread.h"
 #include "osi/include/wakelock.h"
 #include "stack_manager.h"
 #include "btif_config.h"
@@ -190,6 +194,7 @@ static int disable(void) {
 
 static void cleanup(void) {
   stack_manager_get_interface()->clean_up_stack();
+  btif_debug_cleanup();
 }
 
 bool is_restricted_mode() {
@@ -378,14 +383,29 @@ static void dump(int fd, const char **arguments)
         metrics_write_base64(fd, true);
         return;
       }
+      if (strncmp(arguments[0], "--loop-stats", 12) == 0) {
+        thread_debug_dump_csv(fd);
+        return;
+      }
+      if (strncmp(arguments[0], "--perf-trace", 12) == 0) {
+        btif_debug_perf_trace_dump(fd);
+        return;
+      }
     }
     btif_debug_conn_dump(fd);
     btif_debug_bond_event_dump(fd);
     btif_debug_a2dp_dump(fd);
     btif_debug_l2c_dump(fd);
     btif_debug_config_dump(fd);
+    btif_debug_context_switch_dump(fd);
+    hci_layer_debug_dump(fd);
+#if (BTA_HH_LE_INCLUDED == TRUE)
+    BTA_HhLeDebugDump(fd);
+#endif
+    module_timeline_dump(fd);
     wakelock_debug_dump(fd);
     alarm_debug_dump(fd);
+    thread_debug_dump(fd);
 #if defined(BTSNOOP_MEM) && (BTSNOOP_MEM == TRUE)
     btif_debug_btsnoop_dump(fd);
 #endif
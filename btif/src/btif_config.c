@@ -22,8 +22,11 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -40,6 +43,7 @@
 #include "osi/include/allocator.h"
 #include "osi/include/compat.h"
 #include "osi/include/config.h"
+#include "osi/include/config_journal.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
 
@@ -57,6 +61,7 @@
 #define INFO_SECTION "Info"
 #define FILE_TIMESTAMP "TimeCreated"
 #define FILE_SOURCE "FileSource"
+#define JOURNAL_GENERATION "JournalGeneration"
 #define TIME_STRING_LENGTH sizeof("YYYY-MM-DD HH:MM:SS")
 static const char* TIME_STRING_FORMAT = "%Y-%m-%d %H:%M:%S";
 
@@ -65,15 +70,39 @@ static const char* TIME_STRING_FORMAT = "%Y-%m-%d %H:%M:%S";
 static const char *CONFIG_FILE_PATH = "bt_config.conf";
 static const char *CONFIG_BACKUP_PATH = "bt_config.bak";
 static const char *CONFIG_LEGACY_FILE_PATH = "bt_config.xml";
+static const char *CONFIG_JOURNAL_PATH = "bt_config.journal";
 #else  // !defined(OS_GENERIC)
 static const char *CONFIG_FILE_PATH = "/data/misc/bluedroid/bt_config.conf";
 static const char *CONFIG_BACKUP_PATH = "/data/misc/bluedroid/bt_config.bak";
 static const char *CONFIG_LEGACY_FILE_PATH = "/data/misc/bluedroid/bt_config.xml";
+static const char *CONFIG_JOURNAL_PATH = "/data/misc/bluedroid/bt_config.journal";
 #endif  // defined(OS_GENERIC)
 static const period_ms_t CONFIG_SETTLE_PERIOD_MS = 3000;
 
+// Once the journal grows past this size the next save rewrites the full
+// config file and starts a new journal.
+static const size_t CONFIG_JOURNAL_COMPACT_SIZE = 64 * 1024;
+
+// Events for |btif_config_write|.
+#define CONFIG_WRITE_FULL        0
+#define CONFIG_WRITE_INCREMENTAL 1
+
+// Keys that are only present in the section of a paired device.
+static const char *PAIRING_KEYS[] = {
+  "LinkKey",
+  "LE_KEY_PENC",
+  "LE_KEY_PID",
+  "LE_KEY_PCSRK",
+  "LE_KEY_LENC",
+  "LE_KEY_LCSRK"
+};
+
 static void timer_config_save_cb(void *data);
 static void btif_config_write(UINT16 event, char *p_param);
+static void btif_config_write_full(void);
+static bool btif_config_write_journal(void);
+static void btif_config_journal_record(const char *section, const char *key, const char *value);
+static bool btif_config_is_paired(const config_t *conf, const char *section);
 static bool is_factory_reset(void);
 static void delete_config_files(void);
 static void btif_config_remove_unpaired(config_t *config);
@@ -130,14 +159,28 @@ bool btif_get_address_type(const BD_ADDR bd_addr, int *p_addr_type)
     return TRUE;
 }
 
-static pthread_mutex_t lock;  // protects operations on |config|.
+static pthread_mutex_t lock;  // protects operations on |config| and the journal state below.
 static config_t *config;
 static alarm_t *config_timer;
 
+// Saves append the changes made since the last save to a journal next to the
+// config file instead of rewriting the whole file, see osi/include/config_journal.h.
+// Unpaired devices are never written to disk, so changes to them are not
+// journaled either; once such a device is paired the next save rewrites the
+// full file to pick up what was skipped.
+static pthread_mutex_t write_lock;          // serializes file writes; taken before |lock|.
+static config_journal_t *journal_pending;   // changes made since the last save.
+static config_journal_t *journal_writing;   // changes being appended; only used with |write_lock|.
+static bool journal_valid;                  // true if changes can be appended to the journal.
+static bool journal_needs_full_write;       // true if skipped changes must reach the disk.
+static int journal_generation;              // generation of the config file on disk.
+static size_t journal_size;                 // bytes in the journal file.
+
 // Module lifecycle functions
 
 static future_t *init(void) {
   pthread_mutex_init(&lock, NULL);
+  pthread_mutex_init(&write_lock, NULL);
   pthread_mutex_lock(&lock);
 
   if (is_factory_reset())
@@ -175,6 +218,23 @@ static future_t *init(void) {
     goto error;
   }
 
+  journal_pending = config_journal_new();
+  journal_writing = config_journal_new();
+  if (!journal_pending || !journal_writing) {
+    LOG_ERROR(LOG_TAG, "%s unable to allocate journal.", __func__);
+    goto error;
+  }
+
+  // Apply changes that were saved after the config file was last rewritten.
+  // Only an intact journal on top of the original file can be appended to;
+  // otherwise the next save rewrites the file and starts a new journal.
+  journal_generation = config_get_int(config, INFO_SECTION, JOURNAL_GENERATION, 0);
+  journal_valid = config_journal_replay(CONFIG_JOURNAL_PATH, config,
+                                        journal_generation, &journal_size) &&
+                  btif_config_source == ORIGINAL;
+  journal_needs_full_write = false;
+
+  // Also strips devices that were unpaired by a replayed removal.
   btif_config_remove_unpaired(config);
 
   // Cleanup temporary pairings if we have left guest mode
@@ -211,10 +271,15 @@ static future_t *init(void) {
 error:
   alarm_free(config_timer);
   config_free(config);
+  config_journal_free(journal_pending);
+  config_journal_free(journal_writing);
   pthread_mutex_unlock(&lock);
   pthread_mutex_destroy(&lock);
+  pthread_mutex_destroy(&write_lock);
   config_timer = NULL;
   config = NULL;
+  journal_pending = NULL;
+  journal_writing = NULL;
   btif_config_source = NOT_LOADED;
   return future_new_immediate(FUTURE_FAIL);
 }
@@ -243,9 +308,14 @@ static future_t *clean_up(void) {
 
   alarm_free(config_timer);
   config_free(config);
+  config_journal_free(journal_pending);
+  config_journal_free(journal_writing);
   pthread_mutex_destroy(&lock);
+  pthread_mutex_destroy(&write_lock);
   config_timer = NULL;
   config = NULL;
+  journal_pending = NULL;
+  journal_writing = NULL;
   return future_new_immediate(FUTURE_SUCCESS);
 }
 
@@ -303,8 +373,12 @@ bool btif_config_set_int(const char *section, const char *key, int value) {
   assert(section != NULL);
   assert(key != NULL);
 
+  char value_str[32] = { 0 };
+  snprintf(value_str, sizeof(value_str), "%d", value);
+
   pthread_mutex_lock(&lock);
-  config_set_int(config, section, key, value);
+  config_set_string(config, section, key, value_str);
+  btif_config_journal_record(section, key, value_str);
   pthread_mutex_unlock(&lock);
 
   return true;
@@ -338,6 +412,7 @@ bool btif_config_set_str(const char *section, const char *key, const char *value
 
   pthread_mutex_lock(&lock);
   config_set_string(config, section, key, value);
+  btif_config_journal_record(section, key, value);
   pthread_mutex_unlock(&lock);
 
   return true;
@@ -406,6 +481,7 @@ bool btif_config_set_bin(const char *section, const char *key, const uint8_t *va
 
   pthread_mutex_lock(&lock);
   config_set_string(config, section, key, str);
+  btif_config_journal_record(section, key, str);
   pthread_mutex_unlock(&lock);
 
   osi_free(str);
@@ -441,6 +517,8 @@ bool btif_config_remove(const char *section, const char *key) {
 
   pthread_mutex_lock(&lock);
   bool ret = config_remove_key(config, section, key);
+  if (ret)
+    btif_config_journal_record(section, key, NULL);
   pthread_mutex_unlock(&lock);
 
   return ret;
@@ -458,7 +536,7 @@ void btif_config_flush(void) {
   assert(config_timer != NULL);
 
   alarm_cancel(config_timer);
-  btif_config_write(0, NULL);
+  btif_config_write(CONFIG_WRITE_FULL, NULL);
 }
 
 bool btif_config_clear(void) {
@@ -467,18 +545,27 @@ bool btif_config_clear(void) {
 
   alarm_cancel(config_timer);
 
+  pthread_mutex_lock(&write_lock);
   pthread_mutex_lock(&lock);
   config_free(config);
+  config_journal_clear(journal_pending);
+
+  // The journal belongs to the config being thrown away.
+  remove(CONFIG_JOURNAL_PATH);
+  journal_valid = false;
+  journal_size = 0;
 
   config = config_new_empty();
   if (config == NULL) {
     pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&write_lock);
     return false;
   }
 
   bool ret = config_save(config, CONFIG_FILE_PATH);
   btif_config_source = RESET;
   pthread_mutex_unlock(&lock);
+  pthread_mutex_unlock(&write_lock);
   return ret;
 }
 
@@ -486,22 +573,107 @@ static void timer_config_save_cb(UNUSED_ATTR void *data) {
   // Moving file I/O to btif context instead of timer callback because
   // it usually takes a lot of time to be completed, introducing
   // delays during A2DP playback causing blips or choppiness.
-  btif_transfer_context(btif_config_write, 0, NULL, 0, NULL);
+  btif_transfer_context(btif_config_write, CONFIG_WRITE_INCREMENTAL, NULL, 0, NULL);
 }
 
-static void btif_config_write(UNUSED_ATTR UINT16 event, UNUSED_ATTR char *p_param) {
+static void btif_config_write(UINT16 event, UNUSED_ATTR char *p_param) {
   assert(config != NULL);
   assert(config_timer != NULL);
 
+  pthread_mutex_lock(&write_lock);
+  pthread_mutex_lock(&lock);
+  const bool incremental = event == CONFIG_WRITE_INCREMENTAL && journal_valid &&
+                           !journal_needs_full_write &&
+                           journal_size < CONFIG_JOURNAL_COMPACT_SIZE;
+  pthread_mutex_unlock(&lock);
+
+  if (!incremental || !btif_config_write_journal())
+    btif_config_write_full();
+  pthread_mutex_unlock(&write_lock);
+}
+
+// Rewrites the config file from a snapshot of |config| and starts a new
+// journal for it. |lock| is only held while the snapshot is taken, so config
+// readers and writers are not blocked on file I/O. Must hold |write_lock|.
+static void btif_config_write_full(void) {
   pthread_mutex_lock(&lock);
-  rename(CONFIG_FILE_PATH, CONFIG_BACKUP_PATH);
   config_t *config_paired = config_new_clone(config);
+  config_journal_clear(journal_pending);
+  journal_needs_full_write = false;
+  const int generation = journal_generation + 1;
+  pthread_mutex_unlock(&lock);
+
   btif_config_remove_unpaired(config_paired);
-  config_save(config_paired, CONFIG_FILE_PATH);
+  config_set_int(config_paired, INFO_SECTION, JOURNAL_GENERATION, generation);
+
+  rename(CONFIG_FILE_PATH, CONFIG_BACKUP_PATH);
+  const bool saved = config_save(config_paired, CONFIG_FILE_PATH);
+  size_t size = 0;
+  const bool valid = saved && config_journal_reset(CONFIG_JOURNAL_PATH, generation, &size);
   config_free(config_paired);
+
+  pthread_mutex_lock(&lock);
+  if (saved)
+    journal_generation = generation;
+  journal_valid = valid;
+  journal_size = size;
   pthread_mutex_unlock(&lock);
 }
 
+// Appends the changes made since the last save to the journal. |lock| is only
+// held to swap the pending changes out. Returns false if the journal could not
+// be written, in which case the caller must fall back to a full write. Must
+// hold |write_lock|.
+static bool btif_config_write_journal(void) {
+  pthread_mutex_lock(&lock);
+  config_journal_t *changes = journal_pending;
+  journal_pending = journal_writing;
+  journal_writing = changes;
+  size_t size = journal_size;
+  pthread_mutex_unlock(&lock);
+
+  const bool ret = config_journal_append(journal_writing, CONFIG_JOURNAL_PATH, &size);
+  // On failure the full write that follows covers these changes.
+  config_journal_clear(journal_writing);
+
+  pthread_mutex_lock(&lock);
+  journal_size = size;
+  pthread_mutex_unlock(&lock);
+  return ret;
+}
+
+// Queues a change to be appended to the journal on the next save. Changes to
+// unpaired devices are skipped, since those are not written to disk; the
+// first pairing key of a device forces a full write instead so that what was
+// skipped for it is saved too. Removals are always journaled so that keys
+// already on disk do not come back on replay. Must hold |lock|.
+static void btif_config_journal_record(const char *section, const char *key, const char *value) {
+  if (!value) {
+    config_journal_remove(journal_pending, section, key);
+    return;
+  }
+
+  if (string_is_bdaddr(section)) {
+    if (!btif_config_is_paired(config, section))
+      return;
+
+    for (size_t i = 0; i < ARRAY_SIZE(PAIRING_KEYS); ++i) {
+      if (!strcmp(key, PAIRING_KEYS[i]))
+        journal_needs_full_write = true;
+    }
+  }
+
+  config_journal_set(journal_pending, section, key, value);
+}
+
+static bool btif_config_is_paired(const config_t *conf, const char *section) {
+  for (size_t i = 0; i < ARRAY_SIZE(PAIRING_KEYS); ++i) {
+    if (config_has_key(conf, section, PAIRING_KEYS[i]))
+      return true;
+  }
+  return false;
+}
+
 static void btif_config_remove_unpaired(config_t *conf) {
   assert(conf != NULL);
   int paired_devices = 0;
@@ -513,12 +685,7 @@ static void btif_config_remove_unpaired(config_t *conf) {
   while (snode != config_section_end(conf)) {
     const char *section = config_section_name(snode);
     if (string_is_bdaddr(section)) {
-      if (!config_has_key(conf, section, "LinkKey") &&
-          !config_has_key(conf, section, "LE_KEY_PENC") &&
-          !config_has_key(conf, section, "LE_KEY_PID") &&
-          !config_has_key(conf, section, "LE_KEY_PCSRK") &&
-          !config_has_key(conf, section, "LE_KEY_LENC") &&
-          !config_has_key(conf, section, "LE_KEY_LCSRK")) {
+      if (!btif_config_is_paired(conf, section)) {
         snode = config_section_next(snode);
         config_remove_section(conf, section);
         continue;
@@ -558,10 +725,20 @@ void btif_debug_config_dump(int fd) {
             break;
     }
 
+    char file_source[32];
+    pthread_mutex_lock(&lock);
+    strlcpy(file_source, config_get_string(config, INFO_SECTION, FILE_SOURCE, "Original"),
+            sizeof(file_source));
+    const int generation = journal_generation;
+    const size_t size = journal_size;
+    const bool full_write_pending = !journal_valid || journal_needs_full_write;
+    pthread_mutex_unlock(&lock);
+
     dprintf(fd, "  Devices loaded: %d\n", btif_config_devices_loaded);
     dprintf(fd, "  File created/tagged: %s\n", btif_config_time_created);
-    dprintf(fd, "  File source: %s\n", config_get_string(config, INFO_SECTION,
-                                           FILE_SOURCE, "Original"));
+    dprintf(fd, "  File source: %s\n", file_source);
+    dprintf(fd, "  Journal: generation %d, %zu bytes%s\n", generation,
+            size, full_write_pending ? " (full write pending)" : "");
 }
 
 static void btif_config_remove_restricted(config_t* config) {
@@ -587,5 +764,6 @@ static bool is_factory_reset(void) {
 static void delete_config_files(void) {
   remove(CONFIG_FILE_PATH);
   remove(CONFIG_BACKUP_PATH);
+  remove(CONFIG_JOURNAL_PATH);
   property_set("persist.bluetooth.factoryreset", "false");
 }
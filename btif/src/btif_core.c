@@ -32,6 +32,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <hardware/bluetooth.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -82,6 +83,19 @@
 #define VENDOR_MAX_CMD_HDR_SIZE    (3)
 #define VENDOR_BD_ADDR_TYPE        (1)
 
+/* Context switch messages are carved out of fixed size slabs, so the BTA to
+** btif hop does not go to the heap. A class holds the message header plus an
+** inline parameter area; larger messages, and messages arriving while their
+** class is exhausted, fall back to osi_malloc. */
+#define BTIF_CS_SLAB_HEAP          0xFF
+#define BTIF_CS_BLOCK_SIZE(param)  (sizeof(tBTIF_CONTEXT_SWITCH_CBACK) + (param))
+#define BTIF_CS_SMALL_PARAM        64
+#define BTIF_CS_SMALL_BLOCKS       64
+#define BTIF_CS_MEDIUM_PARAM       256
+#define BTIF_CS_MEDIUM_BLOCKS      32
+#define BTIF_CS_LARGE_PARAM        1024
+#define BTIF_CS_LARGE_BLOCKS       8
+
 /************************************************************************************
 **  Local type definitions
 ************************************************************************************/
@@ -104,6 +118,17 @@ typedef union {
   btif_storage_write_t write_req;
 } btif_storage_req_t;
 
+typedef struct {
+    UINT16 param_size;      /* inline parameter bytes of each block */
+    UINT16 num_blocks;
+    UINT8  *p_arena;
+    void   *p_free;         /* free blocks, linked through their first word */
+    UINT16 in_use;
+    UINT16 peak_in_use;
+    UINT32 hits;
+    UINT32 exhausted;       /* fell back to the heap because the class was full */
+} btif_cs_slab_t;
+
 typedef enum {
     BTIF_CORE_STATE_DISABLED = 0,
     BTIF_CORE_STATE_ENABLING,
@@ -133,6 +158,25 @@ static uid_set_t* uid_set = NULL;
 
 static BOOLEAN ssr_triggered = FALSE;
 
+static UINT8 btif_cs_small_arena[BTIF_CS_SMALL_BLOCKS * BTIF_CS_BLOCK_SIZE(BTIF_CS_SMALL_PARAM)]
+    __attribute__ ((aligned));
+static UINT8 btif_cs_medium_arena[BTIF_CS_MEDIUM_BLOCKS * BTIF_CS_BLOCK_SIZE(BTIF_CS_MEDIUM_PARAM)]
+    __attribute__ ((aligned));
+static UINT8 btif_cs_large_arena[BTIF_CS_LARGE_BLOCKS * BTIF_CS_BLOCK_SIZE(BTIF_CS_LARGE_PARAM)]
+    __attribute__ ((aligned));
+
+/* ordered by increasing |param_size| */
+static btif_cs_slab_t btif_cs_slabs[] = {
+    { BTIF_CS_SMALL_PARAM, BTIF_CS_SMALL_BLOCKS, btif_cs_small_arena, NULL, 0, 0, 0, 0 },
+    { BTIF_CS_MEDIUM_PARAM, BTIF_CS_MEDIUM_BLOCKS, btif_cs_medium_arena, NULL, 0, 0, 0, 0 },
+    { BTIF_CS_LARGE_PARAM, BTIF_CS_LARGE_BLOCKS, btif_cs_large_arena, NULL, 0, 0, 0, 0 },
+};
+#define BTIF_CS_SLAB_COUNT (sizeof(btif_cs_slabs) / sizeof(btif_cs_slabs[0]))
+
+static pthread_mutex_t btif_cs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t btif_cs_once = PTHREAD_ONCE_INIT;
+static UINT32 btif_cs_oversized;
+
 /************************************************************************************
 **  Static functions
 ************************************************************************************/
@@ -143,6 +187,9 @@ static bool btif_fetch_property(const char *key, bt_bdaddr_t *addr);
 /* sends message to btif task */
 static void btif_sendmsg(void *p_msg);
 
+static tBTIF_CONTEXT_SWITCH_CBACK *btif_cs_msg_alloc(int param_len);
+static void btif_cs_msg_free(tBTIF_CONTEXT_SWITCH_CBACK *p_msg);
+
 /************************************************************************************
 **  Externs
 ************************************************************************************/
@@ -176,6 +223,125 @@ void bte_main_config_hci_logging(BOOLEAN enable, BOOLEAN bt_disabled);
 **
 *******************************************************************************/
 
+static void btif_cs_slabs_init(void)
+{
+    for (size_t i = 0; i < BTIF_CS_SLAB_COUNT; i++)
+    {
+        btif_cs_slab_t *p_slab = &btif_cs_slabs[i];
+        const size_t block_size = BTIF_CS_BLOCK_SIZE(p_slab->param_size);
+
+        for (UINT16 j = p_slab->num_blocks; j > 0; j--)
+        {
+            void *p_block = p_slab->p_arena + (j - 1) * block_size;
+            *(void **)p_block = p_slab->p_free;
+            p_slab->p_free = p_block;
+        }
+    }
+}
+
+/*******************************************************************************
+**
+** Function         btif_cs_msg_alloc
+**
+** Description      Allocates a context switch message with room for
+**                  |param_len| parameter bytes, from the smallest slab class
+**                  that fits, or from the heap if none has a free block.
+**
+** Returns          The message, never NULL
+**
+*******************************************************************************/
+
+static tBTIF_CONTEXT_SWITCH_CBACK *btif_cs_msg_alloc(int param_len)
+{
+    tBTIF_CONTEXT_SWITCH_CBACK *p_msg = NULL;
+    UINT8 slab = BTIF_CS_SLAB_HEAP;
+
+    pthread_once(&btif_cs_once, btif_cs_slabs_init);
+
+    pthread_mutex_lock(&btif_cs_lock);
+    for (size_t i = 0; i < BTIF_CS_SLAB_COUNT; i++)
+    {
+        btif_cs_slab_t *p_slab = &btif_cs_slabs[i];
+        if (param_len > p_slab->param_size)
+            continue;
+
+        if (p_slab->p_free == NULL)
+        {
+            p_slab->exhausted++;
+            break;
+        }
+
+        p_msg = (tBTIF_CONTEXT_SWITCH_CBACK *)p_slab->p_free;
+        p_slab->p_free = *(void **)p_msg;
+        p_slab->hits++;
+        if (++p_slab->in_use > p_slab->peak_in_use)
+            p_slab->peak_in_use = p_slab->in_use;
+        slab = (UINT8)i;
+        break;
+    }
+    if (slab == BTIF_CS_SLAB_HEAP && param_len > btif_cs_slabs[BTIF_CS_SLAB_COUNT - 1].param_size)
+        btif_cs_oversized++;
+    pthread_mutex_unlock(&btif_cs_lock);
+
+    if (p_msg == NULL)
+        p_msg = (tBTIF_CONTEXT_SWITCH_CBACK *)osi_malloc(sizeof(tBTIF_CONTEXT_SWITCH_CBACK) + param_len);
+    p_msg->slab = slab;
+    return p_msg;
+}
+
+/*******************************************************************************
+**
+** Function         btif_cs_msg_free
+**
+** Description      Returns a context switch message to its slab, or to the
+**                  heap if it was allocated there.
+**
+** Returns          void
+**
+*******************************************************************************/
+
+static void btif_cs_msg_free(tBTIF_CONTEXT_SWITCH_CBACK *p_msg)
+{
+    if (p_msg->slab == BTIF_CS_SLAB_HEAP)
+    {
+        osi_free(p_msg);
+        return;
+    }
+
+    btif_cs_slab_t *p_slab = &btif_cs_slabs[p_msg->slab];
+    pthread_mutex_lock(&btif_cs_lock);
+    *(void **)p_msg = p_slab->p_free;
+    p_slab->p_free = p_msg;
+    p_slab->in_use--;
+    pthread_mutex_unlock(&btif_cs_lock);
+}
+
+/*******************************************************************************
+**
+** Function         btif_debug_context_switch_dump
+**
+** Description      Dumps the context switch slab counters to |fd|
+**
+** Returns          void
+**
+*******************************************************************************/
+
+void btif_debug_context_switch_dump(int fd)
+{
+    dprintf(fd, "\nbtif context switch messages:\n");
+
+    pthread_mutex_lock(&btif_cs_lock);
+    for (size_t i = 0; i < BTIF_CS_SLAB_COUNT; i++)
+    {
+        const btif_cs_slab_t *p_slab = &btif_cs_slabs[i];
+        dprintf(fd, "  %4d byte slab: %u hits, %u exhausted, %d/%d in use, peak %d\n",
+                p_slab->param_size, p_slab->hits, p_slab->exhausted,
+                p_slab->in_use, p_slab->num_blocks, p_slab->peak_in_use);
+    }
+    dprintf(fd, "  oversized (heap): %u\n", btif_cs_oversized);
+    pthread_mutex_unlock(&btif_cs_lock);
+}
+
 static void btif_context_switched(void *p_msg)
 {
 
@@ -207,8 +373,7 @@ static void btif_context_switched(void *p_msg)
 
 bt_status_t btif_transfer_context (tBTIF_CBACK *p_cback, UINT16 event, char* p_params, int param_len, tBTIF_COPY_CBACK *p_copy_cback)
 {
-    tBTIF_CONTEXT_SWITCH_CBACK *p_msg =
-        (tBTIF_CONTEXT_SWITCH_CBACK *)osi_malloc(sizeof(tBTIF_CONTEXT_SWITCH_CBACK) + param_len);
+    tBTIF_CONTEXT_SWITCH_CBACK *p_msg = btif_cs_msg_alloc(param_len);
 
     BTIF_TRACE_VERBOSE("btif_transfer_context event %d, len %d", event, param_len);
 
@@ -291,14 +456,15 @@ static void bt_jni_msg_ready(void *context) {
       BTIF_TRACE_ERROR("unhandled btif event (%d)", p_msg->event & BT_EVT_MASK);
       break;
   }
-  osi_free(p_msg);
+  btif_cs_msg_free((tBTIF_CONTEXT_SWITCH_CBACK *)p_msg);
 }
 
 /*******************************************************************************
 **
 ** Function         btif_sendmsg
 **
-** Description      Sends msg to BTIF task
+** Description      Sends a context switch msg to BTIF task. The message
+**                  carries its own work item, so posting does not allocate.
 **
 ** Returns          void
 **
@@ -306,13 +472,17 @@ static void bt_jni_msg_ready(void *context) {
 
 void btif_sendmsg(void *p_msg)
 {
+  tBTIF_CONTEXT_SWITCH_CBACK *p = (tBTIF_CONTEXT_SWITCH_CBACK *)p_msg;
+
   if (!bt_jni_workqueue_thread) {
     BTIF_TRACE_ERROR("%s: message dropped, queue not initialized or gone", __func__);
-    osi_free(p_msg);
+    btif_cs_msg_free(p);
     return;
   }
 
-  thread_post(bt_jni_workqueue_thread, bt_jni_msg_ready, p_msg);
+  p->work.func = bt_jni_msg_ready;
+  p->work.context = p;
+  thread_post_work(bt_jni_workqueue_thread, &p->work);
 }
 
 void btif_thread_post(thread_fn func, void *context) {
@@ -16,6 +16,8 @@
  *
  ******************************************************************************/
 
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
 
@@ -24,14 +26,60 @@
 #include "btif/include/btif_debug_conn.h"
 #include "btif/include/btif_media.h"
 #include "include/bt_target.h"
+#include "osi/include/perf_trace.h"
+#include "osi/include/properties.h"
+#include "osi/include/reactor.h"
 #include "osi/include/wakelock.h"
 
+static const char *PERF_TRACE_JSON_PATH = "/data/misc/bluetooth/logs/perf_trace.json";
+
+static bool perf_trace_enabled;
+static perf_trace_mode_t perf_trace_mode;
+
 void btif_debug_init(void) {
+  char loop_stats[PROPERTY_VALUE_MAX];
+  osi_property_get("persist.bluetooth.loopstats", loop_stats, "false");
+  reactor_set_stats_enabled(!strcmp(loop_stats, "true"));
+
+  // "ftrace" streams markers next to the kernel trace, "json" buffers them
+  // until the next dump.
+  char perf_trace[PROPERTY_VALUE_MAX];
+  osi_property_get("persist.bluetooth.perftrace", perf_trace, "off");
+  if (!strcmp(perf_trace, "ftrace") || !strcmp(perf_trace, "json")) {
+    perf_trace_mode = !strcmp(perf_trace, "ftrace") ? PERF_TRACE_FTRACE : PERF_TRACE_JSON;
+    perf_trace_enabled = perf_trace_start(perf_trace_mode, PERF_TRACE_JSON_PATH);
+  }
+
 #if defined(BTSNOOP_MEM) && (BTSNOOP_MEM == TRUE)
   btif_debug_btsnoop_init();
 #endif
 }
 
+void btif_debug_cleanup(void) {
+  // The stack threads are gone by now, so no thread is inside a marker.
+  if (perf_trace_enabled) {
+    perf_trace_stop();
+    perf_trace_enabled = false;
+  }
+  perf_trace_cleanup();
+}
+
+void btif_debug_perf_trace_dump(int fd) {
+  if (!perf_trace_enabled) {
+    dprintf(fd, "Perf trace is disabled; set persist.bluetooth.perftrace\n");
+    return;
+  }
+
+  // Restart right away so tracing carries on past the dump.
+  size_t events = perf_trace_stop();
+  perf_trace_start(perf_trace_mode, PERF_TRACE_JSON_PATH);
+
+  if (perf_trace_mode == PERF_TRACE_JSON)
+    dprintf(fd, "Wrote %zu perf trace events to %s\n", events, PERF_TRACE_JSON_PATH);
+  else
+    dprintf(fd, "Perf trace is streaming to the ftrace trace_marker\n");
+}
+
 // TODO: Find a better place for this to enable additional re-use
 uint64_t btif_debug_ts(void) {
   struct timeval tv;
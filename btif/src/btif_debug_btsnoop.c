@@ -17,32 +17,85 @@
  ******************************************************************************/
 
 #include <assert.h>
+#include <pthread.h>
 #include <resolv.h>
+#include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 
 #include "btif/include/btif_debug.h"
 #include "btif/include/btif_debug_btsnoop.h"
 #include "hci/include/btsnoop_mem.h"
 #include "include/bt_target.h"
-#include "osi/include/ringbuffer.h"
+#include "include/stack_config.h"
+#include "osi/include/allocator.h"
+#include "osi/include/list.h"
+#include "osi/include/osi.h"
+#include "osi/include/thread.h"
 
 #define REDUCE_HCI_TYPE_TO_SIGNIFICANT_BITS(type) (type >> 8)
 
-// Total btsnoop memory log buffer size
+// Total btsnoop memory log buffer size, including the chunks that are not
+// compressed yet. Records are kept compressed, so this holds several times
+// more history than its size.
 #ifndef BTSNOOP_MEM_BUFFER_SIZE
 static const size_t BTSNOOP_MEM_BUFFER_SIZE = (256 * 1024);
 #endif
 
-// Block size for copying buffers (for compression/encoding etc.)
-static const size_t BLOCK_SIZE = 16384;
+// Records are collected uncompressed in chunks of this size, which are then
+// compressed one at a time on a background thread.
+static const size_t CHUNK_SIZE = 16384;
 
-// Maximum line length in bugreport (should be multiple of 4 for base64 output)
-static const uint8_t MAX_LINE_LENGTH = 128;
+// Chunks waiting for the compression thread beyond this are dropped.
+static const size_t MAX_PENDING_CHUNKS = 4;
+
+// Maximum number of L2CAP CIDs logged in full.
+#define MAX_FULL_CIDS 8
 
-static ringbuffer_t *buffer = NULL;
+// Maximum line length in bugreport (should be multiple of 4 for base64 output)
+#define MAX_LINE_LENGTH 128
+
+// Each chunk is compressed on its own as raw deflate data, ending on a full
+// flush. The chunks therefore concatenate into one valid deflate stream and
+// the dump only needs to add the zlib header, a final block and the adler32
+// of the whole stream, which is combined from the per chunk checksums.
+typedef struct {
+  size_t length;      // Compressed length of |data|.
+  size_t raw_length;  // Length of the records before compression.
+  uint32_t adler;     // adler32 of the records.
+  uint8_t data[];
+} btsnooz_chunk_t;
+
+typedef struct {
+  size_t length;
+  uint8_t data[];
+} btsnooz_raw_chunk_t;
+
+// Protects everything below, including |last_timestamp_ms|.
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static btsnooz_raw_chunk_t *staging = NULL;
+static list_t *pending_chunks = NULL;     // btsnooz_raw_chunk_t, oldest first
+static list_t *compressed_chunks = NULL;  // btsnooz_chunk_t, oldest first
+static size_t compressed_size = 0;
+static size_t raw_size = 0;
+static size_t dropped_chunks = 0;
 static uint64_t last_timestamp_ms = 0;
 
+// Held while compressing, so the dump can wait for the chunk in flight.
+// Taken before |buffer_lock| when both are needed.
+static pthread_mutex_t compress_lock = PTHREAD_MUTEX_INITIALIZER;
+static z_stream compressor;
+static thread_t *compress_thread = NULL;
+
+static uint16_t full_cids[MAX_FULL_CIDS];
+static size_t num_full_cids = 0;
+
 static size_t btsnoop_calculate_packet_length(uint16_t type, const uint8_t *data, size_t length);
+static void btsnoop_queue_staging_locked(void);
+static void btsnoop_compress_pending(void *context);
+static btsnooz_chunk_t *btsnoop_compress_chunk(const btsnooz_raw_chunk_t *raw, bool last);
+static void btsnoop_append_chunk_locked(btsnooz_chunk_t *chunk);
+static void btsnoop_evict_locked(void);
 
 static void btsnoop_cb(const uint16_t type, const uint8_t *data, const size_t length) {
   btsnooz_header_t header;
@@ -50,13 +103,15 @@ static void btsnoop_cb(const uint16_t type, const uint8_t *data, const size_t le
   size_t included_length = btsnoop_calculate_packet_length(type, data, length);
   if (included_length == 0)
     return;
+  if (included_length > CHUNK_SIZE - sizeof(btsnooz_header_t))
+    included_length = CHUNK_SIZE - sizeof(btsnooz_header_t);
 
-  // Make room in the ring buffer
+  pthread_mutex_lock(&buffer_lock);
 
-  while (ringbuffer_available(buffer) < (included_length + sizeof(btsnooz_header_t))) {
-    ringbuffer_pop(buffer, (uint8_t *)&header, sizeof(btsnooz_header_t));
-    ringbuffer_delete(buffer, header.length - 1);
-  }
+  // Make room in the staging chunk
+
+  if (staging->length + sizeof(btsnooz_header_t) + included_length > CHUNK_SIZE)
+    btsnoop_queue_staging_locked();
 
   // Insert data
 
@@ -68,8 +123,20 @@ static void btsnoop_cb(const uint16_t type, const uint8_t *data, const size_t le
   header.delta_time_ms = last_timestamp_ms ? now - last_timestamp_ms : 0;
   last_timestamp_ms = now;
 
-  ringbuffer_insert(buffer, (uint8_t *)&header, sizeof(btsnooz_header_t));
-  ringbuffer_insert(buffer, data, included_length);
+  memcpy(staging->data + staging->length, &header, sizeof(btsnooz_header_t));
+  staging->length += sizeof(btsnooz_header_t);
+  memcpy(staging->data + staging->length, data, included_length);
+  staging->length += included_length;
+
+  pthread_mutex_unlock(&buffer_lock);
+}
+
+static bool btsnoop_is_full_cid(uint16_t cid) {
+  for (size_t i = 0; i < num_full_cids; ++i) {
+    if (full_cids[i] == cid)
+      return true;
+  }
+  return false;
 }
 
 static size_t btsnoop_calculate_packet_length(uint16_t type, const uint8_t *data, size_t length) {
@@ -99,9 +166,10 @@ static size_t btsnoop_calculate_packet_length(uint16_t type, const uint8_t *data
       // Check if we have enough data for an L2CAP header
       if (length > len_hci_acl) {
         uint16_t l2cap_cid = data[L2CAP_CID_OFFSET] | (data[L2CAP_CID_OFFSET + 1] << 8);
-        if (l2cap_cid == L2CAP_SIGNALING_CID) {
+        if (l2cap_cid == L2CAP_SIGNALING_CID || btsnoop_is_full_cid(l2cap_cid)) {
           // For the signaling CID, take the full packet.
           // That way, the PSM setup is captured, allowing decoding of PSMs down the road.
+          // Channels configured for full capture are treated the same way.
           return length;
         } else {
           // Otherwise, return as much as we reasonably can
@@ -120,90 +188,277 @@ static size_t btsnoop_calculate_packet_length(uint16_t type, const uint8_t *data
   }
 }
 
-static bool btsnoop_compress(ringbuffer_t *rb_dst, ringbuffer_t *rb_src) {
-  assert(rb_dst != NULL);
-  assert(rb_src != NULL);
+// Hands the full staging chunk to the compression thread and starts a new
+// one. Must be called with |buffer_lock| held.
+static void btsnoop_queue_staging_locked(void) {
+  if (list_length(pending_chunks) >= MAX_PENDING_CHUNKS) {
+    btsnooz_raw_chunk_t *oldest = list_front(pending_chunks);
+    list_remove(pending_chunks, oldest);
+    raw_size -= oldest->length;
+    osi_free(oldest);
+    ++dropped_chunks;
+  }
 
-  z_stream zs = {.zalloc = Z_NULL, .zfree = Z_NULL, .opaque = Z_NULL};
-  if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK)
-    return false;
+  raw_size += staging->length;
+  list_append(pending_chunks, staging);
+  staging = osi_malloc(sizeof(btsnooz_raw_chunk_t) + CHUNK_SIZE);
+  staging->length = 0;
+  btsnoop_evict_locked();
 
-  bool rc = true;
-  uint8_t block_src[BLOCK_SIZE];
-  uint8_t block_dst[BLOCK_SIZE];
+  thread_post(compress_thread, btsnoop_compress_pending, NULL);
+}
 
-  const size_t num_blocks = (ringbuffer_size(rb_src) + BLOCK_SIZE - 1) / BLOCK_SIZE;
-  for (size_t i = 0; i < num_blocks; ++i) {
-    zs.avail_in = ringbuffer_peek(rb_src, i * BLOCK_SIZE, block_src, BLOCK_SIZE);
-    zs.next_in = block_src;
+// Compresses all pending chunks, oldest first. Runs on |compress_thread|.
+static void btsnoop_compress_pending(UNUSED_ATTR void *context) {
+  pthread_mutex_lock(&compress_lock);
+  for (;;) {
+    // Taking the chunk off the list keeps it from being dropped while it is
+    // compressed; holding |compress_lock| keeps the dump from missing it.
+    pthread_mutex_lock(&buffer_lock);
+    btsnooz_raw_chunk_t *raw = NULL;
+    if (!list_is_empty(pending_chunks)) {
+      raw = list_front(pending_chunks);
+      list_remove(pending_chunks, raw);
+    }
+    pthread_mutex_unlock(&buffer_lock);
+    if (raw == NULL)
+      break;
 
-    do {
-      zs.avail_out = BLOCK_SIZE;
-      zs.next_out = block_dst;
+    btsnooz_chunk_t *chunk = btsnoop_compress_chunk(raw, false);
 
-      int err = deflate(&zs, (i == num_blocks - 1) ? Z_FINISH : Z_NO_FLUSH);
-      if (err == Z_STREAM_ERROR) {
-        rc = false;
-        break;
-      }
+    pthread_mutex_lock(&buffer_lock);
+    raw_size -= raw->length;
+    btsnoop_append_chunk_locked(chunk);
+    pthread_mutex_unlock(&buffer_lock);
+    osi_free(raw);
+  }
+  pthread_mutex_unlock(&compress_lock);
+}
+
+// Compresses |raw| into a new chunk, ending the deflate stream if |last| is
+// true. Must be called with |compress_lock| held. Returns NULL on failure.
+static btsnooz_chunk_t *btsnoop_compress_chunk(const btsnooz_raw_chunk_t *raw, bool last) {
+  if (deflateReset(&compressor) != Z_OK)
+    return NULL;
+
+  // deflateBound() does not account for the empty block of a full flush.
+  const size_t bound = deflateBound(&compressor, raw->length) + 8;
+  btsnooz_chunk_t *chunk = osi_malloc(sizeof(btsnooz_chunk_t) + bound);
+
+  compressor.next_in = (Bytef *)raw->data;
+  compressor.avail_in = raw->length;
+  compressor.next_out = chunk->data;
+  compressor.avail_out = bound;
+
+  int err = deflate(&compressor, last ? Z_FINISH : Z_FULL_FLUSH);
+  if ((err != Z_OK && err != Z_STREAM_END) || compressor.avail_in != 0 ||
+      (last && err != Z_STREAM_END)) {
+    osi_free(chunk);
+    return NULL;
+  }
 
-      const size_t length = BLOCK_SIZE - zs.avail_out;
-      ringbuffer_insert(rb_dst, block_dst, length);
-    } while (zs.avail_out == 0);
+  chunk->length = bound - compressor.avail_out;
+  chunk->raw_length = raw->length;
+  chunk->adler = adler32(adler32(0L, Z_NULL, 0), raw->data, raw->length);
+
+  // Give back the slack, the budget is accounted for in compressed bytes.
+  btsnooz_chunk_t *trimmed = osi_malloc(sizeof(btsnooz_chunk_t) + chunk->length);
+  memcpy(trimmed, chunk, sizeof(btsnooz_chunk_t) + chunk->length);
+  osi_free(chunk);
+  return trimmed;
+}
+
+// Appends |chunk| to the compressed history and evicts the oldest chunks to
+// stay within budget. Must be called with |buffer_lock| held.
+static void btsnoop_append_chunk_locked(btsnooz_chunk_t *chunk) {
+  if (chunk == NULL) {
+    ++dropped_chunks;
+    return;
   }
 
-  deflateEnd(&zs);
-  return rc;
+  list_append(compressed_chunks, chunk);
+  compressed_size += chunk->length;
+  btsnoop_evict_locked();
+}
+
+// Evicts the oldest compressed chunks until they fit into the budget next to
+// the chunks waiting for compression and the staging chunk. Must be called
+// with |buffer_lock| held.
+static void btsnoop_evict_locked(void) {
+  while (compressed_size + raw_size + CHUNK_SIZE > BTSNOOP_MEM_BUFFER_SIZE &&
+         !list_is_empty(compressed_chunks)) {
+    btsnooz_chunk_t *oldest = list_front(compressed_chunks);
+    list_remove(compressed_chunks, oldest);
+    compressed_size -= oldest->length;
+    osi_free(oldest);
+  }
+}
+
+static void btsnoop_parse_full_cids(const char *cids) {
+  num_full_cids = 0;
+  while (cids != NULL && *cids != '\0' && num_full_cids < MAX_FULL_CIDS) {
+    char *end;
+    unsigned long cid = strtoul(cids, &end, 0);
+    if (end == cids)
+      break;
+    if (cid > 0 && cid <= UINT16_MAX)
+      full_cids[num_full_cids++] = cid;
+    cids = (*end == ',') ? end + 1 : end;
+  }
+}
+
+// Base64 encodes into whole lines, so output costs one write per line.
+typedef struct {
+  int fd;
+  uint8_t pending[3];
+  size_t pending_length;
+  char line[MAX_LINE_LENGTH + 5];
+  size_t line_length;
+} b64_writer_t;
+
+static void b64_write_triplet(b64_writer_t *writer, const uint8_t *in, size_t length) {
+  if (writer->line_length >= MAX_LINE_LENGTH) {
+    dprintf(writer->fd, "%.*s\n", (int)writer->line_length, writer->line);
+    writer->line_length = 0;
+  }
+  writer->line_length += b64_ntop(in, length, writer->line + writer->line_length, 5);
+}
+
+static void b64_write(b64_writer_t *writer, const uint8_t *data, size_t length) {
+  while (length > 0) {
+    writer->pending[writer->pending_length++] = *data++;
+    --length;
+    if (writer->pending_length == 3) {
+      b64_write_triplet(writer, writer->pending, 3);
+      writer->pending_length = 0;
+    }
+  }
+}
+
+static void b64_flush(b64_writer_t *writer) {
+  if (writer->pending_length > 0)
+    b64_write_triplet(writer, writer->pending, writer->pending_length);
+  writer->pending_length = 0;
+  dprintf(writer->fd, "%.*s", (int)writer->line_length, writer->line);
+  writer->line_length = 0;
 }
 
 void btif_debug_btsnoop_init(void) {
-  if (buffer == NULL)
-    buffer = ringbuffer_init(BTSNOOP_MEM_BUFFER_SIZE);
+  if (staging == NULL) {
+    // The chunks are small, a smaller window saves memory at no cost.
+    if (deflateInit2(&compressor, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -14, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+      return;
+
+    compress_thread = thread_new("btsnooz_compress");
+    if (compress_thread == NULL) {
+      deflateEnd(&compressor);
+      return;
+    }
+
+    staging = osi_malloc(sizeof(btsnooz_raw_chunk_t) + CHUNK_SIZE);
+    staging->length = 0;
+    pending_chunks = list_new(NULL);
+    compressed_chunks = list_new(NULL);
+  }
+
+  btsnoop_parse_full_cids(stack_config_get_interface()->get_btsnooz_full_cids());
   btsnoop_mem_set_callback(btsnoop_cb);
 }
 
 void btif_debug_btsnoop_dump(int fd) {
-  dprintf(fd, "--- BEGIN:BTSNOOP_LOG_SUMMARY (%zu bytes in) ---\n", ringbuffer_size(buffer));
-
-  ringbuffer_t *ringbuffer = ringbuffer_init(BTSNOOP_MEM_BUFFER_SIZE);
-  if (ringbuffer == NULL) {
-    dprintf(fd, "%s Unable to allocate memory for compression", __func__);
+  if (staging == NULL)
     return;
+
+  // No chunk is in flight while |compress_lock| is held, so the history has
+  // no holes, and the compressor is free for the dump to use.
+  pthread_mutex_lock(&compress_lock);
+
+  // Snapshot the history under |buffer_lock|. Compression and output happen
+  // after it is released, so packets are not held up by the dump.
+
+  pthread_mutex_lock(&buffer_lock);
+
+  const size_t num_compressed = list_length(compressed_chunks);
+  const size_t num_raw = list_length(pending_chunks) + 1;
+  const size_t num_chunks = num_compressed + num_raw;
+  btsnooz_chunk_t **chunks = osi_calloc(num_chunks * sizeof(btsnooz_chunk_t *));
+  btsnooz_raw_chunk_t **raws = osi_malloc(num_raw * sizeof(btsnooz_raw_chunk_t *));
+
+  size_t i = 0;
+  for (const list_node_t *node = list_begin(compressed_chunks);
+       node != list_end(compressed_chunks); node = list_next(node)) {
+    const btsnooz_chunk_t *chunk = list_node(node);
+    chunks[i] = osi_malloc(sizeof(btsnooz_chunk_t) + chunk->length);
+    memcpy(chunks[i], chunk, sizeof(btsnooz_chunk_t) + chunk->length);
+    ++i;
   }
 
-  // Prepend preamble
+  // The pending chunks stay queued for the compression thread; the dump
+  // compresses copies of them, followed by the staging chunk.
+  i = 0;
+  for (const list_node_t *node = list_begin(pending_chunks);
+       node != list_end(pending_chunks); node = list_next(node)) {
+    const btsnooz_raw_chunk_t *raw = list_node(node);
+    raws[i] = osi_malloc(sizeof(btsnooz_raw_chunk_t) + raw->length);
+    memcpy(raws[i], raw, sizeof(btsnooz_raw_chunk_t) + raw->length);
+    ++i;
+  }
+  raws[i] = osi_malloc(sizeof(btsnooz_raw_chunk_t) + staging->length);
+  memcpy(raws[i], staging, sizeof(btsnooz_raw_chunk_t) + staging->length);
+
+  const size_t total_raw_size = raw_size + staging->length;
+  const size_t total_compressed_size = compressed_size;
+  const size_t total_dropped_chunks = dropped_chunks;
 
   btsnooz_preamble_t preamble;
   preamble.version = BTSNOOZ_CURRENT_VERSION;
   preamble.last_timestamp_ms = last_timestamp_ms;
-  ringbuffer_insert(ringbuffer, (uint8_t *)&preamble, sizeof(btsnooz_preamble_t));
 
-  // Compress data
+  pthread_mutex_unlock(&buffer_lock);
+
+  // The staging chunk ends the stream.
+  bool compressed = true;
+  for (i = 0; i < num_raw; ++i) {
+    if (compressed) {
+      chunks[num_compressed + i] = btsnoop_compress_chunk(raws[i], i == num_raw - 1);
+      compressed = chunks[num_compressed + i] != NULL;
+    }
+    osi_free(raws[i]);
+  }
+  osi_free(raws);
+
+  pthread_mutex_unlock(&compress_lock);
 
-  bool rc = btsnoop_compress(ringbuffer, buffer);
-  if (rc == false) {
+  dprintf(fd, "--- BEGIN:BTSNOOP_LOG_SUMMARY (%zu bytes in, %zu compressed, %zu chunks dropped) ---\n",
+          total_raw_size, total_compressed_size, total_dropped_chunks);
+
+  if (!compressed) {
+    for (i = 0; i < num_chunks; ++i)
+      osi_free(chunks[i]);
+    osi_free(chunks);
     dprintf(fd, "%s Log compression failed", __func__);
-    goto error;
+    return;
   }
 
-  // Base64 encode & output
+  // Preamble, then a zlib stream made of the chunks
 
-  uint8_t b64_in[3] = {0};
-  char b64_out[5] = {0};
+  static const uint8_t ZLIB_HEADER[] = { 0x78, 0x9c };
+  b64_writer_t writer = { .fd = fd };
+  uLong adler = adler32(0L, Z_NULL, 0);
 
-  size_t line_length = 0;
-  while (ringbuffer_size(ringbuffer) > 0) {
-    size_t read = ringbuffer_pop(ringbuffer, b64_in, 3);
-    if (line_length >= MAX_LINE_LENGTH) {
-      dprintf(fd, "\n");
-      line_length = 0;
-    }
-    line_length += b64_ntop(b64_in, read, b64_out, 5);
-    dprintf(fd, "%s", b64_out);
+  b64_write(&writer, (uint8_t *)&preamble, sizeof(btsnooz_preamble_t));
+  b64_write(&writer, ZLIB_HEADER, sizeof(ZLIB_HEADER));
+  for (i = 0; i < num_chunks; ++i) {
+    b64_write(&writer, chunks[i]->data, chunks[i]->length);
+    adler = adler32_combine(adler, chunks[i]->adler, chunks[i]->raw_length);
+    osi_free(chunks[i]);
   }
+  osi_free(chunks);
 
-  dprintf(fd, "\n--- END:BTSNOOP_LOG_SUMMARY ---\n");
+  const uint8_t trailer[] = { adler >> 24, adler >> 16, adler >> 8, adler };
+  b64_write(&writer, trailer, sizeof(trailer));
+  b64_flush(&writer);
 
-error:
-  ringbuffer_free(ringbuffer);
+  dprintf(fd, "\n--- END:BTSNOOP_LOG_SUMMARY ---\n");
 }
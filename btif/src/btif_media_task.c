@@ -30,10 +30,6 @@
  **                 audio & video processing
  **
  ******************************************************************************/
-#ifdef BT_AUDIO_SYSTRACE_LOG
-#define ATRACE_TAG ATRACE_TAG_ALWAYS
-#endif
-
 #define LOG_TAG "bt_btif_media"
 
 #include <assert.h>
@@ -58,6 +54,8 @@
 #include "osi/include/log.h"
 #include "osi/include/metrics.h"
 #include "osi/include/mutex.h"
+#include "osi/include/perf_trace.h"
+#include "osi/include/shm_ring.h"
 #include "osi/include/thread.h"
 #include "bt_utils.h"
 #include "a2d_api.h"
@@ -105,11 +103,6 @@ OI_UINT32 contextData[CODEC_DATA_WORDS(2, SBC_CODEC_FAST_FILTER_BUFFERS)];
 OI_INT16 pcmData[15*SBC_MAX_SAMPLES_PER_FRAME*SBC_MAX_CHANNELS];
 #endif
 
-#ifdef BT_AUDIO_SYSTRACE_LOG
-#include <cutils/trace.h>
-#define PERF_SYSTRACE 1
-#endif
-
 #ifdef BTA_AV_SPLIT_A2DP_ENABLED
 #include "bta_api.h"
 #endif
@@ -731,6 +724,7 @@ static const char* dump_a2dp_ctrl_event(UINT8 event)
         CASE_RETURN_STR(A2DP_CTRL_CMD_OFFLOAD_START)
         CASE_RETURN_STR(A2DP_CTRL_CMD_OFFLOAD_SUPPORTED)
         CASE_RETURN_STR(A2DP_CTRL_CMD_OFFLOAD_NOT_SUPPORTED)
+        CASE_RETURN_STR(A2DP_CTRL_CMD_SHM_RING_SETUP)
         CASE_RETURN_STR(A2DP_CTRL_GET_CODEC_CONFIG)
         CASE_RETURN_STR(A2DP_CTRL_GET_MULTICAST_STATUS)
         CASE_RETURN_STR(A2DP_CTRL_GET_CONNECTION_STATUS)
@@ -773,6 +767,57 @@ static void a2dp_cmd_acknowledge(int status)
 }
 
 
+/*******************************************************************************
+ **
+ ** Function         btif_media_setup_shm_ring
+ **
+ ** Description      Creates the shared memory PCM ring requested by the audio
+ **                  HAL, attaches it to the audio channel and hands its
+ **                  descriptors to the HAL ahead of the ACK, so that the HAL
+ **                  only sees success once it holds the ring. Only used for
+ **                  the software encoding source path; otherwise the HAL
+ **                  keeps using the audio socket.
+ **
+ ** Returns          void
+ **
+ *******************************************************************************/
+static void btif_media_setup_shm_ring(void)
+{
+    int fds[SHM_RING_FD_COUNT];
+    UINT8 num_fds = SHM_RING_FD_COUNT;
+    shm_ring_t *ring;
+
+    if (bt_split_a2dp_enabled || btif_media_cb.peer_sep != AVDT_TSEP_SNK)
+    {
+        a2dp_cmd_acknowledge(A2DP_CTRL_ACK_UNSUPPORTED);
+        return;
+    }
+
+    ring = shm_ring_new("a2dp_pcm", A2DP_SHM_RING_SZ);
+    if (ring == NULL)
+    {
+        a2dp_cmd_acknowledge(A2DP_CTRL_ACK_UNSUPPORTED);
+        return;
+    }
+
+    /* the audio channel owns the ring from here on */
+    shm_ring_get_fds(ring, fds);
+    if (!UIPC_Ioctl(UIPC_CH_ID_AV_AUDIO, UIPC_SET_SHM_RING, ring))
+    {
+        a2dp_cmd_acknowledge(A2DP_CTRL_ACK_FAILURE);
+        return;
+    }
+
+    if (!UIPC_SendFds(UIPC_CH_ID_AV_CTRL, &num_fds, 1, fds, SHM_RING_FD_COUNT))
+    {
+        APPL_TRACE_ERROR("%s: unable to send ring to audio HAL", __func__);
+        UIPC_Ioctl(UIPC_CH_ID_AV_AUDIO, UIPC_SET_SHM_RING, NULL);
+        a2dp_cmd_acknowledge(A2DP_CTRL_ACK_FAILURE);
+        return;
+    }
+    a2dp_cmd_acknowledge(A2DP_CTRL_ACK_SUCCESS);
+}
+
 static void btif_recv_ctrl_data(void)
 {
     UINT8 cmd = 0;
@@ -1115,6 +1160,9 @@ static void btif_recv_ctrl_data(void)
             bt_split_a2dp_enabled = FALSE; //Change to FALSE later
             a2dp_cmd_acknowledge(A2DP_CTRL_ACK_SUCCESS);
             break;
+        case A2DP_CTRL_CMD_SHM_RING_SETUP:
+            btif_media_setup_shm_ring();
+            break;
         case A2DP_CTRL_GET_CONNECTION_STATUS:
             if (btif_av_is_connected())
             {
@@ -4069,9 +4117,6 @@ BOOLEAN btif_media_aa_read_feeding(tUIPC_CH_ID channel_id)
     INT32   fract_max;
     INT32   fract_threshold;
     UINT32  nb_byte_read;
-    #ifdef BT_AUDIO_SYSTRACE_LOG
-    char trace_buf[512];
-    #endif
 
     /* Get the SBC sampling rate */
     switch (btif_media_cb.encoder.s16SamplingFreq)
@@ -4167,19 +4212,7 @@ BOOLEAN btif_media_aa_read_feeding(tUIPC_CH_ID channel_id)
         btif_media_cb.stats.media_read_total_underrun_bytes += (read_size - nb_byte_read);
         btif_media_cb.stats.media_read_total_underrun_count++;
         btif_media_cb.stats.media_read_last_underrun_us = time_now_us();
-        #ifdef BT_AUDIO_SYSTRACE_LOG
-        snprintf(trace_buf, 32, "A2DP UNDERRUN read %ld ", nb_byte_read);
-
-        if (PERF_SYSTRACE)
-        {
-            ATRACE_BEGIN(trace_buf);
-        }
-
-        if (PERF_SYSTRACE)
-        {
-            ATRACE_END();
-        }
-        #endif
+        PERF_TRACE_COUNTER("a2dp_underrun_bytes", read_size - nb_byte_read);
 
         if (nb_byte_read == 0)
             return FALSE;
@@ -4267,7 +4300,9 @@ static void btif_media_aa_prep_sbc_2_send(UINT8 nb_frame,
             {
                 size_t frames  = blocm_x_subband * btif_media_cb.encoder.s16NumOfChannels;
                 memcpy_by_audio_format(btif_media_cb.encoder.as16PcmBuffer, AUDIO_FORMAT_PCM_16_BIT, btif_media_cb.encoder.as32PcmBuffer, AUDIO_FORMAT_PCM_8_24_BIT, frames);
+                PERF_TRACE_BEGIN("sbc_encode");
                 SBC_Encoder(&(btif_media_cb.encoder));
+                PERF_TRACE_END("sbc_encode");
 
                 /* Update SBC frame length */
                 p_buf->len += btif_media_cb.encoder.u16PacketLength;
@@ -4403,13 +4438,10 @@ static void btif_media_send_aa_frame(uint64_t timestamp_us)
 {
     UINT8 nb_frame_2_send = 0;
     UINT8 nb_iterations = 0;
-
-    btif_get_num_aa_frame_iteration(&nb_iterations, &nb_frame_2_send);
+    PERF_TRACE_SCOPE("a2dp_send_frames");
 
     /* get the number of frame to send */
-    #ifdef BT_AUDIO_SYSTRACE_LOG
-    char trace_buf[1024];
-    #endif
+    btif_get_num_aa_frame_iteration(&nb_iterations, &nb_frame_2_send);
 
     if (nb_frame_2_send != 0) {
         for (UINT8 counter = 0; counter < nb_iterations; counter++)
@@ -4421,22 +4453,8 @@ static void btif_media_send_aa_frame(uint64_t timestamp_us)
 
     LOG_VERBOSE(LOG_TAG, "%s Sent %d frames per iteration, %d iterations",
                         __func__, nb_frame_2_send, nb_iterations);
-    #ifdef BT_AUDIO_SYSTRACE_LOG
-    snprintf(trace_buf, 32, "btif_media_send_aa_frame:");
-    if (PERF_SYSTRACE)
-    {
-        ATRACE_BEGIN(trace_buf);
-    }
-    #endif
 
     /* send it */
-
-    #ifdef BT_AUDIO_SYSTRACE_LOG
-    if (PERF_SYSTRACE)
-    {
-        ATRACE_END();
-    }
-    #endif
     bta_av_ci_src_data_ready(BTA_AV_CHNL_AUDIO);
 }
 
@@ -5176,6 +5194,30 @@ void btif_debug_a2dp_dump(int fd)
             (unsigned long long)dequeue_stats->max_premature_scheduling_delta_us / 1000,
             (unsigned long long)ave_time_us / 1000);
 
+    //
+    // UIPC audio channel reads
+    //
+    tUIPC_READ_STATS read_stats;
+    if (UIPC_Ioctl(UIPC_CH_ID_AV_AUDIO, UIPC_GET_READ_STATS, &read_stats))
+    {
+        dprintf(fd, "  UIPC reads (total/short)                                : %llu / %llu\n",
+                (unsigned long long)read_stats.read_count,
+                (unsigned long long)read_stats.short_read_count);
+
+        ave_size = 0;
+        if (read_stats.read_count != 0)
+            ave_size = read_stats.total_bytes / read_stats.read_count;
+        dprintf(fd, "  UIPC read bytes (total/ave)                             : %llu / %zu\n",
+                (unsigned long long)read_stats.total_bytes, ave_size);
+
+        dprintf(fd, "  UIPC read wait / max read gap in ms                     : %llu / %llu\n",
+                (unsigned long long)read_stats.total_wait_us / 1000,
+                (unsigned long long)read_stats.max_read_gap_us / 1000);
+
+        dprintf(fd, "  UIPC last read time ago in ms                           : %llu\n",
+                (read_stats.last_read_us > 0) ?
+                    (unsigned long long)(now_us - read_stats.last_read_us) / 1000 : 0);
+    }
 }
 
 void btif_update_a2dp_metrics(void)
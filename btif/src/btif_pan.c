@@ -46,6 +46,7 @@
 #include <sys/prctl.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -84,8 +85,6 @@
 
 #define asrt(s) if (!(s)) BTIF_TRACE_ERROR("btif_pan: ## %s assert %s failed at line:%d ##",__FUNCTION__, #s, __LINE__)
 
-#define MIN(x, y) (((x) < (y)) ? (x) : (y))
-
 btpan_cb_t btpan_cb;
 
 static bool jni_initialized;
@@ -102,6 +101,7 @@ static void btpan_tap_fd_signaled(int fd, int type, int flags, uint32_t user_id)
 static void btpan_cleanup_conn(btpan_conn_t* conn);
 static void bta_pan_callback(tBTA_PAN_EVT event, tBTA_PAN *p_data);
 static void btu_exec_tap_fd_read(void *p_param);
+static void btpan_free_rx_bufs(void);
 
 static btpan_interface_t pan_if = {
     sizeof(pan_if),
@@ -135,6 +135,7 @@ void btif_pan_init()
     if (jni_initialized && !btpan_cb.enabled)
     {
         BTIF_TRACE_DEBUG("Enabling PAN....");
+        btpan_free_rx_bufs();
         memset(&btpan_cb, 0, sizeof(btpan_cb));
         btpan_cb.tap_fd = INVALID_FD;
         btpan_cb.flow = 1;
@@ -158,6 +159,7 @@ static void pan_disable()
             btpan_cb.tap_fd = INVALID_FD;
         }
     }
+    btpan_free_rx_bufs();
 }
 
 void btif_pan_cleanup()
@@ -446,18 +448,25 @@ int btpan_tap_send(int tap_fd, const BD_ADDR src, const BD_ADDR dst, UINT16 prot
         memcpy(&eth_hdr.h_dest, dst, ETH_ADDR_LEN);
         memcpy(&eth_hdr.h_src, src, ETH_ADDR_LEN);
         eth_hdr.h_proto = htons(proto);
-        char packet[TAP_MAX_PKT_WRITE_LEN + sizeof(tETH_HDR)];
-        memcpy(packet, &eth_hdr, sizeof(tETH_HDR));
         if (len > TAP_MAX_PKT_WRITE_LEN)
         {
             LOG_ERROR(LOG_TAG, "btpan_tap_send eth packet size:%d is exceeded limit!", len);
             return -1;
         }
-        memcpy(packet + sizeof(tETH_HDR), buf, len);
+
+        // Gather the ethernet header and the BNEP payload straight from where
+        // they live instead of flattening them into a bounce buffer first.
+        // Each write on a TAP fd is exactly one frame, so frames are never
+        // coalesced into a single writev.
+        struct iovec iov[2];
+        iov[0].iov_base = &eth_hdr;
+        iov[0].iov_len = sizeof(tETH_HDR);
+        iov[1].iov_base = (void *)buf;
+        iov[1].iov_len = len;
 
         /* Send data to network interface */
         ssize_t ret;
-        OSI_NO_INTR(ret = write(tap_fd, packet, len + sizeof(tETH_HDR)));
+        OSI_NO_INTR(ret = writev(tap_fd, iov, 2));
         BTIF_TRACE_DEBUG("ret:%d", ret);
         return (int)ret;
     }
@@ -600,25 +609,51 @@ static inline bool should_forward(tETH_HDR* hdr)
     return false;
 }
 
-static int forward_bnep(tETH_HDR* eth_hdr, BT_HDR *hdr) {
+// Returns the index of the connection |eth_hdr| should be forwarded on, or -1
+// if no connection matches the destination.
+static int find_forward_conn(const tETH_HDR* eth_hdr) {
     int broadcast = eth_hdr->h_dest[0] & 1;
 
-    // Find the right connection to send this frame over.
     for (int i = 0; i < MAX_PAN_CONNS; i++)
     {
         UINT16 handle = btpan_cb.conns[i].handle;
         if (handle != (UINT16)-1 &&
                 (broadcast || memcmp(btpan_cb.conns[i].eth_addr, eth_hdr->h_dest, sizeof(BD_ADDR)) == 0
                  || memcmp(btpan_cb.conns[i].peer, eth_hdr->h_dest, sizeof(BD_ADDR)) == 0)) {
-            int result = PAN_WriteBuf(handle, eth_hdr->h_dest, eth_hdr->h_src, ntohs(eth_hdr->h_proto), hdr, 0);
-            switch (result) {
-                case PAN_Q_SIZE_EXCEEDED:
-                    return FORWARD_CONGEST;
-                case PAN_SUCCESS:
-                    return FORWARD_SUCCESS;
-                default:
-                    return FORWARD_FAILURE;
-            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns true if forwarding |eth_hdr| now would fail with PAN_Q_SIZE_EXCEEDED.
+// PAN_WriteBuf releases the buffer on congestion, so the caller checks first
+// and keeps the frame for the next attempt instead.
+static bool forward_bnep_congested(const tETH_HDR* eth_hdr) {
+    // Broadcast frames are copied onto every link and never report congestion.
+    if (eth_hdr->h_dest[0] & 1)
+        return false;
+
+    int i = find_forward_conn(eth_hdr);
+    if (i < 0)
+        return false;
+
+    return PAN_IsTxQueueFull(btpan_cb.conns[i].handle);
+}
+
+static int forward_bnep(tETH_HDR* eth_hdr, BT_HDR *hdr) {
+    // Find the right connection to send this frame over.
+    int i = find_forward_conn(eth_hdr);
+    if (i >= 0) {
+        UINT16 handle = btpan_cb.conns[i].handle;
+        int result = PAN_WriteBuf(handle, eth_hdr->h_dest, eth_hdr->h_src, ntohs(eth_hdr->h_proto), hdr, 0);
+        switch (result) {
+            case PAN_Q_SIZE_EXCEEDED:
+                return FORWARD_CONGEST;
+            case PAN_SUCCESS:
+                return FORWARD_SUCCESS;
+            default:
+                return FORWARD_FAILURE;
         }
     }
     osi_free(hdr);
@@ -719,79 +754,102 @@ static void bta_pan_callback(tBTA_PAN_EVT event, tBTA_PAN *p_data)
     btif_transfer_context(bta_pan_callback_transfer, event, (char*)p_data, sizeof(tBTA_PAN), NULL);
 }
 
-#define IS_EXCEPTION(e) ((e) & (POLLHUP | POLLRDHUP | POLLERR | POLLNVAL))
+// Returns an RX buffer sized and offset so that a frame read from the TAP
+// driver can be handed to BNEP as is, with room for the BNEP and L2CAP headers.
+static BT_HDR *btpan_get_rx_buf(void) {
+    BT_HDR *buffer = btpan_cb.spare_buf;
+    btpan_cb.spare_buf = NULL;
+    if (buffer == NULL)
+        buffer = (BT_HDR *)osi_malloc(PAN_BUF_SIZE);
+
+    buffer->event = 0;
+    buffer->layer_specific = 0;
+    buffer->offset = PAN_MINIMUM_OFFSET;
+    buffer->len = PAN_BUF_SIZE - sizeof(BT_HDR) - buffer->offset;
+    return buffer;
+}
+
+// Keeps |buffer| around for the next read instead of freeing it.
+static void btpan_put_rx_buf(BT_HDR *buffer) {
+    if (btpan_cb.spare_buf == NULL)
+        btpan_cb.spare_buf = buffer;
+    else
+        osi_free(buffer);
+}
+
+static void btpan_free_rx_bufs(void) {
+    osi_free_and_reset((void **)&btpan_cb.congest_buf);
+    osi_free_and_reset((void **)&btpan_cb.spare_buf);
+}
+
 static void btu_exec_tap_fd_read(void *p_param) {
-    struct pollfd ufd;
     int fd = PTR_TO_INT(p_param);
 
-    if (fd == INVALID_FD || fd != btpan_cb.tap_fd)
+    if (fd == INVALID_FD || fd != btpan_cb.tap_fd) {
+        // The TAP device went away; a frame held back for it can't be sent.
+        btpan_free_rx_bufs();
         return;
+    }
 
     // Don't occupy BTU context too long, avoid buffer overruns and
     // give other profiles a chance to run by limiting the amount of memory
-    // PAN can use.
+    // PAN can use. The TAP fd is non-blocking, so all queued frames are drained
+    // in one pass and an empty driver queue shows up as EAGAIN.
     for (int i = 0; i < PAN_BUF_MAX && btif_is_enabled() && btpan_cb.flow; i++) {
-        BT_HDR *buffer = (BT_HDR *)osi_malloc(PAN_BUF_SIZE);
-        buffer->offset = PAN_MINIMUM_OFFSET;
-        buffer->len = PAN_BUF_SIZE - sizeof(BT_HDR) - buffer->offset;
+        // If we don't have an undelivered frame left over, read one from the TAP
+        // driver straight into a buffer BNEP can send without another copy.
+        BT_HDR *buffer = btpan_cb.congest_buf;
+        btpan_cb.congest_buf = NULL;
+        if (buffer == NULL) {
+            buffer = btpan_get_rx_buf();
 
-        UINT8 *packet = (UINT8 *)buffer + sizeof(BT_HDR) + buffer->offset;
-
-        // If we don't have an undelivered packet left over, pull one from the TAP driver.
-        // We save it in the congest_packet right away in case we can't deliver it in this
-        // attempt.
-        if (!btpan_cb.congest_packet_size) {
             ssize_t ret;
-            OSI_NO_INTR(ret = read(fd, btpan_cb.congest_packet,
-                                   sizeof(btpan_cb.congest_packet)));
+            OSI_NO_INTR(ret = read(fd, (UINT8 *)(buffer + 1) + buffer->offset, buffer->len));
+            if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                btpan_put_rx_buf(buffer);
+                break;
+            }
+
             switch (ret) {
                 case -1:
                     BTIF_TRACE_ERROR("%s unable to read from driver: %s", __func__, strerror(errno));
-                    osi_free(buffer);
+                    btpan_put_rx_buf(buffer);
                     //add fd back to monitor thread to try it again later
                     btsock_thread_add_fd(pan_pth, fd, 0, SOCK_THREAD_FD_RD, 0);
                     return;
                 case 0:
                     BTIF_TRACE_WARNING("%s end of file reached.", __func__);
-                    osi_free(buffer);
+                    btpan_put_rx_buf(buffer);
                     //add fd back to monitor thread to process the exception
                     btsock_thread_add_fd(pan_pth, fd, 0, SOCK_THREAD_FD_RD, 0);
                     return;
                 default:
-                    btpan_cb.congest_packet_size = ret;
+                    buffer->len = ret;
                     break;
             }
         }
 
-        memcpy(packet, btpan_cb.congest_packet, MIN(btpan_cb.congest_packet_size, buffer->len));
-        buffer->len = MIN(btpan_cb.congest_packet_size, buffer->len);
-
+        UINT8 *packet = (UINT8 *)(buffer + 1) + buffer->offset;
         if (buffer->len > sizeof(tETH_HDR) && should_forward((tETH_HDR *)packet)) {
             // Extract the ethernet header from the buffer since the PAN_WriteBuf inside
             // forward_bnep can't handle two pointers that point inside the same GKI buffer.
             tETH_HDR hdr;
             memcpy(&hdr, packet, sizeof(tETH_HDR));
 
+            // Hold on to the frame until BNEP can take it again.
+            if (forward_bnep_congested(&hdr)) {
+                btpan_cb.congest_buf = buffer;
+                break;
+            }
+
             // Skip the ethernet header.
             buffer->len -= sizeof(tETH_HDR);
             buffer->offset += sizeof(tETH_HDR);
-            if (forward_bnep(&hdr, buffer) != FORWARD_CONGEST)
-                btpan_cb.congest_packet_size = 0;
+            forward_bnep(&hdr, buffer);
         } else {
             BTIF_TRACE_WARNING("%s dropping packet of length %d", __func__, buffer->len);
-            btpan_cb.congest_packet_size = 0;
-            osi_free(buffer);
+            btpan_put_rx_buf(buffer);
         }
-
-        // Bail out of the loop if reading from the TAP fd would block.
-        ufd.fd = fd;
-        ufd.events = POLLIN;
-        ufd.revents = 0;
-
-        int ret;
-        OSI_NO_INTR(ret = poll(&ufd, 1, 0));
-        if (ret <= 0 || IS_EXCEPTION(ufd.revents))
-            break;
     }
 
     if (btpan_cb.flow) {
@@ -53,6 +53,7 @@
 #include "osi/include/list.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
+#include "sdp_api.h"
 
 /************************************************************************************
 **  Constants & Macros
@@ -804,6 +805,9 @@ bt_status_t btif_storage_add_bonded_device(bt_bdaddr_t *remote_bd_addr,
         btif_config_set_int(bdstr, "Restricted", 1);
     }
 
+    /* A new bond may be a different device behind the same address */
+    SDP_FlushDiscoveryCache(remote_bd_addr->address);
+
     /* write bonded info immediately */
     btif_config_flush();
     return ret ? BT_STATUS_SUCCESS : BT_STATUS_FAIL;
@@ -836,6 +840,7 @@ bt_status_t btif_storage_remove_bonded_device(bt_bdaddr_t *remote_bd_addr)
         ret &= btif_config_remove(bdstr, "PinLength");
     if(btif_config_exist(bdstr, "LinkKey"))
         ret &= btif_config_remove(bdstr, "LinkKey");
+    SDP_FlushDiscoveryCache(remote_bd_addr->address);
     /* write bonded info immediately */
     btif_config_flush();
     return ret ? BT_STATUS_SUCCESS : BT_STATUS_FAIL;
@@ -27,6 +27,7 @@
 #include "btif_api.h"
 #include "btif_common.h"
 #include "device/include/controller.h"
+#include "device/include/interop.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
 #include "osi/include/semaphore.h"
@@ -108,8 +109,19 @@ static void event_init_stack(void *context) {
     module_management_start();
 
     module_init(get_module(OSI_MODULE));
-    module_init(get_module(BT_UTILS_MODULE));
-    module_init(get_module(BTIF_CONFIG_MODULE));
+
+    // None of these depend on each other. stack_config is not among them: it
+    // is initialized by its first user, which may be never if the stack is
+    // not enabled.
+    const module_t *boot_modules[] = {
+      get_module(BT_UTILS_MODULE),
+      get_module(BTIF_CONFIG_MODULE),
+      get_module(INTEROP_MODULE),
+      NULL
+    };
+    if (!module_init_all(boot_modules))
+      LOG_ERROR(LOG_TAG, "%s some modules failed to initialize", __func__);
+
     btif_init_bluetooth();
 
     // stack init is synchronous, so no waiting necessary here
@@ -203,6 +215,9 @@ static void event_clean_up_stack(void *context) {
   stack_is_initialized = false;
 
   btif_cleanup_bluetooth();
+  // Modules initialized on first use may depend on any of the ones below.
+  module_clean_up_lazy();
+  module_clean_up(get_module(INTEROP_MODULE));
   module_clean_up(get_module(BTIF_CONFIG_MODULE));
   module_clean_up(get_module(BT_UTILS_MODULE));
   module_clean_up(get_module(OSI_MODULE));
@@ -0,0 +1,215 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <resolv.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "btif/include/btif_debug_btsnoop.h"
+#include "hci/include/btsnoop_mem.h"
+#include "include/stack_config.h"
+}
+
+// The dump is fed through the callback btsnoop_mem would call, with
+// timestamps that go up by one millisecond per packet.
+
+static btsnoop_data_cb btsnoop_callback;
+static uint64_t timestamp_ms;
+
+extern "C" {
+
+void btsnoop_mem_set_callback(btsnoop_data_cb cb) {
+  btsnoop_callback = cb;
+}
+
+uint64_t btif_debug_ts(void) {
+  return ++timestamp_ms;
+}
+
+static const char *get_btsnooz_full_cids(void) {
+  return "";
+}
+
+static stack_config_t stack_config = {};
+
+const stack_config_t *stack_config_get_interface(void) {
+  stack_config.get_btsnooz_full_cids = get_btsnooz_full_cids;
+  return &stack_config;
+}
+
+}  // extern "C"
+
+// A record of the decompressed log.
+struct Record {
+  uint8_t type;
+  uint16_t packet_length;
+  uint32_t delta_time_ms;
+  std::vector<uint8_t> data;
+};
+
+class BtifDebugBtsnoopTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      btif_debug_btsnoop_init();
+      ASSERT_TRUE(btsnoop_callback != NULL);
+    }
+
+    // Logs an HCI event with |sequence| in its parameters.
+    void LogEvent(uint32_t sequence) {
+      uint8_t event[] = { 0x0e, 0x08, 0x01, 0x03, 0x0c, 0x00, 0, 0, 0, 0 };
+      memcpy(event + 6, &sequence, sizeof(sequence));
+      btsnoop_callback(BT_EVT_TO_BTU_HCI_EVT, event, sizeof(event));
+    }
+
+    // Dumps the log, decodes and decompresses it and returns its records.
+    std::vector<Record> Dump(btsnooz_preamble_t *preamble) {
+      std::vector<Record> records;
+
+      FILE *fp = tmpfile();
+      EXPECT_TRUE(fp != NULL);
+      if (fp == NULL)
+        return records;
+      btif_debug_btsnoop_dump(fileno(fp));
+      rewind(fp);
+
+      // Everything between the BEGIN and END lines is base64.
+      std::string encoded;
+      char line[256];
+      bool begun = false;
+      while (fgets(line, sizeof(line), fp)) {
+        if (strstr(line, "--- BEGIN:BTSNOOP_LOG_SUMMARY")) {
+          begun = true;
+        } else if (strstr(line, "--- END:BTSNOOP_LOG_SUMMARY")) {
+          break;
+        } else if (begun) {
+          encoded.append(line, strcspn(line, "\n"));
+        }
+      }
+      fclose(fp);
+      EXPECT_TRUE(begun);
+
+      std::vector<uint8_t> decoded(encoded.size());
+      int decoded_length = b64_pton(encoded.c_str(), decoded.data(), decoded.size());
+      EXPECT_LT(static_cast<int>(sizeof(btsnooz_preamble_t)), decoded_length);
+      if (decoded_length <= static_cast<int>(sizeof(btsnooz_preamble_t)))
+        return records;
+      memcpy(preamble, decoded.data(), sizeof(btsnooz_preamble_t));
+
+      // The rest is a zlib stream, which checks its own adler32.
+      std::vector<uint8_t> raw;
+      z_stream stream = {};
+      EXPECT_EQ(Z_OK, inflateInit(&stream));
+      stream.next_in = decoded.data() + sizeof(btsnooz_preamble_t);
+      stream.avail_in = decoded_length - sizeof(btsnooz_preamble_t);
+      int err = Z_OK;
+      while (err == Z_OK) {
+        uint8_t out[4096];
+        stream.next_out = out;
+        stream.avail_out = sizeof(out);
+        err = inflate(&stream, Z_NO_FLUSH);
+        raw.insert(raw.end(), out, out + sizeof(out) - stream.avail_out);
+      }
+      inflateEnd(&stream);
+      EXPECT_EQ(Z_STREAM_END, err);
+      EXPECT_EQ(0U, stream.avail_in);
+
+      size_t offset = 0;
+      while (offset + sizeof(btsnooz_header_t) <= raw.size()) {
+        btsnooz_header_t header;
+        memcpy(&header, raw.data() + offset, sizeof(header));
+        offset += sizeof(header);
+
+        const size_t length = header.length - 1;  // -1 for the type byte.
+        EXPECT_LE(offset + length, raw.size());
+        if (offset + length > raw.size())
+          break;
+
+        Record record;
+        record.type = header.type;
+        record.packet_length = header.packet_length;
+        record.delta_time_ms = header.delta_time_ms;
+        record.data.assign(raw.begin() + offset, raw.begin() + offset + length);
+        records.push_back(record);
+        offset += length;
+      }
+      EXPECT_EQ(raw.size(), offset);
+
+      return records;
+    }
+
+    // Returns the sequence number of the event logged by LogEvent().
+    static uint32_t GetSequence(const Record& record) {
+      uint32_t sequence = 0;
+      EXPECT_EQ(10U, record.data.size());
+      if (record.data.size() == 10U)
+        memcpy(&sequence, record.data.data() + 6, sizeof(sequence));
+      return sequence;
+    }
+};
+
+TEST_F(BtifDebugBtsnoopTest, dump_records) {
+  static const uint32_t NUM_EVENTS = 100;
+  for (uint32_t i = 0; i < NUM_EVENTS; ++i)
+    LogEvent(i);
+
+  btsnooz_preamble_t preamble;
+  std::vector<Record> records = Dump(&preamble);
+  EXPECT_EQ(BTSNOOZ_CURRENT_VERSION, preamble.version);
+  EXPECT_EQ(timestamp_ms, preamble.last_timestamp_ms);
+
+  ASSERT_LE(NUM_EVENTS, records.size());
+  for (uint32_t i = 0; i < NUM_EVENTS; ++i) {
+    const Record& record = records[records.size() - NUM_EVENTS + i];
+    EXPECT_EQ(BT_EVT_TO_BTU_HCI_EVT >> 8, record.type);
+    EXPECT_EQ(11U, record.packet_length);
+    EXPECT_EQ(i, GetSequence(record));
+    if (i > 0)
+      EXPECT_EQ(1U, record.delta_time_ms);
+  }
+}
+
+// Logs far more than the buffer holds, so that chunks get compressed in the
+// background and the oldest ones evicted. The dump still decompresses into
+// whole records that end with the latest ones, in order.
+TEST_F(BtifDebugBtsnoopTest, dump_after_eviction) {
+  static const uint32_t NUM_EVENTS = 200000;
+  for (uint32_t i = 0; i < NUM_EVENTS; ++i)
+    LogEvent(i);
+
+  btsnooz_preamble_t preamble;
+  std::vector<Record> records = Dump(&preamble);
+  EXPECT_EQ(timestamp_ms, preamble.last_timestamp_ms);
+
+  ASSERT_LT(1000U, records.size());
+  ASSERT_GT(NUM_EVENTS, records.size());
+  for (size_t i = 1; i <= 1000; ++i)
+    EXPECT_EQ(NUM_EVENTS - i, GetSequence(records[records.size() - i]));
+
+  // The same log dumps the same way twice.
+  std::vector<Record> again = Dump(&preamble);
+  ASSERT_EQ(records.size(), again.size());
+  EXPECT_EQ(GetSequence(records.front()), GetSequence(again.front()));
+}
@@ -53,10 +53,15 @@ include $(CLEAR_VARS)
 
 LOCAL_C_INCLUDES := \
     $(LOCAL_PATH)/.. \
+    $(LOCAL_PATH)/../btcore/include \
+    $(LOCAL_PATH)/../hci/include \
+    $(LOCAL_PATH)/../include \
+    $(LOCAL_PATH)/../stack/include \
     $(bluetooth_C_INCLUDES)
 
 LOCAL_SRC_FILES := \
     ../osi/test/AllocationTestHarness.cpp \
+    ./test/controller_test.cpp \
     ./test/interop_test.cpp \
     ./test/classic/peer_test.cpp
 
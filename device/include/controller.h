@@ -87,7 +87,10 @@ const controller_static_t *controller_get_static_interface();
 
 const controller_t *controller_get_interface();
 
+// Like |controller_get_interface|, but talks to the given HCI layer and
+// keeps the capabilities cache in |capabilities_cache_path|.
 const controller_t *controller_get_test_interface(
     const hci_t *hci_interface,
     const hci_packet_factory_t *packet_factory_interface,
-    const hci_packet_parser_t *packet_parser_interface);
+    const hci_packet_parser_t *packet_parser_interface,
+    const char *capabilities_cache_path);
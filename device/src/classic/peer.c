@@ -83,6 +83,7 @@ EXPORT_SYMBOL const module_t classic_peer_module = {
 // Interface functions
 
 classic_peer_t *classic_peer_by_address(bt_bdaddr_t *address) {
+  module_init_lazy(&classic_peer_module);
   assert(initialized);
   assert(address != NULL);
 
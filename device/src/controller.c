@@ -21,12 +21,16 @@
 #include "device/include/controller.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "bt_types.h"
 #include "btcore/include/event_mask.h"
 #include "btcore/include/module.h"
 #include "btcore/include/version.h"
 #include "hcimsgs.h"
+#include "osi/include/allocator.h"
+#include "osi/include/config.h"
 #include "osi/include/future.h"
 #include "stack/include/btm_ble_api.h"
 #include "osi/include/log.h"
@@ -84,6 +88,65 @@ static bool secure_connections_supported;
 
 #define AWAIT_COMMAND(command) future_await(hci->transmit_command_futured(command))
 
+// The most commands |start_up| has in flight at once.
+#define MAX_BATCHED_COMMANDS 8
+
+// Commands sent back to back, with their responses collected in send order.
+typedef struct {
+  future_t *responses[MAX_BATCHED_COMMANDS];
+  size_t count;
+  size_t next;
+} command_batch_t;
+
+// Bump whenever the keys or the meaning of their values change.
+#define CAPABILITIES_CACHE_FORMAT 2
+#define CAPABILITIES_SECTION "Capabilities"
+
+#if defined(OS_GENERIC)
+#define CAPABILITIES_CACHE_PATH "bt_controller.conf"
+#else  // !defined(OS_GENERIC)
+#define CAPABILITIES_CACHE_PATH "/data/misc/bluedroid/bt_controller.conf"
+#endif  // defined(OS_GENERIC)
+
+static const char *capabilities_cache_path = CAPABILITIES_CACHE_PATH;
+
+// What |start_up| learns from the controller that only depends on its
+// firmware. Cached on disk keyed by the local version info, one key per
+// field so that the file does not depend on the layout of this struct.
+typedef struct {
+  uint8_t supported_commands[HCI_SUPPORTED_COMMANDS_ARRAY_SIZE];
+  bt_device_features_t features_classic[MAX_FEATURES_CLASSIC_PAGE_COUNT];
+  uint8_t last_features_classic_page_index;
+  bool ble_offload_features_supported;
+  uint8_t ble_white_list_size;
+  uint16_t acl_data_size_ble;
+  uint8_t acl_buffer_count_ble;
+  uint8_t ble_supported_states[BLE_SUPPORTED_STATES_SIZE];
+  bt_device_features_t features_ble;
+  uint8_t ble_resolving_list_max_size;
+  uint16_t ble_suggested_default_data_length;
+  uint8_t local_supported_codecs[MAX_LOCAL_SUPPORTED_CODECS_SIZE];
+  uint8_t number_of_local_supported_codecs;
+} controller_capabilities_t;
+
+static void discover_and_configure_controller(void);
+static void configure_cached_controller(void);
+static void send_page_0_host_support(command_batch_t *batch);
+static void send_late_host_configuration(command_batch_t *batch);
+static void batch_begin(command_batch_t *batch);
+static void batch_send(command_batch_t *batch, BT_HDR *command);
+static BT_HDR *batch_next(command_batch_t *batch);
+static void await_generic_responses(command_batch_t *batch);
+static bool load_cached_capabilities(void);
+static void save_cached_capabilities(void);
+static bool read_capabilities(const config_t *config, controller_capabilities_t *caps);
+static void write_capabilities(config_t *config, const controller_capabilities_t *caps);
+static bool get_cached_int(const config_t *config, const char *key, int max, int *value);
+static bool get_cached_bytes(const config_t *config, const char *key, uint8_t *bytes, size_t length);
+static void set_cached_bytes(config_t *config, const char *key, const uint8_t *bytes, size_t length);
+static void bytes_to_hex(const uint8_t *bytes, size_t length, char *hex);
+static bool hex_to_bytes(const char *hex, uint8_t *bytes, size_t length);
+
 // Module lifecycle functions
 
 void send_soc_log_command(bool value) {
@@ -108,28 +171,25 @@ void send_soc_log_command(bool value) {
 
 static future_t *start_up(void) {
   BT_HDR *response;
+  command_batch_t batch;
 
   // Send the initial reset command
   response = AWAIT_COMMAND(packet_factory->make_reset());
   packet_parser->parse_generic_command_complete(response);
 
-  // Request the classic buffer size next
-  response = AWAIT_COMMAND(packet_factory->make_read_buffer_size());
-  packet_parser->parse_read_buffer_size_response(
-      response, &acl_data_size_classic, &acl_buffer_count_classic);
-
-  // Tell the controller about our buffer sizes and buffer counts next
+  // Request the classic buffer size, and tell the controller about our buffer
+  // sizes and buffer counts
   // TODO(zachoverflow): factor this out. eww l2cap contamination. And why just a hardcoded 10?
-  response = AWAIT_COMMAND(
-    packet_factory->make_host_buffer_size(
+  batch_begin(&batch);
+  batch_send(&batch, packet_factory->make_read_buffer_size());
+  batch_send(&batch, packet_factory->make_host_buffer_size(
       L2CAP_MTU_SIZE,
       SCO_HOST_BUFFER_SIZE,
       L2CAP_HOST_FC_ACL_BUFS,
-      10
-    )
-  );
-
-  packet_parser->parse_generic_command_complete(response);
+      10));
+  packet_parser->parse_read_buffer_size_response(
+      batch_next(&batch), &acl_data_size_classic, &acl_buffer_count_classic);
+  packet_parser->parse_generic_command_complete(batch_next(&batch));
 
   #ifdef QLOGKIT_USERDEBUG
     send_soc_log_command(true);
@@ -141,67 +201,88 @@ static future_t *start_up(void) {
     }
   #endif
 
-  // Read the local version info off the controller next, including
-  // information such as manufacturer and supported HCI version
-  response = AWAIT_COMMAND(packet_factory->make_read_local_version_info());
-  packet_parser->parse_read_local_version_info_response(response, &bt_version);
+  // Read the local version info, including information such as manufacturer
+  // and supported HCI version, and the bluetooth address off the controller
+  batch_begin(&batch);
+  batch_send(&batch, packet_factory->make_read_local_version_info());
+  batch_send(&batch, packet_factory->make_read_bd_addr());
+  packet_parser->parse_read_local_version_info_response(batch_next(&batch), &bt_version);
+  packet_parser->parse_read_bd_addr_response(batch_next(&batch), &address);
+
+  // Everything else read from the controller only depends on its firmware,
+  // so a warm start only needs to replay the host configuration writes.
+  if (load_cached_capabilities()) {
+    LOG_INFO(LOG_TAG, "%s using cached controller capabilities", __func__);
+    configure_cached_controller();
+  } else {
+    discover_and_configure_controller();
+    save_cached_capabilities();
+  }
+
+  assert(HCI_READ_ENCR_KEY_SIZE_SUPPORTED(supported_commands));
+
+  readable = true;
+  return future_new_immediate(FUTURE_SUCCESS);
+}
 
-  // Read the bluetooth address off the controller next
-  response = AWAIT_COMMAND(packet_factory->make_read_bd_addr());
-  packet_parser->parse_read_bd_addr_response(response, &address);
+// Reads the controller capabilities, issuing the reads which don't depend on
+// each other back to back, and writes the host configuration as soon as the
+// capabilities it depends on are known.
+static void discover_and_configure_controller(void) {
+  command_batch_t batch;
+
+  // Request the controller's supported commands, page 0 of the controller
+  // features and the BLE offload features support
+  batch_begin(&batch);
+  batch_send(&batch, packet_factory->make_read_local_supported_commands());
+  batch_send(&batch, packet_factory->make_read_local_extended_features(0));
+#if (BLE_INCLUDED == TRUE)
+  batch_send(&batch, packet_factory->make_ble_read_offload_features_support());
+#endif
 
-  // Request the controller's supported commands next
-  response = AWAIT_COMMAND(packet_factory->make_read_local_supported_commands());
   packet_parser->parse_read_local_supported_commands_response(
-    response,
+    batch_next(&batch),
     supported_commands,
     HCI_SUPPORTED_COMMANDS_ARRAY_SIZE
   );
 
-  // Read page 0 of the controller features next
   uint8_t page_number = 0;
-  response = AWAIT_COMMAND(packet_factory->make_read_local_extended_features(page_number));
   packet_parser->parse_read_local_extended_features_response(
-    response,
+    batch_next(&batch),
     &page_number,
     &last_features_classic_page_index,
     features_classic,
     MAX_FEATURES_CLASSIC_PAGE_COUNT
   );
-
   assert(page_number == 0);
-  page_number++;
+
+#if (BLE_INCLUDED == TRUE)
+  packet_parser->parse_ble_read_offload_features_response(batch_next(&batch), &ble_offload_features_supported);
+#endif
 
   // Inform the controller what page 0 features we support, based on what
   // it told us it supports. We need to do this first before we request the
   // next page, because the controller's response for page 1 may be
   // dependent on what we configure from page 0
-  simple_pairing_supported = HCI_SIMPLE_PAIRING_SUPPORTED(features_classic[0].as_array);
-  if (simple_pairing_supported) {
-    response = AWAIT_COMMAND(packet_factory->make_write_simple_pairing_mode(HCI_SP_MODE_ENABLED));
-    packet_parser->parse_generic_command_complete(response);
-  }
-
-#if (BLE_INCLUDED == TRUE)
-  if (HCI_LE_SPT_SUPPORTED(features_classic[0].as_array)) {
-    uint8_t simultaneous_le_host = HCI_SIMUL_LE_BREDR_SUPPORTED(features_classic[0].as_array) ? BTM_BLE_SIMULTANEOUS_HOST : 0;
-    response = AWAIT_COMMAND(
-      packet_factory->make_ble_write_host_support(BTM_BLE_HOST_SUPPORT, simultaneous_le_host)
-    );
-
-    packet_parser->parse_generic_command_complete(response);
-
-    // If we modified the BT_HOST_SUPPORT, we will need ext. feat. page 1
-    if (last_features_classic_page_index < 1)
-      last_features_classic_page_index = 1;
-  }
-#endif
+  batch_begin(&batch);
+  send_page_0_host_support(&batch);
+  await_generic_responses(&batch);
 
   // Done telling the controller about what page 0 features we support
   // Request the remaining feature pages
+  batch_begin(&batch);
+  for (page_number = 1;
+       page_number <= last_features_classic_page_index && page_number < MAX_FEATURES_CLASSIC_PAGE_COUNT;
+       ++page_number) {
+    batch_send(&batch, packet_factory->make_read_local_extended_features(page_number));
+  }
+  page_number = 1;
   while (page_number <= last_features_classic_page_index &&
          page_number < MAX_FEATURES_CLASSIC_PAGE_COUNT) {
-    response = AWAIT_COMMAND(packet_factory->make_read_local_extended_features(page_number));
+    // A page may report more pages than page 0 did; fetch those one by one.
+    BT_HDR *response = batch.next < batch.count ?
+        batch_next(&batch) :
+        AWAIT_COMMAND(packet_factory->make_read_local_extended_features(page_number));
     packet_parser->parse_read_local_extended_features_response(
       response,
       &page_number,
@@ -212,32 +293,24 @@ static future_t *start_up(void) {
 
     page_number++;
   }
-#if (BLE_INCLUDED == TRUE)
-  // read BLE offload features support from controller
-  response = AWAIT_COMMAND(packet_factory->make_ble_read_offload_features_support());
-  packet_parser->parse_ble_read_offload_features_response(response, &ble_offload_features_supported);
-#endif
-#if (SC_MODE_INCLUDED == TRUE)
-  if(ble_offload_features_supported) {
-    secure_connections_supported = HCI_SC_CTRLR_SUPPORTED(features_classic[2].as_array);
-    if (secure_connections_supported) {
-      response = AWAIT_COMMAND(packet_factory->make_write_secure_connections_host_support(HCI_SC_MODE_ENABLED));
-      packet_parser->parse_generic_command_complete(response);
-    }
-  }
-#endif
+  // Drop responses to pages past the last one the controller reported.
+  while (batch.next < batch.count)
+    osi_free(batch_next(&batch));
 
 #if (BLE_INCLUDED == TRUE)
   ble_supported = last_features_classic_page_index >= 1 && HCI_LE_HOST_SUPPORTED(features_classic[1].as_array);
   if (ble_supported) {
-    // Request the ble white list size next
-    response = AWAIT_COMMAND(packet_factory->make_ble_read_white_list_size());
-    packet_parser->parse_ble_read_white_list_size_response(response, &ble_white_list_size);
-
-    // Request the ble buffer size next
-    response = AWAIT_COMMAND(packet_factory->make_ble_read_buffer_size());
+    // Request the ble white list size, buffer size, supported states and
+    // supported features
+    batch_begin(&batch);
+    batch_send(&batch, packet_factory->make_ble_read_white_list_size());
+    batch_send(&batch, packet_factory->make_ble_read_buffer_size());
+    batch_send(&batch, packet_factory->make_ble_read_supported_states());
+    batch_send(&batch, packet_factory->make_ble_read_local_supported_features());
+
+    packet_parser->parse_ble_read_white_list_size_response(batch_next(&batch), &ble_white_list_size);
     packet_parser->parse_ble_read_buffer_size_response(
-      response,
+      batch_next(&batch),
       &acl_data_size_ble,
       &acl_buffer_count_ble
     );
@@ -246,58 +319,322 @@ static future_t *start_up(void) {
     if (acl_data_size_ble == 0)
       acl_data_size_ble = acl_data_size_classic;
 
-    // Request the ble supported states next
-    response = AWAIT_COMMAND(packet_factory->make_ble_read_supported_states());
     packet_parser->parse_ble_read_supported_states_response(
-      response,
+      batch_next(&batch),
       ble_supported_states,
       sizeof(ble_supported_states)
     );
-
-    // Request the ble supported features next
-    response = AWAIT_COMMAND(packet_factory->make_ble_read_local_supported_features());
     packet_parser->parse_ble_read_local_supported_features_response(
-      response,
+      batch_next(&batch),
       &features_ble
     );
+  }
+#endif
 
-    if (HCI_LE_ENHANCED_PRIVACY_SUPPORTED(features_ble.as_array)) {
-        response = AWAIT_COMMAND(packet_factory->make_ble_read_resolving_list_size());
-        packet_parser->parse_ble_read_resolving_list_size_response(
-            response,
-            &ble_resolving_list_max_size);
-    }
+  // The reads which depend on the LE features and the supported commands
+  bool read_resolving_list_size = false;
+  bool read_data_length = false;
+  bool read_codecs = HCI_READ_LOCAL_CODECS_SUPPORTED(supported_commands);
 
-    if (HCI_LE_DATA_LEN_EXT_SUPPORTED(features_ble.as_array)) {
-        response = AWAIT_COMMAND(packet_factory->make_ble_read_suggested_default_data_length());
-        packet_parser->parse_ble_read_suggested_default_data_length_response(
-            response,
-            &ble_suggested_default_data_length);
-    }
+  batch_begin(&batch);
+#if (BLE_INCLUDED == TRUE)
+  if (ble_supported) {
+    read_resolving_list_size = HCI_LE_ENHANCED_PRIVACY_SUPPORTED(features_ble.as_array);
+    read_data_length = HCI_LE_DATA_LEN_EXT_SUPPORTED(features_ble.as_array);
+  }
+#endif
+  if (read_resolving_list_size)
+    batch_send(&batch, packet_factory->make_ble_read_resolving_list_size());
+  if (read_data_length)
+    batch_send(&batch, packet_factory->make_ble_read_suggested_default_data_length());
+  if (read_codecs)
+    batch_send(&batch, packet_factory->make_read_local_supported_codecs());
+
+  // The remaining host configuration can go out with them
+  size_t first_write = batch.count;
+  send_late_host_configuration(&batch);
+
+  if (read_resolving_list_size) {
+    packet_parser->parse_ble_read_resolving_list_size_response(
+        batch_next(&batch),
+        &ble_resolving_list_max_size);
+  }
+  if (read_data_length) {
+    packet_parser->parse_ble_read_suggested_default_data_length_response(
+        batch_next(&batch),
+        &ble_suggested_default_data_length);
+  }
+  if (read_codecs) {
+    packet_parser->parse_read_local_supported_codecs_response(
+        batch_next(&batch),
+        &number_of_local_supported_codecs, local_supported_codecs);
+  }
+  assert(batch.next == first_write);
+  UNUSED(first_write);
+  await_generic_responses(&batch);
+}
+
+// Writes the host configuration derived from cached capabilities. None of
+// the writes depend on each other's results, so they all go out at once.
+static void configure_cached_controller(void) {
+  command_batch_t batch;
+
+#if (BLE_INCLUDED == TRUE)
+  ble_supported = last_features_classic_page_index >= 1 && HCI_LE_HOST_SUPPORTED(features_classic[1].as_array);
+#endif
+
+  batch_begin(&batch);
+  send_page_0_host_support(&batch);
+  send_late_host_configuration(&batch);
+  await_generic_responses(&batch);
+}
+
+// Sends the writes depending on page 0 of the controller features.
+static void send_page_0_host_support(command_batch_t *batch) {
+  simple_pairing_supported = HCI_SIMPLE_PAIRING_SUPPORTED(features_classic[0].as_array);
+  if (simple_pairing_supported)
+    batch_send(batch, packet_factory->make_write_simple_pairing_mode(HCI_SP_MODE_ENABLED));
+
+#if (BLE_INCLUDED == TRUE)
+  if (HCI_LE_SPT_SUPPORTED(features_classic[0].as_array)) {
+    uint8_t simultaneous_le_host = HCI_SIMUL_LE_BREDR_SUPPORTED(features_classic[0].as_array) ? BTM_BLE_SIMULTANEOUS_HOST : 0;
+    batch_send(batch, packet_factory->make_ble_write_host_support(BTM_BLE_HOST_SUPPORT, simultaneous_le_host));
+
+    // If we modified the BT_HOST_SUPPORT, we will need ext. feat. page 1
+    if (last_features_classic_page_index < 1)
+      last_features_classic_page_index = 1;
+  }
+#endif
+}
 
-    // Set the ble event mask next
-    response = AWAIT_COMMAND(packet_factory->make_ble_set_event_mask(&BLE_EVENT_MASK));
-    packet_parser->parse_generic_command_complete(response);
+// Sends the writes depending on all the feature pages.
+static void send_late_host_configuration(command_batch_t *batch) {
+#if (SC_MODE_INCLUDED == TRUE)
+  if (ble_offload_features_supported) {
+    secure_connections_supported = HCI_SC_CTRLR_SUPPORTED(features_classic[2].as_array);
+    if (secure_connections_supported)
+      batch_send(batch, packet_factory->make_write_secure_connections_host_support(HCI_SC_MODE_ENABLED));
   }
 #endif
 
-  if (simple_pairing_supported) {
-    response = AWAIT_COMMAND(packet_factory->make_set_event_mask(&CLASSIC_EVENT_MASK));
-    packet_parser->parse_generic_command_complete(response);
+#if (BLE_INCLUDED == TRUE)
+  if (ble_supported)
+    batch_send(batch, packet_factory->make_ble_set_event_mask(&BLE_EVENT_MASK));
+#endif
+
+  if (simple_pairing_supported)
+    batch_send(batch, packet_factory->make_set_event_mask(&CLASSIC_EVENT_MASK));
+}
+
+static void batch_begin(command_batch_t *batch) {
+  batch->count = 0;
+  batch->next = 0;
+}
+
+static void batch_send(command_batch_t *batch, BT_HDR *command) {
+  assert(batch->count < MAX_BATCHED_COMMANDS);
+  batch->responses[batch->count++] = hci->transmit_command_futured(command);
+}
+
+// Returns the response to the next command of |batch|, in the order the
+// commands were sent.
+static BT_HDR *batch_next(command_batch_t *batch) {
+  assert(batch->next < batch->count);
+  return future_await(batch->responses[batch->next++]);
+}
+
+static void await_generic_responses(command_batch_t *batch) {
+  while (batch->next < batch->count)
+    packet_parser->parse_generic_command_complete(batch_next(batch));
+}
+
+static void make_cache_key(char *key, size_t size) {
+  snprintf(key, size, "%02x.%04x.%02x.%04x.%04x",
+      bt_version.hci_version, bt_version.hci_revision, bt_version.lmp_version,
+      bt_version.manufacturer, bt_version.lmp_subversion);
+}
+
+static bool load_cached_capabilities(void) {
+  config_t *config = config_new(capabilities_cache_path);
+  if (!config)
+    return false;
+
+  char version[32];
+  make_cache_key(version, sizeof(version));
+
+  controller_capabilities_t caps;
+  memset(&caps, 0, sizeof(caps));
+  bool loaded = config_get_int(config, CAPABILITIES_SECTION, "Format", 0) == CAPABILITIES_CACHE_FORMAT &&
+      !strcmp(config_get_string(config, CAPABILITIES_SECTION, "Version", ""), version) &&
+      read_capabilities(config, &caps);
+  config_free(config);
+
+  if (!loaded)
+    return false;
+
+  memcpy(supported_commands, caps.supported_commands, sizeof(supported_commands));
+  memcpy(features_classic, caps.features_classic, sizeof(features_classic));
+  last_features_classic_page_index = caps.last_features_classic_page_index;
+  ble_offload_features_supported = caps.ble_offload_features_supported;
+  ble_white_list_size = caps.ble_white_list_size;
+  acl_data_size_ble = caps.acl_data_size_ble;
+  acl_buffer_count_ble = caps.acl_buffer_count_ble;
+  memcpy(ble_supported_states, caps.ble_supported_states, sizeof(ble_supported_states));
+  features_ble = caps.features_ble;
+  ble_resolving_list_max_size = caps.ble_resolving_list_max_size;
+  ble_suggested_default_data_length = caps.ble_suggested_default_data_length;
+  memcpy(local_supported_codecs, caps.local_supported_codecs, sizeof(local_supported_codecs));
+  number_of_local_supported_codecs = caps.number_of_local_supported_codecs;
+  return true;
+}
+
+static void save_cached_capabilities(void) {
+  controller_capabilities_t caps;
+  memset(&caps, 0, sizeof(caps));
+
+  memcpy(caps.supported_commands, supported_commands, sizeof(supported_commands));
+  memcpy(caps.features_classic, features_classic, sizeof(features_classic));
+  caps.last_features_classic_page_index = last_features_classic_page_index;
+  caps.ble_offload_features_supported = ble_offload_features_supported;
+  caps.ble_white_list_size = ble_white_list_size;
+  caps.acl_data_size_ble = acl_data_size_ble;
+  caps.acl_buffer_count_ble = acl_buffer_count_ble;
+  memcpy(caps.ble_supported_states, ble_supported_states, sizeof(ble_supported_states));
+  caps.features_ble = features_ble;
+  caps.ble_resolving_list_max_size = ble_resolving_list_max_size;
+  caps.ble_suggested_default_data_length = ble_suggested_default_data_length;
+  memcpy(caps.local_supported_codecs, local_supported_codecs, sizeof(local_supported_codecs));
+  caps.number_of_local_supported_codecs = number_of_local_supported_codecs;
+
+  char version[32];
+  make_cache_key(version, sizeof(version));
+
+  // Only the current controller is kept; a firmware update replaces it.
+  config_t *config = config_new_empty();
+  config_set_int(config, CAPABILITIES_SECTION, "Format", CAPABILITIES_CACHE_FORMAT);
+  config_set_string(config, CAPABILITIES_SECTION, "Version", version);
+  write_capabilities(config, &caps);
+  if (!config_save(config, capabilities_cache_path))
+    LOG_WARN(LOG_TAG, "%s unable to save controller capabilities", __func__);
+  config_free(config);
+}
+
+// Reads every field of |caps| from |config|. Returns false if any of them is
+// missing or out of range.
+static bool read_capabilities(const config_t *config, controller_capabilities_t *caps) {
+  char key[32];
+  int value;
+
+  if (!get_cached_bytes(config, "SupportedCommands", caps->supported_commands, sizeof(caps->supported_commands)))
+    return false;
+
+  for (size_t i = 0; i < MAX_FEATURES_CLASSIC_PAGE_COUNT; ++i) {
+    snprintf(key, sizeof(key), "FeaturesClassicPage%zu", i);
+    if (!get_cached_bytes(config, key, caps->features_classic[i].as_array, sizeof(caps->features_classic[i].as_array)))
+      return false;
   }
 
-  // read local supported codecs
-  if(HCI_READ_LOCAL_CODECS_SUPPORTED(supported_commands)) {
-    response = AWAIT_COMMAND(packet_factory->make_read_local_supported_codecs());
-    packet_parser->parse_read_local_supported_codecs_response(
-        response,
-        &number_of_local_supported_codecs, local_supported_codecs);
+  if (!get_cached_int(config, "LastFeaturesClassicPage", UINT8_MAX, &value))
+    return false;
+  caps->last_features_classic_page_index = value;
+
+  if (!get_cached_int(config, "BleOffloadFeaturesSupported", 1, &value))
+    return false;
+  caps->ble_offload_features_supported = value;
+
+  if (!get_cached_int(config, "BleWhiteListSize", UINT8_MAX, &value))
+    return false;
+  caps->ble_white_list_size = value;
+
+  if (!get_cached_int(config, "BleAclDataSize", UINT16_MAX, &value))
+    return false;
+  caps->acl_data_size_ble = value;
+
+  if (!get_cached_int(config, "BleAclBufferCount", UINT8_MAX, &value))
+    return false;
+  caps->acl_buffer_count_ble = value;
+
+  if (!get_cached_bytes(config, "BleSupportedStates", caps->ble_supported_states, sizeof(caps->ble_supported_states)))
+    return false;
+
+  if (!get_cached_bytes(config, "BleFeatures", caps->features_ble.as_array, sizeof(caps->features_ble.as_array)))
+    return false;
+
+  if (!get_cached_int(config, "BleResolvingListMaxSize", UINT8_MAX, &value))
+    return false;
+  caps->ble_resolving_list_max_size = value;
+
+  if (!get_cached_int(config, "BleSuggestedDefaultDataLength", UINT16_MAX, &value))
+    return false;
+  caps->ble_suggested_default_data_length = value;
+
+  if (!get_cached_int(config, "LocalSupportedCodecCount", MAX_LOCAL_SUPPORTED_CODECS_SIZE, &value))
+    return false;
+  caps->number_of_local_supported_codecs = value;
+
+  return get_cached_bytes(config, "LocalSupportedCodecs", caps->local_supported_codecs, caps->number_of_local_supported_codecs);
+}
+
+static void write_capabilities(config_t *config, const controller_capabilities_t *caps) {
+  char key[32];
+
+  set_cached_bytes(config, "SupportedCommands", caps->supported_commands, sizeof(caps->supported_commands));
+  for (size_t i = 0; i < MAX_FEATURES_CLASSIC_PAGE_COUNT; ++i) {
+    snprintf(key, sizeof(key), "FeaturesClassicPage%zu", i);
+    set_cached_bytes(config, key, caps->features_classic[i].as_array, sizeof(caps->features_classic[i].as_array));
   }
+  config_set_int(config, CAPABILITIES_SECTION, "LastFeaturesClassicPage", caps->last_features_classic_page_index);
+  config_set_int(config, CAPABILITIES_SECTION, "BleOffloadFeaturesSupported", caps->ble_offload_features_supported);
+  config_set_int(config, CAPABILITIES_SECTION, "BleWhiteListSize", caps->ble_white_list_size);
+  config_set_int(config, CAPABILITIES_SECTION, "BleAclDataSize", caps->acl_data_size_ble);
+  config_set_int(config, CAPABILITIES_SECTION, "BleAclBufferCount", caps->acl_buffer_count_ble);
+  set_cached_bytes(config, "BleSupportedStates", caps->ble_supported_states, sizeof(caps->ble_supported_states));
+  set_cached_bytes(config, "BleFeatures", caps->features_ble.as_array, sizeof(caps->features_ble.as_array));
+  config_set_int(config, CAPABILITIES_SECTION, "BleResolvingListMaxSize", caps->ble_resolving_list_max_size);
+  config_set_int(config, CAPABILITIES_SECTION, "BleSuggestedDefaultDataLength", caps->ble_suggested_default_data_length);
+  config_set_int(config, CAPABILITIES_SECTION, "LocalSupportedCodecCount", caps->number_of_local_supported_codecs);
+  set_cached_bytes(config, "LocalSupportedCodecs", caps->local_supported_codecs, caps->number_of_local_supported_codecs);
+}
+
+// Reads |key| as an integer between 0 and |max|.
+static bool get_cached_int(const config_t *config, const char *key, int max, int *value) {
+  *value = config_get_int(config, CAPABILITIES_SECTION, key, -1);
+  return *value >= 0 && *value <= max;
+}
+
+// Reads |key| as exactly |length| bytes of hex.
+static bool get_cached_bytes(const config_t *config, const char *key, uint8_t *bytes, size_t length) {
+  const char *hex = config_get_string(config, CAPABILITIES_SECTION, key, NULL);
+  return hex != NULL && hex_to_bytes(hex, bytes, length);
+}
+
+static void set_cached_bytes(config_t *config, const char *key, const uint8_t *bytes, size_t length) {
+  char hex[2 * HCI_SUPPORTED_COMMANDS_ARRAY_SIZE + 1];
+  assert(length <= HCI_SUPPORTED_COMMANDS_ARRAY_SIZE);
+  bytes_to_hex(bytes, length, hex);
+  config_set_string(config, CAPABILITIES_SECTION, key, hex);
+}
+
+static void bytes_to_hex(const uint8_t *bytes, size_t length, char *hex) {
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < length; ++i) {
+    hex[2 * i] = digits[bytes[i] >> 4];
+    hex[2 * i + 1] = digits[bytes[i] & 0x0f];
+  }
+  hex[2 * length] = '\0';
+}
 
-  assert(HCI_READ_ENCR_KEY_SIZE_SUPPORTED(supported_commands));
+static bool hex_to_bytes(const char *hex, uint8_t *bytes, size_t length) {
+  if (strlen(hex) != 2 * length)
+    return false;
 
-  readable = true;
-  return future_new_immediate(FUTURE_SUCCESS);
+  for (size_t i = 0; i < length; ++i) {
+    unsigned int byte;
+    if (sscanf(&hex[2 * i], "%2x", &byte) != 1)
+      return false;
+    bytes[i] = (uint8_t)byte;
+  }
+  return true;
 }
 
 static future_t *shut_down(void) {
@@ -573,10 +910,12 @@ const controller_t *controller_get_interface() {
 const controller_t *controller_get_test_interface(
     const hci_t *hci_interface,
     const hci_packet_factory_t *packet_factory_interface,
-    const hci_packet_parser_t *packet_parser_interface) {
+    const hci_packet_parser_t *packet_parser_interface,
+    const char *capabilities_cache_path_for_test) {
 
   hci = hci_interface;
   packet_factory = packet_factory_interface;
   packet_parser = packet_parser_interface;
+  capabilities_cache_path = capabilities_cache_path_for_test;
   return &interface;
 }
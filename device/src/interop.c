@@ -19,31 +19,53 @@
 #define LOG_TAG "bt_device_interop"
 
 #include <assert.h>
-#include <string.h> // For memcmp
+#include <pthread.h>
+#include <string.h>
 
 #include "btcore/include/module.h"
 #include "device/include/interop.h"
 #include "device/include/interop_database.h"
 #include "osi/include/allocator.h"
-#include "osi/include/list.h"
+#include "osi/include/hash_map.h"
 #include "osi/include/log.h"
+#include "osi/include/prefix_trie.h"
 
 #define CASE_RETURN_STR(const) case const: return #const;
 
-static list_t *interop_list = NULL;
+#define FEATURE_BIT(feature) (1ULL << (feature))
+
+// Per-peer results are remembered for this many addresses before the memo
+// is dropped and rebuilt, so random LE addresses cannot grow it unbounded.
+static const size_t MEMO_BUCKETS = 16;
+static const size_t MEMO_MAX_PEERS = 64;
+
+// All lookups go through tries built from the static database on first use.
+// Dynamic entries are added to |addr_trie| as they come in; a memo of the
+// combined feature set is kept per peer address.
+static pthread_mutex_t interop_lock = PTHREAD_MUTEX_INITIALIZER;
+static prefix_trie_t *addr_trie = NULL;
+static prefix_trie_t *name_trie = NULL;
+static prefix_trie_t *manufacturer_trie = NULL;
+static hash_map_t *addr_memo = NULL;
 
 static const char* interop_feature_string_(const interop_feature_t feature);
-static void interop_free_entry_(void *data);
+static bool interop_bdaddr_equality_(const void *x, const void *y);
 static void interop_lazy_init_(void);
-static bool interop_match_fixed_(const interop_feature_t feature, const bt_bdaddr_t *addr);
-static bool interop_match_dynamic_(const interop_feature_t feature, const bt_bdaddr_t *addr);
+static void interop_add_fixed_addrs_(void);
+static uint64_t interop_addr_features_(const bt_bdaddr_t *addr);
 
 // Interface functions
 
 bool interop_match_addr(const interop_feature_t feature, const bt_bdaddr_t *addr) {
   assert(addr);
+  assert(feature < 64);
 
-  if (interop_match_fixed_(feature, addr) || interop_match_dynamic_(feature, addr)) {
+  pthread_mutex_lock(&interop_lock);
+  interop_lazy_init_();
+  uint64_t features = interop_addr_features_(addr);
+  pthread_mutex_unlock(&interop_lock);
+
+  if (features & FEATURE_BIT(feature)) {
     char bdstr[20] = {0};
     LOG_WARN(LOG_TAG, "%s() Device %s is a match for interop workaround %s.",
           __func__, bdaddr_to_string(addr, bdstr, sizeof(bdstr)),
@@ -56,31 +78,35 @@ bool interop_match_addr(const interop_feature_t feature, const bt_bdaddr_t *addr
 
 bool interop_match_name(const interop_feature_t feature, const char *name) {
   assert(name);
+  assert(feature < 64);
 
-  const size_t db_size = sizeof(interop_name_database) / sizeof(interop_name_entry_t);
-  for (size_t i = 0; i != db_size; ++i) {
-    if (feature == interop_name_database[i].feature &&
-        strlen(name) >= interop_name_database[i].length &&
-        strncmp(name, interop_name_database[i].name, interop_name_database[i].length) == 0) {
-      LOG_WARN(LOG_TAG, "%s() Device with name: %s is a match for interop workaround %s", __func__,
-          name, interop_feature_string_(feature));
-      return true;
-    }
+  pthread_mutex_lock(&interop_lock);
+  interop_lazy_init_();
+  uint64_t features = prefix_trie_match_prefixes(name_trie, name, strlen(name));
+  pthread_mutex_unlock(&interop_lock);
+
+  if (features & FEATURE_BIT(feature)) {
+    LOG_WARN(LOG_TAG, "%s() Device with name: %s is a match for interop workaround %s", __func__,
+        name, interop_feature_string_(feature));
+    return true;
   }
 
   return false;
 }
 
 bool interop_match_manufacturer(const interop_feature_t feature, uint16_t manufacturer) {
-  const size_t db_size = sizeof(interop_manufacturer_database) / sizeof(interop_manufacturer_t);
+  assert(feature < 64);
 
-  for (size_t i = 0; i != db_size; ++i) {
-    if (feature == interop_manufacturer_database[i].feature &&
-        manufacturer == interop_manufacturer_database[i].manufacturer) {
-      LOG_WARN(LOG_TAG, "%s() Device with manufacturer id: %d is a match for interop "
-        "workaround %s", __func__, manufacturer, interop_feature_string_(feature));
-      return true;
-    }
+  pthread_mutex_lock(&interop_lock);
+  interop_lazy_init_();
+  uint64_t features = prefix_trie_match_prefixes(manufacturer_trie, &manufacturer,
+      sizeof(manufacturer));
+  pthread_mutex_unlock(&interop_lock);
+
+  if (features & FEATURE_BIT(feature)) {
+    LOG_WARN(LOG_TAG, "%s() Device with manufacturer id: %d is a match for interop "
+      "workaround %s", __func__, manufacturer, interop_feature_string_(feature));
+    return true;
   }
 
   return false;
@@ -107,26 +133,38 @@ void interop_database_add(const uint16_t feature, const bt_bdaddr_t *addr, size_
   assert(addr);
   assert(length > 0);
   assert(length < sizeof(bt_bdaddr_t));
+  assert(feature < 64);
 
-  interop_addr_entry_t *entry = osi_calloc(sizeof(interop_addr_entry_t));
-  memcpy(&entry->addr, addr, length);
-  entry->feature = feature;
-  entry->length = length;
-
+  pthread_mutex_lock(&interop_lock);
   interop_lazy_init_();
-  list_append(interop_list, entry);
+  prefix_trie_add(addr_trie, addr, length, FEATURE_BIT(feature));
+  hash_map_clear(addr_memo);
+  pthread_mutex_unlock(&interop_lock);
 }
 
 void interop_database_clear() {
-  if (interop_list)
-    list_clear(interop_list);
+  pthread_mutex_lock(&interop_lock);
+  if (addr_trie) {
+    prefix_trie_clear(addr_trie);
+    interop_add_fixed_addrs_();
+    hash_map_clear(addr_memo);
+  }
+  pthread_mutex_unlock(&interop_lock);
 }
 
 // Module life-cycle functions
 
 static future_t *interop_clean_up(void) {
-  list_free(interop_list);
-  interop_list = NULL;
+  pthread_mutex_lock(&interop_lock);
+  prefix_trie_free(addr_trie);
+  addr_trie = NULL;
+  prefix_trie_free(name_trie);
+  name_trie = NULL;
+  prefix_trie_free(manufacturer_trie);
+  manufacturer_trie = NULL;
+  hash_map_free(addr_memo);
+  addr_memo = NULL;
+  pthread_mutex_unlock(&interop_lock);
   return future_new_immediate(FUTURE_SUCCESS);
 }
 
@@ -160,44 +198,63 @@ static const char* interop_feature_string_(const interop_feature_t feature) {
   return "UNKNOWN";
 }
 
-static void interop_free_entry_(void *data) {
-  interop_addr_entry_t *entry = (interop_addr_entry_t *)data;
-  osi_free(entry);
+static bool interop_bdaddr_equality_(const void *x, const void *y) {
+  return bdaddr_equals((bt_bdaddr_t *)x, (bt_bdaddr_t *)y);
 }
 
+// Must be called with |interop_lock| held.
 static void interop_lazy_init_(void) {
-  if (interop_list == NULL) {
-    interop_list = list_new(interop_free_entry_);
-  }
-}
+  if (addr_trie != NULL)
+    return;
 
-static bool interop_match_dynamic_(const interop_feature_t feature, const bt_bdaddr_t *addr) {
-  if (interop_list == NULL || list_length(interop_list) == 0)
-    return false;
+  addr_trie = prefix_trie_new();
+  interop_add_fixed_addrs_();
 
-  const list_node_t *node = list_begin(interop_list);
-  while (node != list_end(interop_list)) {
-    interop_addr_entry_t *entry = list_node(node);
-    assert(entry);
-
-    if (feature == entry->feature && memcmp(addr, &entry->addr, entry->length) == 0)
-      return true;
+  name_trie = prefix_trie_new();
+  const size_t name_db_size = sizeof(interop_name_database) / sizeof(interop_name_entry_t);
+  for (size_t i = 0; i != name_db_size; ++i) {
+    prefix_trie_add(name_trie, interop_name_database[i].name, interop_name_database[i].length,
+        FEATURE_BIT(interop_name_database[i].feature));
+  }
 
-    node = list_next(node);
+  manufacturer_trie = prefix_trie_new();
+  const size_t manufacturer_db_size =
+      sizeof(interop_manufacturer_database) / sizeof(interop_manufacturer_t);
+  for (size_t i = 0; i != manufacturer_db_size; ++i) {
+    uint16_t manufacturer = interop_manufacturer_database[i].manufacturer;
+    prefix_trie_add(manufacturer_trie, &manufacturer, sizeof(manufacturer),
+        FEATURE_BIT(interop_manufacturer_database[i].feature));
   }
-  return false;
-}
 
-static bool interop_match_fixed_(const interop_feature_t feature, const bt_bdaddr_t *addr) {
-  assert(addr);
+  addr_memo = hash_map_new(MEMO_BUCKETS, hash_function_bdaddr, osi_free, osi_free,
+      interop_bdaddr_equality_);
+}
 
+// Must be called with |interop_lock| held.
+static void interop_add_fixed_addrs_(void) {
   const size_t db_size = sizeof(interop_addr_database) / sizeof(interop_addr_entry_t);
   for (size_t i = 0; i != db_size; ++i) {
-    if (feature == interop_addr_database[i].feature &&
-        memcmp(addr, &interop_addr_database[i].addr, interop_addr_database[i].length) == 0) {
-      return true;
-    }
+    prefix_trie_add(addr_trie, &interop_addr_database[i].addr, interop_addr_database[i].length,
+        FEATURE_BIT(interop_addr_database[i].feature));
   }
+}
 
-  return false;
+// Returns the workarounds of all features matching |addr|, fixed and dynamic.
+// Must be called with |interop_lock| held.
+static uint64_t interop_addr_features_(const bt_bdaddr_t *addr) {
+  uint64_t *memo = hash_map_get(addr_memo, addr);
+  if (memo)
+    return *memo;
+
+  uint64_t features = prefix_trie_match_prefixes(addr_trie, addr, sizeof(bt_bdaddr_t));
+
+  if (hash_map_size(addr_memo) >= MEMO_MAX_PEERS)
+    hash_map_clear(addr_memo);
+
+  bt_bdaddr_t *key = osi_malloc(sizeof(bt_bdaddr_t));
+  bdaddr_copy(key, addr);
+  memo = osi_malloc(sizeof(uint64_t));
+  *memo = features;
+  hash_map_set(addr_memo, key, memo);
+  return features;
 }
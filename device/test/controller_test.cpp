@@ -0,0 +1,480 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "osi/test/AllocationTestHarness.h"
+
+extern "C" {
+#include "btcore/include/module.h"
+#include "device/include/controller.h"
+#include "hcidefs.h"
+#include "osi/include/allocator.h"
+#include "osi/include/config.h"
+#include "osi/include/future.h"
+#include "osi/include/osi.h"
+#include "stack/include/btm_api.h"
+#include "utils/include/bt_utils.h"
+
+extern const module_t controller_module;
+}
+
+static const char CACHE_FILE[] = "/data/local/tmp/controller_test.conf";
+
+// A controller that answers every command at once. Commands carry nothing
+// but their id, which the response echoes so that the parser can check that
+// responses are collected in the order the commands were sent.
+struct FakeController {
+  bt_version_t version;
+  uint8_t supported_commands[64];
+  bt_device_features_t features_classic[2];
+  bt_device_features_t features_ble;
+  uint8_t white_list_size;
+  uint16_t acl_data_size_ble;
+  uint8_t codecs[2];
+};
+
+static FakeController fake;
+static std::vector<uint32_t> sent;
+static size_t responses_parsed;
+static size_t max_in_flight;
+
+// Stubs for what controller.c uses outside the test interface
+extern "C" {
+const hci_t *hci_layer_get_interface() {
+  return NULL;
+}
+
+const hci_packet_factory_t *hci_packet_factory_get_interface() {
+  return NULL;
+}
+
+const hci_packet_parser_t *hci_packet_parser_get_interface() {
+  return NULL;
+}
+
+bt_soc_type get_soc_type() {
+  return BT_SOC_DEFAULT;
+}
+
+tBTM_STATUS BTM_VendorSpecificCommand(UNUSED_ATTR UINT16 opcode, UNUSED_ATTR UINT8 param_len,
+                                      UNUSED_ATTR UINT8 *p_param_buf,
+                                      UNUSED_ATTR tBTM_VSC_CMPL_CB *p_cb) {
+  return BTM_SUCCESS;
+}
+}
+
+// Identifies a command by its opcode and, for the feature page reads, the
+// page asked for.
+static uint32_t make_id(uint16_t opcode, uint8_t page) {
+  return opcode | (page << 16);
+}
+
+static BT_HDR *make_packet(uint16_t opcode, uint8_t page = 0) {
+  uint32_t id = make_id(opcode, page);
+  BT_HDR *packet = (BT_HDR *)osi_calloc(sizeof(BT_HDR) + sizeof(id));
+  packet->len = sizeof(id);
+  memcpy(packet->data, &id, sizeof(id));
+  return packet;
+}
+
+static uint32_t get_id(BT_HDR *packet) {
+  uint32_t id;
+  memcpy(&id, packet->data, sizeof(id));
+  return id;
+}
+
+static future_t *transmit_command_futured(BT_HDR *command) {
+  uint32_t id = get_id(command);
+  osi_free(command);
+
+  sent.push_back(id);
+  if (sent.size() - responses_parsed > max_in_flight)
+    max_in_flight = sent.size() - responses_parsed;
+  return future_new_immediate(make_packet(id & 0xffff, id >> 16));
+}
+
+// Checks that |response| answers |id| and frees it.
+static void expect_response(BT_HDR *response, uint32_t id) {
+  EXPECT_EQ(id, get_id(response));
+  osi_free(response);
+  responses_parsed++;
+}
+
+static BT_HDR *make_reset(void) { return make_packet(HCI_RESET); }
+static BT_HDR *make_read_buffer_size(void) { return make_packet(HCI_READ_BUFFER_SIZE); }
+static BT_HDR *make_host_buffer_size(UNUSED_ATTR uint16_t acl_size, UNUSED_ATTR uint8_t sco_size,
+                                     UNUSED_ATTR uint16_t acl_count, UNUSED_ATTR uint16_t sco_count) {
+  return make_packet(HCI_HOST_BUFFER_SIZE);
+}
+static BT_HDR *make_read_local_version_info(void) { return make_packet(HCI_READ_LOCAL_VERSION_INFO); }
+static BT_HDR *make_read_bd_addr(void) { return make_packet(HCI_READ_BD_ADDR); }
+static BT_HDR *make_read_local_supported_commands(void) { return make_packet(HCI_READ_LOCAL_SUPPORTED_CMDS); }
+static BT_HDR *make_read_local_extended_features(uint8_t page_number) {
+  return make_packet(HCI_READ_LOCAL_EXT_FEATURES, page_number);
+}
+static BT_HDR *make_write_simple_pairing_mode(UNUSED_ATTR uint8_t mode) { return make_packet(HCI_WRITE_SIMPLE_PAIRING_MODE); }
+static BT_HDR *make_write_secure_connections_host_support(UNUSED_ATTR uint8_t mode) { return make_packet(HCI_WRITE_SECURE_CONNS_SUPPORT); }
+static BT_HDR *make_set_event_mask(UNUSED_ATTR const bt_event_mask_t *event_mask) { return make_packet(HCI_SET_EVENT_MASK); }
+static BT_HDR *make_ble_write_host_support(UNUSED_ATTR uint8_t supported_host, UNUSED_ATTR uint8_t simultaneous_host) {
+  return make_packet(HCI_WRITE_LE_HOST_SUPPORT);
+}
+static BT_HDR *make_ble_read_white_list_size(void) { return make_packet(HCI_BLE_READ_WHITE_LIST_SIZE); }
+static BT_HDR *make_ble_read_buffer_size(void) { return make_packet(HCI_BLE_READ_BUFFER_SIZE); }
+static BT_HDR *make_ble_read_supported_states(void) { return make_packet(HCI_BLE_READ_SUPPORTED_STATES); }
+static BT_HDR *make_ble_read_local_supported_features(void) { return make_packet(HCI_BLE_READ_LOCAL_SPT_FEAT); }
+static BT_HDR *make_ble_read_resolving_list_size(void) { return make_packet(HCI_BLE_READ_RESOLVING_LIST_SIZE); }
+static BT_HDR *make_ble_read_suggested_default_data_length(void) { return make_packet(HCI_BLE_READ_DEFAULT_DATA_LENGTH); }
+static BT_HDR *make_ble_set_event_mask(UNUSED_ATTR const bt_event_mask_t *event_mask) { return make_packet(HCI_BLE_SET_EVENT_MASK); }
+static BT_HDR *make_read_local_supported_codecs(void) { return make_packet(HCI_READ_LOCAL_SUPPORTED_CODECS); }
+static BT_HDR *make_ble_read_offload_features_support(void) { return make_packet(HCI_BLE_VENDOR_CAP_OCF); }
+
+static void parse_generic_command_complete(BT_HDR *response) {
+  EXPECT_NE(0U, sent.size());
+  osi_free(response);
+  responses_parsed++;
+}
+
+static void parse_read_buffer_size_response(BT_HDR *response, uint16_t *data_size_ptr,
+                                            uint16_t *acl_buffer_count_ptr) {
+  expect_response(response, HCI_READ_BUFFER_SIZE);
+  *data_size_ptr = 1021;
+  *acl_buffer_count_ptr = 8;
+}
+
+static void parse_read_local_version_info_response(BT_HDR *response, bt_version_t *bt_version_ptr) {
+  expect_response(response, HCI_READ_LOCAL_VERSION_INFO);
+  *bt_version_ptr = fake.version;
+}
+
+static void parse_read_bd_addr_response(BT_HDR *response, bt_bdaddr_t *address_ptr) {
+  expect_response(response, HCI_READ_BD_ADDR);
+  memset(address_ptr, 0x42, sizeof(*address_ptr));
+}
+
+static void parse_read_local_supported_commands_response(BT_HDR *response, uint8_t *supported_commands_ptr,
+                                                         size_t supported_commands_length) {
+  expect_response(response, HCI_READ_LOCAL_SUPPORTED_CMDS);
+  memcpy(supported_commands_ptr, fake.supported_commands, supported_commands_length);
+}
+
+static void parse_read_local_extended_features_response(BT_HDR *response, uint8_t *page_number_ptr,
+                                                        uint8_t *max_page_number_ptr,
+                                                        bt_device_features_t *feature_pages,
+                                                        UNUSED_ATTR size_t feature_pages_count) {
+  uint8_t page = get_id(response) >> 16;
+  expect_response(response, make_id(HCI_READ_LOCAL_EXT_FEATURES, page));
+  ASSERT_LT(page, 2);
+  *page_number_ptr = page;
+  *max_page_number_ptr = 1;
+  feature_pages[page] = fake.features_classic[page];
+}
+
+static void parse_ble_read_white_list_size_response(BT_HDR *response, uint8_t *white_list_size_ptr) {
+  expect_response(response, HCI_BLE_READ_WHITE_LIST_SIZE);
+  *white_list_size_ptr = fake.white_list_size;
+}
+
+static void parse_ble_read_buffer_size_response(BT_HDR *response, uint16_t *data_size_ptr,
+                                                uint8_t *acl_buffer_count_ptr) {
+  expect_response(response, HCI_BLE_READ_BUFFER_SIZE);
+  *data_size_ptr = fake.acl_data_size_ble;
+  *acl_buffer_count_ptr = 4;
+}
+
+static void parse_ble_read_supported_states_response(BT_HDR *response, uint8_t *supported_states,
+                                                     size_t supported_states_size) {
+  expect_response(response, HCI_BLE_READ_SUPPORTED_STATES);
+  memset(supported_states, 0x3f, supported_states_size);
+}
+
+static void parse_ble_read_local_supported_features_response(BT_HDR *response,
+                                                             bt_device_features_t *supported_features) {
+  expect_response(response, HCI_BLE_READ_LOCAL_SPT_FEAT);
+  *supported_features = fake.features_ble;
+}
+
+static void parse_ble_read_resolving_list_size_response(BT_HDR *response, uint8_t *resolving_list_size_ptr) {
+  expect_response(response, HCI_BLE_READ_RESOLVING_LIST_SIZE);
+  *resolving_list_size_ptr = 16;
+}
+
+static void parse_ble_read_suggested_default_data_length_response(BT_HDR *response,
+                                                                  uint16_t *ble_default_packet_length_ptr) {
+  expect_response(response, HCI_BLE_READ_DEFAULT_DATA_LENGTH);
+  *ble_default_packet_length_ptr = 251;
+}
+
+static void parse_read_local_supported_codecs_response(BT_HDR *response, uint8_t *number_of_local_supported_codecs,
+                                                       uint8_t *local_supported_codecs) {
+  expect_response(response, HCI_READ_LOCAL_SUPPORTED_CODECS);
+  *number_of_local_supported_codecs = sizeof(fake.codecs);
+  memcpy(local_supported_codecs, fake.codecs, sizeof(fake.codecs));
+}
+
+static void parse_ble_read_offload_features_response(BT_HDR *response, bool *ble_offload_features_supported) {
+  expect_response(response, HCI_BLE_VENDOR_CAP_OCF);
+  *ble_offload_features_supported = true;
+}
+
+static hci_t hci;
+
+static const hci_packet_factory_t packet_factory = {
+  make_reset,
+  make_read_buffer_size,
+  make_host_buffer_size,
+  make_read_local_version_info,
+  make_read_bd_addr,
+  make_read_local_supported_commands,
+  make_read_local_extended_features,
+  make_write_simple_pairing_mode,
+  make_write_secure_connections_host_support,
+  make_set_event_mask,
+  make_ble_write_host_support,
+  make_ble_read_white_list_size,
+  make_ble_read_buffer_size,
+  make_ble_read_supported_states,
+  make_ble_read_local_supported_features,
+  make_ble_read_resolving_list_size,
+  make_ble_read_suggested_default_data_length,
+  make_ble_set_event_mask,
+  make_read_local_supported_codecs,
+  make_ble_read_offload_features_support
+};
+
+static const hci_packet_parser_t packet_parser = {
+  parse_generic_command_complete,
+  parse_read_buffer_size_response,
+  parse_read_local_version_info_response,
+  parse_read_bd_addr_response,
+  parse_read_local_supported_commands_response,
+  parse_read_local_extended_features_response,
+  parse_ble_read_white_list_size_response,
+  parse_ble_read_buffer_size_response,
+  parse_ble_read_supported_states_response,
+  parse_ble_read_local_supported_features_response,
+  parse_ble_read_resolving_list_size_response,
+  parse_ble_read_suggested_default_data_length_response,
+  parse_read_local_supported_codecs_response,
+  parse_ble_read_offload_features_response
+};
+
+class ControllerTest : public AllocationTestHarness {
+  protected:
+    virtual void SetUp() {
+      AllocationTestHarness::SetUp();
+      unlink(CACHE_FILE);
+
+      memset(&fake, 0, sizeof(fake));
+      fake.version.hci_version = HCI_PROTO_VERSION_4_2;
+      fake.version.hci_revision = 0x0100;
+      fake.version.lmp_version = HCI_PROTO_VERSION_4_2;
+      fake.version.manufacturer = 0x001d;
+      fake.version.lmp_subversion = 0x0200;
+      fake.supported_commands[HCI_SUPP_COMMANDS_READ_ENCR_KEY_SIZE_OFF] |= HCI_SUPP_COMMANDS_READ_ENCR_KEY_SIZE_MASK;
+      fake.supported_commands[HCI_SUPP_COMMANDS_READ_LOCAL_CODECS_OFF] |= HCI_SUPP_COMMANDS_READ_LOCAL_CODECS_MASK;
+      fake.features_classic[0].as_array[HCI_FEATURE_SIMPLE_PAIRING_OFF] |= HCI_FEATURE_SIMPLE_PAIRING_MASK;
+      fake.features_classic[0].as_array[HCI_FEATURE_LE_SPT_OFF] |= HCI_FEATURE_LE_SPT_MASK;
+      fake.features_classic[1].as_array[HCI_EXT_FEATURE_LE_HOST_OFF] |= HCI_EXT_FEATURE_LE_HOST_MASK;
+      fake.features_ble.as_array[HCI_LE_FEATURE_ENHANCED_PRIVACY_OFF] |= HCI_LE_FEATURE_ENHANCED_PRIVACY_MASK;
+      fake.features_ble.as_array[HCI_LE_FEATURE_DATA_LEN_EXT_OFF] |= HCI_LE_FEATURE_DATA_LEN_EXT_MASK;
+      fake.white_list_size = 32;
+      fake.acl_data_size_ble = 251;
+      fake.codecs[0] = 0x02;
+      fake.codecs[1] = 0x05;
+
+      memset(&hci, 0, sizeof(hci));
+      hci.transmit_command_futured = transmit_command_futured;
+      controller = controller_get_test_interface(&hci, &packet_factory, &packet_parser, CACHE_FILE);
+
+      module_management_start();
+    }
+
+    virtual void TearDown() {
+      module_shut_down(&controller_module);
+      module_management_stop();
+      unlink(CACHE_FILE);
+      AllocationTestHarness::TearDown();
+    }
+
+    // Restarts the controller and returns the commands it sent.
+    std::vector<uint32_t> StartUp() {
+      module_shut_down(&controller_module);
+      sent.clear();
+      responses_parsed = 0;
+      max_in_flight = 0;
+
+      EXPECT_TRUE(module_start_up(&controller_module));
+      EXPECT_TRUE(controller->get_is_ready());
+
+      EXPECT_EQ(sent.size(), responses_parsed);
+      return sent;
+    }
+
+    static size_t Count(const std::vector<uint32_t> &commands, uint16_t opcode, uint8_t page = 0) {
+      size_t count = 0;
+      for (uint32_t command : commands)
+        count += (command == make_id(opcode, page));
+      return count;
+    }
+
+    // Checks the capabilities the controller reports against |fake|.
+    void ExpectCapabilities() {
+      EXPECT_EQ(0, memcmp(&fake.features_classic[0], controller->get_features_classic(0),
+                          sizeof(bt_device_features_t)));
+      EXPECT_EQ(0, memcmp(&fake.features_classic[1], controller->get_features_classic(1),
+                          sizeof(bt_device_features_t)));
+      EXPECT_EQ(1, controller->get_last_features_classic_index());
+      EXPECT_TRUE(controller->supports_simple_pairing());
+      EXPECT_TRUE(controller->supports_ble());
+      EXPECT_TRUE(controller->supports_ble_privacy());
+      EXPECT_TRUE(controller->supports_ble_packet_extension());
+      EXPECT_TRUE(controller->supports_ble_offload_features());
+      EXPECT_EQ(0, memcmp(&fake.features_ble, controller->get_features_ble(),
+                          sizeof(bt_device_features_t)));
+      EXPECT_EQ(0x3f, controller->get_ble_supported_states()[7]);
+      EXPECT_EQ(fake.white_list_size, controller->get_ble_white_list_size());
+      EXPECT_EQ(fake.acl_data_size_ble, controller->get_acl_data_size_ble());
+      EXPECT_EQ(4, controller->get_acl_buffer_count_ble());
+      EXPECT_EQ(16, controller->get_ble_resolving_list_max_size());
+      EXPECT_EQ(251, controller->get_ble_default_data_packet_length());
+
+      uint8_t number_of_codecs = 0;
+      const uint8_t *codecs = controller->get_local_supported_codecs(&number_of_codecs);
+      ASSERT_EQ(sizeof(fake.codecs), number_of_codecs);
+      EXPECT_EQ(0, memcmp(fake.codecs, codecs, sizeof(fake.codecs)));
+    }
+
+    const controller_t *controller;
+};
+
+// Reads that don't depend on each other are in flight together, and their
+// responses are still parsed in the order the commands went out.
+TEST_F(ControllerTest, cold_start_batches_reads) {
+  std::vector<uint32_t> commands = StartUp();
+
+  EXPECT_LT(1U, max_in_flight);
+  EXPECT_EQ(1U, Count(commands, HCI_READ_LOCAL_SUPPORTED_CMDS));
+  EXPECT_EQ(1U, Count(commands, HCI_READ_LOCAL_EXT_FEATURES));
+  EXPECT_EQ(1U, Count(commands, HCI_READ_LOCAL_EXT_FEATURES, 1));
+  EXPECT_EQ(1U, Count(commands, HCI_BLE_READ_LOCAL_SPT_FEAT));
+  EXPECT_EQ(1U, Count(commands, HCI_READ_LOCAL_SUPPORTED_CODECS));
+  EXPECT_EQ(1U, Count(commands, HCI_WRITE_SIMPLE_PAIRING_MODE));
+  EXPECT_EQ(1U, Count(commands, HCI_BLE_SET_EVENT_MASK));
+  ExpectCapabilities();
+
+  // Page 1 may depend on the page 0 host support, so it is asked for after
+  // that has been written.
+  size_t write_le_host = 0, read_page_1 = 0;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    if (commands[i] == HCI_WRITE_LE_HOST_SUPPORT)
+      write_le_host = i;
+    else if (commands[i] == make_id(HCI_READ_LOCAL_EXT_FEATURES, 1))
+      read_page_1 = i;
+  }
+  EXPECT_LT(write_le_host, read_page_1);
+}
+
+// A warm start with the same firmware only writes the host configuration.
+TEST_F(ControllerTest, warm_start_uses_cache) {
+  std::vector<uint32_t> cold = StartUp();
+  std::vector<uint32_t> warm = StartUp();
+
+  EXPECT_GT(cold.size(), warm.size());
+  EXPECT_EQ(0U, Count(warm, HCI_READ_LOCAL_SUPPORTED_CMDS));
+  EXPECT_EQ(0U, Count(warm, HCI_READ_LOCAL_EXT_FEATURES));
+  EXPECT_EQ(0U, Count(warm, HCI_BLE_READ_LOCAL_SPT_FEAT));
+  EXPECT_EQ(0U, Count(warm, HCI_READ_LOCAL_SUPPORTED_CODECS));
+  EXPECT_EQ(1U, Count(warm, HCI_READ_LOCAL_VERSION_INFO));
+  EXPECT_EQ(1U, Count(warm, HCI_WRITE_SIMPLE_PAIRING_MODE));
+  EXPECT_EQ(1U, Count(warm, HCI_WRITE_LE_HOST_SUPPORT));
+  EXPECT_EQ(1U, Count(warm, HCI_BLE_SET_EVENT_MASK));
+  EXPECT_EQ(1U, Count(warm, HCI_SET_EVENT_MASK));
+  ExpectCapabilities();
+}
+
+// Each capability has its own key, so the file reads back the same whatever
+// the layout of the structs in memory.
+TEST_F(ControllerTest, cache_file_format) {
+  StartUp();
+
+  config_t *config = config_new(CACHE_FILE);
+  ASSERT_TRUE(config != NULL);
+  EXPECT_STREQ("08.0100.08.001d.0200", config_get_string(config, "Capabilities", "Version", NULL));
+  EXPECT_EQ(32, config_get_int(config, "Capabilities", "BleWhiteListSize", 0));
+  EXPECT_EQ(251, config_get_int(config, "Capabilities", "BleAclDataSize", 0));
+  EXPECT_EQ(1, config_get_int(config, "Capabilities", "LastFeaturesClassicPage", 0));
+  EXPECT_EQ(2, config_get_int(config, "Capabilities", "LocalSupportedCodecCount", 0));
+  EXPECT_STREQ("0205", config_get_string(config, "Capabilities", "LocalSupportedCodecs", NULL));
+  EXPECT_EQ(128U, strlen(config_get_string(config, "Capabilities", "SupportedCommands", "")));
+  config_free(config);
+}
+
+// New firmware reports a different version, which must not pick up the
+// capabilities of the old one.
+TEST_F(ControllerTest, firmware_update_invalidates_cache) {
+  StartUp();
+
+  fake.version.lmp_subversion++;
+  fake.white_list_size = 64;
+  std::vector<uint32_t> commands = StartUp();
+  EXPECT_EQ(1U, Count(commands, HCI_BLE_READ_WHITE_LIST_SIZE));
+  EXPECT_EQ(64, controller->get_ble_white_list_size());
+
+  // The cache now belongs to the new firmware.
+  commands = StartUp();
+  EXPECT_EQ(0U, Count(commands, HCI_BLE_READ_WHITE_LIST_SIZE));
+  EXPECT_EQ(64, controller->get_ble_white_list_size());
+}
+
+// A cache that is incomplete, out of range or of another format is ignored
+// and rewritten.
+TEST_F(ControllerTest, bad_cache_is_ignored) {
+  static const char *const broken_keys[] = {
+    "Format", "SupportedCommands", "FeaturesClassicPage1", "BleAclDataSize", "LocalSupportedCodecs"
+  };
+
+  for (const char *key : broken_keys) {
+    StartUp();
+
+    config_t *config = config_new(CACHE_FILE);
+    ASSERT_TRUE(config != NULL);
+    if (!strcmp(key, "Format"))
+      config_set_int(config, "Capabilities", key, 1);
+    else if (!strcmp(key, "BleAclDataSize"))
+      config_set_int(config, "Capabilities", key, 65536);
+    else if (!strcmp(key, "SupportedCommands"))
+      config_remove_key(config, "Capabilities", key);
+    else
+      config_set_string(config, "Capabilities", key, "0");
+    ASSERT_TRUE(config_save(config, CACHE_FILE));
+    config_free(config);
+
+    std::vector<uint32_t> commands = StartUp();
+    EXPECT_EQ(1U, Count(commands, HCI_READ_LOCAL_SUPPORTED_CMDS)) << key;
+    ExpectCapabilities();
+
+    commands = StartUp();
+    EXPECT_EQ(0U, Count(commands, HCI_READ_LOCAL_SUPPORTED_CMDS)) << key;
+  }
+}
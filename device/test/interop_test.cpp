@@ -75,3 +75,27 @@ TEST(InteropTest, test_name_miss) {
   EXPECT_FALSE(interop_match_name(INTEROP_DISABLE_AUTO_PAIRING, "audi"));
   EXPECT_FALSE(interop_match_name(INTEROP_AUTO_RETRY_PAIRING, "BMW M3"));
 }
+
+TEST(InteropTest, test_manufacturer) {
+  EXPECT_TRUE(interop_match_manufacturer(INTEROP_DISABLE_SDP_AFTER_PAIRING, 76));
+  EXPECT_TRUE(interop_match_manufacturer(INTEROP_DISABLE_SNIFF_DURING_SCO, 76));
+  EXPECT_FALSE(interop_match_manufacturer(INTEROP_DISABLE_AUTO_PAIRING, 76));
+  EXPECT_FALSE(interop_match_manufacturer(INTEROP_DISABLE_SDP_AFTER_PAIRING, 76 << 8));
+}
+
+TEST(InteropTest, test_dynamic_after_cached_miss) {
+  bt_bdaddr_t test_address;
+  string_to_bdaddr("38:2c:4a:c9:12:34", &test_address);
+
+  // Repeated lookups for one peer, for different features.
+  EXPECT_TRUE(interop_match_addr(INTEROP_DISABLE_LE_SECURE_CONNECTIONS, &test_address));
+  EXPECT_FALSE(interop_match_addr(INTEROP_2MBPS_LINK_ONLY, &test_address));
+
+  interop_database_add(INTEROP_2MBPS_LINK_ONLY, &test_address, 5);
+  EXPECT_TRUE(interop_match_addr(INTEROP_2MBPS_LINK_ONLY, &test_address));
+
+  // Clearing the dynamic entries keeps the static ones.
+  interop_database_clear();
+  EXPECT_FALSE(interop_match_addr(INTEROP_2MBPS_LINK_ONLY, &test_address));
+  EXPECT_TRUE(interop_match_addr(INTEROP_DISABLE_LE_SECURE_CONNECTIONS, &test_address));
+}
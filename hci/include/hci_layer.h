@@ -117,3 +117,11 @@ const hci_t *hci_layer_get_test_interface(
     const low_power_manager_t *low_power_manager_interface);
 
 void hci_layer_cleanup_interface();
+
+// Dumps per opcode command response latency histograms to |fd|.
+void hci_layer_debug_dump(int fd);
+
+// Returns when the oldest inbound ACL packet not yet taken was received, in
+// microseconds of boot time, or 0 if unknown. The consumer of the upwards
+// data queue calls this once for every ACL packet it takes off the queue.
+uint64_t hci_layer_take_acl_rx_time_us(void);
@@ -37,10 +37,11 @@
 #include "hcimsgs.h"
 #include "low_power_manager.h"
 #include "osi/include/alarm.h"
-#include "osi/include/list.h"
 #include "osi/include/log.h"
+#include "osi/include/perf_trace.h"
 #include "osi/include/properties.h"
 #include "osi/include/reactor.h"
+#include "osi/include/time.h"
 #include "packet_fragmenter.h"
 #include "vendor.h"
 
@@ -57,6 +58,27 @@ bt_bdaddr_t btif_local_bd_addr;
 
 #define BT_HCI_TIMEOUT_TAG_NUM 1010000
 
+// Vendor command used to start and stop the A2DP offload path
+// (HCI_VSQC_CONTROLLER_A2DP_OPCODE in btif_media_task.c).
+#define HCI_VS_A2DP_CONTROL (0x000A | HCI_GRP_VENDOR_SPECIFIC)
+#define IS_VENDOR_OPCODE(opcode) \
+  (((opcode) & HCI_GRP_VENDOR_SPECIFIC) == HCI_GRP_VENDOR_SPECIFIC)
+
+// Commands awaiting a response are indexed by opcode in this many slots.
+#define PENDING_COMMAND_SLOTS 32
+#define PENDING_COMMAND_SLOT(opcode) \
+  (((opcode) ^ ((opcode) >> 10)) & (PENDING_COMMAND_SLOTS - 1))
+
+// Bulk commands may only hold this many command credits at a time, so a
+// long run of them leaves room in the window for everything else.
+#define MAX_BULK_COMMANDS_IN_FLIGHT 1
+
+// Latency is tracked for up to this many distinct opcodes.
+#define COMMAND_STATS_SLOTS 128
+#define COMMAND_LATENCY_BUCKETS 8
+// Number of inbound ACL receive times kept until the stack picks them up.
+#define ACL_RX_TIMES 64
+
 static const uint8_t preamble_sizes[] = {
   HCI_COMMAND_PREAMBLE_SIZE,
   HCI_ACL_PREAMBLE_SIZE,
@@ -94,15 +116,43 @@ typedef struct {
   BT_HDR *buffer;
 } packet_receive_data_t;
 
-typedef struct {
+// Commands are scheduled from two lanes. Urgent commands overtake anything
+// still queued in the default lane, unless they act on the same connection or
+// peer as a queued command. Default lane commands are sent in order,
+// since callers rely on that (e.g. suspending scans around resolving list
+// updates); bulk commands in it are only limited in how many credits they
+// may hold.
+typedef enum {
+  COMMAND_LANE_URGENT,
+  COMMAND_LANE_DEFAULT,
+  COMMAND_LANE_COUNT
+} command_lane_t;
+
+typedef struct waiting_command_t {
   uint16_t opcode;
   future_t *complete_future;
   command_complete_cb complete_callback;
   command_status_cb status_callback;
   void *context;
   BT_HDR *command;
+
+  bool is_bulk;
+  uint64_t sent_us;
+  // Links while awaiting a response: the opcode slot chain and the list of
+  // pending commands in the order they were sent, both oldest first.
+  struct waiting_command_t *next_in_slot;
+  struct waiting_command_t *prev_sent;
+  struct waiting_command_t *next_sent;
 } waiting_command_t;
 
+typedef struct {
+  uint16_t opcode;
+  uint32_t count;  // 0 marks an unused slot
+  uint64_t total_us;
+  uint64_t max_us;
+  uint32_t buckets[COMMAND_LATENCY_BUCKETS];
+} command_latency_t;
+
 typedef enum {
     BT_SOC_DEFAULT = 0,
     BT_SOC_SMD,
@@ -128,6 +178,11 @@ low_power_config_t lpm_config = LPM_CONFIG_NONE;
 static const uint32_t EPILOG_TIMEOUT_MS = 3000;
 static const uint32_t COMMAND_PENDING_TIMEOUT_MS = 8000;
 
+// Upper bounds of all but the last latency bucket.
+static const uint32_t COMMAND_LATENCY_BOUNDS_MS[COMMAND_LATENCY_BUCKETS - 1] = {
+  1, 2, 5, 10, 20, 50, 200
+};
+
 extern int soc_type;
 
 // Our interface
@@ -155,19 +210,37 @@ static alarm_t *hardware_error_timer;
 
 // Outbound-related
 static int command_credits = 1;
-static fixed_queue_t *command_queue;
+static fixed_queue_t *command_queues[COMMAND_LANE_COUNT];
+// Keeps the lane choice of a new command in line with what is queued.
+static pthread_mutex_t command_queues_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool command_lane_registered[COMMAND_LANE_COUNT];
+static int bulk_commands_in_flight;
 static fixed_queue_t *packet_queue;
 
 // Inbound-related
 static alarm_t *command_response_timer;
-static list_t *commands_pending_response;
+static waiting_command_t *pending_commands[PENDING_COMMAND_SLOTS];
+static waiting_command_t *oldest_pending_command;
+static waiting_command_t *newest_pending_command;
+static size_t pending_vendor_commands;
 static pthread_mutex_t commands_pending_response_lock;
 static packet_receive_data_t incoming_packets[INBOUND_PACKET_TYPE_COUNT];
 
 // The hand-off point for data going to a higher layer, set by the higher layer
 static fixed_queue_t *upwards_data_queue;
 
+// Receive times of ACL packets handed up, in queue order. Written by the HCI
+// thread, read by the single consumer of |upwards_data_queue|.
+static uint64_t acl_rx_times_us[ACL_RX_TIMES];
+static uint32_t acl_rx_handed_up;
+static uint32_t acl_rx_taken;
+
 static int hci_state;
+
+// Outlives the module so stats can be dumped at any time
+static pthread_mutex_t command_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static command_latency_t command_stats[COMMAND_STATS_SLOTS];
+static uint32_t command_stats_untracked;
 static future_t *shut_down();
 
 static void event_finish_startup(void *context);
@@ -183,6 +256,8 @@ static void epilog_timer_expired(void *context);
 static void hardware_error_timer_expired(void *context);
 
 static void event_command_ready(fixed_queue_t *queue, void *context);
+static void listen_for_command_lane(command_lane_t lane, bool listen);
+static void listen_for_commands(bool listen);
 static void event_packet_ready(fixed_queue_t *queue, void *context);
 static void command_timed_out(void *context);
 
@@ -190,7 +265,15 @@ static void hal_says_data_ready(serial_data_type_t type);
 static bool filter_incoming_event(BT_HDR *packet);
 
 static serial_data_type_t event_to_data_type(uint16_t event);
+static command_lane_t command_lane(command_opcode_t opcode);
+static size_t command_target_length(command_opcode_t opcode);
+static bool command_targets_queued(const waiting_command_t *wait_entry);
+static bool command_is_bulk(command_opcode_t opcode);
+static void enqueue_command(waiting_command_t *wait_entry);
+static void add_pending_command(waiting_command_t *wait_entry);
+static void remove_pending_command(waiting_command_t *wait_entry);
 static waiting_command_t *get_waiting_command(command_opcode_t opcode);
+static void record_command_latency(const waiting_command_t *wait_entry);
 static void update_command_response_timer(void);
 
 static bool create_hw_reset_evt_packet(packet_receive_data_t *incoming);
@@ -207,6 +290,8 @@ static future_t *start_up(void) {
   // This value can change when you get a command complete or command status event.
   command_credits = 1;
   firmware_is_configured = false;
+  __atomic_store_n(&acl_rx_handed_up, 0, __ATOMIC_RELEASE);
+  acl_rx_taken = 0;
 
   char prop_lpm_config[PROPERTY_VALUE_MAX];
   osi_property_get("persist.service.bdroid.lpmcfg", prop_lpm_config, "all");
@@ -256,11 +341,14 @@ static future_t *start_up(void) {
     goto error;
   }
 
-  command_queue = fixed_queue_new(SIZE_MAX);
-  if (!command_queue) {
-    LOG_ERROR(LOG_TAG, "%s unable to create pending command queue.", __func__);
-    goto error;
+  for (int i = 0; i < COMMAND_LANE_COUNT; i++) {
+    command_queues[i] = fixed_queue_new(SIZE_MAX);
+    if (!command_queues[i]) {
+      LOG_ERROR(LOG_TAG, "%s unable to create pending command queue.", __func__);
+      goto error;
+    }
   }
+  bulk_commands_in_flight = 0;
 
   packet_queue = fixed_queue_new(SIZE_MAX);
   if (!packet_queue) {
@@ -274,11 +362,10 @@ static future_t *start_up(void) {
     goto error;
   }
 
-  commands_pending_response = list_new(NULL);
-  if (!commands_pending_response) {
-    LOG_ERROR(LOG_TAG, "%s unable to create list for commands pending response.", __func__);
-    goto error;
-  }
+  memset(pending_commands, 0, sizeof(pending_commands));
+  oldest_pending_command = NULL;
+  newest_pending_command = NULL;
+  pending_vendor_commands = 0;
 
   memset(incoming_packets, 0, sizeof(incoming_packets));
 
@@ -289,7 +376,7 @@ static future_t *start_up(void) {
 
   packet_fragmenter->init(&packet_fragmenter_callbacks);
 
-  fixed_queue_register_dequeue(command_queue, thread_get_reactor(thread), event_command_ready, NULL);
+  listen_for_commands(true);
   fixed_queue_register_dequeue(packet_queue, thread_get_reactor(thread), event_packet_ready, NULL);
 
   vendor->open(btif_local_bd_addr.address, &interface);
@@ -348,12 +435,18 @@ static future_t *shut_down() {
 
   hci_state = HCI_SHUTDOWN;
 
-  fixed_queue_free(command_queue, osi_free);
-  command_queue = NULL;
+  for (int i = 0; i < COMMAND_LANE_COUNT; i++) {
+    fixed_queue_free(command_queues[i], osi_free);
+    command_queues[i] = NULL;
+    command_lane_registered[i] = false;
+  }
   fixed_queue_free(packet_queue, buffer_allocator->free);
   packet_queue = NULL;
-  list_free(commands_pending_response);
-  commands_pending_response = NULL;
+  while (oldest_pending_command) {
+    waiting_command_t *wait_entry = oldest_pending_command;
+    remove_pending_command(wait_entry);
+    osi_free(wait_entry);
+  }
 
   pthread_mutex_destroy(&commands_pending_response_lock);
 
@@ -428,7 +521,7 @@ static void transmit_command(
   // in case the upper layer didn't already
   command->event = MSG_STACK_TO_HC_HCI_CMD;
 
-  fixed_queue_enqueue(command_queue, wait_entry);
+  enqueue_command(wait_entry);
 }
 
 static future_t *transmit_command_futured(BT_HDR *command) {
@@ -444,7 +537,7 @@ static future_t *transmit_command_futured(BT_HDR *command) {
   // in case the upper layer didn't already
   command->event = MSG_STACK_TO_HC_HCI_CMD;
 
-  fixed_queue_enqueue(command_queue, wait_entry);
+  enqueue_command(wait_entry);
   return future;
 }
 
@@ -544,43 +637,117 @@ static void hardware_error_timer_expired(UNUSED_ATTR void *context) {
 
 // Command/packet transmitting functions
 
-static void event_command_ready(fixed_queue_t *queue, UNUSED_ATTR void *context) {
-  if (hci_state < HCI_STARTED) {
-    LOG_ERROR("%s Returning, hci_layer not ready", __func__);
-    return;
+static void enqueue_command(waiting_command_t *wait_entry) {
+  wait_entry->is_bulk = command_is_bulk(wait_entry->opcode);
+
+  pthread_mutex_lock(&command_queues_lock);
+  command_lane_t lane = command_lane(wait_entry->opcode);
+  if (lane == COMMAND_LANE_URGENT && command_targets_queued(wait_entry))
+    lane = COMMAND_LANE_DEFAULT;
+  fixed_queue_enqueue(command_queues[lane], wait_entry);
+  pthread_mutex_unlock(&command_queues_lock);
+}
+
+// Returns the next command to send, or NULL if nothing may be sent right now.
+static waiting_command_t *next_command(void) {
+  pthread_mutex_lock(&command_queues_lock);
+  waiting_command_t *wait_entry = fixed_queue_try_dequeue(command_queues[COMMAND_LANE_URGENT]);
+  if (!wait_entry) {
+    fixed_queue_t *queue = command_queues[COMMAND_LANE_DEFAULT];
+    wait_entry = fixed_queue_try_peek_first(queue);
+    if (wait_entry && !(wait_entry->is_bulk && bulk_commands_in_flight >= MAX_BULK_COMMANDS_IN_FLIGHT))
+      wait_entry = fixed_queue_try_dequeue(queue);
+    else
+      wait_entry = NULL;
   }
-  if (command_credits > 0) {
-    waiting_command_t *wait_entry = fixed_queue_dequeue(queue);
-    command_credits--;
+  pthread_mutex_unlock(&command_queues_lock);
+  return wait_entry;
+}
 
-    // Move it to the list of commands awaiting response
-    pthread_mutex_lock(&commands_pending_response_lock);
-    list_append(commands_pending_response, wait_entry);
-    pthread_mutex_unlock(&commands_pending_response_lock);
+// True if commands are queued in |lane| but have to wait for a command response.
+static bool command_lane_blocked(command_lane_t lane) {
+  waiting_command_t *wait_entry = fixed_queue_try_peek_first(command_queues[lane]);
+  if (!wait_entry)
+    return false;
 
-    // Send it off
-    if (LPM_CONFIG_TX == lpm_config) {
-        low_power_manager->stop_idle_timer();;
-    }
-    else {
-        low_power_manager->wake_assert();
-    }
+  if (command_credits <= 0)
+    return true;
 
-    if (LPM_CONFIG_TX == lpm_config) {
-        low_power_manager->start_idle_timer(false);
-    }
-    else {
-        low_power_manager->transmit_done();
-    }
+  // Only the default lane is held back by bulk commands in flight
+  return lane == COMMAND_LANE_DEFAULT &&
+      wait_entry->is_bulk && bulk_commands_in_flight >= MAX_BULK_COMMANDS_IN_FLIGHT;
+}
+
+static void send_command(waiting_command_t *wait_entry) {
+  wait_entry->sent_us = time_get_os_boottime_us();
+
+  // Move it to the list of commands awaiting response
+  pthread_mutex_lock(&commands_pending_response_lock);
+  add_pending_command(wait_entry);
+  pthread_mutex_unlock(&commands_pending_response_lock);
+
+  // Send it off
+  if (LPM_CONFIG_TX == lpm_config) {
+      low_power_manager->stop_idle_timer();;
+  }
+  else {
+      low_power_manager->wake_assert();
+  }
 
-    packet_fragmenter->fragment_and_dispatch(wait_entry->command);
+  if (LPM_CONFIG_TX == lpm_config) {
+      low_power_manager->start_idle_timer(false);
+  }
+  else {
+      low_power_manager->transmit_done();
+  }
 
+  packet_fragmenter->fragment_and_dispatch(wait_entry->command);
+}
 
+// Both command lanes wake us up; send as much as the controller's command
+// window allows, urgent commands first.
+static void event_command_ready(UNUSED_ATTR fixed_queue_t *queue, UNUSED_ATTR void *context) {
+  if (hci_state < HCI_STARTED) {
+    LOG_ERROR("%s Returning, hci_layer not ready", __func__);
+    return;
+  }
 
+  bool sent = false;
+  waiting_command_t *wait_entry;
+  while (command_credits > 0 && (wait_entry = next_command()) != NULL) {
+    command_credits--;
+    send_command(wait_entry);
+    sent = true;
+  }
+
+  if (sent)
     update_command_response_timer();
+
+  // A blocked lane stays readable while it waits for a response; stop
+  // watching it until one arrives rather than spinning on the reactor. A
+  // default lane held back by the bulk limit leaves the urgent lane running.
+  for (int i = 0; i < COMMAND_LANE_COUNT; i++) {
+    if (command_lane_blocked(i))
+      listen_for_command_lane(i, false);
   }
 }
 
+static void listen_for_command_lane(command_lane_t lane, bool listen) {
+  if (listen == command_lane_registered[lane])
+    return;
+
+  if (listen)
+    fixed_queue_register_dequeue(command_queues[lane], thread_get_reactor(thread), event_command_ready, NULL);
+  else
+    fixed_queue_unregister_dequeue(command_queues[lane]);
+  command_lane_registered[lane] = listen;
+}
+
+static void listen_for_commands(bool listen) {
+  for (int i = 0; i < COMMAND_LANE_COUNT; i++)
+    listen_for_command_lane(i, listen);
+}
+
 static void event_packet_ready(fixed_queue_t *queue, UNUSED_ATTR void *context) {
   if (hci_state < HCI_STARTED) {
     LOG_ERROR("%s Returning, hci_layer not ready", __func__);
@@ -620,10 +787,10 @@ static void fragmenter_transmit_finished(BT_HDR *packet, bool all_fragments_sent
 static void command_timed_out(UNUSED_ATTR void *context) {
   pthread_mutex_lock(&commands_pending_response_lock);
 
-  if (list_is_empty(commands_pending_response)) {
+  if (!oldest_pending_command) {
     LOG_ERROR(LOG_TAG, "%s with no commands pending response", __func__);
   } else {
-    waiting_command_t *wait_entry = list_front(commands_pending_response);
+    waiting_command_t *wait_entry = oldest_pending_command;
     pthread_mutex_unlock(&commands_pending_response_lock);
 
     // We shouldn't try to recover the stack from this command timeout.
@@ -673,6 +840,7 @@ static void command_timed_out(UNUSED_ATTR void *context) {
 // This function is not required to read all of a packet in one go, so
 // be wary of reentry. But this function must return after finishing a packet.
 static void hal_says_data_ready(serial_data_type_t type) {
+  PERF_TRACE_SCOPE("hci_rx");
   packet_receive_data_t *incoming = &incoming_packets[PACKET_TYPE_TO_INBOUND_INDEX(type)];
 
   uint8_t reset;
@@ -834,6 +1002,9 @@ static bool filter_incoming_event(BT_HDR *packet) {
     }
 
     wait_entry = get_waiting_command(opcode);
+    if (wait_entry)
+      record_command_latency(wait_entry);
+
     if (!wait_entry) {
       // TODO: Currently command_credits aren't parsed at all; here or in higher layers...
       if (opcode != HCI_COMMAND_NONE) {
@@ -856,6 +1027,9 @@ static bool filter_incoming_event(BT_HDR *packet) {
     // If a command generates a command status event, it won't be getting a command complete event
 
     wait_entry = get_waiting_command(opcode);
+    if (wait_entry)
+      record_command_latency(wait_entry);
+
     if (!wait_entry)
       LOG_WARN(LOG_TAG, "%s command status event with no matching command. opcode: 0x%x", __func__, opcode);
     else if (wait_entry->status_callback)
@@ -869,6 +1043,9 @@ static bool filter_incoming_event(BT_HDR *packet) {
 intercepted:
   update_command_response_timer();
 
+  // Credits or a bulk slot may have been freed up
+  listen_for_commands(true);
+
   if (wait_entry) {
     // If it has a callback, it's responsible for freeing the packet
     if (event_code == HCI_COMMAND_STATUS_EVT || (!wait_entry->complete_callback && !wait_entry->complete_future))
@@ -909,6 +1086,11 @@ static void dispatch_reassembled(BT_HDR *packet) {
   assert(upwards_data_queue != NULL);
 
   if (upwards_data_queue) {
+    if ((packet->event & MSG_EVT_MASK) == MSG_HC_TO_STACK_HCI_ACL) {
+      uint32_t index = __atomic_load_n(&acl_rx_handed_up, __ATOMIC_RELAXED);
+      acl_rx_times_us[index % ACL_RX_TIMES] = time_get_os_boottime_us();
+      __atomic_store_n(&acl_rx_handed_up, index + 1, __ATOMIC_RELEASE);
+    }
     fixed_queue_enqueue(upwards_data_queue, packet);
   } else {
     LOG_ERROR(LOG_TAG, "%s had no queue to place upwards data packet in. Dropping it on the floor.", __func__);
@@ -932,49 +1114,187 @@ static serial_data_type_t event_to_data_type(uint16_t event) {
   return 0;
 }
 
-static waiting_command_t *get_waiting_command(command_opcode_t opcode) {
-  pthread_mutex_lock(&commands_pending_response_lock);
+// The create connection cancels are not urgent: they must never overtake the
+// create they cancel.
+static command_lane_t command_lane(command_opcode_t opcode) {
+  switch (opcode) {
+    case HCI_DISCONNECT:
+    case HCI_ACCEPT_CONNECTION_REQUEST:
+    case HCI_REJECT_CONNECTION_REQUEST:
+    case HCI_LINK_KEY_REQUEST_REPLY:
+    case HCI_LINK_KEY_REQUEST_NEG_REPLY:
+    case HCI_SWITCH_ROLE:
+    case HCI_VS_A2DP_CONTROL:
+      return COMMAND_LANE_URGENT;
+    default:
+      return COMMAND_LANE_DEFAULT;
+  }
+}
 
-  for (const list_node_t *node = list_begin(commands_pending_response);
-      node != list_end(commands_pending_response);
-      node = list_next(node)) {
-    waiting_command_t *wait_entry = list_node(node);
+// Returns how many leading parameter bytes of an urgent command name the
+// connection handle or peer address it acts on, or 0 if it acts on neither.
+static size_t command_target_length(command_opcode_t opcode) {
+  switch (opcode) {
+    case HCI_DISCONNECT:
+      return sizeof(uint16_t);
+    case HCI_ACCEPT_CONNECTION_REQUEST:
+    case HCI_REJECT_CONNECTION_REQUEST:
+    case HCI_LINK_KEY_REQUEST_REPLY:
+    case HCI_LINK_KEY_REQUEST_NEG_REPLY:
+    case HCI_SWITCH_ROLE:
+      return BD_ADDR_LEN;
+    default:
+      return 0;
+  }
+}
 
-    if (!wait_entry || wait_entry->opcode != opcode)
-      continue;
+// True if a command queued in the default lane starts with the same handle or
+// address as |wait_entry|. Such a command may depend on being sent first, so
+// |wait_entry| has to queue up behind it. Parameters that only happen to be
+// equal just cost the head start. Must be called with |command_queues_lock|
+// held.
+static bool command_targets_queued(const waiting_command_t *wait_entry) {
+  size_t length = command_target_length(wait_entry->opcode);
+  const BT_HDR *command = wait_entry->command;
+  if (!length || command->len < HCI_COMMAND_PREAMBLE_SIZE + length)
+    return false;
+  const uint8_t *target = command->data + command->offset + HCI_COMMAND_PREAMBLE_SIZE;
+
+  const list_t *queued = fixed_queue_get_list(command_queues[COMMAND_LANE_DEFAULT]);
+  for (const list_node_t *node = list_begin(queued); node != list_end(queued); node = list_next(node)) {
+    const BT_HDR *other = ((const waiting_command_t *)list_node(node))->command;
+    if (other->len >= HCI_COMMAND_PREAMBLE_SIZE + length &&
+        !memcmp(other->data + other->offset + HCI_COMMAND_PREAMBLE_SIZE, target, length))
+      return true;
+  }
+  return false;
+}
 
-    list_remove(commands_pending_response, wait_entry);
+static bool command_is_bulk(command_opcode_t opcode) {
+  switch (opcode) {
+    case HCI_BLE_ADD_DEV_RESOLVING_LIST:
+    case HCI_BLE_RM_DEV_RESOLVING_LIST:
+    case HCI_BLE_CLEAR_RESOLVING_LIST:
+    case HCI_BLE_MULTI_ADV_OCF:
+    case HCI_BLE_BATCH_SCAN_OCF:
+    case HCI_BLE_ADV_FILTER_OCF:
+      return true;
+    default:
+      return false;
+  }
+}
 
-    pthread_mutex_unlock(&commands_pending_response_lock);
-    return wait_entry;
+// Must be called with |commands_pending_response_lock| held.
+static void add_pending_command(waiting_command_t *wait_entry) {
+  waiting_command_t **link = &pending_commands[PENDING_COMMAND_SLOT(wait_entry->opcode)];
+  while (*link)
+    link = &(*link)->next_in_slot;
+  *link = wait_entry;
+  wait_entry->next_in_slot = NULL;
+
+  wait_entry->prev_sent = newest_pending_command;
+  wait_entry->next_sent = NULL;
+  if (newest_pending_command)
+    newest_pending_command->next_sent = wait_entry;
+  else
+    oldest_pending_command = wait_entry;
+  newest_pending_command = wait_entry;
+
+  if (IS_VENDOR_OPCODE(wait_entry->opcode))
+    pending_vendor_commands++;
+  if (wait_entry->is_bulk)
+    bulk_commands_in_flight++;
+}
+
+// Must be called with |commands_pending_response_lock| held.
+static void remove_pending_command(waiting_command_t *wait_entry) {
+  waiting_command_t **link = &pending_commands[PENDING_COMMAND_SLOT(wait_entry->opcode)];
+  while (*link != wait_entry)
+    link = &(*link)->next_in_slot;
+  *link = wait_entry->next_in_slot;
+
+  if (wait_entry->prev_sent)
+    wait_entry->prev_sent->next_sent = wait_entry->next_sent;
+  else
+    oldest_pending_command = wait_entry->next_sent;
+  if (wait_entry->next_sent)
+    wait_entry->next_sent->prev_sent = wait_entry->prev_sent;
+  else
+    newest_pending_command = wait_entry->prev_sent;
+
+  if (IS_VENDOR_OPCODE(wait_entry->opcode))
+    pending_vendor_commands--;
+  if (wait_entry->is_bulk)
+    bulk_commands_in_flight--;
+}
+
+static waiting_command_t *get_waiting_command(command_opcode_t opcode) {
+  waiting_command_t *wait_entry;
+
+  pthread_mutex_lock(&commands_pending_response_lock);
+
+  for (wait_entry = pending_commands[PENDING_COMMAND_SLOT(opcode)];
+      wait_entry != NULL;
+      wait_entry = wait_entry->next_in_slot) {
+    if (wait_entry->opcode == opcode)
+      break;
   }
+
   // look for any command complete with improper VS Opcode
-  for (const list_node_t *node = list_begin(commands_pending_response);
-      node != list_end(commands_pending_response);
-      node = list_next(node)) {
-    waiting_command_t *wait_entry = list_node(node);
-
-    if (wait_entry && (wait_entry->opcode != opcode) &&
-        (((wait_entry->opcode & HCI_GRP_VENDOR_SPECIFIC) == HCI_GRP_VENDOR_SPECIFIC) &&
-        ((opcode & HCI_GRP_VENDOR_SPECIFIC) == HCI_GRP_VENDOR_SPECIFIC))) {
+  if (!wait_entry && pending_vendor_commands > 0 && IS_VENDOR_OPCODE(opcode)) {
+    for (wait_entry = oldest_pending_command;
+        wait_entry != NULL;
+        wait_entry = wait_entry->next_sent) {
+      if (IS_VENDOR_OPCODE(wait_entry->opcode)) {
         LOG_DEBUG("%s VS event found treat it as valid 0x%x", __func__, opcode);
+        break;
+      }
     }
-    else {
-        continue;
-    }
+  }
 
-    list_remove(commands_pending_response, wait_entry);
+  if (wait_entry)
+    remove_pending_command(wait_entry);
 
-    pthread_mutex_unlock(&commands_pending_response_lock);
-    return wait_entry;
+  pthread_mutex_unlock(&commands_pending_response_lock);
+  return wait_entry;
+}
+
+static void record_command_latency(const waiting_command_t *wait_entry) {
+  uint64_t latency_us = time_get_os_boottime_us() - wait_entry->sent_us;
+  size_t slot = wait_entry->opcode % COMMAND_STATS_SLOTS;
+  command_latency_t *stats = NULL;
+
+  pthread_mutex_lock(&command_stats_lock);
+
+  for (size_t i = 0; i < COMMAND_STATS_SLOTS; i++) {
+    command_latency_t *candidate = &command_stats[(slot + i) % COMMAND_STATS_SLOTS];
+    if (candidate->count == 0 || candidate->opcode == wait_entry->opcode) {
+      stats = candidate;
+      break;
+    }
   }
 
-  pthread_mutex_unlock(&commands_pending_response_lock);
-  return NULL;
+  if (!stats) {
+    command_stats_untracked++;
+  } else {
+    size_t bucket = 0;
+    while (bucket < COMMAND_LATENCY_BUCKETS - 1 &&
+        latency_us >= COMMAND_LATENCY_BOUNDS_MS[bucket] * 1000ULL)
+      bucket++;
+
+    stats->opcode = wait_entry->opcode;
+    stats->count++;
+    stats->total_us += latency_us;
+    if (latency_us > stats->max_us)
+      stats->max_us = latency_us;
+    stats->buckets[bucket]++;
+  }
+
+  pthread_mutex_unlock(&command_stats_lock);
 }
 
 static void update_command_response_timer(void) {
-  if (list_is_empty(commands_pending_response)) {
+  if (!oldest_pending_command) {
     alarm_cancel(command_response_timer);
   } else {
     alarm_set(command_response_timer, COMMAND_PENDING_TIMEOUT_MS,
@@ -982,6 +1302,42 @@ static void update_command_response_timer(void) {
   }
 }
 
+uint64_t hci_layer_take_acl_rx_time_us(void) {
+  uint32_t handed_up = __atomic_load_n(&acl_rx_handed_up, __ATOMIC_ACQUIRE);
+  if (acl_rx_taken == handed_up)
+    return 0;
+
+  uint32_t index = acl_rx_taken++;
+  // The slot was reused before the stack got to this packet.
+  if (handed_up - index > ACL_RX_TIMES)
+    return 0;
+  return acl_rx_times_us[index % ACL_RX_TIMES];
+}
+
+void hci_layer_debug_dump(int fd) {
+  dprintf(fd, "\nHCI command latency:\n");
+  dprintf(fd, "  opcode  count  avg(ms)  max(ms)");
+  for (size_t i = 0; i < COMMAND_LATENCY_BUCKETS - 1; i++)
+    dprintf(fd, "   <%-3u", COMMAND_LATENCY_BOUNDS_MS[i]);
+  dprintf(fd, "  >=%-3u\n", COMMAND_LATENCY_BOUNDS_MS[COMMAND_LATENCY_BUCKETS - 2]);
+
+  pthread_mutex_lock(&command_stats_lock);
+  for (size_t i = 0; i < COMMAND_STATS_SLOTS; i++) {
+    const command_latency_t *stats = &command_stats[i];
+    if (stats->count == 0)
+      continue;
+
+    dprintf(fd, "  0x%04x %6u %8.2f %8.2f", stats->opcode, stats->count,
+            (double)stats->total_us / stats->count / 1000.0, stats->max_us / 1000.0);
+    for (size_t j = 0; j < COMMAND_LATENCY_BUCKETS; j++)
+      dprintf(fd, " %6u", stats->buckets[j]);
+    dprintf(fd, "\n");
+  }
+  if (command_stats_untracked)
+    dprintf(fd, "  %u responses for untracked opcodes\n", command_stats_untracked);
+  pthread_mutex_unlock(&command_stats_lock);
+}
+
 static void init_layer_interface() {
   if (!interface_created) {
     interface.send_low_power_command = low_power_manager->post_command;
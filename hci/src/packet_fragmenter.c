@@ -27,8 +27,6 @@
 #include "buffer_allocator.h"
 #include "device/include/controller.h"
 #include "hci_internals.h"
-#include "osi/include/hash_functions.h"
-#include "osi/include/hash_map.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
 
@@ -44,25 +42,28 @@
 #define POINT_TO_POINT 0
 #define L2CAP_HEADER_SIZE       4
 
-// TODO(zachoverflow): find good value for this
-#define NUMBER_OF_BUCKETS 42
-
 // Our interface and callbacks
 static const packet_fragmenter_t interface;
 static const allocator_t *buffer_allocator;
 static const controller_t *controller;
 static const packet_fragmenter_callbacks_t *callbacks;
 
-static hash_map_t *partial_packets;
+// Packets being reassembled, indexed directly by connection handle so that
+// every ACL packet finds its partial packet without a lookup.
+static BT_HDR *partial_packets[HANDLE_MASK + 1];
 
 static void init(const packet_fragmenter_callbacks_t *result_callbacks) {
   callbacks = result_callbacks;
-  partial_packets = hash_map_new(NUMBER_OF_BUCKETS, hash_function_naive, NULL, NULL, NULL);
+  memset(partial_packets, 0, sizeof(partial_packets));
 }
 
 static void cleanup() {
-  if (partial_packets)
-    hash_map_free(partial_packets);
+  for (size_t i = 0; i < ARRAY_SIZE(partial_packets); ++i) {
+    if (partial_packets[i]) {
+      buffer_allocator->free(partial_packets[i]);
+      partial_packets[i] = NULL;
+    }
+  }
 }
 
 static void fragment_and_dispatch(BT_HDR *packet) {
@@ -148,13 +149,13 @@ static void reassemble_and_dispatch(UNUSED_ATTR BT_HDR *packet) {
       return;
     }
 
-    BT_HDR *partial_packet = (BT_HDR *)hash_map_get(partial_packets, (void *)(uintptr_t)handle);
+    BT_HDR *partial_packet = partial_packets[handle];
 
     if (boundary_flag == START_PACKET_BOUNDARY) {
       if (partial_packet) {
         LOG_WARN(LOG_TAG, "%s found unfinished packet for handle with start packet. Dropping old.", __func__);
 
-        hash_map_erase(partial_packets, (void *)(uintptr_t)handle);
+        partial_packets[handle] = NULL;
         buffer_allocator->free(partial_packet);
       }
 
@@ -178,6 +179,7 @@ static void reassemble_and_dispatch(UNUSED_ATTR BT_HDR *packet) {
         return;
       }
 
+      // The whole L2CAP packet is in this fragment, so it goes up as is.
       if (full_length <= packet->len) {
         if (full_length < packet->len)
           LOG_WARN(LOG_TAG, "%s found l2cap full length %d less than the hci length %d.", __func__, l2cap_length, packet->len);
@@ -198,7 +200,7 @@ static void reassemble_and_dispatch(UNUSED_ATTR BT_HDR *packet) {
       STREAM_SKIP_UINT16(stream); // skip the handle
       UINT16_TO_STREAM(stream, full_length - HCI_ACL_PREAMBLE_SIZE);
 
-      hash_map_set(partial_packets, (void *)(uintptr_t)handle, partial_packet);
+      partial_packets[handle] = partial_packet;
       // Free the old packet buffer, since we don't need it anymore
       buffer_allocator->free(packet);
     } else {
@@ -228,7 +230,7 @@ static void reassemble_and_dispatch(UNUSED_ATTR BT_HDR *packet) {
       partial_packet->offset = projected_offset;
 
       if (partial_packet->offset == partial_packet->len) {
-        hash_map_erase(partial_packets, (void *)(uintptr_t)handle);
+        partial_packets[handle] = NULL;
         partial_packet->offset = 0;
         callbacks->reassembled(partial_packet);
       }
@@ -52,7 +52,8 @@ DECLARE_TEST_MODES(
   transmit_command_command_status,
   transmit_command_command_complete,
   ignoring_packets_ignored_packet,
-  ignoring_packets_following_packet
+  ignoring_packets_following_packet,
+  command_lanes
 );
 
 static const char *small_sample_data = "\"It is easy to see,\" replied Don Quixote";
@@ -72,6 +73,8 @@ static const uint16_t test_handle_continuation = (0x1992 & 0xCFFF) | 0x1000;
 static int packet_index;
 static unsigned int data_size_sum;
 static BT_HDR *data_to_receive;
+static command_opcode_t sent_opcodes[8];
+static size_t sent_count;
 
 static void signal_work_item(UNUSED_ATTR void *context) {
   semaphore_post(done);
@@ -206,6 +209,14 @@ STUB_FUNCTION(uint16_t, hal_transmit_data, (serial_data_type_t type, uint8_t *da
     return length;
   }
 
+  DURING(command_lanes) {
+    EXPECT_EQ(DATA_TYPE_COMMAND, type);
+    if (sent_count < ARRAY_SIZE(sent_opcodes))
+      sent_opcodes[sent_count] = data[0] | (data[1] << 8);
+    sent_count++;
+    return length;
+  }
+
   UNEXPECTED_CALL;
   return 0;
 }
@@ -238,7 +249,8 @@ STUB_FUNCTION(size_t, hal_read_data, (serial_data_type_t type, uint8_t *buffer,
   DURING(
       transmit_command_no_callbacks,
       transmit_command_command_status,
-      transmit_command_command_complete) {
+      transmit_command_command_complete,
+      command_lanes) {
     EXPECT_EQ(DATA_TYPE_EVENT, type);
     return replay_data_to_receive(max_size, buffer);
   }
@@ -267,6 +279,11 @@ STUB_FUNCTION(void, hal_packet_finished, (serial_data_type_t type))
     return;
   }
 
+  DURING(command_lanes) {
+    EXPECT_EQ(DATA_TYPE_EVENT, type);
+    return;
+  }
+
   UNEXPECTED_CALL;
 }
 
@@ -291,6 +308,7 @@ STUB_FUNCTION(void, btsnoop_capture, (const BT_HDR *buffer, bool is_received))
     return;
   }
 
+  DURING(command_lanes) return;
 
   DURING(
       transmit_command_no_callbacks,
@@ -347,6 +365,8 @@ STUB_FUNCTION(void, low_power_wake_assert, ())
     AT_CALL(0) return;
   }
 
+  DURING(command_lanes) return;
+
   UNEXPECTED_CALL;
 }
 
@@ -359,6 +379,8 @@ STUB_FUNCTION(void, low_power_transmit_done, ())
     AT_CALL(0) return;
   }
 
+  DURING(command_lanes) return;
+
   UNEXPECTED_CALL;
 }
 
@@ -635,18 +657,22 @@ TEST_F(HciLayerTest, test_receive_simple) {
   osi_free(data_to_receive);
 }
 
-static BT_HDR *manufacture_command_complete(command_opcode_t opcode) {
+static BT_HDR *manufacture_command_complete_with_credits(command_opcode_t opcode, uint8_t credits) {
   BT_HDR *ret = (BT_HDR *)osi_calloc(sizeof(BT_HDR) + 5);
   uint8_t *stream = ret->data;
   UINT8_TO_STREAM(stream, HCI_COMMAND_COMPLETE_EVT);
   UINT8_TO_STREAM(stream, 3); // length of the event parameters
-  UINT8_TO_STREAM(stream, 1); // the number of commands that can be sent
+  UINT8_TO_STREAM(stream, credits); // the number of commands that can be sent
   UINT16_TO_STREAM(stream, opcode);
   ret->len = 5;
 
   return ret;
 }
 
+static BT_HDR *manufacture_command_complete(command_opcode_t opcode) {
+  return manufacture_command_complete_with_credits(opcode, 1);
+}
+
 static BT_HDR *manufacture_command_status(command_opcode_t opcode) {
   BT_HDR *ret = (BT_HDR *)osi_calloc(sizeof(BT_HDR) + 6);
   uint8_t *stream = ret->data;
@@ -753,4 +779,151 @@ TEST_F(HciLayerTest, test_ignoring_packets) {
   osi_free(data_to_receive);
 }
 
+static void transmit_command_with_params(command_opcode_t opcode, const uint8_t *params, uint8_t params_length) {
+  BT_HDR *command = (BT_HDR *)osi_calloc(sizeof(BT_HDR) + 3 + params_length);
+  uint8_t *stream = command->data;
+  UINT16_TO_STREAM(stream, opcode);
+  UINT8_TO_STREAM(stream, params_length); // length of the command parameters
+  if (params_length)
+    memcpy(stream, params, params_length);
+  command->len = 3 + params_length;
+
+  hci->transmit_command(command, NULL, NULL, NULL);
+}
+
+static void transmit_command_with_opcode(command_opcode_t opcode) {
+  transmit_command_with_params(opcode, NULL, 0);
+}
+
+static void receive_command_complete(command_opcode_t opcode, uint8_t credits) {
+  data_to_receive = manufacture_command_complete_with_credits(opcode, credits);
+  hal_callbacks->data_ready(DATA_TYPE_EVENT);
+  osi_free(data_to_receive);
+}
+
+TEST_F(HciLayerTest, test_command_lane_priority) {
+  reset_for(command_lanes);
+  sent_count = 0;
+
+  // Use up the only credit
+  transmit_command_with_opcode(HCI_READ_BD_ADDR);
+  flush_thread(internal_thread);
+  ASSERT_EQ(1U, sent_count);
+
+  // An urgent command queued after a default one is sent first
+  transmit_command_with_opcode(HCI_READ_LOCAL_VERSION_INFO);
+  transmit_command_with_opcode(HCI_DISCONNECT);
+  flush_thread(internal_thread);
+  EXPECT_EQ(1U, sent_count);
+
+  receive_command_complete(HCI_READ_BD_ADDR, 1);
+  flush_thread(internal_thread);
+  ASSERT_EQ(2U, sent_count);
+  EXPECT_EQ(HCI_DISCONNECT, sent_opcodes[1]);
+
+  receive_command_complete(HCI_DISCONNECT, 1);
+  flush_thread(internal_thread);
+  ASSERT_EQ(3U, sent_count);
+  EXPECT_EQ(HCI_READ_LOCAL_VERSION_INFO, sent_opcodes[2]);
+
+  receive_command_complete(HCI_READ_LOCAL_VERSION_INFO, 1);
+}
+
+TEST_F(HciLayerTest, test_command_lane_bulk_limit) {
+  reset_for(command_lanes);
+  sent_count = 0;
+
+  transmit_command_with_opcode(HCI_READ_BD_ADDR);
+  flush_thread(internal_thread);
+  ASSERT_EQ(1U, sent_count);
+
+  transmit_command_with_opcode(HCI_BLE_ADD_DEV_RESOLVING_LIST);
+  transmit_command_with_opcode(HCI_BLE_RM_DEV_RESOLVING_LIST);
+  flush_thread(internal_thread);
+  EXPECT_EQ(1U, sent_count);
+
+  // Only one bulk command is sent even though the controller has room for more
+  receive_command_complete(HCI_READ_BD_ADDR, 3);
+  flush_thread(internal_thread);
+  ASSERT_EQ(2U, sent_count);
+  EXPECT_EQ(HCI_BLE_ADD_DEV_RESOLVING_LIST, sent_opcodes[1]);
+
+  // Urgent commands still use the credits the bulk command leaves
+  transmit_command_with_opcode(HCI_DISCONNECT);
+  flush_thread(internal_thread);
+  ASSERT_EQ(3U, sent_count);
+  EXPECT_EQ(HCI_DISCONNECT, sent_opcodes[2]);
+
+  // The next bulk command goes out once the first one completes
+  receive_command_complete(HCI_BLE_ADD_DEV_RESOLVING_LIST, 2);
+  flush_thread(internal_thread);
+  ASSERT_EQ(4U, sent_count);
+  EXPECT_EQ(HCI_BLE_RM_DEV_RESOLVING_LIST, sent_opcodes[3]);
+
+  receive_command_complete(HCI_DISCONNECT, 2);
+  receive_command_complete(HCI_BLE_RM_DEV_RESOLVING_LIST, 3);
+}
+
+TEST_F(HciLayerTest, test_command_lane_cancel_follows_create) {
+  static const uint8_t bd_addr[] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+  reset_for(command_lanes);
+  sent_count = 0;
+
+  transmit_command_with_opcode(HCI_READ_BD_ADDR);
+  flush_thread(internal_thread);
+  ASSERT_EQ(1U, sent_count);
+
+  // The cancel must not reach the controller before the create it cancels
+  transmit_command_with_params(HCI_CREATE_CONNECTION, bd_addr, sizeof(bd_addr));
+  transmit_command_with_params(HCI_CREATE_CONNECTION_CANCEL, bd_addr, sizeof(bd_addr));
+  flush_thread(internal_thread);
+  EXPECT_EQ(1U, sent_count);
+
+  receive_command_complete(HCI_READ_BD_ADDR, 1);
+  flush_thread(internal_thread);
+  ASSERT_EQ(2U, sent_count);
+  EXPECT_EQ(HCI_CREATE_CONNECTION, sent_opcodes[1]);
+
+  receive_command_complete(HCI_CREATE_CONNECTION, 1);
+  flush_thread(internal_thread);
+  ASSERT_EQ(3U, sent_count);
+  EXPECT_EQ(HCI_CREATE_CONNECTION_CANCEL, sent_opcodes[2]);
+
+  receive_command_complete(HCI_CREATE_CONNECTION_CANCEL, 1);
+}
+
+TEST_F(HciLayerTest, test_command_lane_same_handle) {
+  static const uint8_t handle[] = { 0x01, 0x00 };
+  static const uint8_t disconnect[] = { 0x01, 0x00, 0x13 };
+  static const uint8_t other_disconnect[] = { 0x02, 0x00, 0x13 };
+  reset_for(command_lanes);
+  sent_count = 0;
+
+  transmit_command_with_opcode(HCI_READ_BD_ADDR);
+  flush_thread(internal_thread);
+  ASSERT_EQ(1U, sent_count);
+
+  // A disconnect stays behind a queued command for its own handle but still
+  // overtakes one for another handle
+  transmit_command_with_opcode(HCI_READ_LOCAL_VERSION_INFO);
+  transmit_command_with_params(HCI_READ_RSSI, handle, sizeof(handle));
+  transmit_command_with_params(HCI_DISCONNECT, disconnect, sizeof(disconnect));
+  transmit_command_with_params(HCI_DISCONNECT, other_disconnect, sizeof(other_disconnect));
+  flush_thread(internal_thread);
+  EXPECT_EQ(1U, sent_count);
+
+  receive_command_complete(HCI_READ_BD_ADDR, 4);
+  flush_thread(internal_thread);
+  ASSERT_EQ(5U, sent_count);
+  EXPECT_EQ(HCI_DISCONNECT, sent_opcodes[1]);
+  EXPECT_EQ(HCI_READ_LOCAL_VERSION_INFO, sent_opcodes[2]);
+  EXPECT_EQ(HCI_READ_RSSI, sent_opcodes[3]);
+  EXPECT_EQ(HCI_DISCONNECT, sent_opcodes[4]);
+
+  receive_command_complete(HCI_DISCONNECT, 1);
+  receive_command_complete(HCI_READ_LOCAL_VERSION_INFO, 1);
+  receive_command_complete(HCI_READ_RSSI, 1);
+  receive_command_complete(HCI_DISCONNECT, 1);
+}
+
 // TODO(zachoverflow): test post-reassembly better, stub out fragmenter instead of using it
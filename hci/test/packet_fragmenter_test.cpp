@@ -41,7 +41,8 @@ DECLARE_TEST_MODES(
   non_acl_passthrough_fragmentation,
   no_reassembly,
   reassembly,
-  non_acl_passthrough_reassembly
+  non_acl_passthrough_reassembly,
+  partial_reassembly
 );
 
 #define LOCAL_BLE_CONTROLLER_ID 1
@@ -369,6 +370,27 @@ TEST_F(PacketFragmenterTest, test_reassembly_necessary) {
   EXPECT_CALL_COUNT(reassembled_callback, 1);
 }
 
+TEST_F(PacketFragmenterTest, test_cleanup_frees_partial_packet) {
+  reset_for(partial_reassembly);
+
+  // Only the start of a packet arrives; cleanup still has to free it.
+  uint16_t data_length = 10;
+  BT_HDR *packet = (BT_HDR *)osi_malloc(data_length + 6 + sizeof(BT_HDR));
+  packet->len = data_length + 6;
+  packet->offset = 0;
+  packet->event = MSG_HC_TO_STACK_HCI_ACL;
+  packet->layer_specific = 0;
+
+  uint8_t *packet_data = packet->data;
+  UINT16_TO_STREAM(packet_data, test_handle_start);
+  UINT16_TO_STREAM(packet_data, data_length + 2);
+  UINT16_TO_STREAM(packet_data, strlen(sample_data));
+  memcpy(packet_data, sample_data, data_length);
+  fragmenter->reassemble_and_dispatch(packet);
+
+  EXPECT_CALL_COUNT(reassembled_callback, 0);
+}
+
 TEST_F(PacketFragmenterTest, test_non_acl_passthrough_reasseembly) {
   reset_for(non_acl_passthrough_reassembly);
   manufacture_packet_and_then_reassemble(MSG_HC_TO_STACK_HCI_EVT, 42, sample_data);
@@ -916,6 +916,16 @@
 #define SDP_MAX_ATTR_LEN            400
 #endif
 
+/* The number of serialized ServiceSearchAttribute responses the server keeps. */
+#ifndef SDP_RSP_CACHE_SIZE
+#define SDP_RSP_CACHE_SIZE          8
+#endif
+
+/* The maximum number of (UUID, record) pairs in the server's UUID index. */
+#ifndef SDP_MAX_UUID_INDEX
+#define SDP_MAX_UUID_INDEX          (SDP_MAX_RECORDS * 8)
+#endif
+
 /* The maximum number of attribute filters supported by SDP databases. */
 #ifndef SDP_MAX_ATTR_FILTERS
 #define SDP_MAX_ATTR_FILTERS        15
@@ -931,6 +941,31 @@
 #define SDP_CLIENT_ENABLED          TRUE
 #endif
 
+/* Keep the ServiceSearchAttribute results of bonded peers across reconnects and restarts. */
+#ifndef SDP_DISC_CACHE_INCLUDED
+#define SDP_DISC_CACHE_INCLUDED     TRUE
+#endif
+
+/* The number of (peer, UUID/attribute filter) results the discovery cache keeps. */
+#ifndef SDP_DISC_CACHE_SIZE
+#define SDP_DISC_CACHE_SIZE         16
+#endif
+
+/* Cached results younger than this, in seconds, are used without contacting the peer. */
+#ifndef SDP_DISC_CACHE_FRESH_S
+#define SDP_DISC_CACHE_FRESH_S      (24 * 60 * 60)
+#endif
+
+/* Cached results older than this, in seconds, are refreshed in the background after use. */
+#ifndef SDP_DISC_CACHE_REFRESH_S
+#define SDP_DISC_CACHE_REFRESH_S    (60 * 60)
+#endif
+
+/* Where the discovery cache is stored, next to bt_config.conf. */
+#ifndef SDP_DISC_CACHE_FILE
+#define SDP_DISC_CACHE_FILE         "/data/misc/bluedroid/sdp_disc_cache.bin"
+#endif
+
 /* The maximum number of record handles retrieved in a search. */
 #ifndef SDP_MAX_DISC_SERVER_RECS
 #define SDP_MAX_DISC_SERVER_RECS    21
@@ -34,6 +34,7 @@ typedef struct {
   bool (*get_btsnoop_turned_on)(void);
   void (*get_btsnoop_ext_options)(bool *hci_ext_dump_enabled, bool *btsnoop_conf_from_file);
   bool (*get_btsnoop_should_save_last)(void);
+  const char *(*get_btsnooz_full_cids)(void);
   bool (*get_trace_config_enabled)(void);
   bool (*get_pts_secure_only_mode)(void);
   bool (*get_pts_conn_updates_disabled)(void);
@@ -99,8 +99,6 @@ fixed_queue_t *btu_hci_msg_queue;
 ******************************************************************************/
 void bte_main_boot_entry(void)
 {
-    module_init(get_module(INTEROP_MODULE));
-
     hci = hci_layer_get_interface();
     if (!hci)
       LOG_ERROR(LOG_TAG, "%s could not get hci layer interface.", __func__);
@@ -113,8 +111,6 @@ void bte_main_boot_entry(void)
 
     data_dispatcher_register_default(hci->event_dispatcher, btu_hci_msg_queue);
     hci->set_data_queue(btu_hci_msg_queue);
-
-    module_init(get_module(STACK_CONFIG_MODULE));
 }
 
 /******************************************************************************
@@ -133,10 +129,6 @@ void bte_main_cleanup()
     fixed_queue_free(btu_hci_msg_queue, NULL);
 
     btu_hci_msg_queue = NULL;
-
-    module_clean_up(get_module(STACK_CONFIG_MODULE));
-
-    module_clean_up(get_module(INTEROP_MODULE));
 }
 
 /******************************************************************************
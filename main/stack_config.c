@@ -22,6 +22,7 @@
 
 #include <assert.h>
 
+#include "btcore/include/module.h"
 #include "osi/include/future.h"
 #include "osi/include/log.h"
 
@@ -30,6 +31,7 @@ const char *BTSNOOP_TURNED_ON_KEY = "BtSnoopLogOutput";
 const char *BTSNOOP_EXT_DUMP_KEY = "BtSnoopExtDump";
 const char *BTSNOOP_CONFIG_FROM_FILE_KEY = "BtSnoopConfigFromFile";
 const char *BTSNOOP_SHOULD_SAVE_LAST_KEY = "BtSnoopSaveLog";
+const char *BTSNOOZ_FULL_CIDS_KEY = "BtSnoozFullCids";
 const char *TRACE_CONFIG_ENABLED_KEY = "TraceConf";
 const char *PTS_SECURE_ONLY_MODE = "PTS_SecurePairOnly";
 const char *PTS_LE_CONN_UPDATED_DISABLED = "PTS_DisableConnUpdates";
@@ -81,53 +83,65 @@ EXPORT_SYMBOL const module_t stack_config_module = {
 
 // Interface functions
 
+// The file is parsed by whoever needs it first rather than at stack init, so
+// a stack which is initialized but never enabled does not pay for it.
+static const config_t *get_config(void) {
+  module_init_lazy(&stack_config_module);
+  return config;
+}
+
 static const char *get_btsnoop_log_path(void) {
-  return config_get_string(config, CONFIG_DEFAULT_SECTION, BTSNOOP_LOG_PATH_KEY,
+  return config_get_string(get_config(), CONFIG_DEFAULT_SECTION, BTSNOOP_LOG_PATH_KEY,
       "/data/misc/bluetooth/logs/btsnoop_hci.log");
 }
 
 static bool get_btsnoop_turned_on(void) {
-  return config_get_bool(config, CONFIG_DEFAULT_SECTION, BTSNOOP_TURNED_ON_KEY, false);
+  return config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, BTSNOOP_TURNED_ON_KEY, false);
 }
 
 static bool get_btsnoop_should_save_last(void) {
-  return config_get_bool(config, CONFIG_DEFAULT_SECTION, BTSNOOP_SHOULD_SAVE_LAST_KEY, false);
+  return config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, BTSNOOP_SHOULD_SAVE_LAST_KEY, false);
+}
+
+static const char *get_btsnooz_full_cids(void) {
+  return config_get_string(get_config(), CONFIG_DEFAULT_SECTION, BTSNOOZ_FULL_CIDS_KEY, NULL);
 }
 
 static bool get_trace_config_enabled(void) {
-  return config_get_bool(config, CONFIG_DEFAULT_SECTION, TRACE_CONFIG_ENABLED_KEY, false);
+  return config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, TRACE_CONFIG_ENABLED_KEY, false);
 }
 
 static bool get_pts_secure_only_mode(void) {
-    return config_get_bool(config, CONFIG_DEFAULT_SECTION, PTS_SECURE_ONLY_MODE, false);
+    return config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, PTS_SECURE_ONLY_MODE, false);
 }
 
 static bool get_pts_conn_updates_disabled(void) {
-  return config_get_bool(config, CONFIG_DEFAULT_SECTION, PTS_LE_CONN_UPDATED_DISABLED, false);
+  return config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, PTS_LE_CONN_UPDATED_DISABLED, false);
 }
 
 static bool get_pts_crosskey_sdp_disable(void) {
-  return config_get_bool(config, CONFIG_DEFAULT_SECTION, PTS_DISABLE_SDP_LE_PAIR, false);
+  return config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, PTS_DISABLE_SDP_LE_PAIR, false);
 }
 
 static const char *get_pts_smp_options(void) {
-  return config_get_string(config, CONFIG_DEFAULT_SECTION, PTS_SMP_PAIRING_OPTIONS_KEY, NULL);
+  return config_get_string(get_config(), CONFIG_DEFAULT_SECTION, PTS_SMP_PAIRING_OPTIONS_KEY, NULL);
 }
 
 static int get_pts_smp_failure_case(void) {
-  return config_get_int(config, CONFIG_DEFAULT_SECTION, PTS_SMP_FAILURE_CASE_KEY, 0);
+  return config_get_int(get_config(), CONFIG_DEFAULT_SECTION, PTS_SMP_FAILURE_CASE_KEY, 0);
 }
 
 static void get_btsnoop_ext_options(bool *hci_ext_dump_enabled, bool *btsnoop_conf_from_file) {
-  *hci_ext_dump_enabled = config_get_bool(config, CONFIG_DEFAULT_SECTION, BTSNOOP_EXT_DUMP_KEY, false);
-  *btsnoop_conf_from_file = config_get_bool(config, CONFIG_DEFAULT_SECTION, BTSNOOP_CONFIG_FROM_FILE_KEY, false);
+  *hci_ext_dump_enabled = config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, BTSNOOP_EXT_DUMP_KEY, false);
+  *btsnoop_conf_from_file = config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, BTSNOOP_CONFIG_FROM_FILE_KEY, false);
 }
 
 static bool get_pts_le_nonconn_adv_enabled(void) {
-  return config_get_bool(config, CONFIG_DEFAULT_SECTION, PTS_LE_NONCONN_ADV_MODE, false);
+  return config_get_bool(get_config(), CONFIG_DEFAULT_SECTION, PTS_LE_NONCONN_ADV_MODE, false);
 }
 
 static config_t *get_all(void) {
+  get_config();
   return config;
 }
 
@@ -136,6 +150,7 @@ const stack_config_t interface = {
   get_btsnoop_turned_on,
   get_btsnoop_ext_options,
   get_btsnoop_should_save_last,
+  get_btsnooz_full_cids,
   get_trace_config_enabled,
   get_pts_secure_only_mode,
   get_pts_conn_updates_disabled,
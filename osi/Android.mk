@@ -31,6 +31,7 @@ btosiCommonSrc := \
     ./src/buffer.c \
     ./src/compat.c \
     ./src/config.c \
+    ./src/config_journal.c \
     ./src/data_dispatcher.c \
     ./src/eager_reader.c \
     ./src/fixed_queue.c \
@@ -42,10 +43,13 @@ btosiCommonSrc := \
     ./src/metrics.cpp \
     ./src/mutex.c \
     ./src/osi.c \
+    ./src/perf_trace.c \
     ./src/properties.c \
     ./src/reactor.c \
+    ./src/prefix_trie.c \
     ./src/ringbuffer.c \
     ./src/semaphore.c \
+    ./src/shm_ring.c \
     ./src/socket.c \
     ./src/socket_utils/socket_local_client.c \
     ./src/socket_utils/socket_local_server.c \
@@ -60,6 +64,7 @@ btosiCommonTestSrc := \
     ./test/allocation_tracker_test.cpp \
     ./test/allocator_test.cpp \
     ./test/array_test.cpp \
+    ./test/config_journal_test.cpp \
     ./test/config_test.cpp \
     ./test/data_dispatcher_test.cpp \
     ./test/eager_reader_test.cpp \
@@ -70,11 +75,14 @@ btosiCommonTestSrc := \
     ./test/leaky_bonded_queue_test.cpp \
     ./test/list_test.cpp \
     ./test/metrics_test.cpp \
+    ./test/perf_trace_test.cpp \
     ./test/properties_test.cpp \
     ./test/rand_test.cpp \
     ./test/reactor_test.cpp \
+    ./test/prefix_trie_test.cpp \
     ./test/ringbuffer_test.cpp \
     ./test/semaphore_test.cpp \
+    ./test/shm_ring_test.cpp \
     ./test/thread_test.cpp \
     ./test/time_test.cpp
 
@@ -183,7 +191,7 @@ ifeq ($(HOST_OS),linux)
 include $(CLEAR_VARS)
 LOCAL_C_INCLUDES := $(btosiCommonIncludes)
 LOCAL_SRC_FILES := $(btosiCommonTestSrc)
-LOCAL_LDLIBS := -lrt -lpthread
+LOCAL_LDLIBS := -lrt -lpthread -ldl
 LOCAL_MODULE := net_test_osi
 LOCAL_MODULE_TAGS := tests
 LOCAL_SHARED_LIBRARIES := liblog libprotobuf-cpp-full libchrome
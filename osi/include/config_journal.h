@@ -0,0 +1,79 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+// This module keeps a journal of the changes made to a config since it was
+// last saved with |config_save|, so that saving a few changes does not
+// require rewriting the whole file. Changes are queued in a |config_journal_t|
+// and appended to the journal file in one write. The journal file starts with
+// the generation of the config file it applies to; the caller stores that
+// generation in the config file itself and bumps it on every full save, so a
+// journal left behind by an older file is never replayed on top of a newer
+// one.
+//
+// The functions in this module are not thread-safe.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "osi/include/config.h"
+
+typedef struct config_journal_t config_journal_t;
+
+// Creates an empty set of queued changes. Returns NULL on allocation failure.
+// Clients must call |config_journal_free| on the returned handle.
+config_journal_t *config_journal_new(void);
+
+// Frees |journal| and any changes still queued in it. |journal| may be NULL.
+void config_journal_free(config_journal_t *journal);
+
+// Queues setting |key| in |section| to |value|. As with |config_set_string|,
+// anything in |value| after a newline is dropped. |journal|, |section|, |key|
+// and |value| must not be NULL.
+void config_journal_set(config_journal_t *journal, const char *section, const char *key, const char *value);
+
+// Queues removing |key| from |section|. |journal|, |section| and |key| must
+// not be NULL.
+void config_journal_remove(config_journal_t *journal, const char *section, const char *key);
+
+// Returns true if |journal| has no queued changes. |journal| must not be NULL.
+bool config_journal_is_empty(const config_journal_t *journal);
+
+// Drops all queued changes. |journal| must not be NULL.
+void config_journal_clear(config_journal_t *journal);
+
+// Appends the changes queued in |journal| to the journal file |filename| with
+// a single write and syncs it. On success the changes are cleared and the
+// number of bytes appended is added to |size|. Returns false if the file is
+// missing or could not be written, in which case the caller must save the
+// full config instead. |journal|, |filename| and |size| must not be NULL.
+bool config_journal_append(config_journal_t *journal, const char *filename, size_t *size);
+
+// Creates or truncates the journal file |filename| for the config file of
+// |generation| and sets |size| to its length. Returns false on error.
+// |filename| and |size| must not be NULL.
+bool config_journal_reset(const char *filename, int generation, size_t *size);
+
+// Applies the changes in the journal file |filename| to |config| if the
+// journal was written for the config file of |generation|; otherwise |config|
+// is left untouched. A record cut short by a crash while it was appended ends
+// the replay. Sets |size| to the number of bytes replayed and returns true if
+// the journal matched and was read in full, i.e. further changes can be
+// appended to it. |filename|, |config| and |size| must not be NULL.
+bool config_journal_replay(const char *filename, config_t *config, int generation, size_t *size);
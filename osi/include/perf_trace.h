@@ -0,0 +1,97 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Begin/end and counter markers for profiling hot paths across threads.
+//
+// Events either go straight to the ftrace trace_marker, where systrace and
+// Perfetto pick them up next to the kernel's scheduling data, or into a
+// buffer per thread which |perf_trace_stop| writes out as a Chrome JSON
+// trace for chrome://tracing or ui.perfetto.dev.
+//
+// While tracing is off every marker costs one load and a branch. Event names
+// are not copied; they must be string literals.
+
+typedef enum {
+  PERF_TRACE_FTRACE,  // Write events to the ftrace trace_marker.
+  PERF_TRACE_JSON,    // Buffer events and write a Chrome JSON trace on stop.
+} perf_trace_mode_t;
+
+// Marks the enclosing scope as the event |name|. At most one per scope.
+#define PERF_TRACE_SCOPE(name) \
+  const char *PERF_TRACE_CONCAT(perf_trace_scope_, __LINE__) \
+      __attribute__((cleanup(perf_trace_scope_end))) = perf_trace_scope_begin(name)
+
+// Marks the code between the two as the event |name|. Both go in the same
+// scope, at most one pair per scope. END is only recorded if BEGIN was, so
+// tracing starting in between never leaves an END without its BEGIN.
+#define PERF_TRACE_BEGIN(name) \
+  const bool perf_trace_begun_ = perf_trace_scope_begin(name) != NULL
+
+#define PERF_TRACE_END(name) \
+  do { if (perf_trace_begun_) perf_trace_end(name); } while (0)
+
+// Records |value| for the counter |name|.
+#define PERF_TRACE_COUNTER(name, value) \
+  do { if (perf_trace_is_active()) perf_trace_counter((name), (value)); } while (0)
+
+// Starts tracing in |mode|. |json_path| is where |PERF_TRACE_JSON| traces are
+// written and is ignored otherwise. Returns false if tracing is already
+// running or the output could not be opened.
+bool perf_trace_start(perf_trace_mode_t mode, const char *json_path);
+
+// Stops tracing and, in |PERF_TRACE_JSON| mode, writes out the buffered events
+// of all threads. Returns the number of events written. Buffers are kept for
+// the next trace.
+size_t perf_trace_stop(void);
+
+// Frees the per thread buffers and closes the trace_marker. Only call this while tracing is stopped and
+// no thread is still inside a marker, e.g. at shutdown.
+void perf_trace_cleanup(void);
+
+// Implementation details of the macros above.
+
+#define PERF_TRACE_CONCAT_(a, b) a##b
+#define PERF_TRACE_CONCAT(a, b) PERF_TRACE_CONCAT_(a, b)
+
+extern bool perf_trace_active;
+
+void perf_trace_begin(const char *name);
+void perf_trace_end(const char *name);
+void perf_trace_counter(const char *name, int64_t value);
+
+static inline bool perf_trace_is_active(void) {
+  return __builtin_expect(__atomic_load_n(&perf_trace_active, __ATOMIC_RELAXED), 0);
+}
+
+static inline const char *perf_trace_scope_begin(const char *name) {
+  if (!perf_trace_is_active())
+    return NULL;
+  perf_trace_begin(name);
+  return name;
+}
+
+static inline void perf_trace_scope_end(const char **name) {
+  if (*name)
+    perf_trace_end(*name);
+}
@@ -0,0 +1,56 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A byte trie mapping keys (address prefixes, device names, ...) to a 64 bit
+// set of tags, e.g. one bit per interop workaround. A single walk along a
+// query answers for all tags at once. Nodes live in one contiguous array, so
+// the trie is meant to be built up front and then queried many times; it is
+// not thread safe.
+
+struct prefix_trie_t;
+typedef struct prefix_trie_t prefix_trie_t;
+
+// Returns a new, empty trie. The returned object must be freed with
+// |prefix_trie_free|.
+prefix_trie_t *prefix_trie_new(void);
+
+// Frees |trie|. Safe to call with NULL.
+void prefix_trie_free(prefix_trie_t *trie);
+
+// Removes all keys from |trie|. |trie| may not be NULL.
+void prefix_trie_clear(prefix_trie_t *trie);
+
+// Adds |key| of |length| bytes with |tags| to |trie|. If |key| is already
+// present, |tags| are merged into its existing tags. Neither |trie| nor |key|
+// may be NULL.
+void prefix_trie_add(prefix_trie_t *trie, const void *key, size_t length, uint64_t tags);
+
+// Returns the union of the tags of all keys in |trie| which are a prefix of,
+// or equal to, the |length| bytes at |key|. Neither |trie| nor |key| may be
+// NULL.
+uint64_t prefix_trie_match_prefixes(const prefix_trie_t *trie, const void *key, size_t length);
+
+// Returns the union of the tags of all keys in |trie| which start with, or
+// are equal to, the |length| bytes at |key|. Neither |trie| nor |key| may be
+// NULL.
+uint64_t prefix_trie_match_extensions(const prefix_trie_t *trie, const void *key, size_t length);
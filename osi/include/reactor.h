@@ -19,6 +19,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "osi/include/osi.h"
@@ -80,3 +81,39 @@ bool reactor_change_registration(reactor_object_t *object,
 // Unregisters a previously registered file descriptor with its reactor. |obj| may not be NULL.
 // |obj| is invalid after calling this function so the caller must drop all references to it.
 void reactor_unregister(reactor_object_t *obj);
+
+// Message loop statistics of a reactor. Collection is off by default; while
+// off the reactor only checks a flag per loop iteration.
+typedef struct {
+  uint64_t iterations;  // number of times epoll_wait() returned.
+  uint64_t events;      // number of callbacks dispatched.
+  uint64_t busy_us;     // time spent dispatching callbacks.
+  uint64_t idle_us;     // time spent blocked in epoll_wait().
+} reactor_stats_t;
+
+// Turns statistics collection on or off for all reactors.
+void reactor_set_stats_enabled(bool enabled);
+
+// Returns true if reactors are collecting statistics.
+bool reactor_stats_enabled(void);
+
+// Copies the loop statistics of |reactor| into |stats|. Neither argument may be NULL.
+void reactor_get_stats(reactor_t *reactor, reactor_stats_t *stats);
+
+// Called from a callback running on |reactor| to attribute the current dispatch
+// to |key| instead of the registered callback, e.g. a work item's function.
+// |wait_us| is how long the input waited in a queue before being picked up
+// and |depth| how many entries were queued. |reactor| may not be NULL.
+void reactor_annotate_callback(reactor_t *reactor, const void *key, uint64_t wait_us, size_t depth);
+
+// Statistics of a reactor copied out by |reactor_debug_snapshot|.
+typedef struct reactor_debug_snapshot_t reactor_debug_snapshot_t;
+
+// Returns a copy of the statistics of |reactor| for |reactor_debug_dump|, so
+// they can be written out without holding any lock. The caller owns the copy
+// and frees it with |osi_free|. |reactor| may not be NULL.
+reactor_debug_snapshot_t *reactor_debug_snapshot(reactor_t *reactor);
+
+// Dumps |snapshot| to |fd| under |name|, as text or as comma separated
+// records if |csv| is true. |snapshot| and |name| may not be NULL.
+void reactor_debug_dump(const reactor_debug_snapshot_t *snapshot, const char *name, int fd, bool csv);
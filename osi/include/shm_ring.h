@@ -0,0 +1,98 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// A single-producer/single-consumer byte ring living in a memfd so it can be
+// shared between two processes. The indices live in the shared mapping and
+// are updated with atomic loads/stores, so moving data in either direction
+// does not need a system call. Each side owns an eventfd which is only
+// signalled when the peer has declared that it is blocked waiting for a
+// given amount of data (or space), i.e. wakeups only happen at watermarks.
+//
+// One process creates the ring with |shm_ring_new| and hands the descriptors
+// returned by |shm_ring_get_fds| to its peer (e.g. over SCM_RIGHTS), which
+// maps the same memory with |shm_ring_attach|.
+
+// Number of file descriptors that describe a ring: the memfd, the eventfd
+// used to wake up the consumer and the eventfd used to wake up the producer.
+#define SHM_RING_FD_COUNT 3
+
+struct shm_ring_t;
+typedef struct shm_ring_t shm_ring_t;
+
+// Creates a new ring able to hold at least |capacity| bytes. The capacity is
+// rounded up to the next power of two. |name| is only used to label the memfd.
+// Returns NULL on failure (e.g. memfd not supported by the kernel). The
+// returned object must be freed with |shm_ring_free|.
+shm_ring_t *shm_ring_new(const char *name, size_t capacity);
+
+// Maps a ring created by a peer from the descriptors received from it. Takes
+// ownership of the descriptors in |fds| in all cases, and closes them on
+// failure. Returns NULL if the descriptors do not describe a valid ring.
+shm_ring_t *shm_ring_attach(const int fds[SHM_RING_FD_COUNT]);
+
+// Marks the ring as closed for the peer, wakes it up if it is blocked and
+// releases all local resources. Safe to call with NULL.
+void shm_ring_free(shm_ring_t *ring);
+
+// Copies the descriptors describing |ring| into |fds| so they can be sent to
+// the peer. The descriptors remain owned by |ring|. |ring| may not be NULL.
+void shm_ring_get_fds(const shm_ring_t *ring, int fds[SHM_RING_FD_COUNT]);
+
+// Returns the usable capacity of |ring| in bytes. |ring| may not be NULL.
+size_t shm_ring_capacity(const shm_ring_t *ring);
+
+// Returns the number of bytes that can currently be read from |ring|.
+// |ring| may not be NULL.
+size_t shm_ring_size(const shm_ring_t *ring);
+
+// Returns the number of bytes that can currently be written into |ring|.
+// |ring| may not be NULL.
+size_t shm_ring_available(const shm_ring_t *ring);
+
+// Returns true if either side has released the ring. Data already in the
+// ring can still be read after the producer went away. |ring| may not be NULL.
+bool shm_ring_is_closed(const shm_ring_t *ring);
+
+// Copies up to |length| bytes from |data| into |ring| without blocking.
+// Returns the number of bytes written, which may be less than |length| if
+// the ring is full, or -1 if the ring has been closed. Must only be called
+// by the producer.
+ssize_t shm_ring_write(shm_ring_t *ring, const void *data, size_t length);
+
+// Copies up to |length| bytes from |ring| into |buffer| without blocking.
+// Returns the number of bytes read. Must only be called by the consumer.
+size_t shm_ring_read(shm_ring_t *ring, void *buffer, size_t length);
+
+// Drops everything currently in |ring|. Must only be called by the consumer.
+void shm_ring_flush(shm_ring_t *ring);
+
+// Blocks the producer until at least |length| bytes can be written, the ring
+// is closed or |timeout_ms| elapses. |length| is clamped to the capacity.
+// Returns true if the requested space is available.
+bool shm_ring_wait_writable(shm_ring_t *ring, size_t length, int timeout_ms);
+
+// Blocks the consumer until at least |length| bytes can be read, the ring is
+// closed or |timeout_ms| elapses. |length| is clamped to the capacity.
+// Returns true if the requested data is available.
+bool shm_ring_wait_readable(shm_ring_t *ring, size_t length, int timeout_ms);
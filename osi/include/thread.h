@@ -19,6 +19,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #define THREAD_NAME_MAX 16
@@ -27,6 +28,17 @@ typedef struct reactor_t reactor_t;
 typedef struct thread_t thread_t;
 typedef void (*thread_fn)(void *context);
 
+// A unit of work which can be posted to a thread without allocating. The
+// object is owned by the caller; |func| is called with |context| on the
+// target thread and may free or reuse the object, e.g. when it is embedded
+// in a message.
+typedef struct thread_work_t {
+  struct thread_work_t *next;  // Owned by the thread while queued.
+  uint64_t posted_us;          // Owned by the thread while queued.
+  thread_fn func;
+  void *context;
+} thread_work_t;
+
 // Creates and starts a new thread with the given name. Only THREAD_NAME_MAX
 // bytes from |name| will be assigned to the newly-created thread. Returns a
 // thread object if the thread was successfully started, NULL otherwise. The
@@ -54,6 +66,15 @@ void thread_join(thread_t *thread);
 // Return true on success, otherwise false.
 bool thread_post(thread_t *thread, thread_fn func, void *context);
 
+// Like |thread_post| but queues the caller provided |work| instead of
+// allocating a queue item, and runs |work->func| with |work->context| on
+// |thread|. |work| must stay valid and must not be posted again until its
+// function has been called. Items are dispatched in posting order together
+// with those of |thread_post|. Neither |thread|, |work| nor |work->func| may
+// be NULL.
+// Return true on success, otherwise false.
+bool thread_post_work(thread_t *thread, thread_work_t *work);
+
 // Requests |thread| to stop. Only |thread_free| and |thread_name| may be called
 // after calling |thread_stop|. This function is guaranteed to not block.
 // |thread| may not be NULL.
@@ -73,3 +94,12 @@ reactor_t *thread_get_reactor(const thread_t *thread);
 
 // Returns the name of the given |thread|. |thread| may not be NULL.
 const char *thread_name(const thread_t *thread);
+
+// Dumps the message loop statistics of every thread to |fd|: reactor
+// utilization, work queue wait times and per callback run times. Statistics
+// are only collected while |reactor_stats_enabled| is true.
+void thread_debug_dump(int fd);
+
+// Same as |thread_debug_dump| but as comma separated records, one per line,
+// for tools to parse.
+void thread_debug_dump_csv(int fd);
@@ -32,12 +32,22 @@
 #include <sys/stat.h>
 
 #include "osi/include/allocator.h"
+#include "osi/include/hash_functions.h"
+#include "osi/include/hash_map.h"
 #include "osi/include/list.h"
 #include "osi/include/log.h"
 #include "log/log.h"
 
+// Number of buckets in the section index. Sized for a bond table of a few
+// hundred devices, each of which gets its own section in bt_config.conf.
+#define SECTION_INDEX_BUCKETS 1024
+
+// Number of buckets in the interned key pool. The set of distinct keys is
+// small and fixed by the code that writes them, regardless of section count.
+#define KEY_POOL_BUCKETS 64
+
 typedef struct {
-  char *key;
+  const char *key;  // Interned in |config_t.keys|; not owned by the entry.
   char *value;
 } entry_t;
 
@@ -47,7 +57,15 @@ typedef struct {
 } section_t;
 
 struct config_t {
+  // Sections in insertion order, which is the order they are saved in.
   list_t *sections;
+
+  // Index of |sections| by name. Keys point at |section_t.name|.
+  hash_map_t *section_index;
+
+  // Every key string used by any section, stored once. Entries point into
+  // this pool so keys can be matched by pointer instead of with strcmp.
+  hash_map_t *keys;
 };
 
 // Empty definition; this type is aliased to list_node_t.
@@ -62,6 +80,10 @@ static section_t *section_find(const config_t *config, const char *section);
 static entry_t *entry_new(const char *key, const char *value);
 static void entry_free(void *ptr);
 static entry_t *entry_find(const config_t *config, const char *section, const char *key);
+static entry_t *section_entry_find(const section_t *sec, const char *interned_key);
+
+static const char *key_intern(config_t *config, const char *key);
+static bool string_equals(const void *x, const void *y);
 
 config_t *config_new_empty(void) {
   config_t *config = osi_calloc(sizeof(config_t));
@@ -72,6 +94,20 @@ config_t *config_new_empty(void) {
     goto error;
   }
 
+  config->section_index = hash_map_new(SECTION_INDEX_BUCKETS,
+      hash_function_string, NULL, NULL, string_equals);
+  if (!config->section_index) {
+    LOG_ERROR(LOG_TAG, "%s unable to allocate section index.", __func__);
+    goto error;
+  }
+
+  config->keys = hash_map_new(KEY_POOL_BUCKETS, hash_function_string,
+      osi_free, NULL, string_equals);
+  if (!config->keys) {
+    LOG_ERROR(LOG_TAG, "%s unable to allocate key pool.", __func__);
+    goto error;
+  }
+
   return config;
 
 error:;
@@ -130,7 +166,11 @@ void config_free(config_t *config) {
   if (!config)
     return;
 
+  // The index and the entries only reference names and keys; free them before
+  // the storage they point into.
+  hash_map_free(config->section_index);
   list_free(config->sections);
+  hash_map_free(config->keys);
   osi_free(config);
 }
 
@@ -214,9 +254,10 @@ void config_set_string(config_t *config, const char *section, const char *key, c
   section_t *sec = section_find(config, section);
   if (!sec) {
     sec = section_new(section);
-    if (sec)
+    if (sec) {
       list_append(config->sections, sec);
-    else {
+      hash_map_set(config->section_index, sec->name, sec);
+    } else {
       LOG_ERROR(LOG_TAG,"%s: Unable to allocate memory for section", __func__);
     }
   }
@@ -236,19 +277,18 @@ void config_set_string(config_t *config, const char *section, const char *key, c
     } else {
       value_no_newline = value_string;
     }
-    for (const list_node_t *node = list_begin(sec->entries); node != list_end(sec->entries); node = list_next(node)) {
-      entry_t *entry = list_node(node);
-      if (!strcmp(entry->key, key)) {
-        osi_free(entry->value);
-        entry->value = osi_strdup(value_no_newline);
-        if (newline) {
-          osi_free(value_no_newline);
-        }
-        return;
+    const char *interned_key = key_intern(config, key);
+    entry_t *entry = section_entry_find(sec, interned_key);
+    if (entry) {
+      osi_free(entry->value);
+      entry->value = osi_strdup(value_no_newline);
+      if (newline) {
+        osi_free(value_no_newline);
       }
+      return;
     }
 
-    entry_t *entry = entry_new(key, value_no_newline);
+    entry = entry_new(interned_key, value_no_newline);
     if (newline) {
       osi_free(value_no_newline);
     }
@@ -264,6 +304,7 @@ bool config_remove_section(config_t *config, const char *section) {
   if (!sec)
     return false;
 
+  hash_map_erase(config->section_index, sec->name);
   return list_remove(config->sections, sec);
 }
 
@@ -491,19 +532,13 @@ static void section_free(void *ptr) {
 }
 
 static section_t *section_find(const config_t *config, const char *section) {
-  for (const list_node_t *node = list_begin(config->sections); node != list_end(config->sections); node = list_next(node)) {
-    section_t *sec = list_node(node);
-    if (!strcmp(sec->name, section))
-      return sec;
-  }
-
-  return NULL;
+  return hash_map_get(config->section_index, section);
 }
 
 static entry_t *entry_new(const char *key, const char *value) {
   entry_t *entry = osi_calloc(sizeof(entry_t));
 
-  entry->key = osi_strdup(key);
+  entry->key = key;
   entry->value = osi_strdup(value);
   return entry;
 }
@@ -513,7 +548,6 @@ static void entry_free(void *ptr) {
     return;
 
   entry_t *entry = ptr;
-  osi_free(entry->key);
   osi_free(entry->value);
   osi_free(entry);
 }
@@ -523,11 +557,33 @@ static entry_t *entry_find(const config_t *config, const char *section, const ch
   if (!sec)
     return NULL;
 
+  // A key that was never interned can't be present in any section.
+  const char *interned_key = hash_map_get(config->keys, key);
+  if (!interned_key)
+    return NULL;
+
+  return section_entry_find(sec, interned_key);
+}
+
+static entry_t *section_entry_find(const section_t *sec, const char *interned_key) {
   for (const list_node_t *node = list_begin(sec->entries); node != list_end(sec->entries); node = list_next(node)) {
     entry_t *entry = list_node(node);
-    if (!strcmp(entry->key, key))
+    if (entry->key == interned_key)
       return entry;
   }
 
   return NULL;
 }
+
+static const char *key_intern(config_t *config, const char *key) {
+  char *interned_key = hash_map_get(config->keys, key);
+  if (!interned_key) {
+    interned_key = osi_strdup(key);
+    hash_map_set(config->keys, interned_key, interned_key);
+  }
+  return interned_key;
+}
+
+static bool string_equals(const void *x, const void *y) {
+  return !strcmp((const char *)x, (const char *)y);
+}
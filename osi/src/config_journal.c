@@ -0,0 +1,280 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_config_journal"
+
+#include "osi/include/config_journal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "osi/include/allocator.h"
+#include "osi/include/list.h"
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+
+// A single queued change.
+typedef struct {
+  char *section;
+  char *key;
+  char *value;  // NULL if the key was removed.
+} record_t;
+
+struct config_journal_t {
+  list_t *records;  // record_t, in the order the changes were made.
+};
+
+static void record(config_journal_t *journal, const char *section, const char *key, char *value);
+static void record_free(void *ptr);
+
+config_journal_t *config_journal_new(void) {
+  config_journal_t *journal = osi_calloc(sizeof(config_journal_t));
+
+  journal->records = list_new(record_free);
+  if (!journal->records) {
+    LOG_ERROR(LOG_TAG, "%s unable to allocate list for records.", __func__);
+    osi_free(journal);
+    return NULL;
+  }
+
+  return journal;
+}
+
+void config_journal_free(config_journal_t *journal) {
+  if (!journal)
+    return;
+
+  list_free(journal->records);
+  osi_free(journal);
+}
+
+void config_journal_set(config_journal_t *journal, const char *section, const char *key, const char *value) {
+  assert(journal != NULL);
+  assert(section != NULL);
+  assert(key != NULL);
+  assert(value != NULL);
+
+  const char *newline = strchr(value, '\n');
+  record(journal, section, key,
+         newline ? osi_strndup(value, newline - value) : osi_strdup(value));
+}
+
+void config_journal_remove(config_journal_t *journal, const char *section, const char *key) {
+  assert(journal != NULL);
+  assert(section != NULL);
+  assert(key != NULL);
+
+  record(journal, section, key, NULL);
+}
+
+bool config_journal_is_empty(const config_journal_t *journal) {
+  assert(journal != NULL);
+  return list_is_empty(journal->records);
+}
+
+void config_journal_clear(config_journal_t *journal) {
+  assert(journal != NULL);
+  list_clear(journal->records);
+}
+
+bool config_journal_append(config_journal_t *journal, const char *filename, size_t *size) {
+  assert(journal != NULL);
+  assert(filename != NULL);
+  assert(size != NULL);
+
+  if (list_is_empty(journal->records))
+    return true;
+
+  size_t len = 0;
+  for (const list_node_t *node = list_begin(journal->records);
+       node != list_end(journal->records); node = list_next(node)) {
+    const record_t *rec = list_node(node);
+    len += strlen(rec->section) + strlen(rec->key) + sizeof("remove\t\t\n");
+    if (rec->value)
+      len += strlen(rec->value) + 1;
+  }
+
+  char *buf = osi_malloc(len + 1);
+  size_t offset = 0;
+  for (const list_node_t *node = list_begin(journal->records);
+       node != list_end(journal->records); node = list_next(node)) {
+    const record_t *rec = list_node(node);
+    if (rec->value) {
+      offset += snprintf(buf + offset, len + 1 - offset, "set\t%s\t%s\t%s\n",
+                         rec->section, rec->key, rec->value);
+    } else {
+      offset += snprintf(buf + offset, len + 1 - offset, "remove\t%s\t%s\n",
+                         rec->section, rec->key);
+    }
+  }
+
+  bool ret = false;
+  int fd;
+  OSI_NO_INTR(fd = open(filename, O_WRONLY | O_APPEND));
+  if (fd < 0) {
+    LOG_ERROR(LOG_TAG, "%s unable to open journal '%s': %s", __func__,
+              filename, strerror(errno));
+    goto done;
+  }
+
+  ssize_t written;
+  OSI_NO_INTR(written = write(fd, buf, offset));
+  if (written != (ssize_t)offset) {
+    LOG_ERROR(LOG_TAG, "%s unable to append to journal '%s': %s", __func__,
+              filename, strerror(errno));
+    close(fd);
+    goto done;
+  }
+
+  if (fdatasync(fd) < 0)
+    LOG_WARN(LOG_TAG, "%s unable to sync journal '%s': %s", __func__,
+             filename, strerror(errno));
+
+  close(fd);
+  list_clear(journal->records);
+  *size += offset;
+  ret = true;
+
+done:
+  osi_free(buf);
+  return ret;
+}
+
+bool config_journal_reset(const char *filename, int generation, size_t *size) {
+  assert(filename != NULL);
+  assert(size != NULL);
+
+  int fd;
+  OSI_NO_INTR(fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP));
+  if (fd < 0) {
+    LOG_ERROR(LOG_TAG, "%s unable to create journal '%s': %s", __func__,
+              filename, strerror(errno));
+    return false;
+  }
+
+  char header[32];
+  int len = snprintf(header, sizeof(header), "generation\t%d\n", generation);
+  ssize_t written;
+  OSI_NO_INTR(written = write(fd, header, len));
+  if (written == len && fdatasync(fd) < 0)
+    LOG_WARN(LOG_TAG, "%s unable to sync journal '%s': %s", __func__,
+             filename, strerror(errno));
+  close(fd);
+
+  if (written != len) {
+    LOG_ERROR(LOG_TAG, "%s unable to write journal '%s': %s", __func__,
+              filename, strerror(errno));
+    return false;
+  }
+
+  *size = len;
+  return true;
+}
+
+bool config_journal_replay(const char *filename, config_t *config, int generation, size_t *size) {
+  assert(filename != NULL);
+  assert(config != NULL);
+  assert(size != NULL);
+
+  *size = 0;
+
+  FILE *fp = fopen(filename, "rt");
+  if (!fp)
+    return false;
+
+  // Records can be arbitrarily long (e.g. HID descriptors), so lines are read
+  // whole rather than into a fixed buffer.
+  char *line = NULL;
+  size_t line_capacity = 0;
+  ssize_t len = getline(&line, &line_capacity, fp);
+  int journal_gen = -1;
+  if (len <= 0 ||
+      sscanf(line, "generation\t%d\n", &journal_gen) != 1 ||
+      journal_gen != generation) {
+    LOG_WARN(LOG_TAG, "%s ignoring journal for generation %d, config is %d",
+             __func__, journal_gen, generation);
+    free(line);
+    fclose(fp);
+    return false;
+  }
+
+  size_t replayed_size = len;
+  int replayed = 0;
+  bool intact = true;
+  while ((len = getline(&line, &line_capacity, fp)) > 0) {
+    // Only the last record can lack its newline: it was cut short by a crash
+    // while it was being appended. Everything before it is complete.
+    if (line[len - 1] != '\n') {
+      LOG_WARN(LOG_TAG, "%s dropping incomplete journal record", __func__);
+      intact = false;
+      break;
+    }
+    line[len - 1] = '\0';
+
+    char *save = NULL;
+    const char *op = strtok_r(line, "\t", &save);
+    const char *section = strtok_r(NULL, "\t", &save);
+    const char *key = strtok_r(NULL, "\t", &save);
+    if (!op || !section || !key) {
+      intact = false;
+      break;
+    }
+
+    if (!strcmp(op, "set")) {
+      // The value is the rest of the line and may itself contain tabs.
+      const char *value = save ? save : "";
+      config_set_string(config, section, key, value);
+    } else if (!strcmp(op, "remove")) {
+      config_remove_key(config, section, key);
+    } else {
+      intact = false;
+      break;
+    }
+    replayed_size += len;
+    ++replayed;
+  }
+  free(line);
+  fclose(fp);
+
+  LOG_INFO(LOG_TAG, "%s replayed %d journal records", __func__, replayed);
+  *size = replayed_size;
+  return intact;
+}
+
+static void record(config_journal_t *journal, const char *section, const char *key, char *value) {
+  record_t *rec = osi_calloc(sizeof(record_t));
+  rec->section = osi_strdup(section);
+  rec->key = osi_strdup(key);
+  rec->value = value;
+  list_append(journal->records, rec);
+}
+
+static void record_free(void *ptr) {
+  record_t *rec = ptr;
+  osi_free(rec->section);
+  osi_free(rec->key);
+  osi_free(rec->value);
+  osi_free(rec);
+}
@@ -26,6 +26,11 @@
 #include "osi/include/osi.h"
 #include "osi/include/semaphore.h"
 #include "osi/include/reactor.h"
+#include "osi/include/time.h"
+
+// Enqueue times kept per queue while statistics are enabled. Entries queued
+// further back than this don't get a wait time.
+#define ENQUEUE_STAMPS 32
 
 typedef struct fixed_queue_t {
   list_t *list;
@@ -35,11 +40,21 @@ typedef struct fixed_queue_t {
   size_t capacity;
 
   reactor_object_t *dequeue_object;
+  reactor_t *dequeue_reactor;
   fixed_queue_cb dequeue_ready;
   void *dequeue_context;
+
+  // Enqueue times in queue order, protected by |lock|. Allocated the first
+  // time an entry is queued with statistics enabled. Removing entries out of
+  // order skews the pairing; the wait times are only a debugging aid.
+  uint64_t *enqueue_us;
+  size_t enqueued;
+  size_t dequeued;
 } fixed_queue_t;
 
 static void internal_dequeue_ready(void *context);
+static void append_locked(fixed_queue_t *queue, void *data);
+static void *take_front_locked(fixed_queue_t *queue);
 
 fixed_queue_t *fixed_queue_new(size_t capacity) {
   fixed_queue_t *ret = osi_calloc(sizeof(fixed_queue_t));
@@ -77,6 +92,7 @@ void fixed_queue_free(fixed_queue_t *queue, fixed_queue_free_cb free_cb) {
       free_cb(list_node(node));
 
   list_free(queue->list);
+  osi_free(queue->enqueue_us);
   semaphore_free(queue->enqueue_sem);
   semaphore_free(queue->dequeue_sem);
   pthread_mutex_destroy(&queue->lock);
@@ -118,7 +134,7 @@ void fixed_queue_enqueue(fixed_queue_t *queue, void *data) {
   semaphore_wait(queue->enqueue_sem);
 
   pthread_mutex_lock(&queue->lock);
-  list_append(queue->list, data);
+  append_locked(queue, data);
   pthread_mutex_unlock(&queue->lock);
 
   semaphore_post(queue->dequeue_sem);
@@ -130,8 +146,7 @@ void *fixed_queue_dequeue(fixed_queue_t *queue) {
   semaphore_wait(queue->dequeue_sem);
 
   pthread_mutex_lock(&queue->lock);
-  void *ret = list_front(queue->list);
-  list_remove(queue->list, ret);
+  void *ret = take_front_locked(queue);
   pthread_mutex_unlock(&queue->lock);
 
   semaphore_post(queue->enqueue_sem);
@@ -147,7 +162,7 @@ bool fixed_queue_try_enqueue(fixed_queue_t *queue, void *data) {
     return false;
 
   pthread_mutex_lock(&queue->lock);
-  list_append(queue->list, data);
+  append_locked(queue, data);
   pthread_mutex_unlock(&queue->lock);
 
   semaphore_post(queue->dequeue_sem);
@@ -162,8 +177,7 @@ void *fixed_queue_try_dequeue(fixed_queue_t *queue) {
     return NULL;
 
   pthread_mutex_lock(&queue->lock);
-  void *ret = list_front(queue->list);
-  list_remove(queue->list, ret);
+  void *ret = take_front_locked(queue);
   pthread_mutex_unlock(&queue->lock);
 
   semaphore_post(queue->enqueue_sem);
@@ -203,6 +217,7 @@ void *fixed_queue_try_remove_from_queue(fixed_queue_t *queue, void *data) {
       semaphore_try_wait(queue->dequeue_sem)) {
     removed = list_remove(queue->list, data);
     assert(removed);
+    queue->dequeued++;
   }
   pthread_mutex_unlock(&queue->lock);
 
@@ -242,6 +257,7 @@ void fixed_queue_register_dequeue(fixed_queue_t *queue, reactor_t *reactor, fixe
 
   queue->dequeue_ready = ready_cb;
   queue->dequeue_context = context;
+  queue->dequeue_reactor = reactor;
   queue->dequeue_object = reactor_register(
     reactor,
     fixed_queue_get_dequeue_fd(queue),
@@ -264,5 +280,40 @@ static void internal_dequeue_ready(void *context) {
   assert(context != NULL);
 
   fixed_queue_t *queue = context;
+
+  if (reactor_stats_enabled()) {
+    uint64_t wait_us = 0;
+    pthread_mutex_lock(&queue->lock);
+    size_t depth = list_length(queue->list);
+    if (queue->enqueue_us && depth && queue->enqueued - queue->dequeued <= ENQUEUE_STAMPS) {
+      uint64_t enqueued_us = queue->enqueue_us[queue->dequeued % ENQUEUE_STAMPS];
+      if (enqueued_us)
+        wait_us = time_get_os_boottime_us() - enqueued_us;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    reactor_annotate_callback(queue->dequeue_reactor, (const void *)queue->dequeue_ready,
+                              wait_us, depth);
+  }
+
   queue->dequeue_ready(queue, queue->dequeue_context);
 }
+
+static void append_locked(fixed_queue_t *queue, void *data) {
+  list_append(queue->list, data);
+
+  if (!queue->enqueue_us && reactor_stats_enabled())
+    queue->enqueue_us = osi_calloc(ENQUEUE_STAMPS * sizeof(uint64_t));
+  if (queue->enqueue_us) {
+    queue->enqueue_us[queue->enqueued % ENQUEUE_STAMPS] =
+        reactor_stats_enabled() ? time_get_os_boottime_us() : 0;
+  }
+  queue->enqueued++;
+}
+
+static void *take_front_locked(fixed_queue_t *queue) {
+  void *data = list_front(queue->list);
+  list_remove(queue->list, data);
+  queue->dequeued++;
+  return data;
+}
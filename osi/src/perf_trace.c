@@ -0,0 +1,314 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_perf_trace"
+
+#include "osi/include/perf_trace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "osi/include/allocator.h"
+#include "osi/include/compat.h"
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+#include "osi/include/time.h"
+
+// Threads that can record events in JSON mode at the same time; events from
+// any further threads are dropped.
+#define MAX_THREADS 32
+
+// Events kept per thread. Older events are overwritten.
+#define EVENTS_PER_THREAD 4096
+
+typedef struct {
+  const char *name;
+  int64_t value;
+  uint64_t timestamp_us;
+  char phase;
+} event_t;
+
+// Events of one thread. Only the owning thread writes |events| and |count|,
+// so recording needs no lock; |perf_trace_stop| reads them once tracing is off.
+// The slot is handed back when the thread exits, and reused once the next
+// |perf_trace_start| has cleared its events.
+typedef struct {
+  pthread_t thread;
+  pid_t tid;
+  char name[17];
+  event_t *events;
+  uint32_t count;
+  bool in_use;  // Owned by a running thread. Guarded by |lock|.
+} thread_buffer_t;
+
+static const char *TRACE_MARKER_PATHS[] = {
+  "/sys/kernel/tracing/trace_marker",
+  "/sys/kernel/debug/tracing/trace_marker",
+};
+
+bool perf_trace_active;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static perf_trace_mode_t mode;
+static int trace_marker_fd = INVALID_FD;
+static char json_path[256];
+static pid_t pid;
+
+static thread_buffer_t buffers[MAX_THREADS];
+static uint32_t dropped_threads;
+
+// Points each thread at its slot in |buffers|.
+static pthread_once_t buffer_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t buffer_key;
+
+static void buffer_key_init(void);
+static void buffer_release(void *context);
+static thread_buffer_t *buffer_for_current_thread(void);
+static void record(char phase, const char *name, int64_t value);
+static void write_marker(char phase, const char *name, int64_t value);
+static size_t write_json(void);
+
+bool perf_trace_start(perf_trace_mode_t new_mode, const char *path) {
+  pthread_mutex_lock(&lock);
+
+  if (perf_trace_is_active()) {
+    pthread_mutex_unlock(&lock);
+    return false;
+  }
+
+  pthread_once(&buffer_key_once, buffer_key_init);
+
+  pid = getpid();
+  if (new_mode == PERF_TRACE_FTRACE) {
+    for (size_t i = 0; i < ARRAY_SIZE(TRACE_MARKER_PATHS) && trace_marker_fd == INVALID_FD; ++i)
+      trace_marker_fd = open(TRACE_MARKER_PATHS[i], O_WRONLY | O_CLOEXEC);
+    if (trace_marker_fd == INVALID_FD) {
+      LOG_ERROR(LOG_TAG, "%s unable to open trace_marker: %s", __func__, strerror(errno));
+      pthread_mutex_unlock(&lock);
+      return false;
+    }
+  } else {
+    assert(path != NULL);
+    strlcpy(json_path, path, sizeof(json_path));
+    for (size_t i = 0; i < MAX_THREADS; ++i)
+      buffers[i].count = 0;
+    dropped_threads = 0;
+  }
+
+  mode = new_mode;
+  __atomic_store_n(&perf_trace_active, true, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&lock);
+
+  LOG_INFO(LOG_TAG, "%s tracing to %s", __func__,
+           new_mode == PERF_TRACE_FTRACE ? "trace_marker" : json_path);
+  return true;
+}
+
+size_t perf_trace_stop(void) {
+  pthread_mutex_lock(&lock);
+
+  if (!perf_trace_is_active()) {
+    pthread_mutex_unlock(&lock);
+    return 0;
+  }
+  __atomic_store_n(&perf_trace_active, false, __ATOMIC_RELEASE);
+
+  // The trace_marker stays open until |perf_trace_cleanup| so a thread that
+  // saw tracing as active never writes to a closed, possibly reused, fd.
+  size_t written = 0;
+  if (mode == PERF_TRACE_JSON)
+    written = write_json();
+
+  pthread_mutex_unlock(&lock);
+  return written;
+}
+
+void perf_trace_cleanup(void) {
+  pthread_mutex_lock(&lock);
+  assert(!perf_trace_is_active());
+
+  // Threads that are still running find their slot gone on the next event
+  // and take a new one.
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    osi_free(buffers[i].events);
+    memset(&buffers[i], 0, sizeof(buffers[i]));
+  }
+
+  if (trace_marker_fd != INVALID_FD) {
+    close(trace_marker_fd);
+    trace_marker_fd = INVALID_FD;
+  }
+
+  pthread_mutex_unlock(&lock);
+}
+
+void perf_trace_begin(const char *name) {
+  record('B', name, 0);
+}
+
+void perf_trace_end(const char *name) {
+  record('E', name, 0);
+}
+
+void perf_trace_counter(const char *name, int64_t value) {
+  record('C', name, value);
+}
+
+static void record(char phase, const char *name, int64_t value) {
+  if (!perf_trace_is_active())
+    return;
+
+  if (mode == PERF_TRACE_FTRACE) {
+    write_marker(phase, name, value);
+    return;
+  }
+
+  thread_buffer_t *buffer = buffer_for_current_thread();
+  if (!buffer)
+    return;
+
+  event_t *event = &buffer->events[buffer->count % EVENTS_PER_THREAD];
+  event->name = name;
+  event->value = value;
+  event->timestamp_us = time_get_os_boottime_us();
+  event->phase = phase;
+  __atomic_store_n(&buffer->count, buffer->count + 1, __ATOMIC_RELEASE);
+}
+
+static void buffer_key_init(void) {
+  int ret = pthread_key_create(&buffer_key, buffer_release);
+  assert(ret == 0);
+}
+
+// Runs on thread exit. The events stay in the slot until they were written out
+// by |perf_trace_stop| and cleared by the next |perf_trace_start|.
+static void buffer_release(void *context) {
+  thread_buffer_t *buffer = (thread_buffer_t *)context;
+
+  pthread_mutex_lock(&lock);
+  // |perf_trace_cleanup| may have given the slot to another thread since.
+  if (buffer->in_use && pthread_equal(buffer->thread, pthread_self()))
+    buffer->in_use = false;
+  pthread_mutex_unlock(&lock);
+}
+
+static thread_buffer_t *buffer_for_current_thread(void) {
+  pthread_t self = pthread_self();
+
+  thread_buffer_t *buffer = (thread_buffer_t *)pthread_getspecific(buffer_key);
+  if (buffer && buffer->in_use && pthread_equal(buffer->thread, self))
+    return buffer;
+
+  // First event from this thread, or its slot was freed by
+  // |perf_trace_cleanup|.
+  pthread_mutex_lock(&lock);
+  buffer = NULL;
+  for (size_t i = 0; i < MAX_THREADS && !buffer; ++i) {
+    if (!buffers[i].in_use && !buffers[i].count)
+      buffer = &buffers[i];
+  }
+
+  if (buffer) {
+    if (!buffer->events)
+      buffer->events = osi_calloc(EVENTS_PER_THREAD * sizeof(event_t));
+    buffer->thread = self;
+    buffer->tid = gettid();
+    buffer->in_use = true;
+    if (prctl(PR_GET_NAME, (unsigned long)buffer->name) == -1)
+      snprintf(buffer->name, sizeof(buffer->name), "%d", buffer->tid);
+    pthread_setspecific(buffer_key, buffer);
+  } else {
+    dropped_threads++;
+  }
+  pthread_mutex_unlock(&lock);
+  return buffer;
+}
+
+// Writes one event in the format atrace uses, which systrace and Perfetto
+// parse out of the ftrace stream.
+static void write_marker(char phase, const char *name, int64_t value) {
+  char marker[128];
+  int length;
+
+  switch (phase) {
+    case 'B':
+      length = snprintf(marker, sizeof(marker), "B|%d|%s", pid, name);
+      break;
+    case 'E':
+      length = snprintf(marker, sizeof(marker), "E|%d", pid);
+      break;
+    default:
+      length = snprintf(marker, sizeof(marker), "C|%d|%s|%" PRId64, pid, name, value);
+      break;
+  }
+
+  if (length > (int)sizeof(marker) - 1)
+    length = sizeof(marker) - 1;
+
+  ssize_t ret;
+  OSI_NO_INTR(ret = write(trace_marker_fd, marker, length));
+}
+
+static size_t write_json(void) {
+  FILE *file = fopen(json_path, "w");
+  if (!file) {
+    LOG_ERROR(LOG_TAG, "%s unable to open %s: %s", __func__, json_path, strerror(errno));
+    return 0;
+  }
+
+  size_t written = 0;
+  bool first = true;
+  fprintf(file, "{\"traceEvents\":[");
+
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    const thread_buffer_t *buffer = &buffers[i];
+    uint32_t events = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+    if (!events)
+      continue;
+
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}", first ? "" : ",", pid, buffer->tid, buffer->name);
+    first = false;
+
+    uint32_t oldest = events > EVENTS_PER_THREAD ? events - EVENTS_PER_THREAD : 0;
+    for (uint32_t j = oldest; j < events; ++j) {
+      const event_t *event = &buffer->events[j % EVENTS_PER_THREAD];
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64 ",\"pid\":%d,\"tid\":%d",
+              event->name, event->phase, event->timestamp_us, pid, buffer->tid);
+      if (event->phase == 'C')
+        fprintf(file, ",\"args\":{\"value\":%" PRId64 "}", event->value);
+      fprintf(file, "}");
+      written++;
+    }
+  }
+
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(file);
+
+  if (dropped_threads)
+    LOG_WARN(LOG_TAG, "%s events of %u threads were dropped", __func__, dropped_threads);
+  LOG_INFO(LOG_TAG, "%s wrote %zu events to %s", __func__, written, json_path);
+  return written;
+}
@@ -0,0 +1,155 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <assert.h>
+#include <string.h>
+
+#include "osi/include/allocator.h"
+#include "osi/include/prefix_trie.h"
+
+// Index 0 is the root, which is never anybody's child or sibling, so it
+// doubles as the "none" link.
+#define NO_NODE 0
+#define INITIAL_CAPACITY 16
+
+typedef struct {
+  uint64_t tags;          // Tags of the key ending at this node.
+  uint64_t subtree_tags;  // Tags of all keys ending at or below this node.
+  uint32_t first_child;   // Children are kept sorted by |byte|.
+  uint32_t next_sibling;
+  uint8_t byte;
+} prefix_trie_node_t;
+
+struct prefix_trie_t {
+  prefix_trie_node_t *nodes;
+  uint32_t count;
+  uint32_t capacity;
+};
+
+static uint32_t find_child(const prefix_trie_t *trie, uint32_t parent, uint8_t byte);
+static uint32_t find_or_add_child(prefix_trie_t *trie, uint32_t parent, uint8_t byte);
+
+prefix_trie_t *prefix_trie_new(void) {
+  prefix_trie_t *trie = osi_calloc(sizeof(prefix_trie_t));
+  trie->capacity = INITIAL_CAPACITY;
+  trie->nodes = osi_calloc(trie->capacity * sizeof(prefix_trie_node_t));
+  trie->count = 1;
+  return trie;
+}
+
+void prefix_trie_free(prefix_trie_t *trie) {
+  if (!trie)
+    return;
+
+  osi_free(trie->nodes);
+  osi_free(trie);
+}
+
+void prefix_trie_clear(prefix_trie_t *trie) {
+  assert(trie != NULL);
+
+  memset(&trie->nodes[0], 0, sizeof(prefix_trie_node_t));
+  trie->count = 1;
+}
+
+void prefix_trie_add(prefix_trie_t *trie, const void *key, size_t length, uint64_t tags) {
+  assert(trie != NULL);
+  assert(key != NULL);
+
+  const uint8_t *p = (const uint8_t *)key;
+  uint32_t node = NO_NODE;
+
+  trie->nodes[node].subtree_tags |= tags;
+  for (size_t i = 0; i < length; ++i) {
+    node = find_or_add_child(trie, node, p[i]);
+    trie->nodes[node].subtree_tags |= tags;
+  }
+  trie->nodes[node].tags |= tags;
+}
+
+uint64_t prefix_trie_match_prefixes(const prefix_trie_t *trie, const void *key, size_t length) {
+  assert(trie != NULL);
+  assert(key != NULL);
+
+  const uint8_t *p = (const uint8_t *)key;
+  uint32_t node = NO_NODE;
+  uint64_t tags = trie->nodes[node].tags;
+
+  for (size_t i = 0; i < length; ++i) {
+    node = find_child(trie, node, p[i]);
+    if (node == NO_NODE)
+      break;
+    tags |= trie->nodes[node].tags;
+  }
+  return tags;
+}
+
+uint64_t prefix_trie_match_extensions(const prefix_trie_t *trie, const void *key, size_t length) {
+  assert(trie != NULL);
+  assert(key != NULL);
+
+  const uint8_t *p = (const uint8_t *)key;
+  uint32_t node = NO_NODE;
+
+  for (size_t i = 0; i < length; ++i) {
+    node = find_child(trie, node, p[i]);
+    if (node == NO_NODE)
+      return 0;
+  }
+  return trie->nodes[node].subtree_tags;
+}
+
+static uint32_t find_child(const prefix_trie_t *trie, uint32_t parent, uint8_t byte) {
+  uint32_t child = trie->nodes[parent].first_child;
+  while (child != NO_NODE && trie->nodes[child].byte < byte)
+    child = trie->nodes[child].next_sibling;
+
+  if (child != NO_NODE && trie->nodes[child].byte == byte)
+    return child;
+  return NO_NODE;
+}
+
+static uint32_t find_or_add_child(prefix_trie_t *trie, uint32_t parent, uint8_t byte) {
+  uint32_t prev = NO_NODE;
+  uint32_t child = trie->nodes[parent].first_child;
+  while (child != NO_NODE && trie->nodes[child].byte < byte) {
+    prev = child;
+    child = trie->nodes[child].next_sibling;
+  }
+
+  if (child != NO_NODE && trie->nodes[child].byte == byte)
+    return child;
+
+  if (trie->count == trie->capacity) {
+    prefix_trie_node_t *nodes = osi_calloc(2 * trie->capacity * sizeof(prefix_trie_node_t));
+    memcpy(nodes, trie->nodes, trie->count * sizeof(prefix_trie_node_t));
+    osi_free(trie->nodes);
+    trie->nodes = nodes;
+    trie->capacity *= 2;
+  }
+
+  uint32_t node = trie->count++;
+  memset(&trie->nodes[node], 0, sizeof(prefix_trie_node_t));
+  trie->nodes[node].byte = byte;
+  trie->nodes[node].next_sibling = child;
+  if (prev == NO_NODE)
+    trie->nodes[parent].first_child = node;
+  else
+    trie->nodes[prev].next_sibling = node;
+  return node;
+}
@@ -21,8 +21,11 @@
 #include "osi/include/reactor.h"
 
 #include <assert.h>
+#include <dlfcn.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
@@ -32,11 +35,31 @@
 #include "osi/include/allocator.h"
 #include "osi/include/list.h"
 #include "osi/include/log.h"
+#include "osi/include/time.h"
 
 #if !defined(EFD_SEMAPHORE)
 #  define EFD_SEMAPHORE (1 << 0)
 #endif
 
+// Upper bounds, in us, of the queueing delay histogram buckets. The last
+// bucket holds everything above the last bound.
+static const uint64_t WAIT_BOUNDS_US[] = { 100, 500, 1000, 5000, 10000, 50000, 100000 };
+#define WAIT_BUCKETS (sizeof(WAIT_BOUNDS_US) / sizeof(WAIT_BOUNDS_US[0]) + 1)
+
+// Distinct callbacks tracked per reactor. Callbacks past this share the
+// last slot, which is keyed by NULL.
+#define CALLBACK_SLOTS 32
+
+typedef struct {
+  const void *key;
+  uint64_t count;
+  uint64_t run_total_us;
+  uint64_t run_max_us;
+  uint64_t wait_total_us;
+  uint64_t wait_max_us;
+  size_t depth_max;
+} callback_stats_t;
+
 struct reactor_t {
   int epoll_fd;
   int event_fd;
@@ -44,7 +67,25 @@ struct reactor_t {
   list_t *invalidation_list;  // reactor objects that have been unregistered.
   pthread_t run_thread;       // the pthread on which reactor_run is executing.
   bool is_running;            // indicates whether |run_thread| is valid.
+  reactor_object_t *running_object;  // the object whose callbacks are executing.
   bool object_removed;
+
+  // Statistics, written by the reactor thread while collection is enabled.
+  pthread_mutex_t stats_lock;
+  reactor_stats_t stats;
+  uint64_t wait_buckets[WAIT_BUCKETS];
+  callback_stats_t callbacks[CALLBACK_SLOTS];
+
+  // Attribution of the callback being dispatched, see |reactor_annotate_callback|.
+  const void *callback_key;
+  uint64_t callback_wait_us;
+  size_t callback_depth;
+};
+
+struct reactor_debug_snapshot_t {
+  reactor_stats_t stats;
+  uint64_t wait_buckets[WAIT_BUCKETS];
+  callback_stats_t callbacks[CALLBACK_SLOTS];
 };
 
 struct reactor_object_t {
@@ -58,10 +99,13 @@ struct reactor_object_t {
 };
 
 static reactor_status_t run_reactor(reactor_t *reactor, int iterations);
+static void record_callback(reactor_t *reactor, uint64_t run_us);
 
 static const size_t MAX_EVENTS = 64;
 static const eventfd_t EVENT_REACTOR_STOP = 1;
 
+static bool stats_enabled;
+
 reactor_t *reactor_new(void) {
   reactor_t *ret = (reactor_t *)osi_calloc(sizeof(reactor_t));
 
@@ -81,6 +125,7 @@ reactor_t *reactor_new(void) {
   }
 
   pthread_mutex_init(&ret->list_lock, NULL);
+  pthread_mutex_init(&ret->stats_lock, NULL);
   ret->invalidation_list = list_new(NULL);
   if (!ret->invalidation_list) {
     LOG_ERROR(LOG_TAG, "%s unable to allocate object invalidation list.", __func__);
@@ -108,6 +153,7 @@ void reactor_free(reactor_t *reactor) {
     return;
 
   list_free(reactor->invalidation_list);
+  pthread_mutex_destroy(&reactor->stats_lock);
   close(reactor->event_fd);
   close(reactor->epoll_fd);
   osi_free(reactor);
@@ -199,7 +245,21 @@ void reactor_unregister(reactor_object_t *obj) {
     LOG_ERROR(LOG_TAG, "%s unable to unregister fd %d from epoll set: %s", __func__, obj->fd, strerror(errno));
 
   if (reactor->is_running && pthread_equal(pthread_self(), reactor->run_thread)) {
-    reactor->object_removed = true;
+    // The object whose callback is executing is freed by the reactor once
+    // the callback returns.
+    if (obj == reactor->running_object) {
+      reactor->object_removed = true;
+      return;
+    }
+
+    // Any other object can't be in a callback since we're on the reactor
+    // thread. Invalidate it so events already returned by epoll_wait in this
+    // iteration are skipped, then release it right away.
+    pthread_mutex_lock(&reactor->list_lock);
+    list_append(reactor->invalidation_list, obj);
+    pthread_mutex_unlock(&reactor->list_lock);
+    pthread_mutex_destroy(&obj->lock);
+    osi_free(obj);
     return;
   }
 
@@ -236,8 +296,21 @@ static reactor_status_t run_reactor(reactor_t *reactor, int iterations) {
     list_clear(reactor->invalidation_list);
     pthread_mutex_unlock(&reactor->list_lock);
 
+    bool collect = reactor_stats_enabled();
+    uint64_t wait_start_us = collect ? time_get_os_boottime_us() : 0;
+
     int ret;
     OSI_NO_INTR(ret = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1));
+
+    uint64_t busy_start_us = 0;
+    if (collect) {
+      busy_start_us = time_get_os_boottime_us();
+      pthread_mutex_lock(&reactor->stats_lock);
+      reactor->stats.iterations++;
+      reactor->stats.idle_us += busy_start_us - wait_start_us;
+      pthread_mutex_unlock(&reactor->stats_lock);
+    }
+
     if (ret == -1) {
       LOG_ERROR(LOG_TAG, "%s error in epoll_wait: %s", __func__, strerror(errno));
       reactor->is_running = false;
@@ -267,11 +340,19 @@ static reactor_status_t run_reactor(reactor_t *reactor, int iterations) {
       pthread_mutex_lock(&object->lock);
       pthread_mutex_unlock(&reactor->list_lock);
 
+      reactor->running_object = object;
       reactor->object_removed = false;
+      reactor->callback_key = (const void *)object->read_ready;
+      reactor->callback_wait_us = 0;
+      reactor->callback_depth = 0;
+      uint64_t callback_start_us = collect ? time_get_os_boottime_us() : 0;
       if (events[j].events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP | EPOLLERR) && object->read_ready)
         object->read_ready(object->context);
       if (!reactor->object_removed && events[j].events & EPOLLOUT && object->write_ready)
         object->write_ready(object->context);
+      if (collect)
+        record_callback(reactor, time_get_os_boottime_us() - callback_start_us);
+      reactor->running_object = NULL;
       pthread_mutex_unlock(&object->lock);
 
       if (reactor->object_removed) {
@@ -279,8 +360,162 @@ static reactor_status_t run_reactor(reactor_t *reactor, int iterations) {
         osi_free(object);
       }
     }
+
+    if (collect) {
+      pthread_mutex_lock(&reactor->stats_lock);
+      reactor->stats.busy_us += time_get_os_boottime_us() - busy_start_us;
+      pthread_mutex_unlock(&reactor->stats_lock);
+    }
   }
 
   reactor->is_running = false;
   return REACTOR_STATUS_DONE;
 }
+
+void reactor_set_stats_enabled(bool enabled) {
+  __atomic_store_n(&stats_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+bool reactor_stats_enabled(void) {
+  return __atomic_load_n(&stats_enabled, __ATOMIC_RELAXED);
+}
+
+void reactor_get_stats(reactor_t *reactor, reactor_stats_t *stats) {
+  assert(reactor != NULL);
+  assert(stats != NULL);
+
+  pthread_mutex_lock(&reactor->stats_lock);
+  *stats = reactor->stats;
+  pthread_mutex_unlock(&reactor->stats_lock);
+}
+
+void reactor_annotate_callback(reactor_t *reactor, const void *key, uint64_t wait_us, size_t depth) {
+  assert(reactor != NULL);
+
+  reactor->callback_key = key;
+  reactor->callback_wait_us = wait_us;
+  reactor->callback_depth = depth;
+}
+
+static void record_callback(reactor_t *reactor, uint64_t run_us) {
+  const void *key = reactor->callback_key;
+  uint64_t wait_us = reactor->callback_wait_us;
+
+  // Open addressing on the callback address; a full table lands in the
+  // shared last slot.
+  size_t start = ((uintptr_t)key >> 4) % (CALLBACK_SLOTS - 1);
+  size_t index = start;
+
+  pthread_mutex_lock(&reactor->stats_lock);
+  while (reactor->callbacks[index].key != key && reactor->callbacks[index].count != 0) {
+    index = (index + 1) % (CALLBACK_SLOTS - 1);
+    if (index == start) {
+      index = CALLBACK_SLOTS - 1;
+      key = NULL;
+      break;
+    }
+  }
+
+  callback_stats_t *callback = &reactor->callbacks[index];
+  callback->key = key;
+  callback->count++;
+  callback->run_total_us += run_us;
+  if (run_us > callback->run_max_us)
+    callback->run_max_us = run_us;
+  callback->wait_total_us += wait_us;
+  if (wait_us > callback->wait_max_us)
+    callback->wait_max_us = wait_us;
+  if (reactor->callback_depth > callback->depth_max)
+    callback->depth_max = reactor->callback_depth;
+
+  size_t bucket = 0;
+  while (bucket < WAIT_BUCKETS - 1 && wait_us >= WAIT_BOUNDS_US[bucket])
+    bucket++;
+  reactor->wait_buckets[bucket]++;
+  reactor->stats.events++;
+  pthread_mutex_unlock(&reactor->stats_lock);
+}
+
+// Formats |key| into |buffer| as its symbol if it has an exported one, or as
+// library+offset for symbolizing offline.
+static const char *callback_name(const void *key, char *buffer, size_t size) {
+  Dl_info info;
+  if (!key)
+    return "(other)";
+  if (!dladdr(key, &info))
+    return "?";
+  if (info.dli_sname && info.dli_saddr == key)
+    return info.dli_sname;
+
+  const char *library = info.dli_fname ? strrchr(info.dli_fname, '/') : NULL;
+  library = library ? library + 1 : info.dli_fname;
+  snprintf(buffer, size, "%s+0x%" PRIxPTR, library ? library : "?",
+           (uintptr_t)key - (uintptr_t)info.dli_fbase);
+  return buffer;
+}
+
+reactor_debug_snapshot_t *reactor_debug_snapshot(reactor_t *reactor) {
+  assert(reactor != NULL);
+
+  reactor_debug_snapshot_t *snapshot = osi_malloc(sizeof(reactor_debug_snapshot_t));
+
+  pthread_mutex_lock(&reactor->stats_lock);
+  snapshot->stats = reactor->stats;
+  memcpy(snapshot->wait_buckets, reactor->wait_buckets, sizeof(snapshot->wait_buckets));
+  memcpy(snapshot->callbacks, reactor->callbacks, sizeof(snapshot->callbacks));
+  pthread_mutex_unlock(&reactor->stats_lock);
+
+  return snapshot;
+}
+
+void reactor_debug_dump(const reactor_debug_snapshot_t *snapshot, const char *name, int fd, bool csv) {
+  assert(snapshot != NULL);
+  assert(name != NULL);
+
+  const reactor_stats_t *stats = &snapshot->stats;
+
+  if (csv) {
+    dprintf(fd, "loop,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", name,
+            stats->iterations, stats->events, stats->busy_us, stats->idle_us);
+    dprintf(fd, "wait,%s", name);
+    for (size_t i = 0; i < WAIT_BUCKETS - 1; i++)
+      dprintf(fd, ",%" PRIu64 ":%" PRIu64, WAIT_BOUNDS_US[i], snapshot->wait_buckets[i]);
+    dprintf(fd, ",inf:%" PRIu64, snapshot->wait_buckets[WAIT_BUCKETS - 1]);
+    dprintf(fd, "\n");
+  } else {
+    uint64_t total_us = stats->busy_us + stats->idle_us;
+    dprintf(fd, "  %s: %" PRIu64 " loops, %" PRIu64 " callbacks, busy %" PRIu64 " ms of %" PRIu64 " ms (%.1f%%)\n",
+            name, stats->iterations, stats->events, stats->busy_us / 1000, total_us / 1000,
+            total_us ? 100.0 * stats->busy_us / total_us : 0.0);
+    dprintf(fd, "    queue wait(us)");
+    for (size_t i = 0; i < WAIT_BUCKETS - 1; i++)
+      dprintf(fd, "  <%" PRIu64 ": %" PRIu64, WAIT_BOUNDS_US[i], snapshot->wait_buckets[i]);
+    dprintf(fd, "  >=%" PRIu64 ": %" PRIu64 "\n", WAIT_BOUNDS_US[WAIT_BUCKETS - 2],
+            snapshot->wait_buckets[WAIT_BUCKETS - 1]);
+    if (stats->events)
+      dprintf(fd, "    %-40s %8s %9s %9s %9s %9s %5s\n", "callback", "count", "avg run",
+              "max run", "avg wait", "max wait", "depth");
+  }
+
+  for (size_t i = 0; i < CALLBACK_SLOTS; i++) {
+    const callback_stats_t *callback = &snapshot->callbacks[i];
+    if (!callback->count)
+      continue;
+
+    char name_buffer[64];
+    const char *callback_symbol = callback_name(callback->key, name_buffer, sizeof(name_buffer));
+
+    if (csv) {
+      dprintf(fd, "callback,%s,%p,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%zu\n",
+              name, callback->key, callback_symbol, callback->count,
+              callback->run_total_us, callback->run_max_us, callback->wait_total_us,
+              callback->wait_max_us, callback->depth_max);
+    } else {
+      dprintf(fd, "    %-40s %8" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %9" PRIu64 " %5zu\n",
+              callback_symbol, callback->count,
+              callback->run_total_us / callback->count, callback->run_max_us,
+              callback->wait_total_us / callback->count, callback->wait_max_us,
+              callback->depth_max);
+    }
+  }
+}
@@ -0,0 +1,401 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_shm_ring"
+
+#include "osi/include/shm_ring.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "osi/include/allocator.h"
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+
+#if !defined(MFD_CLOEXEC)
+#  define MFD_CLOEXEC 0x0001U
+#  define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#if !defined(F_ADD_SEALS)
+#  define F_ADD_SEALS (1024 + 9)
+#  define F_GET_SEALS (1024 + 10)
+#  define F_SEAL_SEAL 0x0001
+#  define F_SEAL_SHRINK 0x0002
+#  define F_SEAL_GROW 0x0004
+#endif
+
+#if !defined(EFD_NONBLOCK)
+#  define EFD_NONBLOCK O_NONBLOCK
+#endif
+
+#define SHM_RING_MAGIC 0x47525342 // "BSRG"
+#define SHM_RING_MAX_CAPACITY (1U << 30)
+#define SHM_RING_CACHE_LINE 64
+
+// Layout of the shared mapping. The producer and consumer indices live on
+// separate cache lines so the two sides do not bounce a line on every
+// update. Indices are free-running byte counters; the occupied size is
+// always |head - tail| in unsigned 32 bit arithmetic.
+typedef struct {
+  uint32_t magic;
+  uint32_t capacity;
+  uint32_t closed;
+  uint8_t pad0[SHM_RING_CACHE_LINE - 3 * sizeof(uint32_t)];
+
+  // Written by the producer only.
+  uint32_t head;
+  // Set by the consumer to the amount of data it is blocked on, 0 otherwise.
+  uint32_t data_wanted;
+  uint8_t pad1[SHM_RING_CACHE_LINE - 2 * sizeof(uint32_t)];
+
+  // Written by the consumer only.
+  uint32_t tail;
+  // Set by the producer to the amount of space it is blocked on, 0 otherwise.
+  uint32_t space_wanted;
+  uint8_t pad2[SHM_RING_CACHE_LINE - 2 * sizeof(uint32_t)];
+} shm_ring_header_t;
+
+struct shm_ring_t {
+  shm_ring_header_t *header;
+  uint8_t *data;
+  size_t map_size;
+  uint32_t capacity;
+  int mem_fd;
+  int data_fd;   // signalled by the producer, waited on by the consumer
+  int space_fd;  // signalled by the consumer, waited on by the producer
+};
+
+static shm_ring_t *ring_map(int mem_fd, int data_fd, int space_fd, size_t map_size);
+static void ring_release(shm_ring_t *ring);
+static uint32_t ring_used(const shm_ring_t *ring);
+static size_t ring_min(size_t a, size_t b);
+static void ring_notify(uint32_t *wanted, uint32_t ready, int fd);
+static bool ring_wait(shm_ring_t *ring, uint32_t *wanted, bool want_space,
+                      uint32_t length, int fd, int timeout_ms);
+
+shm_ring_t *shm_ring_new(const char *name, size_t capacity) {
+  assert(name != NULL);
+
+  if (capacity == 0 || capacity > SHM_RING_MAX_CAPACITY) {
+    LOG_ERROR(LOG_TAG, "%s invalid capacity %zu", __func__, capacity);
+    return NULL;
+  }
+
+  uint32_t rounded = 1;
+  while (rounded < capacity)
+    rounded <<= 1;
+
+#if defined(__NR_memfd_create)
+  int mem_fd = syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  int mem_fd = INVALID_FD;
+  errno = ENOSYS;
+#endif
+  if (mem_fd == INVALID_FD) {
+    LOG_WARN(LOG_TAG, "%s unable to create memfd: %s", __func__, strerror(errno));
+    return NULL;
+  }
+
+  const size_t map_size = sizeof(shm_ring_header_t) + rounded;
+  if (ftruncate(mem_fd, map_size) == -1 ||
+      fcntl(mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+    LOG_ERROR(LOG_TAG, "%s unable to size memfd: %s", __func__, strerror(errno));
+    close(mem_fd);
+    return NULL;
+  }
+
+  int data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  shm_ring_t *ring = NULL;
+  if (data_fd != INVALID_FD && space_fd != INVALID_FD)
+    ring = ring_map(mem_fd, data_fd, space_fd, map_size);
+
+  if (!ring) {
+    LOG_ERROR(LOG_TAG, "%s unable to set up ring: %s", __func__, strerror(errno));
+    close(mem_fd);
+    if (data_fd != INVALID_FD)
+      close(data_fd);
+    if (space_fd != INVALID_FD)
+      close(space_fd);
+    return NULL;
+  }
+
+  ring->capacity = rounded;
+  ring->header->capacity = rounded;
+  __atomic_store_n(&ring->header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+  return ring;
+}
+
+shm_ring_t *shm_ring_attach(const int fds[SHM_RING_FD_COUNT]) {
+  assert(fds != NULL);
+
+  shm_ring_t *ring = NULL;
+  struct stat st;
+  int seals = fcntl(fds[0], F_GET_SEALS);
+
+  // The peer must not be able to shrink the file under us, or any access to
+  // the mapping could fault.
+  if (fstat(fds[0], &st) == -1 || seals == -1 ||
+      (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW) ||
+      (size_t)st.st_size <= sizeof(shm_ring_header_t)) {
+    LOG_ERROR(LOG_TAG, "%s descriptor %d is not a sealed ring", __func__, fds[0]);
+    goto error;
+  }
+
+  ring = ring_map(fds[0], fds[1], fds[2], st.st_size);
+  if (!ring) {
+    LOG_ERROR(LOG_TAG, "%s unable to map ring: %s", __func__, strerror(errno));
+    goto error;
+  }
+
+  const uint32_t capacity = ring->header->capacity;
+  if (__atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC ||
+      capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+      sizeof(shm_ring_header_t) + capacity != ring->map_size) {
+    LOG_ERROR(LOG_TAG, "%s invalid ring header", __func__);
+    ring_release(ring);
+    return NULL;
+  }
+
+  ring->capacity = capacity;
+  return ring;
+
+error:
+  for (int i = 0; i < SHM_RING_FD_COUNT; ++i)
+    if (fds[i] != INVALID_FD)
+      close(fds[i]);
+  return NULL;
+}
+
+void shm_ring_free(shm_ring_t *ring) {
+  if (!ring)
+    return;
+
+  __atomic_store_n(&ring->header->closed, 1, __ATOMIC_SEQ_CST);
+  eventfd_write(ring->data_fd, 1);
+  eventfd_write(ring->space_fd, 1);
+  ring_release(ring);
+}
+
+void shm_ring_get_fds(const shm_ring_t *ring, int fds[SHM_RING_FD_COUNT]) {
+  assert(ring != NULL);
+  assert(fds != NULL);
+
+  fds[0] = ring->mem_fd;
+  fds[1] = ring->data_fd;
+  fds[2] = ring->space_fd;
+}
+
+size_t shm_ring_capacity(const shm_ring_t *ring) {
+  assert(ring != NULL);
+  return ring->capacity;
+}
+
+size_t shm_ring_size(const shm_ring_t *ring) {
+  assert(ring != NULL);
+  return ring_used(ring);
+}
+
+size_t shm_ring_available(const shm_ring_t *ring) {
+  assert(ring != NULL);
+  return ring->capacity - ring_used(ring);
+}
+
+bool shm_ring_is_closed(const shm_ring_t *ring) {
+  assert(ring != NULL);
+  return __atomic_load_n(&ring->header->closed, __ATOMIC_ACQUIRE) != 0;
+}
+
+ssize_t shm_ring_write(shm_ring_t *ring, const void *data, size_t length) {
+  assert(ring != NULL);
+  assert(data != NULL || length == 0);
+
+  if (shm_ring_is_closed(ring))
+    return -1;
+
+  shm_ring_header_t *header = ring->header;
+  const uint32_t head = header->head;
+  const uint32_t tail = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+  const uint32_t space = ring->capacity - (head - tail);
+  if (space > ring->capacity)
+    return -1;  // Corrupted indices, treat as a dead peer.
+
+  if (length > space)
+    length = space;
+  if (length == 0)
+    return 0;
+
+  const uint32_t offset = head & (ring->capacity - 1);
+  const size_t first = ring_min(length, ring->capacity - offset);
+  memcpy(ring->data + offset, data, first);
+  memcpy(ring->data, (const uint8_t *)data + first, length - first);
+
+  __atomic_store_n(&header->head, head + (uint32_t)length, __ATOMIC_SEQ_CST);
+  ring_notify(&header->data_wanted, (head - tail) + length, ring->data_fd);
+  return length;
+}
+
+size_t shm_ring_read(shm_ring_t *ring, void *buffer, size_t length) {
+  assert(ring != NULL);
+  assert(buffer != NULL || length == 0);
+
+  shm_ring_header_t *header = ring->header;
+  const uint32_t tail = header->tail;
+  const uint32_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+  const uint32_t used = head - tail;
+  if (used > ring->capacity)
+    return 0;
+
+  if (length > used)
+    length = used;
+  if (length == 0)
+    return 0;
+
+  const uint32_t offset = tail & (ring->capacity - 1);
+  const size_t first = ring_min(length, ring->capacity - offset);
+  memcpy(buffer, ring->data + offset, first);
+  memcpy((uint8_t *)buffer + first, ring->data, length - first);
+
+  __atomic_store_n(&header->tail, tail + (uint32_t)length, __ATOMIC_SEQ_CST);
+  ring_notify(&header->space_wanted, ring->capacity - (used - length), ring->space_fd);
+  return length;
+}
+
+void shm_ring_flush(shm_ring_t *ring) {
+  assert(ring != NULL);
+
+  shm_ring_header_t *header = ring->header;
+  const uint32_t head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&header->tail, head, __ATOMIC_SEQ_CST);
+  ring_notify(&header->space_wanted, ring->capacity, ring->space_fd);
+}
+
+bool shm_ring_wait_writable(shm_ring_t *ring, size_t length, int timeout_ms) {
+  assert(ring != NULL);
+  return ring_wait(ring, &ring->header->space_wanted, true,
+                   ring_min(length, ring->capacity), ring->space_fd, timeout_ms);
+}
+
+bool shm_ring_wait_readable(shm_ring_t *ring, size_t length, int timeout_ms) {
+  assert(ring != NULL);
+  return ring_wait(ring, &ring->header->data_wanted, false,
+                   ring_min(length, ring->capacity), ring->data_fd, timeout_ms);
+}
+
+static shm_ring_t *ring_map(int mem_fd, int data_fd, int space_fd, size_t map_size) {
+  void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  shm_ring_t *ring = osi_calloc(sizeof(shm_ring_t));
+  ring->header = (shm_ring_header_t *)map;
+  ring->data = (uint8_t *)map + sizeof(shm_ring_header_t);
+  ring->map_size = map_size;
+  ring->mem_fd = mem_fd;
+  ring->data_fd = data_fd;
+  ring->space_fd = space_fd;
+  return ring;
+}
+
+static void ring_release(shm_ring_t *ring) {
+  munmap(ring->header, ring->map_size);
+  close(ring->mem_fd);
+  close(ring->data_fd);
+  close(ring->space_fd);
+  osi_free(ring);
+}
+
+static uint32_t ring_used(const shm_ring_t *ring) {
+  const uint32_t head = __atomic_load_n(&ring->header->head, __ATOMIC_ACQUIRE);
+  const uint32_t tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+  return ring_min(head - tail, ring->capacity);
+}
+
+static size_t ring_min(size_t a, size_t b) {
+  return (a < b) ? a : b;
+}
+
+// Called after publishing a new index. |ready| is the amount of data (or
+// space) the peer can now see. The sequentially consistent store of the
+// index followed by the load of |wanted| pairs with the store of |wanted|
+// followed by the index load in |ring_wait|, so a waiter can never miss
+// an update.
+static void ring_notify(uint32_t *wanted, uint32_t ready, int fd) {
+  uint32_t threshold = __atomic_load_n(wanted, __ATOMIC_SEQ_CST);
+  if (threshold == 0 || ready < threshold)
+    return;
+
+  if (__atomic_compare_exchange_n(wanted, &threshold, 0, false,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    eventfd_write(fd, 1);
+}
+
+static bool ring_wait(shm_ring_t *ring, uint32_t *wanted, bool want_space,
+                      uint32_t length, int fd, int timeout_ms) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (length == 0)
+    length = 1;
+
+  for (;;) {
+    __atomic_store_n(wanted, length, __ATOMIC_SEQ_CST);
+
+    const uint32_t used = ring_used(ring);
+    const uint32_t ready = want_space ? ring->capacity - used : used;
+    if (ready >= length) {
+      __atomic_store_n(wanted, 0, __ATOMIC_SEQ_CST);
+      return true;
+    }
+
+    if (shm_ring_is_closed(ring))
+      break;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 +
+                           (now.tv_nsec - start.tv_nsec) / 1000000;
+    if (elapsed_ms >= timeout_ms)
+      break;
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int ret;
+    OSI_NO_INTR(ret = poll(&pfd, 1, timeout_ms - elapsed_ms));
+    if (ret == -1) {
+      LOG_ERROR(LOG_TAG, "%s poll failed: %s", __func__, strerror(errno));
+      break;
+    }
+
+    eventfd_t value;
+    eventfd_read(fd, &value);
+  }
+
+  __atomic_store_n(wanted, 0, __ATOMIC_SEQ_CST);
+  return false;
+}
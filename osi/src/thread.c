@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <malloc.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
@@ -31,10 +32,10 @@
 
 #include "osi/include/allocator.h"
 #include "osi/include/compat.h"
-#include "osi/include/fixed_queue.h"
 #include "osi/include/log.h"
 #include "osi/include/reactor.h"
 #include "osi/include/semaphore.h"
+#include "osi/include/time.h"
 
 struct thread_t {
   bool is_joined;
@@ -42,7 +43,18 @@ struct thread_t {
   pid_t tid;
   char name[THREAD_NAME_MAX + 1];
   reactor_t *reactor;
-  fixed_queue_t *work_queue;
+
+  // Posted work items, oldest first, linked through |thread_work_t.next|.
+  // The items are owned by whoever posted them, so queueing never allocates.
+  pthread_mutex_t work_lock;
+  thread_work_t *work_head;
+  thread_work_t *work_tail;
+  size_t work_capacity;
+  size_t work_depth;
+  semaphore_t *work_sem;   // Counts queued items; wakes up the reactor.
+  semaphore_t *space_sem;  // Counts free slots; posting blocks when full.
+
+  struct thread_t *next_registered;  // Protected by |registered_lock|.
 };
 
 struct start_arg {
@@ -51,16 +63,25 @@ struct start_arg {
   int error;
 };
 
+// Work item allocated by |thread_post| on behalf of its caller.
 typedef struct {
+  thread_work_t work;
   thread_fn func;
   void *context;
 } work_item_t;
 
 static void *run_thread(void *start_arg);
 static void work_queue_read_cb(void *context);
+static thread_work_t *work_queue_pop(thread_t *thread, size_t *depth);
+static void debug_dump(int fd, bool csv);
+static void run_work_item(void *context);
 
 static const size_t DEFAULT_WORK_QUEUE_CAPACITY = 128;
 
+// Live threads, for |thread_debug_dump|.
+static pthread_mutex_t registered_lock = PTHREAD_MUTEX_INITIALIZER;
+static thread_t *registered_threads;
+
 thread_t *thread_new_sized(const char *name, size_t work_queue_capacity) {
   assert(name != NULL);
   assert(work_queue_capacity != 0);
@@ -74,8 +95,11 @@ thread_t *thread_new_sized(const char *name, size_t work_queue_capacity) {
   if (!ret->reactor)
     goto error;
 
-  ret->work_queue = fixed_queue_new(work_queue_capacity);
-  if (!ret->work_queue)
+  pthread_mutex_init(&ret->work_lock, NULL);
+  ret->work_capacity = work_queue_capacity;
+  ret->work_sem = semaphore_new(0);
+  ret->space_sem = semaphore_new(work_queue_capacity);
+  if (!ret->work_sem || !ret->space_sem)
     goto error;
 
   // Start is on the stack, but we use a semaphore, so it's safe
@@ -94,11 +118,18 @@ thread_t *thread_new_sized(const char *name, size_t work_queue_capacity) {
   if (start.error)
     goto error;
 
+  pthread_mutex_lock(&registered_lock);
+  ret->next_registered = registered_threads;
+  registered_threads = ret;
+  pthread_mutex_unlock(&registered_lock);
+
   return ret;
 
 error:;
   if (ret) {
-    fixed_queue_free(ret->work_queue, osi_free);
+    semaphore_free(ret->work_sem);
+    semaphore_free(ret->space_sem);
+    pthread_mutex_destroy(&ret->work_lock);
     reactor_free(ret->reactor);
   }
   osi_free(ret);
@@ -116,7 +147,28 @@ void thread_free(thread_t *thread) {
   thread_stop(thread);
   thread_join(thread);
 
-  fixed_queue_free(thread->work_queue, osi_free);
+  pthread_mutex_lock(&registered_lock);
+  for (thread_t **link = &registered_threads; *link != NULL; link = &(*link)->next_registered) {
+    if (*link == thread) {
+      *link = thread->next_registered;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&registered_lock);
+
+  // Anything still queued was posted after the thread drained its queue.
+  // Items from |thread_post| are ours to free; embedded items belong to
+  // whoever posted them.
+  for (thread_work_t *work = thread->work_head; work != NULL; ) {
+    thread_work_t *next = work->next;
+    if (work->func == run_work_item)
+      osi_free(work->context);
+    work = next;
+  }
+
+  semaphore_free(thread->work_sem);
+  semaphore_free(thread->space_sem);
+  pthread_mutex_destroy(&thread->work_lock);
   reactor_free(thread->reactor);
   osi_free(thread);
 }
@@ -139,12 +191,36 @@ bool thread_post(thread_t *thread, thread_fn func, void *context) {
   // of queue space, we should abort this operation, otherwise we'll
   // deadlock.
 
-  // Queue item is freed either when the queue itself is destroyed
-  // or when the item is removed from the queue for dispatch.
+  // Queue item is freed either when the thread is destroyed or when the
+  // item has been dispatched.
   work_item_t *item = (work_item_t *)osi_malloc(sizeof(work_item_t));
+  item->work.func = run_work_item;
+  item->work.context = item;
   item->func = func;
   item->context = context;
-  fixed_queue_enqueue(thread->work_queue, item);
+  return thread_post_work(thread, &item->work);
+}
+
+bool thread_post_work(thread_t *thread, thread_work_t *work) {
+  assert(thread != NULL);
+  assert(work != NULL);
+  assert(work->func != NULL);
+
+  semaphore_wait(thread->space_sem);
+
+  work->posted_us = reactor_stats_enabled() ? time_get_os_boottime_us() : 0;
+
+  pthread_mutex_lock(&thread->work_lock);
+  work->next = NULL;
+  if (thread->work_tail)
+    thread->work_tail->next = work;
+  else
+    thread->work_head = work;
+  thread->work_tail = work;
+  thread->work_depth++;
+  pthread_mutex_unlock(&thread->work_lock);
+
+  semaphore_post(thread->work_sem);
   return true;
 }
 
@@ -202,10 +278,9 @@ static void *run_thread(void *start_arg) {
 
   semaphore_post(start->start_sem);
 
-  int fd = fixed_queue_get_dequeue_fd(thread->work_queue);
-  void *context = thread->work_queue;
+  int fd = semaphore_get_fd(thread->work_sem);
 
-  reactor_object_t *work_queue_object = reactor_register(thread->reactor, fd, context, work_queue_read_cb, NULL);
+  reactor_object_t *work_queue_object = reactor_register(thread->reactor, fd, thread, work_queue_read_cb, NULL);
   reactor_start(thread->reactor);
   reactor_unregister(work_queue_object);
 
@@ -213,15 +288,13 @@ static void *run_thread(void *start_arg) {
   // This allows a caller to safely tear down by enqueuing a teardown
   // work item and then joining the thread.
   size_t count = 0;
-  work_item_t *item = fixed_queue_try_dequeue(thread->work_queue);
-  while (item && count <= fixed_queue_capacity(thread->work_queue)) {
-    item->func(item->context);
-    osi_free(item);
-    item = fixed_queue_try_dequeue(thread->work_queue);
+  while (count <= thread->work_capacity && semaphore_try_wait(thread->work_sem)) {
+    thread_work_t *work = work_queue_pop(thread, NULL);
+    work->func(work->context);
     ++count;
   }
 
-  if (count > fixed_queue_capacity(thread->work_queue))
+  if (count > thread->work_capacity)
     LOG_DEBUG(LOG_TAG, "%s growing event queue on shutdown.", __func__);
 
   LOG_WARN(LOG_TAG, "%s: thread id %d, thread name %s exited", __func__, thread->tid, thread->name);
@@ -231,8 +304,90 @@ static void *run_thread(void *start_arg) {
 static void work_queue_read_cb(void *context) {
   assert(context != NULL);
 
-  fixed_queue_t *queue = (fixed_queue_t *)context;
-  work_item_t *item = fixed_queue_dequeue(queue);
+  thread_t *thread = (thread_t *)context;
+  semaphore_wait(thread->work_sem);
+
+  size_t depth;
+  thread_work_t *work = work_queue_pop(thread, &depth);
+
+  if (work->posted_us && reactor_stats_enabled()) {
+    // Attribute the time to the posted function rather than this callback.
+    thread_fn func = work->func;
+    if (func == run_work_item)
+      func = ((work_item_t *)work->context)->func;
+    reactor_annotate_callback(thread->reactor, (const void *)func,
+                              time_get_os_boottime_us() - work->posted_us, depth);
+  }
+
+  work->func(work->context);
+}
+
+// Takes the oldest item off the queue of |thread| and, if |depth| is not
+// NULL, stores how many items were queued. The caller must have consumed a
+// count from |work_sem| first, so the queue is never empty here.
+static thread_work_t *work_queue_pop(thread_t *thread, size_t *depth) {
+  pthread_mutex_lock(&thread->work_lock);
+  if (depth)
+    *depth = thread->work_depth;
+  thread_work_t *work = thread->work_head;
+  assert(work != NULL);
+  thread->work_head = work->next;
+  if (!thread->work_head)
+    thread->work_tail = NULL;
+  thread->work_depth--;
+  pthread_mutex_unlock(&thread->work_lock);
+
+  semaphore_post(thread->space_sem);
+  return work;
+}
+
+static void run_work_item(void *context) {
+  work_item_t *item = (work_item_t *)context;
   item->func(item->context);
   osi_free(item);
 }
+
+void thread_debug_dump(int fd) {
+  dprintf(fd, "\nMessage loops:\n");
+  if (!reactor_stats_enabled())
+    dprintf(fd, "  collection disabled\n");
+
+  debug_dump(fd, false);
+}
+
+void thread_debug_dump_csv(int fd) {
+  dprintf(fd, "loop,thread,iterations,callbacks,busy_us,idle_us\n");
+  dprintf(fd, "wait,thread,upper_bound_us:count...\n");
+  dprintf(fd, "callback,thread,address,symbol,count,run_total_us,run_max_us,wait_total_us,wait_max_us,depth_max\n");
+
+  debug_dump(fd, true);
+}
+
+// Copies the statistics of every thread under |registered_lock| and writes
+// them out afterwards, so a slow reader of |fd| never holds up thread
+// creation or the reactors.
+static void debug_dump(int fd, bool csv) {
+  typedef struct {
+    char name[THREAD_NAME_MAX + 1];
+    reactor_debug_snapshot_t *stats;
+  } thread_snapshot_t;
+
+  pthread_mutex_lock(&registered_lock);
+  size_t count = 0;
+  for (thread_t *thread = registered_threads; thread != NULL; thread = thread->next_registered)
+    ++count;
+
+  thread_snapshot_t *snapshots = osi_calloc(count * sizeof(thread_snapshot_t));
+  size_t i = 0;
+  for (thread_t *thread = registered_threads; thread != NULL; thread = thread->next_registered, ++i) {
+    strlcpy(snapshots[i].name, thread->name, sizeof(snapshots[i].name));
+    snapshots[i].stats = reactor_debug_snapshot(thread->reactor);
+  }
+  pthread_mutex_unlock(&registered_lock);
+
+  for (i = 0; i < count; ++i) {
+    reactor_debug_dump(snapshots[i].stats, snapshots[i].name, fd, csv);
+    osi_free(snapshots[i].stats);
+  }
+  osi_free(snapshots);
+}
@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "AllocationTestHarness.h"
+
+extern "C" {
+#include "osi/include/config.h"
+#include "osi/include/config_journal.h"
+}
+
+static const char CONFIG_FILE[] = "/data/local/tmp/config_journal_test.conf";
+static const char JOURNAL_FILE[] = "/data/local/tmp/config_journal_test.journal";
+
+class ConfigJournalTest : public AllocationTestHarness {
+  protected:
+    virtual void SetUp() {
+      AllocationTestHarness::SetUp();
+      unlink(CONFIG_FILE);
+      unlink(JOURNAL_FILE);
+    }
+
+    virtual void TearDown() {
+      unlink(CONFIG_FILE);
+      unlink(JOURNAL_FILE);
+      AllocationTestHarness::TearDown();
+    }
+
+    // Saves a config file of |generation| with a single key in it and starts
+    // an empty journal for it.
+    void SaveConfig(int generation) {
+      config_t *config = config_new_empty();
+      config_set_string(config, "Adapter", "Name", "adapter");
+      config_set_int(config, "Info", "JournalGeneration", generation);
+      ASSERT_TRUE(config_save(config, CONFIG_FILE));
+      config_free(config);
+
+      size_t size = 0;
+      ASSERT_TRUE(config_journal_reset(JOURNAL_FILE, generation, &size));
+      EXPECT_EQ(sizeof("generation\t1\n") - 1, size);
+    }
+
+    // Loads the config file and replays the journal on top of it, the way
+    // the config is read at startup.
+    config_t *LoadConfig(bool *intact) {
+      config_t *config = config_new(CONFIG_FILE);
+      EXPECT_TRUE(config != NULL);
+      const int generation = config_get_int(config, "Info", "JournalGeneration", 0);
+      size_t size = 0;
+      *intact = config_journal_replay(JOURNAL_FILE, config, generation, &size);
+      return config;
+    }
+
+    void AppendRaw(const char *data) {
+      FILE *fp = fopen(JOURNAL_FILE, "at");
+      ASSERT_TRUE(fp != NULL);
+      fputs(data, fp);
+      fclose(fp);
+    }
+};
+
+TEST_F(ConfigJournalTest, append) {
+  SaveConfig(1);
+
+  config_journal_t *journal = config_journal_new();
+  EXPECT_TRUE(config_journal_is_empty(journal));
+  config_journal_set(journal, "00:01:02:03:04:05", "Name", "first");
+  config_journal_set(journal, "00:01:02:03:04:05", "Service", "a\tb");
+  config_journal_remove(journal, "Adapter", "Name");
+  EXPECT_FALSE(config_journal_is_empty(journal));
+
+  size_t size = sizeof("generation\t1\n") - 1;
+  ASSERT_TRUE(config_journal_append(journal, JOURNAL_FILE, &size));
+  EXPECT_TRUE(config_journal_is_empty(journal));
+  config_journal_free(journal);
+
+  static const char expected[] =
+      "generation\t1\n"
+      "set\t00:01:02:03:04:05\tName\tfirst\n"
+      "set\t00:01:02:03:04:05\tService\ta\tb\n"
+      "remove\tAdapter\tName\n";
+  EXPECT_EQ(sizeof(expected) - 1, size);
+
+  char contents[sizeof(expected) + 16] = { 0 };
+  FILE *fp = fopen(JOURNAL_FILE, "rt");
+  ASSERT_TRUE(fp != NULL);
+  fread(contents, 1, sizeof(contents) - 1, fp);
+  fclose(fp);
+  EXPECT_STREQ(expected, contents);
+}
+
+TEST_F(ConfigJournalTest, append_without_journal) {
+  config_journal_t *journal = config_journal_new();
+  config_journal_set(journal, "Adapter", "Name", "adapter");
+
+  size_t size = 0;
+  EXPECT_FALSE(config_journal_append(journal, JOURNAL_FILE, &size));
+  EXPECT_FALSE(config_journal_is_empty(journal));
+  EXPECT_EQ(0U, size);
+  config_journal_free(journal);
+}
+
+TEST_F(ConfigJournalTest, replay_on_load) {
+  SaveConfig(1);
+
+  config_journal_t *journal = config_journal_new();
+  config_journal_set(journal, "00:01:02:03:04:05", "Name", "first");
+  config_journal_set(journal, "00:01:02:03:04:05", "Name", "second\nignored");
+  size_t size = 0;
+  ASSERT_TRUE(config_journal_append(journal, JOURNAL_FILE, &size));
+
+  config_journal_set(journal, "00:01:02:03:04:05", "LinkKey", "");
+  config_journal_remove(journal, "Adapter", "Name");
+  ASSERT_TRUE(config_journal_append(journal, JOURNAL_FILE, &size));
+  config_journal_free(journal);
+
+  bool intact = false;
+  config_t *config = LoadConfig(&intact);
+  EXPECT_TRUE(intact);
+  EXPECT_STREQ("second", config_get_string(config, "00:01:02:03:04:05", "Name", NULL));
+  EXPECT_STREQ("", config_get_string(config, "00:01:02:03:04:05", "LinkKey", NULL));
+  EXPECT_FALSE(config_has_key(config, "Adapter", "Name"));
+  config_free(config);
+}
+
+TEST_F(ConfigJournalTest, replay_other_generation) {
+  SaveConfig(1);
+  AppendRaw("set\tAdapter\tName\tjournaled\n");
+
+  config_t *config = config_new(CONFIG_FILE);
+  size_t size = 0;
+  EXPECT_FALSE(config_journal_replay(JOURNAL_FILE, config, 2, &size));
+  EXPECT_STREQ("adapter", config_get_string(config, "Adapter", "Name", NULL));
+  EXPECT_EQ(0U, size);
+  config_free(config);
+}
+
+TEST_F(ConfigJournalTest, replay_missing_journal) {
+  SaveConfig(1);
+  unlink(JOURNAL_FILE);
+
+  bool intact = true;
+  config_t *config = LoadConfig(&intact);
+  EXPECT_FALSE(intact);
+  EXPECT_STREQ("adapter", config_get_string(config, "Adapter", "Name", NULL));
+  config_free(config);
+}
+
+// A full save writes the config file of the next generation and only then
+// starts its journal. A crash in between leaves the old journal behind, which
+// must not be replayed on top of the new file.
+TEST_F(ConfigJournalTest, compaction) {
+  SaveConfig(1);
+  AppendRaw("set\tAdapter\tName\tcompacted\n");
+
+  bool intact = false;
+  config_t *config = LoadConfig(&intact);
+  ASSERT_TRUE(intact);
+  config_set_int(config, "Info", "JournalGeneration", 2);
+  ASSERT_TRUE(config_save(config, CONFIG_FILE));
+  config_free(config);
+
+  AppendRaw("set\tAdapter\tName\tstale\n");
+  config = LoadConfig(&intact);
+  EXPECT_FALSE(intact);
+  EXPECT_STREQ("compacted", config_get_string(config, "Adapter", "Name", NULL));
+  config_free(config);
+
+  size_t size = 0;
+  ASSERT_TRUE(config_journal_reset(JOURNAL_FILE, 2, &size));
+  config = LoadConfig(&intact);
+  EXPECT_TRUE(intact);
+  EXPECT_STREQ("compacted", config_get_string(config, "Adapter", "Name", NULL));
+  config_free(config);
+}
+
+TEST_F(ConfigJournalTest, torn_tail) {
+  SaveConfig(1);
+  AppendRaw("set\tAdapter\tName\tcomplete\n");
+  AppendRaw("set\tAdapter\tName\ttor");
+
+  config_t *config = config_new(CONFIG_FILE);
+  size_t size = 0;
+  EXPECT_FALSE(config_journal_replay(JOURNAL_FILE, config, 1, &size));
+  EXPECT_STREQ("complete", config_get_string(config, "Adapter", "Name", NULL));
+  EXPECT_EQ(sizeof("generation\t1\nset\tAdapter\tName\tcomplete\n") - 1, size);
+  config_free(config);
+}
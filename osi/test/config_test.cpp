@@ -1,9 +1,14 @@
 #include <gtest/gtest.h>
 
+#include <chrono>
+
 #include "AllocationTestHarness.h"
 
 extern "C" {
+#include "osi/include/allocation_tracker.h"
 #include "osi/include/config.h"
+
+void allocation_tracker_uninit(void);
 }
 
 static const char CONFIG_FILE[] = "/data/local/tmp/config_test.conf";
@@ -201,3 +206,107 @@ TEST_F(ConfigTest, config_save_basic) {
   EXPECT_TRUE(config_save(config, CONFIG_FILE));
   config_free(config);
 }
+
+TEST_F(ConfigTest, config_remove_section_then_readd) {
+  config_t *config = config_new(CONFIG_FILE);
+  EXPECT_TRUE(config_remove_section(config, "DID"));
+  EXPECT_FALSE(config_has_key(config, "DID", "version"));
+  config_set_int(config, "DID", "version", 0x2000);
+  EXPECT_EQ(config_get_int(config, "DID", "version", 0), 0x2000);
+  EXPECT_FALSE(config_has_key(config, "DID", "productId"));
+  config_free(config);
+}
+
+TEST_F(ConfigTest, config_keys_are_per_section) {
+  config_t *config = config_new_empty();
+  config_set_string(config, "00:00:00:00:00:01", "Name", "first");
+  config_set_string(config, "00:00:00:00:00:02", "Name", "second");
+  EXPECT_STREQ(config_get_string(config, "00:00:00:00:00:01", "Name", NULL), "first");
+  EXPECT_STREQ(config_get_string(config, "00:00:00:00:00:02", "Name", NULL), "second");
+  EXPECT_TRUE(config_remove_key(config, "00:00:00:00:00:01", "Name"));
+  EXPECT_FALSE(config_has_key(config, "00:00:00:00:00:01", "Name"));
+  EXPECT_TRUE(config_has_key(config, "00:00:00:00:00:02", "Name"));
+  config_free(config);
+}
+
+// Allocation tracking costs far more than the config operations themselves,
+// so the benchmark runs with the tracker off. Everything it allocates is
+// freed before the tracker comes back for the next test.
+class ConfigBenchmarkTest : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+      allocation_tracker_uninit();
+    }
+
+    virtual void TearDown() {
+      allocation_tracker_init();
+    }
+};
+
+// Loads and queries a bond table the size of a heavily used device's
+// bt_config.conf. The best time of a few runs of each phase is recorded as a
+// test property (load_us, lookup_us, save_us), so it ends up in the XML report
+// of --gtest_output and lookup regressions are easy to spot.
+TEST_F(ConfigBenchmarkTest, config_1000_devices) {
+  static const int NUM_DEVICES = 1000;
+  static const int NUM_RUNS = 5;
+  static const char *KEYS[] = {
+    "Name", "DevClass", "DevType", "AddrType", "Timestamp", "LinkKeyType",
+    "PinLength", "LinkKey", "Service", "Manufacturer", "LmpVer", "LmpSubVer",
+  };
+  static const int NUM_KEYS = sizeof(KEYS) / sizeof(KEYS[0]);
+
+  config_t *config = config_new_empty();
+  char section[18];
+  for (int i = 0; i < NUM_DEVICES; ++i) {
+    snprintf(section, sizeof(section), "00:11:22:33:%02x:%02x", i >> 8, i & 0xff);
+    for (int k = 0; k < NUM_KEYS; ++k)
+      config_set_int(config, section, KEYS[k], i + k);
+  }
+  EXPECT_TRUE(config_save(config, CONFIG_FILE));
+  config_free(config);
+
+  typedef std::chrono::steady_clock clock;
+  auto elapsed_us = [](clock::time_point start, clock::time_point end) {
+    return (long long)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  };
+  long long load_us = -1, lookup_us = -1, save_us = -1;
+  auto keep_best = [](long long *best, long long value) {
+    if (*best < 0 || value < *best)
+      *best = value;
+  };
+
+  for (int run = 0; run < NUM_RUNS; ++run) {
+    auto start = clock::now();
+    config = config_new(CONFIG_FILE);
+    auto loaded = clock::now();
+    ASSERT_TRUE(config != NULL);
+
+    int mismatches = 0;
+    for (int i = 0; i < NUM_DEVICES; ++i) {
+      snprintf(section, sizeof(section), "00:11:22:33:%02x:%02x", i >> 8, i & 0xff);
+      for (int k = 0; k < NUM_KEYS; ++k) {
+        if (config_get_int(config, section, KEYS[k], -1) != i + k)
+          ++mismatches;
+      }
+      if (config_has_key(config, section, "NotAKey"))
+        ++mismatches;
+    }
+    auto queried = clock::now();
+    EXPECT_EQ(mismatches, 0);
+
+    EXPECT_TRUE(config_save(config, CONFIG_FILE));
+    auto saved = clock::now();
+    config_free(config);
+
+    keep_best(&load_us, elapsed_us(start, loaded));
+    keep_best(&lookup_us, elapsed_us(loaded, queried));
+    keep_best(&save_us, elapsed_us(queried, saved));
+  }
+
+  RecordProperty("devices", NUM_DEVICES);
+  RecordProperty("lookups", NUM_DEVICES * (NUM_KEYS + 1));
+  RecordProperty("load_us", (int)load_us);
+  RecordProperty("lookup_us", (int)lookup_us);
+  RecordProperty("save_us", (int)save_us);
+}
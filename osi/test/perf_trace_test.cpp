@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include "AllocationTestHarness.h"
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "osi/include/perf_trace.h"
+#include "osi/include/semaphore.h"
+#include "osi/include/thread.h"
+}
+
+static const char *TRACE_PATH = "/tmp/perf_trace_test.json";
+
+class PerfTraceTest : public AllocationTestHarness {
+ protected:
+  virtual void TearDown() {
+    perf_trace_stop();
+    perf_trace_cleanup();
+    unlink(TRACE_PATH);
+    AllocationTestHarness::TearDown();
+  }
+};
+
+static char *read_trace(void) {
+  FILE *file = fopen(TRACE_PATH, "r");
+  if (!file)
+    return NULL;
+
+  static char contents[64 * 1024];
+  size_t length = fread(contents, 1, sizeof(contents) - 1, file);
+  contents[length] = '\0';
+  fclose(file);
+  return contents;
+}
+
+static size_t count_occurrences(const char *haystack, const char *needle) {
+  size_t count = 0;
+  for (const char *p = strstr(haystack, needle); p; p = strstr(p + 1, needle))
+    ++count;
+  return count;
+}
+
+static void traced_function(void) {
+  PERF_TRACE_SCOPE("traced_function");
+  PERF_TRACE_COUNTER("traced_counter", 42);
+}
+
+static void traced_work_item(void *context) {
+  traced_function();
+  semaphore_post((semaphore_t *)context);
+}
+
+TEST_F(PerfTraceTest, test_disabled_records_nothing) {
+  traced_function();
+  EXPECT_EQ(0U, perf_trace_stop());
+}
+
+TEST_F(PerfTraceTest, test_json_scope_and_counter) {
+  ASSERT_TRUE(perf_trace_start(PERF_TRACE_JSON, TRACE_PATH));
+  EXPECT_FALSE(perf_trace_start(PERF_TRACE_JSON, TRACE_PATH));
+
+  traced_function();
+  PERF_TRACE_BEGIN("manual");
+  PERF_TRACE_END("manual");
+
+  EXPECT_EQ(5U, perf_trace_stop());
+
+  const char *trace = read_trace();
+  ASSERT_TRUE(trace != NULL);
+  EXPECT_EQ(trace, strstr(trace, "{\"traceEvents\":["));
+  EXPECT_EQ(2U, count_occurrences(trace, "\"name\":\"traced_function\""));
+  EXPECT_EQ(1U, count_occurrences(trace, "\"ph\":\"C\""));
+  EXPECT_EQ(1U, count_occurrences(trace, "\"args\":{\"value\":42}"));
+  EXPECT_EQ(2U, count_occurrences(trace, "\"name\":\"manual\""));
+
+  // Nothing is recorded once stopped.
+  traced_function();
+  EXPECT_EQ(0U, perf_trace_stop());
+}
+
+TEST_F(PerfTraceTest, test_json_per_thread) {
+  ASSERT_TRUE(perf_trace_start(PERF_TRACE_JSON, TRACE_PATH));
+
+  thread_t *thread = thread_new("traced_thread");
+  semaphore_t *done = semaphore_new(0);
+  thread_post(thread, traced_work_item, done);
+  semaphore_wait(done);
+  traced_function();
+
+  EXPECT_EQ(6U, perf_trace_stop());
+
+  const char *trace = read_trace();
+  ASSERT_TRUE(trace != NULL);
+  EXPECT_EQ(2U, count_occurrences(trace, "\"name\":\"thread_name\""));
+  EXPECT_EQ(1U, count_occurrences(trace, "\"name\":\"traced_thread\""));
+
+  semaphore_free(done);
+  thread_free(thread);
+}
+
+TEST_F(PerfTraceTest, test_restart_clears_events) {
+  ASSERT_TRUE(perf_trace_start(PERF_TRACE_JSON, TRACE_PATH));
+  traced_function();
+  EXPECT_EQ(3U, perf_trace_stop());
+
+  ASSERT_TRUE(perf_trace_start(PERF_TRACE_JSON, TRACE_PATH));
+  PERF_TRACE_COUNTER("traced_counter", 1);
+  EXPECT_EQ(1U, perf_trace_stop());
+}
+
+TEST_F(PerfTraceTest, test_begin_end_balanced_across_start) {
+  PERF_TRACE_BEGIN("manual");
+  ASSERT_TRUE(perf_trace_start(PERF_TRACE_JSON, TRACE_PATH));
+  PERF_TRACE_END("manual");
+
+  // The END of a BEGIN that was not recorded is dropped too.
+  EXPECT_EQ(0U, perf_trace_stop());
+}
+
+TEST_F(PerfTraceTest, test_exited_threads_free_their_buffer) {
+  // More threads than there are buffers, over a few traces.
+  for (int trace = 0; trace < 3; ++trace) {
+    ASSERT_TRUE(perf_trace_start(PERF_TRACE_JSON, TRACE_PATH));
+
+    semaphore_t *done = semaphore_new(0);
+    for (int i = 0; i < 20; ++i) {
+      thread_t *thread = thread_new("traced_thread");
+      thread_post(thread, traced_work_item, done);
+      semaphore_wait(done);
+      thread_free(thread);
+    }
+    semaphore_free(done);
+
+    EXPECT_EQ(20U * 3, perf_trace_stop());
+  }
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include "osi/test/AllocationTestHarness.h"
+
+extern "C" {
+#include "osi/include/prefix_trie.h"
+}
+
+class PrefixTrieTest : public AllocationTestHarness {};
+
+static void add_string(prefix_trie_t *trie, const char *key, uint64_t tags) {
+  prefix_trie_add(trie, key, strlen(key), tags);
+}
+
+static uint64_t prefixes_of(prefix_trie_t *trie, const char *key) {
+  return prefix_trie_match_prefixes(trie, key, strlen(key));
+}
+
+static uint64_t extensions_of(prefix_trie_t *trie, const char *key) {
+  return prefix_trie_match_extensions(trie, key, strlen(key));
+}
+
+TEST_F(PrefixTrieTest, test_new_free_simple) {
+  prefix_trie_t *trie = prefix_trie_new();
+  ASSERT_TRUE(trie != NULL);
+  EXPECT_EQ(0u, prefixes_of(trie, "anything"));
+  EXPECT_EQ(0u, extensions_of(trie, ""));
+  prefix_trie_free(trie);
+}
+
+TEST_F(PrefixTrieTest, test_free_null) {
+  prefix_trie_free(NULL);
+}
+
+TEST_F(PrefixTrieTest, test_match_prefixes) {
+  prefix_trie_t *trie = prefix_trie_new();
+  add_string(trie, "Car", 1 << 0);
+  add_string(trie, "Caramel", 1 << 1);
+  add_string(trie, "BMW", 1 << 2);
+
+  EXPECT_EQ(1u << 0, prefixes_of(trie, "Car"));
+  EXPECT_EQ(1u << 0, prefixes_of(trie, "Carbon"));
+  EXPECT_EQ((1u << 0) | (1u << 1), prefixes_of(trie, "Caramel Kit"));
+  EXPECT_EQ(1u << 2, prefixes_of(trie, "BMW M3"));
+  EXPECT_EQ(0u, prefixes_of(trie, "Ca"));
+  EXPECT_EQ(0u, prefixes_of(trie, "car"));
+
+  prefix_trie_free(trie);
+}
+
+TEST_F(PrefixTrieTest, test_match_extensions) {
+  prefix_trie_t *trie = prefix_trie_new();
+  add_string(trie, "Car", 1 << 0);
+  add_string(trie, "Caramel", 1 << 1);
+
+  EXPECT_EQ((1u << 0) | (1u << 1), extensions_of(trie, "Ca"));
+  EXPECT_EQ(1u << 1, extensions_of(trie, "Cara"));
+  EXPECT_EQ(1u << 1, extensions_of(trie, "Caramel"));
+  EXPECT_EQ(0u, extensions_of(trie, "Caramels"));
+  EXPECT_EQ((1u << 0) | (1u << 1), extensions_of(trie, ""));
+
+  prefix_trie_free(trie);
+}
+
+TEST_F(PrefixTrieTest, test_binary_keys_merge_tags) {
+  prefix_trie_t *trie = prefix_trie_new();
+  const uint8_t oui[] = { 0x00, 0x18, 0x91 };
+  const uint8_t addr[] = { 0x00, 0x18, 0x91, 0x12, 0x34, 0x56 };
+  const uint8_t other[] = { 0x00, 0x18, 0x90, 0x12, 0x34, 0x56 };
+
+  prefix_trie_add(trie, oui, sizeof(oui), 1ULL << 3);
+  prefix_trie_add(trie, oui, sizeof(oui), 1ULL << 63);
+  EXPECT_EQ((1ULL << 3) | (1ULL << 63), prefix_trie_match_prefixes(trie, addr, sizeof(addr)));
+  EXPECT_EQ(0u, prefix_trie_match_prefixes(trie, other, sizeof(other)));
+
+  prefix_trie_clear(trie);
+  EXPECT_EQ(0u, prefix_trie_match_prefixes(trie, addr, sizeof(addr)));
+
+  prefix_trie_free(trie);
+}
+
+TEST_F(PrefixTrieTest, test_many_keys) {
+  prefix_trie_t *trie = prefix_trie_new();
+  for (int i = 0; i < 256; ++i) {
+    uint8_t key[2] = { (uint8_t)(255 - i), (uint8_t)i };
+    prefix_trie_add(trie, key, sizeof(key), 1ULL << (i % 64));
+  }
+
+  for (int i = 0; i < 256; ++i) {
+    uint8_t key[3] = { (uint8_t)(255 - i), (uint8_t)i, 0 };
+    EXPECT_EQ(1ULL << (i % 64), prefix_trie_match_prefixes(trie, key, sizeof(key)));
+    EXPECT_EQ(1ULL << (i % 64), prefix_trie_match_extensions(trie, key, 1));
+  }
+
+  prefix_trie_free(trie);
+}
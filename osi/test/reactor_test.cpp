@@ -101,6 +101,53 @@ TEST_F(ReactorTest, reactor_unregister_from_callback) {
   reactor_free(reactor);
 }
 
+typedef struct {
+  reactor_t *reactor;
+  reactor_object_t *self;
+  reactor_object_t *other;
+  bool other_called;
+} unregister_other_arg_t;
+
+static void unregister_other_cb(void *context) {
+  unregister_other_arg_t *arg = (unregister_other_arg_t *)context;
+  if (!arg->other) {
+    arg->other_called = true;
+    return;
+  }
+  reactor_unregister(arg->other);
+  reactor_unregister(arg->self);
+  reactor_stop(arg->reactor);
+}
+
+TEST_F(ReactorTest, reactor_unregister_other_from_callback) {
+  reactor_t *reactor = reactor_new();
+
+  int self_fd = eventfd(0, 0);
+  int other_fd = eventfd(0, 0);
+  unregister_other_arg_t arg;
+  arg.reactor = reactor;
+  arg.other_called = false;
+
+  // The object registered with |other| == NULL only records that it ran.
+  unregister_other_arg_t other_arg;
+  other_arg.other = NULL;
+  other_arg.other_called = false;
+  arg.other = reactor_register(reactor, other_fd, &other_arg, unregister_other_cb, NULL);
+  arg.self = reactor_register(reactor, self_fd, &arg, unregister_other_cb, NULL);
+
+  // Make both readable before the reactor runs so they come back from the
+  // same epoll_wait call. Whichever order they are dispatched in, both
+  // objects must be released exactly once.
+  eventfd_write(other_fd, 1);
+  eventfd_write(self_fd, 1);
+  spawn_reactor_thread(reactor);
+  join_reactor_thread();
+
+  close(self_fd);
+  close(other_fd);
+  reactor_free(reactor);
+}
+
 TEST_F(ReactorTest, reactor_unregister_from_separate_thread) {
   reactor_t *reactor = reactor_new();
 
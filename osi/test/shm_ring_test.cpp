@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "osi/test/AllocationTestHarness.h"
+
+extern "C" {
+#include "osi/include/osi.h"
+#include "osi/include/shm_ring.h"
+}
+
+class ShmRingTest : public AllocationTestHarness {};
+
+// Maps a second view of |ring| the way the remote process would.
+static shm_ring_t *attach_peer(const shm_ring_t *ring) {
+  int fds[SHM_RING_FD_COUNT];
+  shm_ring_get_fds(ring, fds);
+  for (int i = 0; i < SHM_RING_FD_COUNT; ++i)
+    fds[i] = dup(fds[i]);
+  return shm_ring_attach(fds);
+}
+
+TEST_F(ShmRingTest, test_new_rounds_capacity) {
+  shm_ring_t *ring = shm_ring_new("test", 1000);
+  ASSERT_TRUE(ring != NULL);
+  EXPECT_EQ((size_t)1024, shm_ring_capacity(ring));
+  EXPECT_EQ((size_t)0, shm_ring_size(ring));
+  EXPECT_EQ((size_t)1024, shm_ring_available(ring));
+  EXPECT_FALSE(shm_ring_is_closed(ring));
+  shm_ring_free(ring);
+}
+
+TEST_F(ShmRingTest, test_write_read_across_mappings) {
+  shm_ring_t *producer = shm_ring_new("test", 16);
+  shm_ring_t *consumer = attach_peer(producer);
+  ASSERT_TRUE(consumer != NULL);
+
+  uint8_t in[24];
+  for (size_t i = 0; i < sizeof(in); ++i)
+    in[i] = i;
+
+  EXPECT_EQ(16, shm_ring_write(producer, in, sizeof(in)));
+  EXPECT_EQ((size_t)16, shm_ring_size(consumer));
+  EXPECT_EQ(0, shm_ring_write(producer, in, 1));
+
+  uint8_t out[24] = {0};
+  EXPECT_EQ((size_t)10, shm_ring_read(consumer, out, 10));
+  EXPECT_EQ((size_t)10, shm_ring_available(producer));
+
+  // Wraps around the end of the buffer.
+  EXPECT_EQ(8, shm_ring_write(producer, in + 16, 8));
+  EXPECT_EQ((size_t)14, shm_ring_read(consumer, out + 10, 14));
+  EXPECT_EQ(0, memcmp(in, out, sizeof(in)));
+
+  shm_ring_free(consumer);
+  shm_ring_free(producer);
+}
+
+TEST_F(ShmRingTest, test_flush) {
+  shm_ring_t *ring = shm_ring_new("test", 64);
+  uint8_t buf[32] = {0};
+
+  shm_ring_write(ring, buf, sizeof(buf));
+  shm_ring_flush(ring);
+  EXPECT_EQ((size_t)0, shm_ring_size(ring));
+  EXPECT_EQ((size_t)0, shm_ring_read(ring, buf, sizeof(buf)));
+
+  shm_ring_free(ring);
+}
+
+TEST_F(ShmRingTest, test_free_closes_peer) {
+  shm_ring_t *producer = shm_ring_new("test", 64);
+  shm_ring_t *consumer = attach_peer(producer);
+  uint8_t buf[8] = {0};
+
+  EXPECT_EQ(8, shm_ring_write(producer, buf, sizeof(buf)));
+  shm_ring_free(producer);
+
+  // Pending data is still readable, but the ring reports itself closed.
+  EXPECT_TRUE(shm_ring_is_closed(consumer));
+  EXPECT_FALSE(shm_ring_wait_readable(consumer, 16, 1000));
+  EXPECT_EQ((size_t)8, shm_ring_read(consumer, buf, sizeof(buf)));
+  shm_ring_free(consumer);
+}
+
+TEST_F(ShmRingTest, test_attach_rejects_plain_file) {
+  int fds[SHM_RING_FD_COUNT];
+  for (int i = 0; i < SHM_RING_FD_COUNT; ++i)
+    fds[i] = dup(STDIN_FILENO);
+  EXPECT_TRUE(shm_ring_attach(fds) == NULL);
+}
+
+TEST_F(ShmRingTest, test_wait_readable_times_out) {
+  shm_ring_t *ring = shm_ring_new("test", 64);
+  EXPECT_FALSE(shm_ring_wait_readable(ring, 1, 10));
+  shm_ring_free(ring);
+}
+
+static const size_t STREAM_BYTES = 1 << 20;
+
+static void *producer_thread(void *context) {
+  shm_ring_t *ring = (shm_ring_t *)context;
+  uint8_t chunk[300];
+  size_t sent = 0;
+
+  while (sent < STREAM_BYTES) {
+    size_t length = sizeof(chunk);
+    if (length > STREAM_BYTES - sent)
+      length = STREAM_BYTES - sent;
+    for (size_t i = 0; i < length; ++i)
+      chunk[i] = (uint8_t)(sent + i);
+
+    size_t written = 0;
+    while (written < length) {
+      ssize_t ret = shm_ring_write(ring, chunk + written, length - written);
+      if (ret < 0)
+        return NULL;
+      written += ret;
+      if (written < length)
+        shm_ring_wait_writable(ring, length - written, 1000);
+    }
+    sent += length;
+  }
+  return NULL;
+}
+
+TEST_F(ShmRingTest, test_threaded_stream_with_watermarks) {
+  shm_ring_t *producer = shm_ring_new("test", 1024);
+  shm_ring_t *consumer = attach_peer(producer);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, producer_thread, producer);
+
+  uint8_t buf[512];
+  size_t received = 0;
+  bool in_order = true;
+  while (received < STREAM_BYTES) {
+    if (!shm_ring_wait_readable(consumer, sizeof(buf), 1000) &&
+        shm_ring_size(consumer) == 0)
+      break;
+    size_t n = shm_ring_read(consumer, buf, sizeof(buf));
+    for (size_t i = 0; i < n; ++i)
+      in_order &= (buf[i] == (uint8_t)(received + i));
+    received += n;
+  }
+
+  pthread_join(thread, NULL);
+  EXPECT_EQ(STREAM_BYTES, received);
+  EXPECT_TRUE(in_order);
+
+  shm_ring_free(consumer);
+  shm_ring_free(producer);
+}
@@ -3,9 +3,14 @@
 #include "AllocationTestHarness.h"
 
 extern "C" {
+#include <stdio.h>
+#include <string.h>
 #include <sys/select.h>
 
+#include "osi/include/allocator.h"
+#include "osi/include/fixed_queue.h"
 #include "osi/include/reactor.h"
+#include "osi/include/semaphore.h"
 #include "osi/include/thread.h"
 #include "osi/include/osi.h"
 }
@@ -57,3 +62,151 @@ TEST_F(ThreadTest, test_thread_is_not_self) {
   EXPECT_FALSE(thread_is_self(thread));
   thread_free(thread);
 }
+
+typedef struct {
+  thread_work_t work;
+  int *order;
+  int *count;
+  int id;
+} posted_work_t;
+
+static void record_order_fn(void *context) {
+  posted_work_t *item = (posted_work_t *)context;
+  item->order[(*item->count)++] = item->id;
+}
+
+TEST_F(ThreadTest, test_thread_post_work_keeps_order) {
+  thread_t *thread = thread_new_sized("test_thread", 4);
+  int order[16];
+  int count = 0;
+  posted_work_t items[16];
+
+  // Alternate embedded and allocated items, more than the queue can hold.
+  for (int i = 0; i < 16; ++i) {
+    items[i].order = order;
+    items[i].count = &count;
+    items[i].id = i;
+    if (i % 2) {
+      thread_post(thread, record_order_fn, &items[i]);
+    } else {
+      items[i].work.func = record_order_fn;
+      items[i].work.context = &items[i];
+      thread_post_work(thread, &items[i].work);
+    }
+  }
+  thread_free(thread);
+
+  ASSERT_EQ(16, count);
+  for (int i = 0; i < 16; ++i)
+    EXPECT_EQ(i, order[i]);
+}
+
+static void count_fn(void *context) {
+  ++*(int *)context;
+}
+
+static void post_semaphore_fn(void *context) {
+  semaphore_post((semaphore_t *)context);
+}
+
+// Returns the call count of the busiest callback in the CSV dump of |name|,
+// and the largest queue depth seen by any of them.
+static int busiest_callback(const char *name, size_t *depth_max) {
+  FILE *file = tmpfile();
+  thread_debug_dump_csv(fileno(file));
+  rewind(file);
+
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "callback,%s,", name);
+
+  int busiest = 0;
+  *depth_max = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    if (strncmp(line, prefix, strlen(prefix)))
+      continue;
+    int count = 0;
+    size_t depth = 0;
+    sscanf(line + strlen(prefix), "%*[^,],%*[^,],%d,%*u,%*u,%*u,%*u,%zu", &count, &depth);
+    if (count > busiest)
+      busiest = count;
+    if (depth > *depth_max)
+      *depth_max = depth;
+  }
+  fclose(file);
+  return busiest;
+}
+
+TEST_F(ThreadTest, test_stats_per_callback) {
+  reactor_set_stats_enabled(true);
+  thread_t *thread = thread_new("stats_thread");
+  semaphore_t *done = semaphore_new(0);
+  int count = 0;
+
+  for (int i = 0; i < 20; ++i)
+    thread_post(thread, count_fn, &count);
+  thread_post(thread, post_semaphore_fn, done);
+  semaphore_wait(done);
+
+  // The last item is only accounted for once it returns, after signalling.
+  reactor_stats_t stats;
+  reactor_get_stats(thread_get_reactor(thread), &stats);
+  EXPECT_EQ(20, count);
+  EXPECT_GE(stats.events, 20U);
+  EXPECT_GE(stats.iterations, 1U);
+
+  size_t depth_max;
+  EXPECT_EQ(20, busiest_callback("stats_thread", &depth_max));
+  EXPECT_GE(depth_max, 1U);
+
+  semaphore_free(done);
+  thread_free(thread);
+  reactor_set_stats_enabled(false);
+}
+
+static void dequeue_one_fn(fixed_queue_t *queue, void *context) {
+  osi_free(fixed_queue_dequeue(queue));
+  semaphore_post((semaphore_t *)context);
+}
+
+TEST_F(ThreadTest, test_stats_fixed_queue_callback) {
+  reactor_set_stats_enabled(true);
+  thread_t *thread = thread_new("queue_thread");
+  fixed_queue_t *queue = fixed_queue_new(SIZE_MAX);
+  semaphore_t *done = semaphore_new(0);
+
+  for (int i = 0; i < 8; ++i)
+    fixed_queue_enqueue(queue, osi_malloc(1));
+  fixed_queue_register_dequeue(queue, thread_get_reactor(thread), dequeue_one_fn, done);
+  for (int i = 0; i < 8; ++i)
+    semaphore_wait(done);
+  // Let the last dequeue callback return and be accounted for.
+  thread_post(thread, post_semaphore_fn, done);
+  semaphore_wait(done);
+
+  // All eight were queued before the consumer registered.
+  size_t depth_max;
+  EXPECT_EQ(8, busiest_callback("queue_thread", &depth_max));
+  EXPECT_EQ(8U, depth_max);
+
+  fixed_queue_free(queue, osi_free);
+  semaphore_free(done);
+  thread_free(thread);
+  reactor_set_stats_enabled(false);
+}
+
+TEST_F(ThreadTest, test_stats_disabled_by_default) {
+  thread_t *thread = thread_new("quiet_thread");
+  semaphore_t *done = semaphore_new(0);
+
+  thread_post(thread, post_semaphore_fn, done);
+  semaphore_wait(done);
+
+  reactor_stats_t stats;
+  reactor_get_stats(thread_get_reactor(thread), &stats);
+  EXPECT_EQ(0U, stats.events);
+  EXPECT_EQ(0U, stats.iterations);
+
+  semaphore_free(done);
+  thread_free(thread);
+}
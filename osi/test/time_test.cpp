@@ -74,3 +74,32 @@ TEST_F(TimeTest, test_time_get_os_boottime_ms_increases_lower_bound) {
   ASSERT_TRUE((t2 - t1) >= TEST_TIME_SLEEP_MS);
   ASSERT_TRUE((t2 - t1) < TEST_TIME_DELTA_UPPER_BOUND_MS);
 }
+
+//
+// Test that the return value of time_get_os_boottime_us() is not zero.
+//
+TEST_F(TimeTest, test_time_get_os_boottime_us_not_zero) {
+  uint64_t t1 = time_get_os_boottime_us();
+  ASSERT_TRUE(t1 > 0);
+}
+
+//
+// Test that the return value of time_get_os_boottime_us()
+// is increasing.
+//
+TEST_F(TimeTest, test_time_get_os_boottime_us_increases_lower_bound) {
+  static const uint64_t TEST_TIME_SLEEP_US = 100 * 1000;
+  struct timespec delay;
+
+  delay.tv_sec = TEST_TIME_SLEEP_US / 1000000;
+  delay.tv_nsec = 1000 * (TEST_TIME_SLEEP_US % 1000000);
+
+  // Take two timestamps with sleep in-between
+  uint64_t t1 = time_get_os_boottime_us();
+  int err = nanosleep(&delay, &delay);
+  uint64_t t2 = time_get_os_boottime_us();
+
+  ASSERT_TRUE(err == 0);
+  ASSERT_TRUE((t2 - t1) >= TEST_TIME_SLEEP_US);
+  ASSERT_TRUE((t2 - t1) < (uint64_t)TEST_TIME_DELTA_UPPER_BOUND_MS * 1000);
+}
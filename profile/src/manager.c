@@ -71,6 +71,7 @@ EXPORT_SYMBOL const module_t profile_manager_module = {
 // Interface functions
 
 void profile_register(const profile_t *profile) {
+  module_init_lazy(&profile_manager_module);
   assert(initialized);
   assert(profile != NULL);
   assert(profile->name != NULL);
@@ -80,6 +81,7 @@ void profile_register(const profile_t *profile) {
 }
 
 const profile_t *profile_by_name(const char *name) {
+  module_init_lazy(&profile_manager_module);
   assert(initialized);
   assert(name != NULL);
 
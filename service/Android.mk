@@ -74,11 +74,13 @@ btserviceDaemonSrc := \
 	ipc/ipc_manager.cpp \
 	logging_helpers.cpp \
 	low_energy_client.cpp \
+	scan_filter_manager.cpp \
 	settings.cpp
 
 btserviceLinuxSrc := \
 	ipc/ipc_handler_linux.cpp \
-	ipc/linux_ipc_host.cpp
+	ipc/linux_ipc_host.cpp \
+	ipc/linux_ipc_protocol.cpp
 
 btserviceBinderDaemonImplSrc := \
 	ipc/binder/bluetooth_binder_server.cpp \
@@ -108,6 +110,7 @@ btserviceBaseTestSrc := \
 	test/gatt_identifier_unittest.cpp \
 	test/gatt_server_unittest.cpp \
 	test/low_energy_client_unittest.cpp \
+	test/scan_filter_manager_unittest.cpp \
 	test/settings_unittest.cpp \
 	test/util_unittest.cpp \
 	test/uuid_unittest.cpp
@@ -153,7 +156,8 @@ LOCAL_SRC_FILES := \
 ifeq ($(HOST_OS),linux)
 LOCAL_SRC_FILES += \
 	$(btserviceLinuxSrc) \
-	test/ipc_linux_unittest.cpp
+	test/ipc_linux_unittest.cpp \
+	test/linux_ipc_protocol_unittest.cpp
 LOCAL_LDLIBS += -lrt
 else
 LOCAL_SRC_FILES += \
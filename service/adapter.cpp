@@ -207,6 +207,11 @@ class AdapterImpl : public Adapter,
     return local_le_features_.max_adv_filter_supported >= kMinOffloadedFilters;
   }
 
+  int GetTotalNumberOfOffloadedFilters() override {
+    lock_guard<mutex> lock(local_le_features_lock_);
+    return local_le_features_.max_adv_filter_supported;
+  }
+
   bool IsOffloadedScanBatchingSupported() override {
     lock_guard<mutex> lock(local_le_features_lock_);
     return local_le_features_.scan_result_storage_size >=
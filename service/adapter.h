@@ -117,6 +117,10 @@ class Adapter {
   // Returns true if hardware-backed scan filtering is supported.
   virtual bool IsOffloadedFilteringSupported() = 0;
 
+  // Returns the number of filters the controller can hold for
+  // hardware-backed scan filtering.
+  virtual int GetTotalNumberOfOffloadedFilters() = 0;
+
   // Returns true if hardware-backed batch scanning is supported.
   virtual bool IsOffloadedScanBatchingSupported() = 0;
 
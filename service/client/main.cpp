@@ -201,6 +201,12 @@ class CLIBluetoothLowEnergyCallback
     EndAsyncOut();
   }
 
+  void OnBatchScanResults(
+      const std::vector<bluetooth::ScanResult>& scan_results) override {
+    for (const auto& scan_result : scan_results)
+      OnScanResult(scan_result);
+  }
+
   void OnMultiAdvertiseCallback(
       int status, bool is_start,
       const bluetooth::AdvertiseSettings& /* settings */) {
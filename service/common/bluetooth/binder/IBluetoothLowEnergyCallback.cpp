@@ -16,6 +16,8 @@
 
 #include "service/common/bluetooth/binder/IBluetoothLowEnergyCallback.h"
 
+#include <utility>
+
 #include <base/logging.h>
 #include <binder/Parcel.h>
 
@@ -28,6 +30,7 @@ using android::status_t;
 
 using bluetooth::AdvertiseData;
 using bluetooth::AdvertiseSettings;
+using bluetooth::ScanResult;
 
 namespace ipc {
 namespace binder {
@@ -78,6 +81,21 @@ status_t BnBluetoothLowEnergyCallback::onTransact(
     OnScanResult(*scan_result);
     return android::NO_ERROR;
   }
+  case ON_BATCH_SCAN_RESULTS_TRANSACTION: {
+    int count = data.readInt32();
+    if (count < 0)
+      return android::BAD_VALUE;
+
+    std::vector<ScanResult> scan_results;
+    scan_results.reserve(count);
+    for (int i = 0; i < count; ++i) {
+      auto scan_result = CreateScanResultFromParcel(data);
+      CHECK(scan_result.get());
+      scan_results.push_back(std::move(*scan_result));
+    }
+    OnBatchScanResults(scan_results);
+    return android::NO_ERROR;
+  }
   case ON_MULTI_ADVERTISE_CALLBACK_TRANSACTION: {
     int status = data.readInt32();
     bool is_start = data.readInt32();
@@ -162,6 +180,22 @@ void BpBluetoothLowEnergyCallback::OnScanResult(
       IBinder::FLAG_ONEWAY);
 }
 
+void BpBluetoothLowEnergyCallback::OnBatchScanResults(
+    const std::vector<ScanResult>& scan_results) {
+  Parcel data, reply;
+
+  data.writeInterfaceToken(
+      IBluetoothLowEnergyCallback::getInterfaceDescriptor());
+  data.writeInt32(scan_results.size());
+  for (const auto& scan_result : scan_results)
+    WriteScanResultToParcel(scan_result, &data);
+
+  remote()->transact(
+      IBluetoothLowEnergyCallback::ON_BATCH_SCAN_RESULTS_TRANSACTION,
+      data, &reply,
+      IBinder::FLAG_ONEWAY);
+}
+
 void BpBluetoothLowEnergyCallback::OnMultiAdvertiseCallback(
     int status, bool is_start,
     const AdvertiseSettings& settings) {
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <base/macros.h>
 #include <binder/IBinder.h>
 #include <binder/IInterface.h>
@@ -60,6 +62,8 @@ namespace binder {
                                  bool connected) = 0;
   virtual void OnMtuChanged(int status, const char* address, int mtu) = 0;
   virtual void OnScanResult(const bluetooth::ScanResult& scan_result) = 0;
+  virtual void OnBatchScanResults(
+      const std::vector<bluetooth::ScanResult>& scan_results) = 0;
   virtual void OnMultiAdvertiseCallback(
       int status, bool is_start,
       const bluetooth::AdvertiseSettings& settings) = 0;
@@ -101,6 +105,8 @@ class BpBluetoothLowEnergyCallback
                          bool connected) override;
   void OnMtuChanged(int status, const char* address, int mtu) override;
   void OnScanResult(const bluetooth::ScanResult& scan_result) override;
+  void OnBatchScanResults(
+      const std::vector<bluetooth::ScanResult>& scan_results) override;
   void OnMultiAdvertiseCallback(
       int status, bool is_start,
       const bluetooth::AdvertiseSettings& settings) override;
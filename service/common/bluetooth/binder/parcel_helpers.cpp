@@ -246,6 +246,7 @@ void WriteScanSettingsToParcel(
   parcel->writeInt64(settings.report_delay().InMilliseconds());
   parcel->writeInt32(settings.match_mode());
   parcel->writeInt32(settings.match_count_per_filter());
+  parcel->writeInt32(settings.report_batch_size());
 }
 
 std::unique_ptr<ScanSettings> CreateScanSettingsFromParcel(
@@ -262,10 +263,13 @@ std::unique_ptr<ScanSettings> CreateScanSettingsFromParcel(
       static_cast<ScanSettings::MatchMode>(parcel.readInt32());
   ScanSettings::MatchCount match_count_per_filter =
       static_cast<ScanSettings::MatchCount>(parcel.readInt32());
+  size_t report_batch_size = parcel.readInt32();
 
-  return std::unique_ptr<ScanSettings>(new ScanSettings(
+  std::unique_ptr<ScanSettings> settings(new ScanSettings(
       mode, callback_type, result_type, report_delay,
       match_mode, match_count_per_filter));
+  settings->set_report_batch_size(report_batch_size);
+  return settings;
 }
 
 void WriteScanResultToParcel(
@@ -16,10 +16,55 @@
 
 #include "service/common/bluetooth/scan_filter.h"
 
+#include <strings.h>
+
+#include <algorithm>
+
 #include "service/common/bluetooth/util/address_helper.h"
+#include "stack/include/bt_types.h"
+#include "stack/include/hcidefs.h"
 
 namespace bluetooth {
 
+namespace {
+
+// Reads the UUID at |data|, which is |uuid_len| bytes in little-endian order
+// as it appears in advertising data.
+bool ParseUUID(const uint8_t* data, size_t uuid_len, UUID* out_uuid) {
+  if (uuid_len == UUID::kNumBytes16) {
+    UUID::UUID16Bit uuid_bytes;
+    std::reverse_copy(data, data + uuid_len, uuid_bytes.begin());
+    *out_uuid = UUID(uuid_bytes);
+  } else if (uuid_len == UUID::kNumBytes32) {
+    UUID::UUID32Bit uuid_bytes;
+    std::reverse_copy(data, data + uuid_len, uuid_bytes.begin());
+    *out_uuid = UUID(uuid_bytes);
+  } else if (uuid_len == UUID::kNumBytes128) {
+    UUID::UUID128Bit uuid_bytes;
+    std::reverse_copy(data, data + uuid_len, uuid_bytes.begin());
+    *out_uuid = UUID(uuid_bytes);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool UUIDMatches(const UUID& uuid, const UUID& filter, const UUID* mask) {
+  if (!mask)
+    return uuid == filter;
+
+  const UUID::UUID128Bit uuid_bytes = uuid.GetFullBigEndian();
+  const UUID::UUID128Bit filter_bytes = filter.GetFullBigEndian();
+  const UUID::UUID128Bit mask_bytes = mask->GetFullBigEndian();
+  for (size_t i = 0; i < UUID::kNumBytes128; ++i) {
+    if ((uuid_bytes[i] & mask_bytes[i]) != (filter_bytes[i] & mask_bytes[i]))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
 ScanFilter::ScanFilter(const ScanFilter& other) {
   device_name_ = other.device_name_;
   device_address_ = other.device_address_;
@@ -67,6 +112,69 @@ void ScanFilter::SetServiceUuidWithMask(const UUID& service_uuid,
   service_uuid_mask_.reset(new UUID(mask));
 }
 
+bool ScanFilter::Matches(const ScanResult& scan_result) const {
+  if (!device_address_.empty() &&
+      strcasecmp(device_address_.c_str(),
+                 scan_result.device_address().c_str()) != 0)
+    return false;
+
+  if (device_name_.empty() && !service_uuid_)
+    return true;
+
+  bool name_found = device_name_.empty();
+  bool uuid_found = !service_uuid_;
+
+  const std::vector<uint8_t>& record = scan_result.scan_record();
+  for (size_t i = 0, field_len = 0; i < record.size(); i += field_len + 1) {
+    field_len = record[i];
+    if (field_len == 0 || i + field_len >= record.size())
+      break;
+
+    const uint8_t type = record[i + 1];
+    const uint8_t* field = record.data() + i + 2;
+    const size_t data_len = field_len - 1;
+
+    switch (type) {
+      case HCI_EIR_COMPLETE_LOCAL_NAME_TYPE:
+      case HCI_EIR_SHORTENED_LOCAL_NAME_TYPE:
+        if (!name_found && device_name_.size() == data_len &&
+            std::equal(field, field + data_len, device_name_.begin()))
+          name_found = true;
+        break;
+      case HCI_EIR_MORE_16BITS_UUID_TYPE:
+      case HCI_EIR_COMPLETE_16BITS_UUID_TYPE:
+      case HCI_EIR_MORE_32BITS_UUID_TYPE:
+      case HCI_EIR_COMPLETE_32BITS_UUID_TYPE:
+      case HCI_EIR_MORE_128BITS_UUID_TYPE:
+      case HCI_EIR_COMPLETE_128BITS_UUID_TYPE: {
+        size_t uuid_len = UUID::kNumBytes128;
+        if (type == HCI_EIR_MORE_16BITS_UUID_TYPE ||
+            type == HCI_EIR_COMPLETE_16BITS_UUID_TYPE)
+          uuid_len = UUID::kNumBytes16;
+        else if (type == HCI_EIR_MORE_32BITS_UUID_TYPE ||
+                 type == HCI_EIR_COMPLETE_32BITS_UUID_TYPE)
+          uuid_len = UUID::kNumBytes32;
+
+        for (size_t j = 0; !uuid_found && j + uuid_len <= data_len;
+             j += uuid_len) {
+          UUID uuid;
+          if (ParseUUID(field + j, uuid_len, &uuid) &&
+              UUIDMatches(uuid, *service_uuid_, service_uuid_mask_.get()))
+            uuid_found = true;
+        }
+        break;
+      }
+      default:
+        break;
+    }
+
+    if (name_found && uuid_found)
+      return true;
+  }
+
+  return false;
+}
+
 bool ScanFilter::operator==(const ScanFilter& rhs) const {
   if (device_name_ != rhs.device_name_)
     return false;
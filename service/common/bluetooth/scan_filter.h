@@ -18,6 +18,7 @@
 
 #include <memory>
 
+#include <bluetooth/scan_result.h>
 #include <bluetooth/uuid.h>
 
 namespace bluetooth {
@@ -61,6 +62,10 @@ class ScanFilter {
   // advertised value, and 0 to ignore that bit.
   void SetServiceUuidWithMask(const UUID& service_uuid, const UUID& mask);
 
+  // Returns true if |scan_result| passes every condition set on this filter.
+  // A filter with no conditions matches everything.
+  bool Matches(const ScanResult& scan_result) const;
+
   // Comparison operator.
   bool operator==(const ScanFilter& rhs) const;
 
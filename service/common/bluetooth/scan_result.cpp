@@ -16,6 +16,8 @@
 
 #include "service/common/bluetooth/scan_result.h"
 
+#include <utility>
+
 #include <base/logging.h>
 
 #include "service/common/bluetooth/util/address_helper.h"
@@ -24,10 +26,10 @@
 namespace bluetooth {
 
 ScanResult::ScanResult(const std::string& device_address,
-                       const std::vector<uint8_t> scan_record,
+                       std::vector<uint8_t> scan_record,
                        int rssi)
     : device_address_(device_address),
-      scan_record_(scan_record),
+      scan_record_(std::move(scan_record)),
       rssi_(rssi) {
   CHECK(util::IsAddressValid(device_address)) << "Invalid BD_ADDR given: "
                                               << device_address;
@@ -22,6 +22,7 @@ ScanSettings::ScanSettings()
     : mode_(MODE_LOW_POWER),
       callback_type_(CALLBACK_TYPE_ALL_MATCHES),
       result_type_(RESULT_TYPE_FULL),
+      report_batch_size_(0),
       match_count_per_filter_(MATCH_COUNT_MAX_ADVERTISEMENTS) {
 }
 
@@ -36,6 +37,7 @@ ScanSettings::ScanSettings(
       callback_type_(callback_type),
       result_type_(result_type),
       report_delay_ms_(report_delay_ms),
+      report_batch_size_(0),
       match_mode_(match_mode),
       match_count_per_filter_(match_count_per_filter) {
 }
@@ -53,6 +55,9 @@ bool ScanSettings::operator==(const ScanSettings& rhs) const {
   if (report_delay_ms_ != rhs.report_delay_ms_)
     return false;
 
+  if (report_batch_size_ != rhs.report_batch_size_)
+    return false;
+
   if (match_mode_ != rhs.match_mode_)
     return false;
 
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include <base/time/time.h>
 
 namespace bluetooth {
@@ -110,6 +112,7 @@ class ScanSettings {
   //   callback_type: CALLBACK_TYPE_ALL_MATCHES
   //   result_type: RESULT_TYPE_FULL
   //   report_delay_ms: 0
+  //   report_batch_size: 0
   //   match_mode: MATCH_MODE_AGGRESSIVE
   //   match_count_per_filter: MATCH_COUNT_MAX_ADVERTISEMENTS
   ScanSettings();
@@ -139,6 +142,18 @@ class ScanSettings {
     report_delay_ms_ = delay;
   }
 
+  // Returns the number of scan results to collect before reporting them in
+  // one batch. If both this and the report delay are set, a batch is reported
+  // on whichever comes first. 0 means batches are not limited by size.
+  size_t report_batch_size() const { return report_batch_size_; }
+  void set_report_batch_size(size_t size) { report_batch_size_ = size; }
+
+  // Returns true if scan results should be delivered in batches rather than
+  // as soon as they are found.
+  bool IsBatched() const {
+    return report_delay_ms_ > base::TimeDelta() || report_batch_size_ > 1;
+  }
+
   // Returns the hardware filter match mode.
   MatchMode match_mode() const { return match_mode_; }
   void set_match_mode(MatchMode mode) { match_mode_ = mode; }
@@ -157,6 +172,7 @@ class ScanSettings {
   CallbackTypeBitField callback_type_;
   ResultType result_type_;
   base::TimeDelta report_delay_ms_;
+  size_t report_batch_size_;
   MatchMode match_mode_;
   MatchCount match_count_per_filter_;
 };
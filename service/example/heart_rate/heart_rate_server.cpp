@@ -39,6 +39,8 @@ class CLIBluetoothLowEnergyCallback
   void OnMtuChanged(int status, const char *address, int mtu) override {}
 
   void OnScanResult(const bluetooth::ScanResult& scan_result) override {}
+  void OnBatchScanResults(
+      const std::vector<bluetooth::ScanResult>& scan_results) override {}
 
   void OnClientRegistered(int status, int client_id){
     if (status != bluetooth::BLE_STATUS_SUCCESS) {
@@ -81,14 +81,20 @@ namespace bluetooth {
 namespace gatt {
 
 struct Characteristic {
+  Characteristic();
+
   UUID uuid;
+  bool notify;
+
+  // Guards the value of this characteristic alone, so reads and writes of
+  // different characteristics never wait on each other or on the API lock.
+  std::mutex lock;
   int blob_section;
   std::vector<uint8_t> blob;
 
   // Support synchronized blob updates by latching under mutex.
   std::vector<uint8_t> next_blob;
   bool next_blob_pending;
-  bool notify;
 };
 
 struct ServerInternals {
@@ -100,10 +106,23 @@ struct ServerInternals {
       int properties,
       int permissions);
 
+  // Look up the cached attribute for a BlueDroid handle or an API UUID,
+  // creating an empty one if needed. The returned characteristic stays valid
+  // for the lifetime of the server; its value is guarded by its own lock.
+  Characteristic& GetCharacteristic(int attribute_handle);
+  Characteristic& GetCharacteristic(const UUID& uuid, int* attribute_handle);
+
+  // Returns the value attribute controlled by |control_handle|, or -1.
+  int GetControlledBlob(int control_handle);
+
+  // Guards the attribute maps below. Only held for lookups and inserts.
+  std::mutex attributes_lock;
+
   // This maps API attribute UUIDs to BlueDroid handles.
   std::map<UUID, int> uuid_to_attribute;
 
-  // The attribute cache, indexed by BlueDroid handles.
+  // The attribute cache, indexed by BlueDroid handles. Elements never move,
+  // so references handed out by GetCharacteristic survive rehashing.
   std::unordered_map<int, Characteristic> characteristics;
 
   // Associate a control attribute with its value attribute.
@@ -119,6 +138,7 @@ struct ServerInternals {
   btgatt_srvc_id_t service_id;
   std::set<int> connections;
 
+  // Guards the API calls and the state above other than the attributes.
   std::mutex lock;
   std::condition_variable api_synchronize;
   int pipefd[kPipeNumEnds];
@@ -161,38 +181,45 @@ void ServiceAddedCallback(int status, int server_if, btgatt_srvc_id_t *srvc_id,
 void RequestReadCallback(int conn_id, int trans_id, bt_bdaddr_t *bda,
                          int attr_handle, int attribute_offset_octets,
                          bool is_long) {
-  std::lock_guard<std::mutex> lock(g_internal->lock);
+  bluetooth::gatt::Characteristic &ch =
+      g_internal->GetCharacteristic(attr_handle);
 
-  bluetooth::gatt::Characteristic &ch = g_internal->characteristics[attr_handle];
+  btgatt_response_t response;
+  response.attr_value.len = 0;
+  int blob_section;
 
-  // Latch next_blob to blob on a 'fresh' read.
-  if (ch.next_blob_pending && attribute_offset_octets == 0 &&
-      ch.blob_section == 0) {
-    std::swap(ch.blob, ch.next_blob);
-    ch.next_blob_pending = false;
+  {
+    std::lock_guard<std::mutex> lock(ch.lock);
+
+    // Latch next_blob to blob on a 'fresh' read. Swapping keeps both
+    // buffers' capacity for the next update.
+    if (ch.next_blob_pending && attribute_offset_octets == 0 &&
+        ch.blob_section == 0) {
+      std::swap(ch.blob, ch.next_blob);
+      ch.next_blob_pending = false;
+    }
+
+    blob_section = ch.blob_section;
+    const size_t blob_offset_octets =
+        std::min(ch.blob.size(), blob_section * kMaxGattAttributeSize);
+    const size_t blob_remaining = ch.blob.size() - blob_offset_octets;
+    const size_t attribute_size =
+        std::min(kMaxGattAttributeSize, blob_remaining);
+
+    if (attribute_offset_octets < static_cast<int>(attribute_size)) {
+      std::copy(ch.blob.begin() + blob_offset_octets + attribute_offset_octets,
+                ch.blob.begin() + blob_offset_octets + attribute_size,
+                response.attr_value.value);
+      response.attr_value.len = attribute_size - attribute_offset_octets;
+    }
   }
 
-  const size_t blob_offset_octets =
-      std::min(ch.blob.size(), ch.blob_section * kMaxGattAttributeSize);
-  const size_t blob_remaining = ch.blob.size() - blob_offset_octets;
-  const size_t attribute_size = std::min(kMaxGattAttributeSize, blob_remaining);
-
   std::string addr(BtAddrString(bda));
   LOG_INFO(LOG_TAG,
       "%s: connection:%d (%s) reading attr:%d attribute_offset_octets:%d "
       "blob_section:%u (is_long:%u)",
       __func__, conn_id, addr.c_str(), attr_handle, attribute_offset_octets,
-      ch.blob_section, is_long);
-
-  btgatt_response_t response;
-  response.attr_value.len = 0;
-
-  if (attribute_offset_octets < static_cast<int>(attribute_size)) {
-    std::copy(ch.blob.begin() + blob_offset_octets + attribute_offset_octets,
-              ch.blob.begin() + blob_offset_octets + attribute_size,
-              response.attr_value.value);
-    response.attr_value.len = attribute_size - attribute_offset_octets;
-  }
+      blob_section, is_long);
 
   response.attr_value.handle = attr_handle;
   response.attr_value.offset = attribute_offset_octets;
@@ -211,22 +238,36 @@ void RequestWriteCallback(int conn_id, int trans_id, bt_bdaddr_t *bda,
       __func__, conn_id, addr.c_str(), trans_id, attr_handle, attribute_offset,
       length, need_rsp, is_prep);
 
-  std::lock_guard<std::mutex> lock(g_internal->lock);
-
   bluetooth::gatt::Characteristic &ch =
-      g_internal->characteristics[attr_handle];
-
-  ch.blob.resize(attribute_offset + length);
-
-  std::copy(value, value + length, ch.blob.begin() + attribute_offset);
+      g_internal->GetCharacteristic(attr_handle);
+
+  size_t blob_size;
+  uint8_t blob_section;
+  {
+    std::lock_guard<std::mutex> lock(ch.lock);
+
+    // The blob keeps its capacity, so in-place writes within the reserved
+    // size never reallocate.
+    const size_t end = attribute_offset + length;
+    if (ch.blob.size() != end)
+      ch.blob.resize(end);
+    std::copy(value, value + length, ch.blob.begin() + attribute_offset);
+
+    blob_size = ch.blob.size();
+    blob_section = blob_size ? ch.blob[0] : 0;
+  }
 
-  auto target_blob = g_internal->controlled_blobs.find(attr_handle);
+  const int target_blob = g_internal->GetControlledBlob(attr_handle);
   // If this is a control attribute, adjust offset of the target blob.
-  if (target_blob != g_internal->controlled_blobs.end() &&
-      ch.blob.size() == 1u) {
-    g_internal->characteristics[target_blob->second].blob_section = ch.blob[0];
+  if (target_blob != -1 && blob_size == 1u) {
+    bluetooth::gatt::Characteristic &target =
+        g_internal->GetCharacteristic(target_blob);
+    {
+      std::lock_guard<std::mutex> lock(target.lock);
+      target.blob_section = blob_section;
+    }
     LOG_INFO(LOG_TAG, "%s: updating attribute %d blob_section to %u", __func__,
-        target_blob->second, ch.blob[0]);
+        target_blob, blob_section);
   } else if (!is_prep) {
     // This is a single frame characteristic write.
     // Notify upwards because we're done now.
@@ -239,6 +280,7 @@ void RequestWriteCallback(int conn_id, int trans_id, bt_bdaddr_t *bda,
   } else {
     // This is a multi-frame characteristic write.
     // Wait for an 'RequestExecWriteCallback' to notify completion.
+    std::lock_guard<std::mutex> lock(g_internal->lock);
     g_internal->last_write = ch.uuid;
   }
 
@@ -286,6 +328,7 @@ void ConnectionCallback(int conn_id, int server_if, int connected,
   std::string addr(BtAddrString(bda));
   LOG_INFO(LOG_TAG, "%s: connection:%d server_if:%d connected:%d addr:%s",
       __func__, conn_id, server_if, connected, addr.c_str());
+  std::lock_guard<std::mutex> lock(g_internal->lock);
   if (connected == 1) {
     g_internal->connections.insert(conn_id);
   } else if (connected == 0) {
@@ -303,9 +346,11 @@ void CharacteristicAddedCallback(int status, int server_if, bt_uuid_t *uuid,
 
   std::lock_guard<std::mutex> lock(g_internal->lock);
 
-  g_internal->uuid_to_attribute[id] = char_handle;
-  g_internal->characteristics[char_handle].uuid = id;
-  g_internal->characteristics[char_handle].blob_section = 0;
+  {
+    std::lock_guard<std::mutex> attributes_lock(g_internal->attributes_lock);
+    g_internal->uuid_to_attribute[id] = char_handle;
+    g_internal->characteristics[char_handle].uuid = id;
+  }
 
   // This terminates an AddCharacteristic.
   g_internal->api_synchronize.notify_one();
@@ -516,6 +561,32 @@ bt_status_t ServerInternals::AddCharacteristic(
       server_if, service_handle, &c_uuid, properties, permissions);
 }
 
+Characteristic& ServerInternals::GetCharacteristic(int attribute_handle) {
+  std::lock_guard<std::mutex> lock(attributes_lock);
+  return characteristics[attribute_handle];
+}
+
+Characteristic& ServerInternals::GetCharacteristic(const UUID& uuid,
+                                                   int* attribute_handle) {
+  std::lock_guard<std::mutex> lock(attributes_lock);
+  *attribute_handle = uuid_to_attribute[uuid];
+  return characteristics[*attribute_handle];
+}
+
+int ServerInternals::GetControlledBlob(int control_handle) {
+  std::lock_guard<std::mutex> lock(attributes_lock);
+  auto target_blob = controlled_blobs.find(control_handle);
+  return target_blob == controlled_blobs.end() ? -1 : target_blob->second;
+}
+
+Characteristic::Characteristic()
+    : notify(false), blob_section(0), next_blob_pending(false) {
+  // Reserve a full attribute up front so that value updates reuse the same
+  // storage instead of reallocating on every write.
+  blob.reserve(kMaxGattAttributeSize);
+  next_blob.reserve(kMaxGattAttributeSize);
+}
+
 ServerInternals::ServerInternals()
     : gatt(nullptr),
       server_if(0),
@@ -652,8 +723,10 @@ bool Server::AddCharacteristic(
     return false;
   }
   internal_->api_synchronize.wait(lock);
-  const int handle = internal_->uuid_to_attribute[id];
-  internal_->characteristics[handle].notify = properties & kPropertyNotify;
+  int handle;
+  Characteristic &ch = internal_->GetCharacteristic(id, &handle);
+  std::lock_guard<std::mutex> characteristic_lock(ch.lock);
+  ch.notify = properties & kPropertyNotify;
   return true;
 }
 
@@ -681,13 +754,21 @@ bool Server::AddBlob(const UUID &id, const UUID &control_id, int properties,
 
   // Finally, associate the control attribute with the value attribute.
   // Also, initialize the control attribute to a readable zero.
-  const int control_attribute = internal_->uuid_to_attribute[control_id];
-  const int blob_attribute = internal_->uuid_to_attribute[id];
-  internal_->controlled_blobs[control_attribute] = blob_attribute;
-  internal_->characteristics[blob_attribute].notify =
-      properties & kPropertyNotify;
+  int control_attribute;
+  int blob_attribute;
+  Characteristic &ctrl = internal_->GetCharacteristic(control_id,
+                                                      &control_attribute);
+  Characteristic &blob = internal_->GetCharacteristic(id, &blob_attribute);
+  {
+    std::lock_guard<std::mutex> attributes_lock(internal_->attributes_lock);
+    internal_->controlled_blobs[control_attribute] = blob_attribute;
+  }
+  {
+    std::lock_guard<std::mutex> blob_lock(blob.lock);
+    blob.notify = properties & kPropertyNotify;
+  }
 
-  Characteristic &ctrl = internal_->characteristics[control_attribute];
+  std::lock_guard<std::mutex> ctrl_lock(ctrl.lock);
   ctrl.next_blob.clear();
   ctrl.next_blob.push_back(0);
   ctrl.next_blob_pending = true;
@@ -748,15 +829,22 @@ bool Server::GetScanResults(ScanResults *results) {
 
 bool Server::SetCharacteristicValue(const UUID &id,
                               const std::vector<uint8_t> &value) {
-  std::lock_guard<std::mutex> lock(internal_->lock);
-  const int attribute_id = internal_->uuid_to_attribute[id];
-  Characteristic &ch = internal_->characteristics[attribute_id];
-  ch.next_blob = value;
-  ch.next_blob_pending = true;
+  int attribute_id;
+  Characteristic &ch = internal_->GetCharacteristic(id, &attribute_id);
+  bool notify;
+  {
+    std::lock_guard<std::mutex> lock(ch.lock);
+    // Copies into the existing buffer, which only grows for values larger
+    // than any seen before.
+    ch.next_blob.assign(value.begin(), value.end());
+    ch.next_blob_pending = true;
+    notify = ch.notify;
+  }
 
-  if (!ch.notify)
+  if (!notify)
     return true;
 
+  std::lock_guard<std::mutex> lock(internal_->lock);
   for (auto connection : internal_->connections) {
     char dummy = 0;
     internal_->gatt->server->send_indication(internal_->server_if,
@@ -770,9 +858,10 @@ bool Server::SetCharacteristicValue(const UUID &id,
 }
 
 bool Server::GetCharacteristicValue(const UUID &id, std::vector<uint8_t> *value) {
-  std::lock_guard<std::mutex> lock(internal_->lock);
-  const int attribute_id = internal_->uuid_to_attribute[id];
-  *value = internal_->characteristics[attribute_id].blob;
+  int attribute_id;
+  Characteristic &ch = internal_->GetCharacteristic(id, &attribute_id);
+  std::lock_guard<std::mutex> lock(ch.lock);
+  value->assign(ch.blob.begin(), ch.blob.end());
   return true;
 }
 
@@ -198,6 +198,41 @@ void MtuChangedCallback(int conn_id, int status, int mtu) {
   FOR_EACH_CLIENT_OBSERVER(MtuChangedCallback(g_interface, conn_id, status, mtu));
 }
 
+void ScanFilterCfgCallback(int action, int client_if, int status,
+                           int filt_type, int avbl_space) {
+  shared_lock<shared_timed_mutex> lock(g_instance_lock);
+  VLOG(2) << __func__ << " - action: " << action << " status: " << status
+          << " client_if: " << client_if << " filt_type: " << filt_type
+          << " avbl_space: " << avbl_space;
+  VERIFY_INTERFACE_OR_RETURN();
+
+  FOR_EACH_CLIENT_OBSERVER(
+      ScanFilterCfgCallback(g_interface, action, client_if, status, filt_type,
+                            avbl_space));
+}
+
+void ScanFilterParamCallback(int action, int client_if, int status,
+                             int avbl_space) {
+  shared_lock<shared_timed_mutex> lock(g_instance_lock);
+  VLOG(2) << __func__ << " - action: " << action << " status: " << status
+          << " client_if: " << client_if << " avbl_space: " << avbl_space;
+  VERIFY_INTERFACE_OR_RETURN();
+
+  FOR_EACH_CLIENT_OBSERVER(
+      ScanFilterParamCallback(g_interface, action, client_if, status,
+                              avbl_space));
+}
+
+void ScanFilterStatusCallback(int enable, int client_if, int status) {
+  shared_lock<shared_timed_mutex> lock(g_instance_lock);
+  VLOG(2) << __func__ << " - enable: " << enable << " status: " << status
+          << " client_if: " << client_if;
+  VERIFY_INTERFACE_OR_RETURN();
+
+  FOR_EACH_CLIENT_OBSERVER(
+      ScanFilterStatusCallback(g_interface, enable, client_if, status));
+}
+
 void MultiAdvEnableCallback(int client_if, int status) {
   shared_lock<shared_timed_mutex> lock(g_instance_lock);
   VLOG(2) << __func__ << " - status: " << status << " client_if: " << client_if;
@@ -234,6 +269,47 @@ void MultiAdvDisableCallback(int client_if, int status) {
       MultiAdvDisableCallback(g_interface, client_if, status));
 }
 
+void BatchscanCfgStorageCallback(int client_if, int status) {
+  shared_lock<shared_timed_mutex> lock(g_instance_lock);
+  VLOG(2) << __func__ << " - status: " << status << " client_if: " << client_if;
+  VERIFY_INTERFACE_OR_RETURN();
+
+  FOR_EACH_CLIENT_OBSERVER(
+      BatchscanCfgStorageCallback(g_interface, client_if, status));
+}
+
+void BatchscanEnableDisableCallback(int action, int client_if, int status) {
+  shared_lock<shared_timed_mutex> lock(g_instance_lock);
+  VLOG(2) << __func__ << " - action: " << action << " status: " << status
+          << " client_if: " << client_if;
+  VERIFY_INTERFACE_OR_RETURN();
+
+  FOR_EACH_CLIENT_OBSERVER(
+      BatchscanEnableDisableCallback(g_interface, action, client_if, status));
+}
+
+void BatchscanReportsCallback(int client_if, int status, int report_format,
+                              int num_records, int data_len,
+                              uint8_t* rep_data) {
+  shared_lock<shared_timed_mutex> lock(g_instance_lock);
+  VLOG(2) << __func__ << " - status: " << status << " client_if: " << client_if
+          << " report_format: " << report_format
+          << " num_records: " << num_records << " data_len: " << data_len;
+  VERIFY_INTERFACE_OR_RETURN();
+
+  FOR_EACH_CLIENT_OBSERVER(
+      BatchscanReportsCallback(g_interface, client_if, status, report_format,
+                               num_records, data_len, rep_data));
+}
+
+void BatchscanThresholdCallback(int client_if) {
+  shared_lock<shared_timed_mutex> lock(g_instance_lock);
+  VLOG(2) << __func__ << " - client_if: " << client_if;
+  VERIFY_INTERFACE_OR_RETURN();
+
+  FOR_EACH_CLIENT_OBSERVER(BatchscanThresholdCallback(g_interface, client_if));
+}
+
 void GetGattDbCallback(int conn_id, btgatt_db_element_t *db, int size) {
   shared_lock<shared_timed_mutex> lock(g_instance_lock);
   VLOG(2) << __func__ << " - conn_id: " << conn_id << " size: " << size;
@@ -447,18 +523,18 @@ const btgatt_client_callbacks_t gatt_client_callbacks = {
     nullptr,  // read_remote_rssi_cb
     ListenCallback,
     MtuChangedCallback,
-    nullptr,  // scan_filter_cfg_cb
-    nullptr,  // scan_filter_param_cb
-    nullptr,  // scan_filter_status_cb
+    ScanFilterCfgCallback,
+    ScanFilterParamCallback,
+    ScanFilterStatusCallback,
     MultiAdvEnableCallback,
     MultiAdvUpdateCallback,
     MultiAdvDataCallback,
     MultiAdvDisableCallback,
     nullptr,  // congestion_cb
-    nullptr,  // batchscan_cfg_storage_cb
-    nullptr,  // batchscan_enb_disable_cb
-    nullptr,  // batchscan_reports_cb
-    nullptr,  // batchscan_threshold_cb
+    BatchscanCfgStorageCallback,
+    BatchscanEnableDisableCallback,
+    BatchscanReportsCallback,
+    BatchscanThresholdCallback,
     nullptr,  // track_adv_event_cb
     nullptr,  // scan_parameter_setup_completed_cb
     GetGattDbCallback,
@@ -684,6 +760,33 @@ void BluetoothGattInterface::ClientObserver::MtuChangedCallback(
   // Do nothing.
 }
 
+void BluetoothGattInterface::ClientObserver::ScanFilterCfgCallback(
+    BluetoothGattInterface* /* gatt_iface */,
+    int /* action */,
+    int /* client_if */,
+    int /* status */,
+    int /* filt_type */,
+    int /* avbl_space */) {
+  // Do nothing.
+}
+
+void BluetoothGattInterface::ClientObserver::ScanFilterParamCallback(
+    BluetoothGattInterface* /* gatt_iface */,
+    int /* action */,
+    int /* client_if */,
+    int /* status */,
+    int /* avbl_space */) {
+  // Do nothing.
+}
+
+void BluetoothGattInterface::ClientObserver::ScanFilterStatusCallback(
+    BluetoothGattInterface* /* gatt_iface */,
+    int /* enable */,
+    int /* client_if */,
+    int /* status */) {
+  // Do nothing.
+}
+
 void BluetoothGattInterface::ClientObserver::MultiAdvEnableCallback(
     BluetoothGattInterface* /* gatt_iface */,
     int /* status */,
@@ -709,6 +812,38 @@ void BluetoothGattInterface::ClientObserver::MultiAdvDisableCallback(
   // Do nothing.
 }
 
+void BluetoothGattInterface::ClientObserver::BatchscanCfgStorageCallback(
+    BluetoothGattInterface* /* gatt_iface */,
+    int /* client_if */,
+    int /* status */) {
+  // Do nothing.
+}
+
+void BluetoothGattInterface::ClientObserver::BatchscanEnableDisableCallback(
+    BluetoothGattInterface* /* gatt_iface */,
+    int /* action */,
+    int /* client_if */,
+    int /* status */) {
+  // Do nothing.
+}
+
+void BluetoothGattInterface::ClientObserver::BatchscanReportsCallback(
+    BluetoothGattInterface* /* gatt_iface */,
+    int /* client_if */,
+    int /* status */,
+    int /* report_format */,
+    int /* num_records */,
+    int /* data_len */,
+    uint8_t* /* rep_data */) {
+  // Do nothing.
+}
+
+void BluetoothGattInterface::ClientObserver::BatchscanThresholdCallback(
+    BluetoothGattInterface* /* gatt_iface */,
+    int /* client_if */) {
+  // Do nothing.
+}
+
 void BluetoothGattInterface::ClientObserver::GetGattDbCallback(
     BluetoothGattInterface* /* gatt_iface */,
     int /* conn_id */,
@@ -104,6 +104,24 @@ class BluetoothGattInterface {
         BluetoothGattInterface* gatt_iface,
         int conn_id, int status, int mtu);
 
+    // |filt_type| is the type of the condition that was configured and
+    // |avbl_space| the number of conditions of that type the controller still
+    // has room for.
+    virtual void ScanFilterCfgCallback(
+        BluetoothGattInterface* gatt_iface,
+        int action, int client_if, int status, int filt_type,
+        int avbl_space);
+
+    // |avbl_space| is the number of filter indices the controller still has
+    // room for.
+    virtual void ScanFilterParamCallback(
+        BluetoothGattInterface* gatt_iface,
+        int action, int client_if, int status, int avbl_space);
+
+    virtual void ScanFilterStatusCallback(
+        BluetoothGattInterface* gatt_iface,
+        int enable, int client_if, int status);
+
     virtual void MultiAdvEnableCallback(
         BluetoothGattInterface* gatt_iface,
         int client_if, int status);
@@ -120,6 +138,25 @@ class BluetoothGattInterface {
         BluetoothGattInterface* gatt_iface,
         int client_if, int status);
 
+    virtual void BatchscanCfgStorageCallback(
+        BluetoothGattInterface* gatt_iface,
+        int client_if, int status);
+
+    virtual void BatchscanEnableDisableCallback(
+        BluetoothGattInterface* gatt_iface,
+        int action, int client_if, int status);
+
+    // |rep_data| holds |num_records| records of the controller's report
+    // format and is only valid for the duration of the call.
+    virtual void BatchscanReportsCallback(
+        BluetoothGattInterface* gatt_iface,
+        int client_if, int status, int report_format,
+        int num_records, int data_len, uint8_t* rep_data);
+
+    virtual void BatchscanThresholdCallback(
+        BluetoothGattInterface* gatt_iface,
+        int client_if);
+
     virtual void GetGattDbCallback(
         BluetoothGattInterface* gatt_iface,
         int conn_id,
@@ -63,6 +63,41 @@ bt_status_t FakeDisconnect(int client_if, const bt_bdaddr_t *bd_addr,
   return BT_STATUS_FAIL;
 }
 
+bt_status_t FakeScanFilterParamSetup(btgatt_filt_param_setup_t filt_param) {
+  if (g_client_handler)
+    return g_client_handler->ScanFilterParamSetup(filt_param);
+
+  return BT_STATUS_FAIL;
+}
+
+bt_status_t FakeScanFilterAddRemove(
+    int client_if, int action, int filt_type, int filt_index, int company_id,
+    int company_id_mask, const bt_uuid_t* p_uuid,
+    const bt_uuid_t* p_uuid_mask, const bt_bdaddr_t* bd_addr,
+    char addr_type, int data_len, char* p_data, int mask_len, char* p_mask) {
+  if (g_client_handler)
+    return g_client_handler->ScanFilterAddRemove(
+        client_if, action, filt_type, filt_index, company_id,
+        company_id_mask, p_uuid, p_uuid_mask, bd_addr, addr_type,
+        data_len, p_data, mask_len, p_mask);
+
+  return BT_STATUS_FAIL;
+}
+
+bt_status_t FakeScanFilterClear(int client_if, int filt_index) {
+  if (g_client_handler)
+    return g_client_handler->ScanFilterClear(client_if, filt_index);
+
+  return BT_STATUS_FAIL;
+}
+
+bt_status_t FakeScanFilterEnable(int client_if, bool enable) {
+  if (g_client_handler)
+    return g_client_handler->ScanFilterEnable(client_if, enable);
+
+  return BT_STATUS_FAIL;
+}
+
 bt_status_t FakeMultiAdvEnable(
     int client_if, int min_interval, int max_interval, int adv_type,
     int chnl_map, int tx_power, int timeout_s) {
@@ -97,6 +132,42 @@ bt_status_t FakeMultiAdvDisable(int client_if) {
   return BT_STATUS_FAIL;
 }
 
+bt_status_t FakeBatchscanConfigStorage(
+    int client_if, int batch_scan_full_max, int batch_scan_trunc_max,
+    int batch_scan_notify_threshold) {
+  if (g_client_handler)
+    return g_client_handler->BatchscanConfigStorage(
+        client_if, batch_scan_full_max, batch_scan_trunc_max,
+        batch_scan_notify_threshold);
+
+  return BT_STATUS_FAIL;
+}
+
+bt_status_t FakeBatchscanEnable(
+    int client_if, int scan_mode, int scan_interval, int scan_window,
+    int addr_type, int discard_rule) {
+  if (g_client_handler)
+    return g_client_handler->BatchscanEnable(
+        client_if, scan_mode, scan_interval, scan_window, addr_type,
+        discard_rule);
+
+  return BT_STATUS_FAIL;
+}
+
+bt_status_t FakeBatchscanDisable(int client_if) {
+  if (g_client_handler)
+    return g_client_handler->BatchscanDisable(client_if);
+
+  return BT_STATUS_FAIL;
+}
+
+bt_status_t FakeBatchscanReadReports(int client_if, int scan_mode) {
+  if (g_client_handler)
+    return g_client_handler->BatchscanReadReports(client_if, scan_mode);
+
+  return BT_STATUS_FAIL;
+}
+
 bt_status_t FakeRegisterServer(bt_uuid_t* app_uuid) {
   if (g_server_handler)
     return g_server_handler->RegisterServer(app_uuid);
@@ -189,10 +260,10 @@ btgatt_client_interface_t fake_btgattc_iface = {
   nullptr,  // register_for_notification
   nullptr,  // deregister_for_notification
   nullptr,  // read_remote_rssi
-  nullptr,  // scan_filter_param_setup
-  nullptr,  // scan_filter_add_remove
-  nullptr,  // scan_filter_clear
-  nullptr,  // scan_filter_enable
+  FakeScanFilterParamSetup,
+  FakeScanFilterAddRemove,
+  FakeScanFilterClear,
+  FakeScanFilterEnable,
   nullptr,  // get_device_type
   nullptr,  // set_adv_data
   nullptr,  // configure_mtu
@@ -202,10 +273,10 @@ btgatt_client_interface_t fake_btgattc_iface = {
   nullptr,  // multi_adv_update
   FakeMultiAdvSetInstData,
   FakeMultiAdvDisable,
-  nullptr,  // batchscan_cfg_storate
-  nullptr,  // batchscan_enb_batch_scan
-  nullptr,  // batchscan_dis_batch_scan
-  nullptr,  // batchscan_read_reports
+  FakeBatchscanConfigStorage,
+  FakeBatchscanEnable,
+  FakeBatchscanDisable,
+  FakeBatchscanReadReports,
   nullptr,  // test_command
   nullptr,  // get_gatt_db
 };
@@ -278,6 +349,27 @@ void FakeBluetoothGattInterface::NotifyScanResultCallback(
                     ScanResultCallback(this, bda, rssi, adv_data));
 }
 
+void FakeBluetoothGattInterface::NotifyScanFilterCfgCallback(
+    int action, int client_if, int status, int filt_type, int avbl_space) {
+  FOR_EACH_OBSERVER(
+      ClientObserver, client_observers_,
+      ScanFilterCfgCallback(this, action, client_if, status, filt_type,
+                            avbl_space));
+}
+
+void FakeBluetoothGattInterface::NotifyScanFilterParamCallback(
+    int action, int client_if, int status, int avbl_space) {
+  FOR_EACH_OBSERVER(
+      ClientObserver, client_observers_,
+      ScanFilterParamCallback(this, action, client_if, status, avbl_space));
+}
+
+void FakeBluetoothGattInterface::NotifyScanFilterStatusCallback(
+    int enable, int client_if, int status) {
+  FOR_EACH_OBSERVER(ClientObserver, client_observers_,
+                    ScanFilterStatusCallback(this, enable, client_if, status));
+}
+
 void FakeBluetoothGattInterface::NotifyMultiAdvEnableCallback(
     int client_if, int status) {
   FOR_EACH_OBSERVER(ClientObserver, client_observers_,
@@ -296,6 +388,35 @@ void FakeBluetoothGattInterface::NotifyMultiAdvDisableCallback(
                     MultiAdvDisableCallback(this, client_if, status));
 }
 
+void FakeBluetoothGattInterface::NotifyBatchscanCfgStorageCallback(
+    int client_if, int status) {
+  FOR_EACH_OBSERVER(ClientObserver, client_observers_,
+                    BatchscanCfgStorageCallback(this, client_if, status));
+}
+
+void FakeBluetoothGattInterface::NotifyBatchscanEnableDisableCallback(
+    int action, int client_if, int status) {
+  FOR_EACH_OBSERVER(
+      ClientObserver, client_observers_,
+      BatchscanEnableDisableCallback(this, action, client_if, status));
+}
+
+void FakeBluetoothGattInterface::NotifyBatchscanReportsCallback(
+    int client_if, int status, int report_format, int num_records,
+    std::vector<uint8_t> rep_data) {
+  FOR_EACH_OBSERVER(
+      ClientObserver, client_observers_,
+      BatchscanReportsCallback(this, client_if, status, report_format,
+                               num_records, rep_data.size(),
+                               rep_data.empty() ? nullptr : rep_data.data()));
+}
+
+void FakeBluetoothGattInterface::NotifyBatchscanThresholdCallback(
+    int client_if) {
+  FOR_EACH_OBSERVER(ClientObserver, client_observers_,
+                    BatchscanThresholdCallback(this, client_if));
+}
+
 void FakeBluetoothGattInterface::NotifyRegisterServerCallback(
     int status, int server_if,
     const bt_uuid_t& app_uuid) {
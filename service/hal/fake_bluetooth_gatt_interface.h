@@ -42,6 +42,17 @@ class FakeBluetoothGattInterface : public BluetoothGattInterface {
     virtual bt_status_t Disconnect(int client_if, const bt_bdaddr_t *bd_addr,
                                    int conn_id) = 0;
 
+    virtual bt_status_t ScanFilterParamSetup(
+        btgatt_filt_param_setup_t filt_param) = 0;
+    virtual bt_status_t ScanFilterAddRemove(
+        int client_if, int action, int filt_type, int filt_index,
+        int company_id, int company_id_mask, const bt_uuid_t* p_uuid,
+        const bt_uuid_t* p_uuid_mask, const bt_bdaddr_t* bd_addr,
+        char addr_type, int data_len, char* p_data, int mask_len,
+        char* p_mask) = 0;
+    virtual bt_status_t ScanFilterClear(int client_if, int filt_index) = 0;
+    virtual bt_status_t ScanFilterEnable(int client_if, bool enable) = 0;
+
     virtual bt_status_t MultiAdvEnable(
         int client_if, int min_interval, int max_interval, int adv_type,
         int chnl_map, int tx_power, int timeout_s) = 0;
@@ -52,6 +63,15 @@ class FakeBluetoothGattInterface : public BluetoothGattInterface {
         int service_data_len, char* service_data,
         int service_uuid_len, char* service_uuid) = 0;
     virtual bt_status_t MultiAdvDisable(int client_if) = 0;
+
+    virtual bt_status_t BatchscanConfigStorage(
+        int client_if, int batch_scan_full_max, int batch_scan_trunc_max,
+        int batch_scan_notify_threshold) = 0;
+    virtual bt_status_t BatchscanEnable(
+        int client_if, int scan_mode, int scan_interval, int scan_window,
+        int addr_type, int discard_rule) = 0;
+    virtual bt_status_t BatchscanDisable(int client_if) = 0;
+    virtual bt_status_t BatchscanReadReports(int client_if, int scan_mode) = 0;
   };
 
   // Handles HAL Bluetooth GATT server API calls for testing. Test code can
@@ -100,9 +120,21 @@ class FakeBluetoothGattInterface : public BluetoothGattInterface {
                                 const bt_bdaddr_t& bda);
   void NotifyScanResultCallback(const bt_bdaddr_t& bda, int rssi,
                                 uint8_t* adv_data);
+  void NotifyScanFilterCfgCallback(int action, int client_if, int status,
+                                   int filt_type, int avbl_space);
+  void NotifyScanFilterParamCallback(int action, int client_if, int status,
+                                     int avbl_space);
+  void NotifyScanFilterStatusCallback(int enable, int client_if, int status);
   void NotifyMultiAdvEnableCallback(int client_if, int status);
   void NotifyMultiAdvDataCallback(int client_if, int status);
   void NotifyMultiAdvDisableCallback(int client_if, int status);
+  void NotifyBatchscanCfgStorageCallback(int client_if, int status);
+  void NotifyBatchscanEnableDisableCallback(int action, int client_if,
+                                            int status);
+  void NotifyBatchscanReportsCallback(int client_if, int status,
+                                      int report_format, int num_records,
+                                      std::vector<uint8_t> rep_data);
+  void NotifyBatchscanThresholdCallback(int client_if);
 
   // Server callbacks:
   void NotifyRegisterServerCallback(int status, int server_if,
@@ -264,6 +264,22 @@ void BluetoothLowEnergyBinderServer::OnScanResult(
   cb->OnScanResult(result);
 }
 
+void BluetoothLowEnergyBinderServer::OnBatchScanResults(
+    bluetooth::LowEnergyClient* client,
+    const std::vector<bluetooth::ScanResult>& results) {
+  VLOG(2) << __func__ << " - count: " << results.size();
+  std::lock_guard<std::mutex> lock(*maps_lock());
+
+  int client_id = client->GetInstanceId();
+  auto cb = GetLECallback(client_id);
+  if (!cb.get()) {
+    VLOG(2) << "Client was unregistered - client_id: " << client_id;
+    return;
+  }
+
+  cb->OnBatchScanResults(results);
+}
+
 android::sp<IBluetoothLowEnergyCallback>
 BluetoothLowEnergyBinderServer::GetLECallback(int client_id) {
   auto cb = GetCallback(client_id);
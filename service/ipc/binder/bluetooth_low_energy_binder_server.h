@@ -69,6 +69,9 @@ class BluetoothLowEnergyBinderServer
                     const char* address, int mtu) override;
   void OnScanResult(bluetooth::LowEnergyClient* client,
                     const bluetooth::ScanResult& result) override;
+  void OnBatchScanResults(
+      bluetooth::LowEnergyClient* client,
+      const std::vector<bluetooth::ScanResult>& results) override;
 
  private:
   // Returns a pointer to the IBluetoothLowEnergyCallback instance associated
@@ -36,6 +36,7 @@
 #include "osi/include/osi.h"
 #include "osi/include/log.h"
 #include "service/adapter.h"
+#include "service/ipc/linux_ipc_protocol.h"
 
 using bluetooth::Adapter;
 using bluetooth::UUID;
@@ -70,12 +71,37 @@ bool TokenBool(const std::string& text) {
   return text == "true";
 }
 
+// Base64 decodes the arguments that the text protocol carries encoded, so
+// that both protocols hand raw values to the handlers.
+void DecodeTextArguments(std::vector<std::string>* tokens) {
+  const std::string& command = (*tokens)[0];
+  std::vector<size_t> encoded;
+
+  if (command == kSetAdapterNameCommand)
+    encoded = {1};
+  else if (command == kSetCharacteristicValueCommand)
+    encoded = {3};
+  else if (command == kSetAdvertisementCommand ||
+           command == kSetScanResponseCommand)
+    encoded = {3, 4};
+
+  for (size_t index : encoded) {
+    if (index >= tokens->size())
+      continue;
+    std::string decoded_data;
+    base::Base64Decode((*tokens)[index], &decoded_data);
+    (*tokens)[index].swap(decoded_data);
+  }
+}
+
 }  // namespace
 
 namespace ipc {
 
 LinuxIPCHost::LinuxIPCHost(int sockfd, Adapter* adapter)
-    : adapter_(adapter), pfds_(1, {sockfd, POLLIN, 0}) {}
+    : adapter_(adapter),
+      pfds_(1, {sockfd, POLLIN, 0}),
+      binary_protocol_(false) {}
 
 LinuxIPCHost::~LinuxIPCHost() {
   close(pfds_[0].fd);
@@ -104,9 +130,7 @@ bool LinuxIPCHost::EventLoop() {
 }
 
 bool LinuxIPCHost::OnSetAdapterName(const std::string& name) {
-  std::string decoded_data;
-  base::Base64Decode(name, &decoded_data);
-  return adapter_->SetName(decoded_data);
+  return adapter_->SetName(name);
 }
 
 bool LinuxIPCHost::OnCreateService(const std::string& service_uuid) {
@@ -172,9 +196,7 @@ bool LinuxIPCHost::OnAddCharacteristic(const std::string& service_uuid,
 bool LinuxIPCHost::OnSetCharacteristicValue(const std::string& service_uuid,
                                     const std::string& characteristic_uuid,
                                     const std::string& value) {
-  std::string decoded_data;
-  base::Base64Decode(value, &decoded_data);
-  std::vector<uint8_t> blob_data(decoded_data.begin(), decoded_data.end());
+  std::vector<uint8_t> blob_data(value.begin(), value.end());
   gatt_servers_[service_uuid]->SetCharacteristicValue(UUID(characteristic_uuid),
                                                       blob_data);
   return true;
@@ -186,7 +208,8 @@ bool LinuxIPCHost::OnSetAdvertisement(const std::string& service_uuid,
                               const std::string& manufacturer_data,
                               const std::string& transmit_name) {
   LOG_INFO(LOG_TAG, "%s: service:%s uuids:%s data:%s", __func__, service_uuid.c_str(),
-           advertise_uuids.c_str(), advertise_data.c_str());
+           advertise_uuids.c_str(),
+           base::HexEncode(advertise_data.data(), advertise_data.size()).c_str());
 
   std::vector<std::string> advertise_uuid_tokens = base::SplitString(
       advertise_uuids, ".", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
@@ -196,14 +219,10 @@ bool LinuxIPCHost::OnSetAdvertisement(const std::string& service_uuid,
   for (const auto& uuid_token : advertise_uuid_tokens)
     ids.emplace_back(uuid_token);
 
-  std::string decoded_data;
-  base::Base64Decode(advertise_data, &decoded_data);
-  std::vector<uint8_t> decoded_advertise_data(decoded_data.begin(),
-                                              decoded_data.end());
-
-  base::Base64Decode(manufacturer_data, &decoded_data);
-  std::vector<uint8_t> decoded_manufacturer_data(decoded_data.begin(),
-                                                 decoded_data.end());
+  std::vector<uint8_t> decoded_advertise_data(advertise_data.begin(),
+                                              advertise_data.end());
+  std::vector<uint8_t> decoded_manufacturer_data(manufacturer_data.begin(),
+                                                 manufacturer_data.end());
 
   gatt_servers_[service_uuid]->SetAdvertisement(ids, decoded_advertise_data,
                                                 decoded_manufacturer_data,
@@ -224,14 +243,10 @@ bool LinuxIPCHost::OnSetScanResponse(const std::string& service_uuid,
   for (const auto& uuid_token : scan_response_uuid_tokens)
     ids.emplace_back(uuid_token);
 
-  std::string decoded_data;
-  base::Base64Decode(scan_response_data, &decoded_data);
-  std::vector<uint8_t> decoded_advertise_data(decoded_data.begin(),
-                                              decoded_data.end());
-
-  base::Base64Decode(manufacturer_data, &decoded_data);
-  std::vector<uint8_t> decoded_manufacturer_data(decoded_data.begin(),
-                                                 decoded_data.end());
+  std::vector<uint8_t> decoded_advertise_data(scan_response_data.begin(),
+                                              scan_response_data.end());
+  std::vector<uint8_t> decoded_manufacturer_data(manufacturer_data.begin(),
+                                                 manufacturer_data.end());
 
   gatt_servers_[service_uuid]->SetScanResponse(ids, decoded_advertise_data,
                                                decoded_manufacturer_data,
@@ -271,8 +286,36 @@ bool LinuxIPCHost::OnMessage() {
     return false;
   }
 
+  if (binary_protocol_) {
+    std::vector<std::vector<std::string>> commands;
+    bool parsed = ParseBinaryFrames(
+        reinterpret_cast<const uint8_t*>(ipc_msg.data()), ipc_msg.size(),
+        &commands);
+    for (const auto& tokens : commands) {
+      if (!OnCommand(tokens))
+        return false;
+    }
+    if (!parsed) {
+      LOG_ERROR(LOG_TAG, "Malformed binary IPC message of %zd bytes", size);
+      return false;
+    }
+    return true;
+  }
+
   std::vector<std::string> tokens = base::SplitString(
       ipc_msg, "|", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+  if (tokens.size() == 2 && tokens[0] == kSetProtocolCommand)
+    return OnSetProtocol(tokens[1]);
+
+  DecodeTextArguments(&tokens);
+  if (OnCommand(tokens))
+    return true;
+
+  LOG_ERROR(LOG_TAG, "Malformed IPC message: %s", ipc_msg.c_str());
+  return false;
+}
+
+bool LinuxIPCHost::OnCommand(const std::vector<std::string>& tokens) {
   switch (tokens.size()) {
     case 2:
       if (tokens[0] == kSetAdapterNameCommand)
@@ -304,11 +347,33 @@ bool LinuxIPCHost::OnMessage() {
       break;
   }
 
-  LOG_ERROR(LOG_TAG, "Malformed IPC message: %s", ipc_msg.c_str());
+  LOG_ERROR(LOG_TAG, "Unknown IPC command %s with %zu arguments",
+            tokens.empty() ? "" : tokens[0].c_str(),
+            tokens.empty() ? 0 : tokens.size() - 1);
   return false;
 }
 
+bool LinuxIPCHost::OnSetProtocol(const std::string& protocol) {
+  if (protocol != kBinaryProtocol) {
+    LOG_ERROR(LOG_TAG, "Unsupported IPC protocol: %s", protocol.c_str());
+    return false;
+  }
+
+  // The acknowledgement is the last text message on this connection.
+  std::string transmit(kSetProtocolCommand);
+  transmit += "|";
+  transmit += kBinaryProtocol;
+  if (!Send(transmit.data(), transmit.size()))
+    return false;
+
+  binary_protocol_ = true;
+  return true;
+}
+
 bool LinuxIPCHost::OnGattWrite() {
+  if (binary_protocol_)
+    return OnGattWriteBinary();
+
   UUID::UUID128Bit id;
   ssize_t r;
 
@@ -321,7 +386,7 @@ bool LinuxIPCHost::OnGattWrite() {
   std::vector<uint8_t> value;
   // TODO(icoolidge): Generalize this for multiple clients.
   auto server = gatt_servers_.begin();
-  server->second->GetCharacteristicValue(UUID(id), &value);
+  GetCharacteristicValue(server->first, UUID(id), &value);
   const std::string value_string(value.begin(), value.end());
   std::string encoded_value;
   base::Base64Encode(value_string, &encoded_value);
@@ -331,7 +396,72 @@ bool LinuxIPCHost::OnGattWrite() {
   transmit += "|" + base::HexEncode(id.data(), id.size());
   transmit += "|" + encoded_value;
 
-  OSI_NO_INTR(r = write(pfds_[kFdIpc].fd, transmit.data(), transmit.size()));
+  return Send(transmit.data(), transmit.size());
+}
+
+bool LinuxIPCHost::OnGattWriteBinary() {
+  UUID::UUID128Bit id;
+  int available = 0;
+
+  // Each notification on the pipe is one ID written atomically, so reading
+  // whole IDs up to what is pending drains them without blocking.
+  if (ioctl(pfds_[kFdGatt].fd, FIONREAD, &available) == -1) {
+    LOG_ERROR(LOG_TAG, "Error sizing GATT pipe: %s", strerror(errno));
+    return false;
+  }
+  size_t count = std::max<size_t>(1, available / id.size());
+
+  std::vector<uint8_t> ids(count * id.size());
+  ssize_t r;
+  OSI_NO_INTR(r = read(pfds_[kFdGatt].fd, ids.data(), ids.size()));
+  if (r <= 0 || r % id.size() != 0) {
+    LOG_ERROR(LOG_TAG, "Error reading GATT attribute ID");
+    return false;
+  }
+  count = r / id.size();
+
+  auto server = gatt_servers_.begin();
+  std::vector<uint8_t> datagram;
+  std::vector<uint8_t> value;
+  for (size_t i = 0; i < count; ++i) {
+    std::copy(ids.begin() + i * id.size(), ids.begin() + (i + 1) * id.size(),
+              id.begin());
+    value.clear();
+    GetCharacteristicValue(server->first, UUID(id), &value);
+
+    std::vector<std::string> fields = {
+      kWriteCharacteristicCommand,
+      server->first,
+      base::HexEncode(id.data(), id.size()),
+      std::string(value.begin(), value.end()),
+    };
+
+    if (!datagram.empty() &&
+        datagram.size() + BinaryFrameSize(fields) > kMaxBinaryDatagramSize) {
+      if (!Send(datagram.data(), datagram.size()))
+        return false;
+      datagram.clear();
+    }
+
+    if (!AppendBinaryFrame(fields, &datagram)) {
+      LOG_ERROR(LOG_TAG, "Characteristic value of %zu bytes is too long",
+                value.size());
+      return false;
+    }
+  }
+
+  return Send(datagram.data(), datagram.size());
+}
+
+bool LinuxIPCHost::GetCharacteristicValue(const std::string& service_uuid,
+                                          const UUID& id,
+                                          std::vector<uint8_t>* value) {
+  return gatt_servers_[service_uuid]->GetCharacteristicValue(id, value);
+}
+
+bool LinuxIPCHost::Send(const void* data, size_t size) {
+  ssize_t r;
+  OSI_NO_INTR(r = write(pfds_[kFdIpc].fd, data, size));
   if (-1 == r) {
     LOG_ERROR(LOG_TAG, "Error replying to IPC: %s", strerror(errno));
     return false;
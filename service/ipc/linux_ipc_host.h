@@ -20,6 +20,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "service/common/bluetooth/uuid.h"
 #include "service/gatt_server_old.h"
@@ -38,20 +39,44 @@ class LinuxIPCHost {
  public:
   // LinuxIPCHost owns the passed sockfd.
   LinuxIPCHost(int sockfd, bluetooth::Adapter* adapter);
-  ~LinuxIPCHost();
+  virtual ~LinuxIPCHost();
 
   // Synchronously handle all events on input FDs.
   bool EventLoop();
 
+ protected:
+  // Reads the value of characteristic |id| of the GATT server for
+  // |service_uuid|. Virtual so that tests can run the host without a GATT
+  // server.
+  virtual bool GetCharacteristicValue(const std::string& service_uuid,
+                                      const bluetooth::UUID& id,
+                                      std::vector<uint8_t>* value);
+
  private:
+  friend class LinuxIPCHostTest;
+
   // Handler for IPC message receives.
   // Decodes protocol and dispatches to another handler.
   bool OnMessage();
 
+  // Dispatches one decoded command to its handler. |tokens| holds the
+  // command name followed by its arguments, with values already decoded.
+  bool OnCommand(const std::vector<std::string>& tokens);
+
+  // Switches the connection to the binary protocol.
+  bool OnSetProtocol(const std::string& protocol);
+
   // Handler for GATT characteristic writes.
   // Encodes to protocol and transmits IPC.
   bool OnGattWrite();
 
+  // Sends all characteristic writes pending on the GATT pipe, batched into
+  // as few binary datagrams as possible.
+  bool OnGattWriteBinary();
+
+  // Transmits one datagram on the IPC socket.
+  bool Send(const void* data, size_t size);
+
   // Applies adapter name changes to stack.
   bool OnSetAdapterName(const std::string& name);
 
@@ -98,6 +123,10 @@ class LinuxIPCHost {
   // File descripters that we will block against.
   std::vector<struct pollfd> pfds_;
 
+  // Whether the client negotiated the binary protocol, see
+  // linux_ipc_protocol.h.
+  bool binary_protocol_;
+
   // Container for multiple GATT servers. Currently only one is supported.
   // TODO(icoolidge): support many to one for real.
   std::unordered_map<std::string, std::unique_ptr<bluetooth::gatt::Server>>
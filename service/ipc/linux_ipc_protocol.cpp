@@ -0,0 +1,99 @@
+//
+//  Copyright (C) 2016 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "service/ipc/linux_ipc_protocol.h"
+
+#include <utility>
+
+namespace {
+
+const size_t kLengthSize = 2;
+const size_t kFieldCountSize = 1;
+const size_t kMaxFieldCount = UINT8_MAX;
+const size_t kMaxLength = UINT16_MAX;
+
+void AppendLength(size_t length, std::vector<uint8_t>* datagram) {
+  datagram->push_back(length & 0xff);
+  datagram->push_back((length >> 8) & 0xff);
+}
+
+size_t ReadLength(const uint8_t* data) {
+  return data[0] | (data[1] << 8);
+}
+
+}  // namespace
+
+namespace ipc {
+
+size_t BinaryFrameSize(const std::vector<std::string>& fields) {
+  size_t size = kLengthSize + kFieldCountSize;
+  for (const auto& field : fields)
+    size += kLengthSize + field.size();
+  return size;
+}
+
+bool AppendBinaryFrame(const std::vector<std::string>& fields,
+                       std::vector<uint8_t>* datagram) {
+  size_t length = BinaryFrameSize(fields) - kLengthSize;
+  if (fields.size() > kMaxFieldCount || length > kMaxLength)
+    return false;
+
+  datagram->reserve(datagram->size() + kLengthSize + length);
+  AppendLength(length, datagram);
+  datagram->push_back(fields.size());
+  for (const auto& field : fields) {
+    AppendLength(field.size(), datagram);
+    datagram->insert(datagram->end(), field.begin(), field.end());
+  }
+  return true;
+}
+
+bool ParseBinaryFrames(const uint8_t* data, size_t size,
+                       std::vector<std::vector<std::string>>* frames) {
+  const uint8_t* end = data + size;
+
+  while (data < end) {
+    if (end - data < static_cast<ptrdiff_t>(kLengthSize + kFieldCountSize))
+      return false;
+
+    const uint8_t* frame_end = data + kLengthSize + ReadLength(data);
+    if (frame_end > end)
+      return false;
+    data += kLengthSize;
+
+    size_t field_count = *data++;
+    std::vector<std::string> fields;
+    fields.reserve(field_count);
+    for (size_t i = 0; i < field_count; ++i) {
+      if (frame_end - data < static_cast<ptrdiff_t>(kLengthSize))
+        return false;
+      size_t field_length = ReadLength(data);
+      data += kLengthSize;
+      if (frame_end - data < static_cast<ptrdiff_t>(field_length))
+        return false;
+      fields.emplace_back(reinterpret_cast<const char*>(data), field_length);
+      data += field_length;
+    }
+
+    if (data != frame_end)
+      return false;
+    frames->push_back(std::move(fields));
+  }
+
+  return true;
+}
+
+}  // namespace ipc
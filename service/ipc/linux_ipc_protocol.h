@@ -0,0 +1,62 @@
+//
+//  Copyright (C) 2016 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace ipc {
+
+// Binary framing for the Linux IPC socket.
+//
+// The text protocol carries one "|" separated command per datagram and
+// base64 encodes binary values. A client switches its connection to binary
+// framing by sending the text message "set-protocol|binary". The host
+// replies with the same message and from then on every datagram in either
+// direction holds one or more frames:
+//
+//   uint16 length            Bytes that follow in this frame, little endian.
+//   uint8  field_count
+//   field_count times:
+//     uint16 field_length    Little endian.
+//     uint8  field[field_length]
+//
+// Field 0 is the command name of the text protocol and the others are its
+// arguments in the same order, with values carried as raw bytes.
+
+const char kSetProtocolCommand[] = "set-protocol";
+const char kBinaryProtocol[] = "binary";
+
+// The host keeps the datagrams it sends below this size.
+const size_t kMaxBinaryDatagramSize = 16384;
+
+// Returns the number of bytes |fields| take up as a frame.
+size_t BinaryFrameSize(const std::vector<std::string>& fields);
+
+// Appends a frame holding |fields| to |datagram|. Returns false if there
+// are too many fields or they are too long to fit into one frame.
+bool AppendBinaryFrame(const std::vector<std::string>& fields,
+                       std::vector<uint8_t>* datagram);
+
+// Appends the fields of each frame in |data| to |frames|. Returns false if
+// a frame is malformed; frames before it are still appended.
+bool ParseBinaryFrames(const uint8_t* data, size_t size,
+                       std::vector<std::vector<std::string>>* frames);
+
+}  // namespace ipc
@@ -16,6 +16,11 @@
 
 #include "service/low_energy_client.h"
 
+#include <strings.h>
+
+#include <algorithm>
+#include <utility>
+
 #include <base/logging.h>
 
 #include "service/adapter.h"
@@ -37,6 +42,80 @@ namespace {
 // can support advertising length extensions in the future.
 const size_t kScanRecordLength = 62;
 
+// Batches are delivered once they reach this many results even if the scan
+// settings would have them wait longer, which bounds the memory a single
+// batch can take up.
+const size_t kMaxScanBatchSize = 1024;
+
+// Batch scan modes of the HAL batch scan API, which double as the formats of
+// the reports read back. Truncated records only hold the address, RSSI and a
+// timestamp; full records add the advertising data and scan response.
+const int kBatchScanModeTruncated = 1;
+const int kBatchScanModeFull = 2;
+
+// Action reported by the batch scan enable/disable callback on enable.
+const int kBatchScanActionEnable = 1;
+
+// Have the controller drop the oldest results once its storage is full.
+const int kBatchScanDiscardOldest = 0;
+
+// The controller reports that its storage is this full, in percent, so that
+// the results can be read before any get dropped.
+const int kBatchScanNotifyThreshold = 95;
+
+// Size of the record header common to both batch scan report formats:
+// address, address type, TX power, RSSI and timestamp.
+const size_t kBatchScanRecordHeaderSize = 11;
+
+// The controller has a single batch scan storage. This is the client using
+// it, or kNoBatchScanClient.
+const int kNoBatchScanClient = -1;
+std::atomic_int g_batch_scan_client(kNoBatchScanClient);
+
+// Converts |ms| to the 0.625 ms units of scan intervals and windows.
+int MsToScanUnits(int ms) {
+  return ms * 8 / 5;
+}
+
+// Appends the |num_records| results of the batch scan report |data| in
+// |report_format| to |scan_results|. Returns false if the report is
+// malformed; results before the malformed record are still appended.
+bool ParseBatchScanReport(int report_format, int num_records,
+                          const uint8_t* data, size_t data_len,
+                          std::vector<ScanResult>* scan_results) {
+  const uint8_t* end = data + data_len;
+  scan_results->reserve(scan_results->size() + num_records);
+
+  for (int i = 0; i < num_records; ++i) {
+    if (static_cast<size_t>(end - data) < kBatchScanRecordHeaderSize)
+      return false;
+
+    // The controller sends the address least significant byte first.
+    bt_bdaddr_t bda;
+    std::reverse_copy(data, data + sizeof(bda.address), bda.address);
+    int rssi = static_cast<int8_t>(data[8]);
+    data += kBatchScanRecordHeaderSize;
+
+    // Full records go on with the advertising data and then the scan
+    // response, each preceded by its length.
+    std::vector<uint8_t> scan_record;
+    for (int j = 0; report_format == kBatchScanModeFull && j < 2; ++j) {
+      if (data == end)
+        return false;
+      size_t length = *data++;
+      if (static_cast<size_t>(end - data) < length)
+        return false;
+      scan_record.insert(scan_record.end(), data, data + length);
+      data += length;
+    }
+
+    scan_results->emplace_back(BtAddrString(&bda), std::move(scan_record),
+                               rssi);
+  }
+
+  return true;
+}
+
 BLEStatus GetBLEStatus(int status) {
   if (status == BT_STATUS_FAIL)
     return BLE_STATUS_FAILURE;
@@ -302,9 +381,18 @@ void GetAdvertiseParams(const AdvertiseSettings& settings, bool has_scan_rsp,
 // LowEnergyClient implementation
 // ========================================================
 
+void LowEnergyClient::Delegate::OnBatchScanResults(
+    LowEnergyClient* client,
+    const std::vector<ScanResult>& scan_results) {
+  for (const auto& scan_result : scan_results)
+    OnScanResult(client, scan_result);
+}
+
 LowEnergyClient::LowEnergyClient(
-    Adapter& adapter, const UUID& uuid, int client_id)
+    Adapter& adapter, const UUID& uuid, int client_id,
+    ScanFilterManager& scan_filter_manager)
     : adapter_(adapter),
+      scan_filter_manager_(scan_filter_manager),
       app_identifier_(uuid),
       client_id_(client_id),
       adv_data_needs_update_(false),
@@ -313,7 +401,9 @@ LowEnergyClient::LowEnergyClient(
       adv_started_(false),
       adv_start_callback_(nullptr),
       adv_stop_callback_(nullptr),
-      scan_started_(false) {
+      scan_started_(false),
+      controller_batch_mode_(0),
+      scan_batch_thread_stop_(false) {
 }
 
 LowEnergyClient::~LowEnergyClient() {
@@ -332,6 +422,7 @@ LowEnergyClient::~LowEnergyClient() {
   // Stop any scans started by this client.
   if (scan_started_.load())
     StopScan();
+  StopScanBatchThread();
 }
 
 bool LowEnergyClient::Connect(std::string address, bool is_direct) {
@@ -419,32 +510,80 @@ bool LowEnergyClient::StartScan(const ScanSettings& settings,
     return false;
   }
 
-  // TODO(jpawlowski): Push settings and filtering logic below the HAL.
-  bt_status_t status = hal::BluetoothGattInterface::Get()->
-      StartScan(client_id_);
-  if (status != BT_STATUS_SUCCESS) {
-    LOG(ERROR) << "Failed to initiate scanning for client: " << client_id_;
+  // Restart from a clean state so that the new settings apply to all results
+  // from here on.
+  if (scan_started_.load() && !StopScan())
     return false;
+
+  {
+    lock_guard<mutex> lock(scan_fields_lock_);
+    scan_settings_ = settings;
+    scan_filters_ = filters;
+  }
+
+  bool try_controller_batching =
+      settings.report_delay() > base::TimeDelta() &&
+      adapter_.IsOffloadedScanBatchingSupported();
+
+  // Set up the controller's filters before results start to come in. This
+  // has to happen before batching is set up, as that may fall back to host
+  // batching and change the filters again.
+  hal::BluetoothGattInterface* gatt_iface = hal::BluetoothGattInterface::Get();
+  scan_filter_manager_.SetClientFilters(gatt_iface, client_id_, filters,
+                                        try_controller_batching);
+
+  bool controller_batching =
+      try_controller_batching && StartControllerBatchScan(settings);
+
+  if (!controller_batching) {
+    if (try_controller_batching) {
+      scan_filter_manager_.SetClientFilters(gatt_iface, client_id_, filters,
+                                            false);
+    }
+
+    // TODO(jpawlowski): Push settings below the HAL.
+    bt_status_t status = gatt_iface->StartScan(client_id_);
+    if (status != BT_STATUS_SUCCESS) {
+      LOG(ERROR) << "Failed to initiate scanning for client: " << client_id_;
+      scan_filter_manager_.RemoveClientFilters(gatt_iface, client_id_);
+      return false;
+    }
   }
 
   scan_started_ = true;
+
+  if (settings.report_delay() > base::TimeDelta()) {
+    scan_batch_thread_stop_ = false;
+    scan_batch_thread_ = std::thread(
+        &LowEnergyClient::ScanBatchThreadMain, this,
+        std::chrono::milliseconds(settings.report_delay().InMilliseconds()));
+  }
+
   return true;
 }
 
 bool LowEnergyClient::StopScan() {
   VLOG(2) << __func__;
 
-  // TODO(armansito): We don't support batch scanning yet so call
-  // StopRegularScanForClient directly. In the future we will need to
-  // conditionally call a batch scan API here.
-  bt_status_t status = hal::BluetoothGattInterface::Get()->
-      StopScan(client_id_);
-  if (status != BT_STATUS_SUCCESS) {
-    LOG(ERROR) << "Failed to stop scan for client: " << client_id_;
-    return false;
+  if (controller_batch_mode_.load()) {
+    if (!StopControllerBatchScan())
+      return false;
+  } else {
+    bt_status_t status = hal::BluetoothGattInterface::Get()->
+        StopScan(client_id_);
+    if (status != BT_STATUS_SUCCESS) {
+      LOG(ERROR) << "Failed to stop scan for client: " << client_id_;
+      return false;
+    }
   }
 
   scan_started_ = false;
+  scan_filter_manager_.RemoveClientFilters(
+      hal::BluetoothGattInterface::Get(), client_id_);
+
+  StopScanBatchThread();
+  FlushScanResults();
+
   return true;
 }
 
@@ -569,18 +708,290 @@ void LowEnergyClient::ScanResultCallback(
   if (!scan_started_.load())
     return;
 
-  lock_guard<mutex> lock(delegate_mutex_);
-  if (!delegate_)
+  size_t record_len = GetScanRecordLength(adv_data);
+  ScanResult result(BtAddrString(&bda),
+                    std::vector<uint8_t>(adv_data, adv_data + record_len),
+                    rssi);
+
+  bool batched;
+  size_t batch_size;
+  {
+    lock_guard<mutex> lock(scan_fields_lock_);
+    if (!MatchesScanFilters(result, false))
+      return;
+
+    batched = scan_settings_.IsBatched();
+    batch_size = scan_settings_.report_batch_size();
+  }
+
+  if (!batched) {
+    lock_guard<mutex> lock(delegate_mutex_);
+    if (delegate_)
+      delegate_->OnScanResult(this, result);
     return;
+  }
 
-  // TODO(armansito): Apply software filters here.
+  // Without a batch size the report delay decides when results go out.
+  size_t flush_size = kMaxScanBatchSize;
+  if (batch_size > 1)
+    flush_size = std::min(batch_size, kMaxScanBatchSize);
 
-  size_t record_len = GetScanRecordLength(adv_data);
-  std::vector<uint8_t> scan_record(adv_data, adv_data + record_len);
+  bool flush;
+  {
+    lock_guard<mutex> lock(scan_batch_lock_);
+    scan_batch_.push_back(std::move(result));
+    flush = scan_batch_.size() >= flush_size;
+  }
+
+  if (flush)
+    FlushScanResults();
+}
+
+void LowEnergyClient::BatchscanCfgStorageCallback(
+    hal::BluetoothGattInterface* gatt_iface,
+    int client_id, int status) {
+  if (client_id != client_id_)
+    return;
 
-  ScanResult result(BtAddrString(&bda), scan_record, rssi);
+  int mode = controller_batch_mode_.load();
+  if (!mode)
+    return;
+
+  if (status != BT_STATUS_SUCCESS) {
+    LOG(ERROR) << "Failed to configure batch scan storage: " << status;
+    FallBackToHostBatching(gatt_iface);
+    return;
+  }
 
-  delegate_->OnScanResult(this, result);
+  ScanSettings::Mode scan_mode;
+  {
+    lock_guard<mutex> lock(scan_fields_lock_);
+    scan_mode = scan_settings_.mode();
+  }
+
+  // The controller scans for a window of 1.5 s, less often the lower the
+  // power the scan settings ask for.
+  const int window_ms = 1500;
+  int interval_ms = 150000;
+  if (scan_mode == ScanSettings::MODE_BALANCED)
+    interval_ms = 15000;
+  else if (scan_mode == ScanSettings::MODE_LOW_LATENCY)
+    interval_ms = 5000;
+
+  bt_status_t hal_status =
+      gatt_iface->GetClientHALInterface()->batchscan_enb_batch_scan(
+          client_id_, mode, MsToScanUnits(interval_ms),
+          MsToScanUnits(window_ms), BLE_ADDR_PUBLIC, kBatchScanDiscardOldest);
+  if (hal_status != BT_STATUS_SUCCESS) {
+    LOG(ERROR) << "Failed to enable batch scan for client: " << client_id_;
+    FallBackToHostBatching(gatt_iface);
+  }
+}
+
+void LowEnergyClient::BatchscanEnableDisableCallback(
+    hal::BluetoothGattInterface* gatt_iface,
+    int action, int client_id, int status) {
+  if (client_id != client_id_)
+    return;
+
+  VLOG(1) << __func__ << " action: " << action << " status: " << status;
+
+  if (action == kBatchScanActionEnable && status != BT_STATUS_SUCCESS) {
+    LOG(ERROR) << "Failed to enable batch scan: " << status;
+    FallBackToHostBatching(gatt_iface);
+  }
+}
+
+void LowEnergyClient::BatchscanReportsCallback(
+    hal::BluetoothGattInterface* gatt_iface,
+    int client_id, int status, int report_format,
+    int num_records, int data_len, uint8_t* rep_data) {
+  // Reports can still come in after StopScan, which reads out whatever the
+  // controller has left.
+  if (client_id != client_id_)
+    return;
+
+  if (status != BT_STATUS_SUCCESS) {
+    LOG(ERROR) << "Failed to read batch scan reports: " << status;
+    return;
+  }
+
+  if (num_records <= 0 || data_len <= 0 || !rep_data)
+    return;
+
+  std::vector<ScanResult> results;
+  if (!ParseBatchScanReport(report_format, num_records, rep_data, data_len,
+                            &results))
+    LOG(WARNING) << "Dropping malformed records of batch scan report";
+
+  VLOG(2) << __func__ << " - " << results.size() << " results";
+
+  {
+    lock_guard<mutex> lock(scan_fields_lock_);
+    lock_guard<mutex> batch_lock(scan_batch_lock_);
+    bool truncated = report_format == kBatchScanModeTruncated;
+    for (auto& result : results) {
+      if (MatchesScanFilters(result, truncated))
+        scan_batch_.push_back(std::move(result));
+    }
+  }
+
+  FlushScanResults();
+}
+
+void LowEnergyClient::BatchscanThresholdCallback(
+    hal::BluetoothGattInterface* gatt_iface,
+    int client_id) {
+  if (client_id != client_id_)
+    return;
+
+  ReadControllerBatchScanReports(gatt_iface);
+}
+
+bool LowEnergyClient::MatchesScanFilters(const ScanResult& scan_result,
+                                         bool truncated) const {
+  if (scan_filters_.empty())
+    return true;
+
+  for (const auto& filter : scan_filters_) {
+    // Truncated results carry no advertising data, leaving the address as
+    // the only thing to filter on.
+    if (!truncated && filter.Matches(scan_result))
+      return true;
+    if (truncated &&
+        (filter.device_address().empty() ||
+         strcasecmp(filter.device_address().c_str(),
+                    scan_result.device_address().c_str()) == 0))
+      return true;
+  }
+
+  return false;
+}
+
+bool LowEnergyClient::StartControllerBatchScan(const ScanSettings& settings) {
+  int owner = kNoBatchScanClient;
+  if (!g_batch_scan_client.compare_exchange_strong(owner, client_id_)) {
+    VLOG(1) << "Controller batch scan in use by client: " << owner;
+    return false;
+  }
+
+  int mode = kBatchScanModeFull;
+  if (settings.result_type() == ScanSettings::RESULT_TYPE_ABBREVIATED)
+    mode = kBatchScanModeTruncated;
+  controller_batch_mode_ = mode;
+
+  // All of the storage goes to the format in use. Scanning is enabled once
+  // the storage is set up, see BatchscanCfgStorageCallback.
+  int full_max = mode == kBatchScanModeFull ? 100 : 0;
+  bt_status_t status = hal::BluetoothGattInterface::Get()->
+      GetClientHALInterface()->batchscan_cfg_storage(
+          client_id_, full_max, 100 - full_max, kBatchScanNotifyThreshold);
+  if (status != BT_STATUS_SUCCESS) {
+    LOG(ERROR) << "Failed to configure batch scan for client: " << client_id_;
+    controller_batch_mode_ = 0;
+    g_batch_scan_client = kNoBatchScanClient;
+    return false;
+  }
+
+  return true;
+}
+
+bool LowEnergyClient::StopControllerBatchScan() {
+  hal::BluetoothGattInterface* gatt_iface = hal::BluetoothGattInterface::Get();
+
+  // The stack runs these in order, so the results still in storage are read
+  // out before scanning stops.
+  ReadControllerBatchScanReports(gatt_iface);
+
+  bt_status_t status =
+      gatt_iface->GetClientHALInterface()->batchscan_dis_batch_scan(client_id_);
+  if (status != BT_STATUS_SUCCESS) {
+    LOG(ERROR) << "Failed to stop batch scan for client: " << client_id_;
+    return false;
+  }
+
+  controller_batch_mode_ = 0;
+  g_batch_scan_client = kNoBatchScanClient;
+  return true;
+}
+
+void LowEnergyClient::ReadControllerBatchScanReports(
+    hal::BluetoothGattInterface* gatt_iface) {
+  int mode = controller_batch_mode_.load();
+  if (!mode)
+    return;
+
+  bt_status_t status =
+      gatt_iface->GetClientHALInterface()->batchscan_read_reports(
+          client_id_, mode);
+  if (status != BT_STATUS_SUCCESS)
+    LOG(ERROR) << "Failed to read batch scan reports for client: " << client_id_;
+}
+
+void LowEnergyClient::FallBackToHostBatching(
+    hal::BluetoothGattInterface* gatt_iface) {
+  if (!controller_batch_mode_.exchange(0))
+    return;
+  g_batch_scan_client = kNoBatchScanClient;
+
+  LOG(WARNING) << "Batching scan results in the daemon for client: "
+               << client_id_;
+
+  // Results now come from the filters for immediate delivery.
+  std::vector<ScanFilter> filters;
+  {
+    lock_guard<mutex> lock(scan_fields_lock_);
+    filters = scan_filters_;
+  }
+  scan_filter_manager_.SetClientFilters(gatt_iface, client_id_, filters,
+                                        false);
+
+  if (gatt_iface->StartScan(client_id_) != BT_STATUS_SUCCESS)
+    LOG(ERROR) << "Failed to initiate scanning for client: " << client_id_;
+}
+
+void LowEnergyClient::FlushScanResults() {
+  // |delegate_mutex_| is held across the swap so that batches are delivered
+  // in the order they were collected.
+  lock_guard<mutex> lock(delegate_mutex_);
+  {
+    lock_guard<mutex> batch_lock(scan_batch_lock_);
+    if (scan_batch_.empty())
+      return;
+    scan_batch_.swap(scan_batch_delivered_);
+  }
+
+  if (delegate_)
+    delegate_->OnBatchScanResults(this, scan_batch_delivered_);
+
+  // Keeps the capacity for the batch after next.
+  scan_batch_delivered_.clear();
+}
+
+void LowEnergyClient::ScanBatchThreadMain(
+    std::chrono::milliseconds report_delay) {
+  std::unique_lock<mutex> lock(scan_batch_lock_);
+  while (!scan_batch_thread_wakeup_.wait_for(
+      lock, report_delay, [this] { return scan_batch_thread_stop_; })) {
+    lock.unlock();
+    if (controller_batch_mode_.load())
+      ReadControllerBatchScanReports(hal::BluetoothGattInterface::Get());
+    else
+      FlushScanResults();
+    lock.lock();
+  }
+}
+
+void LowEnergyClient::StopScanBatchThread() {
+  if (!scan_batch_thread_.joinable())
+    return;
+
+  {
+    lock_guard<mutex> lock(scan_batch_lock_);
+    scan_batch_thread_stop_ = true;
+  }
+  scan_batch_thread_wakeup_.notify_one();
+  scan_batch_thread_.join();
 }
 
 void LowEnergyClient::ConnectCallback(
@@ -828,7 +1239,8 @@ void LowEnergyClient::InvokeAndClearStopCallback(BLEStatus status) {
 // ========================================================
 
 LowEnergyClientFactory::LowEnergyClientFactory(Adapter& adapter)
-    : adapter_(adapter) {
+    : adapter_(adapter),
+      scan_filter_manager_(adapter) {
   hal::BluetoothGattInterface::Get()->AddClientObserver(this);
 }
 
@@ -879,7 +1291,8 @@ void LowEnergyClientFactory::RegisterClientCallback(
   std::unique_ptr<LowEnergyClient> client;
   BLEStatus result = BLE_STATUS_FAILURE;
   if (status == BT_STATUS_SUCCESS) {
-    client.reset(new LowEnergyClient(adapter_, uuid, client_id));
+    client.reset(new LowEnergyClient(adapter_, uuid, client_id,
+                                     scan_filter_manager_));
 
     gatt_iface->AddClientObserver(client.get());
 
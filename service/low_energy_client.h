@@ -17,9 +17,13 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <map>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include <base/macros.h>
 
@@ -32,6 +36,7 @@
 #include "service/common/bluetooth/scan_settings.h"
 #include "service/common/bluetooth/uuid.h"
 #include "service/hal/bluetooth_gatt_interface.h"
+#include "service/scan_filter_manager.h"
 
 namespace bluetooth {
 
@@ -61,6 +66,13 @@ class LowEnergyClient : private hal::BluetoothGattInterface::ClientObserver,
     virtual void OnScanResult(LowEnergyClient* client,
                               const ScanResult& scan_result) = 0;
 
+    // Called asynchronously with the scan results found since the previous
+    // batch, when the scan settings ask for batched delivery. See
+    // ScanSettings::IsBatched(). By default each result is passed on to
+    // OnScanResult.
+    virtual void OnBatchScanResults(LowEnergyClient* client,
+                                    const std::vector<ScanResult>& scan_results);
+
     // Called asynchronously to notify the delegate of connection state change
     virtual void OnConnectionState(LowEnergyClient* client, int status,
                                    const char* address, bool connected) = 0;
@@ -99,12 +111,25 @@ class LowEnergyClient : private hal::BluetoothGattInterface::ClientObserver,
 
   // Initiates a BLE device scan for this client using the given |settings| and
   // |filters|. See the documentation for ScanSettings and ScanFilter for how
-  // these parameters can be configured. Return true on success, false
-  // otherwise. Please see logs for details in case of error.
+  // these parameters can be configured. Results that match none of |filters|
+  // are dropped, if possible already by the controller; if |filters| is empty
+  // all results are reported. Return true on success, false otherwise. Please
+  // see logs for details in case of error.
+  //
+  // If |settings| has a report delay and the controller supports it, results
+  // are collected in controller storage and read out in bulk once the storage
+  // fills up or the report delay passes, rather than waking up the host for
+  // every advertisement. RESULT_TYPE_ABBREVIATED then reports only address
+  // and RSSI, which takes less storage; those results can only be filtered by
+  // device address. Only one client at a time can batch in the controller,
+  // others fall back to batching in the daemon.
   bool StartScan(const ScanSettings& settings,
                  const std::vector<ScanFilter>& filters);
 
-  // Stops an ongoing BLE device scan for this client.
+  // Stops an ongoing BLE device scan for this client. Results still waiting
+  // for their batch are handed to the delegate before this returns, except
+  // for results in controller storage, which follow once the controller has
+  // reported them. This must not be called from within a Delegate callback.
   bool StopScan();
 
   // Starts advertising based on the given advertising and scan response
@@ -144,7 +169,8 @@ class LowEnergyClient : private hal::BluetoothGattInterface::ClientObserver,
 
   // Constructor shouldn't be called directly as instances are meant to be
   // obtained from the factory.
-  LowEnergyClient(Adapter& adapter, const UUID& uuid, int client_id);
+  LowEnergyClient(Adapter& adapter, const UUID& uuid, int client_id,
+                  ScanFilterManager& scan_filter_manager);
 
   // BluetoothGattInterface::ClientObserver overrides:
   void ScanResultCallback(
@@ -169,6 +195,19 @@ class LowEnergyClient : private hal::BluetoothGattInterface::ClientObserver,
   void MultiAdvDisableCallback(
       hal::BluetoothGattInterface* gatt_iface,
       int client_id, int status) override;
+  void BatchscanCfgStorageCallback(
+      hal::BluetoothGattInterface* gatt_iface,
+      int client_id, int status) override;
+  void BatchscanEnableDisableCallback(
+      hal::BluetoothGattInterface* gatt_iface,
+      int action, int client_id, int status) override;
+  void BatchscanReportsCallback(
+      hal::BluetoothGattInterface* gatt_iface,
+      int client_id, int status, int report_format,
+      int num_records, int data_len, uint8_t* rep_data) override;
+  void BatchscanThresholdCallback(
+      hal::BluetoothGattInterface* gatt_iface,
+      int client_id) override;
 
   // Helper method called from SetAdvertiseData/SetScanResponse.
   bt_status_t SetAdvertiseData(
@@ -185,9 +224,39 @@ class LowEnergyClient : private hal::BluetoothGattInterface::ClientObserver,
   void InvokeAndClearStartCallback(BLEStatus status);
   void InvokeAndClearStopCallback(BLEStatus status);
 
+  // Hands the pending batch of scan results to the delegate.
+  void FlushScanResults();
+
+  // Returns true if |scan_result| passes the filters of the current scan.
+  // Requires |scan_fields_lock_|.
+  bool MatchesScanFilters(const ScanResult& scan_result,
+                          bool truncated) const;
+
+  // Starts and stops scanning with results batched in controller storage.
+  bool StartControllerBatchScan(const ScanSettings& settings);
+  bool StopControllerBatchScan();
+
+  // Asks the controller for the results it has stored so far.
+  void ReadControllerBatchScanReports(hal::BluetoothGattInterface* gatt_iface);
+
+  // Switches a scan whose controller batch scan failed to set up over to a
+  // regular scan batched in the daemon.
+  void FallBackToHostBatching(hal::BluetoothGattInterface* gatt_iface);
+
+  // Body of |scan_batch_thread_|, which flushes the pending batch, or reads
+  // the controller's, every report delay until the scan stops.
+  void ScanBatchThreadMain(std::chrono::milliseconds report_delay);
+
+  // Stops |scan_batch_thread_| if it is running.
+  void StopScanBatchThread();
+
   // Raw pointer to the Bluetooth Adapter.
   Adapter& adapter_;
 
+  // Programs the filters of this client's scans into the controller. Owned by
+  // the factory.
+  ScanFilterManager& scan_filter_manager_;
+
   // See getters above for documentation.
   UUID app_identifier_;
   int client_id_;
@@ -219,9 +288,32 @@ class LowEnergyClient : private hal::BluetoothGattInterface::ClientObserver,
   // Current scan settings.
   ScanSettings scan_settings_;
 
+  // Filters applied to scan results of the current scan.
+  std::vector<ScanFilter> scan_filters_;
+
   // If true, then this client have a BLE device scan in progress.
   std::atomic_bool scan_started_;
 
+  // The HAL batch scan mode while results of this client's scan are batched
+  // in the controller, 0 otherwise.
+  std::atomic_int controller_batch_mode_;
+
+  // Protects the pending scan results below.
+  std::mutex scan_batch_lock_;
+
+  // Results collected for the next batch. Together with
+  // |scan_batch_delivered_| this double buffers the batches so that their
+  // storage is reused instead of reallocated for every batch.
+  std::vector<ScanResult> scan_batch_;
+
+  // The batch being handed to the delegate. Guarded by |delegate_mutex_|.
+  std::vector<ScanResult> scan_batch_delivered_;
+
+  // Flushes batches on the report delay while a batched scan is running.
+  std::thread scan_batch_thread_;
+  std::condition_variable scan_batch_thread_wakeup_;
+  bool scan_batch_thread_stop_;
+
   // Raw handle to the Delegate, which must outlive this LowEnergyClient
   // instance.
   std::mutex delegate_mutex_;
@@ -270,6 +362,9 @@ class LowEnergyClientFactory
   // Raw pointer to the Adapter that owns this factory.
   Adapter& adapter_;
 
+  // Shared by all clients, as the controller's filters are.
+  ScanFilterManager scan_filter_manager_;
+
   DISALLOW_COPY_AND_ASSIGN(LowEnergyClientFactory);
 };
 
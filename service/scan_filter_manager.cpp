@@ -0,0 +1,634 @@
+//
+//  Copyright (C) 2016 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "service/scan_filter_manager.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <climits>
+#include <tuple>
+
+#include <base/logging.h>
+
+#include "service/adapter.h"
+#include "service/common/bluetooth/util/address_helper.h"
+
+using std::lock_guard;
+using std::mutex;
+
+namespace bluetooth {
+
+namespace {
+
+// Condition types of the HAL scan filter API, see BTM_BLE_PF_* in the stack.
+// A filter index selects the types it checks with the bit (1 << type).
+const int kFilterTypeAddress = 0;
+const int kFilterTypeServiceUuid = 2;
+const int kFilterTypeLocalName = 4;
+
+// Passed to ReportFailure when the controller is out of filter indices.
+const int kFilterIndexType = -1;
+
+// Actions of the HAL scan filter API.
+const int kActionAdd = 0;
+const int kActionDelete = 1;
+
+// Whether a filter index reports what passes right away as scan results or
+// stores it for batch scan reports.
+const int kDeliveryModeImmediate = 0;
+const int kDeliveryModeBatch = 2;
+
+// Conditions of the same type are OR'ed, different types are AND'ed.
+const int kListLogicOr = 0;
+const int kFilterLogicAnd = 1;
+
+const int kRssiThresholdNone = -128;
+
+// Matches the device address whether it is public or random.
+const char kAddressTypeAny = 2;
+
+// The controller matches local names of up to this many bytes.
+const size_t kMaxLocalNameLength = 29;
+
+// The stack keeps filter index 0 for itself.
+const int kFirstFilterIndex = 1;
+
+// The condition types a filter that doesn't fit keeps, most selective first.
+const int kRelaxOrder[] = {
+  kFilterTypeAddress, kFilterTypeServiceUuid, kFilterTypeLocalName
+};
+
+}  // namespace
+
+bool ScanFilterManager::Condition::operator==(const Condition& rhs) const {
+  return type == rhs.type && value == rhs.value;
+}
+
+bool ScanFilterManager::Condition::operator<(const Condition& rhs) const {
+  return std::tie(type, value) < std::tie(rhs.type, rhs.value);
+}
+
+bool ScanFilterManager::Filter::operator<(const Filter& rhs) const {
+  return std::tie(delivery_mode, conditions) <
+         std::tie(rhs.delivery_mode, rhs.conditions);
+}
+
+ScanFilterManager::ScanFilterManager(Adapter& adapter)
+    : adapter_(adapter),
+      enabled_(false),
+      indices_in_use_(0),
+      index_capacity_(INT_MAX),
+      has_failures_(false),
+      updating_(false) {
+  adapter_.AddObserver(this);
+  hal::BluetoothGattInterface::Get()->AddClientObserver(this);
+}
+
+ScanFilterManager::~ScanFilterManager() {
+  hal::BluetoothGattInterface::Get()->RemoveClientObserver(this);
+  adapter_.RemoveObserver(this);
+}
+
+void ScanFilterManager::SetClientFilters(
+    hal::BluetoothGattInterface* gatt_iface,
+    int client_id,
+    const std::vector<ScanFilter>& filters,
+    bool batched) {
+  Client client;
+  client.delivery_mode = batched ? kDeliveryModeBatch : kDeliveryModeImmediate;
+  for (const auto& filter : filters)
+    client.filters.push_back(GetConditions(filter));
+
+  {
+    lock_guard<mutex> lock(lock_);
+    clients_[client_id] = std::move(client);
+  }
+
+  Update(gatt_iface, client_id);
+}
+
+void ScanFilterManager::RemoveClientFilters(
+    hal::BluetoothGattInterface* gatt_iface,
+    int client_id) {
+  {
+    lock_guard<mutex> lock(lock_);
+    if (!clients_.erase(client_id))
+      return;
+  }
+
+  Update(gatt_iface, client_id);
+}
+
+size_t ScanFilterManager::GetNumberOfControllerFilters() {
+  lock_guard<mutex> lock(lock_);
+  return enabled_ ? programmed_.size() : 0;
+}
+
+// static
+ScanFilterManager::Conditions ScanFilterManager::GetConditions(
+    const ScanFilter& filter) {
+  Conditions conditions;
+
+  // ScanFilter compares addresses case-insensitively.
+  if (!filter.device_address().empty()) {
+    std::string address = filter.device_address();
+    std::transform(address.begin(), address.end(), address.begin(), ::toupper);
+    conditions.insert({ kFilterTypeAddress, address });
+  }
+
+  if (filter.service_uuid()) {
+    UUID::UUID128Bit uuid = filter.service_uuid()->GetFullBigEndian();
+    UUID::UUID128Bit mask;
+    if (filter.service_uuid_mask())
+      mask = filter.service_uuid_mask()->GetFullBigEndian();
+    else
+      mask.fill(0xff);
+
+    std::string value(uuid.begin(), uuid.end());
+    value.append(mask.begin(), mask.end());
+    conditions.insert({ kFilterTypeServiceUuid, value });
+  }
+
+  // Longer names are left to the host.
+  if (!filter.device_name().empty() &&
+      filter.device_name().size() <= kMaxLocalNameLength)
+    conditions.insert({ kFilterTypeLocalName, filter.device_name() });
+
+  return conditions;
+}
+
+std::set<ScanFilterManager::Filter> ScanFilterManager::PackFilters(
+    int max_indices) const {
+  // The condition sets of each delivery mode. An empty set lets everything
+  // through.
+  std::map<int, std::vector<Conditions>> modes;
+  for (const auto& client : clients_) {
+    auto& sets = modes[client.second.delivery_mode];
+    if (client.second.filters.empty())
+      sets.emplace_back();
+    sets.insert(sets.end(), client.second.filters.begin(),
+                client.second.filters.end());
+  }
+
+  // Every round either drops a condition or lets a delivery mode through
+  // unfiltered, so this ends at the latest once nothing is filtered.
+  for (;;) {
+    // Leave out duplicates, and sets that include all conditions of another
+    // set: they only let through what the other one does already.
+    for (auto& mode : modes) {
+      auto& sets = mode.second;
+      std::sort(sets.begin(), sets.end());
+      sets.erase(std::unique(sets.begin(), sets.end()), sets.end());
+
+      std::vector<Conditions> kept;
+      for (const auto& set : sets) {
+        bool narrower = false;
+        for (const auto& other : sets) {
+          if (other.size() < set.size() &&
+              std::includes(set.begin(), set.end(),
+                            other.begin(), other.end())) {
+            narrower = true;
+            break;
+          }
+        }
+        if (!narrower)
+          kept.push_back(set);
+      }
+      sets.swap(kept);
+    }
+
+    // Sets of a single condition share one filter index per type.
+    std::set<Filter> packed;
+    for (const auto& mode : modes) {
+      std::map<int, Conditions> shared;
+      for (const auto& set : mode.second) {
+        if (set.size() == 1)
+          shared[set.begin()->type].insert(*set.begin());
+        else
+          packed.insert({ mode.first, set });
+      }
+      for (auto& type : shared)
+        packed.insert({ mode.first, std::move(type.second) });
+    }
+
+    std::map<int, int> conditions;
+    for (const auto& filter : packed) {
+      for (const auto& condition : filter.conditions)
+        conditions[condition.type]++;
+    }
+
+    // Programming filters that let everything through is pointless.
+    if (conditions.empty())
+      return std::set<Filter>();
+
+    int full_type = kFilterIndexType;
+    for (const auto& count : conditions) {
+      auto capacity = condition_capacity_.find(count.first);
+      if (capacity != condition_capacity_.end() &&
+          count.second > capacity->second) {
+        full_type = count.first;
+        break;
+      }
+    }
+
+    if (full_type == kFilterIndexType &&
+        packed.size() <= static_cast<size_t>(max_indices))
+      return packed;
+
+    // Relax a set of several conditions: drop the condition of a type there
+    // is no space for, or else keep only one condition so that the set can
+    // share an index with the others of that type.
+    bool relaxed = false;
+    for (auto& mode : modes) {
+      for (auto& set : mode.second) {
+        if (set.size() < 2)
+          continue;
+
+        if (full_type != kFilterIndexType) {
+          auto iter = std::find_if(set.begin(), set.end(),
+              [full_type](const Condition& condition) {
+                return condition.type == full_type;
+              });
+          if (iter == set.end())
+            continue;
+          set.erase(iter);
+        } else {
+          // Prefer a type that already has a shared index.
+          const Condition* keep = nullptr;
+          for (const auto& condition : set) {
+            for (const auto& other : mode.second) {
+              if (other.size() == 1 && other.begin()->type == condition.type)
+                keep = &condition;
+            }
+          }
+          for (int type : kRelaxOrder) {
+            for (const auto& condition : set) {
+              if (!keep && condition.type == type)
+                keep = &condition;
+            }
+          }
+          set = Conditions{ *keep };
+        }
+
+        relaxed = true;
+        break;
+      }
+      if (relaxed)
+        break;
+    }
+    if (relaxed)
+      continue;
+
+    // There is nothing left to relax, so the filters of one delivery mode
+    // have to go.
+    for (auto& mode : modes) {
+      bool affected = false;
+      for (const auto& set : mode.second) {
+        for (const auto& condition : set) {
+          if (full_type == kFilterIndexType || condition.type == full_type)
+            affected = true;
+        }
+      }
+      if (affected) {
+        mode.second.assign(1, Conditions());
+        break;
+      }
+    }
+  }
+}
+
+void ScanFilterManager::Update(hal::BluetoothGattInterface* gatt_iface,
+                               int client_if) {
+  // Failures reported while an update runs are only recorded, so go again
+  // until there are none left.
+  do {
+    lock_guard<mutex> lock(lock_);
+    updating_ = true;
+    UpdateLocked(gatt_iface, client_if);
+    updating_ = false;
+  } while (has_failures_.load());
+}
+
+void ScanFilterManager::UpdateLocked(hal::BluetoothGattInterface* gatt_iface,
+                                     int client_if) {
+  const btgatt_client_interface_t* hal_iface =
+      gatt_iface->GetClientHALInterface();
+
+  std::vector<int> failures;
+  std::map<int, int> reported;
+  {
+    lock_guard<mutex> lock(failures_lock_);
+    failures.swap(failures_);
+    reported.swap(reported_capacity_);
+    has_failures_ = false;
+  }
+
+  for (const auto& capacity : reported) {
+    if (capacity.first == kFilterIndexType)
+      index_capacity_ = capacity.second;
+    else
+      condition_capacity_[capacity.first] = capacity.second;
+  }
+
+  if (!failures.empty()) {
+    // A call the HAL rejected comes without a report of the space left, so
+    // assume there is none beyond what is in use.
+    for (int type : failures) {
+      if (reported.count(type))
+        continue;
+      if (type == kFilterIndexType) {
+        index_capacity_ = std::min(index_capacity_, indices_in_use_);
+        continue;
+      }
+      int capacity = conditions_in_use_[type];
+      auto iter = condition_capacity_.find(type);
+      if (iter != condition_capacity_.end())
+        capacity = std::min(capacity, iter->second);
+      condition_capacity_[type] = capacity;
+    }
+
+    // It's unknown which filter is missing a condition, so they are all
+    // programmed again. Until then the controller lets everything through.
+    if (enabled_) {
+      hal_iface->scan_filter_enable(client_if, false);
+      enabled_ = false;
+    }
+    for (const auto& filter : programmed_)
+      RemoveFilter(gatt_iface, client_if, filter.first, filter.second);
+    programmed_.clear();
+  }
+
+  int max_indices = 0;
+  if (adapter_.IsOffloadedFilteringSupported()) {
+    max_indices = std::min(
+        adapter_.GetTotalNumberOfOffloadedFilters() - kFirstFilterIndex,
+        index_capacity_);
+  }
+
+  std::set<Filter> filters = PackFilters(max_indices);
+
+  if (filters.empty() && enabled_) {
+    VLOG(1) << "Scan results are filtered in the daemon only";
+    hal_iface->scan_filter_enable(client_if, false);
+    enabled_ = false;
+  }
+
+  // Remove what is no longer needed first, which frees up space.
+  std::set<int> used_indices;
+  for (auto iter = programmed_.begin(); iter != programmed_.end();) {
+    if (filters.count(iter->first)) {
+      used_indices.insert(iter->second);
+      ++iter;
+      continue;
+    }
+    RemoveFilter(gatt_iface, client_if, iter->first, iter->second);
+    iter = programmed_.erase(iter);
+  }
+
+  int index = kFirstFilterIndex;
+  for (const auto& filter : filters) {
+    if (programmed_.count(filter))
+      continue;
+
+    while (used_indices.count(index))
+      index++;
+
+    // Update() starts over with the failure taken into account.
+    if (!AddFilter(gatt_iface, client_if, filter, index))
+      return;
+
+    used_indices.insert(index);
+    programmed_[filter] = index;
+  }
+
+  if (!filters.empty() && !enabled_) {
+    VLOG(1) << "Scan results are filtered in the controller with "
+            << filters.size() << " filters";
+    if (hal_iface->scan_filter_enable(client_if, true) != BT_STATUS_SUCCESS) {
+      LOG(ERROR) << "Failed to enable scan filtering in the controller";
+      return;
+    }
+    enabled_ = true;
+  }
+}
+
+bool ScanFilterManager::AddFilter(hal::BluetoothGattInterface* gatt_iface,
+                                  int client_if, const Filter& filter,
+                                  int index) {
+  const btgatt_client_interface_t* hal_iface =
+      gatt_iface->GetClientHALInterface();
+
+  // Takes back the conditions added so far.
+  Conditions added;
+  auto roll_back = [&]() {
+    hal_iface->scan_filter_clear(client_if, index);
+    for (const auto& condition : added)
+      conditions_in_use_[condition.type]--;
+  };
+
+  int feat_seln = 0;
+  for (const auto& condition : filter.conditions) {
+    feat_seln |= 1 << condition.type;
+    ExpectAddCallback(condition.type, conditions_in_use_[condition.type] + 1);
+
+    bt_status_t status = BT_STATUS_FAIL;
+    switch (condition.type) {
+      case kFilterTypeAddress: {
+        bt_bdaddr_t bda;
+        util::BdAddrFromString(condition.value, &bda);
+        status = hal_iface->scan_filter_add_remove(
+            client_if, kActionAdd, condition.type, index, 0, 0, nullptr,
+            nullptr, &bda, kAddressTypeAny, 0, nullptr, 0, nullptr);
+        break;
+      }
+      case kFilterTypeServiceUuid: {
+        UUID::UUID128Bit uuid_bytes;
+        UUID::UUID128Bit mask_bytes;
+        std::copy(condition.value.begin(),
+                  condition.value.begin() + uuid_bytes.size(),
+                  uuid_bytes.begin());
+        std::copy(condition.value.begin() + uuid_bytes.size(),
+                  condition.value.end(), mask_bytes.begin());
+        bt_uuid_t uuid = UUID(uuid_bytes).GetBlueDroid();
+        bt_uuid_t mask = UUID(mask_bytes).GetBlueDroid();
+        status = hal_iface->scan_filter_add_remove(
+            client_if, kActionAdd, condition.type, index, 0, 0, &uuid, &mask,
+            nullptr, 0, 0, nullptr, 0, nullptr);
+        break;
+      }
+      case kFilterTypeLocalName: {
+        std::string name = condition.value;
+        status = hal_iface->scan_filter_add_remove(
+            client_if, kActionAdd, condition.type, index, 0, 0, nullptr,
+            nullptr, nullptr, 0, name.size(), &name[0], 0, nullptr);
+        break;
+      }
+      default:
+        NOTREACHED();
+    }
+
+    if (status != BT_STATUS_SUCCESS) {
+      LOG(ERROR) << "Failed to add scan filter condition of type: "
+                 << condition.type;
+      CancelAddCallback(condition.type);
+      roll_back();
+      ReportFailure(condition.type);
+      return false;
+    }
+
+    conditions_in_use_[condition.type]++;
+    added.insert(condition);
+  }
+
+  btgatt_filt_param_setup_t params;
+  memset(&params, 0, sizeof(params));
+  params.client_if = client_if;
+  params.action = kActionAdd;
+  params.filt_index = index;
+  params.feat_seln = feat_seln;
+  params.list_logic_type = kListLogicOr;
+  params.filt_logic_type = kFilterLogicAnd;
+  params.rssi_high_thres = kRssiThresholdNone;
+  params.rssi_low_thres = kRssiThresholdNone;
+  params.dely_mode = filter.delivery_mode;
+  ExpectAddCallback(kFilterIndexType, indices_in_use_ + 1);
+
+  if (hal_iface->scan_filter_param_setup(params) != BT_STATUS_SUCCESS) {
+    LOG(ERROR) << "Failed to set up scan filter index: " << index;
+    CancelAddCallback(kFilterIndexType);
+    roll_back();
+    ReportFailure(kFilterIndexType);
+    return false;
+  }
+
+  indices_in_use_++;
+  return true;
+}
+
+void ScanFilterManager::RemoveFilter(hal::BluetoothGattInterface* gatt_iface,
+                                     int client_if, const Filter& filter,
+                                     int index) {
+  const btgatt_client_interface_t* hal_iface =
+      gatt_iface->GetClientHALInterface();
+
+  // Clearing an index removes all of its conditions.
+  hal_iface->scan_filter_clear(client_if, index);
+  for (const auto& condition : filter.conditions)
+    conditions_in_use_[condition.type]--;
+
+  btgatt_filt_param_setup_t params;
+  memset(&params, 0, sizeof(params));
+  params.client_if = client_if;
+  params.action = kActionDelete;
+  params.filt_index = index;
+  hal_iface->scan_filter_param_setup(params);
+  indices_in_use_--;
+}
+
+void ScanFilterManager::ReportFailure(int type) {
+  lock_guard<mutex> lock(failures_lock_);
+  failures_.push_back(type);
+  has_failures_ = true;
+}
+
+void ScanFilterManager::ExpectAddCallback(int type, int in_use) {
+  lock_guard<mutex> lock(failures_lock_);
+  pending_adds_[type].push_back(in_use);
+}
+
+void ScanFilterManager::CancelAddCallback(int type) {
+  lock_guard<mutex> lock(failures_lock_);
+  pending_adds_[type].pop_back();
+}
+
+void ScanFilterManager::ReportSpace(int type, bool added, int avbl_space) {
+  lock_guard<mutex> lock(failures_lock_);
+  auto& pending = pending_adds_[type];
+  if (pending.empty())
+    return;
+
+  // Callbacks come in the order of the calls, so the oldest pending add is
+  // the one reported on.
+  int in_use = pending.front() - (added ? 0 : 1);
+  pending.pop_front();
+  reported_capacity_[type] = in_use + avbl_space;
+}
+
+void ScanFilterManager::OnAdapterStateChanged(
+    Adapter* /* adapter */,
+    AdapterState /* prev_state */,
+    AdapterState new_state) {
+  VLOG(1) << "Resetting scan filter state, adapter state: "
+          << AdapterStateToString(new_state);
+
+  // The filters of the clients are kept and programmed again on the next
+  // update, which also finds out again how much space there is.
+  lock_guard<mutex> lock(lock_);
+  programmed_.clear();
+  enabled_ = false;
+  conditions_in_use_.clear();
+  condition_capacity_.clear();
+  indices_in_use_ = 0;
+  index_capacity_ = INT_MAX;
+
+  // Callbacks for calls made before the reset never arrive.
+  lock_guard<mutex> failures_lock(failures_lock_);
+  failures_.clear();
+  pending_adds_.clear();
+  reported_capacity_.clear();
+  has_failures_ = false;
+}
+
+void ScanFilterManager::ScanFilterCfgCallback(
+    hal::BluetoothGattInterface* gatt_iface,
+    int action, int client_if, int status, int filt_type,
+    int avbl_space) {
+  if (action != kActionAdd)
+    return;
+
+  ReportSpace(filt_type, status == BT_STATUS_SUCCESS, avbl_space);
+  if (status == BT_STATUS_SUCCESS)
+    return;
+
+  LOG(WARNING) << "Controller is out of space for scan filter conditions of "
+               << "type: " << filt_type;
+  ReportFailure(filt_type);
+
+  // An update that is running picks this up before it returns.
+  if (!updating_.load())
+    Update(gatt_iface, client_if);
+}
+
+void ScanFilterManager::ScanFilterParamCallback(
+    hal::BluetoothGattInterface* gatt_iface,
+    int action, int client_if, int status, int avbl_space) {
+  if (action != kActionAdd)
+    return;
+
+  ReportSpace(kFilterIndexType, status == BT_STATUS_SUCCESS, avbl_space);
+  if (status == BT_STATUS_SUCCESS)
+    return;
+
+  LOG(WARNING) << "Controller is out of space for scan filter indices";
+  ReportFailure(kFilterIndexType);
+
+  if (!updating_.load())
+    Update(gatt_iface, client_if);
+}
+
+}  // namespace bluetooth
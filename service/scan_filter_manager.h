@@ -0,0 +1,196 @@
+//
+//  Copyright (C) 2016 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+
+#include "service/adapter.h"
+#include "service/common/bluetooth/scan_filter.h"
+#include "service/hal/bluetooth_gatt_interface.h"
+
+namespace bluetooth {
+
+// ScanFilterManager programs the scan filters of all LowEnergyClients into
+// the controller's advertising packet content filters (APCF), so that the
+// controller drops advertisements no client is interested in instead of
+// waking up the host for them.
+//
+// The controller has a small number of filter indices and a limited number
+// of conditions of each type. Identical filters of different clients share
+// an index, filters that are narrower than another one are left out, and
+// filters on a single condition of the same type share an index in which
+// their conditions are OR'ed. If that is still too much, filters are relaxed
+// to fewer conditions, and as a last resort the controller lets everything
+// through. The controller only ever lets through more than the clients
+// asked for, never less; each LowEnergyClient still applies its own filters
+// to the results it gets.
+//
+// The controller forgets its filters whenever the adapter is turned off, so
+// everything known about what is programmed and how much space there is
+// starts over on every adapter state change.
+class ScanFilterManager : private Adapter::Observer,
+                          private hal::BluetoothGattInterface::ClientObserver {
+ public:
+  // Don't construct/destruct directly except in tests. The
+  // LowEnergyClientFactory owns the instance shared by its clients.
+  explicit ScanFilterManager(Adapter& adapter);
+  ~ScanFilterManager() override;
+
+  // Sets the filters of the scan |client_id| is running, replacing any set
+  // before. An empty |filters| asks for all results. |batched| is true while
+  // the client's results are batched in controller storage, which the
+  // controller fills from separate filters.
+  void SetClientFilters(hal::BluetoothGattInterface* gatt_iface,
+                        int client_id,
+                        const std::vector<ScanFilter>& filters,
+                        bool batched);
+
+  // Drops the filters of |client_id| once its scan has stopped.
+  void RemoveClientFilters(hal::BluetoothGattInterface* gatt_iface,
+                           int client_id);
+
+  // Returns the number of filter indices programmed into the controller. 0
+  // means the controller lets all advertisements through.
+  size_t GetNumberOfControllerFilters();
+
+ private:
+  // A condition of a controller filter.
+  struct Condition {
+    // The HAL filter type.
+    int type;
+
+    // The device address, the local name, or the 128-bit service UUID
+    // followed by its mask, both big-endian.
+    std::string value;
+
+    bool operator==(const Condition& rhs) const;
+    bool operator<(const Condition& rhs) const;
+  };
+
+  using Conditions = std::set<Condition>;
+
+  // What gets programmed into one filter index. An advertisement passes if
+  // it matches all condition types and, within a type, any of the
+  // conditions. An index without conditions lets everything through.
+  struct Filter {
+    int delivery_mode;
+    Conditions conditions;
+
+    bool operator<(const Filter& rhs) const;
+  };
+
+  // The filters of one client's scan.
+  struct Client {
+    int delivery_mode;
+    std::vector<Conditions> filters;
+  };
+
+  // Returns the conditions of |filter| the controller is able to check.
+  static Conditions GetConditions(const ScanFilter& filter);
+
+  // Returns the filters to program for |clients_| that fit into
+  // |max_indices| filter indices and |condition_capacity_|. Returns an empty
+  // set if the controller has to let everything through.
+  std::set<Filter> PackFilters(int max_indices) const;
+
+  // Brings the controller in line with |clients_|, retrying as long as the
+  // controller reports that it ran out of space.
+  void Update(hal::BluetoothGattInterface* gatt_iface, int client_if);
+  void UpdateLocked(hal::BluetoothGattInterface* gatt_iface, int client_if);
+
+  // Programs |filter| into filter |index| of the controller, and clears it
+  // again. AddFilter returns false if the HAL rejected a call, after taking
+  // back what it had added.
+  bool AddFilter(hal::BluetoothGattInterface* gatt_iface, int client_if,
+                 const Filter& filter, int index);
+  void RemoveFilter(hal::BluetoothGattInterface* gatt_iface, int client_if,
+                    const Filter& filter, int index);
+
+  // Records that the controller has no space for another condition of
+  // |type|, or with kFilterIndexType another filter index.
+  void ReportFailure(int type);
+
+  // Called before and, if the HAL rejected it, after asking the controller
+  // to add a condition of |type| or a filter index. |in_use| is the number
+  // the controller holds once it is added.
+  void ExpectAddCallback(int type, int in_use);
+  void CancelAddCallback(int type);
+
+  // Records the capacity of |type| from the space the controller reports
+  // left after an add.
+  void ReportSpace(int type, bool added, int avbl_space);
+
+  // Adapter::Observer override:
+  void OnAdapterStateChanged(Adapter* adapter,
+                             AdapterState prev_state,
+                             AdapterState new_state) override;
+
+  // BluetoothGattInterface::ClientObserver overrides:
+  void ScanFilterCfgCallback(
+      hal::BluetoothGattInterface* gatt_iface,
+      int action, int client_if, int status, int filt_type,
+      int avbl_space) override;
+  void ScanFilterParamCallback(
+      hal::BluetoothGattInterface* gatt_iface,
+      int action, int client_if, int status, int avbl_space) override;
+
+  Adapter& adapter_;
+
+  // Protects the members below. Held while the controller is programmed.
+  std::mutex lock_;
+
+  std::map<int, Client> clients_;
+
+  // The filters programmed into the controller and their indices.
+  std::map<Filter, int> programmed_;
+  bool enabled_;
+
+  // Conditions of each type and filter indices in use, and how many of them
+  // the controller turned out to have space for. Types without a capacity
+  // have not run out yet.
+  std::map<int, int> conditions_in_use_;
+  std::map<int, int> condition_capacity_;
+  int indices_in_use_;
+  int index_capacity_;
+
+  // Types that ran out of space since the last update, see ReportFailure.
+  // Callbacks can arrive while |lock_| is held, so this has its own lock.
+  std::mutex failures_lock_;
+  std::vector<int> failures_;
+  std::atomic_bool has_failures_;
+
+  // For each type, what the controller holds after each add it has not
+  // called back for yet, oldest first, and the capacities it reported since
+  // the last update. Guarded by |failures_lock_|.
+  std::map<int, std::deque<int>> pending_adds_;
+  std::map<int, int> reported_capacity_;
+
+  // True while Update() is programming the controller.
+  std::atomic_bool updating_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScanFilterManager);
+};
+
+}  // namespace bluetooth
@@ -40,6 +40,25 @@ class MockGattHandler
   MOCK_METHOD3(Disconnect, bt_status_t(int , const bt_bdaddr_t *, int));
 
   // Stub implementations for uninteresting TestClientHandler methods:
+  bt_status_t ScanFilterParamSetup(btgatt_filt_param_setup_t) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t ScanFilterAddRemove(int, int, int, int, int, int,
+                                  const bt_uuid_t*, const bt_uuid_t*,
+                                  const bt_bdaddr_t*, char, int, char*, int,
+                                  char*) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t ScanFilterClear(int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t ScanFilterEnable(int, bool) override {
+    return BT_STATUS_FAIL;
+  }
+
   bt_status_t MultiAdvEnable(int, int, int, int, int, int, int) override {
     return BT_STATUS_FAIL;
   }
@@ -53,6 +72,22 @@ class MockGattHandler
     return BT_STATUS_FAIL;
   }
 
+  bt_status_t BatchscanConfigStorage(int, int, int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t BatchscanEnable(int, int, int, int, int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t BatchscanDisable(int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t BatchscanReadReports(int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(MockGattHandler);
 };
@@ -0,0 +1,417 @@
+//
+//  Copyright (C) 2016 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/base64.h>
+#include <base/files/scoped_file.h>
+#include <base/macros.h>
+#include <base/strings/string_number_conversions.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "service/adapter.h"
+#include "service/ipc/linux_ipc_host.h"
+#include "service/ipc/linux_ipc_protocol.h"
+#include "service/test/mock_adapter.h"
+
+using bluetooth::UUID;
+using testing::InSequence;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+using testing::_;
+
+namespace ipc {
+namespace {
+
+const char kServiceUuid[] = "0000180d-0000-1000-8000-00805f9b34fb";
+const char kCharacteristicUuid[] = "00002a37-0000-1000-8000-00805f9b34fb";
+const int kUpdateCount = 20000;
+const size_t kValueSize = 20;
+
+std::string MakeValue(int index) {
+  std::string value(kValueSize, '\0');
+  for (size_t i = 0; i < kValueSize; ++i)
+    value[i] = static_cast<char>((index + i) & 0xff);
+  return value;
+}
+
+TEST(LinuxIPCProtocolTest, RoundTrip) {
+  const std::vector<std::string> first = {
+    "set-characteristic-value", kServiceUuid, kCharacteristicUuid,
+    std::string("a|b\0c", 5),
+  };
+  const std::vector<std::string> second = { "start-service", kServiceUuid };
+  const std::vector<std::string> empty_field = { "set-device-name", "" };
+
+  std::vector<uint8_t> datagram;
+  EXPECT_TRUE(AppendBinaryFrame(first, &datagram));
+  EXPECT_TRUE(AppendBinaryFrame(second, &datagram));
+  EXPECT_TRUE(AppendBinaryFrame(empty_field, &datagram));
+  EXPECT_EQ(BinaryFrameSize(first) + BinaryFrameSize(second) +
+                BinaryFrameSize(empty_field),
+            datagram.size());
+
+  std::vector<std::vector<std::string>> frames;
+  EXPECT_TRUE(ParseBinaryFrames(datagram.data(), datagram.size(), &frames));
+  ASSERT_EQ(3u, frames.size());
+  EXPECT_EQ(first, frames[0]);
+  EXPECT_EQ(second, frames[1]);
+  EXPECT_EQ(empty_field, frames[2]);
+}
+
+TEST(LinuxIPCProtocolTest, RejectsMalformedFrames) {
+  std::vector<uint8_t> datagram;
+  EXPECT_TRUE(AppendBinaryFrame({ "start-service", kServiceUuid }, &datagram));
+  EXPECT_TRUE(AppendBinaryFrame({ "stop-service", kServiceUuid }, &datagram));
+
+  // Truncating the second frame still yields the first one.
+  std::vector<std::vector<std::string>> frames;
+  EXPECT_FALSE(ParseBinaryFrames(datagram.data(), datagram.size() - 1,
+                                 &frames));
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_EQ("start-service", frames[0][0]);
+
+  // A field running past the end of its frame.
+  const uint8_t overrun[] = { 0x04, 0x00, 0x01, 0x05, 0x00, 'a' };
+  frames.clear();
+  EXPECT_FALSE(ParseBinaryFrames(overrun, sizeof(overrun), &frames));
+  EXPECT_TRUE(frames.empty());
+
+  // A field that is too long for a frame.
+  EXPECT_FALSE(AppendBinaryFrame({ std::string(UINT16_MAX, 'x') }, &datagram));
+}
+
+// Serves characteristic values from a map instead of a GATT server.
+class TestIPCHost : public LinuxIPCHost {
+ public:
+  TestIPCHost(int sockfd, bluetooth::Adapter* adapter)
+      : LinuxIPCHost(sockfd, adapter) {}
+  ~TestIPCHost() override = default;
+
+  std::map<UUID, std::vector<uint8_t>> values;
+
+ protected:
+  bool GetCharacteristicValue(const std::string& service_uuid, const UUID& id,
+                              std::vector<uint8_t>* value) override {
+    EXPECT_EQ(kServiceUuid, service_uuid);
+    *value = values[id];
+    return true;
+  }
+};
+
+}  // namespace
+
+// Drives a LinuxIPCHost from the client end of a socket pair.
+class LinuxIPCHostTest : public ::testing::Test {
+ public:
+  LinuxIPCHostTest() = default;
+  ~LinuxIPCHostTest() override = default;
+
+  void SetUp() override {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds));
+    client_fd_.reset(fds[0]);
+    host_.reset(new TestIPCHost(fds[1], &adapter_));
+  }
+
+ protected:
+  // Sends one datagram from the client and lets the host handle it.
+  bool SendToHost(const void* data, size_t size) {
+    EXPECT_EQ(static_cast<ssize_t>(size), write(client_fd_.get(), data, size));
+    return host_->OnMessage();
+  }
+
+  bool SendToHost(const std::string& message) {
+    return SendToHost(message.data(), message.size());
+  }
+
+  // Receives one datagram on the client side.
+  std::string Receive() {
+    std::vector<char> buffer(kMaxBinaryDatagramSize + 1);
+    ssize_t size = read(client_fd_.get(), buffer.data(), buffer.size());
+    EXPECT_GT(size, 0);
+    return std::string(buffer.data(), size > 0 ? size : 0);
+  }
+
+  bool HasPendingDatagram() {
+    struct pollfd pfd = { client_fd_.get(), POLLIN, 0 };
+    return poll(&pfd, 1, 0) == 1;
+  }
+
+  void NegotiateBinary() {
+    ASSERT_TRUE(SendToHost(std::string(kSetProtocolCommand) + "|" +
+                           kBinaryProtocol));
+    ASSERT_EQ(std::string(kSetProtocolCommand) + "|" + kBinaryProtocol,
+              Receive());
+  }
+
+  // Gives the host a GATT server for |kServiceUuid| whose write
+  // notifications come from |gatt_write_fd_|.
+  void AddGattServer() {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    gatt_read_fd_.reset(fds[0]);
+    gatt_write_fd_.reset(fds[1]);
+    host_->gatt_servers_[kServiceUuid].reset(new bluetooth::gatt::Server);
+    host_->pfds_.push_back({gatt_read_fd_.get(), POLLIN, 0});
+  }
+
+  // Queues a write notification for |id| with |value| on the GATT pipe.
+  void NotifyWrite(const UUID& id, const std::string& value) {
+    host_->values[id] = std::vector<uint8_t>(value.begin(), value.end());
+    UUID::UUID128Bit bytes = id.GetFullBigEndian();
+    ASSERT_EQ(static_cast<ssize_t>(bytes.size()),
+              write(gatt_write_fd_.get(), bytes.data(), bytes.size()));
+  }
+
+  bool OnGattWrite() { return host_->OnGattWrite(); }
+
+  bool binary_protocol() const { return host_->binary_protocol_; }
+
+  NiceMock<bluetooth::testing::MockAdapter> adapter_;
+  base::ScopedFD client_fd_;
+  base::ScopedFD gatt_read_fd_;
+  base::ScopedFD gatt_write_fd_;
+  std::unique_ptr<TestIPCHost> host_;
+};
+
+namespace {
+
+// The frame the host sends for a write of |value| to |id|.
+std::vector<std::string> WriteFrame(const UUID& id, const std::string& value) {
+  UUID::UUID128Bit bytes = id.GetFullBigEndian();
+  return { "write-characteristic", kServiceUuid,
+           base::HexEncode(bytes.data(), bytes.size()), value };
+}
+
+std::vector<std::vector<std::string>> ParseDatagram(
+    const std::string& datagram) {
+  std::vector<std::vector<std::string>> frames;
+  EXPECT_TRUE(ParseBinaryFrames(
+      reinterpret_cast<const uint8_t*>(datagram.data()), datagram.size(),
+      &frames));
+  return frames;
+}
+
+TEST_F(LinuxIPCHostTest, SetProtocol) {
+  EXPECT_FALSE(binary_protocol());
+
+  // Unknown protocols are refused without an acknowledgement.
+  EXPECT_FALSE(SendToHost(std::string(kSetProtocolCommand) + "|json"));
+  EXPECT_FALSE(HasPendingDatagram());
+  EXPECT_FALSE(binary_protocol());
+
+  NegotiateBinary();
+  EXPECT_TRUE(binary_protocol());
+}
+
+TEST_F(LinuxIPCHostTest, TextMessage) {
+  const std::string name("name|with\0bytes", 15);
+  std::string encoded_name;
+  base::Base64Encode(name, &encoded_name);
+
+  // Arguments are base64 decoded before they reach the handlers.
+  EXPECT_CALL(adapter_, SetName(name)).WillOnce(Return(true));
+  EXPECT_TRUE(SendToHost("set-device-name|" + encoded_name));
+
+  EXPECT_FALSE(SendToHost("set-device-name"));
+  EXPECT_FALSE(SendToHost("no-such-command|" + encoded_name));
+}
+
+TEST_F(LinuxIPCHostTest, BinaryMessage) {
+  NegotiateBinary();
+
+  const std::string first("raw|name\0", 9);
+  std::vector<uint8_t> datagram;
+  ASSERT_TRUE(AppendBinaryFrame({ "set-device-name", first }, &datagram));
+  ASSERT_TRUE(AppendBinaryFrame({ "set-device-name", "second" }, &datagram));
+
+  {
+    // All frames of a datagram are dispatched in order, values as sent.
+    InSequence sequence;
+    EXPECT_CALL(adapter_, SetName(first)).WillOnce(Return(true));
+    EXPECT_CALL(adapter_, SetName("second")).WillOnce(Return(true));
+  }
+  EXPECT_TRUE(SendToHost(datagram.data(), datagram.size()));
+
+  // Text messages are not understood anymore.
+  EXPECT_FALSE(SendToHost("set-device-name|c2Vjb25k"));
+}
+
+TEST_F(LinuxIPCHostTest, GattWriteBinaryBatches) {
+  NegotiateBinary();
+  AddGattServer();
+
+  const UUID ids[] = {
+    UUID("00002a37-0000-1000-8000-00805f9b34fb"),
+    UUID("00002a38-0000-1000-8000-00805f9b34fb"),
+    UUID("00002a39-0000-1000-8000-00805f9b34fb"),
+  };
+  for (size_t i = 0; i < arraysize(ids); ++i)
+    NotifyWrite(ids[i], MakeValue(i));
+
+  // Every pending write goes out in a single datagram.
+  ASSERT_TRUE(OnGattWrite());
+  std::vector<std::vector<std::string>> frames = ParseDatagram(Receive());
+  ASSERT_EQ(arraysize(ids), frames.size());
+  for (size_t i = 0; i < arraysize(ids); ++i)
+    EXPECT_EQ(WriteFrame(ids[i], MakeValue(i)), frames[i]);
+  EXPECT_FALSE(HasPendingDatagram());
+}
+
+TEST_F(LinuxIPCHostTest, GattWriteBinarySplitsDatagrams) {
+  NegotiateBinary();
+  AddGattServer();
+
+  // Two of these fit into a datagram, three do not.
+  const size_t value_size = kMaxBinaryDatagramSize / 3;
+  const int write_count = 5;
+  std::vector<UUID> ids;
+  for (int i = 0; i < write_count; ++i) {
+    UUID::UUID16Bit id16 = {{ 0x2a, static_cast<uint8_t>(i) }};
+    ids.emplace_back(id16);
+    NotifyWrite(ids.back(), std::string(value_size, 'a' + i));
+  }
+
+  ASSERT_TRUE(OnGattWrite());
+
+  int received = 0;
+  int datagrams = 0;
+  while (HasPendingDatagram()) {
+    std::string datagram = Receive();
+    EXPECT_LE(datagram.size(), kMaxBinaryDatagramSize);
+    datagrams++;
+    for (const auto& frame : ParseDatagram(datagram)) {
+      ASSERT_LT(received, write_count);
+      EXPECT_EQ(WriteFrame(ids[received],
+                           std::string(value_size, 'a' + received)), frame);
+      received++;
+    }
+  }
+  EXPECT_EQ(write_count, received);
+  EXPECT_EQ(3, datagrams);
+}
+
+// Times |kUpdateCount| adapter name updates from a client through a
+// LinuxIPCHost running its own event loop, as a stand-in for a client
+// pushing high-rate updates. The host is closed by shutting down the client
+// end, so the elapsed time covers every update being dispatched.
+class LinuxIPCHostThroughputTest : public ::testing::Test {
+ public:
+  LinuxIPCHostThroughputTest() = default;
+  ~LinuxIPCHostThroughputTest() override = default;
+
+  void SetUp() override {
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds));
+    client_fd_.reset(fds[0]);
+    host_.reset(new LinuxIPCHost(fds[1], &adapter_));
+
+    EXPECT_CALL(adapter_, SetName(_))
+        .Times(kUpdateCount)
+        .WillRepeatedly(Invoke([this](const std::string& name) {
+          EXPECT_EQ(MakeValue(received_++), name);
+          return true;
+        }));
+  }
+
+  void TearDown() override {
+    if (host_thread_.joinable()) {
+      shutdown(client_fd_.get(), SHUT_WR);
+      host_thread_.join();
+    }
+  }
+
+ protected:
+  void Send(const void* data, size_t size) {
+    ASSERT_EQ(static_cast<ssize_t>(size), write(client_fd_.get(), data, size));
+  }
+
+  void Send(const std::string& message) {
+    Send(message.data(), message.size());
+  }
+
+  void StartHost() {
+    host_thread_ = std::thread([this] { host_->EventLoop(); });
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  // Closes the client's sending side, waits for the host to handle
+  // everything sent before that and records the rate.
+  void StopHost() {
+    ASSERT_EQ(0, shutdown(client_fd_.get(), SHUT_WR));
+    host_thread_.join();
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    int elapsed_us = static_cast<int>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+            .count());
+
+    EXPECT_EQ(kUpdateCount, received_);
+    RecordProperty("updates", kUpdateCount);
+    RecordProperty("elapsed_us", elapsed_us);
+    if (elapsed_us > 0)
+      RecordProperty("updates_per_sec",
+                     static_cast<int>(kUpdateCount * 1000000LL / elapsed_us));
+  }
+
+  NiceMock<bluetooth::testing::MockAdapter> adapter_;
+  base::ScopedFD client_fd_;
+  std::unique_ptr<LinuxIPCHost> host_;
+  std::thread host_thread_;
+  std::chrono::steady_clock::time_point start_;
+  int received_ = 0;
+};
+
+TEST_F(LinuxIPCHostThroughputTest, Text) {
+  StartHost();
+  for (int i = 0; i < kUpdateCount; ++i) {
+    std::string encoded_value;
+    base::Base64Encode(MakeValue(i), &encoded_value);
+    Send("set-device-name|" + encoded_value);
+  }
+  StopHost();
+}
+
+TEST_F(LinuxIPCHostThroughputTest, Binary) {
+  StartHost();
+  Send(std::string(kSetProtocolCommand) + "|" + kBinaryProtocol);
+
+  std::vector<uint8_t> datagram;
+  for (int i = 0; i < kUpdateCount; ++i) {
+    std::vector<std::string> fields = { "set-device-name", MakeValue(i) };
+    if (datagram.size() + BinaryFrameSize(fields) > kMaxBinaryDatagramSize) {
+      Send(datagram.data(), datagram.size());
+      datagram.clear();
+    }
+    ASSERT_TRUE(AppendBinaryFrame(fields, &datagram));
+  }
+  Send(datagram.data(), datagram.size());
+  StopHost();
+}
+
+}  // namespace
+}  // namespace ipc
@@ -14,6 +14,11 @@
 //  limitations under the License.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 #include <base/macros.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -29,6 +34,8 @@ using ::testing::_;
 using ::testing::Return;
 using ::testing::Pointee;
 using ::testing::DoAll;
+using ::testing::Field;
+using ::testing::InSequence;
 using ::testing::Invoke;
 
 namespace bluetooth {
@@ -53,6 +60,26 @@ class MockGattHandler
       MultiAdvSetInstDataMock,
       bt_status_t(bool, bool, bool, int, int, char*, int, char*, int, char*));
   MOCK_METHOD1(MultiAdvDisable, bt_status_t(int));
+  MOCK_METHOD4(BatchscanConfigStorage, bt_status_t(int, int, int, int));
+  MOCK_METHOD6(BatchscanEnable, bt_status_t(int, int, int, int, int, int));
+  MOCK_METHOD1(BatchscanDisable, bt_status_t(int));
+  MOCK_METHOD2(BatchscanReadReports, bt_status_t(int, int));
+  MOCK_METHOD1(ScanFilterParamSetup, bt_status_t(btgatt_filt_param_setup_t));
+  MOCK_METHOD3(ScanFilterAddRemoveMock, bt_status_t(int, int, int));
+  MOCK_METHOD2(ScanFilterClear, bt_status_t(int, int));
+  MOCK_METHOD2(ScanFilterEnable, bt_status_t(int, bool));
+
+  // Only the action, condition type and filter index are checked here, see
+  // scan_filter_manager_unittest.cpp for the conditions themselves.
+  bt_status_t ScanFilterAddRemove(
+      int /* client_if */, int action, int filt_type, int filt_index,
+      int /* company_id */, int /* company_id_mask */,
+      const bt_uuid_t* /* p_uuid */, const bt_uuid_t* /* p_uuid_mask */,
+      const bt_bdaddr_t* /* bd_addr */, char /* addr_type */,
+      int /* data_len */, char* /* p_data */, int /* mask_len */,
+      char* /* p_mask */) override {
+    return ScanFilterAddRemoveMock(action, filt_type, filt_index);
+  }
 
   // GMock has macros for up to 10 arguments (11 is really just too many...).
   // For now we forward this call to a 10 argument mock, omitting the
@@ -77,7 +104,8 @@ class MockGattHandler
 
 class TestDelegate : public LowEnergyClient::Delegate {
  public:
-  TestDelegate() : scan_result_count_(0), connection_state_count_(0),
+  TestDelegate() : scan_result_count_(0), batch_count_(0),
+                   batch_result_count_(0), connection_state_count_(0),
                    last_mtu_(0) {
   }
 
@@ -86,6 +114,11 @@ class TestDelegate : public LowEnergyClient::Delegate {
   int scan_result_count() const { return scan_result_count_; }
   const ScanResult& last_scan_result() const { return last_scan_result_; }
 
+  // Batches may be delivered on the report delay thread.
+  int batch_count() const { return batch_count_.load(); }
+  int batch_result_count() const { return batch_result_count_.load(); }
+  const std::vector<ScanResult>& last_batch() const { return last_batch_; }
+
   int connection_state_count() const { return connection_state_count_; }
 
   void OnConnectionState(LowEnergyClient* client, int status,
@@ -106,10 +139,23 @@ class TestDelegate : public LowEnergyClient::Delegate {
     last_scan_result_ = scan_result;
   }
 
+  void OnBatchScanResults(LowEnergyClient* client,
+                          const std::vector<ScanResult>& scan_results) {
+    ASSERT_TRUE(client);
+    ASSERT_FALSE(scan_results.empty());
+    batch_result_count_ += scan_results.size();
+    batch_count_++;
+    last_batch_ = scan_results;
+  }
+
  private:
   int scan_result_count_;
   ScanResult last_scan_result_;
 
+  std::atomic_int batch_count_;
+  std::atomic_int batch_result_count_;
+  std::vector<ScanResult> last_batch_;
+
   int connection_state_count_;
 
   int last_mtu_;
@@ -157,6 +203,116 @@ class AdvertiseDataHandler : public MockGattHandler {
   std::vector<uint8_t> uuid_data_;
 };
 
+// Models the batch scan storage of a controller. While batch scanning,
+// advertisements are stored in the format of the scan mode, the host is told
+// once the storage passes the notify threshold, and reading reports drains
+// the storage.
+class BatchScanControllerHandler : public MockGattHandler {
+ public:
+  // Bytes of storage the controller has for batch scan results.
+  static const size_t kStorageSize = 4096;
+
+  BatchScanControllerHandler()
+      : fake_iface_(nullptr), client_if_(0), full_max_(0), trunc_max_(0),
+        notify_threshold_(0), scan_mode_(0), storage_size_(0),
+        num_records_(0), read_count_(0), dropped_count_(0) {}
+  ~BatchScanControllerHandler() override = default;
+
+  void set_fake_iface(hal::FakeBluetoothGattInterface* fake_iface) {
+    fake_iface_ = fake_iface;
+  }
+
+  int scan_mode() const { return scan_mode_; }
+  int read_count() const { return read_count_; }
+  int dropped_count() const { return dropped_count_; }
+
+  bt_status_t BatchscanConfigStorage(int client_if, int full_max,
+                                     int trunc_max,
+                                     int notify_threshold) override {
+    full_max_ = full_max;
+    trunc_max_ = trunc_max;
+    notify_threshold_ = notify_threshold;
+    fake_iface_->NotifyBatchscanCfgStorageCallback(client_if,
+                                                   BT_STATUS_SUCCESS);
+    return BT_STATUS_SUCCESS;
+  }
+
+  bt_status_t BatchscanEnable(int client_if, int scan_mode, int, int, int,
+                              int) override {
+    client_if_ = client_if;
+    scan_mode_ = scan_mode;
+    storage_size_ =
+        kStorageSize * (scan_mode == 1 ? trunc_max_ : full_max_) / 100;
+    fake_iface_->NotifyBatchscanEnableDisableCallback(1, client_if,
+                                                      BT_STATUS_SUCCESS);
+    return BT_STATUS_SUCCESS;
+  }
+
+  bt_status_t BatchscanDisable(int client_if) override {
+    scan_mode_ = 0;
+    fake_iface_->NotifyBatchscanEnableDisableCallback(0, client_if,
+                                                      BT_STATUS_SUCCESS);
+    return BT_STATUS_SUCCESS;
+  }
+
+  bt_status_t BatchscanReadReports(int client_if, int scan_mode) override {
+    read_count_++;
+    std::vector<uint8_t> data;
+    data.swap(storage_);
+    int num_records = num_records_;
+    num_records_ = 0;
+    fake_iface_->NotifyBatchscanReportsCallback(
+        client_if, BT_STATUS_SUCCESS, scan_mode, num_records, data);
+    return BT_STATUS_SUCCESS;
+  }
+
+  // Called for every advertisement the controller receives.
+  void ReceiveAdvertisement(const bt_bdaddr_t& bda, int8_t rssi,
+                            const std::vector<uint8_t>& adv_data,
+                            const std::vector<uint8_t>& scan_rsp) {
+    if (!scan_mode_)
+      return;
+
+    std::vector<uint8_t> record(bda.address, bda.address + 6);
+    std::reverse(record.begin(), record.end());
+    record.push_back(0);  // Address type
+    record.push_back(0);  // TX power
+    record.push_back(rssi);
+    record.push_back(0);  // Timestamp
+    record.push_back(0);
+    if (scan_mode_ == 2) {
+      record.push_back(adv_data.size());
+      record.insert(record.end(), adv_data.begin(), adv_data.end());
+      record.push_back(scan_rsp.size());
+      record.insert(record.end(), scan_rsp.begin(), scan_rsp.end());
+    }
+
+    if (storage_.size() + record.size() > storage_size_) {
+      dropped_count_++;
+      return;
+    }
+
+    storage_.insert(storage_.end(), record.begin(), record.end());
+    num_records_++;
+
+    if (storage_.size() * 100 >= storage_size_ * notify_threshold_)
+      fake_iface_->NotifyBatchscanThresholdCallback(client_if_);
+  }
+
+ private:
+  hal::FakeBluetoothGattInterface* fake_iface_;
+  int client_if_;
+  int full_max_;
+  int trunc_max_;
+  int notify_threshold_;
+  int scan_mode_;
+  size_t storage_size_;
+  std::vector<uint8_t> storage_;
+  int num_records_;
+  int read_count_;
+  int dropped_count_;
+};
+
 class LowEnergyClientTest : public ::testing::Test {
  public:
   LowEnergyClientTest() = default;
@@ -959,6 +1115,312 @@ TEST_F(LowEnergyClientPostRegisterTest, ScanRecord) {
   le_client_->SetDelegate(nullptr);
 }
 
+TEST_F(LowEnergyClientPostRegisterTest, ScanFilters) {
+  TestDelegate delegate;
+  le_client_->SetDelegate(&delegate);
+
+  // Complete local name "abc" followed by the 16-bit service UUID 0x180D.
+  const uint8_t kTestRecord[] = {
+    0x04, 0x09, 'a', 'b', 'c', 0x03, 0x03, 0x0D, 0x18, 0x00
+  };
+  const bt_bdaddr_t kTestAddress = {
+    { 0x01, 0x02, 0x03, 0x0A, 0x0B, 0x0C }
+  };
+  const int kTestRssi = 64;
+
+  EXPECT_CALL(mock_adapter_, IsEnabled())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_handler_, Scan(_))
+      .WillRepeatedly(Return(BT_STATUS_SUCCESS));
+
+  ScanSettings settings;
+  std::vector<ScanFilter> filters(2);
+  filters[0].set_device_name("xyz");
+  filters[1].SetServiceUuid(UUID("180E"));
+
+  // Neither filter matches.
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  fake_hal_gatt_iface_->NotifyScanResultCallback(
+      kTestAddress, kTestRssi, (uint8_t*) kTestRecord);
+  EXPECT_EQ(0, delegate.scan_result_count());
+  ASSERT_TRUE(le_client_->StopScan());
+
+  // One of them does.
+  filters[1].SetServiceUuid(UUID("180D"));
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  fake_hal_gatt_iface_->NotifyScanResultCallback(
+      kTestAddress, kTestRssi, (uint8_t*) kTestRecord);
+  EXPECT_EQ(1, delegate.scan_result_count());
+  ASSERT_TRUE(le_client_->StopScan());
+
+  // Address and name have to match at the same time.
+  filters.resize(1);
+  filters[0].set_device_name("abc");
+  ASSERT_TRUE(filters[0].SetDeviceAddress("01:02:03:0a:0b:0c"));
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  fake_hal_gatt_iface_->NotifyScanResultCallback(
+      kTestAddress, kTestRssi, (uint8_t*) kTestRecord);
+  EXPECT_EQ(2, delegate.scan_result_count());
+  ASSERT_TRUE(filters[0].SetDeviceAddress("01:02:03:0A:0B:0D"));
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  fake_hal_gatt_iface_->NotifyScanResultCallback(
+      kTestAddress, kTestRssi, (uint8_t*) kTestRecord);
+  EXPECT_EQ(2, delegate.scan_result_count());
+  ASSERT_TRUE(le_client_->StopScan());
+
+  le_client_->SetDelegate(nullptr);
+}
+
+TEST_F(LowEnergyClientPostRegisterTest, ScanFiltersInController) {
+  EXPECT_CALL(mock_adapter_, IsEnabled())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(mock_adapter_, IsOffloadedFilteringSupported())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(mock_adapter_, GetTotalNumberOfOffloadedFilters())
+      .WillRepeatedly(Return(16));
+
+  ScanSettings settings;
+  std::vector<ScanFilter> filters(1);
+  filters[0].set_device_name("abc");
+
+  // The filter is programmed and enabled before the scan starts.
+  {
+    InSequence seq;
+    EXPECT_CALL(*mock_handler_, ScanFilterAddRemoveMock(0, 4, 1))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+    EXPECT_CALL(*mock_handler_,
+                ScanFilterParamSetup(
+                    Field(&btgatt_filt_param_setup_t::feat_seln, 1 << 4)))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+    EXPECT_CALL(*mock_handler_, ScanFilterEnable(_, true))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+    EXPECT_CALL(*mock_handler_, Scan(true))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+  }
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  ::testing::Mock::VerifyAndClearExpectations(mock_handler_.get());
+
+  // Once the scan stops, the controller lets everything through again and
+  // the filter is removed.
+  {
+    InSequence seq;
+    EXPECT_CALL(*mock_handler_, Scan(false))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+    EXPECT_CALL(*mock_handler_, ScanFilterEnable(_, false))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+    EXPECT_CALL(*mock_handler_, ScanFilterClear(_, 1))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+    EXPECT_CALL(*mock_handler_, ScanFilterParamSetup(_))
+        .WillOnce(Return(BT_STATUS_SUCCESS));
+  }
+  ASSERT_TRUE(le_client_->StopScan());
+}
+
+TEST_F(LowEnergyClientPostRegisterTest, BatchScanResults) {
+  TestDelegate delegate;
+  le_client_->SetDelegate(&delegate);
+
+  const uint8_t kTestRecord[] = { 0x02, 0x01, 0x00, 0x00 };
+  const bt_bdaddr_t kTestAddress = {
+    { 0x01, 0x02, 0x03, 0x0A, 0x0B, 0x0C }
+  };
+  const int kTestRssi = 64;
+
+  EXPECT_CALL(mock_adapter_, IsEnabled())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_handler_, Scan(_))
+      .WillRepeatedly(Return(BT_STATUS_SUCCESS));
+
+  ScanSettings settings;
+  std::vector<ScanFilter> filters;
+
+  // Batches go out once they are full.
+  EXPECT_CALL(mock_adapter_, IsOffloadedScanBatchingSupported())
+      .WillRepeatedly(Return(false));
+  EXPECT_CALL(*mock_handler_, BatchscanConfigStorage(_, _, _, _))
+      .Times(0);
+  settings.set_report_batch_size(3);
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  for (int i = 0; i < 7; ++i) {
+    fake_hal_gatt_iface_->NotifyScanResultCallback(
+        kTestAddress, kTestRssi, (uint8_t*) kTestRecord);
+  }
+  EXPECT_EQ(0, delegate.scan_result_count());
+  EXPECT_EQ(2, delegate.batch_count());
+  EXPECT_EQ(6, delegate.batch_result_count());
+
+  // Stopping the scan delivers what is left over.
+  ASSERT_TRUE(le_client_->StopScan());
+  EXPECT_EQ(3, delegate.batch_count());
+  EXPECT_EQ(7, delegate.batch_result_count());
+
+  // With a report delay results wait for the delay to pass.
+  settings.set_report_batch_size(0);
+  settings.set_report_delay(base::TimeDelta::FromMilliseconds(10));
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  for (int i = 0; i < 5; ++i) {
+    fake_hal_gatt_iface_->NotifyScanResultCallback(
+        kTestAddress, kTestRssi, (uint8_t*) kTestRecord);
+  }
+  for (int i = 0; i < 500 && delegate.batch_result_count() < 12; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(12, delegate.batch_result_count());
+  EXPECT_EQ(0, delegate.scan_result_count());
+
+  ASSERT_TRUE(le_client_->StopScan());
+  EXPECT_EQ(12, delegate.batch_result_count());
+
+  le_client_->SetDelegate(nullptr);
+}
+
+TEST_F(LowEnergyClientPostRegisterTest, ControllerBatchScanTruncated) {
+  // Re-initialize the test with a controller model.
+  TearDown();
+  std::shared_ptr<BatchScanControllerHandler> controller(
+      new BatchScanControllerHandler());
+  mock_handler_ = std::static_pointer_cast<MockGattHandler>(controller);
+  SetUp();
+  controller->set_fake_iface(fake_hal_gatt_iface_);
+
+  TestDelegate delegate;
+  le_client_->SetDelegate(&delegate);
+
+  EXPECT_CALL(mock_adapter_, IsEnabled())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(mock_adapter_, IsOffloadedScanBatchingSupported())
+      .WillRepeatedly(Return(true));
+
+  // Batch scanning replaces the regular scan.
+  EXPECT_CALL(*mock_handler_, Scan(_))
+      .Times(0);
+
+  // Leave reading the reports to the storage threshold.
+  ScanSettings settings;
+  settings.set_result_type(ScanSettings::RESULT_TYPE_ABBREVIATED);
+  settings.set_report_delay(base::TimeDelta::FromHours(1));
+  std::vector<ScanFilter> filters;
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  EXPECT_EQ(1, controller->scan_mode());
+
+  const int kAdvertisementCount = 1000;
+  const int kTestRssi = -70;
+  for (int i = 0; i < kAdvertisementCount; ++i) {
+    const bt_bdaddr_t bda = {
+      { 0x01, 0x02, 0x03, 0x04, static_cast<uint8_t>(i >> 8),
+        static_cast<uint8_t>(i) }
+    };
+    controller->ReceiveAdvertisement(bda, kTestRssi, { 0x02, 0x01, 0x06 },
+                                     {});
+  }
+
+  // A few bulk reads wake up the host instead of every advertisement.
+  int reads = controller->read_count();
+  EXPECT_GE(reads, 2);
+  EXPECT_LE(reads, 3);
+  EXPECT_EQ(reads, delegate.batch_count());
+  EXPECT_EQ(0, delegate.scan_result_count());
+
+  // Stopping drains what is left in storage.
+  ASSERT_TRUE(le_client_->StopScan());
+  EXPECT_EQ(0, controller->scan_mode());
+  EXPECT_EQ(0, controller->dropped_count());
+  EXPECT_EQ(kAdvertisementCount, delegate.batch_result_count());
+
+  const ScanResult& last = delegate.last_batch().back();
+  EXPECT_EQ("01:02:03:04:03:E7", last.device_address());
+  EXPECT_EQ(kTestRssi, last.rssi());
+  EXPECT_TRUE(last.scan_record().empty());
+
+  le_client_->SetDelegate(nullptr);
+}
+
+TEST_F(LowEnergyClientPostRegisterTest, ControllerBatchScanFull) {
+  // Re-initialize the test with a controller model.
+  TearDown();
+  std::shared_ptr<BatchScanControllerHandler> controller(
+      new BatchScanControllerHandler());
+  mock_handler_ = std::static_pointer_cast<MockGattHandler>(controller);
+  SetUp();
+  controller->set_fake_iface(fake_hal_gatt_iface_);
+
+  TestDelegate delegate;
+  le_client_->SetDelegate(&delegate);
+
+  EXPECT_CALL(mock_adapter_, IsEnabled())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(mock_adapter_, IsOffloadedScanBatchingSupported())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(*mock_handler_, Scan(_))
+      .Times(0);
+
+  ScanSettings settings;
+  settings.set_report_delay(base::TimeDelta::FromHours(1));
+  std::vector<ScanFilter> filters(1);
+  filters[0].set_device_name("abc");
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+  EXPECT_EQ(2, controller->scan_mode());
+
+  const bt_bdaddr_t kTestAddress = {
+    { 0x01, 0x02, 0x03, 0x0A, 0x0B, 0x0C }
+  };
+  const std::vector<uint8_t> kAdvData = { 0x04, 0x09, 'a', 'b', 'c' };
+  const std::vector<uint8_t> kOtherAdvData = { 0x04, 0x09, 'x', 'y', 'z' };
+  const std::vector<uint8_t> kScanRsp = { 0x02, 0x0A, 0x04 };
+  for (int i = 0; i < 10; ++i) {
+    controller->ReceiveAdvertisement(
+        kTestAddress, -40 - i, i % 2 ? kOtherAdvData : kAdvData, kScanRsp);
+  }
+
+  ASSERT_TRUE(le_client_->StopScan());
+  EXPECT_EQ(1, controller->read_count());
+  EXPECT_EQ(1, delegate.batch_count());
+
+  // Only the advertisements that pass the filter are reported, with the scan
+  // response appended to the advertising data.
+  ASSERT_EQ(5u, delegate.last_batch().size());
+  std::vector<uint8_t> expected_record(kAdvData);
+  expected_record.insert(expected_record.end(), kScanRsp.begin(),
+                         kScanRsp.end());
+  for (int i = 0; i < 5; ++i) {
+    const ScanResult& result = delegate.last_batch()[i];
+    EXPECT_EQ("01:02:03:0A:0B:0C", result.device_address());
+    EXPECT_EQ(-40 - 2 * i, result.rssi());
+    EXPECT_EQ(expected_record, result.scan_record());
+  }
+
+  le_client_->SetDelegate(nullptr);
+}
+
+TEST_F(LowEnergyClientPostRegisterTest, ControllerBatchScanFallback) {
+  EXPECT_CALL(mock_adapter_, IsEnabled())
+      .WillRepeatedly(Return(true));
+  EXPECT_CALL(mock_adapter_, IsOffloadedScanBatchingSupported())
+      .WillRepeatedly(Return(true));
+
+  ScanSettings settings;
+  settings.set_report_delay(base::TimeDelta::FromHours(1));
+  std::vector<ScanFilter> filters;
+
+  // The controller fails to set up its storage, so the daemon batches the
+  // results of a regular scan instead.
+  EXPECT_CALL(*mock_handler_, BatchscanConfigStorage(_, _, _, _))
+      .Times(1)
+      .WillOnce(Return(BT_STATUS_FAIL));
+  EXPECT_CALL(*mock_handler_, Scan(true))
+      .Times(1)
+      .WillOnce(Return(BT_STATUS_SUCCESS));
+  ASSERT_TRUE(le_client_->StartScan(settings, filters));
+
+  EXPECT_CALL(*mock_handler_, BatchscanDisable(_))
+      .Times(0);
+  EXPECT_CALL(*mock_handler_, Scan(false))
+      .Times(1)
+      .WillOnce(Return(BT_STATUS_SUCCESS));
+  ASSERT_TRUE(le_client_->StopScan());
+
+  ::testing::Mock::VerifyAndClearExpectations(mock_handler_.get());
+}
+
 MATCHER_P(BitEq, x, std::string(negation ? "isn't" : "is") +
                         " bitwise equal to " + ::testing::PrintToString(x)) {
   static_assert(sizeof(x) == sizeof(arg), "Size mismatch");
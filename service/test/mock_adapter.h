@@ -41,6 +41,7 @@ class MockAdapter : public Adapter {
   MOCK_METHOD1(IsDeviceConnected, bool(const std::string&));
   MOCK_METHOD0(GetTotalNumberOfTrackableAdvertisements, int());
   MOCK_METHOD0(IsOffloadedFilteringSupported, bool());
+  MOCK_METHOD0(GetTotalNumberOfOffloadedFilters, int());
   MOCK_METHOD0(IsOffloadedScanBatchingSupported, bool());
   MOCK_CONST_METHOD0(GetLowEnergyClientFactory, LowEnergyClientFactory*());
   MOCK_CONST_METHOD0(GetGattClientFactory, GattClientFactory*());
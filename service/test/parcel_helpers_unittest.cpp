@@ -174,6 +174,9 @@ TEST(ParcelHelpersTest, ScanSettings) {
 
   EXPECT_TRUE(TestScanSettings(settings0));
   EXPECT_TRUE(TestScanSettings(settings1));
+
+  settings1.set_report_batch_size(25);
+  EXPECT_TRUE(TestScanSettings(settings1));
 }
 
 TEST(ParcelHelpersTest, ScanFilter) {
@@ -0,0 +1,593 @@
+//
+//  Copyright (C) 2016 Google, Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at:
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "service/adapter.h"
+#include "service/hal/fake_bluetooth_gatt_interface.h"
+#include "service/logging_helpers.h"
+#include "service/scan_filter_manager.h"
+#include "test/mock_adapter.h"
+
+using ::testing::_;
+using ::testing::AnyNumber;
+using ::testing::Return;
+using ::testing::SaveArg;
+
+namespace bluetooth {
+namespace {
+
+const int kFilterTypeAddress = 0;
+const int kFilterTypeServiceUuid = 2;
+const int kFilterTypeLocalName = 4;
+const int kActionAdd = 0;
+const int kDeliveryModeImmediate = 0;
+const int kDeliveryModeBatch = 2;
+
+// Filter indices and conditions of the other types the fake controller has
+// space for.
+const int kMaxIndices = 8;
+const int kMaxConditions = 16;
+
+// The advertisement of a device, as far as the controller filters look at
+// it.
+struct Advertisement {
+  std::string address;
+  std::string name;
+  UUID service_uuid;
+};
+
+// Acts like a controller with APCF support: keeps the conditions programmed
+// into each filter index, with room for |max_names| local names, and checks
+// advertisements against them. Like the stack, it reports the space left
+// after each add.
+class FakeFilterController
+    : public hal::FakeBluetoothGattInterface::TestClientHandler {
+ public:
+  explicit FakeFilterController(int max_names)
+      : max_names_(max_names), fake_iface_(nullptr), enabled_(false),
+        reject_calls_(false), rejected_(0) {
+  }
+  ~FakeFilterController() override = default;
+
+  void set_fake_iface(hal::FakeBluetoothGattInterface* fake_iface) {
+    fake_iface_ = fake_iface;
+  }
+
+  // Makes the HAL reject adds that don't fit right away, and report nothing
+  // about the space left.
+  void set_reject_calls(bool reject_calls) { reject_calls_ = reject_calls; }
+
+  void set_max_names(int max_names) { max_names_ = max_names; }
+
+  // Forgets all filters, like a controller that was turned off.
+  void Reset() {
+    indices_.clear();
+    enabled_ = false;
+  }
+
+  bool enabled() const { return enabled_; }
+
+  // Returns the number of adds that did not fit.
+  int rejected() const { return rejected_; }
+
+  int GetNumberOfConditions(int type) const {
+    int count = 0;
+    for (const auto& index : indices_)
+      count += index.second.conditions.count(type);
+    return count;
+  }
+
+  // Returns true if the controller reports |adv| for |delivery_mode|.
+  bool Passes(const Advertisement& adv, int delivery_mode) const {
+    if (!enabled_)
+      return true;
+
+    for (const auto& iter : indices_) {
+      const Index& index = iter.second;
+      if (!index.set_up || index.delivery_mode != delivery_mode)
+        continue;
+
+      bool passes = true;
+      for (int type : { kFilterTypeAddress, kFilterTypeServiceUuid,
+                        kFilterTypeLocalName }) {
+        if (!(index.feat_seln & (1 << type)))
+          continue;
+
+        bool any = false;
+        auto range = index.conditions.equal_range(type);
+        for (auto cond = range.first; cond != range.second; ++cond)
+          any |= Matches(type, cond->second, adv);
+        passes &= any;
+      }
+      if (passes)
+        return true;
+    }
+
+    return false;
+  }
+
+ private:
+  struct Index {
+    Index() : set_up(false), feat_seln(0), delivery_mode(0) {}
+
+    bool set_up;
+    int feat_seln;
+    int delivery_mode;
+    std::multimap<int, std::string> conditions;
+  };
+
+  static bool Matches(int type, const std::string& value,
+                      const Advertisement& adv) {
+    if (type == kFilterTypeAddress || type == kFilterTypeLocalName)
+      return value == (type == kFilterTypeAddress ? adv.address : adv.name);
+
+    UUID::UUID128Bit uuid = adv.service_uuid.GetFullBigEndian();
+    for (size_t i = 0; i < uuid.size(); ++i) {
+      uint8_t mask = value[uuid.size() + i];
+      if ((uuid[i] & mask) != (static_cast<uint8_t>(value[i]) & mask))
+        return false;
+    }
+    return true;
+  }
+
+  bt_status_t ScanFilterParamSetup(btgatt_filt_param_setup_t params) override {
+    if (params.action != kActionAdd) {
+      indices_.erase(params.filt_index);
+      return BT_STATUS_SUCCESS;
+    }
+
+    Index& index = indices_[params.filt_index];
+    index.set_up = true;
+    index.feat_seln = params.feat_seln;
+    index.delivery_mode = params.dely_mode;
+    if (!reject_calls_) {
+      int set_up = 0;
+      for (const auto& iter : indices_)
+        set_up += iter.second.set_up;
+      fake_iface_->NotifyScanFilterParamCallback(
+          params.action, params.client_if, BT_STATUS_SUCCESS,
+          kMaxIndices - set_up);
+    }
+    return BT_STATUS_SUCCESS;
+  }
+
+  bt_status_t ScanFilterAddRemove(
+      int client_if, int action, int filt_type, int filt_index,
+      int /* company_id */, int /* company_id_mask */, const bt_uuid_t* p_uuid,
+      const bt_uuid_t* p_uuid_mask, const bt_bdaddr_t* bd_addr,
+      char /* addr_type */, int data_len, char* p_data, int /* mask_len */,
+      char* /* p_mask */) override {
+    EXPECT_EQ(kActionAdd, action);
+
+    // Like the stack, report running out of space asynchronously.
+    int max = filt_type == kFilterTypeLocalName ? max_names_ : kMaxConditions;
+    if (GetNumberOfConditions(filt_type) >= max) {
+      rejected_++;
+      if (reject_calls_)
+        return BT_STATUS_FAIL;
+      fake_iface_->NotifyScanFilterCfgCallback(action, client_if,
+                                               BT_STATUS_NOMEM, filt_type, 0);
+      return BT_STATUS_SUCCESS;
+    }
+
+    std::string value;
+    switch (filt_type) {
+      case kFilterTypeAddress:
+        value = BtAddrString(bd_addr);
+        break;
+      case kFilterTypeServiceUuid: {
+        UUID::UUID128Bit uuid = UUID(*p_uuid).GetFullBigEndian();
+        UUID::UUID128Bit mask = UUID(*p_uuid_mask).GetFullBigEndian();
+        value.assign(uuid.begin(), uuid.end());
+        value.append(mask.begin(), mask.end());
+        break;
+      }
+      case kFilterTypeLocalName:
+        value.assign(p_data, data_len);
+        break;
+      default:
+        ADD_FAILURE() << "Unexpected filter type: " << filt_type;
+        return BT_STATUS_FAIL;
+    }
+
+    indices_[filt_index].conditions.emplace(filt_type, value);
+    if (!reject_calls_)
+      fake_iface_->NotifyScanFilterCfgCallback(
+          action, client_if, BT_STATUS_SUCCESS, filt_type,
+          max - GetNumberOfConditions(filt_type));
+    return BT_STATUS_SUCCESS;
+  }
+
+  bt_status_t ScanFilterClear(int /* client_if */, int filt_index) override {
+    indices_[filt_index].conditions.clear();
+    return BT_STATUS_SUCCESS;
+  }
+
+  bt_status_t ScanFilterEnable(int /* client_if */, bool enable) override {
+    enabled_ = enable;
+    return BT_STATUS_SUCCESS;
+  }
+
+  // Stub implementations for uninteresting TestClientHandler methods:
+  bt_status_t RegisterClient(bt_uuid_t*) override { return BT_STATUS_FAIL; }
+  bt_status_t UnregisterClient(int) override { return BT_STATUS_FAIL; }
+  bt_status_t Scan(bool) override { return BT_STATUS_FAIL; }
+
+  bt_status_t Connect(int, const bt_bdaddr_t*, bool, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t Disconnect(int, const bt_bdaddr_t*, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t MultiAdvEnable(int, int, int, int, int, int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t MultiAdvSetInstData(int, bool, bool, bool, int,
+                                  int, char*, int, char*, int, char*) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t MultiAdvDisable(int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t BatchscanConfigStorage(int, int, int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t BatchscanEnable(int, int, int, int, int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t BatchscanDisable(int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  bt_status_t BatchscanReadReports(int, int) override {
+    return BT_STATUS_FAIL;
+  }
+
+  int max_names_;
+  hal::FakeBluetoothGattInterface* fake_iface_;
+  bool enabled_;
+  bool reject_calls_;
+  int rejected_;
+  std::map<int, Index> indices_;
+
+  DISALLOW_COPY_AND_ASSIGN(FakeFilterController);
+};
+
+ScanFilter NameFilter(const std::string& name) {
+  ScanFilter filter;
+  filter.set_device_name(name);
+  return filter;
+}
+
+ScanFilter AddressAndNameFilter(const std::string& address,
+                                const std::string& name) {
+  ScanFilter filter;
+  EXPECT_TRUE(filter.SetDeviceAddress(address));
+  filter.set_device_name(name);
+  return filter;
+}
+
+class ScanFilterManagerTest : public ::testing::Test {
+ public:
+  ScanFilterManagerTest() = default;
+  ~ScanFilterManagerTest() override = default;
+
+  void SetUp() override {
+    SetUpController(16);
+  }
+
+  void TearDown() override {
+    manager_.reset();
+    hal::BluetoothGattInterface::CleanUp();
+  }
+
+ protected:
+  // Sets up a controller with space for |max_names| local names and 8 filter
+  // indices, one of which the stack keeps for itself.
+  void SetUpController(int max_names) {
+    manager_.reset();
+    if (hal::BluetoothGattInterface::IsInitialized())
+      hal::BluetoothGattInterface::CleanUp();
+
+    controller_.reset(new FakeFilterController(max_names));
+    fake_hal_gatt_iface_ = new hal::FakeBluetoothGattInterface(
+        std::static_pointer_cast<
+            hal::FakeBluetoothGattInterface::TestClientHandler>(controller_),
+        nullptr);
+    controller_->set_fake_iface(fake_hal_gatt_iface_);
+    hal::BluetoothGattInterface::InitializeForTesting(fake_hal_gatt_iface_);
+
+    EXPECT_CALL(mock_adapter_, IsOffloadedFilteringSupported())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(mock_adapter_, GetTotalNumberOfOffloadedFilters())
+        .WillRepeatedly(Return(kMaxIndices));
+    EXPECT_CALL(mock_adapter_, AddObserver(_))
+        .WillRepeatedly(SaveArg<0>(&adapter_observer_));
+    EXPECT_CALL(mock_adapter_, RemoveObserver(_)).Times(AnyNumber());
+
+    manager_.reset(new ScanFilterManager(mock_adapter_));
+  }
+
+  void SetClientFilters(int client_id, const std::vector<ScanFilter>& filters,
+                        bool batched = false) {
+    manager_->SetClientFilters(fake_hal_gatt_iface_, client_id, filters,
+                               batched);
+  }
+
+  bool Passes(const Advertisement& adv,
+              int delivery_mode = kDeliveryModeImmediate) {
+    return controller_->Passes(adv, delivery_mode);
+  }
+
+  // Turns the adapter off and on again.
+  void RestartAdapter() {
+    controller_->Reset();
+    const AdapterState kStates[] = {
+      ADAPTER_STATE_ON, ADAPTER_STATE_TURNING_OFF, ADAPTER_STATE_OFF,
+      ADAPTER_STATE_TURNING_ON, ADAPTER_STATE_ON
+    };
+    for (size_t i = 1; i < arraysize(kStates); ++i)
+      adapter_observer_->OnAdapterStateChanged(&mock_adapter_, kStates[i - 1],
+                                               kStates[i]);
+  }
+
+  testing::MockAdapter mock_adapter_;
+  Adapter::Observer* adapter_observer_;
+  hal::FakeBluetoothGattInterface* fake_hal_gatt_iface_;
+  std::shared_ptr<FakeFilterController> controller_;
+  std::unique_ptr<ScanFilterManager> manager_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScanFilterManagerTest);
+};
+
+TEST_F(ScanFilterManagerTest, SharedFilters) {
+  // The same name asked for by two clients and the names of a third one all
+  // go into one filter index.
+  SetClientFilters(1, { NameFilter("abc") });
+  SetClientFilters(2, { NameFilter("abc") });
+  SetClientFilters(3, { NameFilter("def"), NameFilter("ghi") });
+
+  EXPECT_TRUE(controller_->enabled());
+  EXPECT_EQ(1u, manager_->GetNumberOfControllerFilters());
+  EXPECT_EQ(3, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "abc", UUID() }));
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "ghi", UUID() }));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "xyz", UUID() }));
+
+  // Removing a client that shares its filter keeps it programmed.
+  manager_->RemoveClientFilters(fake_hal_gatt_iface_, 3);
+  manager_->RemoveClientFilters(fake_hal_gatt_iface_, 1);
+  EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "abc", UUID() }));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "ghi", UUID() }));
+
+  manager_->RemoveClientFilters(fake_hal_gatt_iface_, 2);
+  EXPECT_FALSE(controller_->enabled());
+  EXPECT_EQ(0u, manager_->GetNumberOfControllerFilters());
+  EXPECT_EQ(0, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+}
+
+TEST_F(ScanFilterManagerTest, NarrowerFilters) {
+  const UUID kUuid("180D");
+
+  ScanFilter uuid_filter;
+  uuid_filter.SetServiceUuid(kUuid);
+  ScanFilter narrower_filter = uuid_filter;
+  narrower_filter.set_device_name("abc");
+
+  // The second filter only lets through what the first one does already.
+  SetClientFilters(1, { uuid_filter });
+  SetClientFilters(2, { narrower_filter });
+
+  EXPECT_EQ(1u, manager_->GetNumberOfControllerFilters());
+  EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeServiceUuid));
+  EXPECT_EQ(0, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "abc", kUuid }));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "abc", UUID("180E") }));
+}
+
+TEST_F(ScanFilterManagerTest, DeliveryModes) {
+  SetClientFilters(1, { NameFilter("abc") });
+  SetClientFilters(2, { NameFilter("def") }, true /* batched */);
+
+  EXPECT_EQ(2u, manager_->GetNumberOfControllerFilters());
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "abc", UUID() },
+                     kDeliveryModeImmediate));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "def", UUID() },
+                      kDeliveryModeImmediate));
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "def", UUID() },
+                     kDeliveryModeBatch));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "abc", UUID() },
+                      kDeliveryModeBatch));
+}
+
+TEST_F(ScanFilterManagerTest, ClientWithoutFilters) {
+  SetClientFilters(1, { NameFilter("abc") });
+  EXPECT_TRUE(controller_->enabled());
+
+  // A client that wants every result leaves nothing to filter.
+  SetClientFilters(2, {});
+  EXPECT_FALSE(controller_->enabled());
+  EXPECT_EQ(0u, manager_->GetNumberOfControllerFilters());
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "xyz", UUID() }));
+
+  manager_->RemoveClientFilters(fake_hal_gatt_iface_, 2);
+  EXPECT_TRUE(controller_->enabled());
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "xyz", UUID() }));
+}
+
+TEST_F(ScanFilterManagerTest, FilteringNotSupported) {
+  EXPECT_CALL(mock_adapter_, IsOffloadedFilteringSupported())
+      .WillRepeatedly(Return(false));
+
+  SetClientFilters(1, { NameFilter("abc") });
+  EXPECT_FALSE(controller_->enabled());
+  EXPECT_EQ(0u, manager_->GetNumberOfControllerFilters());
+}
+
+TEST_F(ScanFilterManagerTest, OutOfFilterIndices) {
+  // Ten filters on an address and a name each, but only 7 filter indices.
+  std::vector<Advertisement> advs;
+  for (int i = 0; i < 10; ++i) {
+    Advertisement adv;
+    adv.address = "01:02:03:04:05:0" + std::to_string(i);
+    adv.name = "device" + std::to_string(i);
+    advs.push_back(adv);
+    SetClientFilters(i, { AddressAndNameFilter(adv.address, adv.name) });
+  }
+
+  EXPECT_TRUE(controller_->enabled());
+  EXPECT_GE(7u, manager_->GetNumberOfControllerFilters());
+  EXPECT_LT(0u, manager_->GetNumberOfControllerFilters());
+
+  // Every client still gets what it asked for, and the controller still
+  // drops advertisements nobody asked for.
+  for (const auto& adv : advs)
+    EXPECT_TRUE(Passes(adv));
+  EXPECT_FALSE(Passes({ "0A:0B:0C:0D:0E:0F", "other", UUID() }));
+}
+
+TEST_F(ScanFilterManagerTest, OutOfConditions) {
+  SetUpController(2);
+
+  const char* kNames[] = { "abc", "def", "ghi" };
+  const char* kUuids[] = { "180D", "180E", "180F" };
+  std::vector<Advertisement> advs;
+  for (int i = 0; i < 3; ++i) {
+    ScanFilter filter;
+    filter.set_device_name(kNames[i]);
+    filter.SetServiceUuid(UUID(kUuids[i]));
+    advs.push_back({ "01:02:03:04:05:06", kNames[i], UUID(kUuids[i]) });
+    SetClientFilters(i, { filter });
+  }
+
+  // The controller has no space for the third name, so one of the filters
+  // gives up its name and only checks the UUID.
+  EXPECT_TRUE(controller_->enabled());
+  EXPECT_EQ(2, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+  EXPECT_EQ(3, controller_->GetNumberOfConditions(kFilterTypeServiceUuid));
+
+  for (const auto& adv : advs)
+    EXPECT_TRUE(Passes(adv));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "abc", UUID("1810") }));
+
+  // With three more names that fit nowhere, the controller has to let
+  // everything through.
+  SetClientFilters(3, { NameFilter("jkl"), NameFilter("mno"),
+                        NameFilter("pqr") });
+  EXPECT_FALSE(controller_->enabled());
+  EXPECT_EQ(0u, manager_->GetNumberOfControllerFilters());
+
+  // Once they are gone, the filters that fit come back.
+  manager_->RemoveClientFilters(fake_hal_gatt_iface_, 3);
+  EXPECT_TRUE(controller_->enabled());
+  for (const auto& adv : advs)
+    EXPECT_TRUE(Passes(adv));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "abc", UUID("1810") }));
+}
+
+TEST_F(ScanFilterManagerTest, ReportedSpace) {
+  SetUpController(2);
+
+  // The first name tells how many fit, so four names are never tried.
+  SetClientFilters(1, { NameFilter("abc") });
+  EXPECT_TRUE(controller_->enabled());
+  SetClientFilters(2, { NameFilter("def"), NameFilter("ghi"),
+                        NameFilter("jkl") });
+
+  EXPECT_EQ(0, controller_->rejected());
+  EXPECT_FALSE(controller_->enabled());
+  EXPECT_EQ(0u, manager_->GetNumberOfControllerFilters());
+
+  manager_->RemoveClientFilters(fake_hal_gatt_iface_, 2);
+  EXPECT_TRUE(controller_->enabled());
+  EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+}
+
+TEST_F(ScanFilterManagerTest, RejectedCall) {
+  SetUpController(1);
+  controller_->set_reject_calls(true);
+
+  SetClientFilters(1, { NameFilter("abc") });
+
+  // The address added before the name was rejected is taken back.
+  SetClientFilters(2, { AddressAndNameFilter("01:02:03:04:05:06", "def") });
+  EXPECT_EQ(1, controller_->rejected());
+  EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeAddress));
+  EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "def", UUID() }));
+  EXPECT_TRUE(Passes({ "0A:0B:0C:0D:0E:0F", "abc", UUID() }));
+  EXPECT_FALSE(Passes({ "0A:0B:0C:0D:0E:0F", "def", UUID() }));
+
+  // Going back and forth keeps the counts in line with the controller.
+  for (int i = 0; i < 3; ++i) {
+    manager_->RemoveClientFilters(fake_hal_gatt_iface_, 2);
+    EXPECT_EQ(0, controller_->GetNumberOfConditions(kFilterTypeAddress));
+    EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+    SetClientFilters(2, { AddressAndNameFilter("01:02:03:04:05:06", "def") });
+    EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeAddress));
+  }
+  EXPECT_EQ(1, controller_->rejected());
+}
+
+TEST_F(ScanFilterManagerTest, AdapterRestart) {
+  SetUpController(1);
+  controller_->set_reject_calls(true);
+
+  // The second name is rejected, so the controller lets everything through.
+  SetClientFilters(1, { NameFilter("abc") });
+  SetClientFilters(2, { NameFilter("def") });
+  EXPECT_EQ(1, controller_->rejected());
+  EXPECT_FALSE(controller_->enabled());
+
+  // After a restart the controller has no filters left but turns out to have
+  // space for both names, which are tried again on the next update.
+  controller_->set_max_names(2);
+  RestartAdapter();
+  SetClientFilters(2, { NameFilter("def") });
+  EXPECT_EQ(1, controller_->rejected());
+  EXPECT_TRUE(controller_->enabled());
+  EXPECT_EQ(1u, manager_->GetNumberOfControllerFilters());
+  EXPECT_EQ(2, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "abc", UUID() }));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "xyz", UUID() }));
+
+  // Removing a client only clears what was programmed since the restart.
+  manager_->RemoveClientFilters(fake_hal_gatt_iface_, 1);
+  EXPECT_EQ(1, controller_->GetNumberOfConditions(kFilterTypeLocalName));
+  EXPECT_FALSE(Passes({ "01:02:03:04:05:06", "abc", UUID() }));
+  EXPECT_TRUE(Passes({ "01:02:03:04:05:06", "def", UUID() }));
+}
+
+}  // namespace
+}  // namespace bluetooth
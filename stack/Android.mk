@@ -130,6 +130,7 @@ LOCAL_SRC_FILES:= \
     ./sdp/sdp_utils.c \
     ./sdp/sdp_api.c \
     ./sdp/sdp_discovery.c \
+    ./sdp/sdp_disc_cache.c \
     ./pan/pan_main.c \
     ./srvc/srvc_battery.c \
     ./srvc/srvc_dis.c \
@@ -163,3 +164,45 @@ LOCAL_CONLYFLAGS += $(bluetooth_CONLYFLAGS)
 LOCAL_CPPFLAGS += $(bluetooth_CPPFLAGS)
 
 include $(BUILD_STATIC_LIBRARY)
+
+# Bluetooth stack unit tests for target
+# ========================================================
+include $(CLEAR_VARS)
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/include \
+    $(LOCAL_PATH)/avdt \
+    $(LOCAL_PATH)/btm \
+    $(LOCAL_PATH)/sdp \
+    $(LOCAL_PATH)/../btcore/include \
+    $(LOCAL_PATH)/../include \
+    $(LOCAL_PATH)/../osi/test \
+    $(LOCAL_PATH)/../utils/include \
+    $(LOCAL_PATH)/.. \
+    $(bluetooth_C_INCLUDES)
+
+LOCAL_SRC_FILES := \
+    ../osi/test/AllocationTestHarness.cpp \
+    ./avdt/avdt_scb_act.c \
+    ./sdp/sdp_db.c \
+    ./sdp/sdp_disc_cache.c \
+    ./sdp/sdp_server.c \
+    ./sdp/sdp_utils.c \
+    ./test/avdt_scb_act_test.cpp \
+    ./test/sdp_disc_cache_test.cpp \
+    ./test/sdp_server_test.cpp \
+    ./test/stack_test_stubs.cpp
+
+LOCAL_MODULE := net_test_stack
+LOCAL_MODULE_TAGS := tests
+LOCAL_SHARED_LIBRARIES := liblog libdl
+LOCAL_STATIC_LIBRARIES := libosi libcutils
+
+LOCAL_CFLAGS += $(bluetooth_CFLAGS) \
+    -DSDP_DISC_CACHE_FILE=\"/data/local/tmp/sdp_disc_cache_test.bin\" \
+    -DSDP_AVRCP_1_6=TRUE \
+    -DAVRC_PEER_VERSION_CONF_FILE=\"/data/local/tmp/sdp_server_test_avrc.conf\"
+LOCAL_CONLYFLAGS += $(bluetooth_CONLYFLAGS)
+LOCAL_CPPFLAGS += $(bluetooth_CPPFLAGS)
+
+include $(BUILD_NATIVE_TEST)
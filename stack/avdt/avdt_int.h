@@ -457,10 +457,6 @@ typedef void (*tAVDT_CCB_ACTION)(tAVDT_CCB *p_ccb, tAVDT_CCB_EVT *p_data);
 typedef struct {
     BT_HDR      *p_buf;
     UINT32      time_stamp;
-#if AVDT_MULTIPLEXING == TRUE
-    UINT8       *p_data;
-    UINT32      data_len;
-#endif
     UINT8       m_pt;
     tAVDT_DATA_OPT_MASK     opt;
 } tAVDT_SCB_APIWRITE;
@@ -503,9 +499,12 @@ typedef struct {
     UINT8           close_code;     /* Error code received in close response */
 #if AVDT_MULTIPLEXING == TRUE
     fixed_queue_t   *frag_q;        /* Queue for outgoing media fragments */
-    UINT32          frag_off;       /* length of already received media fragments */
-    UINT32          frag_org_len;   /* original length before fragmentation of receiving media packet */
-    UINT8           *p_next_frag;   /* next fragment to send */
+    UINT32          frag_off;       /* length of already received media fragments, or
+                                       length still to fragment of the sent one */
+    UINT32          frag_org_len;   /* original length before fragmentation of receiving
+                                       or sent media packet */
+    BT_HDR          *p_frag_src;    /* media packet being fragmented, its payload starts
+                                       at the next fragment to send */
     UINT8           *p_media_buf;   /* buffer for media packet assigned by AVDT_SetMediaBuf */
     UINT32          media_buf_len;  /* length of buffer for media packet assigned by AVDT_SetMediaBuf */
 #endif
@@ -678,7 +677,8 @@ extern void avdt_scb_clr_pkt(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data);
 extern void avdt_scb_transport_channel_timer(tAVDT_SCB *p_scb,
                                              tAVDT_SCB_EVT *p_data);
 extern void avdt_scb_clr_vars(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data);
-extern void avdt_scb_queue_frags(tAVDT_SCB *p_scb, UINT8 **pp_data, UINT32 *p_data_len);
+extern void avdt_scb_queue_frags(tAVDT_SCB *p_scb, BOOLEAN first);
+extern void avdt_scb_clr_frags(tAVDT_SCB *p_scb);
 
 /* msg function declarations */
 extern BOOLEAN avdt_msg_send(tAVDT_CCB *p_ccb, BT_HDR *p_msg);
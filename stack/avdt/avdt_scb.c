@@ -651,6 +651,7 @@ void avdt_scb_dealloc(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
 #if AVDT_MULTIPLEXING == TRUE
     /* free fragments we're holding, if any; it shouldn't happen */
     fixed_queue_free(p_scb->frag_q, osi_free);
+    osi_free(p_scb->p_frag_src);
 #endif
 
     memset(p_scb, 0, sizeof(tAVDT_SCB));
@@ -38,6 +38,7 @@
 #include "avdt_int.h"
 #include "bt_common.h"
 #include "btu.h"
+#include "osi/include/perf_trace.h"
 
 
 extern fixed_queue_t *btu_general_alarm_queue;
@@ -1331,81 +1332,87 @@ void avdt_scb_hdl_write_req_no_frag(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
 **
 ** Function         avdt_scb_hdl_write_req_frag
 **
-** Description      This function builds a new fragments of media packet from
-**                  the passed in buffers and stores them in the SCB.
+** Description      This function adds the media header, if required, to a
+**                  media packet that does not fit the peer MTU and queues
+**                  its first fragments. The packet itself is kept as the
+**                  source of the remaining fragments.
 **
 ** Returns          Nothing.
 **
 *******************************************************************************/
 void avdt_scb_hdl_write_req_frag(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
 {
+    BT_HDR  *p_buf = p_data->apiwrite.p_buf;
     UINT8   *p;
     UINT32  ssrc;
 
     /* free fragments we're holding, if any; it shouldn't happen */
-    if (!fixed_queue_is_empty(p_scb->frag_q))
+    if (!fixed_queue_is_empty(p_scb->frag_q) || p_scb->p_frag_src != NULL)
     {
         /* this shouldn't be happening */
         AVDT_TRACE_WARNING("*** Dropped media packet; congested");
-        BT_HDR *p_frag;
-        while ((p_frag = (BT_HDR*)fixed_queue_try_dequeue(p_scb->frag_q)) != NULL)
-             osi_free(p_frag);
+        avdt_scb_clr_frags(p_scb);
     }
 
-    /* build a media fragments */
-    p_scb->frag_off = p_data->apiwrite.data_len;
-    p_scb->p_next_frag = p_data->apiwrite.p_data;
-
-    ssrc = avdt_scb_gen_ssrc(p_scb);
-
-    if (! fixed_queue_is_empty(p_scb->frag_q)) {
-        list_t *list = fixed_queue_get_list(p_scb->frag_q);
-        const list_node_t *node = list_begin(list);
-        if (node != list_end(list)) {
-            BT_HDR *p_frag = (BT_HDR *)list_node(node);
-            node = list_next(node);
-
-            /* get first packet */
-            /* posit on Adaptation Layer header */
-            p_frag->len += AVDT_AL_HDR_SIZE + AVDT_MEDIA_HDR_SIZE;
-            p_frag->offset -= AVDT_AL_HDR_SIZE + AVDT_MEDIA_HDR_SIZE;
-            p = (UINT8 *)(p_frag + 1) + p_frag->offset;
-
-            /* Adaptation Layer header */
-            /* TSID, no-fragment bit and coding of length (in 2 length octets
-             * following)
-             */
-            *p++ = (p_scb->curr_cfg.mux_tsid_media<<3) | AVDT_ALH_LCODE_16BIT;
-
-            /* length of all remaining transport packet */
-            UINT16_TO_BE_STREAM(p, p_frag->layer_specific + AVDT_MEDIA_HDR_SIZE );
-            /* media header */
-            UINT8_TO_BE_STREAM(p, AVDT_MEDIA_OCTET1);
-            UINT8_TO_BE_STREAM(p, p_data->apiwrite.m_pt);
-            UINT16_TO_BE_STREAM(p, p_scb->media_seq);
-            UINT32_TO_BE_STREAM(p, p_data->apiwrite.time_stamp);
-            UINT32_TO_BE_STREAM(p, ssrc);
-            p_scb->media_seq++;
+    /* Add RTP header if required; it is part of the fragmented transport
+       packet, so it goes in the headroom in front of the payload */
+    if ( !(p_data->apiwrite.opt & AVDT_DATA_OPT_NO_RTP) )
+    {
+        if (p_buf->offset < AVDT_MEDIA_HDR_SIZE)
+        {
+            android_errorWriteWithInfoLog(0x534e4554, "242535997", -1, NULL, 0);
+            osi_free(p_buf);
+            return;
         }
 
-        for ( ; node != list_end(list); node = list_next(node)) {
-            BT_HDR *p_frag = (BT_HDR *)list_node(node);
-
-            /* posit on Adaptation Layer header */
-            p_frag->len += AVDT_AL_HDR_SIZE;
-            p_frag->offset -= AVDT_AL_HDR_SIZE;
-            p = (UINT8 *)(p_frag + 1) + p_frag->offset;
-            /* Adaptation Layer header */
-            /* TSID, fragment bit and coding of length (in 2 length octets
-             * following)
-             */
-            *p++ = (p_scb->curr_cfg.mux_tsid_media << 3) |
-                (AVDT_ALH_FRAG_MASK | AVDT_ALH_LCODE_16BIT);
-
-            /* length of all remaining transport packet */
-            UINT16_TO_BE_STREAM(p, p_frag->layer_specific);
-        }
+        ssrc = avdt_scb_gen_ssrc(p_scb);
+
+        p_buf->len += AVDT_MEDIA_HDR_SIZE;
+        p_buf->offset -= AVDT_MEDIA_HDR_SIZE;
+        p_scb->media_seq++;
+        p = (UINT8 *)(p_buf + 1) + p_buf->offset;
+
+        UINT8_TO_BE_STREAM(p, AVDT_MEDIA_OCTET1);
+        UINT8_TO_BE_STREAM(p, p_data->apiwrite.m_pt);
+        UINT16_TO_BE_STREAM(p, p_scb->media_seq);
+        UINT32_TO_BE_STREAM(p, p_data->apiwrite.time_stamp);
+        UINT32_TO_BE_STREAM(p, ssrc);
     }
+
+    p_scb->p_frag_src = p_buf;
+    p_scb->frag_org_len = p_buf->len;
+    p_scb->frag_off = p_buf->len;
+
+    avdt_scb_queue_frags(p_scb, TRUE);
+}
+
+/*******************************************************************************
+**
+** Function         avdt_scb_needs_frag
+**
+** Description      Check whether a media packet must be sent in fragments,
+**                  i.e. fragmentation is configured for the stream and the
+**                  packet with its headers exceeds the peer MTU.
+**
+** Returns          TRUE if the packet must be fragmented.
+**
+*******************************************************************************/
+static BOOLEAN avdt_scb_needs_frag(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
+{
+    tAVDT_TC_TBL    *p_tbl;
+    UINT32          len = p_data->apiwrite.p_buf->len + AVDT_AL_HDR_SIZE;
+
+    if ((p_scb->curr_cfg.psc_mask & AVDT_PSC_MUX) == 0)
+        return FALSE;
+
+    p_tbl = avdt_ad_tc_tbl_by_type(AVDT_CHAN_MEDIA, p_scb->p_ccb, p_scb);
+    if (p_tbl == NULL)
+        return FALSE;
+
+    if ( !(p_data->apiwrite.opt & AVDT_DATA_OPT_NO_RTP) )
+        len += AVDT_MEDIA_HDR_SIZE;
+
+    return (len > p_tbl->peer_mtu);
 }
 #endif
 
@@ -1422,8 +1429,10 @@ void avdt_scb_hdl_write_req_frag(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
 *******************************************************************************/
 void avdt_scb_hdl_write_req(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
 {
+    PERF_TRACE_SCOPE("avdtp_write");
+
 #if AVDT_MULTIPLEXING == TRUE
-    if (fixed_queue_is_empty(p_scb->frag_q))
+    if (!avdt_scb_needs_frag(p_scb, p_data))
 #endif
         avdt_scb_hdl_write_req_no_frag(p_scb, p_data);
 #if AVDT_MULTIPLEXING == TRUE
@@ -1510,11 +1519,7 @@ void avdt_scb_snd_stream_close(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
         fixed_queue_length(p_scb->frag_q), p_scb->frag_off);
 
     /* clean fragments queue */
-    BT_HDR *p_frag;
-    while ((p_frag = (BT_HDR*)fixed_queue_try_dequeue(p_scb->frag_q)) != NULL)
-        osi_free(p_frag);
-
-    p_scb->frag_off = 0;
+    avdt_scb_clr_frags(p_scb);
 #endif
     osi_free_and_reset((void **)&p_scb->p_pkt);
 
@@ -1943,9 +1948,7 @@ void avdt_scb_free_pkt(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
 
 #if AVDT_MULTIPLEXING == TRUE
     /* clean fragments queue */
-    BT_HDR          *p_frag;
-    while ((p_frag = (BT_HDR*)fixed_queue_try_dequeue(p_scb->frag_q)) != NULL)
-         osi_free(p_frag);
+    avdt_scb_clr_frags(p_scb);
 #endif
 
     AVDT_TRACE_WARNING("Dropped media packet");
@@ -1996,14 +1999,11 @@ void avdt_scb_clr_pkt(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
                                   &avdt_ctrl);
     }
 #if AVDT_MULTIPLEXING == TRUE
-    else if (!fixed_queue_is_empty(p_scb->frag_q))
+    else if (!fixed_queue_is_empty(p_scb->frag_q) || p_scb->p_frag_src != NULL)
     {
         AVDT_TRACE_DEBUG("Dropped fragments queue");
         /* clean fragments queue */
-        BT_HDR *p_frag;
-        while ((p_frag = (BT_HDR*)fixed_queue_try_dequeue(p_scb->frag_q)) != NULL)
-             osi_free(p_frag);
-        p_scb->frag_off = 0;
+        avdt_scb_clr_frags(p_scb);
 
         /* we need to call callback to keep data flow going */
         (*p_scb->cs.p_ctrl_cback)(avdt_scb_to_hdl(p_scb), NULL, AVDT_WRITE_CFM_EVT,
@@ -2076,7 +2076,7 @@ void avdt_scb_chk_snd_pkt(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
                 if (AVDT_AD_SUCCESS == res || fixed_queue_is_empty(p_scb->frag_q))
                 {
                     /* all buffers were sent to L2CAP, compose more to queue */
-                    avdt_scb_queue_frags(p_scb, &p_scb->p_next_frag, &p_scb->frag_off);
+                    avdt_scb_queue_frags(p_scb, FALSE);
                     if (!fixed_queue_is_empty(p_scb->frag_q))
                     {
                         data.llcong = p_scb->cong;
@@ -2138,36 +2138,43 @@ void avdt_scb_clr_vars(tAVDT_SCB *p_scb, tAVDT_SCB_EVT *p_data)
 **
 ** Function         avdt_scb_queue_frags
 **
-** Description      This function breaks media payload into fragments
-**                  and put the fragments in the given queue.
+** Description      This function breaks the media packet being sent into
+**                  fragments and puts them in the fragments queue. Each
+**                  fragment but the last gets its own buffer sized to the
+**                  fragment. The last one is sent in the media packet
+**                  buffer itself, its Adaptation Layer header written over
+**                  payload already copied out, so the tail of the packet is
+**                  never copied. first is TRUE for the first call on a new
+**                  packet, when the fragment budget is taken from what is
+**                  still queued at L2CAP.
 **
 ** Returns          Nothing.
 **
 *******************************************************************************/
-void avdt_scb_queue_frags(tAVDT_SCB *p_scb, UINT8 **pp_data,
-                          UINT32 *p_data_len)
+void avdt_scb_queue_frags(tAVDT_SCB *p_scb, BOOLEAN first)
 {
     UINT16  lcid;
     UINT16  num_frag;
-    UINT16  mtu_used;
+    UINT16  frag_max;
+    UINT16  frag_len;
     UINT8   *p;
-    BOOLEAN al_hdr = FALSE;
     UINT8   tcid;
     tAVDT_TC_TBL    *p_tbl;
-    UINT16          buf_size;
-    UINT16          offset = AVDT_MEDIA_OFFSET + AVDT_AL_HDR_SIZE;
-    UINT16          cont_offset = offset - AVDT_MEDIA_HDR_SIZE;
+    BT_HDR          *p_src = p_scb->p_frag_src;
+    BT_HDR          *p_frag;
+    const UINT16    offset = AVDT_MEDIA_OFFSET - AVDT_MEDIA_HDR_SIZE + AVDT_AL_HDR_SIZE;
+
+    if (p_src == NULL)
+        return;
 
     tcid = avdt_ad_type_to_tcid(AVDT_CHAN_MEDIA, p_scb);
     lcid = avdt_cb.ad.rt_tbl[avdt_ccb_to_idx(p_scb->p_ccb)][tcid].lcid;
 
-    if( p_scb->frag_off != 0)
+    if (!first)
     {
         /* continuing process is usually triggered by un-congest event.
          * the number of buffers at L2CAP is very small (if not 0).
          * we do not need to L2CA_FlushChannel() */
-        offset = cont_offset;
-        al_hdr = TRUE;
         num_frag = AVDT_MAX_FRAG_COUNT;
     }
     else
@@ -2186,49 +2193,67 @@ void avdt_scb_queue_frags(tAVDT_SCB *p_scb, UINT8 **pp_data,
 
     /* look up transport channel table entry to get peer mtu */
     p_tbl = avdt_ad_tc_tbl_by_type(AVDT_CHAN_MEDIA, p_scb->p_ccb, p_scb);
-    buf_size = p_tbl->peer_mtu + BT_HDR_SIZE;
-    AVDT_TRACE_DEBUG("peer_mtu: %d, buf_size: %d num_frag=%d",
-        p_tbl->peer_mtu, buf_size, num_frag);
-
-    if (buf_size > AVDT_DATA_BUF_SIZE)
-        buf_size = AVDT_DATA_BUF_SIZE;
-
-    mtu_used = buf_size - BT_HDR_SIZE;
-
-    while (*p_data_len && num_frag) {
-        /* allocate buffer for fragment */
-        BT_HDR *p_frag = (BT_HDR *)osi_malloc(buf_size);
-
-        /* fill fragment by chunk of media payload */
-        p_frag->layer_specific = *p_data_len;/* length of all remaining transport packet */
-        p_frag->offset = offset;
-        /* adjust packet offset for continuing packets */
-        offset = cont_offset;
-
-        p_frag->len = mtu_used - p_frag->offset;
-        if(p_frag->len > *p_data_len)
-            p_frag->len = *p_data_len;
-        memcpy((UINT8*)(p_frag+1) + p_frag->offset, *pp_data, p_frag->len);
-        *pp_data += p_frag->len;
-        *p_data_len -= p_frag->len;
-        AVDT_TRACE_DEBUG("Prepared fragment len=%d", p_frag->len);
-
-        if(al_hdr)
+    frag_max = p_tbl->peer_mtu - AVDT_AL_HDR_SIZE;
+    AVDT_TRACE_DEBUG("peer_mtu: %d, num_frag=%d", p_tbl->peer_mtu, num_frag);
+
+    while (p_scb->frag_off && num_frag) {
+        frag_len = (p_scb->frag_off > frag_max) ? frag_max : (UINT16)p_scb->frag_off;
+
+        if (frag_len == p_scb->frag_off)
+        {
+            /* last fragment, send the rest of the media packet in place */
+            p_frag = p_src;
+            p_scb->p_frag_src = NULL;
+        }
+        else
         {
-            /* Adaptation Layer header */
-            p_frag->len += AVDT_AL_HDR_SIZE;
-            p_frag->offset -= AVDT_AL_HDR_SIZE;
-            p = (UINT8 *)(p_frag + 1) + p_frag->offset;
-            /* TSID, fragment bit and coding of length(in 2 length octets following) */
-            *p++ = (p_scb->curr_cfg.mux_tsid_media<<3) | (AVDT_ALH_FRAG_MASK|AVDT_ALH_LCODE_16BIT);
-
-            /* length of all remaining transport packet */
-            UINT16_TO_BE_STREAM(p, p_frag->layer_specific );
+            p_frag = (BT_HDR *)osi_malloc(BT_HDR_SIZE + offset + frag_len);
+            p_frag->offset = offset;
+            p_frag->len = frag_len;
+            p_frag->layer_specific = 0;
+            memcpy((UINT8 *)(p_frag + 1) + offset, (UINT8 *)(p_src + 1) + p_src->offset,
+                   frag_len);
+            p_src->offset += frag_len;
+            p_src->len -= frag_len;
         }
+        AVDT_TRACE_DEBUG("Prepared fragment len=%d", frag_len);
+
+        /* Adaptation Layer header */
+        p_frag->len += AVDT_AL_HDR_SIZE;
+        p_frag->offset -= AVDT_AL_HDR_SIZE;
+        p = (UINT8 *)(p_frag + 1) + p_frag->offset;
+        /* TSID, fragment bit and coding of length(in 2 length octets following) */
+        *p++ = (p_scb->curr_cfg.mux_tsid_media << 3) | AVDT_ALH_LCODE_16BIT |
+            ((p_scb->frag_off != p_scb->frag_org_len) ? AVDT_ALH_FRAG_MASK : 0);
+
+        /* length of all remaining transport packet */
+        UINT16_TO_BE_STREAM(p, p_scb->frag_off);
+
+        p_scb->frag_off -= frag_len;
+
         /* put fragment into gueue */
         fixed_queue_enqueue(p_scb->frag_q, p_frag);
         num_frag--;
     }
 }
-#endif
 
+/*******************************************************************************
+**
+** Function         avdt_scb_clr_frags
+**
+** Description      This function frees the queued fragments and the media
+**                  packet being fragmented.
+**
+** Returns          Nothing.
+**
+*******************************************************************************/
+void avdt_scb_clr_frags(tAVDT_SCB *p_scb)
+{
+    BT_HDR *p_frag;
+
+    while ((p_frag = (BT_HDR*)fixed_queue_try_dequeue(p_scb->frag_q)) != NULL)
+        osi_free(p_frag);
+    osi_free_and_reset((void **)&p_scb->p_frag_src);
+    p_scb->frag_off = 0;
+}
+#endif
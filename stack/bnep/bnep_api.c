@@ -586,6 +586,31 @@ tBNEP_RESULT  BNEP_Write (UINT16 handle,
 }
 
 
+/*******************************************************************************
+**
+** Function         BNEP_IsTxQueueFull
+**
+** Description      This function checks whether the transmit queue of a BNEP
+**                  connection is full, i.e. whether the next BNEP_WriteBuf on
+**                  this handle would be rejected with BNEP_Q_SIZE_EXCEEDED.
+**                  It lets callers that own a filled buffer hold on to it
+**                  instead of handing it over only to have it released.
+**
+** Parameters:      handle       - handle of the connection
+**
+** Returns:         TRUE if the transmit queue is full or the handle is invalid
+**
+*******************************************************************************/
+BOOLEAN BNEP_IsTxQueueFull (UINT16 handle)
+{
+    if ((!handle) || (handle > BNEP_MAX_CONNECTIONS))
+        return TRUE;
+
+    tBNEP_CONN *p_bcb = &(bnep_cb.bcb[handle - 1]);
+    return (fixed_queue_length(p_bcb->xmit_q) >= BNEP_MAX_XMITQ_DEPTH);
+}
+
+
 /*******************************************************************************
 **
 ** Function         BNEP_SetProtocolFilters
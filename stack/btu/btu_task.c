@@ -35,6 +35,7 @@
 #include "btu.h"
 #include "gap_int.h"
 #include "bt_common.h"
+#include "hci_layer.h"
 #include "hcimsgs.h"
 #include "l2c_int.h"
 #include "osi/include/alarm.h"
@@ -102,8 +103,28 @@ extern fixed_queue_t *btif_msg_queue;
 
 extern thread_t *bt_workqueue_thread;
 
+/* HCI receive time of the ACL packet being processed */
+static UINT64 acl_rx_time_us;
+
 static void btu_hci_msg_process(BT_HDR *p_msg);
 
+/*******************************************************************************
+**
+** Function         btu_acl_rx_time_us
+**
+** Description      Returns when the ACL packet currently being processed was
+**                  received by the HCI layer, in microseconds of boot time.
+**                  Only meaningful on the btu thread while the packet is
+**                  handled synchronously, e.g. from a GATT notification.
+**
+** Returns          receive time, or 0 if unknown
+**
+*******************************************************************************/
+UINT64 btu_acl_rx_time_us(void)
+{
+    return acl_rx_time_us;
+}
+
 void btu_hci_msg_ready(fixed_queue_t *queue, UNUSED_ATTR void *context) {
     BT_HDR *p_msg = (BT_HDR *)fixed_queue_dequeue(queue);
     btu_hci_msg_process(p_msg);
@@ -127,6 +148,7 @@ static void btu_hci_msg_process(BT_HDR *p_msg) {
 #endif
             break;
         case BT_EVT_TO_BTU_HCI_ACL:
+            acl_rx_time_us = hci_layer_take_acl_rx_time_us();
             /* All Acl Data goes to L2CAP */
             l2c_rcv_acl_data (p_msg);
             break;
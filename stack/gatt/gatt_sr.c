@@ -31,6 +31,7 @@
 #include "gatt_int.h"
 #include "l2c_api.h"
 #include "l2c_int.h"
+#include "osi/include/perf_trace.h"
 #define GATT_MTU_REQ_MIN_LEN        2
 
 
@@ -1441,6 +1442,8 @@ void gatts_process_value_conf(tGATT_TCB *p_tcb, UINT8 op_code)
 void gatt_server_handle_client_req (tGATT_TCB *p_tcb, UINT8 op_code,
                                     UINT16 len, UINT8 *p_data)
 {
+    PERF_TRACE_SCOPE("gatt_server_req");
+
     /* there is pending command, discard this one */
     if (!gatt_sr_cmd_empty(p_tcb) && op_code != GATT_HANDLE_VALUE_CONF)
         return;
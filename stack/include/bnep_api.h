@@ -370,6 +370,20 @@ extern tBNEP_RESULT  BNEP_Write (UINT16 handle,
                                  UINT8 *p_src_addr,
                                  BOOLEAN fw_ext_present);
 
+/*******************************************************************************
+**
+** Function         BNEP_IsTxQueueFull
+**
+** Description      This function checks whether the transmit queue of a BNEP
+**                  connection is full.
+**
+** Parameters:      handle       - handle of the connection
+**
+** Returns:         TRUE if the transmit queue is full or the handle is invalid
+**
+*******************************************************************************/
+extern BOOLEAN BNEP_IsTxQueueFull (UINT16 handle);
+
 /*******************************************************************************
 **
 ** Function         BNEP_SetProtocolFilters
@@ -68,6 +68,7 @@ extern const BD_ADDR        BT_BD_ANY;
 #if (defined(HCILP_INCLUDED) && HCILP_INCLUDED == TRUE)
 extern void btu_check_bt_sleep (void);
 #endif
+extern UINT64 btu_acl_rx_time_us(void);
 
 /* Functions provided by btu_hcif.c
 ************************************
@@ -383,6 +383,20 @@ extern tPAN_RESULT PAN_WriteBuf (UINT16 handle,
                                  BT_HDR *p_buf,
                                  BOOLEAN ext);
 
+/*******************************************************************************
+**
+** Function         PAN_IsTxQueueFull
+**
+** Description      This function checks whether a unicast PAN_WriteBuf on the
+**                  given connection would be rejected with PAN_Q_SIZE_EXCEEDED
+**
+** Parameters:      handle   - handle for the connection
+**
+** Returns          TRUE if the BNEP transmit queue is full, FALSE otherwise
+**
+*******************************************************************************/
+extern BOOLEAN PAN_IsTxQueueFull (UINT16 handle);
+
 /*******************************************************************************
 **
 ** Function         PAN_SetProtocolFilters
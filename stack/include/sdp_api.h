@@ -228,6 +228,9 @@ BOOLEAN SDP_ServiceSearchRequest (UINT8 *p_bd_addr,
 **                  SDP_ServiceSearchRequest is that this one does a
 **                  combined ServiceSearchAttributeRequest SDP function.
 **
+**                  If recent results for the same peer and filters are in the
+**                  discovery cache, they are returned without connecting.
+**
 ** Returns          TRUE if discovery started, FALSE if failed.
 **
 *******************************************************************************/
@@ -244,7 +247,8 @@ BOOLEAN SDP_ServiceSearchAttributeRequest (UINT8 *p_bd_addr,
 **                  The difference between this API function and the function
 **                  SDP_ServiceSearchRequest is that this one does a
 **                  combined ServiceSearchAttributeRequest SDP function with the
-**                  user data piggyback
+**                  user data piggyback. It uses the discovery cache the same
+**                  way SDP_ServiceSearchAttributeRequest does.
 **
 ** Returns          TRUE if discovery started, FALSE if failed.
 **
@@ -253,6 +257,22 @@ BOOLEAN SDP_ServiceSearchAttributeRequest2 (UINT8 *p_bd_addr,
                                                    tSDP_DISCOVERY_DB *p_db,
                                                    tSDP_DISC_CMPL_CB2 *p_cb, void * user_data);
 
+/*******************************************************************************
+**
+** Function         SDP_FlushDiscoveryCache
+**
+** Description      This function drops the cached ServiceSearchAttribute
+**                  results of a peer, so the next discovery goes over the air.
+**                  It should be called when the bond with the peer changes, or
+**                  when a profile finds the cached service info is wrong.
+**
+**                  If bd_addr is NULL, the results of all peers are dropped.
+**
+** Returns          void
+**
+*******************************************************************************/
+void SDP_FlushDiscoveryCache (BD_ADDR bd_addr);
+
 /* API of utilities to find data in the local discovery database */
 
 /*******************************************************************************
@@ -41,6 +41,7 @@
 #include "btm_api.h"
 #include "btm_int.h"
 #include "btcore/include/bdaddr.h"
+#include "osi/include/perf_trace.h"
 
 
 extern fixed_queue_t *btu_general_alarm_queue;
@@ -1149,6 +1150,7 @@ void l2c_link_check_send_pkts (tL2C_LCB *p_lcb, tL2C_CCB *p_ccb, BT_HDR *p_buf)
 {
     int         xx;
     BOOLEAN     single_write = FALSE;
+    PERF_TRACE_SCOPE("l2cap_check_send_pkts");
 
     /* Save the channel ID for faster counting */
     if (p_buf)
@@ -633,6 +633,51 @@ tPAN_RESULT PAN_WriteBuf (UINT16 handle, BD_ADDR dst, BD_ADDR src, UINT16 protoc
 }
 
 
+/*******************************************************************************
+**
+** Function         PAN_IsTxQueueFull
+**
+** Description      This function checks whether a unicast PAN_WriteBuf on the
+**                  given connection would be rejected with PAN_Q_SIZE_EXCEEDED.
+**                  The connection is resolved the same way PAN_WriteBuf does.
+**
+** Parameters:      handle   - handle for the connection
+**
+** Returns          TRUE if the BNEP transmit queue is full, FALSE otherwise
+**
+*******************************************************************************/
+BOOLEAN PAN_IsTxQueueFull (UINT16 handle)
+{
+    tPAN_CONN *pcb = NULL;
+
+    if (pan_cb.role == PAN_ROLE_INACTIVE || (!(pan_cb.num_conns)))
+        return FALSE;
+
+    if (pan_cb.active_role == PAN_ROLE_CLIENT)
+    {
+        for (UINT16 i = 0; i < MAX_PAN_CONNS; i++)
+        {
+            if (pan_cb.pcb[i].con_state == PAN_STATE_CONNECTED &&
+                pan_cb.pcb[i].src_uuid == UUID_SERVCLASS_PANU)
+            {
+                pcb = &pan_cb.pcb[i];
+                break;
+            }
+        }
+    }
+    else
+    {
+        pcb = pan_get_pcb_by_handle (handle);
+    }
+
+    /* Writes on a missing or inactive connection fail rather than congest */
+    if (!pcb || pcb->con_state != PAN_STATE_CONNECTED)
+        return FALSE;
+
+    return BNEP_IsTxQueueFull (pcb->handle);
+}
+
+
 /*******************************************************************************
 **
 ** Function         PAN_SetProtocolFilters
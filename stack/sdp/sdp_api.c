@@ -182,6 +182,9 @@ BOOLEAN SDP_ServiceSearchAttributeRequest (UINT8 *p_bd_addr, tSDP_DISCOVERY_DB *
 #if SDP_CLIENT_ENABLED == TRUE
     tCONN_CB     *p_ccb;
 
+    if (sdp_disc_cache_serve (p_bd_addr, p_db, p_cb, NULL, NULL))
+        return(TRUE);
+
     /* Specific BD address */
     p_ccb = sdp_conn_originate (p_bd_addr);
 
@@ -219,6 +222,9 @@ BOOLEAN SDP_ServiceSearchAttributeRequest2 (UINT8 *p_bd_addr, tSDP_DISCOVERY_DB
 #if SDP_CLIENT_ENABLED == TRUE
     tCONN_CB     *p_ccb;
 
+    if (sdp_disc_cache_serve (p_bd_addr, p_db, NULL, p_cb2, user_data))
+        return(TRUE);
+
     /* Specific BD address */
     p_ccb = sdp_conn_originate (p_bd_addr);
 
@@ -43,6 +43,25 @@
 /********************************************************************************/
 static BOOLEAN find_uuid_in_seq (UINT8 *p , UINT32 seq_len, UINT8 *p_his_uuid,
                                  UINT16 his_len, int nest_level);
+static void sdp_db_build_uuid_index (void);
+static tSDP_RECORD *sdp_db_index_search (tSDP_RECORD *p_rec, tSDP_UUID_SEQ *p_seq);
+
+/*******************************************************************************
+**
+** Function         sdp_db_changed
+**
+** Description      This function is called whenever a record or an attribute
+**                  is added or removed. It drops everything derived from the
+**                  database: the UUID index and the cached server responses.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_db_changed (void)
+{
+    sdp_cb.server_db.uuid_index_state = SDP_UUID_INDEX_STALE;
+    sdp_server_flush_rsp_cache ();
+}
 
 
 /*******************************************************************************
@@ -68,6 +87,12 @@ tSDP_RECORD *sdp_db_service_search (tSDP_RECORD *p_rec, tSDP_UUID_SEQ *p_seq)
     else
         p_rec++;
 
+    if (sdp_cb.server_db.uuid_index_state == SDP_UUID_INDEX_STALE)
+        sdp_db_build_uuid_index ();
+
+    if (sdp_cb.server_db.uuid_index_state == SDP_UUID_INDEX_READY)
+        return (sdp_db_index_search (p_rec, p_seq));
+
     /* Look through the records. The spec says that a match occurs if */
     /* the record contains all the passed UUIDs in it.                */
     for ( ; p_rec < p_end; p_rec++)
@@ -153,6 +178,188 @@ static BOOLEAN find_uuid_in_seq (UINT8 *p , UINT32 seq_len, UINT8 *p_uuid,
     return (FALSE);
 }
 
+/*******************************************************************************
+**
+** Function         uuid_index_cmp
+**
+** Description      qsort/bsearch comparator for the UUID index. Entries are
+**                  ordered by UUID, then by record.
+**
+** Returns          <0, 0 or >0
+**
+*******************************************************************************/
+static int uuid_index_cmp (const void *p1, const void *p2)
+{
+    const tSDP_UUID_INDEX_ENT *p_ent1 = (const tSDP_UUID_INDEX_ENT *)p1;
+    const tSDP_UUID_INDEX_ENT *p_ent2 = (const tSDP_UUID_INDEX_ENT *)p2;
+    int cmp = memcmp (p_ent1->uuid, p_ent2->uuid, MAX_UUID_SIZE);
+
+    if (cmp != 0)
+        return (cmp);
+    return ((int)p_ent1->rec_idx - (int)p_ent2->rec_idx);
+}
+
+/*******************************************************************************
+**
+** Function         add_uuid_to_index
+**
+** Description      This function adds one UUID of a record to the UUID index.
+**                  UUIDs of an invalid length are skipped, they never match.
+**
+** Returns          FALSE if the index is full, else TRUE
+**
+*******************************************************************************/
+static BOOLEAN add_uuid_to_index (UINT8 *p_uuid, UINT32 len, UINT16 rec_idx)
+{
+    tSDP_DB             *p_db = &sdp_cb.server_db;
+    tSDP_UUID_INDEX_ENT *p_ent;
+
+    if (p_db->num_uuid_index == SDP_MAX_UUID_INDEX)
+        return (FALSE);
+
+    p_ent = &p_db->uuid_index[p_db->num_uuid_index];
+    if (sdpu_uuid_to_uuid128 (p_uuid, len, p_ent->uuid))
+    {
+        p_ent->rec_idx = rec_idx;
+        p_db->num_uuid_index++;
+    }
+    return (TRUE);
+}
+
+/*******************************************************************************
+**
+** Function         add_seq_uuids_to_index
+**
+** Description      This function adds the UUIDs found in a data element
+**                  sequence to the UUID index. It walks the sequence the same
+**                  way find_uuid_in_seq does.
+**
+** Returns          FALSE if the index is full, else TRUE
+**
+*******************************************************************************/
+static BOOLEAN add_seq_uuids_to_index (UINT8 *p, UINT32 seq_len, UINT16 rec_idx,
+                                       int nest_level)
+{
+    UINT8   *p_end = p + seq_len;
+    UINT8   type;
+    UINT32  len;
+
+    if (nest_level > 3)
+        return (TRUE);
+
+    while (p < p_end)
+    {
+        type = *p++;
+        p = sdpu_get_len_from_type(p, p_end, type, &len);
+        if (p == NULL || (p + len) > p_end)
+            break;
+
+        type = type >> 3;
+        if (type == UUID_DESC_TYPE)
+        {
+            if (!add_uuid_to_index (p, len, rec_idx))
+                return (FALSE);
+        }
+        else if (type == DATA_ELE_SEQ_DESC_TYPE)
+        {
+            if (!add_seq_uuids_to_index (p, len, rec_idx, nest_level + 1))
+                return (FALSE);
+        }
+        p = p + len;
+    }
+    return (TRUE);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_db_build_uuid_index
+**
+** Description      This function collects the UUIDs of every record into a
+**                  sorted (UUID, record) index, so service searches do not
+**                  have to parse the attribute sequences of each record again.
+**                  If the index overflows, searches go back to parsing.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_db_build_uuid_index (void)
+{
+    tSDP_DB         *p_db = &sdp_cb.server_db;
+    tSDP_RECORD     *p_rec;
+    tSDP_ATTRIBUTE  *p_attr;
+    UINT16          xx, yy;
+    BOOLEAN         ok = TRUE;
+
+    p_db->num_uuid_index = 0;
+
+    for (xx = 0, p_rec = &p_db->record[0]; ok && xx < p_db->num_records; xx++, p_rec++)
+    {
+        p_attr = &p_rec->attribute[0];
+        for (yy = 0; ok && yy < p_rec->num_attributes; yy++, p_attr++)
+        {
+            if (p_attr->type == UUID_DESC_TYPE)
+                ok = add_uuid_to_index (p_attr->value_ptr, p_attr->len, xx);
+            else if (p_attr->type == DATA_ELE_SEQ_DESC_TYPE)
+                ok = add_seq_uuids_to_index (p_attr->value_ptr, p_attr->len, xx, 0);
+        }
+    }
+
+    if (!ok)
+    {
+        SDP_TRACE_WARNING("%s: more than %d UUIDs, not indexing", __func__,
+                          SDP_MAX_UUID_INDEX);
+        p_db->uuid_index_state = SDP_UUID_INDEX_FULL;
+        return;
+    }
+
+    qsort (p_db->uuid_index, p_db->num_uuid_index, sizeof(tSDP_UUID_INDEX_ENT),
+           uuid_index_cmp);
+    p_db->uuid_index_state = SDP_UUID_INDEX_READY;
+}
+
+/*******************************************************************************
+**
+** Function         sdp_db_index_search
+**
+** Description      This function is the indexed version of the record walk
+**                  in sdp_db_service_search. It looks up every UUID of the
+**                  sequence for each record, starting at p_rec.
+**
+** Returns          Pointer to the record, or NULL if not found.
+**
+*******************************************************************************/
+static tSDP_RECORD *sdp_db_index_search (tSDP_RECORD *p_rec, tSDP_UUID_SEQ *p_seq)
+{
+    tSDP_DB             *p_db = &sdp_cb.server_db;
+    tSDP_RECORD         *p_end = &p_db->record[p_db->num_records];
+    tSDP_UUID_INDEX_ENT key[MAX_UUIDS_PER_SEQ];
+    UINT16              yy;
+
+    for (yy = 0; yy < p_seq->num_uids; yy++)
+    {
+        /* A UUID of an invalid length never matches any record */
+        if (!sdpu_uuid_to_uuid128 (p_seq->uuid_entry[yy].value,
+                                   p_seq->uuid_entry[yy].len, key[yy].uuid))
+            return (NULL);
+    }
+
+    for ( ; p_rec < p_end; p_rec++)
+    {
+        for (yy = 0; yy < p_seq->num_uids; yy++)
+        {
+            key[yy].rec_idx = (UINT16)(p_rec - &p_db->record[0]);
+            if (!bsearch (&key[yy], p_db->uuid_index, p_db->num_uuid_index,
+                          sizeof(tSDP_UUID_INDEX_ENT), uuid_index_cmp))
+                break;
+        }
+
+        if (yy == p_seq->num_uids)
+            return (p_rec);
+    }
+
+    return (NULL);
+}
+
 /*******************************************************************************
 **
 ** Function         sdp_db_find_record
@@ -345,6 +552,7 @@ BOOLEAN SDP_DeleteRecord (UINT32 handle)
         /* require new DI record to be created in SDP_SetLocalDiRecord */
         sdp_cb.server_db.di_primary_handle = 0;
 
+        sdp_db_changed ();
         return (TRUE);
     }
     else
@@ -367,6 +575,7 @@ BOOLEAN SDP_DeleteRecord (UINT32 handle)
                 }
 
                 sdp_cb.server_db.num_records--;
+                sdp_db_changed ();
 
                 SDP_TRACE_DEBUG("SDP_DeleteRecord ok, num_records:%d", sdp_cb.server_db.num_records);
                 /* if we're deleting the primary DI record, clear the */
@@ -461,6 +670,8 @@ BOOLEAN SDP_AddAttribute (UINT32 handle, UINT16 attr_id, UINT8 attr_type,
                 return (FALSE);
             }
 
+            sdp_db_changed ();
+
             /* Found the record. Now, see if the attribute already exists */
             for (xx = 0; xx < p_rec->num_attributes; xx++, p_attr++)
             {
@@ -890,6 +1101,8 @@ BOOLEAN SDP_DeleteAttribute (UINT32 handle, UINT16 attr_id)
             {
                 if (p_attr->id == attr_id)
                 {
+                    sdp_db_changed ();
+
                     pad_ptr = p_attr->value_ptr;
                     len = p_attr->len;
                     if (p_rec->free_pad_ptr + p_attr->len >= SDP_MAX_PAD_LEN)
@@ -0,0 +1,741 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  This file contains the SDP discovery cache. It keeps the raw attribute
+ *  list of ServiceSearchAttribute responses per peer and per UUID/attribute
+ *  filter, so that reconnecting to a known device does not have to repeat
+ *  the SDP connection and transactions. Only results of bonded peers are
+ *  kept. The cache is stored in a small binary file next to bt_config.conf,
+ *  which is written by a private thread a settle period after the last
+ *  change, so bursts of changes are batched and the BTU thread never blocks
+ *  on file I/O.
+ *
+ ******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bt_target.h"
+#include "bt_common.h"
+#include "bt_utils.h"
+#include "btm_int.h"
+#include "btu.h"
+#include "osi/include/alarm.h"
+#include "osi/include/fixed_queue.h"
+#include "osi/include/thread.h"
+
+#include "sdp_api.h"
+#include "sdpint.h"
+
+#if (SDP_CLIENT_ENABLED == TRUE) && (SDP_DISC_CACHE_INCLUDED == TRUE)
+
+extern fixed_queue_t *btu_general_alarm_queue;
+
+/* File format: magic, version, then the entries back to back */
+#define SDP_DISC_CACHE_MAGIC        0x53445043  /* "SDPC" */
+#define SDP_DISC_CACHE_VERSION      1
+#define SDP_DISC_CACHE_FILE_HDR_LEN 5
+#define SDP_DISC_CACHE_ENT_HDR_LEN  (BD_ADDR_LEN + 4 + 2 + 2)
+
+/* Filters of a discovery database, serialized as the cache key */
+#define SDP_DISC_CACHE_KEY_LEN      (2 + SDP_MAX_UUID_FILTERS * (1 + MAX_UUID_SIZE) + \
+                                     SDP_MAX_ATTR_FILTERS * 2)
+
+/* Size of the database used to refresh an entry in the background */
+#define SDP_DISC_CACHE_REFRESH_DB_SIZE  8192
+
+/* Changes are written to the file once none came in for this long */
+#define SDP_DISC_CACHE_SETTLE_MS        3000
+
+typedef struct
+{
+    BD_ADDR     bd_addr;
+    UINT32      saved_time;     /* wall clock, seconds */
+    UINT16      key_len;
+    UINT16      list_len;
+    UINT8       *p_data;        /* key followed by the attribute list */
+} tSDP_DISC_CACHE_ENT;
+
+/* A background refresh in progress */
+typedef struct
+{
+    BD_ADDR             bd_addr;
+    tSDP_DISCOVERY_DB   *p_db;
+} tSDP_DISC_CACHE_REFRESH;
+
+/* Accessed from the BTU thread, from btif when bonds change, and from the
+** writer thread */
+static pthread_mutex_t      disc_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static tSDP_DISC_CACHE_ENT  disc_cache[SDP_DISC_CACHE_SIZE];
+static BOOLEAN              disc_cache_loaded;
+static BOOLEAN              disc_cache_dirty;
+
+static thread_t             *disc_cache_thread;
+static fixed_queue_t        *disc_cache_alarm_queue;
+static alarm_t              *disc_cache_save_timer;
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_key
+**
+** Description      This function serializes the UUID and attribute filters of
+**                  a discovery database into a cache key.
+**
+** Returns          Length of the key, 0 if the request cannot be cached
+**
+*******************************************************************************/
+static UINT16 sdp_disc_cache_key (tSDP_DISCOVERY_DB *p_db, UINT8 *p_key)
+{
+#if (defined(SDP_BROWSE_PLUS) && SDP_BROWSE_PLUS == TRUE)
+    /* Browsing sends one request per UUID filter, only full results are cached */
+    UNUSED(p_db);
+    UNUSED(p_key);
+    return (0);
+#else
+    UINT8   *p = p_key;
+    UINT16  xx;
+
+    UINT8_TO_BE_STREAM (p, p_db->num_uuid_filters);
+    for (xx = 0; xx < p_db->num_uuid_filters; xx++)
+    {
+        tSDP_UUID *p_uuid = &p_db->uuid_filters[xx];
+
+        UINT8_TO_BE_STREAM (p, p_uuid->len);
+        if (p_uuid->len == LEN_UUID_16)
+        {
+            UINT16_TO_BE_STREAM (p, p_uuid->uu.uuid16);
+        }
+        else if (p_uuid->len == LEN_UUID_32)
+        {
+            UINT32_TO_BE_STREAM (p, p_uuid->uu.uuid32);
+        }
+        else if (p_uuid->len == LEN_UUID_128)
+        {
+            ARRAY_TO_BE_STREAM (p, p_uuid->uu.uuid128, LEN_UUID_128);
+        }
+    }
+
+    UINT8_TO_BE_STREAM (p, p_db->num_attr_filters);
+    for (xx = 0; xx < p_db->num_attr_filters; xx++)
+        UINT16_TO_BE_STREAM (p, p_db->attr_filters[xx]);
+
+    return ((UINT16)(p - p_key));
+#endif
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_is_fresh
+**
+** Description      This function checks the age of a cache entry against
+**                  max_age. Entries from the future (clock changes) are old.
+**
+** Returns          TRUE if the entry is younger than max_age
+**
+*******************************************************************************/
+static BOOLEAN sdp_disc_cache_is_fresh (const tSDP_DISC_CACHE_ENT *p_ent, UINT32 now,
+                                        UINT32 max_age)
+{
+    return ((p_ent->saved_time <= now) && ((now - p_ent->saved_time) < max_age));
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_free_ent
+**
+** Description      This function frees a cache entry.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_disc_cache_free_ent (tSDP_DISC_CACHE_ENT *p_ent)
+{
+    osi_free (p_ent->p_data);
+    memset (p_ent, 0, sizeof(tSDP_DISC_CACHE_ENT));
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_load
+**
+** Description      This function reads the cache file, once. Expired or
+**                  malformed entries are dropped. Called with the lock held.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_disc_cache_load (void)
+{
+    UINT8   hdr[SDP_DISC_CACHE_ENT_HDR_LEN];
+    UINT8   *p;
+    UINT32  magic, now = (UINT32)time(NULL);
+    UINT8   version;
+    UINT16  num = 0;
+    FILE    *fp;
+
+    if (disc_cache_loaded)
+        return;
+    disc_cache_loaded = TRUE;
+
+    fp = fopen (SDP_DISC_CACHE_FILE, "rb");
+    if (fp == NULL)
+        return;
+
+    if (fread (hdr, SDP_DISC_CACHE_FILE_HDR_LEN, 1, fp) != 1)
+        goto done;
+    p = hdr;
+    BE_STREAM_TO_UINT32 (magic, p);
+    BE_STREAM_TO_UINT8 (version, p);
+    if ((magic != SDP_DISC_CACHE_MAGIC) || (version != SDP_DISC_CACHE_VERSION))
+    {
+        SDP_TRACE_WARNING ("%s: ignoring cache file version %d", __func__, version);
+        goto done;
+    }
+
+    while ((num < SDP_DISC_CACHE_SIZE) &&
+           (fread (hdr, SDP_DISC_CACHE_ENT_HDR_LEN, 1, fp) == 1))
+    {
+        tSDP_DISC_CACHE_ENT *p_ent = &disc_cache[num];
+
+        p = hdr;
+        STREAM_TO_ARRAY (p_ent->bd_addr, p, BD_ADDR_LEN);
+        BE_STREAM_TO_UINT32 (p_ent->saved_time, p);
+        BE_STREAM_TO_UINT16 (p_ent->key_len, p);
+        BE_STREAM_TO_UINT16 (p_ent->list_len, p);
+
+        if ((p_ent->key_len > SDP_DISC_CACHE_KEY_LEN) ||
+            (p_ent->list_len > SDP_MAX_LIST_BYTE_COUNT))
+        {
+            SDP_TRACE_WARNING ("%s: malformed cache file", __func__);
+            memset (p_ent, 0, sizeof(tSDP_DISC_CACHE_ENT));
+            break;
+        }
+
+        p_ent->p_data = (UINT8 *)osi_malloc (p_ent->key_len + p_ent->list_len);
+        if (fread (p_ent->p_data, p_ent->key_len + p_ent->list_len, 1, fp) != 1)
+        {
+            sdp_disc_cache_free_ent (p_ent);
+            break;
+        }
+
+        if (sdp_disc_cache_is_fresh (p_ent, now, SDP_DISC_CACHE_FRESH_S))
+            num++;
+        else
+            sdp_disc_cache_free_ent (p_ent);
+    }
+
+    SDP_TRACE_DEBUG ("%s: %d entries", __func__, num);
+
+done:
+    fclose (fp);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_write
+**
+** Description      This function writes the cache to a temporary file and
+**                  renames it over the cache file, so a crash never leaves a
+**                  partial file behind. The entries are copied out under the
+**                  lock, the file is written without it.
+**
+**                  It runs on the writer thread when the save timer fires,
+**                  and from sdp_disc_cache_cleanup at shutdown.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_disc_cache_write (void *data)
+{
+    static const char *temp_file = SDP_DISC_CACHE_FILE ".new";
+    UINT8   *p_buf, *p;
+    size_t  len = SDP_DISC_CACHE_FILE_HDR_LEN;
+    UINT16  xx;
+    BOOLEAN ok;
+    FILE    *fp;
+
+    UNUSED(data);
+
+    pthread_mutex_lock (&disc_cache_lock);
+    if (!disc_cache_dirty)
+    {
+        pthread_mutex_unlock (&disc_cache_lock);
+        return;
+    }
+
+    for (xx = 0; xx < SDP_DISC_CACHE_SIZE; xx++)
+    {
+        if (disc_cache[xx].p_data != NULL)
+            len += SDP_DISC_CACHE_ENT_HDR_LEN + disc_cache[xx].key_len + disc_cache[xx].list_len;
+    }
+
+    p = p_buf = (UINT8 *)osi_malloc (len);
+    UINT32_TO_BE_STREAM (p, SDP_DISC_CACHE_MAGIC);
+    UINT8_TO_BE_STREAM (p, SDP_DISC_CACHE_VERSION);
+
+    for (xx = 0; xx < SDP_DISC_CACHE_SIZE; xx++)
+    {
+        tSDP_DISC_CACHE_ENT *p_ent = &disc_cache[xx];
+
+        if (p_ent->p_data == NULL)
+            continue;
+
+        ARRAY_TO_STREAM (p, p_ent->bd_addr, BD_ADDR_LEN);
+        UINT32_TO_BE_STREAM (p, p_ent->saved_time);
+        UINT16_TO_BE_STREAM (p, p_ent->key_len);
+        UINT16_TO_BE_STREAM (p, p_ent->list_len);
+        ARRAY_TO_STREAM (p, p_ent->p_data, p_ent->key_len + p_ent->list_len);
+    }
+
+    disc_cache_dirty = FALSE;
+    pthread_mutex_unlock (&disc_cache_lock);
+
+    fp = fopen (temp_file, "wb");
+    if (fp == NULL)
+    {
+        SDP_TRACE_ERROR ("%s: unable to open %s: %s", __func__, temp_file, strerror(errno));
+        osi_free (p_buf);
+        return;
+    }
+
+    ok = (fwrite (p_buf, len, 1, fp) == 1) && (fflush (fp) == 0) && (fsync (fileno (fp)) == 0);
+    if (fclose (fp) != 0)
+        ok = FALSE;
+
+    if (!ok || (rename (temp_file, SDP_DISC_CACHE_FILE) != 0))
+    {
+        SDP_TRACE_ERROR ("%s: unable to write %s: %s", __func__, SDP_DISC_CACHE_FILE,
+                         strerror(errno));
+        unlink (temp_file);
+    }
+
+    osi_free (p_buf);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_changed
+**
+** Description      This function marks the cache as changed and (re)starts
+**                  the save timer. Called with the lock held.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_disc_cache_changed (void)
+{
+    disc_cache_dirty = TRUE;
+
+    /* Without the writer thread, the change is written at cleanup */
+    if (disc_cache_save_timer != NULL)
+        alarm_set_on_queue (disc_cache_save_timer, SDP_DISC_CACHE_SETTLE_MS,
+                            sdp_disc_cache_write, NULL, disc_cache_alarm_queue);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_evict
+**
+** Description      This function frees the entries of a peer, or of all peers
+**                  if p_bd_addr is NULL. Called with the lock held.
+**
+** Returns          TRUE if any entry was freed
+**
+*******************************************************************************/
+static BOOLEAN sdp_disc_cache_evict (UINT8 *p_bd_addr)
+{
+    UINT16  xx;
+    BOOLEAN evicted = FALSE;
+
+    for (xx = 0; xx < SDP_DISC_CACHE_SIZE; xx++)
+    {
+        if ((disc_cache[xx].p_data != NULL) &&
+            ((p_bd_addr == NULL) ||
+             (memcmp (disc_cache[xx].bd_addr, p_bd_addr, BD_ADDR_LEN) == 0)))
+        {
+            sdp_disc_cache_free_ent (&disc_cache[xx]);
+            evicted = TRUE;
+        }
+    }
+    return (evicted);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_find
+**
+** Description      This function looks up the entry of a peer for a key.
+**                  Called with the lock held.
+**
+** Returns          Pointer to the entry, or NULL if not found
+**
+*******************************************************************************/
+static tSDP_DISC_CACHE_ENT *sdp_disc_cache_find (UINT8 *p_bd_addr, UINT8 *p_key,
+                                                 UINT16 key_len)
+{
+    tSDP_DISC_CACHE_ENT *p_ent = &disc_cache[0];
+    UINT16              xx;
+
+    for (xx = 0; xx < SDP_DISC_CACHE_SIZE; xx++, p_ent++)
+    {
+        if ((p_ent->p_data != NULL) && (p_ent->key_len == key_len) &&
+            (memcmp (p_ent->bd_addr, p_bd_addr, BD_ADDR_LEN) == 0) &&
+            (memcmp (p_ent->p_data, p_key, key_len) == 0))
+            return (p_ent);
+    }
+    return (NULL);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_deliver
+**
+** Description      This function completes a discovery served from the
+**                  cache. It runs from the BTU alarm queue, so the user
+**                  callback is never called from within the request API.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_disc_cache_deliver (void *data)
+{
+    tCONN_CB    *p_ccb = (tCONN_CB *)data;
+    UINT16      reason = sdp_disc_parse_attr_list (p_ccb);
+
+    SDP_TRACE_EVENT ("SDP - cached discovery done, reason: %d", reason);
+
+    /* A result that does not parse is useless, next time ask the peer */
+    if ((reason != SDP_SUCCESS) && (reason != SDP_DB_FULL))
+        SDP_FlushDiscoveryCache (p_ccb->device_address);
+
+    if (p_ccb->p_cb)
+        (*p_ccb->p_cb) (reason);
+    else if (p_ccb->p_cb2)
+        (*p_ccb->p_cb2) (reason, p_ccb->user_data);
+
+    sdpu_release_ccb (p_ccb);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_refresh_cmpl
+**
+** Description      Completion of a background refresh. The new result has
+**                  already been stored by sdp_disc_cache_store on success.
+**                  If the peer could not be reached or did not answer, the
+**                  result just served may be wrong too, so it is dropped.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_disc_cache_refresh_cmpl (UINT16 result, void *user_data)
+{
+    tSDP_DISC_CACHE_REFRESH *p_refresh = (tSDP_DISC_CACHE_REFRESH *)user_data;
+
+    SDP_TRACE_DEBUG ("%s: result %d", __func__, result);
+
+    if ((result != SDP_SUCCESS) && (result != SDP_DB_FULL))
+        SDP_FlushDiscoveryCache (p_refresh->bd_addr);
+
+    osi_free (p_refresh->p_db);
+    osi_free (p_refresh);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_refresh
+**
+** Description      This function repeats a cached discovery over the air into
+**                  a private database, to pick up changes of the peer's
+**                  records for the next reconnect.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_disc_cache_refresh (UINT8 *p_bd_addr, tSDP_DISCOVERY_DB *p_user_db)
+{
+    tSDP_DISC_CACHE_REFRESH *p_refresh;
+    tCONN_CB                *p_ccb;
+
+    p_refresh = (tSDP_DISC_CACHE_REFRESH *)osi_malloc (sizeof(tSDP_DISC_CACHE_REFRESH));
+    memcpy (p_refresh->bd_addr, p_bd_addr, BD_ADDR_LEN);
+    p_refresh->p_db = (tSDP_DISCOVERY_DB *)osi_malloc (SDP_DISC_CACHE_REFRESH_DB_SIZE);
+    SDP_InitDiscoveryDb (p_refresh->p_db, SDP_DISC_CACHE_REFRESH_DB_SIZE,
+                         p_user_db->num_uuid_filters, p_user_db->uuid_filters,
+                         p_user_db->num_attr_filters, p_user_db->attr_filters);
+
+    p_ccb = sdp_conn_originate (p_bd_addr);
+    if (p_ccb == NULL)
+    {
+        osi_free (p_refresh->p_db);
+        osi_free (p_refresh);
+        return;
+    }
+
+    p_ccb->disc_state = SDP_DISC_WAIT_CONN;
+    p_ccb->p_db       = p_refresh->p_db;
+    p_ccb->p_cb2      = sdp_disc_cache_refresh_cmpl;
+    p_ccb->user_data  = p_refresh;
+    p_ccb->is_attr_search = TRUE;
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_serve
+**
+** Description      This function is called by the ServiceSearchAttribute
+**                  request APIs. If a fresh result for the peer and the
+**                  filters of p_db is cached, the discovery is completed from
+**                  it without connecting. Results older than
+**                  SDP_DISC_CACHE_REFRESH_S are refreshed in the background.
+**                  Results of peers that are no longer bonded are dropped.
+**
+** Returns          TRUE if the discovery is served from the cache
+**
+*******************************************************************************/
+BOOLEAN sdp_disc_cache_serve (UINT8 *p_bd_addr, tSDP_DISCOVERY_DB *p_db,
+                              tSDP_DISC_CMPL_CB *p_cb, tSDP_DISC_CMPL_CB2 *p_cb2,
+                              void *user_data)
+{
+    tSDP_DISC_CACHE_ENT *p_ent;
+    tCONN_CB            *p_ccb;
+    UINT8               key[SDP_DISC_CACHE_KEY_LEN];
+    UINT16              key_len = sdp_disc_cache_key (p_db, key);
+    UINT32              now = (UINT32)time(NULL);
+    BOOLEAN             refresh;
+
+    if (key_len == 0)
+        return (FALSE);
+
+    pthread_mutex_lock (&disc_cache_lock);
+    sdp_disc_cache_load ();
+
+    if (!btm_sec_is_a_bonded_dev (p_bd_addr))
+    {
+        if (sdp_disc_cache_evict (p_bd_addr))
+            sdp_disc_cache_changed ();
+        pthread_mutex_unlock (&disc_cache_lock);
+        return (FALSE);
+    }
+
+    p_ent = sdp_disc_cache_find (p_bd_addr, key, key_len);
+    if ((p_ent == NULL) || !sdp_disc_cache_is_fresh (p_ent, now, SDP_DISC_CACHE_FRESH_S))
+    {
+        pthread_mutex_unlock (&disc_cache_lock);
+        return (FALSE);
+    }
+
+    p_ccb = sdpu_allocate_ccb ();
+    if (p_ccb == NULL)
+    {
+        pthread_mutex_unlock (&disc_cache_lock);
+        return (FALSE);
+    }
+
+    /* Looks like a connection being set up, so SDP_CancelServiceSearch works */
+    p_ccb->con_flags |= SDP_FLAGS_IS_ORIG;
+    p_ccb->con_state  = SDP_STATE_CONN_SETUP;
+    memcpy (p_ccb->device_address, p_bd_addr, BD_ADDR_LEN);
+    p_ccb->disc_state = SDP_DISC_WAIT_SEARCH_ATTR;
+    p_ccb->p_db       = p_db;
+    p_ccb->p_cb       = p_cb;
+    p_ccb->p_cb2      = p_cb2;
+    p_ccb->user_data  = user_data;
+    p_ccb->is_attr_search = TRUE;
+
+    p_ccb->rsp_list = (UINT8 *)osi_malloc (SDP_MAX_LIST_BYTE_COUNT);
+    memcpy (p_ccb->rsp_list, p_ent->p_data + p_ent->key_len, p_ent->list_len);
+    p_ccb->list_len = p_ent->list_len;
+
+    refresh = !sdp_disc_cache_is_fresh (p_ent, now, SDP_DISC_CACHE_REFRESH_S);
+    pthread_mutex_unlock (&disc_cache_lock);
+
+    SDP_TRACE_EVENT ("SDP - serving discovery from cache, refresh: %d", refresh);
+
+    alarm_set_on_queue (p_ccb->sdp_conn_timer, 0, sdp_disc_cache_deliver, p_ccb,
+                        btu_general_alarm_queue);
+
+    if (refresh)
+        sdp_disc_cache_refresh (p_bd_addr, p_db);
+
+    return (TRUE);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_store
+**
+** Description      This function is called when a ServiceSearchAttribute
+**                  discovery completed successfully. If the peer is bonded,
+**                  it saves the raw attribute list for the peer and the
+**                  filters of the CCB's database, replacing the oldest entry
+**                  if the cache is full.
+**
+** Returns          void
+**
+*******************************************************************************/
+void sdp_disc_cache_store (tCONN_CB *p_ccb)
+{
+    tSDP_DISC_CACHE_ENT *p_ent;
+    UINT8               key[SDP_DISC_CACHE_KEY_LEN];
+    UINT16              key_len = sdp_disc_cache_key (p_ccb->p_db, key);
+    UINT16              xx;
+
+    if ((key_len == 0) || !btm_sec_is_a_bonded_dev (p_ccb->device_address))
+        return;
+
+    pthread_mutex_lock (&disc_cache_lock);
+    sdp_disc_cache_load ();
+
+    p_ent = sdp_disc_cache_find (p_ccb->device_address, key, key_len);
+    if (p_ent != NULL)
+    {
+        if ((p_ent->list_len != p_ccb->list_len) ||
+            (memcmp (p_ent->p_data + key_len, p_ccb->rsp_list, p_ccb->list_len) != 0))
+            SDP_TRACE_EVENT ("SDP - peer records changed, updating cache");
+        sdp_disc_cache_free_ent (p_ent);
+    }
+    else
+    {
+        /* Take a free entry, or the oldest one */
+        p_ent = &disc_cache[0];
+        for (xx = 0; xx < SDP_DISC_CACHE_SIZE; xx++)
+        {
+            if (disc_cache[xx].p_data == NULL)
+            {
+                p_ent = &disc_cache[xx];
+                break;
+            }
+            if (disc_cache[xx].saved_time < p_ent->saved_time)
+                p_ent = &disc_cache[xx];
+        }
+        if (p_ent->p_data != NULL)
+            sdp_disc_cache_free_ent (p_ent);
+    }
+
+    memcpy (p_ent->bd_addr, p_ccb->device_address, BD_ADDR_LEN);
+    p_ent->saved_time = (UINT32)time(NULL);
+    p_ent->key_len = key_len;
+    p_ent->list_len = p_ccb->list_len;
+    p_ent->p_data = (UINT8 *)osi_malloc (key_len + p_ccb->list_len);
+    memcpy (p_ent->p_data, key, key_len);
+    memcpy (p_ent->p_data + key_len, p_ccb->rsp_list, p_ccb->list_len);
+
+    sdp_disc_cache_changed ();
+    pthread_mutex_unlock (&disc_cache_lock);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_init
+**
+** Description      This function starts the thread that writes the cache
+**                  file. The file itself is read on first use.
+**
+** Returns          void
+**
+*******************************************************************************/
+void sdp_disc_cache_init (void)
+{
+    disc_cache_thread = thread_new ("sdp_disc_cache");
+    if (disc_cache_thread == NULL)
+    {
+        SDP_TRACE_ERROR ("%s: unable to create writer thread", __func__);
+        return;
+    }
+
+    disc_cache_alarm_queue = fixed_queue_new (SIZE_MAX);
+    alarm_register_processing_queue (disc_cache_alarm_queue, disc_cache_thread);
+
+    pthread_mutex_lock (&disc_cache_lock);
+    disc_cache_save_timer = alarm_new ("sdp.disc_cache_save_timer");
+    pthread_mutex_unlock (&disc_cache_lock);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_cache_cleanup
+**
+** Description      This function stops the writer thread, writes pending
+**                  changes and frees the cache. The next use reads the file
+**                  again.
+**
+** Returns          void
+**
+*******************************************************************************/
+void sdp_disc_cache_cleanup (void)
+{
+    alarm_t *p_timer;
+
+    pthread_mutex_lock (&disc_cache_lock);
+    p_timer = disc_cache_save_timer;
+    disc_cache_save_timer = NULL;
+    pthread_mutex_unlock (&disc_cache_lock);
+
+    /* Waits for a write in progress */
+    alarm_free (p_timer);
+
+    if (disc_cache_thread != NULL)
+    {
+        alarm_unregister_processing_queue (disc_cache_alarm_queue);
+        fixed_queue_free (disc_cache_alarm_queue, NULL);
+        disc_cache_alarm_queue = NULL;
+        thread_free (disc_cache_thread);
+        disc_cache_thread = NULL;
+    }
+
+    sdp_disc_cache_write (NULL);
+
+    pthread_mutex_lock (&disc_cache_lock);
+    sdp_disc_cache_evict (NULL);
+    disc_cache_loaded = FALSE;
+    pthread_mutex_unlock (&disc_cache_lock);
+}
+
+#endif  /* SDP_CLIENT_ENABLED == TRUE && SDP_DISC_CACHE_INCLUDED == TRUE */
+
+/*******************************************************************************
+**
+** Function         SDP_FlushDiscoveryCache
+**
+** Description      This function drops the cached ServiceSearchAttribute
+**                  results of a peer, or of all peers if bd_addr is NULL.
+**
+** Returns          void
+**
+*******************************************************************************/
+void SDP_FlushDiscoveryCache (BD_ADDR bd_addr)
+{
+#if (SDP_CLIENT_ENABLED == TRUE) && (SDP_DISC_CACHE_INCLUDED == TRUE)
+    pthread_mutex_lock (&disc_cache_lock);
+    sdp_disc_cache_load ();
+
+    if (sdp_disc_cache_evict (bd_addr))
+        sdp_disc_cache_changed ();
+    pthread_mutex_unlock (&disc_cache_lock);
+#else
+    UNUSED(bd_addr);
+#endif
+}
@@ -640,10 +640,9 @@ static void process_service_attr_rsp (tCONN_CB* p_ccb, uint8_t* p_reply,
 static void process_service_search_attr_rsp (tCONN_CB* p_ccb, uint8_t* p_reply,
                                              uint8_t* p_reply_end)
 {
-    UINT8           *p, *p_start, *p_end, *p_param_len;
-    UINT8           type;
-    UINT32          seq_len;
+    UINT8           *p_start, *p_param_len;
     UINT16          param_len, lists_byte_count = 0;
+    UINT16          reason;
     BOOLEAN         cont_request_needed = FALSE;
 
 #if (SDP_DEBUG_RAW == TRUE)
@@ -804,13 +803,39 @@ static void process_service_search_attr_rsp (tCONN_CB* p_ccb, uint8_t* p_reply,
     /*******************************************************************/
     /* We now have the full response, which is a sequence of sequences */
     /*******************************************************************/
+    reason = sdp_disc_parse_attr_list (p_ccb);
+
+    /* Remember it, so the next discovery of this peer can skip the connection */
+    if (reason == SDP_SUCCESS)
+        sdp_disc_cache_store (p_ccb);
+
+    /* Since we got everything we need, disconnect the call */
+    sdp_disconnect (p_ccb, reason);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_disc_parse_attr_list
+**
+** Description      This function parses the complete attribute list of a
+**                  ServiceSearchAttribute response held in the CCB's response
+**                  list into the CCB's discovery database. The list comes
+**                  either from the peer or from the discovery cache.
+**
+** Returns          SDP_SUCCESS, or the reason to report to the user
+**
+*******************************************************************************/
+UINT16 sdp_disc_parse_attr_list (tCONN_CB *p_ccb)
+{
+    UINT8           *p, *p_end;
+    UINT8           type;
+    UINT32          seq_len;
 
 #if (SDP_RAW_DATA_INCLUDED == TRUE)
     SDP_TRACE_WARNING("process_service_search_attr_rsp");
     if (!sdp_copy_raw_data (p_ccb, TRUE)) {
         SDP_TRACE_ERROR("sdp_copy_raw_data failed");
-        sdp_disconnect(p_ccb, SDP_ILLEGAL_PARAMETER);
-        return;
+        return (SDP_ILLEGAL_PARAMETER);
     }
 #endif
 
@@ -822,35 +847,27 @@ static void process_service_search_attr_rsp (tCONN_CB* p_ccb, uint8_t* p_reply,
     if ((type >> 3) != DATA_ELE_SEQ_DESC_TYPE)
     {
         SDP_TRACE_WARNING ("SDP - Wrong type: 0x%02x in attr_rsp", type);
-        return;
+        return (SDP_ILLEGAL_PARAMETER);
     }
     p = sdpu_get_len_from_type(p, p + p_ccb->list_len, type, &seq_len);
     if (p == NULL || (p + seq_len) > (p + p_ccb->list_len))
     {
         SDP_TRACE_WARNING("%s: bad length", __func__);
-        sdp_disconnect(p_ccb, SDP_ILLEGAL_PARAMETER);
-        return;
+        return (SDP_ILLEGAL_PARAMETER);
     }
     p_end = &p_ccb->rsp_list[p_ccb->list_len];
 
     if ((p + seq_len) != p_end)
-    {
-        sdp_disconnect (p_ccb, SDP_INVALID_CONT_STATE);
-        return;
-    }
+        return (SDP_INVALID_CONT_STATE);
 
     while (p < p_end)
     {
         p = save_attr_seq (p_ccb, p, &p_ccb->rsp_list[p_ccb->list_len]);
         if (!p)
-        {
-            sdp_disconnect (p_ccb, SDP_DB_FULL);
-            return;
-        }
+            return (SDP_DB_FULL);
     }
 
-    /* Since we got everything we need, disconnect the call */
-    sdp_disconnect (p_ccb, SDP_SUCCESS);
+    return (SDP_SUCCESS);
 }
 
 /*******************************************************************************
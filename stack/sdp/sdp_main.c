@@ -89,6 +89,8 @@ void sdp_init (void)
         sdp_cb.ccb[i].sdp_conn_timer = alarm_new("sdp.sdp_conn_timer");
     }
 
+    sdp_disc_cache_init ();
+
     /* Initialize the L2CAP configuration. We only care about MTU and flush */
     sdp_cb.l2cap_my_cfg.mtu_present       = TRUE;
     sdp_cb.l2cap_my_cfg.mtu               = SDP_MTU_SIZE;
@@ -147,7 +149,10 @@ void sdp_free(void) {
     for (int i = 0; i < SDP_MAX_CONNECTIONS; i++) {
         alarm_free(sdp_cb.ccb[i].sdp_conn_timer);
         sdp_cb.ccb[i].sdp_conn_timer = NULL;
+        sdp_server_release_rsp(&sdp_cb.ccb[i]);
     }
+    sdp_server_flush_rsp_cache();
+    sdp_disc_cache_cleanup();
 }
 
 #if (defined(SDP_DEBUG) && SDP_DEBUG == TRUE)
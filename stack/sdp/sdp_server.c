@@ -934,6 +934,387 @@ static void process_service_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
 
 
 
+/*******************************************************************************
+**
+** Function         sdp_rsp_blob_release
+**
+** Description      This function drops a reference to a serialized response,
+**                  and frees it when the last reference goes away.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_rsp_blob_release (tSDP_RSP_BLOB *p_blob)
+{
+    if (p_blob != NULL && --p_blob->ref_count == 0)
+        osi_free (p_blob);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_rsp_blob_unshare
+**
+** Description      This function makes sure the caller is the only user of a
+**                  serialized response before it gets modified. If the blob
+**                  is shared, the caller's reference is traded for a copy.
+**
+** Returns          Pointer to the blob the caller may modify
+**
+*******************************************************************************/
+static tSDP_RSP_BLOB *sdp_rsp_blob_unshare (tSDP_RSP_BLOB *p_blob)
+{
+    tSDP_RSP_BLOB *p_copy;
+    size_t size = sizeof(tSDP_RSP_BLOB) + p_blob->len;
+
+    if (p_blob->ref_count == 1)
+        return (p_blob);
+
+    p_copy = (tSDP_RSP_BLOB *)osi_malloc (size);
+    memcpy (p_copy, p_blob, size);
+    p_copy->ref_count = 1;
+
+    p_blob->ref_count--;
+    return (p_copy);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_apply_peer_quirks
+**
+** Description      This function applies the per peer AVRCP and HFP version
+**                  and feature workarounds to an attribute that has been
+**                  serialized at offset in the response. The database record
+**                  itself is restored afterwards.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_apply_peer_quirks (tCONN_CB *p_ccb, tSDP_RECORD *p_rec,
+                                   tSDP_ATTRIBUTE *p_attr,
+                                   tSDP_RSP_BLOB **pp_blob, UINT16 offset)
+{
+    BOOLEAN         is_avrcp_fallback = FALSE;
+    BOOLEAN         is_avrcp_browse_bit_reset = FALSE;
+    BOOLEAN         is_hfp_fallback = FALSE;
+    BOOLEAN         is_avrcp_ca_bit_reset = FALSE;
+
+#if ((defined(SDP_AVRCP_1_6) && (SDP_AVRCP_1_6 == TRUE)) || \
+        (defined(SDP_AVRCP_1_5) && (SDP_AVRCP_1_5 == TRUE)))
+    /* Check for UUID Remote Control and Remote BD address  */
+    is_avrcp_fallback = sdp_fallback_avrcp_version (p_attr, p_ccb->device_address);
+    is_avrcp_browse_bit_reset = sdp_reset_avrcp_browsing_bit(
+                p_rec->attribute[1], p_attr, p_ccb->device_address);
+#if (defined(SDP_AVRCP_1_6) && (SDP_AVRCP_1_6 == TRUE))
+    is_avrcp_ca_bit_reset = sdp_reset_avrcp_cover_art_bit(
+                p_rec->attribute[1], p_attr, p_ccb->device_address);
+#endif
+#endif
+    is_hfp_fallback = sdp_change_hfp_version (p_attr, p_ccb->device_address);
+
+    if (!is_avrcp_fallback && !is_avrcp_browse_bit_reset &&
+        !is_hfp_fallback && !is_avrcp_ca_bit_reset)
+        return;
+
+    *pp_blob = sdp_rsp_blob_unshare (*pp_blob);
+    memcpy (&(*pp_blob)->data[offset], p_attr->value_ptr, p_attr->len);
+
+    if (is_avrcp_fallback)
+    {
+#if (defined(SDP_AVRCP_1_6) && (SDP_AVRCP_1_6 == TRUE))
+        /* Update AVRCP version back to 1.6 */
+        p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x06;
+#else
+#if (defined(SDP_AVRCP_1_5) && (SDP_AVRCP_1_5 == TRUE))
+        /* Update AVRCP version back to 1.5 */
+        p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x05;
+#endif
+#endif
+    }
+    if (is_avrcp_browse_bit_reset)
+    {
+        /* Restore Browsing bit */
+        SDP_TRACE_ERROR("Restore Browsing bit");
+        p_attr->value_ptr[AVRCP_SUPPORTED_FEATURES_POSITION]
+                                |= AVRCP_BROWSE_SUPPORT_BITMASK;
+    }
+    if (is_hfp_fallback)
+    {
+        SDP_TRACE_ERROR("Restore HFP version to 1.6");
+        /* Update HFP version back to 1.6 */
+        p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x06;
+    }
+    if (is_avrcp_ca_bit_reset)
+    {
+        /* Restore Cover Art bit */
+        SDP_TRACE_ERROR("Restore Cover Art bit");
+        p_attr->value_ptr[AVRCP_SUPPORTED_FEATURES_POSITION - 1]
+                                |= AVRCP_CA_SUPPORT_BITMASK;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         sdp_build_rsp_blob
+**
+** Description      This function serializes the complete attribute list of a
+**                  ServiceSearchAttribute response, including the outer
+**                  sequence header.
+**
+**                  If p_ccb is given, the peer workarounds are applied while
+**                  building. Otherwise the response is peer independent and
+**                  the attributes the workarounds may touch are recorded as
+**                  patches, to be applied to a copy for the peers needing it.
+**
+** Returns          Pointer to the blob, with one reference held by the caller
+**
+*******************************************************************************/
+static tSDP_RSP_BLOB *sdp_build_rsp_blob (tCONN_CB *p_ccb, tSDP_UUID_SEQ *p_uid_seq,
+                                          tSDP_ATTR_SEQ *p_attr_seq)
+{
+    tSDP_RSP_BLOB  *p_blob;
+    tSDP_RSP_PATCH *p_patch;
+    tSDP_RECORD    *p_rec;
+    tSDP_ATTRIBUTE *p_attr;
+    UINT8          *p;
+    UINT16          list_len, seq_len, start_id, end_id, offset, xx;
+
+    list_len = sdpu_get_list_len (p_uid_seq, p_attr_seq);
+
+    p_blob = (tSDP_RSP_BLOB *)osi_malloc (sizeof(tSDP_RSP_BLOB) + list_len + 3);
+    p_blob->ref_count = 1;
+    p_blob->num_patches = 0;
+    p_blob->patches_full = FALSE;
+    p = &p_blob->data[0];
+
+    /* Put in the sequence header (2 or 3 bytes) */
+    if (list_len + 3 > 255)
+    {
+        UINT8_TO_BE_STREAM  (p, (DATA_ELE_SEQ_DESC_TYPE << 3) | SIZE_IN_NEXT_WORD);
+        UINT16_TO_BE_STREAM (p, list_len);
+    }
+    else
+    {
+        UINT8_TO_BE_STREAM (p, (DATA_ELE_SEQ_DESC_TYPE << 3) | SIZE_IN_NEXT_BYTE);
+        UINT8_TO_BE_STREAM (p, list_len);
+    }
+
+    for (p_rec = sdp_db_service_search (NULL, p_uid_seq); p_rec; p_rec = sdp_db_service_search (p_rec, p_uid_seq))
+    {
+        seq_len = sdpu_get_attrib_seq_len (p_rec, p_attr_seq);
+        if (seq_len == 0)
+            continue;
+
+        UINT8_TO_BE_STREAM  (p, (DATA_ELE_SEQ_DESC_TYPE << 3) | SIZE_IN_NEXT_WORD);
+        UINT16_TO_BE_STREAM (p, seq_len);
+
+        for (xx = 0; xx < p_attr_seq->num_attr; xx++)
+        {
+            start_id = p_attr_seq->attr_entry[xx].start;
+            end_id = p_attr_seq->attr_entry[xx].end;
+
+            while ((p_attr = sdp_db_find_attr_in_rec (p_rec, start_id, end_id)) != NULL)
+            {
+                p = sdpu_build_attrib_entry (p, p_attr);
+
+                /* The value is always the tail of the entry */
+                offset = (UINT16)(p - &p_blob->data[0] - p_attr->len);
+
+                if (p_ccb != NULL)
+                {
+                    sdp_apply_peer_quirks (p_ccb, p_rec, p_attr, &p_blob, offset);
+                }
+                else if ((p_attr->id == ATTR_ID_BT_PROFILE_DESC_LIST) ||
+                         (p_attr->id == ATTR_ID_SUPPORTED_FEATURES))
+                {
+                    if (p_blob->num_patches < SDP_MAX_RSP_PATCHES)
+                    {
+                        p_patch = &p_blob->patch[p_blob->num_patches++];
+                        p_patch->record_handle = p_rec->record_handle;
+                        p_patch->attr_id = p_attr->id;
+                        p_patch->offset = offset;
+                    }
+                    else
+                        p_blob->patches_full = TRUE;
+                }
+
+                /* If doing a range, stick with this one till no more attributes found */
+                if ((start_id == end_id) || (p_attr->id >= end_id))
+                    break;
+                start_id = p_attr->id + 1;
+            }
+        }
+    }
+
+    p_blob->len = (UINT16)(p - &p_blob->data[0]);
+    return (p_blob);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_rsp_cache_find
+**
+** Description      This function looks up a serialized response by the raw
+**                  UUID and attribute sequences of the request.
+**
+** Returns          Pointer to the blob with a new reference, or NULL
+**
+*******************************************************************************/
+static tSDP_RSP_BLOB *sdp_rsp_cache_find (UINT8 *p_key, UINT16 key_len)
+{
+    tSDP_RSP_CACHE_ENT *p_ent = &sdp_cb.rsp_cache[0];
+    UINT16             xx;
+
+    for (xx = 0; xx < SDP_RSP_CACHE_SIZE; xx++, p_ent++)
+    {
+        if ((p_ent->p_blob != NULL) && (p_ent->key_len == key_len) &&
+            (memcmp (p_ent->key, p_key, key_len) == 0))
+        {
+            p_ent->last_used = ++sdp_cb.rsp_cache_seq;
+            p_ent->p_blob->ref_count++;
+            return (p_ent->p_blob);
+        }
+    }
+    return (NULL);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_rsp_cache_store
+**
+** Description      This function adds a serialized response to the cache,
+**                  evicting the least recently used one if it is full.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void sdp_rsp_cache_store (UINT8 *p_key, UINT16 key_len, tSDP_RSP_BLOB *p_blob)
+{
+    tSDP_RSP_CACHE_ENT *p_ent = &sdp_cb.rsp_cache[0];
+    tSDP_RSP_CACHE_ENT *p_victim = p_ent;
+    UINT16             xx;
+
+    for (xx = 0; xx < SDP_RSP_CACHE_SIZE; xx++, p_ent++)
+    {
+        if (p_ent->p_blob == NULL)
+        {
+            p_victim = p_ent;
+            break;
+        }
+        if (p_ent->last_used < p_victim->last_used)
+            p_victim = p_ent;
+    }
+
+    sdp_rsp_blob_release (p_victim->p_blob);
+
+    p_blob->ref_count++;
+    p_victim->p_blob = p_blob;
+    p_victim->last_used = ++sdp_cb.rsp_cache_seq;
+    p_victim->key_len = key_len;
+    memcpy (p_victim->key, p_key, key_len);
+}
+
+/*******************************************************************************
+**
+** Function         sdp_server_flush_rsp_cache
+**
+** Description      This function drops all cached responses. It is called
+**                  whenever the server database changes. Connections in the
+**                  middle of sending a response keep their own reference.
+**
+** Returns          void
+**
+*******************************************************************************/
+void sdp_server_flush_rsp_cache (void)
+{
+    UINT16 xx;
+
+    for (xx = 0; xx < SDP_RSP_CACHE_SIZE; xx++)
+    {
+        sdp_rsp_blob_release (sdp_cb.rsp_cache[xx].p_blob);
+        sdp_cb.rsp_cache[xx].p_blob = NULL;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         sdp_server_release_rsp
+**
+** Description      This function drops the ServiceSearchAttribute response
+**                  held by a connection.
+**
+** Returns          void
+**
+*******************************************************************************/
+void sdp_server_release_rsp (tCONN_CB *p_ccb)
+{
+    sdp_rsp_blob_release (p_ccb->p_rsp_blob);
+    p_ccb->p_rsp_blob = NULL;
+}
+
+/*******************************************************************************
+**
+** Function         sdp_get_search_attr_rsp
+**
+** Description      This function returns the serialized response for a
+**                  ServiceSearchAttribute request, from the cache if the same
+**                  UUID and attribute sequences were asked for before. The
+**                  peer workarounds are applied to a private copy if needed.
+**
+** Returns          Pointer to the blob, with one reference held by the caller
+**
+*******************************************************************************/
+static tSDP_RSP_BLOB *sdp_get_search_attr_rsp (tCONN_CB *p_ccb,
+                                               tSDP_UUID_SEQ *p_uid_seq,
+                                               tSDP_ATTR_SEQ *p_attr_seq,
+                                               UINT8 *p_uid, UINT16 uid_len,
+                                               UINT8 *p_attrs, UINT16 attrs_len)
+{
+    tSDP_RSP_BLOB  *p_blob = NULL;
+    tSDP_RSP_PATCH *p_patch;
+    tSDP_RECORD    *p_rec;
+    tSDP_ATTRIBUTE *p_attr;
+    UINT8           key[SDP_RSP_CACHE_KEY_LEN];
+    UINT16          key_len = uid_len + attrs_len;
+    BOOLEAN         cacheable = (key_len <= SDP_RSP_CACHE_KEY_LEN);
+    UINT8           xx;
+
+    if (cacheable)
+    {
+        memcpy (key, p_uid, uid_len);
+        memcpy (key + uid_len, p_attrs, attrs_len);
+        p_blob = sdp_rsp_cache_find (key, key_len);
+    }
+
+    if (p_blob == NULL)
+    {
+        p_blob = sdp_build_rsp_blob (NULL, p_uid_seq, p_attr_seq);
+        if (p_blob->patches_full)
+        {
+            /* Cannot be shared, build one for this peer only */
+            sdp_rsp_blob_release (p_blob);
+            return (sdp_build_rsp_blob (p_ccb, p_uid_seq, p_attr_seq));
+        }
+        if (cacheable)
+            sdp_rsp_cache_store (key, key_len, p_blob);
+    }
+
+    for (xx = 0; xx < p_blob->num_patches; xx++)
+    {
+        p_patch = &p_blob->patch[xx];
+        p_rec = sdp_db_find_record (p_patch->record_handle);
+        if (p_rec == NULL)
+            continue;
+        p_attr = sdp_db_find_attr_in_rec (p_rec, p_patch->attr_id, p_patch->attr_id);
+        if (p_attr == NULL)
+            continue;
+
+        /* After the first copy, p_blob is private and carries the same patches */
+        sdp_apply_peer_quirks (p_ccb, p_rec, p_attr, &p_blob, p_patch->offset);
+    }
+
+    return (p_blob);
+}
+
 /*******************************************************************************
 **
 ** Function         process_service_search_attr_req
@@ -942,6 +1323,10 @@ static void process_service_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
 **                  read request from the client. It builds a reply message with
 **                  info from the database, and sends the reply back to the client.
 **
+**                  The whole attribute list is serialized on the first request
+**                  and kept by the connection, so a continuation only copies
+**                  the next slice of it.
+**
 ** Returns          void
 **
 *******************************************************************************/
@@ -950,25 +1335,17 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
                                              UINT8 *p_req_end)
 {
     UINT16         max_list_len;
-    INT16          rem_len;
     UINT16         len_to_send, cont_offset;
     tSDP_UUID_SEQ   uid_seq;
     UINT8           *p_rsp, *p_rsp_start, *p_rsp_param_len;
-    UINT16          rsp_param_len, xx;
-    tSDP_RECORD    *p_rec;
-    tSDP_ATTR_SEQ   attr_seq, attr_seq_sav;
-    tSDP_ATTRIBUTE *p_attr;
+    UINT8           *p_uid_start, *p_uid_end, *p_attr_start;
+    UINT16          rsp_param_len;
+    tSDP_ATTR_SEQ   attr_seq;
     BT_HDR         *p_buf;
-    BOOLEAN         maxxed_out = FALSE, is_cont = FALSE;
-    BOOLEAN         is_avrcp_fallback = FALSE;
-    BOOLEAN         is_avrcp_browse_bit_reset = FALSE;
-    BOOLEAN         is_hfp_fallback = FALSE;
-    BOOLEAN         is_avrcp_ca_bit_reset = FALSE;
-    UINT8           *p_seq_start = NULL;
-    UINT16          seq_len, attr_len;
-    UNUSED(p_req_end);
+    BOOLEAN         is_cont = FALSE;
 
     /* Extract the UUID sequence to search for */
+    p_uid_start = p_req;
     p_req = sdpu_extract_uid_seq (p_req, param_len, &uid_seq);
 
     if ((!p_req) || (!uid_seq.num_uids) ||
@@ -976,6 +1353,7 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
         sdpu_build_n_send_error (p_ccb, trans_num, SDP_INVALID_REQ_SYNTAX, SDP_TEXT_BAD_UUID_LIST);
         return;
     }
+    p_uid_end = p_req;
 
     /* Get the max list length we can send. Cap it at our max list length. */
     BE_STREAM_TO_UINT16 (max_list_len, p_req);
@@ -984,6 +1362,7 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
         max_list_len = p_ccb->rem_mtu_size - SDP_MAX_SERVATTR_RSPHDR_LEN;
 
     param_len = (unsigned short int)((p_req_end - p_req) & USHRT_MAX);
+    p_attr_start = p_req;
     p_req = sdpu_extract_attr_seq (p_req, param_len, &attr_seq);
 
     if ((!p_req) || (!attr_seq.num_attr) ||
@@ -992,18 +1371,12 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
         return;
     }
 
-    memcpy(&attr_seq_sav, &attr_seq, sizeof(tSDP_ATTR_SEQ)) ;
-
     if (max_list_len < 4) {
         sdpu_build_n_send_error(p_ccb, trans_num, SDP_ILLEGAL_PARAMETER, NULL);
         android_errorWriteLog(0x534e4554, "68817966");
         return;
     }
 
-    /* Free and reallocate buffer */
-    osi_free(p_ccb->rsp_list);
-    p_ccb->rsp_list = (UINT8 *)osi_malloc(max_list_len);
-
     /* Check if this is a continuation request */
     if (*p_req) {
         if (*p_req++ != SDP_CONTINUATION_LEN ||
@@ -1014,7 +1387,7 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
         }
         BE_STREAM_TO_UINT16(cont_offset, p_req);
 
-        if (cont_offset != p_ccb->cont_offset) {
+        if ((cont_offset != p_ccb->cont_offset) || (p_ccb->p_rsp_blob == NULL)) {
             sdpu_build_n_send_error (p_ccb, trans_num, SDP_INVALID_CONT_STATE,
                                      SDP_TEXT_BAD_CONT_INX);
             return;
@@ -1025,11 +1398,6 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
             return;
         }
         is_cont = TRUE;
-
-        /* Initialise for continuation response */
-        p_rsp = &p_ccb->rsp_list[0];
-        attr_seq.attr_entry[p_ccb->cont_info.next_attr_index].start =
-            p_ccb->cont_info.next_attr_start_id;
     } else {
         if (p_req+1 != p_req_end)
         {
@@ -1037,280 +1405,28 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
             return;
         }
 
+        sdp_server_release_rsp (p_ccb);
+        p_ccb->p_rsp_blob = sdp_get_search_attr_rsp (p_ccb, &uid_seq, &attr_seq,
+                                                     p_uid_start, (UINT16)(p_uid_end - p_uid_start),
+                                                     p_attr_start, (UINT16)(p_req - p_attr_start));
         p_ccb->cont_offset = 0;
-        p_rsp = &p_ccb->rsp_list[3];    /* Leave space for data elem descr */
-
-        /* Reset continuation parameters in p_ccb */
-        p_ccb->cont_info.prev_sdp_rec = NULL;
-        p_ccb->cont_info.curr_sdp_rec = NULL;
-        p_ccb->cont_info.next_attr_index = 0;
-        p_ccb->cont_info.last_attr_seq_desc_sent = FALSE;
-        p_ccb->cont_info.attr_offset = 0;
-    }
-
-    /* Get a list of handles that match the UUIDs given to us */
-    for (p_rec = sdp_db_service_search (p_ccb->cont_info.prev_sdp_rec, &uid_seq); p_rec; p_rec = sdp_db_service_search (p_rec, &uid_seq))
-    {
-        p_ccb->cont_info.curr_sdp_rec = p_rec;
-        /* Allow space for attribute sequence type and length */
-        p_seq_start = p_rsp;
-        if (p_ccb->cont_info.last_attr_seq_desc_sent == FALSE)
-        {
-            /* See if there is enough room to include a new service in the current response */
-            rem_len = max_list_len - (INT16) (p_rsp - &p_ccb->rsp_list[0]);
-            if (rem_len < 3)
-            {
-                /* Not enough room. Update continuation info for next response */
-                p_ccb->cont_info.next_attr_index = 0;
-                p_ccb->cont_info.next_attr_start_id = attr_seq.attr_entry[0].start;
-                break;
-            }
-            p_rsp += 3;
-        }
-
-        /* Get a list of handles that match the UUIDs given to us */
-        for (xx = p_ccb->cont_info.next_attr_index; xx < attr_seq.num_attr; xx++)
-        {
-            p_attr = sdp_db_find_attr_in_rec (p_rec, attr_seq.attr_entry[xx].start, attr_seq.attr_entry[xx].end);
-
-            if (p_attr)
-            {
-#if ((defined(SDP_AVRCP_1_6) && (SDP_AVRCP_1_6 == TRUE)) || \
-        (defined(SDP_AVRCP_1_5) && (SDP_AVRCP_1_5 == TRUE)))
-                /* Check for UUID Remote Control and Remote BD address  */
-                is_avrcp_fallback = sdp_fallback_avrcp_version (p_attr, p_ccb->device_address);
-                is_avrcp_browse_bit_reset = sdp_reset_avrcp_browsing_bit(
-                            p_rec->attribute[1], p_attr, p_ccb->device_address);
-#if (defined(SDP_AVRCP_1_6) && (SDP_AVRCP_1_6 == TRUE))
-                is_avrcp_ca_bit_reset = sdp_reset_avrcp_cover_art_bit(
-                            p_rec->attribute[1], p_attr, p_ccb->device_address);
-#endif
-#endif
-                is_hfp_fallback = sdp_change_hfp_version (p_attr, p_ccb->device_address);
-                /* Check if attribute fits. Assume 3-byte value type/length */
-                rem_len = max_list_len - (INT16) (p_rsp - &p_ccb->rsp_list[0]);
-
-                /* just in case */
-                if (rem_len <= 0)
-                {
-                    p_ccb->cont_info.next_attr_index = xx;
-                    p_ccb->cont_info.next_attr_start_id = p_attr->id;
-                    maxxed_out = TRUE;
-                    break;
-                }
-
-                attr_len = sdpu_get_attrib_entry_len(p_attr);
-                /* if there is a partial attribute pending to be sent */
-                if (p_ccb->cont_info.attr_offset)
-                {
-                    if (attr_len < p_ccb->cont_info.attr_offset)
-                    {
-                        android_errorWriteLog(0x534e4554, "79217770");
-                        SDP_TRACE_ERROR("offset is bigger than attribute length");
-                        sdpu_build_n_send_error(p_ccb, trans_num, SDP_INVALID_CONT_STATE,
-                                                SDP_TEXT_BAD_CONT_LEN);
-                        return;
-                    }
-                    p_rsp = sdpu_build_partial_attrib_entry (p_rsp, p_attr, rem_len,
-                                                             &p_ccb->cont_info.attr_offset);
-
-                    /* If the partial attrib could not been fully added yet */
-                    if (p_ccb->cont_info.attr_offset != attr_len)
-                    {
-                        maxxed_out = TRUE;
-                        break;
-                    }
-                    else /* If the partial attrib has been added in full by now */
-                        p_ccb->cont_info.attr_offset = 0; /* reset attr_offset */
-                }
-                else if (rem_len < attr_len) /* Not enough space for attr... so add partially */
-                {
-                    if (attr_len >= SDP_MAX_ATTR_LEN)
-                    {
-                        SDP_TRACE_ERROR("SDP attr too big: max_list_len=%d,attr_len=%d", max_list_len, attr_len);
-                        sdpu_build_n_send_error (p_ccb, trans_num, SDP_NO_RESOURCES, NULL);
-                        return;
-                    }
-
-                    /* add the partial attribute if possible */
-                    p_rsp = sdpu_build_partial_attrib_entry (p_rsp, p_attr, (UINT16)rem_len,
-                                                             &p_ccb->cont_info.attr_offset);
-
-                    p_ccb->cont_info.next_attr_index = xx;
-                    p_ccb->cont_info.next_attr_start_id = p_attr->id;
-                    maxxed_out = TRUE;
-                    break;
-                }
-                else /* build the whole attribute */
-                    p_rsp = sdpu_build_attrib_entry (p_rsp, p_attr);
-
-                /* If doing a range, stick with this one till no more attributes found */
-                if (attr_seq.attr_entry[xx].start != attr_seq.attr_entry[xx].end)
-                {
-                    /* Update for next time through */
-                    attr_seq.attr_entry[xx].start = p_attr->id + 1;
-
-                    xx--;
-                }
-                if (is_avrcp_fallback)
-                {
-#if (defined(SDP_AVRCP_1_6) && (SDP_AVRCP_1_6 == TRUE))
-                    /* Update AVRCP version back to 1.6 */
-                    p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x06;
-#else
-#if (defined(SDP_AVRCP_1_5) && (SDP_AVRCP_1_5 == TRUE))
-                    /* Update AVRCP version back to 1.5 */
-                    p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x05;
-#endif
-#endif
-                    is_avrcp_fallback = FALSE;
-                }
-                if (is_avrcp_browse_bit_reset)
-                {
-                    /* Restore Browsing bit */
-                    SDP_TRACE_ERROR("Restore Browsing bit");
-                    p_attr->value_ptr[AVRCP_SUPPORTED_FEATURES_POSITION]
-                                            |= AVRCP_BROWSE_SUPPORT_BITMASK;
-                    is_avrcp_browse_bit_reset = FALSE;
-                }
-                if (is_hfp_fallback)
-                {
-                    SDP_TRACE_ERROR("Restore HFP version to 1.6");
-                    /* Update HFP version back to 1.6 */
-                    p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x06;
-                    is_hfp_fallback = FALSE;
-                }
-                if (is_avrcp_ca_bit_reset)
-                {
-                    /* Restore Cover Art bit */
-                    SDP_TRACE_ERROR("Restore Cover Art bit");
-                    p_attr->value_ptr[AVRCP_SUPPORTED_FEATURES_POSITION - 1]
-                                            |= AVRCP_CA_SUPPORT_BITMASK;
-                    is_avrcp_ca_bit_reset = FALSE;
-                }
-            }
-        }
-        if (is_avrcp_fallback)
-        {
-#if (defined(SDP_AVRCP_1_6) && (SDP_AVRCP_1_6 == TRUE))
-            /* Update AVRCP version back to 1.6 */
-            p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x06;
-#else
-#if (defined(SDP_AVRCP_1_5) && (SDP_AVRCP_1_5 == TRUE))
-            /* Update AVRCP version back to 1.5 */
-            p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x05;
-#endif
-#endif
-            is_avrcp_fallback = FALSE;
-        }
-        if (is_avrcp_browse_bit_reset)
-        {
-            /* Restore Browsing bit */
-            SDP_TRACE_ERROR("Restore Browsing bit");
-            p_attr->value_ptr[AVRCP_SUPPORTED_FEATURES_POSITION]
-                                    |= AVRCP_BROWSE_SUPPORT_BITMASK;
-            is_avrcp_browse_bit_reset = FALSE;
-        }
-        if (is_hfp_fallback)
-        {
-            SDP_TRACE_ERROR("Restore HFP version to 1.6");
-            /* Update HFP version back to 1.6 */
-            p_attr->value_ptr[PROFILE_VERSION_POSITION] = 0x06;
-            is_hfp_fallback = FALSE;
-        }
-        if (is_avrcp_ca_bit_reset)
-        {
-            /* Restore Cover Art bit */
-            SDP_TRACE_ERROR("Restore Cover Art bit");
-            p_attr->value_ptr[AVRCP_SUPPORTED_FEATURES_POSITION - 1]
-                                    |= AVRCP_CA_SUPPORT_BITMASK;
-            is_avrcp_ca_bit_reset = FALSE;
-        }
-
-        /* Go back and put the type and length into the buffer */
-        if (p_ccb->cont_info.last_attr_seq_desc_sent == FALSE)
-        {
-            seq_len = sdpu_get_attrib_seq_len(p_rec, &attr_seq_sav);
-            if (seq_len != 0)
-            {
-                if (p_seq_start)
-                {
-                    UINT8_TO_BE_STREAM  (p_seq_start, (DATA_ELE_SEQ_DESC_TYPE << 3) | SIZE_IN_NEXT_WORD);
-                    UINT16_TO_BE_STREAM (p_seq_start, seq_len);
-                }
-                else
-                {
-                    SDP_TRACE_DEBUG("SDP service and attribute rsp: Attribute sequence p_seq_start is NULL");
-                }
-
-                if (maxxed_out)
-                    p_ccb->cont_info.last_attr_seq_desc_sent = TRUE;
-            }
-            else
-                p_rsp = p_seq_start;
-        }
-
-        if (maxxed_out)
-            break;
-
-        /* Restore the attr_seq to look for in the next sdp record */
-        memcpy(&attr_seq, &attr_seq_sav, sizeof(tSDP_ATTR_SEQ)) ;
-
-        /* Reset the next attr index */
-        p_ccb->cont_info.next_attr_index = 0;
-        p_ccb->cont_info.prev_sdp_rec = p_rec;
-        p_ccb->cont_info.last_attr_seq_desc_sent = FALSE;
+        p_ccb->list_len = p_ccb->p_rsp_blob->len;
     }
 
     /* response length */
-    len_to_send = (UINT16) (p_rsp - &p_ccb->rsp_list[0]);
-    cont_offset = 0;
-
-    // The current SDP server design has a critical flaw where it can run into an infinite
-    // request/response loop with the client. Here's the scenario:
-    // - client makes SDP request
-    // - server returns the first fragment of the response with a continuation token
-    // - an SDP record is deleted from the server
-    // - client issues another request with previous continuation token
-    // - server has nothing to send back because the record is unavailable but in the
-    //   first fragment, it had specified more response bytes than are now available
-    // - server sends back no additional response bytes and returns the same continuation token
-    // - client issues another request with the continuation token, and the process repeats
-    //
-    // We work around this design flaw here by checking if we will make forward progress
-    // (i.e. we will send > 0 response bytes) on a continued request. If not, we must have
-    // run into the above situation and we tell the peer an error occurred.
-    //
-    // TODO(sharvil): rewrite SDP server.
+    len_to_send = p_ccb->list_len - p_ccb->cont_offset;
+    if (len_to_send > max_list_len)
+        len_to_send = max_list_len;
+
+    // The response is a snapshot taken on the first request, so records deleted
+    // in the meantime cannot make a continuation come up empty. Still make sure
+    // we never answer a continuation without making forward progress, or the
+    // client would loop on the same continuation token.
     if (is_cont && len_to_send == 0) {
       sdpu_build_n_send_error(p_ccb, trans_num, SDP_INVALID_CONT_STATE, NULL);
       return;
     }
 
-    /* If first response, insert sequence header */
-    if (!is_cont)
-    {
-        /* Get the total list length for requested uid and attribute sequence */
-        p_ccb->list_len = sdpu_get_list_len(&uid_seq, &attr_seq_sav) + 3;
-        /* Put in the sequence header (2 or 3 bytes) */
-        if (p_ccb->list_len > 255)
-        {
-            p_ccb->rsp_list[0] = (UINT8) ((DATA_ELE_SEQ_DESC_TYPE << 3) | SIZE_IN_NEXT_WORD);
-            p_ccb->rsp_list[1] = (UINT8) ((p_ccb->list_len - 3) >> 8);
-            p_ccb->rsp_list[2] = (UINT8) (p_ccb->list_len - 3);
-        }
-        else
-        {
-            cont_offset = 1;
-
-            p_ccb->rsp_list[1] = (UINT8) ((DATA_ELE_SEQ_DESC_TYPE << 3) | SIZE_IN_NEXT_BYTE);
-            p_ccb->rsp_list[2] = (UINT8) (p_ccb->list_len - 3);
-
-            p_ccb->list_len--;
-            len_to_send--;
-        }
-    }
-
     /* Get a buffer to use to build the response */
     p_buf = (BT_HDR *)osi_malloc(SDP_DATA_BUF_SIZE);
     p_buf->offset = L2CAP_MIN_OFFSET;
@@ -1327,8 +1443,8 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
     /* Stream the list length to send */
     UINT16_TO_BE_STREAM (p_rsp, len_to_send);
 
-    /* copy from rsp_list to the actual buffer to be sent */
-    memcpy (p_rsp, &p_ccb->rsp_list[cont_offset], len_to_send);
+    /* copy the next slice of the serialized list to the actual buffer to be sent */
+    memcpy (p_rsp, &p_ccb->p_rsp_blob->data[p_ccb->cont_offset], len_to_send);
     p_rsp += len_to_send;
 
     p_ccb->cont_offset += len_to_send;
@@ -1336,13 +1452,14 @@ static void process_service_search_attr_req (tCONN_CB *p_ccb, UINT16 trans_num,
     /* If anything left to send, continuation needed */
     if (p_ccb->cont_offset < p_ccb->list_len)
     {
-        is_cont = TRUE;
-
         UINT8_TO_BE_STREAM  (p_rsp, SDP_CONTINUATION_LEN);
         UINT16_TO_BE_STREAM (p_rsp, p_ccb->cont_offset);
     }
     else
+    {
         UINT8_TO_BE_STREAM (p_rsp, 0);
+        sdp_server_release_rsp (p_ccb);
+    }
 
     /* Go back and put the parameter length into the buffer */
     rsp_param_len = p_rsp - p_rsp_param_len - 2;
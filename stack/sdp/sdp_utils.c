@@ -156,6 +156,7 @@ void sdpu_release_ccb (tCONN_CB *p_ccb)
     if (p_ccb->rsp_list)
         SDP_TRACE_DEBUG("releasing SDP rsp_list");
     osi_free_and_reset((void **)&p_ccb->rsp_list);
+    sdp_server_release_rsp (p_ccb);
 }
 
 /*******************************************************************************
@@ -1127,3 +1128,32 @@ void sdpu_uuid16_to_uuid128(UINT16 uuid16, UINT8* p_uuid128)
     uuid16_bo = ntohs(uuid16);
     memcpy(p_uuid128+ 2, &uuid16_bo, sizeof(uint16_t));
 }
+
+/*******************************************************************************
+**
+** Function         sdpu_uuid_to_uuid128
+**
+** Description      This function expands a 16, 32 or 128-bit BE UUID to its
+**                  128-bit form, so that any two UUIDs can be compared with
+**                  memcmp.
+**
+**                  p_uuid: UUID in Big Endian format
+**                  len: length of the UUID in bytes
+**                  p_uuid128: Expanded 128-bit UUID
+**
+** Returns          TRUE if the UUID length is valid, else FALSE
+**
+*******************************************************************************/
+BOOLEAN sdpu_uuid_to_uuid128 (UINT8 *p_uuid, UINT32 len, UINT8 *p_uuid128)
+{
+    memcpy (p_uuid128, sdp_base_uuid, MAX_UUID_SIZE);
+
+    if (len == 2)
+        memcpy (p_uuid128 + 2, p_uuid, len);
+    else if ((len == 4) || (len == 16))
+        memcpy (p_uuid128, p_uuid, len);
+    else
+        return (FALSE);
+
+    return (TRUE);
+}
@@ -136,12 +136,26 @@ typedef struct
 } tSDP_RECORD;
 
 
+/* Entry of the UUID index: a UUID found anywhere in a record */
+typedef struct
+{
+    UINT8       uuid[MAX_UUID_SIZE];        /* UUID expanded to 128 bits */
+    UINT16      rec_idx;                    /* index of the record in the database */
+} tSDP_UUID_INDEX_ENT;
+
+#define SDP_UUID_INDEX_STALE    0           /* needs to be rebuilt before use */
+#define SDP_UUID_INDEX_READY    1
+#define SDP_UUID_INDEX_FULL     2           /* too many UUIDs, records are parsed instead */
+
 /* Define the SDP database */
 typedef struct
 {
     UINT32         di_primary_handle;       /* Device ID Primary record or NULL if nonexistent */
     UINT16         num_records;
     tSDP_RECORD    record[SDP_MAX_RECORDS];
+    UINT8          uuid_index_state;
+    UINT16         num_uuid_index;
+    tSDP_UUID_INDEX_ENT uuid_index[SDP_MAX_UUID_INDEX];   /* sorted by UUID, then record */
 } tSDP_DB;
 
 enum
@@ -161,6 +175,41 @@ typedef struct
     BOOLEAN           last_attr_seq_desc_sent; /* whether attr seq length has been sent previously */
     UINT16            attr_offset; /* offset within the attr to keep trak of partial attributes in the responses */
 } tSDP_CONT_INFO;
+
+/* Max length of the UUID and attribute sequences used as a response cache key */
+#define SDP_RSP_CACHE_KEY_LEN   64
+
+/* Max number of attribute values in a cached response that may differ per peer */
+#define SDP_MAX_RSP_PATCHES     (SDP_MAX_RECORDS * 2)
+
+/* Attribute value in a serialized response that is rewritten for some peers */
+typedef struct
+{
+    UINT32            record_handle;
+    UINT16            attr_id;
+    UINT16            offset;       /* offset of the attribute value in the response */
+} tSDP_RSP_PATCH;
+
+/* Fully serialized attribute list of a ServiceSearchAttribute response. The
+** server answers the first request and every continuation from it, so it is
+** shared between the response cache and the connections sending it. */
+typedef struct
+{
+    UINT16            ref_count;
+    UINT16            len;
+    UINT8             num_patches;
+    BOOLEAN           patches_full; /* more values than fit in patch[] */
+    tSDP_RSP_PATCH    patch[SDP_MAX_RSP_PATCHES];
+    UINT8             data[];
+} tSDP_RSP_BLOB;
+
+typedef struct
+{
+    tSDP_RSP_BLOB     *p_blob;
+    UINT32            last_used;
+    UINT16            key_len;
+    UINT8             key[SDP_RSP_CACHE_KEY_LEN];
+} tSDP_RSP_CACHE_ENT;
 #endif  /* SDP_SERVER_ENABLED == TRUE */
 
 /* Define the SDP Connection Control Block */
@@ -211,6 +260,7 @@ typedef struct
 #if SDP_SERVER_ENABLED == TRUE
     UINT16            cont_offset;              /* Continuation state data in the server response */
     tSDP_CONT_INFO    cont_info;                /* structure to hold continuation information for the server response */
+    tSDP_RSP_BLOB     *p_rsp_blob;              /* ServiceSearchAttribute response being sent */
 #endif  /* SDP_SERVER_ENABLED == TRUE */
 
 } tCONN_CB;
@@ -223,6 +273,8 @@ typedef struct
     tCONN_CB          ccb[SDP_MAX_CONNECTIONS];
 #if SDP_SERVER_ENABLED == TRUE
     tSDP_DB           server_db;
+    tSDP_RSP_CACHE_ENT rsp_cache[SDP_RSP_CACHE_SIZE];
+    UINT32            rsp_cache_seq;            /* LRU clock of the response cache */
 #endif
     tL2CAP_APPL_INFO  reg_info;                 /* L2CAP Registration info */
     UINT16            max_attr_list_size;       /* Max attribute list size to use   */
@@ -296,6 +348,7 @@ extern UINT16 sdpu_get_attrib_seq_len(tSDP_RECORD *p_rec, tSDP_ATTR_SEQ *attr_se
 extern UINT16 sdpu_get_attrib_entry_len(tSDP_ATTRIBUTE *p_attr);
 extern UINT8 *sdpu_build_partial_attrib_entry (UINT8 *p_out, tSDP_ATTRIBUTE *p_attr, UINT16 len, UINT16 *offset);
 extern void sdpu_uuid16_to_uuid128(UINT16 uuid16, UINT8* p_uuid128);
+extern BOOLEAN sdpu_uuid_to_uuid128 (UINT8 *p_uuid, UINT32 len, UINT8 *p_uuid128);
 
 /* Functions provided by sdp_db.c
 */
@@ -308,8 +361,12 @@ extern tSDP_ATTRIBUTE *sdp_db_find_attr_in_rec (tSDP_RECORD *p_rec, UINT16 start
 */
 #if SDP_SERVER_ENABLED == TRUE
 extern void     sdp_server_handle_client_req (tCONN_CB *p_ccb, BT_HDR *p_msg);
+extern void     sdp_server_release_rsp (tCONN_CB *p_ccb);
+extern void     sdp_server_flush_rsp_cache (void);
 #else
 #define sdp_server_handle_client_req(p_ccb, p_msg)
+#define sdp_server_release_rsp(p_ccb)
+#define sdp_server_flush_rsp_cache()
 #endif
 
 extern BOOLEAN sdp_dev_blacklisted_for_avrcp15 (BD_ADDR addr);
@@ -321,11 +378,28 @@ extern int sdp_get_stored_avrc_tg_version(BD_ADDR addr);
 #if SDP_CLIENT_ENABLED == TRUE
 extern void sdp_disc_connected (tCONN_CB *p_ccb);
 extern void sdp_disc_server_rsp (tCONN_CB *p_ccb, BT_HDR *p_msg);
+extern UINT16 sdp_disc_parse_attr_list (tCONN_CB *p_ccb);
 #else
 #define sdp_disc_connected(p_ccb)
 #define sdp_disc_server_rsp(p_ccb, p_msg)
 #endif
 
+/* Functions provided by sdp_disc_cache.c
+*/
+#if (SDP_CLIENT_ENABLED == TRUE) && (SDP_DISC_CACHE_INCLUDED == TRUE)
+extern BOOLEAN sdp_disc_cache_serve (UINT8 *p_bd_addr, tSDP_DISCOVERY_DB *p_db,
+                                     tSDP_DISC_CMPL_CB *p_cb, tSDP_DISC_CMPL_CB2 *p_cb2,
+                                     void *user_data);
+extern void sdp_disc_cache_store (tCONN_CB *p_ccb);
+extern void sdp_disc_cache_init (void);
+extern void sdp_disc_cache_cleanup (void);
+#else
+#define sdp_disc_cache_serve(p_bd_addr, p_db, p_cb, p_cb2, user_data) FALSE
+#define sdp_disc_cache_store(p_ccb)
+#define sdp_disc_cache_init()
+#define sdp_disc_cache_cleanup()
+#endif
+
 
 
 #endif
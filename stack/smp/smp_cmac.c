@@ -31,6 +31,7 @@
     #include "btm_ble_api.h"
     #include "smp_int.h"
     #include "hcimsgs.h"
+    #include "osi/include/perf_trace.h"
 
 typedef struct
 {
@@ -297,6 +298,7 @@ BOOLEAN aes_cipher_msg_auth_code(BT_OCTET16 key, UINT8 *input, UINT16 length,
     UINT16  diff;
     UINT16  n = (length + BT_OCTET16_LEN - 1) / BT_OCTET16_LEN;       /* n is number of rounds */
     BOOLEAN ret = FALSE;
+    PERF_TRACE_SCOPE("smp_cmac");
 
     SMP_TRACE_EVENT ("%s", __func__);
 
@@ -37,6 +37,7 @@
 #include "aes.h"
 #include "p_256_ecc_pp.h"
 #include "device/include/controller.h"
+#include "osi/include/perf_trace.h"
 
 #ifndef SMP_MAX_ENC_REPEAT
   #define SMP_MAX_ENC_REPEAT  3
@@ -130,6 +131,7 @@ BOOLEAN smp_encrypt_data (UINT8 *key, UINT8 key_len,
     UINT8 *p_rev_data = NULL;    /* input data in big endilan format */
     UINT8 *p_rev_key = NULL;     /* input key in big endilan format */
     UINT8 *p_rev_output = NULL;  /* encrypted output in big endilan format */
+    PERF_TRACE_SCOPE("smp_aes128");
 
     SMP_TRACE_DEBUG ("%s", __func__);
     if ( (p_out == NULL ) || (key_len != SMP_ENCRYT_KEY_SIZE) )
@@ -1075,7 +1077,9 @@ void smp_process_private_key(tSMP_CB *p_cb)
     SMP_TRACE_DEBUG ("%s", __FUNCTION__);
 
     memcpy(private_key, p_cb->private_key, BT_OCTET32_LEN);
+    PERF_TRACE_BEGIN("smp_ecc_public_key");
     ECC_PointMult(&public_key, &(curve_p256.G), (DWORD*) private_key, KEY_LENGTH_DWORDS_P256);
+    PERF_TRACE_END("smp_ecc_public_key");
     memcpy(p_cb->loc_publ_key.x, public_key.x, BT_OCTET32_LEN);
     memcpy(p_cb->loc_publ_key.y, public_key.y, BT_OCTET32_LEN);
 
@@ -1112,7 +1116,9 @@ void smp_compute_dhkey (tSMP_CB *p_cb)
     memcpy(peer_publ_key.x, p_cb->peer_publ_key.x, BT_OCTET32_LEN);
     memcpy(peer_publ_key.y, p_cb->peer_publ_key.y, BT_OCTET32_LEN);
 
+    PERF_TRACE_BEGIN("smp_ecc_dhkey");
     ECC_PointMult(&new_publ_key, &peer_publ_key, (DWORD*) private_key, KEY_LENGTH_DWORDS_P256);
+    PERF_TRACE_END("smp_ecc_dhkey");
 
     memcpy(p_cb->dhkey, new_publ_key.x, BT_OCTET32_LEN);
 
@@ -0,0 +1,240 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "AllocationTestHarness.h"
+
+extern "C" {
+#include <string.h>
+
+#include "avdt_api.h"
+#include "avdt_defs.h"
+#include "avdt_int.h"
+#include "bt_common.h"
+#include "osi/include/allocator.h"
+#include "osi/include/fixed_queue.h"
+#include "osi/include/osi.h"
+}
+
+static const UINT16 test_peer_mtu = 100;
+static const UINT8 test_tsid = 5;
+static const UINT8 test_m_pt = 0x60;
+static const UINT32 test_time_stamp = 0x01020304;
+
+static tAVDT_TC_TBL test_tc_tbl;
+
+// Stubs for the parts of the stack avdt_scb_act.c talks to
+extern "C" {
+tAVDT_CB avdt_cb;
+UINT8 audio_latency_trace_level = BT_TRACE_LEVEL_NONE;
+
+UINT16 L2CA_FlushChannel(UNUSED_ATTR UINT16 lcid, UNUSED_ATTR UINT16 num_to_flush) { return 0; }
+
+tAVDT_TC_TBL *avdt_ad_tc_tbl_by_type(UNUSED_ATTR UINT8 type, UNUSED_ATTR tAVDT_CCB *p_ccb,
+    UNUSED_ATTR tAVDT_SCB *p_scb) {
+  return &test_tc_tbl;
+}
+UINT8 avdt_ad_type_to_tcid(UNUSED_ATTR UINT8 type, UNUSED_ATTR tAVDT_SCB *p_scb) { return 0; }
+UINT8 avdt_ad_write_req(UNUSED_ATTR UINT8 type, UNUSED_ATTR tAVDT_CCB *p_ccb,
+    UNUSED_ATTR tAVDT_SCB *p_scb, BT_HDR *p_buf) {
+  osi_free(p_buf);
+  return AVDT_AD_SUCCESS;
+}
+void avdt_ad_open_req(UNUSED_ATTR UINT8 type, UNUSED_ATTR tAVDT_CCB *p_ccb,
+    UNUSED_ATTR tAVDT_SCB *p_scb, UNUSED_ATTR UINT8 role) {}
+void avdt_ad_close_req(UNUSED_ATTR UINT8 type, UNUSED_ATTR tAVDT_CCB *p_ccb,
+    UNUSED_ATTR tAVDT_SCB *p_scb) {}
+
+tAVDT_CCB *avdt_ccb_by_idx(UNUSED_ATTR UINT8 idx) { return NULL; }
+UINT8 avdt_ccb_to_idx(UNUSED_ATTR tAVDT_CCB *p_ccb) { return 0; }
+void avdt_ccb_event(UNUSED_ATTR tAVDT_CCB *p_ccb, UNUSED_ATTR UINT8 event,
+    UNUSED_ATTR tAVDT_CCB_EVT *p_data) {}
+
+void avdt_msg_send_cmd(UNUSED_ATTR tAVDT_CCB *p_ccb, UNUSED_ATTR void *p_scb,
+    UNUSED_ATTR UINT8 sig_id, UNUSED_ATTR tAVDT_MSG *p_params) {}
+void avdt_msg_send_rsp(UNUSED_ATTR tAVDT_CCB *p_ccb, UNUSED_ATTR UINT8 sig_id,
+    UNUSED_ATTR tAVDT_MSG *p_params) {}
+void avdt_msg_send_rej(UNUSED_ATTR tAVDT_CCB *p_ccb, UNUSED_ATTR UINT8 sig_id,
+    UNUSED_ATTR tAVDT_MSG *p_params) {}
+
+void avdt_scb_event(UNUSED_ATTR tAVDT_SCB *p_scb, UNUSED_ATTR UINT8 event,
+    UNUSED_ATTR tAVDT_SCB_EVT *p_data) {}
+void avdt_scb_dealloc(UNUSED_ATTR tAVDT_SCB *p_scb, UNUSED_ATTR tAVDT_SCB_EVT *p_data) {}
+UINT8 avdt_scb_to_hdl(UNUSED_ATTR tAVDT_SCB *p_scb) { return 1; }
+void avdt_scb_transport_channel_timer_timeout(UNUSED_ATTR void *data) {}
+}
+
+class AvdtScbActTest : public AllocationTestHarness {
+  protected:
+    virtual void SetUp() {
+      AllocationTestHarness::SetUp();
+
+      memset(&avdt_cb, 0, sizeof(avdt_cb));
+      memset(&test_tc_tbl, 0, sizeof(test_tc_tbl));
+      test_tc_tbl.peer_mtu = test_peer_mtu;
+
+      memset(&scb, 0, sizeof(scb));
+      scb.p_ccb = &ccb;
+      scb.frag_q = fixed_queue_new(SIZE_MAX);
+      scb.curr_cfg.psc_mask = AVDT_PSC_MUX;
+      scb.curr_cfg.mux_tsid_media = test_tsid;
+    }
+
+    virtual void TearDown() {
+      avdt_scb_clr_frags(&scb);
+      fixed_queue_free(scb.frag_q, NULL);
+
+      AllocationTestHarness::TearDown();
+    }
+
+    BT_HDR *media_packet(UINT16 offset, UINT16 len) {
+      BT_HDR *p_buf = (BT_HDR *)osi_malloc(BT_HDR_SIZE + offset + len);
+      p_buf->offset = offset;
+      p_buf->len = len;
+      p_buf->layer_specific = 0;
+      for (UINT16 i = 0; i < len; i++)
+        p_buf->data[offset + i] = (UINT8)i;
+      return p_buf;
+    }
+
+    void write_req(BT_HDR *p_buf, UINT8 opt = 0) {
+      tAVDT_SCB_EVT evt;
+      memset(&evt, 0, sizeof(evt));
+      evt.apiwrite.p_buf = p_buf;
+      evt.apiwrite.opt = opt;
+      evt.apiwrite.time_stamp = test_time_stamp;
+      evt.apiwrite.m_pt = test_m_pt;
+      avdt_scb_hdl_write_req(&scb, &evt);
+    }
+
+    // Checks the Adaptation Layer header of |p_frag| and returns its payload
+    const UINT8 *check_al_hdr(BT_HDR *p_frag, bool continuation, UINT16 remaining) {
+      const UINT8 *p = p_frag->data + p_frag->offset;
+      EXPECT_EQ((test_tsid << 3) | AVDT_ALH_LCODE_16BIT |
+                    (continuation ? AVDT_ALH_FRAG_MASK : 0), p[0]);
+      EXPECT_EQ(remaining, (p[1] << 8) | p[2]);
+      return p + AVDT_AL_HDR_SIZE;
+    }
+
+    tAVDT_CCB ccb;
+    tAVDT_SCB scb;
+};
+
+TEST_F(AvdtScbActTest, test_write_req_frag) {
+  const UINT16 payload_len = 250;
+  const UINT16 frag_max = test_peer_mtu - AVDT_AL_HDR_SIZE;
+  const UINT16 total_len = payload_len + AVDT_MEDIA_HDR_SIZE;
+
+  BT_HDR *p_buf = media_packet(AVDT_MEDIA_OFFSET, payload_len);
+  write_req(p_buf);
+
+  // Two copied fragments and the rest sent in the original packet
+  ASSERT_EQ(3U, fixed_queue_length(scb.frag_q));
+  EXPECT_EQ(0U, scb.frag_off);
+  EXPECT_TRUE(scb.p_frag_src == NULL);
+  EXPECT_EQ(1, scb.media_seq);
+
+  BT_HDR *p_frag = (BT_HDR *)fixed_queue_try_dequeue(scb.frag_q);
+  EXPECT_EQ(frag_max + AVDT_AL_HDR_SIZE, p_frag->len);
+  const UINT8 *p = check_al_hdr(p_frag, false, total_len);
+  EXPECT_EQ(AVDT_MEDIA_OCTET1, p[0]);
+  EXPECT_EQ(test_m_pt, p[1]);
+  EXPECT_EQ(1, (p[2] << 8) | p[3]);
+  EXPECT_EQ(test_time_stamp, (UINT32)((p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7]));
+  p += AVDT_MEDIA_HDR_SIZE;
+  for (UINT16 i = 0; i < frag_max - AVDT_MEDIA_HDR_SIZE; i++)
+    ASSERT_EQ((UINT8)i, p[i]) << "at payload byte " << i;
+  osi_free(p_frag);
+
+  UINT16 payload_off = frag_max - AVDT_MEDIA_HDR_SIZE;
+  p_frag = (BT_HDR *)fixed_queue_try_dequeue(scb.frag_q);
+  EXPECT_EQ(frag_max + AVDT_AL_HDR_SIZE, p_frag->len);
+  p = check_al_hdr(p_frag, true, total_len - frag_max);
+  for (UINT16 i = 0; i < frag_max; i++)
+    ASSERT_EQ((UINT8)(payload_off + i), p[i]) << "at payload byte " << payload_off + i;
+  osi_free(p_frag);
+
+  payload_off += frag_max;
+  p_frag = (BT_HDR *)fixed_queue_try_dequeue(scb.frag_q);
+  EXPECT_EQ(p_buf, p_frag);
+  EXPECT_EQ(total_len - 2 * frag_max + AVDT_AL_HDR_SIZE, p_frag->len);
+  p = check_al_hdr(p_frag, true, total_len - 2 * frag_max);
+  for (UINT16 i = 0; i < payload_len - payload_off; i++)
+    ASSERT_EQ((UINT8)(payload_off + i), p[i]) << "at payload byte " << payload_off + i;
+  osi_free(p_frag);
+}
+
+TEST_F(AvdtScbActTest, test_write_req_frag_replaces_pending_packet) {
+  write_req(media_packet(AVDT_MEDIA_OFFSET, 250));
+  write_req(media_packet(AVDT_MEDIA_OFFSET, 150));
+
+  // Only the fragments of the second packet are left
+  EXPECT_EQ(2U, fixed_queue_length(scb.frag_q));
+  EXPECT_EQ(2, scb.media_seq);
+}
+
+TEST_F(AvdtScbActTest, test_write_req_frag_no_headroom) {
+  write_req(media_packet(AVDT_MEDIA_HDR_SIZE - 1, 250));
+
+  // The packet is dropped without writing in front of it
+  EXPECT_TRUE(fixed_queue_is_empty(scb.frag_q));
+  EXPECT_TRUE(scb.p_frag_src == NULL);
+  EXPECT_EQ(0U, scb.frag_off);
+  EXPECT_EQ(0, scb.media_seq);
+}
+
+TEST_F(AvdtScbActTest, test_write_req_frag_no_rtp) {
+  const UINT16 payload_len = 250;
+  const UINT16 frag_max = test_peer_mtu - AVDT_AL_HDR_SIZE;
+
+  // No headroom is needed for a media header that isn't added.
+  BT_HDR *p_buf = media_packet(AVDT_AL_HDR_SIZE, payload_len);
+  write_req(p_buf, AVDT_DATA_OPT_NO_RTP);
+
+  ASSERT_EQ(3U, fixed_queue_length(scb.frag_q));
+  EXPECT_EQ(0, scb.media_seq);
+
+  UINT16 payload_off = 0;
+  for (int i = 0; i < 3; i++) {
+    BT_HDR *p_frag = (BT_HDR *)fixed_queue_try_dequeue(scb.frag_q);
+    UINT16 frag_len = (payload_len - payload_off > frag_max) ? frag_max
+                                                            : payload_len - payload_off;
+    EXPECT_EQ(frag_len + AVDT_AL_HDR_SIZE, p_frag->len);
+    const UINT8 *p = check_al_hdr(p_frag, i != 0, payload_len - payload_off);
+    for (UINT16 j = 0; j < frag_len; j++)
+      ASSERT_EQ((UINT8)(payload_off + j), p[j]) << "at payload byte " << payload_off + j;
+    payload_off += frag_len;
+    osi_free(p_frag);
+  }
+  EXPECT_EQ(payload_len, payload_off);
+}
+
+TEST_F(AvdtScbActTest, test_write_req_media_seq) {
+  // Sequence numbers carry on across packets that are and aren't fragmented.
+  write_req(media_packet(AVDT_MEDIA_OFFSET, 250));
+  EXPECT_EQ(1, scb.media_seq);
+  avdt_scb_clr_frags(&scb);
+
+  write_req(media_packet(AVDT_MEDIA_OFFSET, 50));
+  ASSERT_TRUE(scb.p_pkt != NULL);
+  const UINT8 *p = (const UINT8 *)(scb.p_pkt + 1) + scb.p_pkt->offset;
+  EXPECT_EQ(2, (p[2] << 8) | p[3]);
+  EXPECT_EQ(2, scb.media_seq);
+  osi_free_and_reset((void **)&scb.p_pkt);
+}
@@ -0,0 +1,261 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "AllocationTestHarness.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bt_common.h"
+#include "bt_target.h"
+#include "osi/include/alarm.h"
+#include "osi/include/fixed_queue.h"
+#include "osi/include/osi.h"
+#include "osi/include/semaphore.h"
+#include "osi/include/thread.h"
+#include "sdp_api.h"
+#include "sdpint.h"
+}
+
+static BD_ADDR test_addr = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+static BD_ADDR test_addr_2 = { 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 };
+static const UINT8 test_list[] = { 0x35, 0x03, 0x09, 0x00, 0x01 };
+
+// Offset of the saved time of the first entry in the cache file
+static const long saved_time_offset = 5 + BD_ADDR_LEN;
+
+extern fixed_queue_t *btu_general_alarm_queue;
+
+static thread_t *btu_thread;
+static semaphore_t *done;
+static bool bonded;
+static tCONN_CB refresh_ccb;
+static int refresh_count;
+static UINT8 parsed_list[sizeof(test_list)];
+static UINT16 parsed_len;
+static UINT16 disc_result;
+
+// Stubs for the parts of the stack sdp_disc_cache.c talks to
+extern "C" {
+BOOLEAN btm_sec_is_a_bonded_dev(UNUSED_ATTR BD_ADDR bda) { return bonded; }
+
+tCONN_CB *sdp_conn_originate(UNUSED_ATTR UINT8 *p_bd_addr) {
+  refresh_count++;
+  return &refresh_ccb;
+}
+
+UINT16 sdp_disc_parse_attr_list(tCONN_CB *p_ccb) {
+  parsed_len = p_ccb->list_len;
+  if (p_ccb->list_len <= sizeof(parsed_list))
+    memcpy(parsed_list, p_ccb->rsp_list, p_ccb->list_len);
+  return SDP_SUCCESS;
+}
+
+BOOLEAN SDP_InitDiscoveryDb(UNUSED_ATTR tSDP_DISCOVERY_DB *p_db, UNUSED_ATTR UINT32 len,
+    UNUSED_ATTR UINT16 num_uuid, UNUSED_ATTR tSDP_UUID *p_uuid_list,
+    UNUSED_ATTR UINT16 num_attr, UNUSED_ATTR UINT16 *p_attr_list) {
+  return TRUE;
+}
+}
+
+static void disc_cmpl(UINT16 result) {
+  disc_result = result;
+  semaphore_post(done);
+}
+
+static void post_done(UNUSED_ATTR void *context) {
+  semaphore_post(done);
+}
+
+class SdpDiscCacheTest : public AllocationTestHarness {
+  protected:
+    virtual void SetUp() {
+      AllocationTestHarness::SetUp();
+
+      unlink(SDP_DISC_CACHE_FILE);
+
+      btu_general_alarm_queue = fixed_queue_new(SIZE_MAX);
+      btu_thread = thread_new("sdp_disc_cache_test");
+      alarm_register_processing_queue(btu_general_alarm_queue, btu_thread);
+      done = semaphore_new(0);
+
+      bonded = true;
+      memset(&sdp_cb, 0, sizeof(sdp_cb));
+      sdp_cb.ccb[0].sdp_conn_timer = alarm_new("sdp_disc_cache_test.timer");
+      memset(&refresh_ccb, 0, sizeof(refresh_ccb));
+      refresh_count = 0;
+      parsed_len = 0;
+      disc_result = SDP_GENERIC_ERROR;
+
+      memset(&db, 0, sizeof(db));
+      db.num_uuid_filters = 1;
+      db.uuid_filters[0].len = LEN_UUID_16;
+      db.uuid_filters[0].uu.uuid16 = UUID_SERVCLASS_AUDIO_SINK;
+
+      sdp_disc_cache_init();
+    }
+
+    virtual void TearDown() {
+      sdp_disc_cache_cleanup();
+      unlink(SDP_DISC_CACHE_FILE);
+
+      alarm_free(sdp_cb.ccb[0].sdp_conn_timer);
+      alarm_unregister_processing_queue(btu_general_alarm_queue);
+      thread_free(btu_thread);
+      fixed_queue_free(btu_general_alarm_queue, NULL);
+      btu_general_alarm_queue = NULL;
+      semaphore_free(done);
+      alarm_cleanup();
+
+      AllocationTestHarness::TearDown();
+    }
+
+    // Stores |test_list| as the result of a discovery of |bd_addr|
+    void store(UINT8 *bd_addr) {
+      tCONN_CB conn;
+      memset(&conn, 0, sizeof(conn));
+      memcpy(conn.device_address, bd_addr, BD_ADDR_LEN);
+      conn.p_db = &db;
+      conn.rsp_list = (UINT8 *)test_list;
+      conn.list_len = sizeof(test_list);
+      sdp_disc_cache_store(&conn);
+    }
+
+    // Returns true if the discovery of |bd_addr| is served from the cache
+    bool serve(UINT8 *bd_addr) {
+      if (!sdp_disc_cache_serve(bd_addr, &db, disc_cmpl, NULL, NULL))
+        return false;
+
+      semaphore_wait(done);
+      // The ccb is released after the callback returns
+      thread_post(btu_thread, post_done, NULL);
+      semaphore_wait(done);
+      EXPECT_EQ(SDP_SUCCESS, disc_result);
+      EXPECT_EQ(sizeof(test_list), parsed_len);
+      EXPECT_EQ(0, memcmp(test_list, parsed_list, sizeof(test_list)));
+      return true;
+    }
+
+    // Writes the cache file and moves the first entry |age| seconds back
+    void age_first_entry(UINT32 age) {
+      sdp_disc_cache_cleanup();
+
+      FILE *fp = fopen(SDP_DISC_CACHE_FILE, "r+b");
+      ASSERT_TRUE(fp != NULL);
+      UINT32 saved_time = (UINT32)time(NULL) - age;
+      UINT8 buf[4] = { (UINT8)(saved_time >> 24), (UINT8)(saved_time >> 16),
+                       (UINT8)(saved_time >> 8), (UINT8)saved_time };
+      fseek(fp, saved_time_offset, SEEK_SET);
+      EXPECT_EQ(1U, fwrite(buf, sizeof(buf), 1, fp));
+      fclose(fp);
+
+      sdp_disc_cache_init();
+    }
+
+    tSDP_DISCOVERY_DB db;
+};
+
+TEST_F(SdpDiscCacheTest, test_serve_hit) {
+  EXPECT_FALSE(serve(test_addr));
+
+  store(test_addr);
+  EXPECT_TRUE(serve(test_addr));
+  EXPECT_EQ(SDP_STATE_IDLE, sdp_cb.ccb[0].con_state);
+  EXPECT_EQ(0, refresh_count);
+
+  // Other filters or peers are not served
+  EXPECT_FALSE(serve(test_addr_2));
+  db.uuid_filters[0].uu.uuid16 = UUID_SERVCLASS_AUDIO_SOURCE;
+  EXPECT_FALSE(serve(test_addr));
+}
+
+TEST_F(SdpDiscCacheTest, test_only_bonded) {
+  bonded = false;
+  store(test_addr);
+  bonded = true;
+  EXPECT_FALSE(serve(test_addr));
+
+  // A peer that is no longer bonded is evicted
+  store(test_addr);
+  bonded = false;
+  EXPECT_FALSE(serve(test_addr));
+  bonded = true;
+  EXPECT_FALSE(serve(test_addr));
+}
+
+TEST_F(SdpDiscCacheTest, test_expiry) {
+  store(test_addr);
+  age_first_entry(SDP_DISC_CACHE_FRESH_S + 10);
+
+  EXPECT_FALSE(serve(test_addr));
+  EXPECT_EQ(0, refresh_count);
+}
+
+TEST_F(SdpDiscCacheTest, test_refresh) {
+  store(test_addr);
+  age_first_entry(SDP_DISC_CACHE_REFRESH_S + 10);
+
+  // Served, and asked again in the background
+  EXPECT_TRUE(serve(test_addr));
+  EXPECT_EQ(1, refresh_count);
+  ASSERT_TRUE(refresh_ccb.p_cb2 != NULL);
+
+  // The peer did not answer, so the result is not trusted anymore
+  refresh_ccb.p_cb2(SDP_CONN_FAILED, refresh_ccb.user_data);
+  EXPECT_FALSE(serve(test_addr));
+}
+
+TEST_F(SdpDiscCacheTest, test_flush) {
+  store(test_addr);
+  store(test_addr_2);
+
+  SDP_FlushDiscoveryCache(test_addr);
+  EXPECT_FALSE(serve(test_addr));
+  EXPECT_TRUE(serve(test_addr_2));
+
+  store(test_addr);
+  SDP_FlushDiscoveryCache(NULL);
+  EXPECT_FALSE(serve(test_addr));
+  EXPECT_FALSE(serve(test_addr_2));
+}
+
+TEST_F(SdpDiscCacheTest, test_save_is_deferred) {
+  store(test_addr);
+
+  // Nothing is written by the caller, only after the settle period
+  EXPECT_NE(0, access(SDP_DISC_CACHE_FILE, F_OK));
+}
+
+TEST_F(SdpDiscCacheTest, test_persistence) {
+  store(test_addr);
+  store(test_addr_2);
+  SDP_FlushDiscoveryCache(test_addr_2);
+
+  // Written at cleanup, read again on first use
+  sdp_disc_cache_cleanup();
+  EXPECT_EQ(0, access(SDP_DISC_CACHE_FILE, F_OK));
+  sdp_disc_cache_init();
+
+  EXPECT_TRUE(serve(test_addr));
+  EXPECT_FALSE(serve(test_addr_2));
+}
@@ -0,0 +1,551 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "AllocationTestHarness.h"
+
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "avrc_defs.h"
+#include "bt_common.h"
+#include "bt_target.h"
+#include "bt_utils.h"
+#include "btif/include/btif_storage.h"
+#include "device/include/interop.h"
+#include "l2c_api.h"
+#include "osi/include/alarm.h"
+#include "osi/include/fixed_queue.h"
+#include "osi/include/osi.h"
+#include "sdp_api.h"
+#include "sdpint.h"
+
+extern fixed_queue_t *btu_general_alarm_queue;
+}
+
+static BD_ADDR peer_addr = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+static BD_ADDR other_addr = { 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 };
+
+static const UINT16 TEST_CID = 0x0040;
+static const UINT16 FILLER_UUID = UUID_SERVCLASS_SERIAL_PORT;
+
+// Layout of the entries sdp_get_stored_avrc_tg_version() reads
+struct avrc_peer_entry {
+  int ver;
+  char addr[3];
+};
+
+static tCONN_CB *ccb;
+static std::vector<std::vector<UINT8> > sent_pdus;
+static bool hfp_blacklisted;
+static bool avrcp_blacklisted;
+
+// Stubs for the parts of the stack sdp_server.c talks to
+extern "C" {
+UINT8 L2CA_DataWrite(UNUSED_ATTR UINT16 cid, BT_HDR *p_data) {
+  UINT8 *p = (UINT8 *)(p_data + 1) + p_data->offset;
+  sent_pdus.push_back(std::vector<UINT8>(p, p + p_data->len));
+  osi_free(p_data);
+  return L2CAP_DW_SUCCESS;
+}
+
+void sdp_conn_timer_timeout(UNUSED_ATTR void *data) {}
+
+bool is_device_present(char *header, unsigned char *device_details) {
+  return hfp_blacklisted && !strcmp(header, IOT_HFP_1_7_BLACKLIST) &&
+         !memcmp(device_details, peer_addr, 3);
+}
+
+bool interop_match_addr(const interop_feature_t feature, const bt_bdaddr_t *addr) {
+  return avrcp_blacklisted && feature == INTEROP_ADV_AVRCP_VER_1_3 &&
+         !memcmp(addr->address, peer_addr, BD_ADDR_LEN);
+}
+
+bool interop_match_name(const interop_feature_t feature, const char *name) {
+  return avrcp_blacklisted && feature == INTEROP_ADV_AVRCP_VER_1_3 &&
+         !strcmp(name, "carkit");
+}
+
+bt_status_t btif_storage_get_remote_device_property(UNUSED_ATTR bt_bdaddr_t *remote_bd_addr,
+                                                    bt_property_t *property) {
+  snprintf((char *)property->val, property->len, "%s", "carkit");
+  return BT_STATUS_SUCCESS;
+}
+}
+
+class SdpServerTest : public AllocationTestHarness {
+  protected:
+    virtual void SetUp() {
+      AllocationTestHarness::SetUp();
+
+      unlink(AVRC_PEER_VERSION_CONF_FILE);
+      btu_general_alarm_queue = fixed_queue_new(SIZE_MAX);
+
+      memset(&sdp_cb, 0, sizeof(sdp_cb));
+      ccb = &sdp_cb.ccb[0];
+      ccb->con_state = SDP_STATE_CONNECTED;
+      ccb->connection_id = TEST_CID;
+      ccb->rem_mtu_size = L2CAP_DEFAULT_MTU;
+      ccb->sdp_conn_timer = alarm_new("sdp_server_test.timer");
+      memcpy(ccb->device_address, peer_addr, BD_ADDR_LEN);
+
+      sent_pdus.clear();
+      hfp_blacklisted = false;
+      avrcp_blacklisted = false;
+      trans_num = 0;
+    }
+
+    virtual void TearDown() {
+      sdpu_release_ccb(ccb);
+      alarm_free(ccb->sdp_conn_timer);
+      SDP_DeleteRecord(0);
+      sdp_server_flush_rsp_cache();
+
+      fixed_queue_free(btu_general_alarm_queue, NULL);
+      btu_general_alarm_queue = NULL;
+      alarm_cleanup();
+      unlink(AVRC_PEER_VERSION_CONF_FILE);
+
+      AllocationTestHarness::TearDown();
+    }
+
+    // Adds a record of |service_uuid| named |name|
+    UINT32 add_named_record(UINT16 service_uuid, const std::string &name) {
+      UINT32 handle = SDP_CreateRecord();
+      EXPECT_NE(0U, handle);
+      SDP_AddServiceClassIdList(handle, 1, &service_uuid);
+      SDP_AddAttribute(handle, ATTR_ID_SERVICE_NAME, TEXT_STR_DESC_TYPE,
+                       name.size(), (UINT8 *)name.c_str());
+      return handle;
+    }
+
+    // Adds an AVRCP 1.6 target record with browsing and cover art support
+    UINT32 add_avrcp_tg_record() {
+      UINT16 service_uuid = UUID_SERVCLASS_AV_REM_CTRL_TARGET;
+      UINT8 features[] = { 0x01, 0x41 };
+      UINT32 handle = SDP_CreateRecord();
+      SDP_AddServiceClassIdList(handle, 1, &service_uuid);
+      SDP_AddProfileDescriptorList(handle, UUID_SERVCLASS_AV_REMOTE_CONTROL, AVRC_REV_1_6);
+      SDP_AddAttribute(handle, ATTR_ID_SUPPORTED_FEATURES, UINT_DESC_TYPE,
+                       sizeof(features), features);
+      return handle;
+    }
+
+    // Adds a Handsfree 1.6 audio gateway record
+    UINT32 add_hfp_ag_record() {
+      UINT16 service_uuid = UUID_SERVCLASS_AG_HANDSFREE;
+      UINT32 handle = SDP_CreateRecord();
+      SDP_AddServiceClassIdList(handle, 1, &service_uuid);
+      SDP_AddProfileDescriptorList(handle, UUID_SERVCLASS_HF_HANDSFREE, 0x0106);
+      return handle;
+    }
+
+    void store_avrc_version(BD_ADDR bd_addr, int ver) {
+      avrc_peer_entry entry;
+      memset(&entry, 0, sizeof(entry));
+      entry.ver = ver;
+      memcpy(entry.addr, bd_addr, sizeof(entry.addr));
+      FILE *fp = fopen(AVRC_PEER_VERSION_CONF_FILE, "ab");
+      ASSERT_TRUE(fp != NULL);
+      EXPECT_EQ(1U, fwrite(&entry, sizeof(entry), 1, fp));
+      fclose(fp);
+    }
+
+    // Sends a ServiceSearchAttribute request for all attributes of the
+    // records with |service_uuid|, continuing at |cont| if it is not empty
+    void send_request(UINT16 service_uuid, UINT16 max_len, const std::vector<UINT8> &cont) {
+      std::vector<UINT8> params = {
+        0x35, 0x03, 0x19, (UINT8)(service_uuid >> 8), (UINT8)service_uuid,
+        (UINT8)(max_len >> 8), (UINT8)max_len,
+        0x35, 0x05, 0x0a, 0x00, 0x00, 0xff, 0xff,
+        (UINT8)cont.size()
+      };
+      params.insert(params.end(), cont.begin(), cont.end());
+
+      BT_HDR *p_msg = (BT_HDR *)osi_malloc(sizeof(BT_HDR) + 5 + params.size());
+      p_msg->offset = 0;
+      p_msg->len = 5 + params.size();
+      UINT8 *p = (UINT8 *)(p_msg + 1);
+      UINT8_TO_BE_STREAM(p, SDP_PDU_SERVICE_SEARCH_ATTR_REQ);
+      UINT16_TO_BE_STREAM(p, ++trans_num);
+      UINT16_TO_BE_STREAM(p, params.size());
+      memcpy(p, params.data(), params.size());
+
+      sdp_server_handle_client_req(ccb, p_msg);
+      osi_free(p_msg);
+    }
+
+    // Runs a ServiceSearchAttribute transaction for the records with
+    // |service_uuid| and returns the reassembled attribute lists. Every
+    // response is checked to fit into |max_len| and the MTU.
+    std::vector<UINT8> query(UINT16 service_uuid, UINT16 max_len = 0xffff, int *num_pdus = NULL) {
+      std::vector<UINT8> list;
+      std::vector<UINT8> cont;
+      int pdus = 0;
+
+      for (;;) {
+        sent_pdus.clear();
+        send_request(service_uuid, max_len, cont);
+        ++pdus;
+        if (sent_pdus.size() != 1U) {
+          ADD_FAILURE() << "Expected one response, got " << sent_pdus.size();
+          break;
+        }
+
+        const std::vector<UINT8> &rsp = sent_pdus[0];
+        EXPECT_EQ(SDP_PDU_SERVICE_SEARCH_ATTR_RSP, rsp[0]);
+        EXPECT_EQ(trans_num, (rsp[1] << 8) | rsp[2]);
+        EXPECT_EQ(rsp.size() - 5U, (size_t)((rsp[3] << 8) | rsp[4]));
+        EXPECT_GE(ccb->rem_mtu_size, rsp.size());
+        if (rsp[0] != SDP_PDU_SERVICE_SEARCH_ATTR_RSP)
+          break;
+
+        const size_t byte_count = (rsp[5] << 8) | rsp[6];
+        EXPECT_GE(max_len, byte_count);
+        list.insert(list.end(), rsp.begin() + 7, rsp.begin() + 7 + byte_count);
+
+        const size_t cont_len = rsp[7 + byte_count];
+        cont.assign(rsp.begin() + 8 + byte_count, rsp.end());
+        EXPECT_EQ(cont_len, cont.size());
+        if (cont.empty())
+          break;
+      }
+
+      if (num_pdus)
+        *num_pdus = pdus;
+      return list;
+    }
+
+    // Parses the data element header at |pos| and returns the length of its
+    // data, which starts at |*data_pos|
+    static size_t parse_header(const std::vector<UINT8> &list, size_t pos, size_t *data_pos) {
+      static const size_t fixed_sizes[] = { 1, 2, 4, 8, 16 };
+      const UINT8 type = list[pos] >> 3;
+      const UINT8 size = list[pos] & 0x07;
+      size_t len;
+
+      *data_pos = pos + 1;
+      if (type == 0) {
+        len = 0;
+      } else if (size < 5) {
+        len = fixed_sizes[size];
+      } else {
+        const size_t num_bytes = 1 << (size - 5);
+        len = 0;
+        for (size_t i = 0; i < num_bytes; ++i)
+          len = (len << 8) | list[(*data_pos)++];
+      }
+      return len;
+    }
+
+    // Returns the value of |attr_id| in record |record| of |list|, without
+    // its data element header
+    static std::vector<UINT8> find_attr(const std::vector<UINT8> &list, size_t record,
+                                        UINT16 attr_id) {
+      size_t pos;
+      const size_t list_end = parse_header(list, 0, &pos) + pos;
+      EXPECT_EQ(list.size(), list_end);
+
+      for (size_t rec = 0; pos < list_end; ++rec) {
+        size_t rec_pos;
+        const size_t rec_end = parse_header(list, pos, &rec_pos) + rec_pos;
+        pos = rec_end;
+        if (rec != record)
+          continue;
+
+        while (rec_pos < rec_end) {
+          size_t id_pos, value_pos;
+          parse_header(list, rec_pos, &id_pos);
+          const UINT16 id = (list[id_pos] << 8) | list[id_pos + 1];
+          const size_t value_len = parse_header(list, id_pos + 2, &value_pos);
+          if (id == attr_id)
+            return std::vector<UINT8>(list.begin() + value_pos,
+                                      list.begin() + value_pos + value_len);
+          rec_pos = value_pos + value_len;
+        }
+      }
+      return std::vector<UINT8>();
+    }
+
+    // Returns the number of responses in the cache and the most recent one
+    static size_t cached_responses(tSDP_RSP_BLOB **p_latest) {
+      size_t count = 0;
+      UINT32 latest = 0;
+      for (size_t i = 0; i < SDP_RSP_CACHE_SIZE; ++i) {
+        const tSDP_RSP_CACHE_ENT &ent = sdp_cb.rsp_cache[i];
+        if (ent.p_blob == NULL)
+          continue;
+        ++count;
+        if (p_latest && ent.last_used >= latest) {
+          latest = ent.last_used;
+          *p_latest = ent.p_blob;
+        }
+      }
+      return count;
+    }
+
+    // Returns the AVRCP version and supported features |peer| is shown
+    void query_avrcp(BD_ADDR peer, UINT8 *version, UINT16 *features) {
+      memcpy(ccb->device_address, peer, BD_ADDR_LEN);
+      std::vector<UINT8> list = query(UUID_SERVCLASS_AV_REM_CTRL_TARGET);
+      std::vector<UINT8> desc = find_attr(list, 0, ATTR_ID_BT_PROFILE_DESC_LIST);
+      std::vector<UINT8> feat = find_attr(list, 0, ATTR_ID_SUPPORTED_FEATURES);
+      ASSERT_EQ(8U, desc.size());
+      ASSERT_EQ(2U, feat.size());
+      *version = desc[7];
+      *features = (feat[0] << 8) | feat[1];
+    }
+
+    UINT16 trans_num;
+};
+
+TEST_F(SdpServerTest, test_continuation_across_mtu) {
+  for (int i = 0; i < 6; ++i)
+    add_named_record(FILLER_UUID, "service " + std::to_string(i) + std::string(100, 'x'));
+
+  int num_pdus = 0;
+  std::vector<UINT8> whole = query(FILLER_UUID, 0xffff, &num_pdus);
+  EXPECT_LT(6U * 100U, whole.size());
+  EXPECT_EQ(2, num_pdus);
+
+  // Responses are capped by the MTU even if the client takes more
+  ccb->rem_mtu_size = 100;
+  std::vector<UINT8> sliced = query(FILLER_UUID, 0xffff, &num_pdus);
+  EXPECT_EQ(whole, sliced);
+  EXPECT_LE(8, num_pdus);
+
+  // And by what the client asks for
+  ccb->rem_mtu_size = L2CAP_DEFAULT_MTU;
+  sliced = query(FILLER_UUID, 64, &num_pdus);
+  EXPECT_EQ(whole, sliced);
+  EXPECT_LE(12, num_pdus);
+
+  for (size_t i = 0; i < 6; ++i) {
+    std::vector<UINT8> name = find_attr(sliced, i, ATTR_ID_SERVICE_NAME);
+    EXPECT_EQ("service " + std::to_string(i) + std::string(100, 'x'),
+              std::string(name.begin(), name.end()));
+  }
+}
+
+TEST_F(SdpServerTest, test_bad_continuation) {
+  for (int i = 0; i < 3; ++i)
+    add_named_record(FILLER_UUID, std::string(100, 'x'));
+
+  send_request(FILLER_UUID, 64, std::vector<UINT8>());
+  ASSERT_EQ(1U, sent_pdus.size());
+  EXPECT_EQ(SDP_PDU_SERVICE_SEARCH_ATTR_RSP, sent_pdus[0][0]);
+  EXPECT_EQ(64U, ccb->cont_offset);
+
+  // A token the server did not hand out is refused
+  sent_pdus.clear();
+  send_request(FILLER_UUID, 64, { 0x00, 0x41 });
+  ASSERT_EQ(1U, sent_pdus.size());
+  EXPECT_EQ(SDP_PDU_ERROR_RESPONSE, sent_pdus[0][0]);
+}
+
+TEST_F(SdpServerTest, test_cache_hit) {
+  add_named_record(FILLER_UUID, std::string(100, 'x'));
+  add_avrcp_tg_record();
+  store_avrc_version(peer_addr, AVRC_REV_1_6);
+
+  std::vector<UINT8> first = query(FILLER_UUID);
+  tSDP_RSP_BLOB *p_blob = NULL;
+  EXPECT_EQ(1U, cached_responses(&p_blob));
+  ASSERT_TRUE(p_blob != NULL);
+
+  // The same request is served from the cached response, which a connection
+  // in the middle of a continuation shares rather than copies
+  ccb->rem_mtu_size = 64;
+  send_request(FILLER_UUID, 0xffff, std::vector<UINT8>());
+  EXPECT_EQ(p_blob, ccb->p_rsp_blob);
+  EXPECT_EQ(2, p_blob->ref_count);
+  sdp_server_release_rsp(ccb);
+
+  memcpy(ccb->device_address, other_addr, BD_ADDR_LEN);
+  EXPECT_EQ(first, query(FILLER_UUID));
+  tSDP_RSP_BLOB *p_again = NULL;
+  EXPECT_EQ(1U, cached_responses(&p_again));
+  EXPECT_EQ(p_blob, p_again);
+
+  // Another request gets its own entry
+  memcpy(ccb->device_address, peer_addr, BD_ADDR_LEN);
+  query(UUID_SERVCLASS_AV_REM_CTRL_TARGET);
+  EXPECT_EQ(2U, cached_responses(&p_again));
+  EXPECT_NE(p_blob, p_again);
+}
+
+TEST_F(SdpServerTest, test_cache_eviction) {
+  for (UINT16 i = 0; i <= SDP_RSP_CACHE_SIZE; ++i)
+    add_named_record(FILLER_UUID + 1 + i, "service");
+
+  for (UINT16 i = 0; i < SDP_RSP_CACHE_SIZE; ++i)
+    query(FILLER_UUID + 1 + i);
+  EXPECT_EQ((size_t)SDP_RSP_CACHE_SIZE, cached_responses(NULL));
+
+  // The least recently used entry makes room for the new one
+  query(FILLER_UUID + 1 + SDP_RSP_CACHE_SIZE);
+  EXPECT_EQ((size_t)SDP_RSP_CACHE_SIZE, cached_responses(NULL));
+  for (size_t i = 0; i < SDP_RSP_CACHE_SIZE; ++i)
+    EXPECT_NE(FILLER_UUID + 1, sdp_cb.rsp_cache[i].key[4] | (sdp_cb.rsp_cache[i].key[3] << 8));
+}
+
+TEST_F(SdpServerTest, test_invalidation) {
+  UINT32 handle = add_named_record(FILLER_UUID, "before");
+  add_named_record(FILLER_UUID, "other");
+
+  query(FILLER_UUID);
+  EXPECT_EQ(1U, cached_responses(NULL));
+
+  // Adding, changing or deleting anything drops the cached responses
+  std::string name = "after";
+  SDP_AddAttribute(handle, ATTR_ID_SERVICE_NAME, TEXT_STR_DESC_TYPE,
+                   name.size(), (UINT8 *)name.c_str());
+  EXPECT_EQ(0U, cached_responses(NULL));
+  std::vector<UINT8> list = query(FILLER_UUID);
+  std::vector<UINT8> value = find_attr(list, 0, ATTR_ID_SERVICE_NAME);
+  EXPECT_EQ(name, std::string(value.begin(), value.end()));
+
+  SDP_DeleteAttribute(handle, ATTR_ID_SERVICE_NAME);
+  EXPECT_EQ(0U, cached_responses(NULL));
+  list = query(FILLER_UUID);
+  EXPECT_TRUE(find_attr(list, 0, ATTR_ID_SERVICE_NAME).empty());
+
+  SDP_DeleteRecord(handle);
+  EXPECT_EQ(0U, cached_responses(NULL));
+  list = query(FILLER_UUID);
+  value = find_attr(list, 0, ATTR_ID_SERVICE_NAME);
+  EXPECT_EQ("other", std::string(value.begin(), value.end()));
+  EXPECT_TRUE(find_attr(list, 1, ATTR_ID_SERVICE_NAME).empty());
+}
+
+TEST_F(SdpServerTest, test_invalidation_during_continuation) {
+  UINT32 handle = add_named_record(FILLER_UUID, std::string(100, 'a'));
+  add_named_record(FILLER_UUID, std::string(100, 'b'));
+  std::vector<UINT8> whole = query(FILLER_UUID);
+
+  // A connection in the middle of a response finishes its snapshot
+  send_request(FILLER_UUID, 64, std::vector<UINT8>());
+  std::vector<UINT8> cont = { (UINT8)(ccb->cont_offset >> 8), (UINT8)ccb->cont_offset };
+  std::vector<UINT8> list(sent_pdus[0].begin() + 7, sent_pdus[0].begin() + 7 + 64);
+  SDP_DeleteRecord(handle);
+
+  for (;;) {
+    sent_pdus.clear();
+    send_request(FILLER_UUID, 64, cont);
+    ASSERT_EQ(1U, sent_pdus.size());
+    const std::vector<UINT8> &rsp = sent_pdus[0];
+    ASSERT_EQ(SDP_PDU_SERVICE_SEARCH_ATTR_RSP, rsp[0]);
+    const size_t byte_count = (rsp[5] << 8) | rsp[6];
+    list.insert(list.end(), rsp.begin() + 7, rsp.begin() + 7 + byte_count);
+    cont.assign(rsp.begin() + 8 + byte_count, rsp.end());
+    if (cont.empty())
+      break;
+  }
+  EXPECT_EQ(whole, list);
+
+  // The next transaction sees the change
+  list = query(FILLER_UUID);
+  std::vector<UINT8> value = find_attr(list, 0, ATTR_ID_SERVICE_NAME);
+  EXPECT_EQ(std::string(100, 'b'), std::string(value.begin(), value.end()));
+}
+
+TEST_F(SdpServerTest, test_quirk_hfp_version) {
+  add_hfp_ag_record();
+  hfp_blacklisted = true;
+
+  memcpy(ccb->device_address, other_addr, BD_ADDR_LEN);
+  std::vector<UINT8> list = query(UUID_SERVCLASS_AG_HANDSFREE);
+  std::vector<UINT8> desc = find_attr(list, 0, ATTR_ID_BT_PROFILE_DESC_LIST);
+  ASSERT_EQ(8U, desc.size());
+  EXPECT_EQ(0x06, desc[7]);
+
+  // Patched in a private copy, so the cached response and the database keep
+  // the real version
+  memcpy(ccb->device_address, peer_addr, BD_ADDR_LEN);
+  list = query(UUID_SERVCLASS_AG_HANDSFREE);
+  desc = find_attr(list, 0, ATTR_ID_BT_PROFILE_DESC_LIST);
+  ASSERT_EQ(8U, desc.size());
+  EXPECT_EQ(0x07, desc[7]);
+
+  memcpy(ccb->device_address, other_addr, BD_ADDR_LEN);
+  list = query(UUID_SERVCLASS_AG_HANDSFREE);
+  desc = find_attr(list, 0, ATTR_ID_BT_PROFILE_DESC_LIST);
+  ASSERT_EQ(8U, desc.size());
+  EXPECT_EQ(0x06, desc[7]);
+}
+
+TEST_F(SdpServerTest, test_quirk_avrcp_stored_version) {
+  add_avrcp_tg_record();
+  store_avrc_version(other_addr, AVRC_REV_1_6);
+  store_avrc_version(peer_addr, AVRC_REV_1_4);
+
+  UINT8 version;
+  UINT16 features;
+
+  // A 1.4 peer sees 1.4, without cover art
+  query_avrcp(peer_addr, &version, &features);
+  EXPECT_EQ(0x04, version);
+  EXPECT_EQ(0x0041, features);
+
+  // A 1.6 peer sees everything
+  query_avrcp(other_addr, &version, &features);
+  EXPECT_EQ(0x06, version);
+  EXPECT_EQ(0x0141, features);
+}
+
+TEST_F(SdpServerTest, test_quirk_avrcp_unknown_peer) {
+  add_avrcp_tg_record();
+  store_avrc_version(other_addr, AVRC_REV_1_6);
+
+  UINT8 version;
+  UINT16 features;
+
+  // A peer without a stored version sees 1.3, without browsing or cover art
+  query_avrcp(peer_addr, &version, &features);
+  EXPECT_EQ(0x03, version);
+  EXPECT_EQ(0x0001, features);
+
+  query_avrcp(other_addr, &version, &features);
+  EXPECT_EQ(0x06, version);
+  EXPECT_EQ(0x0141, features);
+}
+
+TEST_F(SdpServerTest, test_quirk_avrcp_blacklisted) {
+  add_avrcp_tg_record();
+  store_avrc_version(peer_addr, AVRC_REV_1_6);
+  store_avrc_version(other_addr, AVRC_REV_1_6);
+  avrcp_blacklisted = true;
+
+  UINT8 version;
+  UINT16 features;
+
+  // Blacklisted peers see 1.3 without browsing, whatever version is stored
+  query_avrcp(peer_addr, &version, &features);
+  EXPECT_EQ(0x03, version);
+  EXPECT_EQ(0x0101, features);
+
+  query_avrcp(other_addr, &version, &features);
+  EXPECT_EQ(0x06, version);
+  EXPECT_EQ(0x0141, features);
+}
@@ -0,0 +1,34 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+// Stubs shared by all the tests in net_test_stack
+
+extern "C" {
+#include "bt_types.h"
+#include "osi/include/fixed_queue.h"
+#include "osi/include/osi.h"
+#include "sdpint.h"
+
+// Set up by the tests that need alarms on the BTU queue
+fixed_queue_t *btu_general_alarm_queue = NULL;
+
+// Reset by the SDP tests
+tSDP_CB sdp_cb;
+
+void LogMsg(UNUSED_ATTR UINT32 trace_set_mask, UNUSED_ATTR const char *fmt_str, ...) {}
+}
@@ -0,0 +1,29 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=     \
+    a2dpringbench.c \
+    ../../audio_a2dp_hw/audio_a2dp_hw.c \
+    ../../udrv/ulinux/uipc.c
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/../../ \
+    $(LOCAL_PATH)/../../include \
+    $(LOCAL_PATH)/../../audio_a2dp_hw \
+    $(LOCAL_PATH)/../../stack/include \
+    $(LOCAL_PATH)/../../udrv/include \
+    $(LOCAL_PATH)/../../utils/include \
+    $(bluetooth_C_INCLUDES)
+
+LOCAL_CFLAGS += $(bluetooth_CFLAGS)
+LOCAL_CONLYFLAGS += $(bluetooth_CONLYFLAGS)
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_EXECUTABLES)
+LOCAL_MODULE_TAGS := debug optional
+LOCAL_MODULE:= a2dpringbench
+
+LOCAL_STATIC_LIBRARIES := libbt-utils libosi
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,398 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/************************************************************************************
+ *
+ *  Filename:      a2dpringbench.c
+ *
+ *  Description:   Latency/jitter harness for the A2DP PCM data path.
+ *
+ *                 Built on the real audio_a2dp_hw.c and uipc.c. A forked child
+ *                 loads the HAL and calls out_write() back to back the way
+ *                 AudioFlinger does; the parent stands in for the media task,
+ *                 answering the HAL's control commands over UIPC and reading
+ *                 one 20 ms tick worth of PCM per media timer tick with
+ *                 UIPC_Read(), so both transports are measured end to end:
+ *                   socket - the audio data socket.
+ *                   ring   - the memfd backed shm_ring, negotiated with
+ *                            A2DP_CTRL_CMD_SHM_RING_SETUP.
+ *                 The mode is picked through A2DP_SHM_RING_PROPERTY, which is
+ *                 restored on exit. The HAL stamps every period with
+ *                 CLOCK_MONOTONIC. Reports end-to-end latency, jitter
+ *                 (stddev), read call cost, underruns, UIPC read stats and
+ *                 context switches on both sides.
+ *
+ *                 Needs to run as a user that can create the sockets in
+ *                 /data/misc/bluedroid and set the property, with the
+ *                 Bluetooth stack itself turned off.
+ *
+ ***********************************************************************************/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "audio_a2dp_hw/audio_a2dp_hw.h"
+#include "bt_types.h"
+#include "bt_trace.h"
+#include "osi/include/osi.h"
+#include "osi/include/properties.h"
+#include "osi/include/shm_ring.h"
+#include "uipc.h"
+
+#define BENCH_RATE          44100
+#define BENCH_FRAME_SZ      4       /* 16 bit stereo */
+#define BENCH_TICK_MS       20      /* BTIF_MEDIA_TIME_TICK */
+#define BENCH_READ_POLL_MS  (BENCH_TICK_MS / 2)   /* A2DP_DATA_READ_POLL_MS */
+#define BENCH_PERIOD_SZ     (AUDIO_STREAM_OUTPUT_BUFFER_SZ / AUDIO_STREAM_OUTPUT_BUFFER_PERIODS)
+#define BENCH_TICK_SZ       (BENCH_RATE * BENCH_FRAME_SZ * BENCH_TICK_MS / 1000)
+#define BENCH_OPEN_TMO_MS   5000
+
+typedef struct {
+    uint64_t count;
+    double sum;
+    double sum_sq;
+    uint64_t max;
+} bench_stat_t;
+
+/* uipc.c traces through the stack's logging */
+UINT8 btif_trace_level = BT_TRACE_LEVEL_WARNING;
+
+void LogMsg(UINT32 trace_set_mask, const char *fmt_str, ...) {
+    if (TRACE_GET_TYPE(trace_set_mask) != TRACE_TYPE_ERROR &&
+        TRACE_GET_TYPE(trace_set_mask) != TRACE_TYPE_WARNING)
+        return;
+
+    va_list ap;
+    va_start(ap, fmt_str);
+    vfprintf(stderr, fmt_str, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+/* the HAL is linked in rather than loaded */
+extern struct audio_module HAL_MODULE_INFO_SYM;
+
+static bool use_ring;
+static volatile bool audio_open;
+static volatile bool ring_ready;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stat_add(bench_stat_t *stat, uint64_t value) {
+    stat->count++;
+    stat->sum += value;
+    stat->sum_sq += (double)value * value;
+    if (value > stat->max)
+        stat->max = value;
+}
+
+static void stat_print(const char *name, const bench_stat_t *stat, double scale, const char *unit) {
+    if (stat->count == 0) {
+        printf("  %-14s n/a\n", name);
+        return;
+    }
+    double mean = stat->sum / stat->count;
+    double var = stat->sum_sq / stat->count - mean * mean;
+    printf("  %-14s mean %8.2f %s  stddev %8.2f %s  max %8.2f %s\n", name,
+           mean / scale, unit, sqrt(var > 0 ? var : 0) / scale, unit,
+           stat->max / scale, unit);
+}
+
+/* HAL side: opens the real HAL and writes as fast as out_write() accepts. */
+static void hal_main(void) {
+    const hw_module_t *module = &HAL_MODULE_INFO_SYM.common;
+    hw_device_t *device = NULL;
+    struct audio_stream_out *out = NULL;
+    uint8_t period[BENCH_PERIOD_SZ];
+
+    if (module->methods->open(module, AUDIO_HARDWARE_INTERFACE, &device) != 0)
+        _exit(1);
+    struct audio_hw_device *adev = (struct audio_hw_device *)device;
+    if (adev->open_output_stream(adev, 0, AUDIO_DEVICE_OUT_BLUETOOTH_A2DP,
+                                 AUDIO_OUTPUT_FLAG_NONE, NULL, &out, NULL) != 0)
+        _exit(1);
+
+    memset(period, 0, sizeof(period));
+    for (;;) {
+        uint64_t stamp = now_ns();
+        memcpy(period, &stamp, sizeof(stamp));
+        out->write(out, period, sizeof(period));
+    }
+}
+
+/* Stack side: the parts of btif_media_task.c the HAL talks to. */
+static void bench_ack(UINT8 ack) {
+    UIPC_Send(UIPC_CH_ID_AV_CTRL, 0, &ack, 1);
+}
+
+static void bench_data_cb(tUIPC_CH_ID ch_id, tUIPC_EVENT event) {
+    if (event != UIPC_OPEN_EVT)
+        return;
+
+    UIPC_Ioctl(ch_id, UIPC_REG_REMOVE_ACTIVE_READSET, NULL);
+    UIPC_Ioctl(ch_id, UIPC_SET_READ_POLL_TMO, (void *)BENCH_READ_POLL_MS);
+    audio_open = true;
+}
+
+/* Mirrors btif_media_setup_shm_ring(): the descriptors go out ahead of the ACK. */
+static void bench_setup_shm_ring(void) {
+    int fds[SHM_RING_FD_COUNT];
+    UINT8 num_fds = SHM_RING_FD_COUNT;
+
+    if (!use_ring) {
+        bench_ack(A2DP_CTRL_ACK_UNSUPPORTED);
+        return;
+    }
+
+    shm_ring_t *ring = shm_ring_new("a2dp_pcm", A2DP_SHM_RING_SZ);
+    if (ring == NULL) {
+        bench_ack(A2DP_CTRL_ACK_UNSUPPORTED);
+        return;
+    }
+
+    shm_ring_get_fds(ring, fds);
+    if (!UIPC_Ioctl(UIPC_CH_ID_AV_AUDIO, UIPC_SET_SHM_RING, ring)) {
+        bench_ack(A2DP_CTRL_ACK_FAILURE);
+        return;
+    }
+
+    if (!UIPC_SendFds(UIPC_CH_ID_AV_CTRL, &num_fds, 1, fds, SHM_RING_FD_COUNT)) {
+        UIPC_Ioctl(UIPC_CH_ID_AV_AUDIO, UIPC_SET_SHM_RING, NULL);
+        bench_ack(A2DP_CTRL_ACK_FAILURE);
+        return;
+    }
+    bench_ack(A2DP_CTRL_ACK_SUCCESS);
+    ring_ready = true;
+}
+
+static void bench_ctrl_cb(UNUSED_ATTR tUIPC_CH_ID ch_id, tUIPC_EVENT event) {
+    UINT8 cmd = 0;
+
+    if (event != UIPC_RX_DATA_READY_EVT)
+        return;
+    if (UIPC_Read(UIPC_CH_ID_AV_CTRL, NULL, &cmd, 1) == 0)
+        return;
+
+    switch (cmd) {
+        case A2DP_CTRL_CMD_CHECK_READY:
+        case A2DP_CTRL_CMD_CHECK_STREAM_STARTED:
+        case A2DP_CTRL_CMD_STOP:
+        case A2DP_CTRL_CMD_SUSPEND:
+        case A2DP_CTRL_CMD_OFFLOAD_NOT_SUPPORTED:
+            bench_ack(A2DP_CTRL_ACK_SUCCESS);
+            break;
+
+        case A2DP_CTRL_CMD_START:
+            UIPC_Open(UIPC_CH_ID_AV_AUDIO, bench_data_cb);
+            bench_ack(A2DP_CTRL_ACK_SUCCESS);
+            break;
+
+        case A2DP_CTRL_GET_AUDIO_CONFIG: {
+            uint32_t sample_rate = BENCH_RATE;
+            uint8_t channel_count = 2;
+            bench_ack(A2DP_CTRL_ACK_SUCCESS);
+            UIPC_Send(UIPC_CH_ID_AV_CTRL, 0, (UINT8 *)&sample_rate, 4);
+            UIPC_Send(UIPC_CH_ID_AV_CTRL, 0, &channel_count, 1);
+            break;
+        }
+
+        case A2DP_CTRL_CMD_SHM_RING_SETUP:
+            bench_setup_shm_ring();
+            break;
+
+        default:
+            bench_ack(A2DP_CTRL_ACK_FAILURE);
+            break;
+    }
+}
+
+static bool wait_ready(void) {
+    for (int waited = 0; waited < BENCH_OPEN_TMO_MS; waited += 10) {
+        if (audio_open && (!use_ring || ring_ready))
+            return true;
+        usleep(10 * 1000);
+    }
+    return false;
+}
+
+/* Picks the HAL timestamps out of the stream; a stamp may straddle reads. */
+static void scan_stamps(bench_stat_t *latency, uint8_t *stamp, uint64_t pos,
+                        const uint8_t *p, size_t len, uint64_t now) {
+    size_t i = 0;
+    while (i < len) {
+        size_t offset = (pos + i) % BENCH_PERIOD_SZ;
+        if (offset >= sizeof(uint64_t)) {
+            i += BENCH_PERIOD_SZ - offset;
+            continue;
+        }
+        size_t take = sizeof(uint64_t) - offset;
+        if (take > len - i)
+            take = len - i;
+        memcpy(stamp + offset, p + i, take);
+        i += take;
+        if (offset + take == sizeof(uint64_t)) {
+            uint64_t sent;
+            memcpy(&sent, stamp, sizeof(sent));
+            stat_add(latency, now - sent);
+        }
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-m socket|ring] [-t seconds]\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *mode = "ring";
+    int seconds = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:t:h")) != -1) {
+        switch (opt) {
+            case 'm':
+                mode = optarg;
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!strcmp(mode, "ring")) {
+        use_ring = true;
+    } else if (strcmp(mode, "socket")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char saved_property[PROPERTY_VALUE_MAX] = {'\0'};
+    osi_property_get(A2DP_SHM_RING_PROPERTY, saved_property, "");
+    if (osi_property_set(A2DP_SHM_RING_PROPERTY, use_ring ? "true" : "false") != 0) {
+        fprintf(stderr, "unable to set %s\n", A2DP_SHM_RING_PROPERTY);
+        return 1;
+    }
+
+    /* fork ahead of the UIPC thread; the HAL retries until the ctrl socket is up */
+    pid_t pid = fork();
+    if (pid == 0) {
+        hal_main();
+        _exit(0);
+    }
+
+    UIPC_Init(NULL);
+    UIPC_Open(UIPC_CH_ID_AV_CTRL, bench_ctrl_cb);
+
+    if (pid < 0 || !wait_ready()) {
+        fprintf(stderr, "HAL did not start streaming over the %s\n", mode);
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            waitpid(pid, NULL, 0);
+        }
+        UIPC_Close(UIPC_CH_ID_ALL);
+        osi_property_set(A2DP_SHM_RING_PROPERTY, saved_property);
+        return 1;
+    }
+
+    bench_stat_t latency = {0};
+    bench_stat_t read_cost = {0};
+    bench_stat_t wake_late = {0};
+    uint64_t underruns = 0;
+    uint64_t pos = 0;
+    uint8_t stamp[sizeof(uint64_t)];
+    uint8_t tick_buf[BENCH_TICK_SZ];
+    const int ticks = seconds * 1000 / BENCH_TICK_MS;
+
+    /* let the HAL fill the transport first, like AudioFlinger does */
+    usleep(100 * 1000);
+
+    struct rusage before;
+    getrusage(RUSAGE_SELF, &before);
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (int tick = 0; tick < ticks; tick++) {
+        next.tv_nsec += BENCH_TICK_MS * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        uint64_t start = now_ns();
+        stat_add(&wake_late, start - ((uint64_t)next.tv_sec * 1000000000ULL + next.tv_nsec));
+        size_t n = UIPC_Read(UIPC_CH_ID_AV_AUDIO, NULL, tick_buf, sizeof(tick_buf));
+        uint64_t end = now_ns();
+        stat_add(&read_cost, end - start);
+
+        if (n < sizeof(tick_buf))
+            underruns++;
+        scan_stamps(&latency, stamp, pos, tick_buf, n, end);
+        pos += n;
+    }
+
+    struct rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    tUIPC_READ_STATS read_stats;
+    memset(&read_stats, 0, sizeof(read_stats));
+    UIPC_Ioctl(UIPC_CH_ID_AV_AUDIO, UIPC_GET_READ_STATS, &read_stats);
+
+    struct rusage hal_usage;
+    int status;
+    kill(pid, SIGTERM);
+    wait4(pid, &status, 0, &hal_usage);
+    UIPC_Close(UIPC_CH_ID_ALL);
+    osi_property_set(A2DP_SHM_RING_PROPERTY, saved_property);
+
+    printf("%s: %d ticks of %d ms, %d byte HAL periods\n", mode, ticks, BENCH_TICK_MS,
+           BENCH_PERIOD_SZ);
+    stat_print("latency", &latency, 1e6, "ms");
+    stat_print("read call", &read_cost, 1e3, "us");
+    stat_print("tick wakeup", &wake_late, 1e3, "us");
+    printf("  underruns:     %" PRIu64 "\n", underruns);
+    printf("  uipc reads:    %" PRIu64 " (%" PRIu64 " short), %" PRIu64 " us blocked\n",
+           (uint64_t)read_stats.read_count, (uint64_t)read_stats.short_read_count,
+           (uint64_t)read_stats.total_wait_us);
+    printf("  stack ctxsw:   %ld voluntary, %ld involuntary\n",
+           after.ru_nvcsw - before.ru_nvcsw, after.ru_nivcsw - before.ru_nivcsw);
+    printf("  hal ctxsw:     %ld voluntary, %ld involuntary\n",
+           hal_usage.ru_nvcsw, hal_usage.ru_nivcsw);
+    return 0;
+}
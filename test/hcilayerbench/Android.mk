@@ -0,0 +1,26 @@
+LOCAL_PATH:= $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:=     \
+    hcilayerbench.c
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/../../ \
+    $(LOCAL_PATH)/../../include \
+    $(LOCAL_PATH)/../../btcore/include \
+    $(LOCAL_PATH)/../../hci/include \
+    $(LOCAL_PATH)/../../stack/include \
+    $(bluetooth_C_INCLUDES)
+
+LOCAL_CFLAGS += $(bluetooth_CFLAGS)
+LOCAL_CONLYFLAGS += $(bluetooth_CONLYFLAGS)
+
+LOCAL_MODULE_PATH := $(TARGET_OUT_EXECUTABLES)
+LOCAL_MODULE_TAGS := debug optional
+LOCAL_MODULE:= hcilayerbench
+
+LOCAL_STATIC_LIBRARIES := libbt-hci libosi libcutils libbtcore libbt-protos
+LOCAL_SHARED_LIBRARIES := liblog libdl libprotobuf-cpp-full
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,881 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/************************************************************************************
+ *
+ *  Filename:      hcilayerbench.c
+ *
+ *  Description:   Replays HCI traffic through hci_layer and packet_fragmenter.
+ *
+ *                 Drives the real hci_layer and packet_fragmenter through a
+ *                 loopback HAL, without a controller. Nothing above the hci
+ *                 layer runs; BTU, L2CAP, GATT and AVDTP are not part of the
+ *                 measurement:
+ *                   inbound  - packets from the capture are handed to the
+ *                              hci thread one at a time, read through
+ *                              hal->read_data() exactly like hci_hal_h4.c.
+ *                   outbound - commands go through transmit_command() and
+ *                              ACL through transmit_downward(), so they are
+ *                              queued, fragmented and "sent" to the HAL.
+ *                 The loopback HAL answers every command with a Command
+ *                 Complete and every ACL packet with a Number Of Completed
+ *                 Packets event, so the capture's own responses are skipped.
+ *                 A consumer thread takes the place of BTU. It only drains the
+ *                 upward queue and counts what is handed up by L2CAP channel
+ *                 (signalling, ATT, SMP, dynamic channels) to show the mix.
+ *
+ *                 The packet sequence only depends on the input, so runs are
+ *                 repeatable. Reports packets/sec, CPU time of the hci thread
+ *                 and the fragmenter, hci thread queueing delay and upward
+ *                 queue latency.
+ *
+ *                 Input is a btsnoop capture (btsnooz logs from a bug report
+ *                 can be converted with tools/scripts/btsnooz.py), or a built
+ *                 in synthetic mix of LE notifications and A2DP media when no
+ *                 capture is given.
+ *
+ *                 Follow-up: the CPU split stops at the upward queue. Timing
+ *                 btu_hci_msg_process(), l2c_rcv_acl_data(), the GATT server
+ *                 and AVDTP media paths needs those layers brought up with
+ *                 connected links and channels (l2c_lcb/ccb, a GATT tcb, an
+ *                 AVDTP stream); without them l2c_rcv_acl_data() drops every
+ *                 packet for an unknown handle and would only measure the
+ *                 drop path. Until then those rows print as not measured.
+ *
+ ***********************************************************************************/
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btcore/include/module.h"
+#include "bt_types.h"
+#include "device/include/controller.h"
+#include "hci/include/btsnoop.h"
+#include "hci/include/buffer_allocator.h"
+#include "hci/include/hci_hal.h"
+#include "hci/include/hci_inject.h"
+#include "hci/include/hci_layer.h"
+#include "hci/include/low_power_manager.h"
+#include "hci/include/packet_fragmenter.h"
+#include "hci/include/vendor.h"
+#include "hcidefs.h"
+#include "l2cdefs.h"
+#include "osi/include/data_dispatcher.h"
+#include "osi/include/fixed_queue.h"
+#include "osi/include/future.h"
+#include "osi/include/osi.h"
+#include "osi/include/semaphore.h"
+#include "osi/include/thread.h"
+#include "osi/include/time.h"
+
+extern const module_t hci_module;
+
+#define BENCH_ACL_SIZE_CLASSIC  1021
+#define BENCH_ACL_SIZE_BLE      251
+#define BENCH_WINDOW            64      /* records in flight between feeder and hci thread */
+#define BENCH_UPWARD_QUEUE_SZ   128     /* same order as btu_hci_msg_queue in practice */
+
+#define BTSNOOP_HEADER_SZ       16
+#define BTSNOOP_RECORD_SZ       24
+#define BTSNOOP_DATALINK_H4     1002
+#define BTSNOOP_FLAG_RECEIVED   0x01
+
+/* Synthetic traffic, one round of each per iteration. */
+#define SYNTH_LE_HANDLE         0x0040
+#define SYNTH_CLASSIC_HANDLE    0x0001
+#define SYNTH_NOTIFY_VALUE_SZ   20
+#define SYNTH_MEDIA_SZ          895     /* one SBC media packet at 2-DH5 */
+#define SYNTH_MEDIA_FRAG_SZ     339     /* controller side fragmentation */
+#define SYNTH_OUT_MEDIA_SZ      1400    /* forces host side fragmentation */
+
+typedef enum {
+    CLASS_EVENT = 0,
+    CLASS_L2CAP_SIGNALLING,
+    CLASS_ATT,
+    CLASS_SMP,
+    CLASS_DYNAMIC,
+    CLASS_SCO,
+    CLASS_OTHER,
+    CLASS_COUNT,
+} traffic_class_t;
+
+static const char *CLASS_NAMES[CLASS_COUNT] = {
+    "hci event",
+    "l2cap sig",
+    "att",
+    "smp",
+    "dynamic",
+    "sco",
+    "other",
+};
+
+typedef struct {
+    uint64_t count;
+    double sum;
+    double sum_sq;
+    uint64_t max;
+} bench_stat_t;
+
+/* One H4 packet from the capture, as it appears on the wire minus the type byte. */
+typedef struct {
+    uint8_t type;
+    bool received;
+    uint16_t len;
+    const uint8_t *data;
+} replay_record_t;
+
+/* A packet in flight from the feeder (or the loopback HAL) to the hci thread. */
+typedef struct {
+    uint8_t type;
+    bool synthesized;
+    uint16_t len;
+    uint16_t pos;
+    uint64_t posted_us;
+    uint8_t data[];
+} inbound_packet_t;
+
+typedef struct {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t cpu_ns;
+} class_stat_t;
+
+static const hci_t *hci;
+static thread_t *hci_thread;
+static thread_t *consumer_thread;
+static const hci_hal_callbacks_t *hal_callbacks;
+static const packet_fragmenter_t *real_fragmenter;
+static fixed_queue_t *upward_queue;
+static semaphore_t *window;
+static semaphore_t *done;
+
+static inbound_packet_t *current_inbound;
+
+/* Only touched on the hci thread. */
+static uint64_t fragmenter_cpu_ns;
+static uint64_t commands_sent;
+static uint64_t acl_fragments_sent;
+static uint64_t packets_in;
+static bench_stat_t hci_wait_stat;
+static bench_stat_t hci_rx_stat;
+
+/* Only touched on the consumer thread. */
+static class_stat_t class_stats[CLASS_COUNT];
+static bench_stat_t upward_latency_stat;
+static uint64_t consumer_packets;
+
+static vendor_cb firmware_config_cb;
+static vendor_cb epilog_cb;
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stat_add(bench_stat_t *stat, uint64_t value) {
+    stat->count++;
+    stat->sum += value;
+    stat->sum_sq += (double)value * value;
+    if (value > stat->max)
+        stat->max = value;
+}
+
+static void stat_print(const char *name, const bench_stat_t *stat, double scale, const char *unit) {
+    if (stat->count == 0) {
+        printf("  %-14s n/a\n", name);
+        return;
+    }
+    double mean = stat->sum / stat->count;
+    double var = stat->sum_sq / stat->count - mean * mean;
+    printf("  %-14s mean %8.2f %s  stddev %8.2f %s  max %8.2f %s\n", name,
+           mean / scale, unit, sqrt(var > 0 ? var : 0) / scale, unit,
+           stat->max / scale, unit);
+}
+
+/* Loopback HAL */
+
+static void deliver_inbound(void *context);
+
+static void post_inbound(uint8_t type, const uint8_t *data, uint16_t len, bool synthesized) {
+    inbound_packet_t *packet = malloc(sizeof(inbound_packet_t) + len);
+    packet->type = type;
+    packet->synthesized = synthesized;
+    packet->len = len;
+    packet->pos = 0;
+    packet->posted_us = time_get_os_boottime_us();
+    memcpy(packet->data, data, len);
+    thread_post(hci_thread, deliver_inbound, packet);
+}
+
+static void deliver_inbound(void *context) {
+    inbound_packet_t *packet = context;
+    uint64_t start_us = time_get_os_boottime_us();
+    stat_add(&hci_wait_stat, start_us - packet->posted_us);
+
+    current_inbound = packet;
+    hal_callbacks->data_ready(packet->type);
+    current_inbound = NULL;
+
+    stat_add(&hci_rx_stat, time_get_os_boottime_us() - start_us);
+    packets_in++;
+    if (!packet->synthesized)
+        semaphore_post(window);
+    free(packet);
+}
+
+static bool hal_init(const hci_hal_callbacks_t *upper_callbacks, thread_t *working_thread) {
+    hal_callbacks = upper_callbacks;
+    hci_thread = working_thread;
+    return true;
+}
+
+static bool hal_open(void) {
+    return true;
+}
+
+static void hal_close(void) {
+}
+
+static size_t hal_read_data(serial_data_type_t type, uint8_t *buffer, size_t max_size) {
+    inbound_packet_t *packet = current_inbound;
+    if (!packet || packet->type != type)
+        return 0;
+
+    size_t count = packet->len - packet->pos;
+    if (count > max_size)
+        count = max_size;
+    memcpy(buffer, packet->data + packet->pos, count);
+    packet->pos += count;
+    return count;
+}
+
+static void hal_packet_finished(UNUSED_ATTR serial_data_type_t type) {
+}
+
+static uint16_t hal_transmit_data(serial_data_type_t type, uint8_t *data, uint16_t length) {
+    if (type == DATA_TYPE_COMMAND) {
+        uint8_t event[] = { HCI_COMMAND_COMPLETE_EVT, 4, 1, data[0], data[1], HCI_SUCCESS };
+        post_inbound(DATA_TYPE_EVENT, event, sizeof(event), true);
+        commands_sent++;
+    } else if (type == DATA_TYPE_ACL) {
+        uint16_t handle = data[0] | (data[1] << 8);
+        uint8_t event[] = { HCI_NUM_COMPL_DATA_PKTS_EVT, 5, 1, handle & 0xff, (handle >> 8) & 0x0f, 1, 0 };
+        post_inbound(DATA_TYPE_EVENT, event, sizeof(event), true);
+        acl_fragments_sent++;
+    }
+    return length;
+}
+
+static bool hal_dev_in_reset(void) {
+    return false;
+}
+
+static hci_hal_t loopback_hal = {
+    hal_init,
+    hal_open,
+    hal_close,
+    hal_read_data,
+    hal_packet_finished,
+    hal_transmit_data,
+    hal_dev_in_reset,
+};
+
+/* Timed wrapper around the real packet fragmenter */
+
+static void fragmenter_init(const packet_fragmenter_callbacks_t *result_callbacks) {
+    real_fragmenter->init(result_callbacks);
+}
+
+static void fragmenter_cleanup(void) {
+    real_fragmenter->cleanup();
+}
+
+/* Every outbound record fed goes through here exactly once, however many
+ * fragments it is sent in, so this is where its window slot comes back. */
+static void fragmenter_fragment_and_dispatch(BT_HDR *packet) {
+    uint64_t start = thread_cpu_ns();
+    real_fragmenter->fragment_and_dispatch(packet);
+    fragmenter_cpu_ns += thread_cpu_ns() - start;
+    semaphore_post(window);
+}
+
+static void fragmenter_reassemble_and_dispatch(BT_HDR *packet) {
+    uint64_t start = thread_cpu_ns();
+    real_fragmenter->reassemble_and_dispatch(packet);
+    fragmenter_cpu_ns += thread_cpu_ns() - start;
+}
+
+static packet_fragmenter_t timed_fragmenter = {
+    fragmenter_init,
+    fragmenter_cleanup,
+    fragmenter_fragment_and_dispatch,
+    fragmenter_reassemble_and_dispatch,
+};
+
+/* Fake controller, vendor library, low power manager and snoop */
+
+static uint16_t get_acl_data_size_classic(void) {
+    return BENCH_ACL_SIZE_CLASSIC;
+}
+
+static uint16_t get_acl_data_size_ble(void) {
+    return BENCH_ACL_SIZE_BLE;
+}
+
+static bool vendor_open(UNUSED_ATTR const uint8_t *local_bdaddr, UNUSED_ATTR const hci_t *hci_interface) {
+    return true;
+}
+
+static void vendor_close(void) {
+}
+
+static int vendor_send_command(UNUSED_ATTR vendor_opcode_t opcode, UNUSED_ATTR void *param) {
+    return 0;
+}
+
+static int vendor_send_async_command(vendor_async_opcode_t opcode, UNUSED_ATTR void *param) {
+    if (opcode == VENDOR_CONFIGURE_FIRMWARE && firmware_config_cb)
+        firmware_config_cb(true);
+    else if (opcode == VENDOR_DO_EPILOG && epilog_cb)
+        epilog_cb(true);
+    return 0;
+}
+
+static void vendor_set_callback(vendor_async_opcode_t opcode, vendor_cb callback) {
+    if (opcode == VENDOR_CONFIGURE_FIRMWARE)
+        firmware_config_cb = callback;
+    else if (opcode == VENDOR_DO_EPILOG)
+        epilog_cb = callback;
+}
+
+static void vendor_ssr_cleanup(UNUSED_ATTR int reason) {
+}
+
+static vendor_t fake_vendor = {
+    vendor_open,
+    vendor_close,
+    vendor_send_command,
+    vendor_send_async_command,
+    vendor_set_callback,
+    vendor_ssr_cleanup,
+};
+
+static void lpm_init(UNUSED_ATTR thread_t *post_thread) {
+}
+
+static void lpm_nop(void) {
+}
+
+static void lpm_start_idle_timer(UNUSED_ATTR bool check_LPM) {
+}
+
+static void snoop_set_api_wants_to_log(UNUSED_ATTR bool value) {
+}
+
+static void snoop_capture(UNUSED_ATTR const BT_HDR *buffer, UNUSED_ATTR bool is_received) {
+}
+
+static bool inject_open(UNUSED_ATTR const hci_t *hci_interface) {
+    return true;
+}
+
+static void inject_close(void) {
+}
+
+static hci_inject_t fake_inject = {
+    inject_open,
+    inject_close,
+};
+
+/* Upward queue consumer */
+
+static traffic_class_t classify(const BT_HDR *packet) {
+    const uint8_t *p = packet->data + packet->offset;
+
+    switch (packet->event & MSG_EVT_MASK) {
+        case MSG_HC_TO_STACK_HCI_EVT:
+            return CLASS_EVENT;
+        case MSG_HC_TO_STACK_HCI_SCO:
+            return CLASS_SCO;
+        case MSG_HC_TO_STACK_HCI_ACL:
+            break;
+        default:
+            return CLASS_OTHER;
+    }
+
+    if (packet->len < HCI_DATA_PREAMBLE_SIZE + L2CAP_PKT_OVERHEAD)
+        return CLASS_OTHER;
+
+    uint16_t cid = p[6] | (p[7] << 8);
+    if (cid == L2CAP_SIGNALLING_CID || cid == L2CAP_BLE_SIGNALLING_CID)
+        return CLASS_L2CAP_SIGNALLING;
+    if (cid == L2CAP_ATT_CID)
+        return CLASS_ATT;
+    if (cid == L2CAP_SMP_CID)
+        return CLASS_SMP;
+    if (cid >= L2CAP_BASE_APPL_CID)
+        return CLASS_DYNAMIC;
+    return CLASS_OTHER;
+}
+
+static void consumer_packet_ready(fixed_queue_t *queue, UNUSED_ATTR void *context) {
+    BT_HDR *packet = fixed_queue_dequeue(queue);
+    uint64_t start = thread_cpu_ns();
+
+    if ((packet->event & MSG_EVT_MASK) == MSG_HC_TO_STACK_HCI_ACL) {
+        uint64_t rx_us = hci_layer_take_acl_rx_time_us();
+        if (rx_us)
+            stat_add(&upward_latency_stat, time_get_os_boottime_us() - rx_us);
+    }
+
+    traffic_class_t class = classify(packet);
+    class_stats[class].packets++;
+    class_stats[class].bytes += packet->len;
+    consumer_packets++;
+
+    osi_free(packet);
+    class_stats[class].cpu_ns += thread_cpu_ns() - start;
+}
+
+/* Synchronization helpers */
+
+static void signal_work_item(UNUSED_ATTR void *context) {
+    semaphore_post(done);
+}
+
+static void flush_thread(thread_t *thread) {
+    /* Double flush to get past anything the reactor already had in hand. */
+    thread_post(thread, signal_work_item, NULL);
+    semaphore_wait(done);
+    thread_post(thread, signal_work_item, NULL);
+    semaphore_wait(done);
+}
+
+static void read_thread_cpu(void *context) {
+    *(uint64_t *)context = thread_cpu_ns();
+    semaphore_post(done);
+}
+
+static uint64_t cpu_of(thread_t *thread) {
+    uint64_t cpu_ns = 0;
+    thread_post(thread, read_thread_cpu, &cpu_ns);
+    semaphore_wait(done);
+    return cpu_ns;
+}
+
+static void reset_complete(BT_HDR *response, UNUSED_ATTR void *context) {
+    osi_free(response);
+    semaphore_post(done);
+}
+
+/* Feeder */
+
+static BT_HDR *make_outbound(uint16_t event, const uint8_t *data, uint16_t len) {
+    BT_HDR *packet = osi_malloc(sizeof(BT_HDR) + len);
+    packet->event = event;
+    packet->len = len;
+    packet->offset = 0;
+    packet->layer_specific = 0;
+    memcpy(packet->data, data, len);
+    return packet;
+}
+
+static bool is_synthesized_response(const replay_record_t *record) {
+    if (record->type != DATA_TYPE_EVENT || record->len < 1)
+        return false;
+    uint8_t code = record->data[0];
+    return code == HCI_COMMAND_COMPLETE_EVT || code == HCI_COMMAND_STATUS_EVT ||
+           code == HCI_NUM_COMPL_DATA_PKTS_EVT;
+}
+
+/* Returns true if the record was handed to the stack. */
+static bool feed_record(const replay_record_t *record) {
+    if (record->received) {
+        if (is_synthesized_response(record))
+            return false;
+        if (record->type != DATA_TYPE_EVENT && record->type != DATA_TYPE_ACL &&
+            record->type != DATA_TYPE_SCO)
+            return false;
+        semaphore_wait(window);
+        post_inbound(record->type, record->data, record->len, false);
+        return true;
+    }
+
+    switch (record->type) {
+        case DATA_TYPE_COMMAND:
+            if (record->len < HCIC_PREAMBLE_SIZE)
+                return false;
+            semaphore_wait(window);
+            hci->transmit_command(make_outbound(MSG_STACK_TO_HC_HCI_CMD, record->data, record->len),
+                                  NULL, NULL, NULL);
+            return true;
+        case DATA_TYPE_ACL:
+            if (record->len < HCI_DATA_PREAMBLE_SIZE)
+                return false;
+            semaphore_wait(window);
+            hci->transmit_downward(MSG_STACK_TO_HC_HCI_ACL,
+                                   make_outbound(MSG_STACK_TO_HC_HCI_ACL | LOCAL_BR_EDR_CONTROLLER_ID,
+                                                 record->data, record->len));
+            return true;
+        case DATA_TYPE_SCO:
+            semaphore_wait(window);
+            hci->transmit_downward(MSG_STACK_TO_HC_HCI_SCO,
+                                   make_outbound(MSG_STACK_TO_HC_HCI_SCO, record->data, record->len));
+            return true;
+        default:
+            return false;
+    }
+}
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Parses a btsnoop v1 H4 capture held in |buffer|. Returns the record count or -1. */
+static ssize_t parse_btsnoop(const uint8_t *buffer, size_t size, replay_record_t **records_out) {
+    if (size < BTSNOOP_HEADER_SZ || memcmp(buffer, "btsnoop", 8) ||
+        read_be32(buffer + 8) != 1 || read_be32(buffer + 12) != BTSNOOP_DATALINK_H4)
+        return -1;
+
+    size_t capacity = 1024;
+    size_t count = 0;
+    replay_record_t *records = malloc(capacity * sizeof(*records));
+
+    size_t pos = BTSNOOP_HEADER_SZ;
+    while (pos + BTSNOOP_RECORD_SZ <= size) {
+        uint32_t included = read_be32(buffer + pos + 4);
+        uint32_t flags = read_be32(buffer + pos + 8);
+        pos += BTSNOOP_RECORD_SZ;
+        if (included > size - pos)
+            break;
+
+        /* Type byte plus something that at least looks like a preamble. */
+        if (included >= 2 && included - 1 <= UINT16_MAX) {
+            if (count == capacity) {
+                capacity *= 2;
+                records = realloc(records, capacity * sizeof(*records));
+            }
+            records[count].type = buffer[pos];
+            records[count].received = flags & BTSNOOP_FLAG_RECEIVED;
+            records[count].len = included - 1;
+            records[count].data = buffer + pos + 1;
+            count++;
+        }
+        pos += included;
+    }
+
+    *records_out = records;
+    return count;
+}
+
+static uint8_t *load_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *buffer = length > 0 ? malloc(length) : NULL;
+    if (buffer && fread(buffer, 1, length, file) != (size_t)length) {
+        free(buffer);
+        buffer = NULL;
+    }
+    fclose(file);
+    *size = length;
+    return buffer;
+}
+
+static uint8_t *put_acl_header(uint8_t *p, uint16_t handle, uint16_t len) {
+    UINT16_TO_STREAM(p, handle);
+    UINT16_TO_STREAM(p, len);
+    return p;
+}
+
+static uint8_t *put_l2cap_header(uint8_t *p, uint16_t len, uint16_t cid) {
+    UINT16_TO_STREAM(p, len);
+    UINT16_TO_STREAM(p, cid);
+    return p;
+}
+
+/*
+ * One round of synthetic traffic, modelled on a HID keyboard and an A2DP sink
+ * sharing the link: eight ATT notifications, a fragmented AVDTP media packet in
+ * each direction, an LE advertising report and a vendor specific command.
+ */
+static size_t synthesize_round(uint8_t *storage, replay_record_t *records) {
+    replay_record_t *r = records;
+    uint8_t *p = storage;
+
+    for (int i = 0; i < 8; i++) {
+        uint16_t att_len = 3 + SYNTH_NOTIFY_VALUE_SZ;
+        r->type = DATA_TYPE_ACL;
+        r->received = true;
+        r->data = p;
+        p = put_acl_header(p, SYNTH_LE_HANDLE | 0x2000, L2CAP_PKT_OVERHEAD + att_len);
+        p = put_l2cap_header(p, att_len, L2CAP_ATT_CID);
+        *p++ = 0x1b;    /* GATT_HANDLE_VALUE_NOTIF */
+        UINT16_TO_STREAM(p, 0x002a);
+        memset(p, i, SYNTH_NOTIFY_VALUE_SZ);
+        p += SYNTH_NOTIFY_VALUE_SZ;
+        r->len = p - r->data;
+        r++;
+    }
+
+    /* Inbound media, split by the controller. */
+    uint16_t remaining = L2CAP_PKT_OVERHEAD + SYNTH_MEDIA_SZ;
+    bool start = true;
+    while (remaining) {
+        uint16_t chunk = remaining > SYNTH_MEDIA_FRAG_SZ ? SYNTH_MEDIA_FRAG_SZ : remaining;
+        r->type = DATA_TYPE_ACL;
+        r->received = true;
+        r->data = p;
+        p = put_acl_header(p, SYNTH_CLASSIC_HANDLE | (start ? 0x2000 : 0x1000), chunk);
+        uint16_t body = chunk;
+        if (start) {
+            p = put_l2cap_header(p, SYNTH_MEDIA_SZ, L2CAP_BASE_APPL_CID);
+            body -= L2CAP_PKT_OVERHEAD;
+        }
+        memset(p, 0x9c, body);
+        p += body;
+        r->len = p - r->data;
+        remaining -= chunk;
+        start = false;
+        r++;
+    }
+
+    /* Outbound media, split by packet_fragmenter. */
+    r->type = DATA_TYPE_ACL;
+    r->received = false;
+    r->data = p;
+    p = put_acl_header(p, SYNTH_CLASSIC_HANDLE | 0x2000, L2CAP_PKT_OVERHEAD + SYNTH_OUT_MEDIA_SZ);
+    p = put_l2cap_header(p, SYNTH_OUT_MEDIA_SZ, L2CAP_BASE_APPL_CID + 1);
+    memset(p, 0x9c, SYNTH_OUT_MEDIA_SZ);
+    p += SYNTH_OUT_MEDIA_SZ;
+    r->len = p - r->data;
+    r++;
+
+    /* LE advertising report. */
+    r->type = DATA_TYPE_EVENT;
+    r->received = true;
+    r->data = p;
+    *p++ = HCI_BLE_EVENT;
+    *p++ = 12 + 31;
+    *p++ = HCI_BLE_ADV_PKT_RPT_EVT;
+    *p++ = 1;       /* num reports */
+    *p++ = 0;       /* ADV_IND */
+    *p++ = 0;       /* public address */
+    memset(p, 0xa5, BD_ADDR_LEN);
+    p += BD_ADDR_LEN;
+    *p++ = 31;
+    memset(p, 0x02, 31);
+    p += 31;
+    *p++ = (uint8_t)-60;
+    r->len = p - r->data;
+    r++;
+
+    /* Vendor specific command, answered by the loopback HAL. */
+    r->type = DATA_TYPE_COMMAND;
+    r->received = false;
+    r->data = p;
+    UINT16_TO_STREAM(p, HCI_GRP_VENDOR_SPECIFIC | 0x0001);
+    *p++ = 0;
+    r->len = p - r->data;
+    r++;
+
+    return r - records;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-f btsnoop_hci.log] [-n iterations]\n", name);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    int iterations = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:n:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                path = optarg;
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    uint8_t *file = NULL;
+    uint8_t *storage = NULL;
+    replay_record_t *records = NULL;
+    ssize_t record_count;
+    if (path) {
+        size_t size = 0;
+        file = load_file(path, &size);
+        if (!file) {
+            fprintf(stderr, "unable to read %s\n", path);
+            return 1;
+        }
+        record_count = parse_btsnoop(file, size, &records);
+        if (record_count <= 0) {
+            fprintf(stderr, "%s is not an H4 btsnoop capture (convert btsnooz with tools/scripts/btsnooz.py)\n", path);
+            return 1;
+        }
+        if (iterations <= 0)
+            iterations = 1;
+    } else {
+        storage = malloc(16 * 1024);
+        records = malloc(32 * sizeof(*records));
+        record_count = synthesize_round(storage, records);
+        if (iterations <= 0)
+            iterations = 20000;
+    }
+
+    static controller_t controller;
+    controller.get_acl_data_size_classic = get_acl_data_size_classic;
+    controller.get_acl_data_size_ble = get_acl_data_size_ble;
+
+    static low_power_manager_t lpm;
+    lpm.init = lpm_init;
+    lpm.cleanup = lpm_nop;
+    lpm.wake_assert = lpm_nop;
+    lpm.transmit_done = lpm_nop;
+    lpm.start_idle_timer = lpm_start_idle_timer;
+    lpm.stop_idle_timer = lpm_nop;
+
+    static btsnoop_t snoop;
+    snoop.set_api_wants_to_log = snoop_set_api_wants_to_log;
+    snoop.capture = snoop_capture;
+
+    const allocator_t *allocator = buffer_allocator_get_interface();
+    real_fragmenter = packet_fragmenter_get_test_interface(&controller, allocator);
+    hci = hci_layer_get_test_interface(allocator, &loopback_hal, &snoop, &fake_inject,
+                                       &timed_fragmenter, &fake_vendor, &lpm);
+
+    window = semaphore_new(BENCH_WINDOW);
+    done = semaphore_new(0);
+    upward_queue = fixed_queue_new(BENCH_UPWARD_QUEUE_SZ);
+    consumer_thread = thread_new("bench_consumer");
+    if (!window || !done || !upward_queue || !consumer_thread) {
+        fprintf(stderr, "unable to set up the upward queue consumer\n");
+        return 1;
+    }
+    fixed_queue_register_dequeue(upward_queue, thread_get_reactor(consumer_thread),
+                                 consumer_packet_ready, NULL);
+    data_dispatcher_register_default(hci->event_dispatcher, upward_queue);
+    hci->set_data_queue(upward_queue);
+
+    if (future_await(hci_module.start_up()) != FUTURE_SUCCESS) {
+        fprintf(stderr, "hci_layer failed to start\n");
+        return 1;
+    }
+
+    /* HCI_RESET's Command Complete is what lets inbound traffic through. */
+    uint8_t reset[] = { HCI_RESET & 0xff, HCI_RESET >> 8, 0 };
+    semaphore_wait(window);
+    hci->transmit_command(make_outbound(MSG_STACK_TO_HC_HCI_CMD, reset, sizeof(reset)),
+                          reset_complete, NULL, NULL);
+    semaphore_wait(done);
+    flush_thread(hci_thread);
+    flush_thread(consumer_thread);
+    memset(&hci_wait_stat, 0, sizeof(hci_wait_stat));
+    memset(&hci_rx_stat, 0, sizeof(hci_rx_stat));
+    fragmenter_cpu_ns = commands_sent = acl_fragments_sent = packets_in = 0;
+
+    uint64_t hci_cpu_start = cpu_of(hci_thread);
+    uint64_t consumer_cpu_start = cpu_of(consumer_thread);
+    uint64_t feeder_cpu_start = thread_cpu_ns();
+    uint64_t start = now_ns();
+
+    uint64_t fed = 0;
+    for (int i = 0; i < iterations; i++)
+        for (ssize_t j = 0; j < record_count; j++)
+            fed += feed_record(&records[j]);
+
+    /* Drain: every window slot comes back once its packet is through the hci thread. */
+    for (int i = 0; i < BENCH_WINDOW; i++)
+        semaphore_wait(window);
+    flush_thread(hci_thread);
+    while (!fixed_queue_is_empty(upward_queue))
+        flush_thread(consumer_thread);
+    flush_thread(consumer_thread);
+
+    uint64_t elapsed = now_ns() - start;
+    uint64_t feeder_cpu = thread_cpu_ns() - feeder_cpu_start;
+    uint64_t hci_cpu = cpu_of(hci_thread) - hci_cpu_start;
+    uint64_t consumer_cpu = cpu_of(consumer_thread) - consumer_cpu_start;
+
+    printf("%s: %d iterations of %zd records, %" PRIu64 " fed\n",
+           path ? path : "synthetic", iterations, record_count, fed);
+    printf("  elapsed:       %.3f s\n", elapsed / 1e9);
+    printf("  throughput:    %.0f packets/s fed, %.0f packets/s up\n",
+           fed / (elapsed / 1e9), consumer_packets / (elapsed / 1e9));
+    printf("  hci thread:    %" PRIu64 " packets in, %" PRIu64 " commands out, %" PRIu64 " acl fragments out\n",
+           packets_in, commands_sent, acl_fragments_sent);
+    printf("CPU time by layer:\n");
+    printf("  feeder         %8.2f ms\n", feeder_cpu / 1e6);
+    printf("  hci + hal      %8.2f ms\n", (hci_cpu - fragmenter_cpu_ns) / 1e6);
+    printf("  fragmenter     %8.2f ms\n", fragmenter_cpu_ns / 1e6);
+    printf("  upward queue   %8.2f ms  (consumer thread standing in for btu)\n", consumer_cpu / 1e6);
+    printf("  btu            not measured\n");
+    printf("  l2cap          not measured\n");
+    printf("  gatt           not measured\n");
+    printf("  avdtp          not measured\n");
+    printf("Latency:\n");
+    stat_print("hci queue", &hci_wait_stat, 1, "us");
+    stat_print("hci rx", &hci_rx_stat, 1, "us");
+    stat_print("upward queue", &upward_latency_stat, 1, "us");
+    printf("Handed up:\n");
+    for (int i = 0; i < CLASS_COUNT; i++) {
+        if (!class_stats[i].packets)
+            continue;
+        printf("  %-14s %10" PRIu64 " packets %12" PRIu64 " bytes %8.2f ms\n", CLASS_NAMES[i],
+               class_stats[i].packets, class_stats[i].bytes, class_stats[i].cpu_ns / 1e6);
+    }
+
+    hci->set_data_queue(NULL);
+    data_dispatcher_register_default(hci->event_dispatcher, NULL);
+    hci_module.shut_down();
+    fixed_queue_unregister_dequeue(upward_queue);
+    thread_free(consumer_thread);
+    fixed_queue_free(upward_queue, osi_free);
+    semaphore_free(window);
+    semaphore_free(done);
+    free(records);
+    free(storage);
+    free(file);
+    return 0;
+}
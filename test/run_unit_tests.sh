@@ -7,6 +7,7 @@ known_tests=(
   net_test_device
   net_test_hci
   net_test_osi
+  net_test_stack
   net_test_btif
 )
 
@@ -0,0 +1,284 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2016 Google, Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/************************************************************************************
+ *
+ *  Filename:      tapiobench.c
+ *
+ *  Description:   Loopback benchmark for the kernel side of the PAN TAP I/O
+ *                 patterns.
+ *
+ *                 Creates a TAP interface and a packet socket bound to it, then
+ *                 moves ethernet frames through the TAP fd with the same system
+ *                 calls btif_pan.c uses:
+ *                   rx - frames sent on the packet socket are drained from the TAP
+ *                        fd into offset buffers until the driver reports EAGAIN.
+ *                   tx - frames are written to the TAP fd with writev, gathering
+ *                        the ethernet header and payload without a bounce copy.
+ *                 Reports throughput in Mbit/s and CPU time per frame.
+ *
+ *                 This only measures the TAP device and the syscall pattern; it
+ *                 does not run btif_pan, BNEP or L2CAP, so it bounds what those
+ *                 layers can reach rather than measuring them.
+ *
+ *                 Needs CAP_NET_ADMIN to create and bring up the interface.
+ *
+ ***********************************************************************************/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/if_tun.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_IF_NAME       "btbench0"
+#define BENCH_ETH_P         0x88b5  /* IEEE local experimental ethertype */
+#define BENCH_ETH_HDR_LEN   14
+#define BENCH_MAX_FRAME     1514
+/* Mirrors PAN_BUF_SIZE / PAN_MINIMUM_OFFSET closely enough for cache effects. */
+#define BENCH_BUF_SIZE      4096
+#define BENCH_BUF_OFFSET    32
+
+typedef struct {
+    const char *tun_dev;
+    const char *mode;
+    int frames;
+    int frame_len;
+} bench_opts_t;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t cpu_us(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000 +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static int tap_open(const char *tun_dev) {
+    int fd = open(tun_dev, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open %s: %s\n", tun_dev, strerror(errno));
+        return -1;
+    }
+
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    strncpy(ifr.ifr_name, BENCH_IF_NAME, IFNAMSIZ - 1);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        fprintf(stderr, "TUNSETIFF failed: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    int sk = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, BENCH_IF_NAME, IFNAMSIZ - 1);
+    ifr.ifr_flags = IFF_UP;
+    int err = ioctl(sk, SIOCSIFFLAGS, &ifr);
+    close(sk);
+    if (err < 0) {
+        fprintf(stderr, "unable to bring up %s: %s\n", BENCH_IF_NAME, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+static int packet_socket_open(void) {
+    int sk = socket(AF_PACKET, SOCK_RAW, htons(BENCH_ETH_P));
+    if (sk < 0) {
+        fprintf(stderr, "unable to open packet socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(BENCH_ETH_P);
+    addr.sll_ifindex = if_nametoindex(BENCH_IF_NAME);
+    if (bind(sk, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "unable to bind packet socket: %s\n", strerror(errno));
+        close(sk);
+        return -1;
+    }
+    return sk;
+}
+
+static void fill_eth_hdr(uint8_t *hdr) {
+    static const uint8_t dst[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    static const uint8_t src[ETH_ALEN] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+    memcpy(hdr, dst, ETH_ALEN);
+    memcpy(hdr + ETH_ALEN, src, ETH_ALEN);
+    hdr[12] = BENCH_ETH_P >> 8;
+    hdr[13] = BENCH_ETH_P & 0xff;
+}
+
+// Kernel -> TAP fd, the read pattern of btu_exec_tap_fd_read.
+static int bench_rx(int tap_fd, int sk, const bench_opts_t *opts) {
+    uint8_t frame[BENCH_MAX_FRAME];
+    memset(frame, 0xa5, sizeof(frame));
+    fill_eth_hdr(frame);
+
+    uint8_t *buf = malloc(BENCH_BUF_SIZE);
+    int sent = 0, received = 0;
+    while (received < opts->frames) {
+        // Keep a modest backlog in the driver queue so each wakeup drains a batch.
+        while (sent < opts->frames && sent - received < 64) {
+            if (send(sk, frame, opts->frame_len, MSG_DONTWAIT) < 0)
+                break;
+            ++sent;
+        }
+
+        struct pollfd pfd = { .fd = tap_fd, .events = POLLIN, .revents = 0 };
+        if (poll(&pfd, 1, 1000) <= 0) {
+            fprintf(stderr, "timed out waiting for TAP data\n");
+            break;
+        }
+
+        for (;;) {
+            ssize_t ret = read(tap_fd, buf + BENCH_BUF_OFFSET, BENCH_BUF_SIZE - BENCH_BUF_OFFSET);
+            if (ret <= 0)
+                break;
+            if (ret >= BENCH_ETH_HDR_LEN &&
+                    ((buf[BENCH_BUF_OFFSET + 12] << 8) | buf[BENCH_BUF_OFFSET + 13]) == BENCH_ETH_P)
+                ++received;
+        }
+    }
+    free(buf);
+    return received;
+}
+
+// TAP fd -> kernel, the write pattern of btpan_tap_send.
+static int bench_tx(int tap_fd, int sk, const bench_opts_t *opts) {
+    uint8_t hdr[BENCH_ETH_HDR_LEN];
+    uint8_t payload[BENCH_MAX_FRAME];
+    uint8_t sink[BENCH_MAX_FRAME];
+    fill_eth_hdr(hdr);
+    memset(payload, 0x5a, sizeof(payload));
+
+    struct iovec iov[2];
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = payload;
+    iov[1].iov_len = opts->frame_len - BENCH_ETH_HDR_LEN;
+
+    int sent = 0, received = 0;
+    while (received < opts->frames) {
+        while (sent < opts->frames && sent - received < 64) {
+            if (writev(tap_fd, iov, 2) < 0)
+                break;
+            ++sent;
+        }
+
+        struct pollfd pfd = { .fd = sk, .events = POLLIN, .revents = 0 };
+        if (poll(&pfd, 1, 1000) <= 0) {
+            fprintf(stderr, "timed out waiting for packet socket data\n");
+            break;
+        }
+
+        while (recv(sk, sink, sizeof(sink), MSG_DONTWAIT) > 0)
+            ++received;
+    }
+    return received;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-d tun_device] [-m rx|tx] [-n frames] [-s frame_len]\n", name);
+}
+
+int main(int argc, char **argv) {
+    bench_opts_t opts = {
+        .tun_dev = "/dev/tun",
+        .mode = "rx",
+        .frames = 100000,
+        .frame_len = BENCH_MAX_FRAME,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:m:n:s:h")) != -1) {
+        switch (opt) {
+            case 'd': opts.tun_dev = optarg; break;
+            case 'm': opts.mode = optarg; break;
+            case 'n': opts.frames = atoi(optarg); break;
+            case 's': opts.frame_len = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (opts.frames <= 0 || opts.frame_len <= BENCH_ETH_HDR_LEN ||
+            opts.frame_len > BENCH_MAX_FRAME ||
+            (strcmp(opts.mode, "rx") && strcmp(opts.mode, "tx"))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int tap_fd = tap_open(opts.tun_dev);
+    if (tap_fd < 0)
+        return 1;
+    int sk = packet_socket_open();
+    if (sk < 0) {
+        close(tap_fd);
+        return 1;
+    }
+
+    uint64_t start = now_us();
+    uint64_t cpu_start = cpu_us();
+    int frames = !strcmp(opts.mode, "rx") ? bench_rx(tap_fd, sk, &opts)
+                                          : bench_tx(tap_fd, sk, &opts);
+    uint64_t elapsed = now_us() - start;
+    uint64_t cpu = cpu_us() - cpu_start;
+
+    close(sk);
+    close(tap_fd);
+
+    if (frames <= 0 || elapsed == 0) {
+        fprintf(stderr, "no frames transferred\n");
+        return 1;
+    }
+
+    double mbps = (double)frames * opts.frame_len * 8 / elapsed;
+    printf("%s: %d frames of %d bytes in %.3f s\n", opts.mode, frames, opts.frame_len,
+           elapsed / 1e6);
+    printf("  throughput: %.1f Mbit/s\n", mbps);
+    printf("  cpu: %.2f us/frame (%.0f%% of one core)\n", (double)cpu / frames,
+           100.0 * cpu / elapsed);
+    return frames == opts.frames ? 0 : 1;
+}
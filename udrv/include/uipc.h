@@ -45,6 +45,20 @@ typedef enum {
 #define UIPC_REG_CBACK                  2
 #define UIPC_REG_REMOVE_ACTIVE_READSET  3
 #define UIPC_SET_READ_POLL_TMO          4
+#define UIPC_SET_SHM_RING               5   /* param is a shm_ring_t*, NULL detaches */
+#define UIPC_GET_READ_STATS             6   /* param is a tUIPC_READ_STATS* */
+
+/* Read side accounting of a channel, reset on every new connection. All
+   times are CLOCK_BOOTTIME based microseconds. */
+typedef struct {
+    UINT64 read_count;          /* UIPC_Read calls */
+    UINT64 short_read_count;    /* reads returning less than requested */
+    UINT64 total_bytes;
+    UINT64 total_wait_us;       /* time spent blocked waiting for data */
+    UINT64 last_read_us;        /* completion time of the last read */
+    UINT64 max_read_gap_us;     /* longest interval between two reads */
+    UINT64 last_ready_us;       /* last time the uipc thread saw data pending */
+} tUIPC_READ_STATS;
 
 typedef void (tUIPC_RCV_CBACK)(tUIPC_CH_ID ch_id, tUIPC_EVENT event); /* points to BT_HDR which describes event type and length of data; len contains the number of bytes of entire message (sizeof(BT_HDR) + offset + size of data) */
 
@@ -94,13 +108,29 @@ void UIPC_Close(tUIPC_CH_ID ch_id);
 *******************************************************************************/
 BOOLEAN UIPC_Send(tUIPC_CH_ID ch_id, UINT16 msg_evt, UINT8 *p_buf, UINT16 msglen);
 
+/*******************************************************************************
+**
+** Function         UIPC_SendFds
+**
+** Description      Called to transmit a message over UIPC together with file
+**                  descriptors (SCM_RIGHTS). The descriptors stay owned by
+**                  the caller.
+**
+** Returns          TRUE in case of success, FALSE in case of failure.
+**
+*******************************************************************************/
+BOOLEAN UIPC_SendFds(tUIPC_CH_ID ch_id, UINT8 *p_buf, UINT16 msglen,
+                     const int *fds, int num_fds);
+
 /*******************************************************************************
 **
 ** Function         UIPC_Read
 **
-** Description      Called to read a message from UIPC.
+** Description      Called to read a message from UIPC. Takes whatever is
+**                  already queued without blocking and only waits, up to the
+**                  channel poll timeout, for the part that is still missing.
 **
-** Returns          void
+** Returns          the number of bytes read.
 **
 *******************************************************************************/
 UINT32 UIPC_Read(tUIPC_CH_ID ch_id, UINT16 *p_msg_evt, UINT8 *p_buf, UINT32 len);
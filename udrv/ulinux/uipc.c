@@ -31,13 +31,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
-#include <sys/prctl.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "audio_a2dp_hw.h"
@@ -45,7 +45,10 @@
 #include "bt_utils.h"
 #include "bt_common.h"
 #include "osi/include/osi.h"
+#include "osi/include/reactor.h"
+#include "osi/include/shm_ring.h"
 #include "osi/include/socket_utils/sockets.h"
+#include "osi/include/thread.h"
 #include "uipc.h"
 
 /*****************************************************************************
@@ -54,8 +57,6 @@
 
 #define PCM_FILENAME "/data/test.pcm"
 
-#define MAX(a,b) ((a)>(b)?(a):(b))
-
 #define CASE_RETURN_STR(const) case const: return #const;
 
 #define UIPC_DISCONNECTED (-1)
@@ -63,39 +64,31 @@
 #define UIPC_LOCK() /*BTIF_TRACE_EVENT(" %s lock", __FUNCTION__);*/ pthread_mutex_lock(&uipc_main.mutex);
 #define UIPC_UNLOCK() /*BTIF_TRACE_EVENT("%s unlock", __FUNCTION__);*/ pthread_mutex_unlock(&uipc_main.mutex);
 
-#define SAFE_FD_ISSET(fd, set) (((fd) == -1) ? FALSE : FD_ISSET((fd), (set)))
-
 #define UIPC_FLUSH_BUFFER_SIZE 1024
 
 /*****************************************************************************
 **  Local type definitions
 ******************************************************************************/
 
-typedef enum {
-    UIPC_TASK_FLAG_DISCONNECT_CHAN = 0x1,
-} tUIPC_TASK_FLAGS;
-
 typedef struct {
     int srvfd;
     int fd;
     int read_poll_tmo_ms;
-    int task_evt_flags;   /* event flags pending to be processed in read task */
-    tUIPC_EVENT cond_flags;
-    pthread_mutex_t cond_mutex;
-    pthread_cond_t  cond;
+    BOOLEAN close_pending;          /* close scheduled on the uipc thread */
+    reactor_object_t *srv_reactor;  /* watches srvfd for incoming connections */
+    reactor_object_t *reactor;      /* watches fd while a callback reads it */
     tUIPC_RCV_CBACK *cback;
+    shm_ring_t *ring;     /* shared memory data path negotiated with the peer */
+    shm_ring_t *ring_in_wait;       /* ring UIPC_Read waits on without the lock */
+    BOOLEAN ring_in_wait_released;  /* released meanwhile, the reader frees it */
+    tUIPC_READ_STATS stats;
 } tUIPC_CHAN;
 
 typedef struct {
-    pthread_t tid; /* main thread id */
-    int running;
+    thread_t *thread;     /* uipc-main, runs all channel callbacks */
+    BOOLEAN running;
     pthread_mutex_t mutex;
 
-    fd_set active_set;
-    fd_set read_set;
-    int max_fd;
-    int signal_fds[2];
-
     tUIPC_CHAN ch[UIPC_CH_NUM];
 } tUIPC_MAIN;
 
@@ -112,6 +105,8 @@ static tUIPC_MAIN uipc_main;
 ******************************************************************************/
 
 static int uipc_close_ch_locked(tUIPC_CH_ID ch_id);
+static void uipc_accept_ready(void *context);
+static void uipc_read_ready(void *context);
 
 /*****************************************************************************
 **  Externs
@@ -137,6 +132,14 @@ const char* dump_uipc_event(tUIPC_EVENT event)
     }
 }
 
+/* same clock as the media task timestamps */
+static UINT64 uipc_time_now_us(void)
+{
+    struct timespec ts_now;
+    clock_gettime(CLOCK_BOOTTIME, &ts_now);
+    return ((UINT64)ts_now.tv_sec * 1000000) + ((UINT64)ts_now.tv_nsec / 1000);
+}
+
 /*****************************************************************************
 **   socket helper functions
 *****************************************************************************/
@@ -214,6 +217,13 @@ static int accept_server_socket(int sfd)
 **
 *****************************************************************************/
 
+static void uipc_raise_priority(void *context)
+{
+    UNUSED(context);
+
+    raise_priority_a2dp(TASK_UIPC_READ);
+}
+
 static int uipc_main_init(void)
 {
     int i;
@@ -224,127 +234,144 @@ static int uipc_main_init(void)
 
     BTIF_TRACE_EVENT("### uipc_main_init ###");
 
-    /* setup interrupt socket pair */
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, uipc_main.signal_fds) < 0)
-    {
-        return -1;
-    }
-
-    FD_SET(uipc_main.signal_fds[0], &uipc_main.active_set);
-    uipc_main.max_fd = MAX(uipc_main.max_fd, uipc_main.signal_fds[0]);
-
     for (i=0; i< UIPC_CH_NUM; i++)
     {
         tUIPC_CHAN *p = &uipc_main.ch[i];
         p->srvfd = UIPC_DISCONNECTED;
         p->fd = UIPC_DISCONNECTED;
-        p->task_evt_flags = 0;
-        pthread_cond_init(&p->cond, NULL);
-        pthread_mutex_init(&p->cond_mutex, NULL);
+        p->close_pending = FALSE;
+        p->srv_reactor = NULL;
+        p->reactor = NULL;
         p->cback = NULL;
+        p->ring = NULL;
+        p->ring_in_wait = NULL;
+        p->ring_in_wait_released = FALSE;
+    }
+
+    uipc_main.thread = thread_new("uipc-main");
+    if (uipc_main.thread == NULL)
+    {
+        BTIF_TRACE_ERROR("%s unable to create uipc thread", __func__);
+        return -1;
     }
 
+    thread_post(uipc_main.thread, uipc_raise_priority, NULL);
+    uipc_main.running = TRUE;
+
     return 0;
 }
 
-void uipc_main_cleanup(void)
+static void uipc_main_cleanup(void *context)
 {
     int i;
+    UNUSED(context);
 
     BTIF_TRACE_EVENT("uipc_main_cleanup");
 
-    close(uipc_main.signal_fds[0]);
-    close(uipc_main.signal_fds[1]);
+    UIPC_LOCK();
 
     /* close any open channels */
     for (i=0; i<UIPC_CH_NUM; i++)
         uipc_close_ch_locked(i);
-}
-
 
+    UIPC_UNLOCK();
+}
 
-/* check pending events in read task */
-static void uipc_check_task_flags_locked(void)
+/* stop delivering read events for a channel, must run on the uipc thread */
+static void uipc_remove_read_locked(tUIPC_CH_ID ch_id)
 {
-    int i;
-
-    for (i=0; i<UIPC_CH_NUM; i++)
+    if (uipc_main.ch[ch_id].reactor)
     {
-        //BTIF_TRACE_EVENT("CHECK TASK FLAGS %x %x",  uipc_main.ch[i].task_evt_flags, UIPC_TASK_FLAG_DISCONNECT_CHAN);
-        if (uipc_main.ch[i].task_evt_flags & UIPC_TASK_FLAG_DISCONNECT_CHAN)
-        {
-            uipc_main.ch[i].task_evt_flags &= ~UIPC_TASK_FLAG_DISCONNECT_CHAN;
-            uipc_close_ch_locked(i);
-        }
-
-        /* add here */
-
+        BTIF_TRACE_EVENT("REMOVE FD %d FROM REACTOR", uipc_main.ch[ch_id].fd);
+        reactor_unregister(uipc_main.ch[ch_id].reactor);
+        uipc_main.ch[ch_id].reactor = NULL;
     }
 }
 
+static void uipc_remove_read(void *context)
+{
+    UIPC_LOCK();
+    uipc_remove_read_locked((tUIPC_CH_ID)(intptr_t)context);
+    UIPC_UNLOCK();
+}
 
-static int uipc_check_fd_locked(tUIPC_CH_ID ch_id)
+static void uipc_accept_ready(void *context)
 {
-    if (ch_id >= UIPC_CH_NUM)
-        return -1;
+    tUIPC_CH_ID ch_id = (tUIPC_CH_ID)(intptr_t)context;
+    tUIPC_CHAN *p = &uipc_main.ch[ch_id];
 
-    //BTIF_TRACE_EVENT("CHECK SRVFD %d (ch %d)", uipc_main.ch[ch_id].srvfd, ch_id);
+    UIPC_LOCK();
 
-    if (SAFE_FD_ISSET(uipc_main.ch[ch_id].srvfd, &uipc_main.read_set))
+    if (p->srvfd == UIPC_DISCONNECTED)
     {
-        BTIF_TRACE_EVENT("INCOMING CONNECTION ON CH %d", ch_id);
+        UIPC_UNLOCK();
+        return;
+    }
 
-        uipc_main.ch[ch_id].fd = accept_server_socket(uipc_main.ch[ch_id].srvfd);
+    BTIF_TRACE_EVENT("INCOMING CONNECTION ON CH %d", ch_id);
 
-        BTIF_TRACE_EVENT("NEW FD %d", uipc_main.ch[ch_id].fd);
+    int fd = accept_server_socket(p->srvfd);
 
-        if ((uipc_main.ch[ch_id].fd > 0) && uipc_main.ch[ch_id].cback)
-        {
-            /*  if we have a callback we should add this fd to the active set
-                and notify user with callback event */
-            BTIF_TRACE_EVENT("ADD FD %d TO ACTIVE SET", uipc_main.ch[ch_id].fd);
-            FD_SET(uipc_main.ch[ch_id].fd, &uipc_main.active_set);
-            uipc_main.max_fd = MAX(uipc_main.max_fd, uipc_main.ch[ch_id].fd);
-        }
+    BTIF_TRACE_EVENT("NEW FD %d", fd);
 
-        if (uipc_main.ch[ch_id].fd < 0)
-        {
-            BTIF_TRACE_ERROR("FAILED TO ACCEPT CH %d (%s)", ch_id, strerror(errno));
-            return -1;
-        }
+    if (fd < 0)
+    {
+        BTIF_TRACE_ERROR("FAILED TO ACCEPT CH %d (%s)", ch_id, strerror(errno));
+        UIPC_UNLOCK();
+        return;
+    }
 
-        if (uipc_main.ch[ch_id].cback)
-            uipc_main.ch[ch_id].cback(ch_id, UIPC_OPEN_EVT);
+    if (p->fd != UIPC_DISCONNECTED)
+    {
+        BTIF_TRACE_WARNING("CH %d REPLACING STALE CONNECTION (FD %d)", ch_id, p->fd);
+        uipc_remove_read_locked(ch_id);
+        close(p->fd);
     }
 
-    //BTIF_TRACE_EVENT("CHECK FD %d (ch %d)", uipc_main.ch[ch_id].fd, ch_id);
+    p->fd = fd;
+    memset(&p->stats, 0, sizeof(p->stats));
 
-    if (SAFE_FD_ISSET(uipc_main.ch[ch_id].fd, &uipc_main.read_set))
+    if (p->cback)
     {
-        //BTIF_TRACE_EVENT("INCOMING DATA ON CH %d", ch_id);
-
-        if (uipc_main.ch[ch_id].cback)
-            uipc_main.ch[ch_id].cback(ch_id, UIPC_RX_DATA_READY_EVT);
+        /*  if we have a callback we should watch this fd and notify
+            user with callback event */
+        BTIF_TRACE_EVENT("ADD FD %d TO REACTOR", fd);
+        p->reactor = reactor_register(thread_get_reactor(uipc_main.thread), fd,
+                                      context, uipc_read_ready, NULL);
+        p->cback(ch_id, UIPC_OPEN_EVT);
     }
-    return 0;
+
+    UIPC_UNLOCK();
 }
 
-static void uipc_check_interrupt_locked(void)
+static void uipc_read_ready(void *context)
 {
-    if (SAFE_FD_ISSET(uipc_main.signal_fds[0], &uipc_main.read_set))
+    tUIPC_CH_ID ch_id = (tUIPC_CH_ID)(intptr_t)context;
+    tUIPC_CHAN *p = &uipc_main.ch[ch_id];
+    int pending = 0;
+    int last_pending;
+
+    UIPC_LOCK();
+
+    p->stats.last_ready_us = uipc_time_now_us();
+
+    /* deliver everything queued on the socket in this wakeup rather than
+       going back through epoll for each message; stop as soon as the
+       callback no longer consumes data or stops watching the channel */
+    do
     {
-        char sig_recv = 0;
-        OSI_NO_INTR(recv(uipc_main.signal_fds[0], &sig_recv, sizeof(sig_recv),
-                         MSG_WAITALL));
-    }
-}
+        last_pending = pending;
 
-static inline void uipc_wakeup_locked(void)
-{
-    char sig_on = 1;
-    BTIF_TRACE_EVENT("UIPC SEND WAKE UP");
+        //BTIF_TRACE_EVENT("INCOMING DATA ON CH %d", ch_id);
+        if (p->cback == NULL || p->reactor == NULL || p->close_pending)
+            break;
+        p->cback(ch_id, UIPC_RX_DATA_READY_EVT);
+
+        if (p->fd == UIPC_DISCONNECTED || ioctl(p->fd, FIONREAD, &pending) < 0)
+            break;
+    } while (pending > 0 && pending != last_pending);
 
-    OSI_NO_INTR(send(uipc_main.signal_fds[1], &sig_on, sizeof(sig_on), 0));
+    UIPC_UNLOCK();
 }
 
 static int uipc_setup_server_locked(tUIPC_CH_ID ch_id, char *name, tUIPC_RCV_CBACK *cback)
@@ -367,17 +394,22 @@ static int uipc_setup_server_locked(tUIPC_CH_ID ch_id, char *name, tUIPC_RCV_CBA
          return -1;
     }
 
-    BTIF_TRACE_EVENT("ADD SERVER FD TO ACTIVE SET %d", fd);
-    FD_SET(fd, &uipc_main.active_set);
-    uipc_main.max_fd = MAX(uipc_main.max_fd, fd);
+    BTIF_TRACE_EVENT("ADD SERVER FD TO REACTOR %d", fd);
+    uipc_main.ch[ch_id].srv_reactor =
+        reactor_register(thread_get_reactor(uipc_main.thread), fd,
+                         (void *)(intptr_t)ch_id, uipc_accept_ready, NULL);
+    if (uipc_main.ch[ch_id].srv_reactor == NULL)
+    {
+        BTIF_TRACE_ERROR("failed to watch %s", name);
+        close(fd);
+        UIPC_UNLOCK();
+        return -1;
+    }
 
     uipc_main.ch[ch_id].srvfd = fd;
     uipc_main.ch[ch_id].cback = cback;
     uipc_main.ch[ch_id].read_poll_tmo_ms = DEFAULT_READ_POLL_TMO_MS;
 
-    /* trigger main thread to update read set */
-    uipc_wakeup_locked();
-
     UIPC_UNLOCK();
 
     return 0;
@@ -386,42 +418,33 @@ static int uipc_setup_server_locked(tUIPC_CH_ID ch_id, char *name, tUIPC_RCV_CBA
 static void uipc_flush_ch_locked(tUIPC_CH_ID ch_id)
 {
     char buf[UIPC_FLUSH_BUFFER_SIZE];
-    struct pollfd pfd;
-
-    pfd.events = POLLIN;
-    pfd.fd = uipc_main.ch[ch_id].fd;
+    int fd = uipc_main.ch[ch_id].fd;
 
-    if (uipc_main.ch[ch_id].fd == UIPC_DISCONNECTED)
+    if (fd == UIPC_DISCONNECTED)
     {
         BTIF_TRACE_EVENT("%s() - fd disconnected. Exiting", __FUNCTION__);
         return;
     }
 
+    /* drain whatever is queued right now; data arriving afterwards is
+       new audio and must not be thrown away */
     while (1)
     {
-        int ret;
-        OSI_NO_INTR(ret = poll(&pfd, 1, 1));
-        if (ret == 0) {
-            BTIF_TRACE_VERBOSE("%s(): poll() timeout - nothing to do. Exiting",
-                               __func__);
-            return;
-        }
-        if (ret < 0) {
-            BTIF_TRACE_WARNING("%s() - poll() failed: return %d errno %d (%s). Exiting",
-                               __func__, ret, errno, strerror(errno));
+        ssize_t ret;
+        OSI_NO_INTR(ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT));
+        if (ret > 0)
+            continue;
+        if (ret == 0)
+        {
+            BTIF_TRACE_WARNING("%s() - peer closed. Exiting", __FUNCTION__);
             return;
         }
-        BTIF_TRACE_VERBOSE("%s() - polling fd %d, revents: 0x%x, ret %d",
-                __FUNCTION__, pfd.fd, pfd.revents, ret);
-        if (pfd.revents & (POLLERR|POLLHUP))
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
         {
-            BTIF_TRACE_WARNING("%s() - POLLERR or POLLHUP. Exiting", __FUNCTION__);
-            return;
+            BTIF_TRACE_WARNING("%s() - recv() failed: errno %d (%s). Exiting",
+                               __func__, errno, strerror(errno));
         }
-
-        /* read sufficiently large buffer to ensure flush empties socket faster than
-           it is getting refilled */
-        read(pfd.fd, &buf, UIPC_FLUSH_BUFFER_SIZE);
+        return;
     }
 }
 
@@ -437,150 +460,96 @@ static void uipc_flush_locked(tUIPC_CH_ID ch_id)
             uipc_flush_ch_locked(UIPC_CH_ID_AV_CTRL);
             break;
         case UIPC_CH_ID_AV_AUDIO:
+            if (uipc_main.ch[ch_id].ring)
+                shm_ring_flush(uipc_main.ch[ch_id].ring);
             uipc_flush_ch_locked(UIPC_CH_ID_AV_AUDIO);
             break;
     }
 }
 
 
-static int uipc_close_ch_locked(tUIPC_CH_ID ch_id)
+/* detaches the shared memory ring from a channel and frees it, unless
+   UIPC_Read is blocked on it, in which case the reader frees it */
+static void uipc_release_ring_locked(tUIPC_CH_ID ch_id)
 {
-    int wakeup = 0;
+    shm_ring_t *ring = uipc_main.ch[ch_id].ring;
 
+    uipc_main.ch[ch_id].ring = NULL;
+    if (ring == NULL)
+        return;
+
+    if (ring == uipc_main.ch[ch_id].ring_in_wait)
+        uipc_main.ch[ch_id].ring_in_wait_released = TRUE;
+    else
+        shm_ring_free(ring);
+}
+
+/* must run on the uipc thread, which owns all reactor registrations */
+static int uipc_close_ch_locked(tUIPC_CH_ID ch_id)
+{
     BTIF_TRACE_EVENT("CLOSE CHANNEL %d", ch_id);
 
     if (ch_id >= UIPC_CH_NUM)
         return -1;
 
+    uipc_main.ch[ch_id].close_pending = FALSE;
+
     if (uipc_main.ch[ch_id].srvfd != UIPC_DISCONNECTED)
     {
         BTIF_TRACE_EVENT("CLOSE SERVER (FD %d)", uipc_main.ch[ch_id].srvfd);
+        reactor_unregister(uipc_main.ch[ch_id].srv_reactor);
+        uipc_main.ch[ch_id].srv_reactor = NULL;
         close(uipc_main.ch[ch_id].srvfd);
-        FD_CLR(uipc_main.ch[ch_id].srvfd, &uipc_main.active_set);
         uipc_main.ch[ch_id].srvfd = UIPC_DISCONNECTED;
-        wakeup = 1;
     }
 
     if (uipc_main.ch[ch_id].fd != UIPC_DISCONNECTED)
     {
         BTIF_TRACE_EVENT("CLOSE CONNECTION (FD %d)", uipc_main.ch[ch_id].fd);
+        uipc_remove_read_locked(ch_id);
         close(uipc_main.ch[ch_id].fd);
-        FD_CLR(uipc_main.ch[ch_id].fd, &uipc_main.active_set);
         uipc_main.ch[ch_id].fd = UIPC_DISCONNECTED;
-        wakeup = 1;
+    }
+
+    if (uipc_main.ch[ch_id].ring)
+    {
+        BTIF_TRACE_EVENT("RELEASE SHM RING (CH %d)", ch_id);
+        uipc_release_ring_locked(ch_id);
     }
 
     /* notify this connection is closed */
     if (uipc_main.ch[ch_id].cback)
         uipc_main.ch[ch_id].cback(ch_id, UIPC_CLOSE_EVT);
 
-    /* trigger main thread update if something was updated */
-    if (wakeup)
-        uipc_wakeup_locked();
-
     return 0;
 }
 
-
-void uipc_close_locked(tUIPC_CH_ID ch_id)
-{
-    if (uipc_main.ch[ch_id].srvfd == UIPC_DISCONNECTED)
-    {
-        BTIF_TRACE_EVENT("CHANNEL %d ALREADY CLOSED", ch_id);
-        return;
-    }
-
-    /* schedule close on this channel */
-    uipc_main.ch[ch_id].task_evt_flags |= UIPC_TASK_FLAG_DISCONNECT_CHAN;
-    uipc_wakeup_locked();
-}
-
-
-static void uipc_read_task(void *arg)
+static void uipc_close_ch(void *context)
 {
-    int ch_id;
-    int result;
-    UNUSED(arg);
-
-    prctl(PR_SET_NAME, (unsigned long)"uipc-main", 0, 0, 0);
+    tUIPC_CH_ID ch_id = (tUIPC_CH_ID)(intptr_t)context;
 
-    raise_priority_a2dp(TASK_UIPC_READ);
-
-    while (uipc_main.running)
-    {
-        uipc_main.read_set = uipc_main.active_set;
-
-        result = select(uipc_main.max_fd+1, &uipc_main.read_set, NULL, NULL, NULL);
-
-        if (result == 0) {
-            BTIF_TRACE_EVENT("select timeout");
-            continue;
-        }
-        if (result < 0) {
-            if (errno != EINTR)
-                BTIF_TRACE_EVENT("select failed %s", strerror(errno));
-            continue;
-        }
-
-        UIPC_LOCK();
-
-        /* clear any wakeup interrupt */
-        uipc_check_interrupt_locked();
-
-        /* check pending task events */
-        uipc_check_task_flags_locked();
-
-        /* make sure we service audio channel first */
-        uipc_check_fd_locked(UIPC_CH_ID_AV_AUDIO);
-
-        /* check for other connections */
-        for (ch_id = 0; ch_id < UIPC_CH_NUM; ch_id++)
-        {
-            if (ch_id != UIPC_CH_ID_AV_AUDIO)
-                uipc_check_fd_locked(ch_id);
-        }
-
-        UIPC_UNLOCK();
-    }
-
-    BTIF_TRACE_EVENT("UIPC READ THREAD EXITING");
-
-    uipc_main_cleanup();
-
-    uipc_main.tid = 0;
-
-    BTIF_TRACE_EVENT("UIPC READ THREAD DONE");
+    UIPC_LOCK();
+    /* the close may have been overtaken by a shutdown */
+    if (uipc_main.ch[ch_id].close_pending)
+        uipc_close_ch_locked(ch_id);
+    UIPC_UNLOCK();
 }
 
 
-int uipc_start_main_server_thread(void)
+void uipc_close_locked(tUIPC_CH_ID ch_id)
 {
-    uipc_main.running = 1;
-
-    if (pthread_create(&uipc_main.tid, (const pthread_attr_t *) NULL, (void*)uipc_read_task, NULL) < 0)
+    if (uipc_main.ch[ch_id].srvfd == UIPC_DISCONNECTED)
     {
-        BTIF_TRACE_ERROR("uipc_thread_create pthread_create failed:%d", errno);
-        return -1;
+        BTIF_TRACE_EVENT("CHANNEL %d ALREADY CLOSED", ch_id);
+        return;
     }
 
-    return 0;
-}
-
-/* blocking call */
-void uipc_stop_main_server_thread(void)
-{
-    /* request shutdown of read thread */
-    UIPC_LOCK();
-    uipc_main.running = 0;
-    uipc_wakeup_locked();
-    UIPC_UNLOCK();
+    if (uipc_main.ch[ch_id].close_pending)
+        return;
 
-    /* wait until read thread is fully terminated */
-    /* tid might hold pointer value where it's value
-       is negative vaule with singed bit is set, so
-       corrected the logic to check zero or non zero */
-    if (uipc_main.tid)
-        pthread_join(uipc_main.tid, NULL);
+    /* schedule close on this channel */
+    uipc_main.ch[ch_id].close_pending = TRUE;
+    thread_post(uipc_main.thread, uipc_close_ch, (void *)(intptr_t)ch_id);
 }
 
 /*******************************************************************************
@@ -602,8 +571,6 @@ void UIPC_Init(void *p_data)
     memset(&uipc_main, 0, sizeof(tUIPC_MAIN));
 
     uipc_main_init();
-
-    uipc_start_main_server_thread();
 }
 
 /*******************************************************************************
@@ -621,7 +588,7 @@ BOOLEAN UIPC_Open(tUIPC_CH_ID ch_id, tUIPC_RCV_CBACK *p_cback)
 
     UIPC_LOCK();
 
-    if (ch_id >= UIPC_CH_NUM)
+    if (ch_id >= UIPC_CH_NUM || !uipc_main.running)
     {
         UIPC_UNLOCK();
         return FALSE;
@@ -675,7 +642,19 @@ void UIPC_Close(tUIPC_CH_ID ch_id)
     else
     {
         BTIF_TRACE_DEBUG("UIPC_Close : waiting for shutdown to complete");
-        uipc_stop_main_server_thread();
+
+        /* no channel may be reopened from a close callback from here on */
+        UIPC_LOCK();
+        uipc_main.running = FALSE;
+        UIPC_UNLOCK();
+
+        if (uipc_main.thread)
+        {
+            /* queued work, including the cleanup, runs before the thread exits */
+            thread_post(uipc_main.thread, uipc_main_cleanup, NULL);
+            thread_free(uipc_main.thread);
+            uipc_main.thread = NULL;
+        }
         BTIF_TRACE_DEBUG("UIPC_Close : shutdown complete");
     }
 }
@@ -709,11 +688,154 @@ BOOLEAN UIPC_Send(tUIPC_CH_ID ch_id, UINT16 msg_evt, UINT8 *p_buf,
     return FALSE;
 }
 
+/*******************************************************************************
+ **
+ ** Function         UIPC_SendFds
+ **
+ ** Description      Called to transmit a message over UIPC together with file
+ **                  descriptors (SCM_RIGHTS). The descriptors stay owned by
+ **                  the caller.
+ **
+ ** Returns          TRUE in case of success, FALSE in case of failure.
+ **
+ *******************************************************************************/
+BOOLEAN UIPC_SendFds(tUIPC_CH_ID ch_id, UINT8 *p_buf, UINT16 msglen,
+        const int *fds, int num_fds)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    char control_buf[CMSG_SPACE(sizeof(int) * SHM_RING_FD_COUNT)];
+    BOOLEAN result = TRUE;
+
+    BTIF_TRACE_DEBUG("UIPC_SendFds : ch_id:%d %d bytes %d fds", ch_id, msglen, num_fds);
+
+    if (ch_id >= UIPC_CH_NUM || num_fds <= 0 ||
+        (size_t)num_fds * sizeof(int) > sizeof(control_buf) - CMSG_SPACE(0))
+        return FALSE;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control_buf, 0, sizeof(control_buf));
+    iov.iov_base = p_buf;
+    iov.iov_len = msglen;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control_buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&msg);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+    memcpy(CMSG_DATA(header), fds, sizeof(int) * num_fds);
+
+    UIPC_LOCK();
+
+    ssize_t ret;
+    OSI_NO_INTR(ret = sendmsg(uipc_main.ch[ch_id].fd, &msg, MSG_NOSIGNAL));
+    if (ret < 0) {
+        BTIF_TRACE_ERROR("failed to send fds (%s)", strerror(errno));
+        result = FALSE;
+    }
+
+    UIPC_UNLOCK();
+
+    return result;
+}
+
+/*******************************************************************************
+ **
+ ** Function         uipc_update_read_stats
+ **
+ ** Description      Timestamps a completed read on a channel. Only the reader
+ **                  of a channel updates its statistics, so this is done
+ **                  without the UIPC lock to keep it off the audio path.
+ **
+ ** Returns          void
+ **
+ *******************************************************************************/
+static void uipc_update_read_stats(tUIPC_CH_ID ch_id, UINT32 len, UINT32 n_read,
+                                   UINT64 wait_us)
+{
+    tUIPC_READ_STATS *stats = &uipc_main.ch[ch_id].stats;
+    UINT64 now_us = uipc_time_now_us();
+
+    if (stats->last_read_us != 0 && now_us - stats->last_read_us > stats->max_read_gap_us)
+        stats->max_read_gap_us = now_us - stats->last_read_us;
+
+    stats->read_count++;
+    if (n_read < len)
+        stats->short_read_count++;
+    stats->total_bytes += n_read;
+    stats->total_wait_us += wait_us;
+    stats->last_read_us = now_us;
+}
+
+/*******************************************************************************
+ **
+ ** Function         uipc_read_ring
+ **
+ ** Description      Reads from the shared memory ring attached to a channel.
+ **                  Mirrors the socket path: waits up to the channel poll
+ **                  timeout for the remaining bytes and reports a detached
+ **                  peer by closing the channel. Called with UIPC lock held.
+ **                  The lock is dropped while waiting so that other channels
+ **                  and senders are not held up; the ring is marked as in
+ **                  wait meanwhile so that releasing it is left to the reader.
+ **
+ ** Returns          return the number of bytes read.
+ **
+ *******************************************************************************/
+static UINT32 uipc_read_ring(tUIPC_CH_ID ch_id, UINT8 *p_buf, UINT32 len)
+{
+    shm_ring_t *ring = uipc_main.ch[ch_id].ring;
+    size_t n_read = shm_ring_read(ring, p_buf, len);
+    UINT64 wait_us = 0;
+
+    if (n_read < len && uipc_main.ch[ch_id].read_poll_tmo_ms > 0 &&
+        !shm_ring_is_closed(ring))
+    {
+        int tmo_ms = uipc_main.ch[ch_id].read_poll_tmo_ms;
+        BOOLEAN ready;
+        UINT64 wait_start_us = uipc_time_now_us();
+
+        uipc_main.ch[ch_id].ring_in_wait = ring;
+        UIPC_UNLOCK();
+        ready = shm_ring_wait_readable(ring, len - n_read, tmo_ms);
+        UIPC_LOCK();
+        uipc_main.ch[ch_id].ring_in_wait = NULL;
+        wait_us = uipc_time_now_us() - wait_start_us;
+
+        if (uipc_main.ch[ch_id].ring_in_wait_released)
+        {
+            /* the channel closed or got a new ring while waiting */
+            uipc_main.ch[ch_id].ring_in_wait_released = FALSE;
+            shm_ring_free(ring);
+            uipc_update_read_stats(ch_id, len, n_read, wait_us);
+            return n_read;
+        }
+
+        if (!ready)
+            BTIF_TRACE_WARNING("ring wait timeout (%d ms)", tmo_ms);
+        n_read += shm_ring_read(ring, p_buf + n_read, len - n_read);
+    }
+
+    if (n_read == 0 && shm_ring_is_closed(ring))
+    {
+        BTIF_TRACE_WARNING("UIPC_Read : ring detached remotely");
+        uipc_close_locked(ch_id);
+    }
+
+    uipc_update_read_stats(ch_id, len, n_read, wait_us);
+    return n_read;
+}
+
 /*******************************************************************************
  **
  ** Function         UIPC_Read
  **
- ** Description      Called to read a message from UIPC.
+ ** Description      Called to read a message from UIPC. Takes whatever is
+ **                  already queued without blocking and only waits, up to the
+ **                  channel poll timeout, for the part that is still missing.
  **
  ** Returns          return the number of bytes read.
  **
@@ -722,8 +844,9 @@ BOOLEAN UIPC_Send(tUIPC_CH_ID ch_id, UINT16 msg_evt, UINT8 *p_buf,
 UINT32 UIPC_Read(tUIPC_CH_ID ch_id, UINT16 *p_msg_evt, UINT8 *p_buf, UINT32 len)
 {
     int n_read = 0;
-    int fd = uipc_main.ch[ch_id].fd;
+    int fd;
     struct pollfd pfd;
+    UINT64 wait_us = 0;
     UNUSED(p_msg_evt);
 
     if (ch_id >= UIPC_CH_NUM)
@@ -732,6 +855,17 @@ UINT32 UIPC_Read(tUIPC_CH_ID ch_id, UINT16 *p_msg_evt, UINT8 *p_buf, UINT32 len)
         return 0;
     }
 
+    if (uipc_main.ch[ch_id].ring)
+    {
+        UINT32 n_ring;
+        UIPC_LOCK();
+        n_ring = uipc_main.ch[ch_id].ring ?
+                 uipc_read_ring(ch_id, p_buf, len) : 0;
+        UIPC_UNLOCK();
+        return n_ring;
+    }
+
+    fd = uipc_main.ch[ch_id].fd;
     if (fd == UIPC_DISCONNECTED)
     {
         BTIF_TRACE_ERROR("UIPC_Read : channel %d closed", ch_id);
@@ -743,15 +877,41 @@ UINT32 UIPC_Read(tUIPC_CH_ID ch_id, UINT16 *p_msg_evt, UINT8 *p_buf, UINT32 len)
 
     while (n_read < (int)len)
     {
+        ssize_t n;
+        OSI_NO_INTR(n = recv(fd, p_buf+n_read, len-n_read, MSG_DONTWAIT));
+
+        //BTIF_TRACE_EVENT("read %d bytes", n);
+
+        if (n > 0)
+        {
+            n_read += n;
+            continue;
+        }
+
+        if (n == 0)
+        {
+            BTIF_TRACE_WARNING("UIPC_Read : channel detached remotely");
+            UIPC_LOCK();
+            uipc_close_locked(ch_id);
+            UIPC_UNLOCK();
+            return 0;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            BTIF_TRACE_WARNING("UIPC_Read : read failed (%s)", strerror(errno));
+            return 0;
+        }
+
+        /* nothing queued, wait for the rest no longer than the poll timeout */
         pfd.fd = fd;
         pfd.events = POLLIN|POLLHUP;
 
-        /* make sure there is data prior to attempting read to avoid blocking
-           a read for more than poll timeout */
-
+        UINT64 wait_start_us = uipc_time_now_us();
         int poll_ret;
         OSI_NO_INTR(poll_ret = poll(&pfd, 1,
                                     uipc_main.ch[ch_id].read_poll_tmo_ms));
+        wait_us += uipc_time_now_us() - wait_start_us;
         if (poll_ret == 0)
         {
             BTIF_TRACE_WARNING("poll timeout (%d ms)", uipc_main.ch[ch_id].read_poll_tmo_ms);
@@ -765,7 +925,7 @@ UINT32 UIPC_Read(tUIPC_CH_ID ch_id, UINT16 *p_msg_evt, UINT8 *p_buf, UINT32 len)
 
         //BTIF_TRACE_EVENT("poll revents %x", pfd.revents);
 
-        if (pfd.revents & (POLLHUP|POLLNVAL) )
+        if ((pfd.revents & (POLLHUP|POLLNVAL)) && !(pfd.revents & POLLIN))
         {
             BTIF_TRACE_WARNING("poll : channel detached remotely");
             UIPC_LOCK();
@@ -773,31 +933,9 @@ UINT32 UIPC_Read(tUIPC_CH_ID ch_id, UINT16 *p_msg_evt, UINT8 *p_buf, UINT32 len)
             UIPC_UNLOCK();
             return 0;
         }
-
-        ssize_t n;
-        OSI_NO_INTR(n = recv(fd, p_buf+n_read, len-n_read, 0));
-
-        //BTIF_TRACE_EVENT("read %d bytes", n);
-
-        if (n == 0)
-        {
-            BTIF_TRACE_WARNING("UIPC_Read : channel detached remotely");
-            UIPC_LOCK();
-            uipc_close_locked(ch_id);
-            UIPC_UNLOCK();
-            return 0;
-        }
-
-        if (n < 0)
-        {
-            BTIF_TRACE_WARNING("UIPC_Read : read failed (%s)", strerror(errno));
-            return 0;
-        }
-
-        n_read+=n;
-
     }
 
+    uipc_update_read_stats(ch_id, len, n_read, wait_us);
     return n_read;
 }
 
@@ -813,6 +951,8 @@ UINT32 UIPC_Read(tUIPC_CH_ID ch_id, UINT16 *p_msg_evt, UINT8 *p_buf, UINT32 len)
 
 extern BOOLEAN UIPC_Ioctl(tUIPC_CH_ID ch_id, UINT32 request, void *param)
 {
+    BOOLEAN result = FALSE;
+
     BTIF_TRACE_DEBUG("#### UIPC_Ioctl : ch_id %d, request %d ####", ch_id, request);
 
     UIPC_LOCK();
@@ -830,14 +970,15 @@ extern BOOLEAN UIPC_Ioctl(tUIPC_CH_ID ch_id, UINT32 request, void *param)
 
         case UIPC_REG_REMOVE_ACTIVE_READSET:
 
-            /* user will read data directly and not use select loop */
-            if (uipc_main.ch[ch_id].fd != UIPC_DISCONNECTED)
+            /* user will read data directly and not use the reactor; the
+               registration is owned by the uipc thread */
+            if (uipc_main.ch[ch_id].reactor)
             {
-                /* remove this channel from active set */
-                FD_CLR(uipc_main.ch[ch_id].fd, &uipc_main.active_set);
-
-                /* refresh active set */
-                uipc_wakeup_locked();
+                if (thread_is_self(uipc_main.thread))
+                    uipc_remove_read_locked(ch_id);
+                else
+                    thread_post(uipc_main.thread, uipc_remove_read,
+                                (void *)(intptr_t)ch_id);
             }
             break;
 
@@ -846,6 +987,26 @@ extern BOOLEAN UIPC_Ioctl(tUIPC_CH_ID ch_id, UINT32 request, void *param)
             BTIF_TRACE_EVENT("UIPC_SET_READ_POLL_TMO : CH %d, TMO %d ms", ch_id, uipc_main.ch[ch_id].read_poll_tmo_ms );
             break;
 
+        case UIPC_SET_SHM_RING:
+            /* the ring is owned by the channel from here on and released
+               when the channel closes */
+            uipc_release_ring_locked(ch_id);
+            if (param && uipc_main.ch[ch_id].srvfd == UIPC_DISCONNECTED)
+            {
+                BTIF_TRACE_WARNING("UIPC_SET_SHM_RING : CH %d not open", ch_id);
+                shm_ring_free((shm_ring_t *)param);
+                break;
+            }
+            uipc_main.ch[ch_id].ring = (shm_ring_t *)param;
+            BTIF_TRACE_EVENT("UIPC_SET_SHM_RING : CH %d, ring %p", ch_id, param);
+            result = (param != NULL);
+            break;
+
+        case UIPC_GET_READ_STATS:
+            memcpy(param, &uipc_main.ch[ch_id].stats, sizeof(tUIPC_READ_STATS));
+            result = TRUE;
+            break;
+
         default:
             BTIF_TRACE_EVENT("UIPC_Ioctl : request not handled (%d)", request);
             break;
@@ -853,6 +1014,6 @@ extern BOOLEAN UIPC_Ioctl(tUIPC_CH_ID ch_id, UINT32 request, void *param)
 
     UIPC_UNLOCK();
 
-    return FALSE;
+    return result;
 }
 
@@ -46,6 +46,7 @@
 #include "osi/include/log.h"
 #include "osi/include/properties.h"
 #include "osi/include/list.h"
+#include "osi/include/prefix_trie.h"
 #include <string.h>
 
 /*******************************************************************************
@@ -65,12 +66,6 @@ typedef struct {
     char dev_name[MAX_NAME_LEN];              // Name of blacklisted device
 } iot_devlist_name_node_t;
 
-typedef struct {
-    char *header;                   // header name
-    unsigned char *dev_details;              // details of blacklisted device
-    bool device_found;
-} iot_input_param;
-
 typedef struct {
     bt_soc_type soc_type;
     char* soc_name;
@@ -85,6 +80,10 @@ static soc_type_node soc_type_entries[] = {
                                        };
 
 static list_t *iot_header_queue = NULL;
+/* All blacklisted devices keyed by "<header>\0<device>", rebuilt from
+ * iot_header_queue on the first lookup after the lists changed. */
+static prefix_trie_t *iot_trie = NULL;
+static bool iot_trie_stale = true;
 #define MAX_LINE 2048
 #define MAX_ADDR_STR_LEN 9
 static pthread_mutex_t         iot_mutex_lock;
@@ -100,6 +99,7 @@ static bt_soc_type soc_type;
 #define INVALID_TASK_ID  (-1)
 
 static void init_soc_type();
+static iot_header_node_t *get_existing_header_node(char* name, unsigned int len);
 
 static future_t *init(void) {
   int i;
@@ -233,78 +233,65 @@ void adjust_priority_a2dp(int start) {
 
 /*****************************************************************************
 **
-** Function        check_bd_cb
+** Function        make_iot_key
 **
-** Description     Compares the BD address.
+** Description     Builds the trie key of a device under a header, which is
+**                 the header name, a NUL and then the 3 byte address prefix
+**                 or the device name.
 **
-** Returns         returns true if the BD address matches otherwise false
+** Returns         length of the key.
 **
 *******************************************************************************/
-static bool check_bd_cb(void* node, void* cb_data)
+static size_t make_iot_key(uint8_t *key, const char *header, const unsigned char *device_details,
+        tBLACKLIST_METHOD method_type)
 {
-    iot_devlist_bd_node_t *bd_node = (iot_devlist_bd_node_t*)node;
-    iot_input_param *input_param = (iot_input_param*)cb_data;
-
-    if (input_param->device_found == true)
-        return true;
-
-    if ((bd_node->dev_bd[0] == input_param->dev_details[0]) &&
-        (bd_node->dev_bd[1] == input_param->dev_details[1]) &&
-        (bd_node->dev_bd[2] == input_param->dev_details[2])) {
-        input_param->device_found = true;
-        return true;
-    }
-    return false;
+    size_t header_len = strlen(header);
+    size_t dev_len = (method_type == METHOD_BD) ? 3 :
+                        strnlen((const char *)device_details, MAX_NAME_LEN - 1);
+
+    memcpy(key, header, header_len);
+    key[header_len] = '\0';
+    memcpy(key + header_len + 1, device_details, dev_len);
+    return header_len + 1 + dev_len;
 }
 
 /*****************************************************************************
 **
-** Function        check_name_cb
+** Function        build_iot_trie
 **
-** Description     Compares the Device name.
+** Description     Rebuilds the lookup trie from the header and device lists.
+**                 Must be called with iot_mutex_lock held.
 **
-** Returns         returns true if the name matches otherwise false
+** Returns         void.
 **
 *******************************************************************************/
-static bool check_name_cb(void* node, void* cb_data)
+static void build_iot_trie(void)
 {
-    iot_devlist_name_node_t *name_node = (iot_devlist_name_node_t*)node;
-    iot_input_param *input_param = (iot_input_param*)cb_data;
+    uint8_t key[2 * MAX_NAME_LEN];
 
-    if (input_param->device_found == true)
-        return true;
+    if (iot_trie == NULL)
+        iot_trie = prefix_trie_new();
+    else
+        prefix_trie_clear(iot_trie);
 
-    if (!strncmp(name_node->dev_name, (const char*)input_param->dev_details,
-                                                strlen((char *)input_param->dev_details))) {
-        input_param->device_found = true;
-        return true;
-    }
-    return false;
-}
+    for (const list_node_t *header_node = list_begin(iot_header_queue);
+           header_node != list_end(iot_header_queue);
+           header_node = list_next(header_node)) {
+        iot_header_node_t *header_entry = list_node(header_node);
 
-/*****************************************************************************
-**
-** Function        check_header_cb
-**
-** Description     Iterates through the each entry in the header list and
-**                 calls the callback associated to each entry.
-**
-** Returns         boolean
-**
-*******************************************************************************/
-static bool check_header_cb(void* node, void* cb_data)
-{
-    iot_header_node_t *header_node = (iot_header_node_t*)node;
-    iot_input_param *input_param = (iot_input_param*)cb_data;
-    if (!strcmp(header_node->header_name, input_param->header)) {
-        if(header_node->devlist) {
-            if (header_node->method_type == METHOD_BD)
-                list_foreach_ext(header_node->devlist, check_bd_cb, cb_data);
-            else if (header_node->method_type == METHOD_NAME)
-                list_foreach_ext(header_node->devlist, check_name_cb, cb_data);
+        if(!header_entry->devlist)
+            continue;
+
+        for (const list_node_t *device_node = list_begin(header_entry->devlist);
+                device_node != list_end(header_entry->devlist);
+                device_node = list_next(device_node)) {
+            /* both node types start with the address or name */
+            size_t len = make_iot_key(key, header_entry->header_name, list_node(device_node),
+                                        header_entry->method_type);
+            prefix_trie_add(iot_trie, key, len, 1);
         }
     }
-    return true;
+    iot_trie_stale = false;
 }
 
 /*****************************************************************************
@@ -313,30 +300,52 @@ static bool check_header_cb(void* node, void* cb_data)
 **
 ** Description     Checks if the device is already present in the blacklisted
 **                 device list or not.The input can be address based or name
-**                 based.
+**                 based. Address entries match on the first 3 bytes, name
+**                 entries match if device_details is a prefix of the name.
 **
 ** Returns         true incase device is present false otherwise.
 **
 *******************************************************************************/
 bool is_device_present(char* header, unsigned char* device_details)
 {
-    iot_input_param input_param;
-    input_param.dev_details = device_details;
-    input_param.header = header;
-    input_param.device_found = false;
+    uint8_t key[2 * MAX_NAME_LEN];
+    iot_header_node_t *header_entry;
+    size_t len;
+    bool device_found;
+
+    if (strlen(header) >= MAX_NAME_LEN)
+        return false;
 
     pthread_mutex_lock(&iot_mutex_lock);
     if (!iot_header_queue) {
         pthread_mutex_unlock(&iot_mutex_lock);
         return false;
     }
-    list_foreach_ext(iot_header_queue, check_header_cb, &input_param);
-    pthread_mutex_unlock(&iot_mutex_lock);
 
-    if (input_param.device_found)
-        return true;
-    else
+    header_entry = get_existing_header_node(header, strlen(header) + 1);
+    if (!header_entry) {
+        pthread_mutex_unlock(&iot_mutex_lock);
+        return false;
+    }
+
+    if ((header_entry->method_type == METHOD_NAME) &&
+        (strlen((const char *)device_details) >= MAX_NAME_LEN)) {
+        /* longer than any stored name */
+        pthread_mutex_unlock(&iot_mutex_lock);
         return false;
+    }
+
+    if (iot_trie_stale)
+        build_iot_trie();
+
+    len = make_iot_key(key, header, device_details, header_entry->method_type);
+    if (header_entry->method_type == METHOD_BD)
+        device_found = prefix_trie_match_prefixes(iot_trie, key, len) != 0;
+    else
+        device_found = prefix_trie_match_extensions(iot_trie, key, len) != 0;
+    pthread_mutex_unlock(&iot_mutex_lock);
+
+    return device_found;
 }
 
 /*****************************************************************************
@@ -558,6 +567,7 @@ static void populate_header(char* line_start, char *header_end)
     }
     if(node)
         populate_list(header_end, node);
+    iot_trie_stale = true;
 }
 
 /*****************************************************************************
@@ -597,6 +607,9 @@ void unload_iot_devlist()
     list_foreach(iot_header_queue, free_header_list, NULL);
     list_free(iot_header_queue);
     iot_header_queue = NULL;
+    prefix_trie_free(iot_trie);
+    iot_trie = NULL;
+    iot_trie_stale = true;
     pthread_mutex_unlock(&iot_mutex_lock);
 }
 
@@ -892,6 +905,7 @@ bool remove_iot_device_from_queue(unsigned char* device_details, char* header,
                     iot_devlist_bd_node_t *bd_addr_entry = list_node(device_node);
                     if(!memcmp(device_details, bd_addr_entry->dev_bd, 3)) {
                         list_remove(header_entry->devlist, bd_addr_entry);
+                        iot_trie_stale = true;
                         return true;
                     }
                 }
@@ -899,6 +913,7 @@ bool remove_iot_device_from_queue(unsigned char* device_details, char* header,
                     iot_devlist_name_node_t *bd_name_entry = list_node(device_node);
                     if(!strcmp((char *)device_details, bd_name_entry->dev_name)) {
                         list_remove(header_entry->devlist, bd_name_entry);
+                        iot_trie_stale = true;
                         return true;
                     }
                 }